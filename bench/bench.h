@@ -0,0 +1,40 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @brief Sink for benchmark results so the compiler cannot drop the measured work.
+ */
+static volatile uintptr_t bench_sink;
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ *
+ * @return uint64_t Current time in nanoseconds.
+ */
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Prints one benchmark result as "<name>: <ns> ns/op (<ops> ops)".
+ *
+ * @param name Benchmark case name.
+ * @param elapsed_ns Total time spent in the measured loop.
+ * @param ops Number of operations performed in the measured loop.
+ */
+static inline void bench_report(const char* name, uint64_t elapsed_ns, uint64_t ops)
+{
+    uint64_t centi_ns = (ops != 0) ? (elapsed_ns * 100ULL) / ops : 0;
+    printf("%s: %llu.%02llu ns/op (%llu ops)\n", name,
+        (unsigned long long)(centi_ns / 100), (unsigned long long)(centi_ns % 100),
+        (unsigned long long)ops);
+}
+
+#endif // BENCH_H
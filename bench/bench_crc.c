@@ -0,0 +1,96 @@
+#include "bench.h"
+#include "crc.h"
+#include "crc_tables.h"
+#include <string.h>
+
+/*
+ * CRC-32 throughput on the host, in MB/s, for an Ethernet-sized frame, a
+ * 64 KiB flash sector and a short message, each from a word-aligned start
+ * and one byte past it with a tail of three bytes. Slicing-by-8 is
+ * compared with one table lookup per byte and with the bit-at-a-time loop,
+ * both over the same tables' definition of the CRC. Host ns/op is per
+ * buffer.
+ *
+ * The unit on target takes a word every four AHB cycles, 168 MB/s at
+ * 168 MHz, whether the CPU or DMA feeds it; the model of it here only
+ * checks results, so it is not timed.
+ */
+
+#define MAX_BYTES (65536U + 4U)
+#define TOTAL_BYTES (64U * 1024U * 1024U)
+
+static uint8_t data[MAX_BYTES] __attribute__((aligned(8)));
+
+static uint32_t bytewise(uint32_t crc, const uint8_t* p, size_t length)
+{
+    uint8_t word[4];
+    for (size_t i = 0; i < length; i += 4, p += 4) {
+        size_t n = (length - i < 4U) ? length - i : 4U;
+        memset(word, 0, sizeof(word));
+        memcpy(word, p, n);
+        for (int32_t b = 3; b >= 0; b--) {
+            crc = (crc << 8) ^ crc32_table[0][(crc >> 24) ^ word[b]];
+        }
+    }
+    return crc;
+}
+
+static uint32_t bitwise(uint32_t crc, const uint8_t* p, size_t length)
+{
+    for (size_t i = 0; i < length; i += 4, p += 4) {
+        uint32_t word = 0;
+        memcpy(&word, p, (length - i < 4U) ? length - i : 4U);
+        crc ^= word;
+        for (uint32_t bit = 0; bit < 32U; bit++) {
+            crc = (crc & 0x80000000U) ? (crc << 1) ^ CRC_TABLE_POLY : crc << 1;
+        }
+    }
+    return crc;
+}
+
+typedef uint32_t (*crc_fn_t)(uint32_t crc, const uint8_t* p, size_t length);
+
+static uint32_t sliced(uint32_t crc, const uint8_t* p, size_t length)
+{
+    return crc32_sw_update(crc, p, length);
+}
+
+static void measure(const char* method, crc_fn_t fn, uint32_t length, uint32_t offset, uint32_t share)
+{
+    char name[64];
+    uint32_t rounds = TOTAL_BYTES / share / length + 1U;
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < rounds; round++) {
+        bench_sink += fn(CRC32_INIT, data + offset, length);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    snprintf(name, sizeof(name), "crc32_%s_%u_bytes_%s", method, (unsigned)length,
+             offset ? "unaligned" : "aligned");
+    bench_report(name, elapsed, rounds);
+    printf("  %.1f MB/s\n", (double)length * rounds / ((double)elapsed / 1e9) / 1e6);
+}
+
+int main(void)
+{
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < MAX_BYTES; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        data[i] = (uint8_t)(seed >> 24);
+    }
+
+    /* The baselines have to compute the same CRC to be worth comparing */
+    if (bytewise(CRC32_INIT, data + 1, 1519) != crc32_sw_update(CRC32_INIT, data + 1, 1519) ||
+        bitwise(CRC32_INIT, data + 1, 1519) != crc32_sw_update(CRC32_INIT, data + 1, 1519)) {
+        return 1;
+    }
+
+    static const uint32_t lengths[] = { 64, 1518, 65536 + 3 };
+    for (uint32_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (uint32_t offset = 0; offset < 2U; offset++) {
+            measure("slicing_by_8", sliced, lengths[l], offset, 1);
+            measure("bytewise", bytewise, lengths[l], offset, 4);
+            measure("bitwise", bitwise, lengths[l], offset, 32);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "bench.h"
+#include "cryp.h"
+#include "hash.h"
+#include <string.h>
+
+/*
+ * Software AES-CBC/CTR/GCM, SHA-1, SHA-256 and HMAC-SHA256 throughput on
+ * the host, in MB/s, for an Ethernet-sized record and a 16 KiB one (a TLS
+ * record's worth). These are the costs the CRYP and HASH cores take off
+ * the CPU. Host ns/op is per record.
+ *
+ * The cores' own rates do not depend on the CPU: by the reference manual
+ * the CRYP core takes 14 cycles a block for AES-128 (18 for 256) and the
+ * HASH core 66 cycles a block for SHA-1 (50 for SHA-256), so at 168 MHz
+ * about 190, 150, 160 and 215 MB/s, with DMA leaving the CPU the set-up.
+ * The models of the cores here only check results, so they are not timed;
+ * each driver makes one pass through its DMA path, checked against the
+ * software before anything is timed.
+ */
+
+#define MAX_BYTES 16384U
+#define TOTAL_BYTES (32U * 1024U * 1024U)
+
+static uint8_t data[MAX_BYTES] __attribute__((aligned(4)));
+static uint8_t out[MAX_BYTES] __attribute__((aligned(4)));
+static const uint8_t key[32] = { 0x60, 0x3D, 0xEB, 0x10, 0x15, 0xCA, 0x71, 0xBE, 0x2B, 0x73, 0xAE,
+                                 0xF0, 0x85, 0x7D, 0x77, 0x81, 0x1F, 0x35, 0x2C, 0x07, 0x3B, 0x61,
+                                 0x08, 0xD7, 0x2D, 0x98, 0x10, 0xA3, 0x09, 0x14, 0xDF, 0xF4 };
+static aes_key_t aes;
+
+typedef void (*crypto_fn_t)(uint32_t length);
+
+static void cbc(uint32_t length)
+{
+    uint8_t iv[AES_BLOCK_SIZE] = { 0 };
+    aes_cbc_encrypt(&aes, iv, data, out, length);
+}
+
+static void cbc_decrypt(uint32_t length)
+{
+    uint8_t iv[AES_BLOCK_SIZE] = { 0 };
+    aes_cbc_decrypt(&aes, iv, data, out, length);
+}
+
+static void ctr(uint32_t length)
+{
+    uint8_t counter[AES_BLOCK_SIZE] = { 0 };
+    aes_ctr(&aes, counter, data, out, length);
+}
+
+static void gcm(uint32_t length)
+{
+    static const uint8_t iv[AES_GCM_IV_SIZE] = { 1 };
+    uint8_t tag[AES_GCM_TAG_SIZE];
+    aes_gcm_encrypt(&aes, iv, data, 13, data, out, length, tag);
+    bench_sink += tag[0];
+}
+
+static void sha1(uint32_t length)
+{
+    uint8_t digest[SHA1_DIGEST_SIZE];
+    sha_digest(SHA_1, data, length, digest);
+    bench_sink += digest[0];
+}
+
+static void sha256(uint32_t length)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha_digest(SHA_256, data, length, digest);
+    bench_sink += digest[0];
+}
+
+static void hmac_sha256(uint32_t length)
+{
+    uint8_t mac[SHA256_DIGEST_SIZE];
+    hmac(SHA_256, key, 32, data, length, mac);
+    bench_sink += mac[0];
+}
+
+static void measure(const char* method, crypto_fn_t fn, uint32_t length)
+{
+    char name[64];
+    uint32_t rounds = TOTAL_BYTES / length + 1U;
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < rounds; round++) {
+        fn(length);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_sink += out[0];
+    snprintf(name, sizeof(name), "%s_%u_bytes", method, (unsigned)length);
+    bench_report(name, elapsed, rounds);
+    printf("  %.1f MB/s\n", (double)length * rounds / ((double)elapsed / 1e9) / 1e6);
+}
+
+static void on_job(status_t status, void* context)
+{
+    *(status_t*)context = status;
+}
+
+static void on_hash(uint8_t* digest, void* context)
+{
+    (void)digest;
+    *(status_t*)context = SUCCESS;
+}
+
+int main(void)
+{
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < MAX_BYTES; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        data[i] = (uint8_t)(seed >> 24);
+    }
+    aes_set_key(&aes, key, 16);
+    if (cryp_init() != SUCCESS || hash_init() != SUCCESS) {
+        return 1;
+    }
+
+    /* The drivers' DMA paths have to agree with what is timed */
+    uint8_t iv[AES_BLOCK_SIZE] = { 0 };
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint8_t answer[SHA256_DIGEST_SIZE];
+    status_t status = FAILURE;
+    cryp_job_t job = { CRYP_CTR, 0, key, 16, iv, NULL, 0, data, out, MAX_BYTES, NULL };
+    if (cryp_start(&job, on_job, &status) != SUCCESS || status != SUCCESS) {
+        return 1;
+    }
+    memcpy(answer, out, sizeof(answer));
+    ctr(MAX_BYTES);
+    status = FAILURE;
+    if (memcmp(answer, out, sizeof(answer)) != 0 ||
+        hash_start(SHA_256, key, 32, data, MAX_BYTES, digest, on_hash, &status) != SUCCESS || status != SUCCESS) {
+        return 1;
+    }
+    hmac(SHA_256, key, 32, data, MAX_BYTES, answer);
+    if (memcmp(answer, digest, sizeof(answer)) != 0) {
+        return 1;
+    }
+
+    static const uint32_t lengths[] = { 1504, MAX_BYTES };
+    for (uint32_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (uint32_t bits = 128; bits <= 256U; bits += 128U) {
+            char name[32];
+            aes_set_key(&aes, key, bits / 8U);
+            snprintf(name, sizeof(name), "aes%u_cbc_encrypt", (unsigned)bits);
+            measure(name, cbc, lengths[l]);
+            snprintf(name, sizeof(name), "aes%u_cbc_decrypt", (unsigned)bits);
+            measure(name, cbc_decrypt, lengths[l]);
+            snprintf(name, sizeof(name), "aes%u_ctr", (unsigned)bits);
+            measure(name, ctr, lengths[l]);
+            snprintf(name, sizeof(name), "aes%u_gcm", (unsigned)bits);
+            measure(name, gcm, lengths[l]);
+        }
+        measure("sha1", sha1, lengths[l]);
+        measure("sha256", sha256, lengths[l]);
+        measure("hmac_sha256", hmac_sha256, lengths[l]);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "bench.h"
+#include "dcmi.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Sustained capture of QVGA RGB565 through the DCMI pipeline against the
+ * host sensor model: 16-line blocks of 10 KiB, a 12 MHz pixel clock with 144
+ * clocks of horizontal and 20 lines of vertical blanking, about 59 frames a
+ * second. The consumer takes the blocks in order and spends a fixed time
+ * of modelled time on each (an encoder, or a link to send them over); it
+ * releases a block once that time has passed, checked after every line.
+ * Each case reports the frames handed off whole per second of modelled
+ * time, the frames dropped and the most blocks the pool had out at once,
+ * for pools of 3 to 8 blocks and consumers faster and slower than the
+ * sensor; the slow one once more capturing every other frame, as it has to
+ * keep up at all. Host ns/op is the driver and the model per frame.
+ *
+ * The frames replayed are raw 320x240 RGB565 images read back to back from
+ * the file given as the argument, or a synthetic sequence without one.
+ */
+
+#define WIDTH 320U
+#define HEIGHT 240U
+#define LINE_BYTES (WIDTH * 2U)
+#define FRAME_BYTES (LINE_BYTES * HEIGHT)
+#define LINES_PER_BLOCK 16U
+#define BLOCK_BYTES (LINE_BYTES * LINES_PER_BLOCK)
+#define MAX_POOL 8U
+#define MAX_IMAGES 8U
+#define FRAMES 120U
+#define PIXEL_CLOCK_HZ 12000000U
+#define HBLANK 144U
+#define VBLANK 20U
+
+static MSG_POOL_STORAGE(storage, BLOCK_BYTES, MAX_POOL);
+static msg_pool_t pool;
+static dcmi_t dcmi;
+static uint8_t* images[MAX_IMAGES];
+static uint32_t image_count;
+
+/* Blocks the consumer holds, oldest first, with the modelled time it is done with each */
+static msg_t* held[MAX_POOL];
+static uint32_t done_us[MAX_POOL];
+static uint32_t held_first;
+static uint32_t held_count;
+static uint32_t busy_until_us;
+static uint32_t cost_us;
+
+static void release_done(void* context)
+{
+    (void)context;
+    uint32_t now = dcmi_sim_time_us();
+    while (held_count > 0U && (int32_t)(now - done_us[held_first]) >= 0) {
+        msg_free(held[held_first]);
+        held_first = (held_first + 1U) % MAX_POOL;
+        held_count--;
+    }
+}
+
+static void on_lines(msg_t* block, const dcmi_lines_t* lines, void* context)
+{
+    (void)lines;
+    (void)context;
+    uint32_t now = dcmi_sim_time_us();
+    uint32_t start = ((int32_t)(busy_until_us - now) > 0) ? busy_until_us : now;
+    busy_until_us = start + cost_us;
+    uint32_t slot = (held_first + held_count) % MAX_POOL;
+    held[slot] = block;
+    done_us[slot] = busy_until_us;
+    held_count++;
+    bench_sink += msg_payload(block) != NULL;
+}
+
+static int measure(uint32_t blocks, uint32_t block_cost_us, uint8_t frame_skip)
+{
+    char name[64];
+    msg_pool_init(&pool, storage, BLOCK_BYTES, blocks);
+    held_first = 0;
+    held_count = 0;
+    cost_us = block_cost_us;
+
+    dcmi_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.width = WIDTH;
+    config.height = HEIGHT;
+    config.bytes_per_pixel = 2;
+    config.lines_per_block = LINES_PER_BLOCK;
+    config.frame_skip = frame_skip;
+    config.sync = DCMI_CR_PCKPOL | DCMI_CR_VSPOL;
+    config.pool = &pool;
+    config.on_lines = on_lines;
+    config.clock = dcmi_sim_time_us;
+    if (dcmi_init(&dcmi, &config) != SUCCESS || dcmi_start(&dcmi) != SUCCESS) {
+        return 1;
+    }
+    busy_until_us = dcmi_sim_time_us();
+
+    uint64_t sim_start = dcmi_sim_time_ns();
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        dcmi_sim_frame(images[i % image_count], LINE_BYTES, HEIGHT);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    double seconds = (double)(dcmi_sim_time_ns() - sim_start) / 1e9;
+
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    snprintf(name, sizeof(name), "dcmi_qvga_%u_blocks_%u_us_per_block%s", (unsigned)blocks, (unsigned)block_cost_us,
+             frame_skip ? "_skip_1" : "");
+    bench_report(name, elapsed, FRAMES);
+    printf("  %.1f fps of %.1f, %u frames dropped, pool peak %u of %u\n", stats->frames / seconds, FRAMES / seconds,
+           (unsigned)stats->dropped_frames, (unsigned)pool.peak, (unsigned)blocks);
+
+    dcmi_deinit(&dcmi);
+    while (held_count > 0U) {
+        msg_free(held[held_first]);
+        held_first = (held_first + 1U) % MAX_POOL;
+        held_count--;
+    }
+    return 0;
+}
+
+static int load(const char* path)
+{
+    FILE* file = (path != NULL) ? fopen(path, "rb") : NULL;
+    if (path != NULL && file == NULL) {
+        return 1;
+    }
+    for (image_count = 0; image_count < MAX_IMAGES; image_count++) {
+        uint8_t* image = malloc(FRAME_BYTES);
+        if (image == NULL) {
+            return 1;
+        }
+        if (file != NULL) {
+            if (fread(image, 1, FRAME_BYTES, file) != FRAME_BYTES) {
+                free(image);
+                break;
+            }
+        } else {
+            /* A gradient that moves from frame to frame */
+            for (uint32_t i = 0; i < FRAME_BYTES; i++) {
+                image[i] = (uint8_t)(i / LINE_BYTES + i % LINE_BYTES + image_count * 8U);
+            }
+        }
+        images[image_count] = image;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    return image_count == 0U;
+}
+
+int main(int argc, char** argv)
+{
+    if (load((argc > 1) ? argv[1] : NULL) != 0) {
+        return 1;
+    }
+    dcmi_sim_timing(PIXEL_CLOCK_HZ, HBLANK, VBLANK);
+    dcmi_sim_line_hook(release_done, NULL);
+
+    static const uint32_t pools[] = { 3, 4, 6, 8 };
+    static const struct {
+        uint32_t cost_us;
+        uint8_t frame_skip;
+    } consumers[] = { { 500, 0 }, { 1100, 0 }, { 1500, 0 }, { 1500, 1 } };
+    int failed = 0;
+    for (uint32_t c = 0; c < sizeof(consumers) / sizeof(consumers[0]); c++) {
+        for (uint32_t p = 0; p < sizeof(pools) / sizeof(pools[0]); p++) {
+            failed |= measure(pools[p], consumers[c].cost_us, consumers[c].frame_skip);
+        }
+    }
+
+    for (uint32_t i = 0; i < image_count; i++) {
+        free(images[i]);
+    }
+    return failed;
+}
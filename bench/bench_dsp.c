@@ -0,0 +1,103 @@
+#include "bench.h"
+#include "dsp.h"
+
+/*
+ * Per-sample cost of the DSP kernels on blocks of BLOCK samples, each
+ * reported as ns per output sample (per tap-sample for the dot products).
+ */
+
+#define BLOCK 256U
+#define FIR_TAPS 32U
+#define BIQUAD_STAGES 4U
+#define ROUNDS 2000U
+
+static q15_t in15[BLOCK], out15[BLOCK], other15[BLOCK];
+static q31_t in31[BLOCK], out31[BLOCK], other31[BLOCK];
+static float32_t inf[BLOCK], outf[BLOCK], otherf[BLOCK];
+
+static q15_t fir_c15[FIR_TAPS];
+static q31_t fir_c31[FIR_TAPS];
+static float32_t fir_cf[FIR_TAPS];
+static q15_t fir_s15[DSP_FIR_STATE_LENGTH(FIR_TAPS, BLOCK)];
+static q31_t fir_s31[DSP_FIR_STATE_LENGTH(FIR_TAPS, BLOCK)];
+static float32_t fir_sf[DSP_FIR_STATE_LENGTH(FIR_TAPS, BLOCK)];
+
+static const float32_t section[5] = { 0.0675f, 0.1349f, 0.0675f, 1.1430f, -0.4128f };
+static q15_t bq_c15[BIQUAD_STAGES * 5];
+static q31_t bq_c31[BIQUAD_STAGES * 5];
+static float32_t bq_cf[BIQUAD_STAGES * 5];
+static q15_t bq_s15[BIQUAD_STAGES * 4];
+static q31_t bq_s31[BIQUAD_STAGES * 4];
+static float32_t bq_sf[BIQUAD_STAGES * 2];
+
+static void prepare(void)
+{
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < BLOCK; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        in15[i] = (q15_t)(seed >> 17);
+        other15[i] = (q15_t)(seed >> 18);
+        in31[i] = (q31_t)(seed >> 2);
+        other31[i] = (q31_t)(seed >> 3);
+        inf[i] = (float32_t)in15[i] / 32768.0f;
+        otherf[i] = (float32_t)other15[i] / 32768.0f;
+    }
+    for (uint32_t i = 0; i < FIR_TAPS; i++) {
+        fir_c15[i] = (q15_t)(32768 / FIR_TAPS);
+        fir_c31[i] = (q31_t)(2147483647 / FIR_TAPS);
+        fir_cf[i] = 1.0f / FIR_TAPS;
+    }
+    for (uint32_t s = 0; s < BIQUAD_STAGES; s++) {
+        for (uint32_t k = 0; k < 5; k++) {
+            bq_c15[s * 5U + k] = (q15_t)(section[k] * 16384.0f);
+            bq_c31[s * 5U + k] = (q31_t)(section[k] * 1073741824.0f);
+            bq_cf[s * 5U + k] = section[k];
+        }
+    }
+}
+
+#define MEASURE(name, ops_per_round, statement)                                                                      \
+    do {                                                                                                             \
+        uint64_t start = bench_now_ns();                                                                             \
+        for (uint32_t round = 0; round < ROUNDS; round++) {                                                          \
+            statement;                                                                                               \
+        }                                                                                                            \
+        bench_report(name, bench_now_ns() - start, (uint64_t)ROUNDS * (ops_per_round));                              \
+    } while (0)
+
+int main(void)
+{
+    dsp_fir_q15_t fir15;
+    dsp_fir_q31_t fir31;
+    dsp_fir_f32_t firf;
+    dsp_biquad_q15_t bq15;
+    dsp_biquad_q31_t bq31;
+    dsp_biquad_f32_t bqf;
+
+    prepare();
+    dsp_fir_init_q15(&fir15, fir_c15, FIR_TAPS, fir_s15, BLOCK);
+    dsp_fir_init_q31(&fir31, fir_c31, FIR_TAPS, fir_s31, BLOCK);
+    dsp_fir_init_f32(&firf, fir_cf, FIR_TAPS, fir_sf, BLOCK);
+    dsp_biquad_init_q15(&bq15, BIQUAD_STAGES, bq_c15, bq_s15, 1);
+    dsp_biquad_init_q31(&bq31, BIQUAD_STAGES, bq_c31, bq_s31, 1);
+    dsp_biquad_init_f32(&bqf, BIQUAD_STAGES, bq_cf, bq_sf);
+
+    MEASURE("add_q15", BLOCK, dsp_add_q15(in15, other15, out15, BLOCK));
+    MEASURE("add_q31", BLOCK, dsp_add_q31(in31, other31, out31, BLOCK));
+    MEASURE("add_f32", BLOCK, dsp_add_f32(inf, otherf, outf, BLOCK));
+    MEASURE("scale_q15", BLOCK, dsp_scale_q15(in15, 23170, 0, out15, BLOCK));
+    MEASURE("scale_q31", BLOCK, dsp_scale_q31(in31, 1518500250, 0, out31, BLOCK));
+    MEASURE("scale_f32", BLOCK, dsp_scale_f32(inf, 0.7071f, outf, BLOCK));
+    MEASURE("dot_q15", BLOCK, bench_sink += (uintptr_t)dsp_dot_q15(in15, other15, BLOCK));
+    MEASURE("dot_q31", BLOCK, bench_sink += (uintptr_t)dsp_dot_q31(in31, other31, BLOCK));
+    MEASURE("dot_f32", BLOCK, bench_sink += (uintptr_t)dsp_dot_f32(inf, otherf, BLOCK));
+    MEASURE("fir_q15_32taps", BLOCK, dsp_fir_q15(&fir15, in15, out15, BLOCK));
+    MEASURE("fir_q31_32taps", BLOCK, dsp_fir_q31(&fir31, in31, out31, BLOCK));
+    MEASURE("fir_f32_32taps", BLOCK, dsp_fir_f32(&firf, inf, outf, BLOCK));
+    MEASURE("biquad_q15_4stages", BLOCK, dsp_biquad_q15(&bq15, in15, out15, BLOCK));
+    MEASURE("biquad_q31_4stages", BLOCK, dsp_biquad_q31(&bq31, in31, out31, BLOCK));
+    MEASURE("biquad_f32_4stages", BLOCK, dsp_biquad_f32(&bqf, inf, outf, BLOCK));
+
+    bench_sink += (uintptr_t)out15[BLOCK - 1U] + (uintptr_t)out31[BLOCK - 1U] + (uintptr_t)(outf[BLOCK - 1U] * 1000.0f);
+    return 0;
+}
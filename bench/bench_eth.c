@@ -0,0 +1,206 @@
+#include "bench.h"
+#include "eth.h"
+#include <string.h>
+
+/*
+ * Receive and transmit rates of the Ethernet driver against the host
+ * descriptor-ring model. Receive plays a pcap capture through the ring and
+ * has the consumer fetch and free every frame: by default a built-in
+ * simple-IMIX capture (seven 64-byte, four 594-byte and one 1518-byte
+ * frame, all UDP), or the capture file named on the command line. It runs
+ * once with an interrupt per frame and once with the receive watchdog
+ * coalescing each playback into one interrupt. Transmit sends the same mix
+ * as two-buffer chains (headers, then payload) with checksum insertion.
+ * The times include the model's copies and checksum work, so they bound the
+ * driver's own cost from above.
+ */
+
+#define BUFFER 1536U
+#define RX_BUFFERS (ETH_RX_RING_LENGTH + 8U)
+#define TX_BUFFERS (2U * ETH_TX_RING_LENGTH)
+#define ROUNDS 100000U
+#define MIX 12U
+
+static MSG_POOL_STORAGE(rx_storage, ETH_BUF_PAYLOAD(BUFFER), RX_BUFFERS);
+static MSG_POOL_STORAGE(tx_storage, ETH_BUF_PAYLOAD(BUFFER), TX_BUFFERS);
+static msg_pool_t rx_pool, tx_pool;
+static mailbox_t rx_output;
+static eth_t eth;
+
+static const uint8_t local_mac[6] = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+static const uint32_t mix[MIX] = { 64, 594, 64, 64, 1518, 594, 64, 64, 594, 64, 594, 64 };
+static uint8_t frames[MIX][ETH_FRAME_MAX];
+
+/* Two captures of six frames each, so a coalesced playback never overruns the ring */
+#define CAPTURES 2U
+#define CAPTURE_FRAMES (MIX / CAPTURES)
+static uint8_t captures[CAPTURES][24U + CAPTURE_FRAMES * (16U + ETH_FRAME_MAX)];
+static uint32_t capture_size[CAPTURES];
+
+static uint16_t checksum(const uint8_t* data, uint32_t length, uint32_t sum)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        sum += (i & 1U) ? data[i] : ((uint32_t)data[i] << 8);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFFU) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/* Ethernet, IPv4 and UDP headers with valid checksums; sizes include the FCS the MAC strips */
+static void build_frames(void)
+{
+    for (uint32_t i = 0; i < MIX; i++) {
+        uint8_t* frame = frames[i];
+        uint32_t length = mix[i] - 4U;
+        uint32_t ip_length = length - 14U;
+        uint32_t udp_length = ip_length - 20U;
+        memset(frame, (int)i, length);
+        memcpy(frame, local_mac, 6);
+        frame[12] = 0x08;
+        frame[13] = 0x00;
+
+        uint8_t* ip = frame + 14;
+        memset(ip, 0, 28);
+        ip[0] = 0x45;
+        ip[2] = (uint8_t)(ip_length >> 8);
+        ip[3] = (uint8_t)ip_length;
+        ip[8] = 64;
+        ip[9] = 17;
+        ip[12] = 10;
+        ip[15] = 2;
+        ip[16] = 10;
+        ip[19] = 1;
+        uint16_t sum = checksum(ip, 20, 0);
+        ip[10] = (uint8_t)(sum >> 8);
+        ip[11] = (uint8_t)sum;
+
+        uint8_t* udp = ip + 20;
+        udp[4] = (uint8_t)(udp_length >> 8);
+        udp[5] = (uint8_t)udp_length;
+        sum = checksum(udp, udp_length, (uint32_t)(~checksum(ip + 12, 8, 0) & 0xFFFFU) + 17U + udp_length);
+        udp[6] = (uint8_t)(sum >> 8);
+        udp[7] = (uint8_t)sum;
+    }
+}
+
+static void build_captures(void)
+{
+    static const uint32_t header[6] = { 0xA1B2C3D4U, 0x00040002U, 0, 0, 65535, 1 };
+    for (uint32_t c = 0; c < CAPTURES; c++) {
+        uint8_t* capture = captures[c];
+        memcpy(capture, header, sizeof(header));
+        uint32_t offset = sizeof(header);
+        for (uint32_t i = c * CAPTURE_FRAMES; i < (c + 1U) * CAPTURE_FRAMES; i++) {
+            uint32_t length = mix[i] - 4U;
+            uint32_t record[4] = { i, 0, length, length };
+            memcpy(capture + offset, record, sizeof(record));
+            memcpy(capture + offset + sizeof(record), frames[i], length);
+            offset += sizeof(record) + length;
+        }
+        capture_size[c] = offset;
+    }
+}
+
+static uint32_t consume(void)
+{
+    uint32_t count = 0;
+    for (msg_t* frame = mailbox_fetch(&rx_output); frame != NULL; frame = mailbox_fetch(&rx_output)) {
+        bench_sink += eth_buf_data(frame)[20];
+        eth_buf_free(frame);
+        count++;
+    }
+    return count;
+}
+
+static status_t start(uint8_t rx_watchdog)
+{
+    eth_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.hclk_hz = 168000000U;
+    memcpy(config.mac, local_mac, 6);
+    config.rmii = 1;
+    config.speed_100 = 1;
+    config.full_duplex = 1;
+    config.checksum_offload = 1;
+    config.rx_watchdog = rx_watchdog;
+    config.rx_pool = &rx_pool;
+    config.rx_output = &rx_output;
+    msg_pool_init(&rx_pool, rx_storage, ETH_BUF_PAYLOAD(BUFFER), RX_BUFFERS);
+    msg_pool_init(&tx_pool, tx_storage, ETH_BUF_PAYLOAD(BUFFER), TX_BUFFERS);
+    mailbox_init(&rx_output, NULL, NULL);
+    return eth_init(&eth, &config);
+}
+
+static void report_rate(const char* name, uint64_t elapsed, uint64_t frames)
+{
+    bench_report(name, elapsed, frames);
+    printf("  %.2f Mpackets/s\n", (double)frames * 1e3 / (double)elapsed);
+}
+
+static void measure_rx(const char* name, uint8_t rx_watchdog, const char* path, uint32_t rounds)
+{
+    if (start(rx_watchdog) != SUCCESS) {
+        return;
+    }
+    uint64_t frames = 0;
+    uint64_t start_ns = bench_now_ns();
+    for (uint32_t round = 0; round < rounds; round++) {
+        if (path != NULL) {
+            eth_sim_play_pcap_file(&eth, path);
+            frames += consume();
+        } else {
+            for (uint32_t c = 0; c < CAPTURES; c++) {
+                eth_sim_play_pcap(&eth, captures[c], capture_size[c]);
+                frames += consume();
+            }
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start_ns;
+
+    report_rate(name, elapsed, frames);
+    const eth_stats_t* stats = eth_get_stats(&eth);
+    printf("  %.2f frames per interrupt, %u ring overruns\n",
+           (double)stats->rx_frames / (double)(stats->rx_interrupts ? stats->rx_interrupts : 1U),
+           (unsigned)stats->rx_ring_full);
+    eth_deinit(&eth);
+}
+
+static void measure_tx(void)
+{
+    static uint8_t out[ETH_FRAME_MAX];
+    if (start(0) != SUCCESS) {
+        return;
+    }
+    uint64_t start_ns = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (uint32_t i = 0; i < MIX; i++) {
+            uint32_t length = mix[i] - 4U;
+            msg_t* head = eth_buf_alloc(&tx_pool);
+            msg_t* payload = eth_buf_alloc(&tx_pool);
+            memcpy(eth_buf_data(head), frames[i], 42);
+            head->length = 42;
+            payload->length = (uint16_t)(length - 42U);
+            eth_buf_append(head, payload);
+            eth_send(&eth, head);
+            bench_sink += eth_sim_transmit(&eth, out, sizeof(out));
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start_ns;
+    report_rate("eth_tx_imix_two_buffer_chains", elapsed, (uint64_t)ROUNDS * MIX);
+    eth_deinit(&eth);
+}
+
+int main(int argc, char** argv)
+{
+    build_frames();
+    build_captures();
+    const char* path = (argc > 1) ? argv[1] : NULL;
+    uint32_t rounds = (path != NULL) ? 100U : ROUNDS;
+
+    measure_rx("eth_rx_interrupt_per_frame", 0, path, rounds);
+    measure_rx("eth_rx_watchdog_coalesced", 1, path, rounds);
+    measure_tx();
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "bench.h"
+#include "fft.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Throughput and accuracy of the FFTs from 256 to 4096 points. Time is
+ * reported per transform; accuracy as the SNR in dB of each transform of
+ * full-scale white noise against a double-precision DFT.
+ */
+
+#define MIN_N 256U
+#define MAX_N FFT_MAX_SIZE
+#define PI 3.14159265358979323846
+
+static q15_t in15[2U * MAX_N], buf15[2U * MAX_N];
+static float32_t inf[2U * MAX_N], buff[2U * MAX_N];
+static double ref_cos[MAX_N], ref_sin[MAX_N];
+static double ref_re[MAX_N], ref_im[MAX_N];
+
+/* Taylor series, like the tests; benches link no libm */
+static void sincos_ref(double x, double* s, double* c)
+{
+    double term_s = x, term_c = 1.0;
+    *s = 0.0;
+    *c = 0.0;
+    for (int k = 1; k < 40; k += 2) {
+        *s += term_s;
+        *c += term_c;
+        term_s *= -x * x / ((k + 1) * (k + 2));
+        term_c *= -x * x / (k * (k + 1));
+    }
+}
+
+/* 10 log10(ratio) through ln(m 2^e) = ln m + e ln 2, m in [1, 2) */
+static double decibels(double ratio)
+{
+    int exponent = 0;
+    while (ratio >= 2.0) {
+        ratio /= 2.0;
+        exponent++;
+    }
+    while (ratio < 1.0) {
+        ratio *= 2.0;
+        exponent--;
+    }
+    double y = (ratio - 1.0) / (ratio + 1.0), term = y, ln = 0.0;
+    for (int k = 1; k < 40; k += 2) {
+        ln += term / k;
+        term *= y * y;
+    }
+    ln = 2.0 * ln + exponent * 0.69314718055994531;
+    return 10.0 * ln / 2.30258509299404568;
+}
+
+static void prepare(uint32_t n)
+{
+    uint32_t seed = n;
+    for (uint32_t i = 0; i < 2U * n; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        in15[i] = (q15_t)(seed >> 16);
+        inf[i] = (float32_t)in15[i] / 32768.0f;
+    }
+    for (uint32_t k = 0; k < n; k++) {
+        double angle = 2.0 * PI * k / n;
+        sincos_ref((angle > PI) ? angle - 2.0 * PI : angle, &ref_sin[k], &ref_cos[k]);
+    }
+}
+
+/* DFT of the first n samples of in15, complex or real */
+static void reference(uint32_t n, uint8_t real)
+{
+    for (uint32_t k = 0; k < n; k++) {
+        double acc_re = 0.0, acc_im = 0.0;
+        for (uint32_t t = 0; t < n; t++) {
+            uint32_t index = (uint32_t)(((uint64_t)k * t) % n);
+            double re = real ? in15[t] : in15[2U * t], im = real ? 0.0 : in15[2U * t + 1U];
+            acc_re += re * ref_cos[index] + im * ref_sin[index];
+            acc_im += im * ref_cos[index] - re * ref_sin[index];
+        }
+        ref_re[k] = acc_re / 32768.0;
+        ref_im[k] = acc_im / 32768.0;
+    }
+}
+
+/* SNR of {re, im} output pairs; packed real output has bin n/2 in slot 1 */
+static double snr(const double* out, uint32_t bins, uint8_t real)
+{
+    double signal = 0.0, noise = 0.0;
+    for (uint32_t k = 0; k < bins; k++) {
+        double re = out[2U * k], im = out[2U * k + 1U];
+        double er = ref_re[k], ei = ref_im[k];
+        if (real && (k == 0U)) {
+            double nr = out[1] - ref_re[bins];
+            noise += nr * nr;
+            signal += ref_re[bins] * ref_re[bins];
+            im = 0.0;
+        }
+        signal += er * er + ei * ei;
+        noise += (re - er) * (re - er) + (im - ei) * (im - ei);
+    }
+    return decibels(signal / noise);
+}
+
+static double scaled[2U * MAX_N];
+
+static void report_snr(const char* name, uint32_t n, double db)
+{
+    printf("%-24s %5u points  SNR %6.1f dB\n", name, (unsigned)n, db);
+}
+
+#define TIME(label, n, restore, transform)                                                                           \
+    do {                                                                                                             \
+        char name[32];                                                                                               \
+        uint32_t rounds = (1U << 22) / (n);                                                                          \
+        snprintf(name, sizeof(name), "%s_%u", label, (unsigned)(n));                                                 \
+        uint64_t start = bench_now_ns();                                                                             \
+        for (uint32_t round = 0; round < rounds; round++) {                                                          \
+            restore;                                                                                                 \
+            transform;                                                                                               \
+        }                                                                                                            \
+        bench_report(name, bench_now_ns() - start, rounds);                                                          \
+    } while (0)
+
+static void measure(uint32_t n)
+{
+
+    prepare(n);
+    reference(n, 0);
+    memcpy(buf15, in15, sizeof(q15_t) * 2U * n);
+    fft_complex_q15(buf15, n, 0);
+    for (uint32_t i = 0; i < 2U * n; i++) {
+        scaled[i] = (double)buf15[i] * n / 32768.0;
+    }
+    report_snr("fft_complex_q15", n, snr(scaled, n, 0));
+    memcpy(buff, inf, sizeof(float32_t) * 2U * n);
+    fft_complex_f32(buff, n, 0);
+    for (uint32_t i = 0; i < 2U * n; i++) {
+        scaled[i] = buff[i];
+    }
+    report_snr("fft_complex_f32", n, snr(scaled, n, 0));
+
+    reference(n, 1);
+    memcpy(buf15, in15, sizeof(q15_t) * n);
+    fft_real_q15(buf15, n);
+    for (uint32_t i = 0; i < n; i++) {
+        scaled[i] = (double)buf15[i] * n / 32768.0;
+    }
+    report_snr("fft_real_q15", n, snr(scaled, n / 2U, 1));
+    memcpy(buff, inf, sizeof(float32_t) * n);
+    fft_real_f32(buff, n);
+    for (uint32_t i = 0; i < n; i++) {
+        scaled[i] = buff[i];
+    }
+    report_snr("fft_real_f32", n, snr(scaled, n / 2U, 1));
+
+    /* Each round restores the input first; the copy is under 2% of a transform */
+    TIME("fft_complex_q15", n, memcpy(buf15, in15, sizeof(q15_t) * 2U * n), fft_complex_q15(buf15, n, 0));
+    TIME("fft_complex_f32", n, memcpy(buff, inf, sizeof(float32_t) * 2U * n), fft_complex_f32(buff, n, 0));
+    TIME("fft_real_q15", n, memcpy(buf15, in15, sizeof(q15_t) * n), fft_real_q15(buf15, n));
+    TIME("fft_real_f32", n, memcpy(buff, inf, sizeof(float32_t) * n), fft_real_f32(buff, n));
+
+    bench_sink += (uintptr_t)buf15[1] + (uintptr_t)(buff[1] * 1000.0f);
+}
+
+int main(void)
+{
+    for (uint32_t n = MIN_N; n <= MAX_N; n *= 2U) {
+        measure(n);
+    }
+    return 0;
+}
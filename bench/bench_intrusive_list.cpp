@@ -0,0 +1,139 @@
+#include "../lib/intrusive_list/intrusive_list.hpp"
+#include "bench.h"
+#include <cstddef>
+
+#define QUEUE_LENGTH 64
+#define ROUNDS 400000
+
+struct event {
+    uint32_t id;
+    node_t hook;
+    uint32_t payload;
+};
+
+static event events[QUEUE_LENGTH];
+
+/* Hand-written C equivalent: explicit head/tail and container_of arithmetic */
+struct c_queue {
+    node_t* head;
+    node_t* tail;
+};
+
+#define EVENT_FROM_NODE(node) ((event*)((char*)(node)-offsetof(event, hook)))
+
+static void c_push_back(c_queue* queue, node_t* node)
+{
+    node->next = NULL;
+    if (queue->tail == NULL) {
+        queue->head = node;
+    } else {
+        queue->tail->next = node;
+    }
+    queue->tail = node;
+}
+
+static node_t* c_pop_front(c_queue* queue)
+{
+    node_t* node = queue->head;
+    if (node != NULL) {
+        queue->head = node->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    return node;
+}
+
+static void bench_c_queue(void)
+{
+    c_queue queue = { NULL, NULL };
+    uint64_t sum = 0;
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (uint32_t i = 0; i < QUEUE_LENGTH; i++) {
+            c_push_back(&queue, &events[i].hook);
+        }
+        node_t* node;
+        while ((node = c_pop_front(&queue)) != NULL) {
+            sum += EVENT_FROM_NODE(node)->payload;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("c_queue_push_pop", elapsed, (uint64_t)ROUNDS * QUEUE_LENGTH * 2);
+    bench_sink = (uintptr_t)sum;
+}
+
+static void bench_intrusive_queue(void)
+{
+    ll::intrusive_list<LL_HOOK(event, hook)> queue;
+    uint64_t sum = 0;
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (uint32_t i = 0; i < QUEUE_LENGTH; i++) {
+            queue.push_back(events[i]);
+        }
+        event* e;
+        while ((e = queue.pop_front()) != nullptr) {
+            sum += e->payload;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("intrusive_queue_push_pop", elapsed, (uint64_t)ROUNDS * QUEUE_LENGTH * 2);
+    bench_sink = (uintptr_t)sum;
+}
+
+static void bench_c_walk(void)
+{
+    c_queue queue = { NULL, NULL };
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < QUEUE_LENGTH; i++) {
+        c_push_back(&queue, &events[i].hook);
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (node_t* node = queue.head; node != NULL; node = node->next) {
+            sum += EVENT_FROM_NODE(node)->payload;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("c_walk", elapsed, (uint64_t)ROUNDS * QUEUE_LENGTH);
+    bench_sink = (uintptr_t)sum;
+}
+
+static void bench_intrusive_walk(void)
+{
+    ll::intrusive_list<LL_HOOK(event, hook)> queue;
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < QUEUE_LENGTH; i++) {
+        queue.push_back(events[i]);
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (event& e : queue) {
+            sum += e.payload;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("intrusive_walk", elapsed, (uint64_t)ROUNDS * QUEUE_LENGTH);
+    bench_sink = (uintptr_t)sum;
+}
+
+int main(void)
+{
+    for (uint32_t i = 0; i < QUEUE_LENGTH; i++) {
+        events[i].id = i;
+        events[i].payload = i;
+    }
+
+    bench_c_queue();
+    bench_intrusive_queue();
+    bench_c_walk();
+    bench_intrusive_walk();
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "../lib/linked_list/linked_list.h"
+#include "bench.h"
+
+#define LIST_LENGTH 64
+#define ROUNDS 200000
+
+static node_t nodes[LIST_LENGTH];
+
+static void bench_head_push_pop(void)
+{
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        ll_init(&nodes[0]);
+        for (uint32_t i = 1; i < LIST_LENGTH; i++) {
+            ll_insert_at_head(&nodes[i]);
+        }
+        while (ll_delete_at_head() == SUCCESS) {
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("ll_head_push_pop", elapsed, (uint64_t)ROUNDS * LIST_LENGTH * 2);
+}
+
+static void bench_tail_push_pop(void)
+{
+    const uint32_t rounds = ROUNDS / 32;
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < rounds; round++) {
+        ll_init(&nodes[0]);
+        for (uint32_t i = 1; i < LIST_LENGTH; i++) {
+            ll_insert_at_tail(&nodes[i]);
+        }
+        while (ll_delete_at_tail() == SUCCESS) {
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("ll_tail_push_pop", elapsed, (uint64_t)rounds * LIST_LENGTH * 2);
+}
+
+static void bench_event_queue(void)
+{
+    /* FIFO usage as seen in event simulations: enqueue at tail, dequeue at head */
+    uint32_t next = 1;
+    uint64_t ops = 0;
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS * 4; round++) {
+        if ((round & 3U) != 3U) {
+            ll_insert_at_tail(&nodes[next]);
+            next++;
+        } else {
+            ll_delete_at_head();
+        }
+        ops++;
+        /* Restart before any node could be queued twice */
+        if ((round & 0x3FU) == 0) {
+            ll_init(&nodes[0]);
+            next = 1;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("ll_event_queue", elapsed, ops);
+}
+
+int main(void)
+{
+    bench_head_push_pop();
+    bench_tail_push_pop();
+    bench_event_queue();
+    bench_sink = (uintptr_t)&nodes[0];
+    return 0;
+}
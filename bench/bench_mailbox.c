@@ -0,0 +1,108 @@
+#include "bench.h"
+#include "mailbox.h"
+#include <string.h>
+
+/*
+ * Message throughput: a producer writes a payload and hands it to a
+ * consumer that reads it, through a zero-copy mailbox and through a
+ * single-producer ring of fixed-size slots that copies the payload in and
+ * out. Messages are sent in bursts of BURST before the consumer drains them.
+ */
+
+#define ITERATIONS 200000U
+#define BURST 8U
+#define MAX_PAYLOAD 1024U
+
+static MSG_POOL_STORAGE(pool_storage, MAX_PAYLOAD, BURST);
+static msg_pool_t pool;
+static mailbox_t mailbox;
+
+typedef struct {
+    uint8_t slots[BURST][MAX_PAYLOAD];
+    uint16_t lengths[BURST];
+    uint32_t head;
+    uint32_t tail;
+} copy_ring_t;
+
+static copy_ring_t ring;
+static uint8_t source[MAX_PAYLOAD];
+static uint8_t destination[MAX_PAYLOAD];
+
+static int copy_ring_push(const void* data, uint32_t length)
+{
+    uint32_t head = ring.head;
+    if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == BURST) {
+        return 0;
+    }
+    uint32_t slot = head % BURST;
+    memcpy(ring.slots[slot], data, length);
+    ring.lengths[slot] = (uint16_t)length;
+    __atomic_store_n(&ring.head, head + 1U, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static uint32_t copy_ring_pop(void* data)
+{
+    uint32_t tail = ring.tail;
+    if (tail == __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    uint32_t slot = tail % BURST;
+    uint32_t length = ring.lengths[slot];
+    memcpy(data, ring.slots[slot], length);
+    __atomic_store_n(&ring.tail, tail + 1U, __ATOMIC_RELEASE);
+    return length;
+}
+
+static void bench_copy_ring(uint32_t size)
+{
+    char name[48];
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < ITERATIONS; i += BURST) {
+        for (uint32_t j = 0; j < BURST; j++) {
+            memset(source, (int)(i + j), size);
+            bench_sink += copy_ring_push(source, size);
+        }
+        for (uint32_t j = 0; j < BURST; j++) {
+            uint32_t length = copy_ring_pop(destination);
+            bench_sink += destination[0] + destination[length - 1U];
+        }
+    }
+    snprintf(name, sizeof(name), "copy_ring_%uB", (unsigned)size);
+    bench_report(name, bench_now_ns() - start, ITERATIONS);
+}
+
+static void bench_zero_copy(uint32_t size)
+{
+    char name[48];
+    msg_pool_init(&pool, pool_storage, MAX_PAYLOAD, BURST);
+    mailbox_init(&mailbox, NULL, NULL);
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < ITERATIONS; i += BURST) {
+        for (uint32_t j = 0; j < BURST; j++) {
+            msg_t* msg = msg_alloc(&pool);
+            memset(msg_payload(msg), (int)(i + j), size);
+            msg->length = (uint16_t)size;
+            mailbox_post(&mailbox, msg);
+        }
+        for (uint32_t j = 0; j < BURST; j++) {
+            msg_t* msg = mailbox_fetch(&mailbox);
+            const uint8_t* payload = (const uint8_t*)msg_payload(msg);
+            bench_sink += payload[0] + payload[msg->length - 1U];
+            msg_free(msg);
+        }
+    }
+    snprintf(name, sizeof(name), "mailbox_zero_copy_%uB", (unsigned)size);
+    bench_report(name, bench_now_ns() - start, ITERATIONS);
+}
+
+int main(void)
+{
+    static const uint32_t sizes[] = { 16, 64, 256, 1024 };
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_copy_ring(sizes[i]);
+        bench_zero_copy(sizes[i]);
+    }
+    return 0;
+}
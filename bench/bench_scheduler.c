@@ -0,0 +1,58 @@
+#include "../lib/scheduler/scheduler.h"
+#include "bench.h"
+
+#define EVENTS 2000000
+#define TASKS 8
+
+static sched_task_t tasks[TASKS];
+static uint32_t handled;
+
+static void counting_handler(sched_task_t* task, uint32_t events)
+{
+    (void)task;
+    handled += (events != 0);
+}
+
+static void bench_post_dispatch(void)
+{
+    handled = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < EVENTS; i++) {
+        sched_post(&tasks[i % TASKS], 1);
+        sched_run_once();
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("sched_post_dispatch", elapsed, EVENTS);
+    printf("sched_post_dispatch: %llu events/s\n",
+        (unsigned long long)((uint64_t)EVENTS * 1000000000ULL / (elapsed ? elapsed : 1)));
+}
+
+static void bench_isr_post_dispatch(void)
+{
+    handled = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < EVENTS; i += TASKS) {
+        for (uint32_t t = 0; t < TASKS; t++) {
+            sched_post_from_isr(&tasks[t], 1U << t);
+        }
+        while (sched_run_once() != 0) {
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("sched_isr_post_dispatch", elapsed, EVENTS);
+    printf("sched_isr_post_dispatch: %llu events/s\n",
+        (unsigned long long)((uint64_t)EVENTS * 1000000000ULL / (elapsed ? elapsed : 1)));
+}
+
+int main(void)
+{
+    sched_init();
+    for (uint32_t i = 0; i < TASKS; i++) {
+        sched_task_init(&tasks[i], counting_handler, NULL, (uint8_t)i);
+    }
+
+    bench_post_dispatch();
+    bench_isr_post_dispatch();
+    bench_sink = handled;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "bench.h"
+#include "sdio_cache.h"
+#include <string.h>
+
+/*
+ * SD card logging throughput against the host card model. A log is written
+ * as 512-byte records, one block each, through write-back caches of 1 to 64
+ * lines, then as direct multi-block writes and read back. The card model
+ * keeps the time the commands and data would take on a 24 MHz 4-bit bus
+ * with typical class 10 access, busy, programming and erase times; that
+ * time gives the MB/s. A cache of one line sends every record as its own
+ * CMD24 and pays a write busy time for each; longer caches coalesce them
+ * into pre-erased CMD25s. Host ns/op is the driver, the cache and the
+ * model's file I/O per record, and is not part of the card figure.
+ *
+ * The card image is a temporary file, or the path given as the argument.
+ */
+
+#define CARD_BLOCKS 65536U
+#define LOG_BLOCKS 8192U
+#define DIRECT_BLOCKS 64U
+
+static sdio_sim_card_t card;
+static sdio_t sd;
+static sdio_cache_t cache;
+static SDIO_CACHE_STORAGE(storage, SDIO_CACHE_MAX_LINES);
+static uint32_t record[SDIO_BLOCK_SIZE / 4U];
+static uint32_t bulk[DIRECT_BLOCKS * SDIO_BLOCK_SIZE / 4U];
+
+static void report(const char* name, uint64_t host_ns, uint64_t card_ns, uint32_t ops, uint32_t blocks)
+{
+    bench_report(name, host_ns, ops);
+    double mbytes = (double)blocks * SDIO_BLOCK_SIZE / ((double)card_ns / 1e9) / 1e6;
+    printf("  card: %.3f MB/s, %.1f us per block\n", mbytes, (double)card_ns / 1e3 / blocks);
+}
+
+static int measure_cache(uint32_t lines)
+{
+    char name[48];
+    if (sdio_cache_init(&cache, &sd, storage, lines) != SUCCESS) {
+        return 1;
+    }
+    uint64_t card_start = card.elapsed_ns;
+    uint64_t start = bench_now_ns();
+    for (uint32_t lba = 0; lba < LOG_BLOCKS; lba++) {
+        record[0] = lba;
+        if (sdio_cache_write(&cache, lba, record, 1) != SUCCESS) {
+            return 1;
+        }
+    }
+    if (sdio_cache_flush(&cache) != SUCCESS) {
+        return 1;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    snprintf(name, sizeof(name), "sdio_cache_%u_lines_record", (unsigned)lines);
+    report(name, elapsed, card.elapsed_ns - card_start, LOG_BLOCKS, LOG_BLOCKS);
+    printf("  %u write commands\n", (unsigned)sdio_cache_get_stats(&cache)->flushes);
+    return 0;
+}
+
+static int measure_direct(uint8_t write)
+{
+    uint64_t card_start = card.elapsed_ns;
+    uint64_t start = bench_now_ns();
+    for (uint32_t lba = 0; lba < LOG_BLOCKS; lba += DIRECT_BLOCKS) {
+        status_t result = write ? sdio_write(&sd, lba, bulk, DIRECT_BLOCKS) : sdio_read(&sd, lba, bulk, DIRECT_BLOCKS);
+        if (result != SUCCESS) {
+            return 1;
+        }
+    }
+    if (sdio_sync(&sd) != SUCCESS) {
+        return 1;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    report(write ? "sdio_write_64_blocks" : "sdio_read_64_blocks", elapsed, card.elapsed_ns - card_start,
+           LOG_BLOCKS / DIRECT_BLOCKS, LOG_BLOCKS);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    FILE* image = (argc > 1) ? fopen(argv[1], "w+b") : tmpfile();
+    if (image == NULL) {
+        return 1;
+    }
+    sdio_sim_insert(&card, image, CARD_BLOCKS, 1);
+    sdio_config_t config = { 168000000U, 0, 0 };
+    if (sdio_init(&sd, &config) != SUCCESS) {
+        return 1;
+    }
+    memset(bulk, 0x5A, sizeof(bulk));
+
+    static const uint32_t lines[] = { 1, 4, 16, 64 };
+    int failed = 0;
+    for (uint32_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        failed |= measure_cache(lines[i]);
+    }
+    failed |= measure_direct(1);
+    failed |= measure_direct(0);
+
+    bench_sink += sdio_get_stats(&sd)->busy_polls;
+    sdio_deinit(&sd);
+    fclose(image);
+    return failed;
+}
@@ -0,0 +1,102 @@
+#include "bench.h"
+#include "spi.h"
+#include <string.h>
+
+/*
+ * Queue throughput of SPI1 at 42 MHz SCK (PCLK2 of 84 MHz divided by 2).
+ * Four transactions circulate: each one's callback submits it again, so
+ * the queue never drains and every transaction is started from the
+ * completion interrupt of the one before. The wire is emulated in bulk (both
+ * streams finish at once and raise their transfer-complete interrupts), so
+ * the time measured per transaction is the driver's: TX and RX completion,
+ * chip-select release and assert, the callback's submit and the next
+ * transaction's two DMA starts. That time is the gap between transactions
+ * on the bus; throughput is the bytes of one transaction over its time on
+ * the wire at 8 bits per byte plus that gap. Host time stands in for the
+ * target's, which at 168 MHz on the Cortex-M4 is several times longer.
+ */
+
+#define SCK_HZ 42000000U
+#define QUEUE 4U
+#define MAX_LENGTH 4096U
+#define BYTES_PER_ROUND (4U * 1024U * 1024U)
+
+static const spi_cs_t cs_pins[] = { { 0, 4 }, { 1, 12 } };
+static uint8_t tx[QUEUE][MAX_LENGTH];
+static uint8_t rx[QUEUE][MAX_LENGTH];
+static spi_transaction_t transactions[QUEUE];
+static spi_bus_t bus;
+
+static void resubmit(spi_transaction_t* transaction, status_t result)
+{
+    (void)result;
+    spi_submit(&bus, transaction);
+}
+
+/* The transaction on the wire finishes: TX one byte ahead of RX */
+static void complete(void)
+{
+    dma_sim_regs[1].S[3].NDTR = 0;
+    dma_sim_regs[1].S[3].CR &= ~DMA_SxCR_EN;
+    dma_sim_regs[1].LISR = DMA_FLAG_TC << 22;
+    dma_stream_irq(2, 3);
+    dma_sim_regs[1].S[2].NDTR = 0;
+    dma_sim_regs[1].S[2].CR &= ~DMA_SxCR_EN;
+    dma_sim_regs[1].LISR = DMA_FLAG_TC << 16;
+    dma_stream_irq(2, 2);
+    dma_sim_regs[1].LISR = 0;
+}
+
+static void measure(uint32_t length)
+{
+    char name[48];
+    uint32_t rounds = BYTES_PER_ROUND / length;
+    if (rounds > 1000000U) {
+        rounds = 1000000U;
+    }
+    for (uint32_t i = 0; i < QUEUE; i++) {
+        memset(&transactions[i], 0, sizeof(transactions[i]));
+        transactions[i].tx = tx[i];
+        transactions[i].rx = rx[i];
+        transactions[i].length = (uint16_t)length;
+        transactions[i].cs = (uint8_t)(i & 1U);
+        transactions[i].clock_div = spi_clock_div(84000000U, SCK_HZ);
+        transactions[i].callback = resubmit;
+        spi_submit(&bus, &transactions[i]);
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < rounds; round++) {
+        complete();
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    snprintf(name, sizeof(name), "spi_transaction_%u_bytes", (unsigned)length);
+    bench_report(name, elapsed, rounds);
+    double gap_ns = (double)elapsed / rounds;
+    double wire_ns = (double)length * 8.0 * 1e9 / SCK_HZ;
+    double mbytes = (double)length / (wire_ns + gap_ns) * 1e3;
+    printf("  at 42 MHz SCK: %.3f MB/s of %.3f, bus busy %.1f%%\n", mbytes, SCK_HZ / 8.0 / 1e6,
+           100.0 * wire_ns / (wire_ns + gap_ns));
+
+    /* Let the queue drain: callbacks stop resubmitting once the bus is gone */
+    spi_deinit(&bus);
+    spi_config_t config = { cs_pins, 2, 0xFF };
+    spi_init(&bus, 1, &config);
+}
+
+int main(void)
+{
+    spi_config_t config = { cs_pins, 2, 0xFF };
+    if (spi_init(&bus, 1, &config) != SUCCESS) {
+        return 1;
+    }
+    measure(4);
+    measure(32);
+    measure(256);
+    measure(4096);
+
+    bench_sink += spi_get_stats(&bus)->aborted;
+    spi_deinit(&bus);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "bench.h"
+#include "timebase.h"
+
+/*
+ * Tickless sleep against the host clock model: random run/sleep patterns,
+ * half of the sleeps cut short by an interrupt. Reports the wake-up latency
+ * seen by the counter and the residual drift of the tick against true time,
+ * first with the stop/restart cost the code compensates for and then with
+ * costs it does not expect.
+ */
+
+#define SLEEPS 20000U
+#define WAKE_CYCLES 12U
+#define C TIMEBASE_CYCLES_PER_TICK
+
+static uint32_t idle_ticks;
+
+static void ignore_ticks(uint32_t ticks)
+{
+    bench_sink += ticks;
+}
+
+static uint32_t next_deadline(void)
+{
+    return idle_ticks;
+}
+
+static void simulate(const char* name, uint32_t stopped_cycles)
+{
+    timebase_sim_reset(WAKE_CYCLES, stopped_cycles);
+    timebase_init(ignore_ticks, next_deadline);
+    uint64_t start_cycle = timebase_sim_next_tick() - C;
+
+    uint32_t seed = 12345;
+    uint64_t begin = bench_now_ns();
+    for (uint32_t i = 0; i < SLEEPS; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        timebase_sim_run(seed % (2U * C));
+        idle_ticks = 2U + (seed >> 8) % 500U;
+        if ((seed & 0x100U) != 0) {
+            timebase_sim_interrupt_at(timebase_sim_cycles() + (seed >> 4) % (idle_ticks * C));
+        }
+        timebase_sleep();
+        timebase_sim_interrupt_at(0);
+    }
+    uint64_t elapsed = bench_now_ns() - begin;
+    timebase_sim_run(0);
+
+    uint64_t ideal_next = start_cycle + ((uint64_t)timebase_ticks() + 1U) * C;
+    int64_t drift = (int64_t)(timebase_sim_next_tick() - ideal_next);
+    uint64_t span = timebase_sim_cycles() - start_cycle;
+    timebase_stats_t stats = timebase_get_stats();
+
+    bench_report(name, elapsed, SLEEPS);
+    printf("%s: drift %lld cycles over %llu ticks (%.3f ppm), wake latency %u cycles, "
+           "%u early wakes, %u ticks suppressed\n",
+        name, (long long)drift, (unsigned long long)(span / C), (double)drift * 1e6 / (double)span,
+        stats.wake_latency_max, stats.early_wakes, stats.ticks_suppressed);
+}
+
+int main(void)
+{
+    simulate("tickless_compensated", TIMEBASE_STOPPED_CYCLES);
+    simulate("tickless_stop_cost_x2", TIMEBASE_STOPPED_CYCLES * 2U);
+    simulate("tickless_stop_cost_zero", 0);
+    return 0;
+}
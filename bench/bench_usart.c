@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "usart.h"
+#include <string.h>
+
+/*
+ * Driver cost per frame at 4 Mbaud on USART1. The hardware side is
+ * emulated in bulk (the DMA writes a whole frame into the ring, raising the
+ * half/complete interrupts it crosses) so that the time measured is mostly
+ * the driver's interrupt work, ring drain and copy, mailbox post and the
+ * consumer's fetch and free; the emulated DMA write is one memcpy. The
+ * share of a CPU is that time against the frame's time on the wire at 10
+ * bits per byte.
+ */
+
+#define BAUD 4000000U
+#define RING_SIZE 256U
+#define PAYLOAD 512U
+#define ROUNDS 200000U
+
+static MSG_POOL_STORAGE(rx_storage, PAYLOAD, 4);
+static MSG_POOL_STORAGE(tx_storage, PAYLOAD, 4);
+static msg_pool_t rx_pool, tx_pool;
+static mailbox_t rx_output;
+static uint8_t ring[RING_SIZE];
+static uint8_t frame[PAYLOAD];
+static usart_t port;
+
+/* Writes count bytes the way the RX stream would, with its half/complete interrupts */
+static void dma_write(uint32_t count)
+{
+    dma_stream_regs_t* regs = port.rx_dma.regs;
+    const uint8_t* source = frame;
+    while (count > 0U) {
+        uint32_t head = RING_SIZE - regs->NDTR;
+        uint32_t boundary = (head < RING_SIZE / 2U) ? RING_SIZE / 2U : RING_SIZE;
+        uint32_t chunk = (count < boundary - head) ? count : boundary - head;
+        memcpy(ring + head, source, chunk);
+        source += chunk;
+        count -= chunk;
+        regs->NDTR -= chunk;
+        if (head + chunk == boundary) {
+            if (regs->NDTR == 0U) {
+                regs->NDTR = RING_SIZE;
+            }
+            dma_sim_regs[1].HISR = (boundary == RING_SIZE ? DMA_FLAG_TC : DMA_FLAG_HT) << 6;
+            dma_stream_irq(2, 5);
+            dma_sim_regs[1].HISR = 0;
+        }
+    }
+}
+
+static void measure_rx(uint32_t length)
+{
+    char name[48];
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        dma_write(length);
+        usart_sim_idle(&port);
+        msg_free(mailbox_fetch(&rx_output));
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    snprintf(name, sizeof(name), "usart_rx_frame_%u_bytes", (unsigned)length);
+    bench_report(name, elapsed, ROUNDS);
+    uint64_t wire_ns = (uint64_t)length * 10U * 1000000000ULL / BAUD;
+    printf("  cpu share at 4 Mbaud: %.3f%%\n", 100.0 * (double)elapsed / ROUNDS / (double)wire_ns);
+}
+
+static void measure_tx(uint32_t length)
+{
+    char name[48];
+    dma_stream_regs_t* regs = port.tx_dma.regs;
+    uint64_t start = bench_now_ns();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        msg_t* msg = msg_alloc(&tx_pool);
+        msg->length = (uint16_t)length;
+        usart_send(&port, msg);
+        /* The stream finishes the message */
+        regs->NDTR = 0;
+        regs->CR &= ~DMA_SxCR_EN;
+        dma_sim_regs[1].HISR = DMA_FLAG_TC << 22;
+        dma_stream_irq(2, 7);
+        dma_sim_regs[1].HISR = 0;
+    }
+    snprintf(name, sizeof(name), "usart_tx_message_%u_bytes", (unsigned)length);
+    bench_report(name, bench_now_ns() - start, ROUNDS);
+}
+
+int main(void)
+{
+    usart_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.baud_rate = BAUD;
+    config.clock_hz = 84000000;
+    config.rx_ring = ring;
+    config.rx_ring_size = RING_SIZE;
+    config.rx_pool = &rx_pool;
+    config.rx_output = &rx_output;
+    msg_pool_init(&rx_pool, rx_storage, PAYLOAD, 4);
+    msg_pool_init(&tx_pool, tx_storage, PAYLOAD, 4);
+    mailbox_init(&rx_output, NULL, NULL);
+    for (uint32_t i = 0; i < PAYLOAD; i++) {
+        frame[i] = (uint8_t)i;
+    }
+    if (usart_init(&port, 1, &config) != SUCCESS) {
+        return 1;
+    }
+
+    measure_rx(16);
+    measure_rx(64);
+    measure_rx(256);
+    measure_tx(16);
+    measure_tx(256);
+
+    bench_sink += usart_get_stats(&port)->rx_frames + usart_get_stats(&port)->tx_messages;
+    usart_deinit(&port);
+    return 0;
+}
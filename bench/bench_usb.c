@@ -0,0 +1,103 @@
+#include "bench.h"
+#include "usb_cdc.h"
+#include <string.h>
+
+/*
+ * Bulk throughput of the CDC-ACM port against the host model of the OTG
+ * core. Receive feeds 64-byte packets into the OUT endpoint and has the
+ * consumer fetch and free each posted message; transmit sends messages and
+ * drains the IN endpoint packet by packet, as the host controller would.
+ * A full-speed bus carries at most 19 bulk packets per frame, 1.216 MB/s,
+ * so anything well above that leaves the CPU mostly idle at line rate. The
+ * times include the model's FIFO work, so they bound the driver from above.
+ */
+
+#define PAYLOAD 512U
+#define BUFFERS 8U
+#define BYTES (64U * 1024U * 1024U)
+
+static MSG_POOL_STORAGE(rx_storage, PAYLOAD, BUFFERS);
+static MSG_POOL_STORAGE(tx_storage, PAYLOAD, BUFFERS);
+static msg_pool_t rx_pool, tx_pool;
+static mailbox_t rx_output;
+static usb_cdc_t cdc;
+
+static status_t start(void)
+{
+    usb_cdc_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.vendor_id = 0x0483;
+    config.product_id = 0x5740;
+    config.rx_pool = &rx_pool;
+    config.rx_output = &rx_output;
+    msg_pool_init(&rx_pool, rx_storage, PAYLOAD, BUFFERS);
+    msg_pool_init(&tx_pool, tx_storage, PAYLOAD, BUFFERS);
+    mailbox_init(&rx_output, NULL, NULL);
+    if (usb_cdc_init(&cdc, &config) != SUCCESS) {
+        return FAILURE;
+    }
+    usb_sim_reset(&cdc.usb);
+    usb_setup_t setup = { 0, USB_REQ_SET_CONFIGURATION, 1, 0, 0 };
+    return (usb_sim_control(&cdc.usb, &setup, NULL) == 0) ? SUCCESS : FAILURE;
+}
+
+static void report_rate(const char* name, uint64_t elapsed, uint64_t bytes)
+{
+    bench_report(name, elapsed, bytes / USB_CDC_PACKET);
+    double rate = (double)bytes * 1e3 / (double)elapsed;
+    printf("  %.1f MB/s, %.0fx the full-speed bulk ceiling\n", rate, rate / 1.216);
+}
+
+static void measure_rx(void)
+{
+    static uint8_t packet[USB_CDC_PACKET];
+    if (start() != SUCCESS) {
+        return;
+    }
+    memset(packet, 0x5A, sizeof(packet));
+    uint64_t bytes = 0;
+    uint64_t start_ns = bench_now_ns();
+    while (bytes < BYTES) {
+        bench_sink += (uintptr_t)usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, packet, sizeof(packet));
+        bytes += sizeof(packet);
+        for (msg_t* msg = mailbox_fetch(&rx_output); msg != NULL; msg = mailbox_fetch(&rx_output)) {
+            bench_sink += ((const uint8_t*)msg_payload(msg))[0];
+            msg_free(msg);
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start_ns;
+    report_rate("usb_cdc_rx_bulk_64b_packets", elapsed, bytes);
+    printf("  %u messages, %u starved\n", (unsigned)usb_cdc_get_stats(&cdc)->rx_messages,
+           (unsigned)usb_cdc_get_stats(&cdc)->rx_starved);
+    usb_cdc_deinit(&cdc);
+}
+
+static void measure_tx(void)
+{
+    static uint8_t packet[USB_CDC_PACKET];
+    if (start() != SUCCESS) {
+        return;
+    }
+    uint64_t bytes = 0;
+    uint64_t start_ns = bench_now_ns();
+    while (bytes < BYTES) {
+        msg_t* msg = msg_alloc(&tx_pool);
+        msg->length = PAYLOAD - 1U;
+        usb_cdc_send(&cdc, msg);
+        for (int32_t got = USB_CDC_PACKET; got == (int32_t)USB_CDC_PACKET;) {
+            got = usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, packet, sizeof(packet));
+            bytes += (got > 0) ? (uint32_t)got : 0U;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start_ns;
+    report_rate("usb_cdc_tx_bulk_511b_messages", elapsed, bytes);
+    printf("  %u refills from the FIFO-empty interrupt\n", (unsigned)usb_get_stats(&cdc.usb)->tx_refills);
+    usb_cdc_deinit(&cdc);
+}
+
+int main(void)
+{
+    measure_rx();
+    measure_tx();
+    return 0;
+}
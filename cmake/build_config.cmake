@@ -0,0 +1,59 @@
+# Generates build_config.h from the values in config/project_info.cmake.
+# The header lands in ${CMAKE_BINARY_DIR}/generated, which is returned in
+# BUILD_CONFIG_INCLUDE_DIR.
+
+function(generate_build_config)
+        if(NOT CLIENT IN_LIST KNOWN_CLIENTS)
+                message(FATAL_ERROR "CLIENT '${CLIENT}' is not listed in KNOWN_CLIENTS")
+        endif()
+
+        # Per-client overrides of the feature matrix, checked with the rest below
+        if(EXISTS ${CMAKE_SOURCE_DIR}/config/clients/${CLIENT}.cmake)
+                include(${CMAKE_SOURCE_DIR}/config/clients/${CLIENT}.cmake)
+        endif()
+
+        if(NOT ENVIRONMENT MATCHES "^(dev|test|prod)$")
+                message(FATAL_ERROR "Unknown ENVIRONMENT '${ENVIRONMENT}', expected dev, test or prod")
+        endif()
+        if(NOT LOG_BACKEND MATCHES "^(stdio|itm)$")
+                message(FATAL_ERROR "Unknown LOG_BACKEND '${LOG_BACKEND}', expected stdio or itm")
+        endif()
+        if(NOT FW_VERSION MATCHES "^([0-9]+)\\.([0-9]+)\\.([0-9]+)$")
+                message(FATAL_ERROR "FW_VERSION '${FW_VERSION}' is not <major>.<minor>.<patch>")
+        endif()
+        set(FW_VERSION_MAJOR ${CMAKE_MATCH_1})
+        set(FW_VERSION_MINOR ${CMAKE_MATCH_2})
+        set(FW_VERSION_PATCH ${CMAKE_MATCH_3})
+
+        # Without LOG_LEVEL, feature_hooks.h picks one from the environment
+        if(DEFINED LOG_LEVEL AND NOT LOG_LEVEL STREQUAL "")
+                if(NOT LOG_LEVEL MATCHES "^(error|warn|info)$")
+                        message(FATAL_ERROR "Unknown LOG_LEVEL '${LOG_LEVEL}', expected error, warn or info")
+                endif()
+                string(TOUPPER ${LOG_LEVEL} LOG_LEVEL_NAME)
+                set(LOG_LEVEL_DEFINE "#define BUILD_CFG_LOG_LEVEL LOG_LEVEL_${LOG_LEVEL_NAME}")
+        else()
+                set(LOG_LEVEL_DEFINE "/* BUILD_CFG_LOG_LEVEL: by environment */")
+        endif()
+
+        set(CLIENT_ID_DEFINES "")
+        set(CLIENT_INDEX 0)
+        foreach(KNOWN_CLIENT ${KNOWN_CLIENTS})
+                string(APPEND CLIENT_ID_DEFINES "#define CLIENT_ID_${KNOWN_CLIENT} ${CLIENT_INDEX}\n")
+                math(EXPR CLIENT_INDEX "${CLIENT_INDEX} + 1")
+        endforeach()
+
+        foreach(FEATURE_NAME TRACE LOGGING LOCKING STATS)
+                if(FEATURE_${FEATURE_NAME})
+                        set(BUILD_CFG_FEATURE_${FEATURE_NAME} 1)
+                else()
+                        set(BUILD_CFG_FEATURE_${FEATURE_NAME} 0)
+                endif()
+        endforeach()
+
+        configure_file(${CMAKE_SOURCE_DIR}/config/build_config.h.in
+                ${CMAKE_BINARY_DIR}/generated/build_config.h
+        )
+
+        set(BUILD_CONFIG_INCLUDE_DIR ${CMAKE_BINARY_DIR}/generated PARENT_SCOPE)
+endfunction()
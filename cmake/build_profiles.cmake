@@ -0,0 +1,82 @@
+# Named target build profiles.
+#
+#   debug : -Og -g3, no LTO
+#   size  : -Os with LTO
+#   speed : -O2 with LTO and static, non-PIC code generation
+#
+# All profiles keep -ffunction-sections/-fdata-sections so the linker can
+# discard unused code with --gc-sections.
+
+set(BUILD_PROFILES debug size speed)
+
+function(apply_build_profile TARGET PROFILE)
+        if(NOT PROFILE IN_LIST BUILD_PROFILES)
+                message(FATAL_ERROR "Unknown BUILD_PROFILE '${PROFILE}', expected one of: ${BUILD_PROFILES}")
+        endif()
+
+        if(PROFILE STREQUAL "debug")
+                set(PROFILE_COMPILE_OPTIONS
+                        -Og
+                        -g3
+                )
+                set(PROFILE_LINK_OPTIONS
+                )
+        elseif(PROFILE STREQUAL "size")
+                set(PROFILE_COMPILE_OPTIONS
+                        -Os
+                        -g
+                        -flto
+                        -fno-common
+                        -fno-unwind-tables
+                        -fno-asynchronous-unwind-tables
+                )
+                set(PROFILE_LINK_OPTIONS
+                        -Os
+                        -flto
+                        -Wl,--sort-section=alignment
+                )
+        elseif(PROFILE STREQUAL "speed")
+                # There is no PLT or GOT on bare metal; the closest equivalent
+                # of -fno-plt is to make sure nothing is compiled as PIC and
+                # that calls are not routed through interposable symbols.
+                set(PROFILE_COMPILE_OPTIONS
+                        -O2
+                        -g
+                        -flto
+                        -fno-pic
+                        -fno-common
+                        -fno-semantic-interposition
+                        -fomit-frame-pointer
+                )
+                set(PROFILE_LINK_OPTIONS
+                        -O2
+                        -flto
+                )
+        endif()
+
+        target_compile_options(${TARGET} PRIVATE ${PROFILE_COMPILE_OPTIONS})
+        target_link_options(${TARGET} PRIVATE
+                ${PROFILE_LINK_OPTIONS}
+                -Wl,--print-memory-usage
+        )
+
+        # Per-module overrides only make sense on top of an optimized profile.
+        # With LTO the flag is recorded per function and survives the link.
+        if(NOT PROFILE STREQUAL "debug")
+                get_target_property(TARGET_SOURCES_LIST ${TARGET} SOURCES)
+                foreach(OVERRIDE ${MODULE_OPT_LEVELS})
+                        string(REPLACE "=" ";" OVERRIDE_PAIR ${OVERRIDE})
+                        list(GET OVERRIDE_PAIR 0 MODULE_DIR)
+                        list(GET OVERRIDE_PAIR 1 MODULE_FLAG)
+                        foreach(SOURCE ${TARGET_SOURCES_LIST})
+                                if(SOURCE MATCHES "^${MODULE_DIR}/.*\\.(c|cpp)$")
+                                        set_source_files_properties(${SOURCE}
+                                                PROPERTIES COMPILE_OPTIONS ${MODULE_FLAG}
+                                        )
+                                endif()
+                        endforeach()
+                endforeach()
+        endif()
+
+        message("BUILD_PROFILE=${PROFILE}")
+endfunction()
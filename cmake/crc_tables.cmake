@@ -0,0 +1,23 @@
+# Generates the slicing-by-8 CRC-32 tables at build time with
+# scripts/gen_crc_tables.py. The sources land in ${CMAKE_BINARY_DIR}/generated
+# next to build_config.h; the generated .c is returned in CRC_TABLE_SOURCES.
+
+function(generate_crc_tables)
+        find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+        set(CRC_TABLE_DIR ${CMAKE_BINARY_DIR}/generated)
+        add_custom_command(
+                OUTPUT ${CRC_TABLE_DIR}/crc_tables.c ${CRC_TABLE_DIR}/crc_tables.h
+                COMMAND Python3::Interpreter ${CMAKE_SOURCE_DIR}/scripts/gen_crc_tables.py
+                        --out-dir ${CRC_TABLE_DIR}
+                DEPENDS ${CMAKE_SOURCE_DIR}/scripts/gen_crc_tables.py
+                COMMENT "Generating CRC-32 tables"
+                VERBATIM
+        )
+
+        set(CRC_TABLE_SOURCES
+                ${CRC_TABLE_DIR}/crc_tables.c
+                ${CRC_TABLE_DIR}/crc_tables.h
+                PARENT_SCOPE
+        )
+endfunction()
@@ -0,0 +1,25 @@
+# Generates the FFT twiddle and bit-reversal tables at build time with
+# scripts/gen_fft_tables.py. The sources land in ${CMAKE_BINARY_DIR}/generated
+# next to build_config.h; the generated .c is returned in FFT_TABLE_SOURCES.
+
+set(FFT_MAX_SIZE 4096 CACHE STRING "Largest FFT the generated tables support (power of two)")
+
+function(generate_fft_tables)
+        find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+        set(FFT_TABLE_DIR ${CMAKE_BINARY_DIR}/generated)
+        add_custom_command(
+                OUTPUT ${FFT_TABLE_DIR}/fft_tables.c ${FFT_TABLE_DIR}/fft_tables.h
+                COMMAND Python3::Interpreter ${CMAKE_SOURCE_DIR}/scripts/gen_fft_tables.py
+                        --size ${FFT_MAX_SIZE} --out-dir ${FFT_TABLE_DIR}
+                DEPENDS ${CMAKE_SOURCE_DIR}/scripts/gen_fft_tables.py
+                COMMENT "Generating FFT tables for ${FFT_MAX_SIZE} points"
+                VERBATIM
+        )
+
+        set(FFT_TABLE_SOURCES
+                ${FFT_TABLE_DIR}/fft_tables.c
+                ${FFT_TABLE_DIR}/fft_tables.h
+                PARENT_SCOPE
+        )
+endfunction()
@@ -0,0 +1,94 @@
+# Profile-guided optimization of the host build of lib/.
+#
+#   pgo_instrument : configure and build an instrumented copy of the host tree
+#   pgo_train      : run every benchmark on it, all into one profile directory
+#   pgo_optimize   : rebuild the host tree with -fprofile-use
+#   pgo_report     : compare benchmark results against a Release build without PGO
+#
+# The targets depend on each other, so "cmake --build . --target pgo_report"
+# runs the whole loop. Profiles are written relative to each build directory
+# (-fprofile-prefix-path), which lets the instrumented and the optimized
+# trees live side by side. Each benchmark's libgcov merges its counters into
+# the .gcda files already there when it exits, so the profile directory ends
+# up holding the whole training set without a separate merge step (gcov-tool
+# merge crashes on GCC 12's value-profile counters).
+
+set(PGO "OFF" CACHE STRING "Host PGO mode: OFF, GENERATE or USE")
+set_property(CACHE PGO PROPERTY STRINGS OFF GENERATE USE)
+set(PGO_PROFILE_DIR ${CMAKE_BINARY_DIR}/pgo-profiles CACHE PATH "Directory holding the PGO profiles")
+
+function(apply_pgo TARGET)
+        if(PGO STREQUAL "GENERATE")
+                target_compile_options(${TARGET} PRIVATE
+                        -fprofile-generate=${PGO_PROFILE_DIR}/training
+                        -fprofile-prefix-path=${CMAKE_BINARY_DIR}
+                        -fprofile-update=prefer-atomic
+                )
+                target_link_options(${TARGET} PRIVATE
+                        -fprofile-generate=${PGO_PROFILE_DIR}/training
+                )
+        elseif(PGO STREQUAL "USE")
+                target_compile_options(${TARGET} PRIVATE
+                        -fprofile-use=${PGO_PROFILE_DIR}/training
+                        -fprofile-prefix-path=${CMAKE_BINARY_DIR}
+                        -fprofile-correction
+                        -Wno-missing-profile
+                )
+        endif()
+endfunction()
+
+function(add_pgo_targets BENCH_NAMES)
+        if(NOT PGO STREQUAL "OFF")
+                return()
+        endif()
+
+        if(NOT CMAKE_C_COMPILER_ID STREQUAL "GNU")
+                message("PGO targets need GCC, disabled")
+                return()
+        endif()
+
+        set(PGO_BUILD_ROOT ${CMAKE_BINARY_DIR}/pgo)
+        set(PGO_ARGS
+                -DHOST=True
+                -DCMAKE_BUILD_TYPE=Release
+                -DPGO_PROFILE_DIR=${PGO_PROFILE_DIR}
+        )
+
+        add_custom_target(pgo_instrument
+                COMMAND ${CMAKE_COMMAND} -S ${CMAKE_SOURCE_DIR} -B ${PGO_BUILD_ROOT}/instrumented ${PGO_ARGS} -DPGO=GENERATE
+                COMMAND ${CMAKE_COMMAND} --build ${PGO_BUILD_ROOT}/instrumented
+        )
+
+        # The runs go one after another, each adding to the previous ones' counters
+        set(TRAIN_COMMANDS
+                COMMAND ${CMAKE_COMMAND} -E remove_directory ${PGO_PROFILE_DIR}/training
+        )
+        foreach(BENCH_NAME ${BENCH_NAMES})
+                list(APPEND TRAIN_COMMANDS
+                        COMMAND ${PGO_BUILD_ROOT}/instrumented/${BENCH_NAME}
+                )
+        endforeach()
+        add_custom_target(pgo_train
+                ${TRAIN_COMMANDS}
+                DEPENDS pgo_instrument
+        )
+
+        add_custom_target(pgo_optimize
+                COMMAND ${CMAKE_COMMAND} -S ${CMAKE_SOURCE_DIR} -B ${PGO_BUILD_ROOT}/optimized ${PGO_ARGS} -DPGO=USE
+                COMMAND ${CMAKE_COMMAND} --build ${PGO_BUILD_ROOT}/optimized --clean-first
+                DEPENDS pgo_train
+        )
+
+        string(REPLACE ";" "," BENCH_LIST "${BENCH_NAMES}")
+        add_custom_target(pgo_report
+                COMMAND ${CMAKE_COMMAND} -S ${CMAKE_SOURCE_DIR} -B ${PGO_BUILD_ROOT}/baseline ${PGO_ARGS} -DPGO=OFF
+                COMMAND ${CMAKE_COMMAND} --build ${PGO_BUILD_ROOT}/baseline
+                COMMAND ${CMAKE_COMMAND}
+                        -DBENCH_NAMES=${BENCH_LIST}
+                        -DBASELINE_DIR=${PGO_BUILD_ROOT}/baseline
+                        -DOPTIMIZED_DIR=${PGO_BUILD_ROOT}/optimized
+                        -P ${CMAKE_SOURCE_DIR}/cmake/pgo_report.cmake
+                DEPENDS pgo_optimize
+                USES_TERMINAL
+        )
+endfunction()
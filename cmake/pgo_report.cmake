@@ -0,0 +1,58 @@
+# Runs every benchmark in a baseline and a PGO-optimized build and prints
+# the per-benchmark speedup. Benchmarks report "<name>: <ns> ns/op" lines.
+#
+# Usage:
+#   cmake -DBENCH_NAMES=<a,b,...> -DBASELINE_DIR=<dir> -DOPTIMIZED_DIR=<dir> -P pgo_report.cmake
+
+# Formats a value given in hundredths as "<int>.<frac>"
+function(format_centi VALUE OUT_VAR)
+        math(EXPR INT_PART "${VALUE} / 100")
+        math(EXPR FRAC_PART "${VALUE} % 100")
+        if(FRAC_PART LESS 10)
+                set(FRAC_PART "0${FRAC_PART}")
+        endif()
+        set(${OUT_VAR} "${INT_PART}.${FRAC_PART}" PARENT_SCOPE)
+endfunction()
+
+# Runs one benchmark and stores "<name>=<hundredths of ns>" pairs in OUT_VAR
+function(run_bench EXECUTABLE OUT_VAR)
+        execute_process(
+                COMMAND ${EXECUTABLE}
+                OUTPUT_VARIABLE BENCH_OUTPUT
+        )
+        string(REGEX MATCHALL "[A-Za-z0-9_]+: [0-9]+\\.[0-9][0-9] ns/op" BENCH_LINES "${BENCH_OUTPUT}")
+        set(RESULTS "")
+        foreach(LINE ${BENCH_LINES})
+                string(REGEX MATCH "^([A-Za-z0-9_]+): ([0-9]+)\\.([0-9][0-9])" _ "${LINE}")
+                list(APPEND RESULTS "${CMAKE_MATCH_1}=${CMAKE_MATCH_2}${CMAKE_MATCH_3}")
+        endforeach()
+        set(${OUT_VAR} ${RESULTS} PARENT_SCOPE)
+endfunction()
+
+string(REPLACE "," ";" BENCH_NAMES "${BENCH_NAMES}")
+
+set(REPORT "")
+foreach(BENCH_NAME ${BENCH_NAMES})
+        run_bench(${BASELINE_DIR}/${BENCH_NAME} BASELINE_RESULTS)
+        run_bench(${OPTIMIZED_DIR}/${BENCH_NAME} OPTIMIZED_RESULTS)
+
+        foreach(BASELINE ${BASELINE_RESULTS})
+                string(REPLACE "=" ";" BASELINE ${BASELINE})
+                list(GET BASELINE 0 CASE_NAME)
+                list(GET BASELINE 1 BASELINE_NS)
+                foreach(OPTIMIZED ${OPTIMIZED_RESULTS})
+                        string(REPLACE "=" ";" OPTIMIZED ${OPTIMIZED})
+                        list(GET OPTIMIZED 0 OPTIMIZED_NAME)
+                        list(GET OPTIMIZED 1 OPTIMIZED_NS)
+                        if(OPTIMIZED_NAME STREQUAL CASE_NAME AND OPTIMIZED_NS GREATER 0)
+                                math(EXPR SPEEDUP "${BASELINE_NS} * 100 / ${OPTIMIZED_NS}")
+                                format_centi(${BASELINE_NS} BASELINE_TEXT)
+                                format_centi(${OPTIMIZED_NS} OPTIMIZED_TEXT)
+                                format_centi(${SPEEDUP} SPEEDUP_TEXT)
+                                string(APPEND REPORT "${CASE_NAME}\t${BASELINE_TEXT}\t${OPTIMIZED_TEXT}\t${SPEEDUP_TEXT}x\n")
+                        endif()
+                endforeach()
+        endforeach()
+endforeach()
+
+message("benchmark\tbaseline ns/op\tpgo ns/op\tspeedup\n${REPORT}")
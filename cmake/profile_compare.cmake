@@ -0,0 +1,45 @@
+# Builds the firmware once per build profile and prints a size comparison.
+#
+# Usage:
+#   cmake -DSOURCE_DIR=<src> -DBINARY_DIR=<build> -DTOOLCHAIN_FILE=<file> -P profile_compare.cmake
+
+set(BUILD_PROFILES debug size speed)
+
+set(SIZE_TABLE "")
+foreach(PROFILE ${BUILD_PROFILES})
+        set(PROFILE_DIR ${BINARY_DIR}/profile-${PROFILE})
+
+        execute_process(
+                COMMAND ${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${PROFILE_DIR}
+                        -DCMAKE_TOOLCHAIN_FILE=${TOOLCHAIN_FILE}
+                        -DBUILD_PROFILE=${PROFILE}
+                OUTPUT_QUIET
+                RESULT_VARIABLE RESULT
+        )
+        if(NOT RESULT EQUAL 0)
+                message(FATAL_ERROR "Configuring profile '${PROFILE}' failed")
+        endif()
+
+        execute_process(
+                COMMAND ${CMAKE_COMMAND} --build ${PROFILE_DIR}
+                OUTPUT_QUIET
+                RESULT_VARIABLE RESULT
+        )
+        if(NOT RESULT EQUAL 0)
+                message(FATAL_ERROR "Building profile '${PROFILE}' failed")
+        endif()
+
+        file(GLOB PROFILE_EXECUTABLE ${PROFILE_DIR}/*.out)
+        execute_process(
+                COMMAND arm-none-eabi-size ${PROFILE_EXECUTABLE}
+                OUTPUT_VARIABLE SIZE_OUTPUT
+        )
+
+        # Second line of the Berkeley output: text data bss dec hex filename
+        string(REGEX MATCH "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" _ "${SIZE_OUTPUT}")
+        math(EXPR FLASH "${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+        math(EXPR RAM "${CMAKE_MATCH_2} + ${CMAKE_MATCH_3}")
+        string(APPEND SIZE_TABLE "${PROFILE}\t${CMAKE_MATCH_1}\t${CMAKE_MATCH_2}\t${CMAKE_MATCH_3}\t${FLASH}\t${RAM}\n")
+endforeach()
+
+message("profile\ttext\tdata\tbss\tflash\tram\n${SIZE_TABLE}")
@@ -0,0 +1,7 @@
+# Overrides for CLIENT example_client, read after config/project_info.cmake.
+#
+# A fielded unit read out over SWD: the trace buffer on for post-mortems,
+# warnings and errors only, written to SWO so no UART is spent on them.
+set(FEATURE_TRACE ON)
+set(LOG_LEVEL "warn")
+set(LOG_BACKEND "itm")
@@ -2,3 +2,35 @@ set(ENVIRONMENT "dev")
 set(CLIENT "client_name")
 set(FEATURE "custom_feature")
 set(FW_VERSION "0.0.1")
+
+# Build profile: debug, size (-Os + LTO) or speed (-O2 + LTO)
+set(BUILD_PROFILE "size" CACHE STRING "Target build profile")
+set_property(CACHE BUILD_PROFILE PROPERTY STRINGS debug size speed)
+
+# Per-module optimization overrides as "<source dir>=<flag>" pairs,
+# applied on top of the size and speed profiles
+set(MODULE_OPT_LEVELS
+        # "lib/linked_list=-O3"
+)
+
+# Clients this tree knows how to build; CLIENT must be one of them.
+# An optional config/clients/<client>.cmake overrides the feature matrix
+# below for that client.
+set(KNOWN_CLIENTS
+        client_name
+        example_client
+)
+
+# Feature matrix, compiled into the generated build_config.h.
+# Disabled features compile out to no code at all.
+set(FEATURE_TRACE OFF)
+set(FEATURE_LOGGING ON)
+set(FEATURE_LOCKING ON)
+set(FEATURE_STATS ON)
+
+# Logging backend: stdio (via _write/__io_putchar) or itm (SWO stimulus port 0)
+set(LOG_BACKEND "stdio")
+
+# Log level: error, warn or info. Left unset, it follows ENVIRONMENT:
+# errors only in prod, warnings too in test, everything in dev.
+# set(LOG_LEVEL "info")
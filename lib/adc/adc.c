@@ -0,0 +1,216 @@
+#include "adc.h"
+#include "feature_hooks.h"
+#include <string.h>
+
+#define RCC_APB1ENR_TIM2EN (1U << 0)
+#define RCC_APB2ENR_ADC1EN (1U << 8)
+#define ADC_CCR_ADCPRE_Msk (3U << 16)
+#define ADC_CCR_ADCPRE_DIV4 (1U << 16)
+#define ADC_SQR1_L_Pos 20U
+#define ADC_IRQN 18U
+#define ADC_MAX_CHANNEL_NUMBER 18U
+
+#if !defined(STM32F407xx)
+adc_regs_t adc_sim_adc1;
+adc_common_regs_t adc_sim_common;
+adc_timer_regs_t adc_sim_tim2;
+#endif
+
+static adc_config_t config;
+static dma_stream_t dma;
+static adc_stats_t stats;
+static uint32_t block_samples;
+static uint8_t initialized;
+static uint8_t running;
+
+static status_t arm_dma(void* memory0, void* memory1)
+{
+    return dma_start_double_buffer(&dma, (uintptr_t)&ADC1_REGS->DR, memory0, memory1, block_samples);
+}
+
+/* RM0090 13.8.1: with DMA cleared the ADC drops its request, then DMA is rearmed and the next trigger resumes */
+static void restart(void)
+{
+    adc_regs_t* adc = ADC1_REGS;
+    REG_CLEAR(adc->CR2, ADC_CR2_DMA);
+    REG_CLEAR(adc->SR, ADC_SR_OVR);
+    arm_dma(dma.memory[0], dma.memory[1]);
+    REG_SET(adc->CR2, ADC_CR2_DMA);
+}
+
+static void dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)context;
+    if (event == DMA_EVENT_ERROR) {
+        STAT_INC(stats.dma_errors);
+        if (running) {
+            restart();
+        }
+        return;
+    }
+    if (event != DMA_EVENT_COMPLETE) {
+        return;
+    }
+
+    /* The hardware has moved on to the other buffer; this one must be replaced before it comes back */
+    msg_t* fresh = msg_alloc(config.pool);
+    if (fresh == NULL) {
+        STAT_INC(stats.dropped_blocks);
+        return;
+    }
+    dma_set_idle_buffer(stream, msg_payload(fresh));
+
+    msg_t* block = msg_from_payload(buffer);
+    block->length = (uint16_t)(block_samples * sizeof(uint16_t));
+    block->type = config.msg_type;
+    mailbox_post(config.output, block);
+    STAT_INC(stats.blocks);
+}
+
+static void set_sample_time(adc_regs_t* adc, uint8_t channel, uint8_t code)
+{
+    if (channel < 10U) {
+        REG_MODIFY(adc->SMPR2, 7U << (channel * 3U), (uint32_t)code << (channel * 3U));
+    } else {
+        REG_MODIFY(adc->SMPR1, 7U << ((channel - 10U) * 3U), (uint32_t)code << ((channel - 10U) * 3U));
+    }
+}
+
+status_t adc_init(const adc_config_t* new_config)
+{
+    if (new_config == NULL || new_config->channel_count == 0U || new_config->channel_count > ADC_MAX_CHANNELS ||
+        new_config->sample_time > 7U || new_config->pool == NULL || new_config->output == NULL ||
+        new_config->scan_rate_hz == 0U) {
+        return FAILURE;
+    }
+    for (uint32_t i = 0; i < new_config->channel_count; i++) {
+        if (new_config->channels[i] > ADC_MAX_CHANNEL_NUMBER) {
+            return FAILURE;
+        }
+    }
+    uint32_t samples = new_config->scans_per_block * new_config->channel_count;
+    uint32_t reload = new_config->timer_clock_hz / new_config->scan_rate_hz;
+    if (samples == 0U || samples > UINT16_MAX || samples * sizeof(uint16_t) > new_config->pool->payload_size ||
+        reload < 2U) {
+        return FAILURE;
+    }
+
+    if (initialized) {
+        adc_stop();
+        dma_stream_release(&dma);
+        initialized = 0;
+    }
+
+    dma_config_t dma_config;
+    memset(&dma_config, 0, sizeof(dma_config));
+    dma_config.channel = ADC_DMA_CHANNEL;
+    dma_config.priority = 3; /* A missed request loses a sample for good */
+    dma_config.direction = DMA_PERIPH_TO_MEMORY;
+    dma_config.mode = DMA_MODE_DOUBLE_BUFFER;
+    dma_config.peripheral_size = 2;
+    dma_config.memory_size = 2;
+    dma_config.memory_increment = 1;
+    dma_config.callback = dma_event;
+    if (dma_stream_init(&dma, ADC_DMA_CONTROLLER, ADC_DMA_STREAM, &dma_config) != SUCCESS) {
+        return FAILURE;
+    }
+
+    config = *new_config;
+    block_samples = samples;
+    memset(&stats, 0, sizeof(stats));
+
+    REG_SET(HAL_RCC->APB2ENR, RCC_APB2ENR_ADC1EN);
+    REG_SET(HAL_RCC->APB1ENR, RCC_APB1ENR_TIM2EN);
+
+    /* ADCCLK = PCLK2 / 4 stays within the 36 MHz limit up to the full 84 MHz APB2 */
+    REG_MODIFY(ADC_COMMON_REGS->CCR, ADC_CCR_ADCPRE_Msk, ADC_CCR_ADCPRE_DIV4);
+
+    adc_regs_t* adc = ADC1_REGS;
+    REG_WRITE(adc->CR2, 0);
+    REG_WRITE(adc->CR1, ADC_CR1_SCAN | ADC_CR1_OVRIE);
+
+    uint32_t sqr[3] = { (uint32_t)(config.channel_count - 1U) << ADC_SQR1_L_Pos, 0, 0 };
+    for (uint32_t i = 0; i < config.channel_count; i++) {
+        /* SQR3 holds ranks 1-6, SQR2 7-12, SQR1 13-16 */
+        sqr[2U - i / 6U] |= (uint32_t)config.channels[i] << ((i % 6U) * 5U);
+        set_sample_time(adc, config.channels[i], config.sample_time);
+    }
+    REG_WRITE(adc->SQR1, sqr[0]);
+    REG_WRITE(adc->SQR2, sqr[1]);
+    REG_WRITE(adc->SQR3, sqr[2]);
+    REG_WRITE(adc->CR2, (ADC_EXTEN_RISING << ADC_CR2_EXTEN_Pos) | (ADC_EXTSEL_TIM2_TRGO << ADC_CR2_EXTSEL_Pos) |
+                            ADC_CR2_DMA | ADC_CR2_DDS);
+
+    adc_timer_regs_t* tim = ADC_TIM2_REGS;
+    REG_WRITE(tim->CR1, 0);
+    REG_WRITE(tim->PSC, 0);
+    REG_WRITE(tim->ARR, reload - 1U);
+    REG_WRITE(tim->CR2, ADC_TIM_CR2_MMS_UPDATE);
+    REG_WRITE(tim->EGR, ADC_TIM_EGR_UG);
+
+    hal_nvic_enable(ADC_IRQN);
+    initialized = 1;
+    return SUCCESS;
+}
+
+status_t adc_start(void)
+{
+    if (!initialized || running) {
+        return FAILURE;
+    }
+    msg_t* first = msg_alloc(config.pool);
+    msg_t* second = msg_alloc(config.pool);
+    if (first == NULL || second == NULL) {
+        if (first != NULL) {
+            msg_free(first);
+        }
+        if (second != NULL) {
+            msg_free(second);
+        }
+        return FAILURE;
+    }
+
+    arm_dma(msg_payload(first), msg_payload(second));
+    REG_SET(ADC1_REGS->CR2, ADC_CR2_ADON);
+    running = 1;
+    REG_SET(ADC_TIM2_REGS->CR1, ADC_TIM_CR1_CEN);
+    return SUCCESS;
+}
+
+void adc_stop(void)
+{
+    if (!running) {
+        return;
+    }
+    REG_CLEAR(ADC_TIM2_REGS->CR1, ADC_TIM_CR1_CEN);
+    REG_CLEAR(ADC1_REGS->CR2, ADC_CR2_ADON);
+    dma_stop(&dma);
+    running = 0;
+    msg_free(msg_from_payload(dma.memory[0]));
+    msg_free(msg_from_payload(dma.memory[1]));
+}
+
+void adc_irq(void)
+{
+    if ((REG_READ(ADC1_REGS->SR) & ADC_SR_OVR) == 0U) {
+        return;
+    }
+    STAT_INC(stats.overruns);
+    if (running) {
+        restart();
+    } else {
+        REG_CLEAR(ADC1_REGS->SR, ADC_SR_OVR);
+    }
+}
+
+const adc_stats_t* adc_get_stats(void)
+{
+    return &stats;
+}
+
+#if defined(STM32F407xx)
+void ADC_IRQHandler(void)
+{
+    adc_irq();
+}
+#endif
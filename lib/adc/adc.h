@@ -0,0 +1,171 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "mailbox.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Continuous ADC1 acquisition.
+ *
+ * TIM2 triggers one scan of the configured channels per sample period and
+ * DMA2 stream 0 moves each conversion into a block in double-buffer mode.
+ * Blocks are message payloads from a pool: when the hardware finishes one,
+ * the stream interrupt swaps a fresh message in as the next idle buffer and
+ * posts the full one to the output mailbox, so samples reach the processing
+ * stage without being copied. The consumer frees each block when done.
+ *
+ * If the pool is empty when a block completes, that block is dropped and
+ * refilled in place. If the ADC overruns (DMA could not keep up, or the
+ * stream stopped on an error) the acquisition is restarted from the start of
+ * the current buffers. Both are counted in adc_stats_t.
+ */
+
+#ifndef ADC_MAX_CHANNELS
+#define ADC_MAX_CHANNELS 16U
+#endif
+
+typedef struct {
+    volatile uint32_t SR;
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t SMPR1;
+    volatile uint32_t SMPR2;
+    volatile uint32_t JOFR[4];
+    volatile uint32_t HTR;
+    volatile uint32_t LTR;
+    volatile uint32_t SQR1;
+    volatile uint32_t SQR2;
+    volatile uint32_t SQR3;
+    volatile uint32_t JSQR;
+    volatile uint32_t JDR[4];
+    volatile uint32_t DR;
+} adc_regs_t;
+
+typedef struct {
+    volatile uint32_t CSR;
+    volatile uint32_t CCR;
+    volatile uint32_t CDR;
+} adc_common_regs_t;
+
+/* General-purpose timer, as far as TRGO generation needs it */
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t SMCR;
+    volatile uint32_t DIER;
+    volatile uint32_t SR;
+    volatile uint32_t EGR;
+    volatile uint32_t CCMR1;
+    volatile uint32_t CCMR2;
+    volatile uint32_t CCER;
+    volatile uint32_t CNT;
+    volatile uint32_t PSC;
+    volatile uint32_t ARR;
+} adc_timer_regs_t;
+
+#if !defined(STM32F407xx)
+extern adc_regs_t adc_sim_adc1;
+extern adc_common_regs_t adc_sim_common;
+extern adc_timer_regs_t adc_sim_tim2;
+#endif
+
+#define ADC1_REGS HAL_PERIPH(adc_regs_t, 0x40012000U, adc_sim_adc1)
+#define ADC_COMMON_REGS HAL_PERIPH(adc_common_regs_t, 0x40012300U, adc_sim_common)
+#define ADC_TIM2_REGS HAL_PERIPH(adc_timer_regs_t, 0x40000000U, adc_sim_tim2)
+
+#define ADC_SR_OVR (1U << 5)
+#define ADC_CR1_SCAN (1U << 8)
+#define ADC_CR1_OVRIE (1U << 26)
+#define ADC_CR2_ADON (1U << 0)
+#define ADC_CR2_DMA (1U << 8)
+#define ADC_CR2_DDS (1U << 9)
+#define ADC_CR2_EXTSEL_Pos 24U
+#define ADC_CR2_EXTEN_Pos 28U
+#define ADC_EXTSEL_TIM2_TRGO 6U
+#define ADC_EXTEN_RISING 1U
+
+#define ADC_TIM_CR1_CEN (1U << 0)
+#define ADC_TIM_CR2_MMS_UPDATE (2U << 4)
+#define ADC_TIM_EGR_UG (1U << 0)
+
+/** DMA request mapping of ADC1 */
+#define ADC_DMA_CONTROLLER 2U
+#define ADC_DMA_STREAM 0U
+#define ADC_DMA_CHANNEL 0U
+
+typedef struct {
+    uint8_t channels[ADC_MAX_CHANNELS]; /**< Scan order, channel numbers 0-18 */
+    uint8_t channel_count;
+    uint8_t sample_time;                /**< SMPx code 0 (3 cycles) - 7 (480 cycles), all channels */
+    uint8_t msg_type;                   /**< Stored in each posted block */
+    uint32_t scan_rate_hz;              /**< Scans per second */
+    uint32_t timer_clock_hz;            /**< TIM2 input clock */
+    uint32_t scans_per_block;
+    msg_pool_t* pool;                   /**< Payloads of at least one block */
+    mailbox_t* output;
+} adc_config_t;
+
+typedef struct {
+    uint32_t blocks;          /**< Blocks posted */
+    uint32_t dropped_blocks;  /**< Blocks overwritten because the pool was empty */
+    uint32_t overruns;        /**< ADC overruns, each followed by a restart */
+    uint32_t dma_errors;      /**< DMA errors, each followed by a restart */
+} adc_stats_t;
+
+/**
+ * @brief Configures ADC1, TIM2 and the DMA stream; does not start sampling.
+ *
+ * @return FAILURE if the configuration is invalid, a block does not fit a
+ * pool payload or exceeds 65535 samples, the scan rate cannot be derived
+ * from the timer clock, or the DMA stream is taken.
+ */
+status_t adc_init(const adc_config_t* config);
+
+/**
+ * @brief Takes two blocks from the pool and starts the trigger timer.
+ *
+ * @return FAILURE if not initialized, already running, or the pool cannot
+ * supply two blocks.
+ */
+status_t adc_start(void);
+
+/** Stops the timer, the ADC and the stream and returns the blocks in flight to the pool. */
+void adc_stop(void);
+
+/** ADC interrupt body (overrun recovery); ADC_IRQHandler calls this. */
+void adc_irq(void);
+
+/** Samples in a posted block, interleaved in scan order. */
+static inline const uint16_t* adc_block_samples(msg_t* msg)
+{
+    return (const uint16_t*)msg_payload(msg);
+}
+
+const adc_stats_t* adc_get_stats(void);
+
+#if !defined(STM32F407xx)
+/**
+ * @brief Host model of a running acquisition: converts count samples (scan
+ * order, interleaved) one trigger at a time and hands them to DMA. Samples
+ * arriving while the stream cannot take them cause an overrun, as on the
+ * hardware.
+ *
+ * @return Samples accepted by DMA.
+ */
+uint32_t adc_sim_feed(const uint16_t* samples, uint32_t count);
+
+/** Raises an overrun as if a conversion had been lost. */
+void adc_sim_overrun(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADC_H
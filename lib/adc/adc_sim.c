@@ -0,0 +1,44 @@
+#include "adc.h"
+
+#if !defined(STM32F407xx)
+
+static void raise_overrun(adc_regs_t* adc)
+{
+    if (adc->SR & ADC_SR_OVR) {
+        return;
+    }
+    adc->SR |= ADC_SR_OVR;
+    if (adc->CR1 & ADC_CR1_OVRIE) {
+        adc_irq();
+    }
+}
+
+uint32_t adc_sim_feed(const uint16_t* samples, uint32_t count)
+{
+    adc_regs_t* adc = ADC1_REGS;
+    uint32_t accepted = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        /* Without the ADC on and its trigger running nothing is converted */
+        if ((adc->CR2 & ADC_CR2_ADON) == 0U || (ADC_TIM2_REGS->CR1 & ADC_TIM_CR1_CEN) == 0U) {
+            break;
+        }
+        adc->DR = samples[i];
+
+        /* Once OVR is set the ADC issues no DMA requests until it is cleared */
+        if ((adc->CR2 & ADC_CR2_DMA) && (adc->SR & ADC_SR_OVR) == 0U &&
+            dma_sim_transfer(ADC_DMA_CONTROLLER, ADC_DMA_STREAM, &samples[i], 1) == 1U) {
+            accepted++;
+        } else {
+            raise_overrun(adc);
+        }
+    }
+    return accepted;
+}
+
+void adc_sim_overrun(void)
+{
+    raise_overrun(ADC1_REGS);
+}
+
+#endif
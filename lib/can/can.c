@@ -0,0 +1,698 @@
+#include "can.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Polls of MSR for a mode change: leaving initialisation waits for 11 recessive bits */
+#define MODE_WAIT_LOOPS 1000000U
+
+typedef struct {
+    uint8_t rcc_bit;
+    uint8_t tx_irqn;
+    uint8_t rx0_irqn;
+    uint8_t rx1_irqn;
+    uint8_t sce_irqn;
+} can_instance_t;
+
+static const can_instance_t instances[CAN_INSTANCES] = {
+    { 25, 19, 20, 21, 22 }, /* CAN1 */
+    { 26, 63, 64, 65, 66 }, /* CAN2 */
+};
+
+#if !defined(STM32F407xx)
+can_regs_t can_sim_regs[CAN_INSTANCES];
+#endif
+
+static can_t* buses[CAN_INSTANCES];
+
+/* Writes with a hardware side effect: mode requests, rc_w1 flags, FIFO release, abort */
+static void write_reg(const can_t* can, volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    (void)can;
+    REG_WRITE(*reg, value);
+#else
+    can_sim_write(can->instance, reg, value);
+#endif
+}
+
+static uint32_t id_limit(uint8_t extended)
+{
+    return extended ? CAN_EXT_EXACT : CAN_STD_EXACT;
+}
+
+/* ------------------------------------------------------------ filters --- */
+
+enum {
+    STD_EXACT = 0,
+    STD_MASK,
+    EXT_EXACT,
+    EXT_MASK,
+    CLASSES,
+};
+
+static uint8_t entry_class(const can_filter_t* filter)
+{
+    uint8_t exact = filter->mask == id_limit(filter->extended);
+    if (filter->extended) {
+        return exact ? EXT_EXACT : EXT_MASK;
+    }
+    return exact ? STD_EXACT : STD_MASK;
+}
+
+/* Whether every frame b passes also passes a */
+static uint8_t covers(const can_filter_t* a, const can_filter_t* b)
+{
+    return a->extended == b->extended && a->fifo == b->fifo && (a->mask & ~b->mask) == 0U &&
+           ((a->id ^ b->id) & a->mask) == 0U;
+}
+
+/* 16-bit filter fields: STID[10:0], RTR, IDE, EXID[17:15]; RTR and IDE always compared */
+static uint32_t std16(uint32_t id)
+{
+    return (id & CAN_STD_EXACT) << 5;
+}
+
+static uint32_t std16_mask(uint32_t mask)
+{
+    return (mask << 5) | 0x18U;
+}
+
+/* 32-bit filter fields, as in RIR */
+static uint32_t word32(uint32_t id, uint8_t extended)
+{
+    return extended ? ((id << CAN_IR_EXID_Pos) | CAN_IR_IDE) : (id << CAN_IR_STID_Pos);
+}
+
+static uint32_t mask32(uint32_t mask, uint8_t extended)
+{
+    return word32(mask, extended) | CAN_IR_IDE | CAN_IR_RTR;
+}
+
+typedef struct {
+    const can_filter_t* filters;
+    uint32_t count;
+    const uint32_t* keep;
+    uint8_t fifo;
+    uint32_t next[CLASSES];
+    uint32_t left[CLASSES];
+    can_filter_bank_t* banks;
+    uint32_t max_banks;
+    uint32_t used;
+} packer_t;
+
+static const can_filter_t* take(packer_t* p, uint8_t cls)
+{
+    if (p->left[cls] == 0U) {
+        return NULL;
+    }
+    for (uint32_t i = p->next[cls]; i < p->count; i++) {
+        const can_filter_t* filter = &p->filters[i];
+        if ((p->keep[i >> 5] & (1U << (i & 31U))) && filter->fifo == p->fifo && entry_class(filter) == cls) {
+            p->next[cls] = i + 1U;
+            p->left[cls]--;
+            return filter;
+        }
+    }
+    return NULL;
+}
+
+static status_t emit(packer_t* p, uint32_t fr1, uint32_t fr2, uint8_t list, uint8_t wide)
+{
+    if (p->used == p->max_banks) {
+        return FAILURE;
+    }
+    can_filter_bank_t* bank = &p->banks[p->used++];
+    bank->fr1 = fr1;
+    bank->fr2 = fr2;
+    bank->list = list;
+    bank->wide = wide;
+    bank->fifo = p->fifo;
+    return SUCCESS;
+}
+
+static status_t pack_fifo(packer_t* p)
+{
+    const can_filter_t* a;
+    const can_filter_t* b;
+
+    /* An odd number of standard masks leaves a 16-bit mask slot for an exact standard ID; an
+       odd number of exact extended IDs leaves a 32-bit list slot, which saves a bank when one
+       exact standard ID would otherwise need a list bank of its own */
+    uint8_t share16 = (p->left[STD_MASK] & 1U) && p->left[STD_EXACT] != 0U;
+    uint8_t share32 = (p->left[EXT_EXACT] & 1U) && ((p->left[STD_EXACT] - share16) & 3U) == 1U;
+
+    while ((a = take(p, STD_MASK)) != NULL) {
+        b = take(p, STD_MASK);
+        if (b == NULL) {
+            b = share16 ? take(p, STD_EXACT) : a;
+        }
+        if (emit(p, std16(a->id) | (std16_mask(a->mask) << 16), std16(b->id) | (std16_mask(b->mask) << 16), 0,
+                 0) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    while (p->left[STD_EXACT] > share32) {
+        uint32_t ids[4];
+        uint32_t n = 0;
+        while (n < 4U && p->left[STD_EXACT] > share32) {
+            ids[n++] = std16(take(p, STD_EXACT)->id);
+        }
+        for (uint32_t i = n; i < 4U; i++) {
+            ids[i] = ids[n - 1U]; /* Repeats match nothing new */
+        }
+        if (emit(p, ids[0] | (ids[1] << 16), ids[2] | (ids[3] << 16), 1, 0) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    while ((a = take(p, EXT_EXACT)) != NULL) {
+        b = take(p, EXT_EXACT);
+        if (b == NULL) {
+            b = share32 ? take(p, STD_EXACT) : a;
+        }
+        if (emit(p, word32(a->id, a->extended), word32(b->id, b->extended), 1, 1) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    while ((a = take(p, EXT_MASK)) != NULL) {
+        if (emit(p, word32(a->id, 1), mask32(a->mask, 1), 0, 1) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    return SUCCESS;
+}
+
+status_t can_filter_compile(const can_filter_t* filters, uint32_t count, can_filter_bank_t* banks, uint32_t max_banks,
+                            uint32_t* bank_count)
+{
+    uint32_t keep[(CAN_FILTER_MAX + 31U) / 32U];
+    if ((filters == NULL && count != 0U) || count > CAN_FILTER_MAX || banks == NULL || bank_count == NULL) {
+        return FAILURE;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t limit = id_limit(filters[i].extended);
+        if (filters[i].id > limit || filters[i].mask > limit || filters[i].fifo > 1U) {
+            return FAILURE;
+        }
+    }
+
+    /* Drop entries another one already passes; of two equal entries the first stays */
+    memset(keep, 0, sizeof(keep));
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t redundant = 0;
+        for (uint32_t j = 0; j < count && !redundant; j++) {
+            redundant = j != i && covers(&filters[j], &filters[i]) && (j < i || !covers(&filters[i], &filters[j]));
+        }
+        if (!redundant) {
+            keep[i >> 5] |= 1U << (i & 31U);
+        }
+    }
+
+    packer_t packer;
+    memset(&packer, 0, sizeof(packer));
+    packer.filters = filters;
+    packer.count = count;
+    packer.keep = keep;
+    packer.banks = banks;
+    packer.max_banks = max_banks;
+    for (uint8_t fifo = 0; fifo < 2U; fifo++) {
+        packer.fifo = fifo;
+        memset(packer.next, 0, sizeof(packer.next));
+        memset(packer.left, 0, sizeof(packer.left));
+        for (uint32_t i = 0; i < count; i++) {
+            if ((keep[i >> 5] & (1U << (i & 31U))) && filters[i].fifo == fifo) {
+                packer.left[entry_class(&filters[i])]++;
+            }
+        }
+        if (pack_fifo(&packer) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    *bank_count = packer.used;
+    return SUCCESS;
+}
+
+static status_t apply_filters(can_t* can, const can_filter_t* filters, uint16_t count)
+{
+    can_filter_bank_t banks[CAN_INSTANCE_BANKS];
+    uint32_t used;
+    if (can_filter_compile(filters, count, banks, CAN_INSTANCE_BANKS, &used) != SUCCESS) {
+        return FAILURE;
+    }
+    for (uint32_t i = 0; i < used; i++) {
+        if (can->config.rx_length[banks[i].fifo] == 0U) {
+            return FAILURE;
+        }
+    }
+
+    /* The filter registers live in CAN1 and are shared with the other instance */
+    can_regs_t* regs = CAN1_REGS;
+    uint32_t first = (can->instance - 1U) * CAN_INSTANCE_BANKS;
+    uint32_t range = ((1U << CAN_INSTANCE_BANKS) - 1U) << first;
+    uint32_t active = 0;
+    uint32_t primask = hal_irq_mask();
+    REG_WRITE(regs->FMR, (CAN_INSTANCE_BANKS << CAN_FMR_CAN2SB_Pos) | CAN_FMR_FINIT);
+    REG_CLEAR(regs->FA1R, range);
+    uint32_t fm1r = REG_READ(regs->FM1R) & ~range;
+    uint32_t fs1r = REG_READ(regs->FS1R) & ~range;
+    uint32_t ffa1r = REG_READ(regs->FFA1R) & ~range;
+    for (uint32_t i = 0; i < used; i++) {
+        uint32_t bit = 1U << (first + i);
+        fm1r |= banks[i].list ? bit : 0U;
+        fs1r |= banks[i].wide ? bit : 0U;
+        ffa1r |= banks[i].fifo ? bit : 0U;
+        active |= bit;
+        REG_WRITE(regs->FILTER[first + i].FR1, banks[i].fr1);
+        REG_WRITE(regs->FILTER[first + i].FR2, banks[i].fr2);
+    }
+    REG_WRITE(regs->FM1R, fm1r);
+    REG_WRITE(regs->FS1R, fs1r);
+    REG_WRITE(regs->FFA1R, ffa1r);
+    REG_SET(regs->FA1R, active);
+    REG_WRITE(regs->FMR, CAN_INSTANCE_BANKS << CAN_FMR_CAN2SB_Pos);
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+/* ----------------------------------------------------------- transmit --- */
+
+/* The arbitration field as a number: base ID, RTR or SRR, IDE, extension, RTR */
+static uint32_t frame_priority(const can_frame_t* frame)
+{
+    uint32_t rtr = (frame->flags & CAN_FRAME_REMOTE) ? 1U : 0U;
+    if (frame->flags & CAN_FRAME_EXTENDED) {
+        /* SRR and IDE are recessive: a standard frame with the same base ID wins */
+        return ((frame->id >> 18) << 21) | (3U << 19) | ((frame->id & 0x3FFFFU) << 1) | rtr;
+    }
+    return (frame->id << 21) | (rtr << 20);
+}
+
+static uint8_t before(const can_tx_entry_t* a, const can_tx_entry_t* b)
+{
+    return a->priority < b->priority || (a->priority == b->priority && (int32_t)(a->sequence - b->sequence) < 0);
+}
+
+static void heap_push(can_t* can, const can_tx_entry_t* entry)
+{
+    can_tx_entry_t* heap = can->tx_heap;
+    uint32_t i = can->tx_count++;
+    while (i > 0U) {
+        uint32_t parent = (i - 1U) / 2U;
+        if (!before(entry, &heap[parent])) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = *entry;
+}
+
+static void heap_pop(can_t* can)
+{
+    can_tx_entry_t* heap = can->tx_heap;
+    uint32_t count = --can->tx_count;
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2U * i + 1U;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1U < count && before(&heap[child + 1U], &heap[child])) {
+            child++;
+        }
+        if (!before(&heap[child], &heap[count])) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = heap[count];
+}
+
+static uint32_t pack(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void unpack(uint32_t word, uint8_t* data)
+{
+    data[0] = (uint8_t)word;
+    data[1] = (uint8_t)(word >> 8);
+    data[2] = (uint8_t)(word >> 16);
+    data[3] = (uint8_t)(word >> 24);
+}
+
+static void load(can_t* can, uint8_t mailbox, const can_tx_entry_t* entry)
+{
+    const can_frame_t* frame = &entry->frame;
+    can_tx_mailbox_regs_t* box = &can->regs->TX[mailbox];
+    uint32_t tir = word32(frame->id, (frame->flags & CAN_FRAME_EXTENDED) != 0U);
+    if (frame->flags & CAN_FRAME_REMOTE) {
+        tir |= CAN_IR_RTR;
+    }
+    can->tx_mailbox[mailbox] = *entry;
+    can->tx_busy |= (uint8_t)(1U << mailbox);
+    REG_WRITE(box->TDTR, frame->length);
+    REG_WRITE(box->TDLR, pack(&frame->data[0]));
+    REG_WRITE(box->TDHR, pack(&frame->data[4]));
+    REG_WRITE(box->TIR, tir | CAN_IR_TXRQ);
+}
+
+/* Moves the head of the queue into free mailboxes, or makes room for it; interrupts masked */
+static void tx_fill(can_t* can)
+{
+    while (can->tx_count != 0U) {
+        const can_tx_entry_t* head = &can->tx_heap[0];
+        uint8_t free_box = 3;
+        uint8_t worst = 3;
+        for (uint8_t m = 0; m < 3U; m++) {
+            if ((can->tx_busy & (1U << m)) == 0U) {
+                free_box = (free_box == 3U) ? m : free_box;
+            } else if (can->tx_mailbox[m].priority == head->priority) {
+                return; /* The hardware orders equal identifiers by mailbox number, not by age */
+            } else if (worst == 3U || can->tx_mailbox[m].priority > can->tx_mailbox[worst].priority) {
+                worst = m;
+            }
+        }
+        if (free_box == 3U) {
+            /* One abort at a time; the mailbox comes back through the transmit interrupt */
+            if (can->tx_aborting == 0U && head->priority < can->tx_mailbox[worst].priority) {
+                can->tx_aborting = (uint8_t)(1U << worst);
+                write_reg(can, &can->regs->TSR, CAN_TSR_ABRQ(worst));
+                STAT_INC(can->stats.tx_preempted);
+            }
+            return;
+        }
+        load(can, free_box, head);
+        heap_pop(can);
+    }
+}
+
+status_t can_send(can_t* can, const can_frame_t* frame)
+{
+    if (can == NULL || frame == NULL || frame->length > 8U ||
+        frame->id > id_limit((frame->flags & CAN_FRAME_EXTENDED) != 0U)) {
+        return FAILURE;
+    }
+    uint32_t primask = hal_irq_mask();
+    if (can->regs == NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    if (can->tx_count >= CAN_TX_QUEUE_LENGTH) {
+        STAT_INC(can->stats.tx_rejected);
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    can_tx_entry_t entry;
+    entry.priority = frame_priority(frame);
+    entry.sequence = can->tx_sequence++;
+    entry.frame = *frame;
+    heap_push(can, &entry);
+    tx_fill(can);
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+uint32_t can_tx_pending(const can_t* can)
+{
+    uint32_t busy = can->tx_busy;
+    return can->tx_count + (busy & 1U) + ((busy >> 1) & 1U) + ((busy >> 2) & 1U);
+}
+
+void can_tx_irq(uint8_t instance)
+{
+    can_t* can = buses[instance - 1U];
+    if (can == NULL) {
+        return;
+    }
+    /* can_send() from a higher-priority interrupt also works the queue */
+    uint32_t primask = hal_irq_mask();
+    uint32_t tsr = REG_READ(can->regs->TSR);
+    /* Leaving an error state raises no interrupt; a finished transmission is the moment to notice */
+    can->error_state &= (uint8_t)REG_READ(can->regs->ESR);
+    for (uint8_t m = 0; m < 3U; m++) {
+        uint8_t bit = (uint8_t)(1U << m);
+        if ((tsr & CAN_TSR_RQCP(m)) == 0U) {
+            continue;
+        }
+        write_reg(can, &can->regs->TSR, CAN_TSR_RQCP(m));
+        if (can->tx_busy & bit) {
+            can->tx_busy &= (uint8_t)~bit;
+            if (tsr & CAN_TSR_TXOK(m)) {
+                STAT_INC(can->stats.tx_frames);
+            } else {
+                heap_push(can, &can->tx_mailbox[m]); /* Aborted before it won arbitration */
+            }
+        }
+        can->tx_aborting &= (uint8_t)~bit;
+    }
+    tx_fill(can);
+    hal_irq_restore(primask);
+}
+
+/* ------------------------------------------------------------ receive --- */
+
+void can_rx_irq(uint8_t instance, uint8_t fifo)
+{
+    can_t* can = buses[instance - 1U];
+    if (can == NULL || fifo > 1U) {
+        return;
+    }
+    can_regs_t* regs = can->regs;
+    can_rx_fifo_regs_t* box = &regs->RX[fifo];
+    can_queue_t* queue = &can->rx_queue[fifo];
+    uint32_t queued = 0;
+    STAT_INC(can->stats.rx_interrupts);
+
+    while (REG_READ(regs->RFR[fifo]) & CAN_RFR_FMP_Msk) {
+        uint16_t head = queue->head;
+        uint16_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if (queue->frames != NULL && (uint16_t)(head - tail) <= queue->mask) {
+            can_frame_t* frame = &queue->frames[head & queue->mask];
+            uint32_t rir = REG_READ(box->RIR);
+            uint32_t rdtr = REG_READ(box->RDTR);
+            if (rir & CAN_IR_IDE) {
+                frame->id = rir >> CAN_IR_EXID_Pos;
+                frame->flags = CAN_FRAME_EXTENDED;
+            } else {
+                frame->id = rir >> CAN_IR_STID_Pos;
+                frame->flags = 0;
+            }
+            if (rir & CAN_IR_RTR) {
+                frame->flags |= CAN_FRAME_REMOTE;
+            }
+            frame->length = (uint8_t)(((rdtr & 0xFU) > 8U) ? 8U : (rdtr & 0xFU));
+            frame->filter = (uint8_t)(rdtr >> CAN_RDTR_FMI_Pos);
+            frame->reserved = 0;
+            unpack(REG_READ(box->RDLR), &frame->data[0]);
+            unpack(REG_READ(box->RDHR), &frame->data[4]);
+            __atomic_store_n(&queue->head, (uint16_t)(head + 1U), __ATOMIC_RELEASE);
+            queued++;
+        } else {
+            STAT_INC(can->stats.rx_dropped);
+        }
+        write_reg(can, &regs->RFR[fifo], CAN_RFR_RFOM);
+    }
+    if (REG_READ(regs->RFR[fifo]) & CAN_RFR_FOVR) {
+        STAT_INC(can->stats.rx_overruns);
+        write_reg(can, &regs->RFR[fifo], CAN_RFR_FOVR);
+    }
+    if (queued != 0U) {
+        STAT_ADD(can->stats.rx_frames, queued);
+        if (can->config.rx_notify != NULL) {
+            can->config.rx_notify(can->config.rx_context);
+        }
+    }
+}
+
+status_t can_receive(can_t* can, can_frame_t* frame)
+{
+    for (uint8_t fifo = 0; fifo < 2U; fifo++) {
+        can_queue_t* queue = &can->rx_queue[fifo];
+        uint16_t tail = queue->tail;
+        if (queue->frames != NULL && tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+            *frame = queue->frames[tail & queue->mask];
+            __atomic_store_n(&queue->tail, (uint16_t)(tail + 1U), __ATOMIC_RELEASE);
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+void can_sce_irq(uint8_t instance)
+{
+    can_t* can = buses[instance - 1U];
+    if (can == NULL) {
+        return;
+    }
+    uint8_t state = (uint8_t)(REG_READ(can->regs->ESR) & (CAN_ESR_EWGF | CAN_ESR_EPVF | CAN_ESR_BOFF));
+    uint8_t entered = (uint8_t)(state & ~can->error_state);
+    if (entered & CAN_ESR_EWGF) {
+        STAT_INC(can->stats.error_warnings);
+    }
+    if (entered & CAN_ESR_EPVF) {
+        STAT_INC(can->stats.error_passive);
+    }
+    if (entered & CAN_ESR_BOFF) {
+        STAT_INC(can->stats.bus_off);
+    }
+    can->error_state = state;
+    write_reg(can, &can->regs->MSR, CAN_MSR_ERRI);
+}
+
+/* ------------------------------------------------------------- control --- */
+
+/* Requests a mode through MCR and waits for MSR to acknowledge it */
+static status_t request_mode(can_t* can, uint32_t mcr, uint32_t ack)
+{
+    write_reg(can, &can->regs->MCR, mcr);
+    for (uint32_t i = 0; i < MODE_WAIT_LOOPS; i++) {
+        if ((REG_READ(can->regs->MSR) & (CAN_MSR_INAK | CAN_MSR_SLAK)) == ack) {
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+/* Time quanta per bit and a sample point near 87.5%, the CANopen and DeviceNet choice */
+static status_t bit_timing(uint32_t clock_hz, uint32_t bitrate, uint32_t* btr)
+{
+    if (bitrate == 0U || bitrate > 1000000U) {
+        return FAILURE;
+    }
+    for (uint32_t quanta = 20; quanta >= 8U; quanta--) {
+        uint32_t per_bit = bitrate * quanta;
+        uint32_t prescaler = clock_hz / per_bit;
+        uint32_t bs2 = (quanta + 4U) / 8U;
+        uint32_t bs1 = quanta - 1U - bs2;
+        if (clock_hz % per_bit != 0U || prescaler == 0U || prescaler > 1024U || bs1 > 16U) {
+            continue;
+        }
+        *btr = ((bs2 - 1U) << 20) | ((bs1 - 1U) << 16) | (prescaler - 1U); /* SJW of one quantum */
+        return SUCCESS;
+    }
+    return FAILURE;
+}
+
+static can_regs_t* instance_regs(uint8_t instance)
+{
+    return (instance == 1U) ? CAN1_REGS : CAN2_REGS;
+}
+
+/* Reset, initialisation mode, timing, filters, interrupts, then onto the bus */
+static status_t join(can_t* can, uint32_t btr)
+{
+    write_reg(can, &can->regs->MCR, CAN_MCR_RESET);
+    if (request_mode(can, CAN_MCR_INRQ, CAN_MSR_INAK) != SUCCESS) {
+        return FAILURE;
+    }
+    REG_WRITE(can->regs->BTR, btr);
+    if (apply_filters(can, can->config.filters, can->config.filter_count) != SUCCESS) {
+        return FAILURE;
+    }
+    REG_WRITE(can->regs->IER, CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FOVIE0 | CAN_IER_FMPIE1 | CAN_IER_FOVIE1 |
+                                  CAN_IER_EWGIE | CAN_IER_EPVIE | CAN_IER_BOFIE | CAN_IER_ERRIE);
+    /* Identifier-ordered mailboxes, overwrite on FIFO overrun, automatic retransmission and bus-off recovery */
+    return request_mode(can, CAN_MCR_ABOM, 0);
+}
+
+status_t can_init(can_t* can, uint8_t instance, const can_config_t* config)
+{
+    static const uint32_t mode_bits[] = { 0, CAN_BTR_SILM, CAN_BTR_SILM | CAN_BTR_LBKM };
+    uint32_t btr;
+    if (can == NULL || config == NULL || instance < 1U || instance > CAN_INSTANCES || config->mode > CAN_MODE_LOOPBACK ||
+        bit_timing(config->clock_hz, config->bitrate, &btr) != SUCCESS) {
+        return FAILURE;
+    }
+    for (uint32_t fifo = 0; fifo < 2U; fifo++) {
+        uint32_t length = config->rx_length[fifo];
+        if (length != 0U && (length < 2U || (length & (length - 1U)) != 0U || config->rx_buffer[fifo] == NULL)) {
+            return FAILURE;
+        }
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (buses[instance - 1U] != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    buses[instance - 1U] = can;
+    hal_irq_restore(primask);
+
+    const can_instance_t* info = &instances[instance - 1U];
+    memset(can, 0, sizeof(*can));
+    can->config = *config;
+    can->instance = instance;
+    can->regs = instance_regs(instance);
+    for (uint32_t fifo = 0; fifo < 2U; fifo++) {
+        if (config->rx_length[fifo] != 0U) {
+            can->rx_queue[fifo].frames = config->rx_buffer[fifo];
+            can->rx_queue[fifo].mask = (uint16_t)(config->rx_length[fifo] - 1U);
+        }
+    }
+
+    /* CAN2 reaches its filters through CAN1, which needs its clock either way */
+    REG_SET(HAL_RCC->APB1ENR, (1U << instances[0].rcc_bit) | (1U << info->rcc_bit));
+    if (join(can, btr | mode_bits[config->mode]) != SUCCESS) {
+        write_reg(can, &can->regs->MCR, CAN_MCR_RESET);
+        can->regs = NULL;
+        buses[instance - 1U] = NULL;
+        return FAILURE;
+    }
+    hal_nvic_enable(info->tx_irqn);
+    hal_nvic_enable(info->rx0_irqn);
+    hal_nvic_enable(info->rx1_irqn);
+    hal_nvic_enable(info->sce_irqn);
+    return SUCCESS;
+}
+
+void can_deinit(can_t* can)
+{
+    if (can == NULL || can->regs == NULL) {
+        return;
+    }
+    const can_instance_t* info = &instances[can->instance - 1U];
+    hal_nvic_disable(info->tx_irqn);
+    hal_nvic_disable(info->rx0_irqn);
+    hal_nvic_disable(info->rx1_irqn);
+    hal_nvic_disable(info->sce_irqn);
+
+    uint32_t primask = hal_irq_mask();
+    uint32_t range = ((1U << CAN_INSTANCE_BANKS) - 1U) << ((can->instance - 1U) * CAN_INSTANCE_BANKS);
+    REG_CLEAR(CAN1_REGS->FA1R, range);
+    /* The reset leaves the bus, drops pending mailboxes and puts the controller to sleep */
+    write_reg(can, &can->regs->MCR, CAN_MCR_RESET);
+    buses[can->instance - 1U] = NULL;
+    can->regs = NULL;
+    can->tx_count = 0;
+    can->tx_busy = 0;
+    can->tx_aborting = 0;
+    hal_irq_restore(primask);
+}
+
+status_t can_set_filters(can_t* can, const can_filter_t* filters, uint16_t count)
+{
+    if (can == NULL || can->regs == NULL || apply_filters(can, filters, count) != SUCCESS) {
+        return FAILURE;
+    }
+    can->config.filters = filters;
+    can->config.filter_count = count;
+    return SUCCESS;
+}
+
+const can_stats_t* can_get_stats(const can_t* can)
+{
+    return &can->stats;
+}
+
+#if defined(STM32F407xx)
+void CAN1_TX_IRQHandler(void) { can_tx_irq(1); }
+void CAN1_RX0_IRQHandler(void) { can_rx_irq(1, 0); }
+void CAN1_RX1_IRQHandler(void) { can_rx_irq(1, 1); }
+void CAN1_SCE_IRQHandler(void) { can_sce_irq(1); }
+void CAN2_TX_IRQHandler(void) { can_tx_irq(2); }
+void CAN2_RX0_IRQHandler(void) { can_rx_irq(2, 0); }
+void CAN2_RX1_IRQHandler(void) { can_rx_irq(2, 1); }
+void CAN2_SCE_IRQHandler(void) { can_sce_irq(2); }
+#endif
@@ -0,0 +1,374 @@
+#ifndef CAN_H
+#define CAN_H
+
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CAN1 and CAN2 (bxCAN) with hardware acceptance filtering, interrupt-side
+ * receive draining and a priority-ordered transmit queue.
+ *
+ * Filtering: the application lists the identifiers (or identifier/mask
+ * pairs) it wants and can_filter_compile() packs them into the fewest filter
+ * banks: four exact standard IDs per bank in 16-bit list mode, two standard
+ * masks in 16-bit mask mode, two exact extended IDs in 32-bit list mode and
+ * one extended mask in 32-bit mask mode, with left-over slots shared between
+ * classes and entries another entry already covers dropped. Frames nothing
+ * asks for are discarded by the controller and never cost an interrupt. The
+ * 28 banks are split evenly: CAN1 has banks 0-13, CAN2 banks 14-27.
+ * Filters accept data frames only.
+ *
+ * Receive: each filter routes to one of the two hardware FIFOs (three frames
+ * deep). Each FIFO has its own interrupt, which drains every frame pending in
+ * it into that FIFO's software queue, a single-producer single-consumer ring
+ * the application provides; the reader takes frames with can_receive()
+ * without masking interrupts. FIFO 0 is read first, so routing urgent
+ * identifiers there gives them priority over a backlog in FIFO 1.
+ *
+ * Transmit: can_send() copies the frame into a queue kept in bus
+ * arbitration order (lowest identifier first, frames with equal identifiers
+ * in submission order) and the three mailboxes are refilled from its head by
+ * the transmit interrupt. When all three hold frames of lower priority than
+ * the head of the queue, the lowest is aborted and goes back into the queue,
+ * so a lower-priority backlog never delays an urgent frame by more than the
+ * frame on the wire. At most one mailbox holds a given identifier at a time,
+ * which keeps same-identifier frames in order.
+ */
+
+#define CAN_INSTANCES 2U
+#define CAN_FILTER_BANKS 28U
+
+/** Filter banks each instance owns (CAN2SB = 14) */
+#define CAN_INSTANCE_BANKS 14U
+
+/** Most filter entries can_filter_compile() takes: four per bank */
+#define CAN_FILTER_MAX (4U * CAN_FILTER_BANKS)
+
+/** Capacity of each instance's transmit queue, mailboxes not included. */
+#ifndef CAN_TX_QUEUE_LENGTH
+#define CAN_TX_QUEUE_LENGTH 16
+#endif
+
+typedef struct {
+    volatile uint32_t TIR;
+    volatile uint32_t TDTR;
+    volatile uint32_t TDLR;
+    volatile uint32_t TDHR;
+} can_tx_mailbox_regs_t;
+
+typedef struct {
+    volatile uint32_t RIR;
+    volatile uint32_t RDTR;
+    volatile uint32_t RDLR;
+    volatile uint32_t RDHR;
+} can_rx_fifo_regs_t;
+
+typedef struct {
+    volatile uint32_t FR1;
+    volatile uint32_t FR2;
+} can_filter_regs_t;
+
+typedef struct {
+    volatile uint32_t MCR;
+    volatile uint32_t MSR;
+    volatile uint32_t TSR;
+    volatile uint32_t RFR[2];           /**< RF0R, RF1R */
+    volatile uint32_t IER;
+    volatile uint32_t ESR;
+    volatile uint32_t BTR;
+    uint32_t reserved0[88];
+    can_tx_mailbox_regs_t TX[3];        /**< 0x180 */
+    can_rx_fifo_regs_t RX[2];           /**< 0x1B0 */
+    uint32_t reserved1[12];
+    volatile uint32_t FMR;              /**< 0x200; this and the filters exist in CAN1 only */
+    volatile uint32_t FM1R;
+    uint32_t reserved2;
+    volatile uint32_t FS1R;
+    uint32_t reserved3;
+    volatile uint32_t FFA1R;
+    uint32_t reserved4;
+    volatile uint32_t FA1R;
+    uint32_t reserved5[8];
+    can_filter_regs_t FILTER[CAN_FILTER_BANKS]; /**< 0x240 */
+} can_regs_t;
+
+#if !defined(STM32F407xx)
+extern can_regs_t can_sim_regs[CAN_INSTANCES];
+#endif
+
+#define CAN1_REGS HAL_PERIPH(can_regs_t, 0x40006400U, can_sim_regs[0])
+#define CAN2_REGS HAL_PERIPH(can_regs_t, 0x40006800U, can_sim_regs[1])
+
+#define CAN_MCR_INRQ (1U << 0)
+#define CAN_MCR_SLEEP (1U << 1)
+#define CAN_MCR_TXFP (1U << 2)
+#define CAN_MCR_RFLM (1U << 3)
+#define CAN_MCR_NART (1U << 4)
+#define CAN_MCR_ABOM (1U << 6)
+#define CAN_MCR_RESET (1U << 15)
+
+#define CAN_MSR_INAK (1U << 0)
+#define CAN_MSR_SLAK (1U << 1)
+#define CAN_MSR_ERRI (1U << 2)
+
+#define CAN_TSR_RQCP(mailbox) (1U << ((mailbox) * 8U))
+#define CAN_TSR_TXOK(mailbox) (2U << ((mailbox) * 8U))
+#define CAN_TSR_ABRQ(mailbox) (0x80U << ((mailbox) * 8U))
+#define CAN_TSR_TME(mailbox) (1U << (26U + (mailbox)))
+
+#define CAN_RFR_FMP_Msk 0x3U
+#define CAN_RFR_FULL (1U << 3)
+#define CAN_RFR_FOVR (1U << 4)
+#define CAN_RFR_RFOM (1U << 5)
+
+#define CAN_IER_TMEIE (1U << 0)
+#define CAN_IER_FMPIE0 (1U << 1)
+#define CAN_IER_FOVIE0 (1U << 3)
+#define CAN_IER_FMPIE1 (1U << 4)
+#define CAN_IER_FOVIE1 (1U << 6)
+#define CAN_IER_EWGIE (1U << 8)
+#define CAN_IER_EPVIE (1U << 9)
+#define CAN_IER_BOFIE (1U << 10)
+#define CAN_IER_LECIE (1U << 11)
+#define CAN_IER_ERRIE (1U << 15)
+
+#define CAN_ESR_EWGF (1U << 0)
+#define CAN_ESR_EPVF (1U << 1)
+#define CAN_ESR_BOFF (1U << 2)
+#define CAN_ESR_LEC_Pos 4U
+#define CAN_ESR_LEC_Msk (7U << CAN_ESR_LEC_Pos)
+#define CAN_ESR_TEC_Pos 16U
+#define CAN_ESR_REC_Pos 24U
+
+#define CAN_BTR_LBKM (1U << 30)
+#define CAN_BTR_SILM (1U << 31)
+
+/* TIR and RIR */
+#define CAN_IR_TXRQ (1U << 0)
+#define CAN_IR_RTR (1U << 1)
+#define CAN_IR_IDE (1U << 2)
+#define CAN_IR_EXID_Pos 3U
+#define CAN_IR_STID_Pos 21U
+
+#define CAN_RDTR_FMI_Pos 8U
+
+#define CAN_FMR_FINIT (1U << 0)
+#define CAN_FMR_CAN2SB_Pos 8U
+
+/** Identifier mask with every bit significant */
+#define CAN_STD_EXACT 0x7FFU
+#define CAN_EXT_EXACT 0x1FFFFFFFU
+
+#define CAN_FRAME_EXTENDED (1U << 0) /**< 29-bit identifier */
+#define CAN_FRAME_REMOTE (1U << 1)   /**< Remote frame; never passes the filters */
+
+typedef struct {
+    uint32_t id;                /**< 11 or 29 bits */
+    uint8_t flags;              /**< CAN_FRAME_* */
+    uint8_t length;             /**< 0-8 */
+    uint8_t filter;             /**< Received frames: filter match index (FMI) */
+    uint8_t reserved;
+    uint8_t data[8];
+} can_frame_t;
+
+/** A wanted identifier, or a set of them: frames with (id & mask) == (filter id & mask) pass. */
+typedef struct {
+    uint32_t id;
+    uint32_t mask;              /**< CAN_STD_EXACT or CAN_EXT_EXACT for a single identifier */
+    uint8_t extended;
+    uint8_t fifo;               /**< 0 or 1 */
+} can_filter_t;
+
+/** One filter bank as can_filter_compile() lays it out. */
+typedef struct {
+    uint32_t fr1;
+    uint32_t fr2;
+    uint8_t list;               /**< Identifier list mode, else identifier/mask */
+    uint8_t wide;               /**< One 32-bit filter or two, else two or four 16-bit ones */
+    uint8_t fifo;
+} can_filter_bank_t;
+
+typedef enum {
+    CAN_MODE_NORMAL = 0,
+    CAN_MODE_SILENT,            /**< Listen only: receives, never drives the bus */
+    CAN_MODE_LOOPBACK,          /**< Sent frames are received by this controller and not driven onto the bus */
+} can_mode_t;
+
+/** Called from the receive interrupt when it queued frames; optional. */
+typedef void (*can_notify_t)(void* context);
+
+typedef struct {
+    uint32_t clock_hz;          /**< PCLK1 */
+    uint32_t bitrate;           /**< Up to 1 Mbit/s */
+    uint8_t mode;               /**< can_mode_t */
+    const can_filter_t* filters;
+    uint16_t filter_count;
+    uint16_t rx_length[2];      /**< Frames of each FIFO's queue, a power of two; 0 if no filter routes there */
+    can_frame_t* rx_buffer[2];
+    can_notify_t rx_notify;
+    void* rx_context;
+} can_config_t;
+
+typedef struct {
+    uint32_t rx_frames;         /**< Queued for the reader */
+    uint32_t rx_dropped;        /**< Taken from a FIFO while its queue was full */
+    uint32_t rx_overruns;       /**< Hardware FIFO overruns: frames lost before the interrupt ran */
+    uint32_t rx_interrupts;
+    uint32_t tx_frames;         /**< Acknowledged on the bus */
+    uint32_t tx_rejected;       /**< can_send() with the queue full */
+    uint32_t tx_preempted;      /**< Mailboxes aborted for a higher-priority frame */
+    uint32_t error_warnings;    /**< Entries into each error state */
+    uint32_t error_passive;
+    uint32_t bus_off;           /**< Recovered from by the controller after 128 x 11 recessive bits */
+} can_stats_t;
+
+/** Queued frame with its place in arbitration order */
+typedef struct {
+    uint32_t priority;          /**< Arbitration field; lower wins */
+    uint32_t sequence;          /**< Submission order among equal priorities */
+    can_frame_t frame;
+} can_tx_entry_t;
+
+typedef struct {
+    can_frame_t* frames;
+    uint16_t mask;              /**< Length - 1 */
+    uint16_t head;              /**< Written by the receive interrupt only */
+    uint16_t tail;              /**< Written by can_receive() only */
+} can_queue_t;
+
+typedef struct {
+    can_regs_t* regs;
+    uint8_t instance;
+    uint8_t tx_busy;            /**< Mailboxes holding a frame, one bit each */
+    uint8_t tx_aborting;        /**< Mailboxes with an abort requested */
+    uint8_t error_state;        /**< ESR EWGF, EPVF and BOFF as last seen */
+    uint16_t tx_count;
+    uint32_t tx_sequence;
+    can_tx_entry_t tx_mailbox[3];
+    can_tx_entry_t tx_heap[CAN_TX_QUEUE_LENGTH + 3]; /**< Room for aborted frames coming back */
+    can_queue_t rx_queue[2];
+    can_config_t config;
+    can_stats_t stats;
+} can_t;
+
+/**
+ * @brief Packs filter entries into the fewest filter banks.
+ *
+ * @param filters Entries; for each, id bits outside the mask are ignored.
+ * @param count At most CAN_FILTER_MAX.
+ * @param banks Receives the layout.
+ * @param max_banks Capacity of banks.
+ * @param bank_count Receives the number of banks used.
+ * @return FAILURE for an invalid entry (identifier or mask out of range,
+ * FIFO above 1) or if the entries need more than max_banks banks.
+ */
+status_t can_filter_compile(const can_filter_t* filters, uint32_t count, can_filter_bank_t* banks, uint32_t max_banks,
+                            uint32_t* bank_count);
+
+/**
+ * @brief Resets an instance, programs the bit timing and filters and joins
+ * the bus.
+ *
+ * @param instance 1 or 2.
+ * @return FAILURE if the configuration is invalid, the bit rate cannot be
+ * reached exactly from clock_hz, the filters do not fit or route to a FIFO
+ * without a queue, the instance is in use, or the controller does not
+ * leave initialisation mode (the bus never shows 11 recessive bits).
+ */
+status_t can_init(can_t* can, uint8_t instance, const can_config_t* config);
+
+/**
+ * @brief Leaves the bus and disables the instance's filters. Frames still
+ * queued for transmit are discarded; received ones stay readable.
+ */
+void can_deinit(can_t* can);
+
+/**
+ * @brief Replaces the instance's filters. Reception through the instance's
+ * banks pauses while they are rewritten.
+ *
+ * @return FAILURE, with the old filters left in place, if the entries are
+ * invalid, do not fit in the instance's banks or route to a FIFO without a
+ * queue.
+ */
+status_t can_set_filters(can_t* can, const can_filter_t* filters, uint16_t count);
+
+/**
+ * @brief Queues a frame for transmission; safe from any context.
+ *
+ * @return FAILURE if the frame is invalid, the instance is not running or
+ * the queue is full.
+ */
+status_t can_send(can_t* can, const can_frame_t* frame);
+
+/** Frames queued or in mailboxes, not yet acknowledged. */
+uint32_t can_tx_pending(const can_t* can);
+
+/**
+ * @brief Takes the oldest received frame, from FIFO 0's queue before
+ * FIFO 1's. Lock-free; call from one context only.
+ *
+ * @return FAILURE if both queues are empty.
+ */
+status_t can_receive(can_t* can, can_frame_t* frame);
+
+/** Transmit interrupt body; the CANn_TX_IRQHandler vectors call this. */
+void can_tx_irq(uint8_t instance);
+
+/** Receive interrupt body for FIFO 0 or 1; the CANn_RXm_IRQHandler vectors call this. */
+void can_rx_irq(uint8_t instance, uint8_t fifo);
+
+/** Status change and error interrupt body; the CANn_SCE_IRQHandler vectors call this. */
+void can_sce_irq(uint8_t instance);
+
+const can_stats_t* can_get_stats(const can_t* can);
+
+#if !defined(STM32F407xx)
+/*
+ * Host model of the controller. Filter matching follows RM0090 32.7.4 over
+ * the bank registers, including the filter match index and the priority
+ * rules between matching filters; FIFOs are three frames deep and overrun by
+ * overwriting the newest frame. Register writes with side effects (mode
+ * requests, rc_w1 flags, FIFO release, transmit abort) go through
+ * can_sim_write(), which can.c calls in place of the plain store.
+ */
+
+/**
+ * @brief Host model: count frames arrive back to back, before the receive
+ * interrupts get to run; then the interrupts of the FIFOs they went to run.
+ *
+ * @return Frames accepted by the filters, overwritten ones included.
+ */
+uint32_t can_sim_receive(can_t* can, const can_frame_t* frames, uint32_t count);
+
+/**
+ * @brief Host model: the controller sends up to max frames, one arbitration
+ * per frame among the pending mailboxes, and runs the transmit interrupt
+ * after each. Pending abort requests are honoured first. In loopback mode
+ * each frame is also received.
+ *
+ * @param out Receives the frames driven onto the bus; may be NULL.
+ * @return Frames sent.
+ */
+uint32_t can_sim_transmit(can_t* can, can_frame_t* out, uint32_t max);
+
+/**
+ * @brief Host model: the error counters reach the given values and the last
+ * error code is set; the error interrupt runs if a state it watches changed.
+ */
+void can_sim_error(can_t* can, uint16_t tec, uint8_t rec, uint8_t lec);
+
+/** Store to a register with hardware side effects, on behalf of can.c. */
+void can_sim_write(uint8_t instance, volatile uint32_t* reg, uint32_t value);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAN_H
@@ -0,0 +1,322 @@
+#include "can.h"
+#include <stddef.h>
+
+#if !defined(STM32F407xx)
+
+typedef struct {
+    uint32_t rir;
+    uint32_t rdtr;
+    uint32_t rdlr;
+    uint32_t rdhr;
+} sim_frame_t;
+
+/* The three-deep receive FIFOs; the output mailbox registers show the oldest */
+typedef struct {
+    sim_frame_t slots[3];
+    uint8_t count;
+} sim_fifo_t;
+
+static sim_fifo_t fifos[CAN_INSTANCES][2];
+
+static void publish(can_regs_t* regs, uint8_t instance, uint8_t fifo)
+{
+    sim_fifo_t* q = &fifos[instance - 1U][fifo];
+    if (q->count != 0U) {
+        regs->RX[fifo].RIR = q->slots[0].rir;
+        regs->RX[fifo].RDTR = q->slots[0].rdtr;
+        regs->RX[fifo].RDLR = q->slots[0].rdlr;
+        regs->RX[fifo].RDHR = q->slots[0].rdhr;
+    }
+    regs->RFR[fifo] = (regs->RFR[fifo] & CAN_RFR_FOVR) | q->count | ((q->count == 3U) ? CAN_RFR_FULL : 0U);
+}
+
+static uint32_t ir_word(const can_frame_t* frame)
+{
+    uint32_t word = (frame->flags & CAN_FRAME_EXTENDED) ? ((frame->id << CAN_IR_EXID_Pos) | CAN_IR_IDE)
+                                                        : (frame->id << CAN_IR_STID_Pos);
+    return word | ((frame->flags & CAN_FRAME_REMOTE) ? CAN_IR_RTR : 0U);
+}
+
+/* The same word in 16-bit filter layout: STID[10:0], RTR, IDE, EXID[17:15] */
+static uint32_t ir_half(uint32_t ir)
+{
+    return ((ir >> 16) & 0xFFE0U) | ((ir & CAN_IR_RTR) << 3) | ((ir & CAN_IR_IDE) << 1) | ((ir >> 18) & 7U);
+}
+
+/*
+ * RM0090 32.7.4: filters are numbered per FIFO in bank order, active or not;
+ * among matching filters a 32-bit one beats a 16-bit one, then list beats
+ * mask, then the lower number wins. Returns the filter number or -1.
+ */
+static int32_t match(uint8_t instance, uint32_t ir, uint8_t* fifo)
+{
+    const can_regs_t* regs = &can_sim_regs[0];
+    if (regs->FMR & CAN_FMR_FINIT) {
+        return -1;
+    }
+    uint32_t split = (regs->FMR >> CAN_FMR_CAN2SB_Pos) & 0x3FU;
+    uint32_t first = (instance == 1U) ? 0U : split;
+    uint32_t last = (instance == 1U) ? split : CAN_FILTER_BANKS;
+    uint32_t numbers[2] = { 0, 0 };
+    int32_t best = -1;
+    uint32_t best_rank = 0;
+    uint32_t half = ir_half(ir);
+
+    for (uint32_t bank = first; bank < last; bank++) {
+        uint32_t bit = 1U << bank;
+        uint8_t list = (regs->FM1R & bit) != 0U;
+        uint8_t wide = (regs->FS1R & bit) != 0U;
+        uint8_t assigned = (regs->FFA1R & bit) != 0U;
+        uint32_t fr1 = regs->FILTER[bank].FR1;
+        uint32_t fr2 = regs->FILTER[bank].FR2;
+        uint32_t count = wide ? (list ? 2U : 1U) : (list ? 4U : 2U);
+        for (uint32_t k = 0; k < count && (regs->FA1R & bit); k++) {
+            uint8_t hit;
+            if (wide) {
+                hit = list ? (ir == ((k == 0U) ? fr1 : fr2)) : (((ir ^ fr1) & fr2) == 0U);
+            } else if (list) {
+                uint32_t word = (k < 2U) ? fr1 : fr2;
+                hit = half == ((word >> ((k & 1U) * 16U)) & 0xFFFFU);
+            } else {
+                uint32_t word = (k == 0U) ? fr1 : fr2;
+                hit = ((half ^ word) & (word >> 16) & 0xFFFFU) == 0U;
+            }
+            uint32_t rank = 4U + wide * 2U + list;
+            if (hit && rank > best_rank) {
+                best = (int32_t)(numbers[assigned] + k);
+                best_rank = rank;
+                *fifo = assigned;
+            }
+        }
+        numbers[assigned] += count;
+    }
+    return best;
+}
+
+/* A frame finishes on the bus and goes through the filters; returns its FIFO or -1 */
+static int32_t deliver(can_regs_t* regs, uint8_t instance, const can_frame_t* frame)
+{
+    uint8_t fifo = 0;
+    uint32_t ir = ir_word(frame);
+    int32_t number = match(instance, ir, &fifo);
+    if (number < 0) {
+        return -1;
+    }
+    sim_frame_t slot;
+    slot.rir = ir;
+    slot.rdtr = ((uint32_t)number << CAN_RDTR_FMI_Pos) | frame->length;
+    slot.rdlr = (uint32_t)frame->data[0] | ((uint32_t)frame->data[1] << 8) | ((uint32_t)frame->data[2] << 16) |
+                ((uint32_t)frame->data[3] << 24);
+    slot.rdhr = (uint32_t)frame->data[4] | ((uint32_t)frame->data[5] << 8) | ((uint32_t)frame->data[6] << 16) |
+                ((uint32_t)frame->data[7] << 24);
+
+    sim_fifo_t* q = &fifos[instance - 1U][fifo];
+    if (q->count < 3U) {
+        q->slots[q->count++] = slot;
+    } else {
+        /* Overrun: without RFLM the newest frame in the FIFO is replaced */
+        regs->RFR[fifo] |= CAN_RFR_FOVR;
+        if ((regs->MCR & CAN_MCR_RFLM) == 0U) {
+            q->slots[2] = slot;
+        }
+    }
+    publish(regs, instance, fifo);
+    return fifo;
+}
+
+static void raise_rx(can_t* can, uint8_t fifos_touched)
+{
+    static const uint32_t enables[2] = { CAN_IER_FMPIE0 | CAN_IER_FOVIE0, CAN_IER_FMPIE1 | CAN_IER_FOVIE1 };
+    for (uint8_t fifo = 0; fifo < 2U; fifo++) {
+        if ((fifos_touched & (1U << fifo)) && can->regs != NULL && (can->regs->IER & enables[fifo])) {
+            can_rx_irq(can->instance, fifo);
+        }
+    }
+}
+
+static void raise_tx(can_t* can)
+{
+    if (can->regs != NULL && (can->regs->IER & CAN_IER_TMEIE)) {
+        can_tx_irq(can->instance);
+    }
+}
+
+static uint8_t on_bus(const can_regs_t* regs)
+{
+    return (regs->MSR & (CAN_MSR_INAK | CAN_MSR_SLAK)) == 0U;
+}
+
+uint32_t can_sim_receive(can_t* can, const can_frame_t* frames, uint32_t count)
+{
+    can_regs_t* regs = can->regs;
+    /* In loopback the receive pin is disconnected */
+    if (regs == NULL || !on_bus(regs) || (regs->BTR & CAN_BTR_LBKM)) {
+        return 0;
+    }
+    uint32_t accepted = 0;
+    uint8_t touched = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t fifo = deliver(regs, can->instance, &frames[i]);
+        if (fifo >= 0) {
+            touched |= (uint8_t)(1U << fifo);
+            accepted++;
+        }
+    }
+    raise_rx(can, touched);
+    return accepted;
+}
+
+/* Arbitration field of a mailbox as a number, lower wins; see frame_priority() in can.c */
+static uint32_t mailbox_priority(uint32_t tir)
+{
+    uint32_t rtr = (tir & CAN_IR_RTR) ? 1U : 0U;
+    if (tir & CAN_IR_IDE) {
+        uint32_t id = tir >> CAN_IR_EXID_Pos;
+        return ((id >> 18) << 21) | (3U << 19) | ((id & 0x3FFFFU) << 1) | rtr;
+    }
+    return ((tir >> CAN_IR_STID_Pos) << 21) | (rtr << 20);
+}
+
+uint32_t can_sim_transmit(can_t* can, can_frame_t* out, uint32_t max)
+{
+    uint32_t sent = 0;
+    while (sent < max && can->regs != NULL && on_bus(can->regs)) {
+        can_regs_t* regs = can->regs;
+        /* A listen-only controller never wins arbitration */
+        if ((regs->BTR & (CAN_BTR_SILM | CAN_BTR_LBKM)) == CAN_BTR_SILM) {
+            break;
+        }
+
+        uint8_t aborted = 0;
+        for (uint8_t m = 0; m < 3U; m++) {
+            if (regs->TSR & CAN_TSR_ABRQ(m)) {
+                regs->TSR &= ~CAN_TSR_ABRQ(m);
+                if (regs->TX[m].TIR & CAN_IR_TXRQ) {
+                    regs->TX[m].TIR &= ~CAN_IR_TXRQ;
+                    regs->TSR = (regs->TSR & ~CAN_TSR_TXOK(m)) | CAN_TSR_RQCP(m) | CAN_TSR_TME(m);
+                    aborted = 1;
+                }
+            }
+        }
+        if (aborted) {
+            raise_tx(can);
+            continue;
+        }
+
+        /* Equal identifiers go out in mailbox order */
+        uint8_t winner = 3;
+        for (uint8_t m = 0; m < 3U; m++) {
+            if ((regs->TX[m].TIR & CAN_IR_TXRQ) &&
+                (winner == 3U || mailbox_priority(regs->TX[m].TIR) < mailbox_priority(regs->TX[winner].TIR))) {
+                winner = m;
+            }
+        }
+        if (winner == 3U) {
+            break;
+        }
+        can_tx_mailbox_regs_t* box = &regs->TX[winner];
+        can_frame_t frame;
+        uint32_t tir = box->TIR;
+        frame.flags = (uint8_t)(((tir & CAN_IR_IDE) ? CAN_FRAME_EXTENDED : 0U) | ((tir & CAN_IR_RTR) ? CAN_FRAME_REMOTE : 0U));
+        frame.id = (tir & CAN_IR_IDE) ? (tir >> CAN_IR_EXID_Pos) : (tir >> CAN_IR_STID_Pos);
+        frame.length = (uint8_t)(box->TDTR & 0xFU);
+        frame.filter = 0;
+        frame.reserved = 0;
+        for (uint32_t i = 0; i < 4U; i++) {
+            frame.data[i] = (uint8_t)(box->TDLR >> (8U * i));
+            frame.data[4U + i] = (uint8_t)(box->TDHR >> (8U * i));
+        }
+        box->TIR = tir & ~CAN_IR_TXRQ;
+        regs->TSR |= CAN_TSR_RQCP(winner) | CAN_TSR_TXOK(winner) | CAN_TSR_TME(winner);
+        if (out != NULL && (regs->BTR & CAN_BTR_SILM) == 0U) {
+            out[sent] = frame;
+        }
+        sent++;
+        if (regs->BTR & CAN_BTR_LBKM) {
+            int32_t fifo = deliver(regs, can->instance, &frame);
+            if (fifo >= 0) {
+                raise_rx(can, (uint8_t)(1U << fifo));
+            }
+        }
+        raise_tx(can);
+    }
+    return sent;
+}
+
+void can_sim_error(can_t* can, uint16_t tec, uint8_t rec, uint8_t lec)
+{
+    can_regs_t* regs = can->regs;
+    if (regs == NULL) {
+        return;
+    }
+    uint32_t old = regs->ESR & (CAN_ESR_EWGF | CAN_ESR_EPVF | CAN_ESR_BOFF);
+    uint32_t state = ((tec > 255U) ? CAN_ESR_BOFF : 0U) | ((tec > 127U || rec > 127U) ? CAN_ESR_EPVF : 0U) |
+                     ((tec >= 96U || rec >= 96U) ? CAN_ESR_EWGF : 0U);
+    regs->ESR = ((uint32_t)((tec > 255U) ? 255U : tec) << CAN_ESR_TEC_Pos) | ((uint32_t)rec << CAN_ESR_REC_Pos) |
+                ((uint32_t)(lec & 7U) << CAN_ESR_LEC_Pos) | state;
+
+    uint32_t entered = state & ~old;
+    uint32_t ier = regs->IER;
+    uint8_t raise = ((entered & CAN_ESR_EWGF) && (ier & CAN_IER_EWGIE)) ||
+                    ((entered & CAN_ESR_EPVF) && (ier & CAN_IER_EPVIE)) ||
+                    ((entered & CAN_ESR_BOFF) && (ier & CAN_IER_BOFIE)) || (lec != 0U && (ier & CAN_IER_LECIE));
+    if (raise && (ier & CAN_IER_ERRIE)) {
+        regs->MSR |= CAN_MSR_ERRI;
+        can_sce_irq(can->instance);
+    }
+}
+
+void can_sim_write(uint8_t instance, volatile uint32_t* reg, uint32_t value)
+{
+    can_regs_t* regs = &can_sim_regs[instance - 1U];
+    uint32_t old = *reg;
+    hal_reg_write(reg, value);
+
+    if (reg == &regs->MCR) {
+        if (value & CAN_MCR_RESET) {
+            /* Master reset: sleep mode, mailboxes empty, FIFOs flushed; filters untouched */
+            regs->MCR = (1U << 16) | CAN_MCR_SLEEP;
+            regs->MSR = CAN_MSR_SLAK;
+            regs->TSR = CAN_TSR_TME(0) | CAN_TSR_TME(1) | CAN_TSR_TME(2);
+            regs->RFR[0] = 0;
+            regs->RFR[1] = 0;
+            regs->IER = 0;
+            regs->ESR = 0;
+            regs->BTR = 0x01230000U;
+            for (uint32_t m = 0; m < 3U; m++) {
+                regs->TX[m].TIR &= ~CAN_IR_TXRQ;
+            }
+            fifos[instance - 1U][0].count = 0;
+            fifos[instance - 1U][1].count = 0;
+        } else {
+            /* Mode changes are acknowledged at once: the bus is always idle here */
+            uint32_t ack = (value & CAN_MCR_INRQ) ? CAN_MSR_INAK : ((value & CAN_MCR_SLEEP) ? CAN_MSR_SLAK : 0U);
+            regs->MSR = (regs->MSR & ~(CAN_MSR_INAK | CAN_MSR_SLAK)) | ack;
+        }
+    } else if (reg == &regs->MSR) {
+        *reg = old & ~(value & (CAN_MSR_ERRI | (1U << 3) | (1U << 4)));
+    } else if (reg == &regs->TSR) {
+        uint32_t tsr = old;
+        for (uint32_t m = 0; m < 3U; m++) {
+            if (value & CAN_TSR_RQCP(m)) {
+                tsr &= ~(0xFU << (8U * m)); /* RQCP, TXOK, ALST and TERR together */
+            }
+            if ((value & CAN_TSR_ABRQ(m)) && (regs->TX[m].TIR & CAN_IR_TXRQ)) {
+                tsr |= CAN_TSR_ABRQ(m);
+            }
+        }
+        *reg = tsr;
+    } else if (reg == &regs->RFR[0] || reg == &regs->RFR[1]) {
+        uint8_t fifo = (reg == &regs->RFR[1]) ? 1U : 0U;
+        sim_fifo_t* q = &fifos[instance - 1U][fifo];
+        *reg = old & ~(value & CAN_RFR_FOVR);
+        if ((value & CAN_RFR_RFOM) && q->count != 0U) {
+            q->slots[0] = q->slots[1];
+            q->slots[1] = q->slots[2];
+            q->count--;
+        }
+        publish(regs, instance, fifo);
+    }
+}
+
+#endif
@@ -0,0 +1,554 @@
+#ifndef CORO_EXECUTOR_HPP
+#define CORO_EXECUTOR_HPP
+
+#include "hal_reg.h"
+#include "intrusive_list.hpp"
+#include "ring.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * Cooperative executor for C++20 stackless coroutines.
+ *
+ * Each flow is a coro::task. Its frame comes from a fixed pool instead of
+ * the heap, so there are no per-task stacks and no malloc. Tasks suspend on
+ * delays, events (which may be set from ISRs) and channel reads. The
+ * executor resumes them from run_once(), typically called from the main
+ * loop with the current tick. What an ISR may touch is masked with
+ * hal_irq_mask(), whether or not FEATURE_LOCKING is built in.
+ */
+
+#ifndef CORO_FRAME_SIZE
+#define CORO_FRAME_SIZE 256
+#endif
+
+#ifndef CORO_FRAME_COUNT
+#define CORO_FRAME_COUNT 32
+#endif
+
+namespace coro {
+
+class executor;
+
+/**
+ * @brief Fixed pool of CORO_FRAME_COUNT coroutine frames of CORO_FRAME_SIZE bytes.
+ */
+class frame_pool {
+public:
+    static frame_pool& instance() noexcept
+    {
+        static frame_pool pool;
+        return pool;
+    }
+
+    /**
+     * @brief Returns a free frame, or nullptr if size is too big or the pool is exhausted.
+     */
+    void* allocate(std::size_t size) noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        if (size > CORO_FRAME_SIZE) {
+            failed_++;
+            hal_irq_restore(primask);
+            return nullptr;
+        }
+
+        block* frame = free_;
+        if (frame != nullptr) {
+            free_ = frame->next;
+        } else if (unused_ < CORO_FRAME_COUNT) {
+            frame = &blocks_[unused_++];
+        }
+        if (frame != nullptr) {
+            used_++;
+            if (used_ > peak_) {
+                peak_ = used_;
+            }
+        } else {
+            failed_++;
+        }
+        hal_irq_restore(primask);
+        return frame;
+    }
+
+    void release(void* frame) noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        block* released = static_cast<block*>(frame);
+        released->next = free_;
+        free_ = released;
+        used_--;
+        hal_irq_restore(primask);
+    }
+
+    std::size_t used() const noexcept
+    {
+        return used_;
+    }
+
+    std::size_t peak() const noexcept
+    {
+        return peak_;
+    }
+
+    std::size_t failed() const noexcept
+    {
+        return failed_;
+    }
+
+private:
+    union block {
+        block* next;
+        alignas(std::max_align_t) unsigned char bytes[CORO_FRAME_SIZE];
+    };
+
+    block blocks_[CORO_FRAME_COUNT];
+    block* free_;
+    std::size_t unused_;
+    std::size_t used_;
+    std::size_t peak_;
+    std::size_t failed_;
+};
+
+/**
+ * @brief State shared by every task frame: queue hook, owner and wake-up data.
+ */
+struct promise_base {
+    node_t hook;
+    std::coroutine_handle<> handle;
+    executor* owner;
+    uint32_t wake_at;
+    void* slot;
+
+    static void* operator new(std::size_t size) noexcept
+    {
+        return frame_pool::instance().allocate(size);
+    }
+
+    static void operator delete(void* frame) noexcept
+    {
+        frame_pool::instance().release(frame);
+    }
+};
+
+using promise_list = ll::intrusive_list<LL_HOOK(promise_base, hook)>;
+
+/**
+ * @brief Fire-and-forget coroutine; hand it to executor::spawn() to start it.
+ *
+ * A task whose frame could not be allocated converts to false.
+ */
+class task {
+public:
+    struct promise_type;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    struct final_awaiter {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        inline void await_suspend(handle_type handle) noexcept;
+
+        void await_resume() const noexcept
+        {
+        }
+    };
+
+    struct promise_type : promise_base {
+        task get_return_object() noexcept
+        {
+            handle = handle_type::from_promise(*this);
+            owner = nullptr;
+            return task(handle_type::from_promise(*this));
+        }
+
+        static task get_return_object_on_allocation_failure() noexcept
+        {
+            return task();
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        final_awaiter final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void return_void() const noexcept
+        {
+        }
+
+        void unhandled_exception() const noexcept
+        {
+        }
+    };
+
+    task() noexcept
+        : handle_()
+    {
+    }
+
+    task(task&& other) noexcept
+        : handle_(other.handle_)
+    {
+        other.handle_ = nullptr;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task()
+    {
+        // Only a task that was never spawned still owns its frame
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(handle_);
+    }
+
+    handle_type release() noexcept
+    {
+        handle_type handle = handle_;
+        handle_ = nullptr;
+        return handle;
+    }
+
+private:
+    explicit task(handle_type handle) noexcept
+        : handle_(handle)
+    {
+    }
+
+    handle_type handle_;
+};
+
+/**
+ * @brief Run queue, timer list and task accounting for a set of tasks.
+ */
+class executor {
+public:
+    executor() noexcept
+        : ready_()
+        , timers_()
+        , now_(0)
+        , live_(0)
+    {
+    }
+
+    executor(const executor&) = delete;
+    executor& operator=(const executor&) = delete;
+
+    /**
+     * @brief Queues a task for its first run.
+     *
+     * @return bool false if the task has no frame (pool exhausted).
+     */
+    bool spawn(task&& new_task) noexcept
+    {
+        if (!new_task) {
+            return false;
+        }
+        task::handle_type handle = new_task.release();
+        promise_base& promise = handle.promise();
+        promise.owner = this;
+        live_++;
+        schedule(promise);
+        return true;
+    }
+
+    /**
+     * @brief Advances time to now, wakes due timers and resumes every task that
+     * is ready at the start of the call.
+     *
+     * @return std::size_t Number of tasks resumed.
+     */
+    std::size_t run_once(uint32_t now) noexcept
+    {
+        now_ = now;
+        while (!timers_.empty() && static_cast<int32_t>(timers_.front().wake_at - now_) <= 0) {
+            schedule(*timers_.pop_front());
+        }
+
+        // Tasks that reschedule themselves run again on the next call
+        uint32_t primask = hal_irq_mask();
+        std::size_t pending = ready_.size();
+        hal_irq_restore(primask);
+
+        std::size_t resumed = 0;
+        while (resumed < pending) {
+            primask = hal_irq_mask();
+            promise_base* promise = ready_.pop_front();
+            hal_irq_restore(primask);
+            if (promise == nullptr) {
+                break;
+            }
+            promise->handle.resume();
+            resumed++;
+        }
+        return resumed;
+    }
+
+    /**
+     * @brief Makes a suspended task runnable. Safe to call from an ISR.
+     */
+    void schedule(promise_base& promise) noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        ready_.push_back(promise);
+        hal_irq_restore(primask);
+    }
+
+    /**
+     * @brief Parks a task until the tick counter reaches deadline.
+     */
+    void sleep_until(promise_base& promise, uint32_t deadline) noexcept
+    {
+        promise.wake_at = deadline;
+        promise_base* previous = nullptr;
+        for (promise_base& timer : timers_) {
+            if (static_cast<int32_t>(timer.wake_at - deadline) > 0) {
+                break;
+            }
+            previous = &timer;
+        }
+        timers_.insert_after(previous, promise);
+    }
+
+    uint32_t now() const noexcept
+    {
+        return now_;
+    }
+
+    /**
+     * @brief Deadline of the earliest timer; only meaningful if has_timers().
+     */
+    uint32_t next_deadline() const noexcept
+    {
+        return timers_.front().wake_at;
+    }
+
+    bool has_timers() const noexcept
+    {
+        return !timers_.empty();
+    }
+
+    bool has_ready() const noexcept
+    {
+        return !ready_.empty();
+    }
+
+    std::size_t live_tasks() const noexcept
+    {
+        return live_;
+    }
+
+    void task_finished() noexcept
+    {
+        live_--;
+    }
+
+private:
+    promise_list ready_;
+    promise_list timers_;
+    uint32_t now_;
+    std::size_t live_;
+};
+
+inline void task::final_awaiter::await_suspend(handle_type handle) noexcept
+{
+    executor* owner = handle.promise().owner;
+    handle.destroy();
+    if (owner != nullptr) {
+        owner->task_finished();
+    }
+}
+
+/**
+ * @brief Suspends the calling task for a number of ticks.
+ */
+struct delay {
+    uint32_t ticks;
+
+    bool await_ready() const noexcept
+    {
+        return ticks == 0;
+    }
+
+    void await_suspend(task::handle_type handle) const noexcept
+    {
+        promise_base& promise = handle.promise();
+        promise.owner->sleep_until(promise, promise.owner->now() + ticks);
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+};
+
+/**
+ * @brief Moves the calling task to the back of the ready queue.
+ */
+struct yield {
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(task::handle_type handle) const noexcept
+    {
+        handle.promise().owner->schedule(handle.promise());
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+};
+
+/**
+ * @brief Latching event, typically set from an interrupt handler.
+ *
+ * set() wakes every waiting task. If nobody is waiting the event latches
+ * and the next co_await completes immediately, clearing it.
+ */
+class event {
+public:
+    constexpr event() noexcept
+        : waiters_()
+        , latched_(false)
+    {
+    }
+
+    void set() noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        if (waiters_.empty()) {
+            latched_ = true;
+        }
+        while (promise_base* waiter = waiters_.pop_front()) {
+            waiter->owner->schedule(*waiter);
+        }
+        hal_irq_restore(primask);
+    }
+
+    bool await_ready() noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        bool ready = latched_;
+        latched_ = false;
+        hal_irq_restore(primask);
+        return ready;
+    }
+
+    bool await_suspend(task::handle_type handle) noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        // The ISR may have fired between await_ready() and here
+        bool suspend = !latched_;
+        if (suspend) {
+            waiters_.push_back(handle.promise());
+        }
+        latched_ = false;
+        hal_irq_restore(primask);
+        return suspend;
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+
+private:
+    promise_list waiters_;
+    volatile bool latched_;
+};
+
+/**
+ * @brief Bounded queue of N trivially copyable items with an awaitable receive.
+ *
+ * send() never blocks and may be called from an ISR. A waiting receiver gets
+ * the item handed over directly, without passing through the buffer.
+ */
+template <typename T, std::size_t N>
+class channel {
+    static_assert(std::is_trivially_copyable<T>::value, "channel items must be trivially copyable");
+
+public:
+    struct receive_awaiter {
+        channel& owner;
+        T value;
+
+        bool await_ready() noexcept
+        {
+            uint32_t primask = hal_irq_mask();
+            bool ready = owner.items_.pop(value);
+            hal_irq_restore(primask);
+            return ready;
+        }
+
+        bool await_suspend(task::handle_type handle) noexcept
+        {
+            uint32_t primask = hal_irq_mask();
+            bool suspend = !owner.items_.pop(value);
+            if (suspend) {
+                handle.promise().slot = &value;
+                owner.receivers_.push_back(handle.promise());
+            }
+            hal_irq_restore(primask);
+            return suspend;
+        }
+
+        T await_resume() const noexcept
+        {
+            return value;
+        }
+    };
+
+    /**
+     * @brief Delivers an item to a waiting receiver or buffers it.
+     *
+     * @return bool false if nobody is waiting and the buffer is full.
+     */
+    bool send(const T& item) noexcept
+    {
+        uint32_t primask = hal_irq_mask();
+        bool sent = true;
+        promise_base* receiver = receivers_.pop_front();
+        if (receiver != nullptr) {
+            std::memcpy(receiver->slot, &item, sizeof(T));
+            receiver->owner->schedule(*receiver);
+        } else {
+            sent = items_.push(item);
+        }
+        hal_irq_restore(primask);
+        return sent;
+    }
+
+    receive_awaiter receive() noexcept
+    {
+        return receive_awaiter { *this, T() };
+    }
+
+    std::size_t size() const noexcept
+    {
+        return items_.size();
+    }
+
+private:
+    fixed::ring<T, N> items_;
+    promise_list receivers_;
+};
+
+} // namespace coro
+
+#endif // CORO_EXECUTOR_HPP
@@ -0,0 +1,268 @@
+#include "crc.h"
+#include "crc_tables.h"
+#include "feature_hooks.h"
+#include <string.h>
+
+#define RCC_AHB1ENR_CRCEN (1U << 12)
+#define DMA_MAX_WORDS 65535U
+
+#if !defined(STM32F407xx)
+crc_regs_t crc_sim_regs;
+#endif
+
+static dma_stream_t dma;
+static crc_stats_t stats;
+static uint8_t initialized;
+static uint8_t dma_ready;
+static uint8_t busy;            /* The unit is taken, by a call or a background CRC */
+
+/* The background CRC in progress */
+static const uint8_t* job_start;
+static size_t job_length;
+static uint32_t job_crc;
+static const uint8_t* job_next;
+static uint32_t job_words;      /* Still to be started after the current transfer */
+static crc_callback_t job_callback;
+static void* job_context;
+
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    crc_sim_write(reg, value);
+#endif
+}
+
+/* Little-endian, from any address: a plain LDR on the M4 */
+static uint32_t load_word(const uint8_t* p)
+{
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/* The last bytes padded with zero to a word */
+static uint32_t load_tail(const uint8_t* p, size_t length)
+{
+    uint32_t word = 0;
+    memcpy(&word, p, length);
+    return word;
+}
+
+static uint8_t claim(void)
+{
+    return __atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE) == 0U;
+}
+
+static void release(void)
+{
+    __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+}
+
+static uint32_t sw_word(uint32_t crc, uint32_t word)
+{
+    crc ^= word;
+    return crc32_table[3][crc >> 24] ^ crc32_table[2][(crc >> 16) & 0xFFU] ^ crc32_table[1][(crc >> 8) & 0xFFU] ^
+           crc32_table[0][crc & 0xFFU];
+}
+
+/*
+ * Each word goes in highest byte first, so of the eight bytes of a pair of
+ * words the top byte of the first has seven more to follow (table 7) and
+ * the bottom byte of the second none (table 0).
+ */
+uint32_t crc32_sw_update(uint32_t crc, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    STAT_ADD(stats.software_bytes, length);
+    for (; length >= 8U; length -= 8U, p += 8) {
+        uint32_t first = load_word(p) ^ crc;
+        uint32_t second = load_word(p + 4);
+        crc = crc32_table[7][first >> 24] ^ crc32_table[6][(first >> 16) & 0xFFU] ^
+              crc32_table[5][(first >> 8) & 0xFFU] ^ crc32_table[4][first & 0xFFU] ^ crc32_table[3][second >> 24] ^
+              crc32_table[2][(second >> 16) & 0xFFU] ^ crc32_table[1][(second >> 8) & 0xFFU] ^
+              crc32_table[0][second & 0xFFU];
+    }
+    if (length >= 4U) {
+        crc = sw_word(crc, load_word(p));
+        p += 4;
+        length -= 4U;
+    }
+    if (length > 0U) {
+        crc = sw_word(crc, load_tail(p, length));
+    }
+    return crc;
+}
+
+/*
+ * The word that takes the register from CRC32_INIT to crc. Each of the 32
+ * shifts of a word leaves bit 0 set exactly when it XORed in the (odd)
+ * polynomial, so they can be undone one by one from the end.
+ */
+static uint32_t preset_word(uint32_t crc)
+{
+    for (uint32_t bit = 0; bit < 32U; bit++) {
+        crc = (crc & 1U) ? ((crc ^ CRC_TABLE_POLY) >> 1) | 0x80000000U : crc >> 1;
+    }
+    return crc ^ CRC32_INIT;
+}
+
+static void begin(uint32_t crc)
+{
+    crc_regs_t* regs = CRC_REGS;
+    write_reg(&regs->CR, CRC_CR_RESET);
+    if (crc != CRC32_INIT) {
+        write_reg(&regs->DR, preset_word(crc));
+    }
+}
+
+static void feed(const uint8_t* p, size_t length)
+{
+    crc_regs_t* regs = CRC_REGS;
+    STAT_ADD(stats.hardware_bytes, length);
+    for (; length >= 4U; length -= 4U, p += 4) {
+        write_reg(&regs->DR, load_word(p));
+    }
+    if (length > 0U) {
+        write_reg(&regs->DR, load_tail(p, length));
+    }
+}
+
+uint32_t crc32_hw_update(uint32_t crc, const void* data, size_t length)
+{
+    if (length == 0U) {
+        return crc;
+    }
+    if (!initialized) {
+        return crc32_sw_update(crc, data, length);
+    }
+    if (!claim()) {
+        STAT_INC(stats.busy_fallbacks);
+        return crc32_sw_update(crc, data, length);
+    }
+    begin(crc);
+    feed((const uint8_t*)data, length);
+    crc = REG_READ(CRC_REGS->DR);
+    release();
+    return crc;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length)
+{
+#if defined(STM32F407xx)
+    return crc32_hw_update(crc, data, length);
+#else
+    return crc32_sw_update(crc, data, length);
+#endif
+}
+
+uint32_t crc32(const void* data, size_t length)
+{
+    return crc32_update(CRC32_INIT, data, length);
+}
+
+static void finish(uint32_t crc)
+{
+    crc_callback_t callback = job_callback;
+    void* context = job_context;
+    release();
+    callback(crc, context);
+}
+
+/* Starts the next transfer of at most 65535 words, or ends the CRC with the tail */
+static void next_transfer(void)
+{
+    if (job_words == 0U) {
+        size_t tail = job_length % 4U;
+        feed(job_next, tail);
+        finish(REG_READ(CRC_REGS->DR));
+        return;
+    }
+
+    const uint8_t* words = job_next;
+    uint32_t count = (job_words < DMA_MAX_WORDS) ? job_words : DMA_MAX_WORDS;
+    job_next += count * 4U;
+    job_words -= count;
+    STAT_ADD(stats.hardware_bytes, count * 4U);
+    STAT_ADD(stats.dma_bytes, count * 4U);
+    dma_start(&dma, (uintptr_t)words, (void*)(uintptr_t)&CRC_REGS->DR, count);
+#if !defined(STM32F407xx)
+    crc_sim_dma(words, count);
+#endif
+}
+
+static void dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    (void)context;
+    if (event == DMA_EVENT_ERROR) {
+        /* How far the unit got is unknown; the data is all still there */
+        STAT_INC(stats.dma_errors);
+        finish(crc32_sw_update(job_crc, job_start, job_length));
+    } else if (event == DMA_EVENT_COMPLETE) {
+        next_transfer();
+    }
+}
+
+status_t crc32_hw_start(uint32_t crc, const void* data, size_t length, crc_callback_t callback, void* context)
+{
+    uint8_t short_data = length < CRC_DMA_MIN_BYTES;
+    if (callback == NULL || !initialized ||
+        (!short_data && (!dma_ready || ((uintptr_t)data % 4U) != 0U))) {
+        return FAILURE;
+    }
+    if (!claim()) {
+        return FAILURE;
+    }
+
+    job_start = (const uint8_t*)data;
+    job_length = length;
+    job_crc = crc;
+    job_next = job_start;
+    job_words = short_data ? 0U : (uint32_t)(length / 4U);
+    job_callback = callback;
+    job_context = context;
+    begin(crc);
+    if (short_data) {
+        feed(job_start, length);
+        finish(REG_READ(CRC_REGS->DR));
+        return SUCCESS;
+    }
+    next_transfer();
+    return SUCCESS;
+}
+
+status_t crc_init(void)
+{
+    if (!initialized) {
+        REG_SET(HAL_RCC->AHB1ENR, RCC_AHB1ENR_CRCEN);
+        write_reg(&CRC_REGS->CR, CRC_CR_RESET);
+        initialized = 1;
+    }
+    if (dma_ready) {
+        return SUCCESS;
+    }
+
+    /* Memory to memory: the data is the peripheral port, incremented; DR the memory port, fixed */
+    dma_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.direction = DMA_MEMORY_TO_MEMORY;
+    config.mode = DMA_MODE_NORMAL;
+    config.peripheral_size = 4;
+    config.memory_size = 4;
+    config.peripheral_increment = 1;
+    config.fifo_threshold = 4;
+    config.callback = dma_event;
+    if (dma_stream_init(&dma, CRC_DMA_CONTROLLER, CRC_DMA_STREAM, &config) != SUCCESS) {
+        return FAILURE;
+    }
+    dma_ready = 1;
+    return SUCCESS;
+}
+
+const crc_stats_t* crc_get_stats(void)
+{
+    return &stats;
+}
@@ -0,0 +1,139 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CRC-32 of frames and flash images, as the STM32 CRC unit computes it.
+ *
+ * The unit shifts 32-bit words into a register preset to 0xFFFFFFFF, most
+ * significant bit first, with the polynomial 0x04C11DB7 and no reflection
+ * or final XOR (CRC-32/MPEG-2 over each word's bytes, highest first). Data
+ * is taken as little-endian words, the way the CPU or a DMA stream reads
+ * memory into the data register, and a last partial word is padded with
+ * zero bytes. The word 0x12345678 gives 0xDF8A8A2B, "123456789" gives
+ * 0xAFF19057.
+ *
+ * On target the CPU feeds the unit, loading words unaligned where it has
+ * to, which is as fast as the unit takes them (a word every four cycles);
+ * crc32_hw_start instead has DMA2 stream 4 feed it in memory-to-memory mode
+ * while the CPU does something else. The host, and the target whenever the
+ * unit is in use, computes the same value with slicing-by-8 lookups in
+ * tables generated at build time into .rodata (scripts/gen_crc_tables.py).
+ *
+ * Results chain: crc32_update(crc32_update(CRC32_INIT, a), b) is the CRC
+ * of a followed by b, as long as a is a whole number of words. The unit
+ * cannot be preset on this part, so continuing from crc first writes the
+ * one word that takes the register from 0xFFFFFFFF to crc.
+ */
+
+typedef struct {
+    volatile uint32_t DR;
+    volatile uint32_t IDR;
+    volatile uint32_t CR;
+} crc_regs_t;
+
+#if !defined(STM32F407xx)
+extern crc_regs_t crc_sim_regs;
+#endif
+
+#define CRC_REGS HAL_PERIPH(crc_regs_t, 0x40023000U, crc_sim_regs)
+
+#define CRC_CR_RESET (1U << 0)
+
+/** The register's value before any data */
+#define CRC32_INIT 0xFFFFFFFFU
+
+/** DMA2 stream feeding the unit; memory-to-memory ignores the channel */
+#define CRC_DMA_CONTROLLER 2U
+#define CRC_DMA_STREAM 4U
+
+#ifndef CRC_DMA_MIN_BYTES
+#define CRC_DMA_MIN_BYTES 1024U     /**< Below this crc32_hw_start is done at once by the CPU */
+#endif
+
+/** Receives the result of crc32_hw_start(), from the DMA stream interrupt. */
+typedef void (*crc_callback_t)(uint32_t crc, void* context);
+
+typedef struct {
+    uint32_t hardware_bytes;    /**< Fed to the unit, by the CPU or DMA */
+    uint32_t dma_bytes;         /**< Of those, fed by DMA */
+    uint32_t software_bytes;    /**< Computed with the tables */
+    uint32_t busy_fallbacks;    /**< Calls that found the unit in use and used the tables */
+    uint32_t dma_errors;        /**< Background CRCs finished with the tables after a DMA error */
+} crc_stats_t;
+
+/**
+ * @brief Clocks the CRC unit and claims its DMA stream.
+ *
+ * @return FAILURE if the DMA stream is taken; the unit then works from the
+ * CPU only.
+ */
+status_t crc_init(void);
+
+/** The CRC of length bytes from CRC32_INIT. */
+uint32_t crc32(const void* data, size_t length);
+
+/**
+ * @brief Continues crc over length more bytes: with the unit on target
+ * once crc_init has run, with the tables on the host or when the unit is
+ * in use (from an interrupt that preempted another computation, or by
+ * crc32_hw_start).
+ */
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length);
+
+/** Slicing-by-8 over the generated tables; any context, any build. */
+uint32_t crc32_sw_update(uint32_t crc, const void* data, size_t length);
+
+/**
+ * @brief Continues crc over length bytes, fed to the unit by the CPU. The
+ * host runs this against the model of the unit.
+ *
+ * @return The new CRC; the tables' result if the unit is in use or
+ * crc_init has not run.
+ */
+uint32_t crc32_hw_update(uint32_t crc, const void* data, size_t length);
+
+/**
+ * @brief Starts a CRC over length bytes in the background, by DMA, for
+ * data too long to wait for (a flash image). data must stay unchanged
+ * until callback runs with the result. Under CRC_DMA_MIN_BYTES the CPU
+ * computes it at once and callback runs before this returns.
+ *
+ * @return FAILURE if callback is NULL, the unit is in use, or the DMA
+ * would be needed and data is not word-aligned or the stream was not
+ * claimed.
+ */
+status_t crc32_hw_start(uint32_t crc, const void* data, size_t length, crc_callback_t callback, void* context);
+
+const crc_stats_t* crc_get_stats(void);
+
+#if !defined(STM32F407xx)
+/** Host model: a write to a register with side effects in the hardware. */
+void crc_sim_write(volatile uint32_t* reg, uint32_t value);
+
+/**
+ * @brief Host model: the DMA stream stops after words more words, as if
+ * held off the bus, leaving a background CRC in progress.
+ */
+void crc_sim_dma_hold(uint32_t words);
+
+/** Host model: lets a held stream move the rest of its words. */
+void crc_sim_dma_resume(void);
+
+/* Hook used by crc.c in place of DMA2 stream 4 moving words into DR */
+void crc_sim_dma(const void* words, uint32_t count);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC_H
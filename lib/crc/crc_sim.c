@@ -0,0 +1,84 @@
+#include "crc.h"
+#include <string.h>
+
+#if !defined(STM32F407xx)
+
+#define POLY 0x04C11DB7U
+
+/* The unit, bit by bit, independent of the tables the driver uses */
+static uint32_t shift_word(uint32_t crc, uint32_t word)
+{
+    crc ^= word;
+    for (uint32_t bit = 0; bit < 32U; bit++) {
+        crc = (crc & 0x80000000U) ? (crc << 1) ^ POLY : crc << 1;
+    }
+    return crc;
+}
+
+void crc_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    crc_regs_t* regs = &crc_sim_regs;
+    if (reg == &regs->DR) {
+        uint32_t crc = regs->DR;
+        hal_reg_write(reg, value);
+        regs->DR = shift_word(crc, value);
+    } else if (reg == &regs->CR) {
+        /* RESET reloads DR and reads back as zero */
+        hal_reg_write(reg, value);
+        if (value & CRC_CR_RESET) {
+            regs->DR = CRC32_INIT;
+        }
+        regs->CR = 0;
+    } else {
+        hal_reg_write(reg, value);
+    }
+}
+
+/* Words the stream has yet to move, and how many more it may before holding */
+static const uint8_t* pending;
+static uint32_t pending_count;
+static uint32_t hold_after = UINT32_MAX;
+
+/*
+ * The stream writes each word to DR, where the unit shifts it in. The
+ * shifted value goes through the DMA model, so that DR already holds it
+ * when the last word's completion interrupt runs, which may start the next
+ * transfer from inside this one.
+ */
+static void run(void)
+{
+    crc_regs_t* regs = &crc_sim_regs;
+    while (pending_count > 0U && hold_after > 0U) {
+        if (hold_after != UINT32_MAX) {
+            hold_after--;
+        }
+        uint32_t word;
+        memcpy(&word, pending, sizeof(word));
+        pending += 4;
+        pending_count--;
+        uint32_t shifted = shift_word(regs->DR, word);
+        if (dma_sim_transfer(CRC_DMA_CONTROLLER, CRC_DMA_STREAM, &shifted, 1) != 1U) {
+            pending_count = 0;
+        }
+    }
+}
+
+void crc_sim_dma(const void* words, uint32_t count)
+{
+    pending = (const uint8_t*)words;
+    pending_count = count;
+    run();
+}
+
+void crc_sim_dma_hold(uint32_t words)
+{
+    hold_after = words;
+}
+
+void crc_sim_dma_resume(void)
+{
+    hold_after = UINT32_MAX;
+    run();
+}
+
+#endif
@@ -0,0 +1,449 @@
+#include "aes.h"
+#include <string.h>
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16,
+};
+
+static const uint8_t inv_sbox[256] = {
+    0x52, 0x09, 0x6A, 0xD5, 0x30, 0x36, 0xA5, 0x38, 0xBF, 0x40, 0xA3, 0x9E, 0x81, 0xF3, 0xD7, 0xFB,
+    0x7C, 0xE3, 0x39, 0x82, 0x9B, 0x2F, 0xFF, 0x87, 0x34, 0x8E, 0x43, 0x44, 0xC4, 0xDE, 0xE9, 0xCB,
+    0x54, 0x7B, 0x94, 0x32, 0xA6, 0xC2, 0x23, 0x3D, 0xEE, 0x4C, 0x95, 0x0B, 0x42, 0xFA, 0xC3, 0x4E,
+    0x08, 0x2E, 0xA1, 0x66, 0x28, 0xD9, 0x24, 0xB2, 0x76, 0x5B, 0xA2, 0x49, 0x6D, 0x8B, 0xD1, 0x25,
+    0x72, 0xF8, 0xF6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xD4, 0xA4, 0x5C, 0xCC, 0x5D, 0x65, 0xB6, 0x92,
+    0x6C, 0x70, 0x48, 0x50, 0xFD, 0xED, 0xB9, 0xDA, 0x5E, 0x15, 0x46, 0x57, 0xA7, 0x8D, 0x9D, 0x84,
+    0x90, 0xD8, 0xAB, 0x00, 0x8C, 0xBC, 0xD3, 0x0A, 0xF7, 0xE4, 0x58, 0x05, 0xB8, 0xB3, 0x45, 0x06,
+    0xD0, 0x2C, 0x1E, 0x8F, 0xCA, 0x3F, 0x0F, 0x02, 0xC1, 0xAF, 0xBD, 0x03, 0x01, 0x13, 0x8A, 0x6B,
+    0x3A, 0x91, 0x11, 0x41, 0x4F, 0x67, 0xDC, 0xEA, 0x97, 0xF2, 0xCF, 0xCE, 0xF0, 0xB4, 0xE6, 0x73,
+    0x96, 0xAC, 0x74, 0x22, 0xE7, 0xAD, 0x35, 0x85, 0xE2, 0xF9, 0x37, 0xE8, 0x1C, 0x75, 0xDF, 0x6E,
+    0x47, 0xF1, 0x1A, 0x71, 0x1D, 0x29, 0xC5, 0x89, 0x6F, 0xB7, 0x62, 0x0E, 0xAA, 0x18, 0xBE, 0x1B,
+    0xFC, 0x56, 0x3E, 0x4B, 0xC6, 0xD2, 0x79, 0x20, 0x9A, 0xDB, 0xC0, 0xFE, 0x78, 0xCD, 0x5A, 0xF4,
+    0x1F, 0xDD, 0xA8, 0x33, 0x88, 0x07, 0xC7, 0x31, 0xB1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xEC, 0x5F,
+    0x60, 0x51, 0x7F, 0xA9, 0x19, 0xB5, 0x4A, 0x0D, 0x2D, 0xE5, 0x7A, 0x9F, 0x93, 0xC9, 0x9C, 0xEF,
+    0xA0, 0xE0, 0x3B, 0x4D, 0xAE, 0x2A, 0xF5, 0xB0, 0xC8, 0xEB, 0xBB, 0x3C, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2B, 0x04, 0x7E, 0xBA, 0x77, 0xD6, 0x26, 0xE1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0C, 0x7D,
+};
+
+/* S[x] times (2, 1, 1, 3), a column of MixColumns */
+static const uint32_t te0[256] = {
+    0xC66363A5U, 0xF87C7C84U, 0xEE777799U, 0xF67B7B8DU, 0xFFF2F20DU, 0xD66B6BBDU, 0xDE6F6FB1U, 0x91C5C554U,
+    0x60303050U, 0x02010103U, 0xCE6767A9U, 0x562B2B7DU, 0xE7FEFE19U, 0xB5D7D762U, 0x4DABABE6U, 0xEC76769AU,
+    0x8FCACA45U, 0x1F82829DU, 0x89C9C940U, 0xFA7D7D87U, 0xEFFAFA15U, 0xB25959EBU, 0x8E4747C9U, 0xFBF0F00BU,
+    0x41ADADECU, 0xB3D4D467U, 0x5FA2A2FDU, 0x45AFAFEAU, 0x239C9CBFU, 0x53A4A4F7U, 0xE4727296U, 0x9BC0C05BU,
+    0x75B7B7C2U, 0xE1FDFD1CU, 0x3D9393AEU, 0x4C26266AU, 0x6C36365AU, 0x7E3F3F41U, 0xF5F7F702U, 0x83CCCC4FU,
+    0x6834345CU, 0x51A5A5F4U, 0xD1E5E534U, 0xF9F1F108U, 0xE2717193U, 0xABD8D873U, 0x62313153U, 0x2A15153FU,
+    0x0804040CU, 0x95C7C752U, 0x46232365U, 0x9DC3C35EU, 0x30181828U, 0x379696A1U, 0x0A05050FU, 0x2F9A9AB5U,
+    0x0E070709U, 0x24121236U, 0x1B80809BU, 0xDFE2E23DU, 0xCDEBEB26U, 0x4E272769U, 0x7FB2B2CDU, 0xEA75759FU,
+    0x1209091BU, 0x1D83839EU, 0x582C2C74U, 0x341A1A2EU, 0x361B1B2DU, 0xDC6E6EB2U, 0xB45A5AEEU, 0x5BA0A0FBU,
+    0xA45252F6U, 0x763B3B4DU, 0xB7D6D661U, 0x7DB3B3CEU, 0x5229297BU, 0xDDE3E33EU, 0x5E2F2F71U, 0x13848497U,
+    0xA65353F5U, 0xB9D1D168U, 0x00000000U, 0xC1EDED2CU, 0x40202060U, 0xE3FCFC1FU, 0x79B1B1C8U, 0xB65B5BEDU,
+    0xD46A6ABEU, 0x8DCBCB46U, 0x67BEBED9U, 0x7239394BU, 0x944A4ADEU, 0x984C4CD4U, 0xB05858E8U, 0x85CFCF4AU,
+    0xBBD0D06BU, 0xC5EFEF2AU, 0x4FAAAAE5U, 0xEDFBFB16U, 0x864343C5U, 0x9A4D4DD7U, 0x66333355U, 0x11858594U,
+    0x8A4545CFU, 0xE9F9F910U, 0x04020206U, 0xFE7F7F81U, 0xA05050F0U, 0x783C3C44U, 0x259F9FBAU, 0x4BA8A8E3U,
+    0xA25151F3U, 0x5DA3A3FEU, 0x804040C0U, 0x058F8F8AU, 0x3F9292ADU, 0x219D9DBCU, 0x70383848U, 0xF1F5F504U,
+    0x63BCBCDFU, 0x77B6B6C1U, 0xAFDADA75U, 0x42212163U, 0x20101030U, 0xE5FFFF1AU, 0xFDF3F30EU, 0xBFD2D26DU,
+    0x81CDCD4CU, 0x180C0C14U, 0x26131335U, 0xC3ECEC2FU, 0xBE5F5FE1U, 0x359797A2U, 0x884444CCU, 0x2E171739U,
+    0x93C4C457U, 0x55A7A7F2U, 0xFC7E7E82U, 0x7A3D3D47U, 0xC86464ACU, 0xBA5D5DE7U, 0x3219192BU, 0xE6737395U,
+    0xC06060A0U, 0x19818198U, 0x9E4F4FD1U, 0xA3DCDC7FU, 0x44222266U, 0x542A2A7EU, 0x3B9090ABU, 0x0B888883U,
+    0x8C4646CAU, 0xC7EEEE29U, 0x6BB8B8D3U, 0x2814143CU, 0xA7DEDE79U, 0xBC5E5EE2U, 0x160B0B1DU, 0xADDBDB76U,
+    0xDBE0E03BU, 0x64323256U, 0x743A3A4EU, 0x140A0A1EU, 0x924949DBU, 0x0C06060AU, 0x4824246CU, 0xB85C5CE4U,
+    0x9FC2C25DU, 0xBDD3D36EU, 0x43ACACEFU, 0xC46262A6U, 0x399191A8U, 0x319595A4U, 0xD3E4E437U, 0xF279798BU,
+    0xD5E7E732U, 0x8BC8C843U, 0x6E373759U, 0xDA6D6DB7U, 0x018D8D8CU, 0xB1D5D564U, 0x9C4E4ED2U, 0x49A9A9E0U,
+    0xD86C6CB4U, 0xAC5656FAU, 0xF3F4F407U, 0xCFEAEA25U, 0xCA6565AFU, 0xF47A7A8EU, 0x47AEAEE9U, 0x10080818U,
+    0x6FBABAD5U, 0xF0787888U, 0x4A25256FU, 0x5C2E2E72U, 0x381C1C24U, 0x57A6A6F1U, 0x73B4B4C7U, 0x97C6C651U,
+    0xCBE8E823U, 0xA1DDDD7CU, 0xE874749CU, 0x3E1F1F21U, 0x964B4BDDU, 0x61BDBDDCU, 0x0D8B8B86U, 0x0F8A8A85U,
+    0xE0707090U, 0x7C3E3E42U, 0x71B5B5C4U, 0xCC6666AAU, 0x904848D8U, 0x06030305U, 0xF7F6F601U, 0x1C0E0E12U,
+    0xC26161A3U, 0x6A35355FU, 0xAE5757F9U, 0x69B9B9D0U, 0x17868691U, 0x99C1C158U, 0x3A1D1D27U, 0x279E9EB9U,
+    0xD9E1E138U, 0xEBF8F813U, 0x2B9898B3U, 0x22111133U, 0xD26969BBU, 0xA9D9D970U, 0x078E8E89U, 0x339494A7U,
+    0x2D9B9BB6U, 0x3C1E1E22U, 0x15878792U, 0xC9E9E920U, 0x87CECE49U, 0xAA5555FFU, 0x50282878U, 0xA5DFDF7AU,
+    0x038C8C8FU, 0x59A1A1F8U, 0x09898980U, 0x1A0D0D17U, 0x65BFBFDAU, 0xD7E6E631U, 0x844242C6U, 0xD06868B8U,
+    0x824141C3U, 0x299999B0U, 0x5A2D2D77U, 0x1E0F0F11U, 0x7BB0B0CBU, 0xA85454FCU, 0x6DBBBBD6U, 0x2C16163AU,
+};
+
+/* S^-1[x] times (14, 9, 13, 11), a column of InvMixColumns */
+static const uint32_t td0[256] = {
+    0x51F4A750U, 0x7E416553U, 0x1A17A4C3U, 0x3A275E96U, 0x3BAB6BCBU, 0x1F9D45F1U, 0xACFA58ABU, 0x4BE30393U,
+    0x2030FA55U, 0xAD766DF6U, 0x88CC7691U, 0xF5024C25U, 0x4FE5D7FCU, 0xC52ACBD7U, 0x26354480U, 0xB562A38FU,
+    0xDEB15A49U, 0x25BA1B67U, 0x45EA0E98U, 0x5DFEC0E1U, 0xC32F7502U, 0x814CF012U, 0x8D4697A3U, 0x6BD3F9C6U,
+    0x038F5FE7U, 0x15929C95U, 0xBF6D7AEBU, 0x955259DAU, 0xD4BE832DU, 0x587421D3U, 0x49E06929U, 0x8EC9C844U,
+    0x75C2896AU, 0xF48E7978U, 0x99583E6BU, 0x27B971DDU, 0xBEE14FB6U, 0xF088AD17U, 0xC920AC66U, 0x7DCE3AB4U,
+    0x63DF4A18U, 0xE51A3182U, 0x97513360U, 0x62537F45U, 0xB16477E0U, 0xBB6BAE84U, 0xFE81A01CU, 0xF9082B94U,
+    0x70486858U, 0x8F45FD19U, 0x94DE6C87U, 0x527BF8B7U, 0xAB73D323U, 0x724B02E2U, 0xE31F8F57U, 0x6655AB2AU,
+    0xB2EB2807U, 0x2FB5C203U, 0x86C57B9AU, 0xD33708A5U, 0x302887F2U, 0x23BFA5B2U, 0x02036ABAU, 0xED16825CU,
+    0x8ACF1C2BU, 0xA779B492U, 0xF307F2F0U, 0x4E69E2A1U, 0x65DAF4CDU, 0x0605BED5U, 0xD134621FU, 0xC4A6FE8AU,
+    0x342E539DU, 0xA2F355A0U, 0x058AE132U, 0xA4F6EB75U, 0x0B83EC39U, 0x4060EFAAU, 0x5E719F06U, 0xBD6E1051U,
+    0x3E218AF9U, 0x96DD063DU, 0xDD3E05AEU, 0x4DE6BD46U, 0x91548DB5U, 0x71C45D05U, 0x0406D46FU, 0x605015FFU,
+    0x1998FB24U, 0xD6BDE997U, 0x894043CCU, 0x67D99E77U, 0xB0E842BDU, 0x07898B88U, 0xE7195B38U, 0x79C8EEDBU,
+    0xA17C0A47U, 0x7C420FE9U, 0xF8841EC9U, 0x00000000U, 0x09808683U, 0x322BED48U, 0x1E1170ACU, 0x6C5A724EU,
+    0xFD0EFFFBU, 0x0F853856U, 0x3DAED51EU, 0x362D3927U, 0x0A0FD964U, 0x685CA621U, 0x9B5B54D1U, 0x24362E3AU,
+    0x0C0A67B1U, 0x9357E70FU, 0xB4EE96D2U, 0x1B9B919EU, 0x80C0C54FU, 0x61DC20A2U, 0x5A774B69U, 0x1C121A16U,
+    0xE293BA0AU, 0xC0A02AE5U, 0x3C22E043U, 0x121B171DU, 0x0E090D0BU, 0xF28BC7ADU, 0x2DB6A8B9U, 0x141EA9C8U,
+    0x57F11985U, 0xAF75074CU, 0xEE99DDBBU, 0xA37F60FDU, 0xF701269FU, 0x5C72F5BCU, 0x44663BC5U, 0x5BFB7E34U,
+    0x8B432976U, 0xCB23C6DCU, 0xB6EDFC68U, 0xB8E4F163U, 0xD731DCCAU, 0x42638510U, 0x13972240U, 0x84C61120U,
+    0x854A247DU, 0xD2BB3DF8U, 0xAEF93211U, 0xC729A16DU, 0x1D9E2F4BU, 0xDCB230F3U, 0x0D8652ECU, 0x77C1E3D0U,
+    0x2BB3166CU, 0xA970B999U, 0x119448FAU, 0x47E96422U, 0xA8FC8CC4U, 0xA0F03F1AU, 0x567D2CD8U, 0x223390EFU,
+    0x87494EC7U, 0xD938D1C1U, 0x8CCAA2FEU, 0x98D40B36U, 0xA6F581CFU, 0xA57ADE28U, 0xDAB78E26U, 0x3FADBFA4U,
+    0x2C3A9DE4U, 0x5078920DU, 0x6A5FCC9BU, 0x547E4662U, 0xF68D13C2U, 0x90D8B8E8U, 0x2E39F75EU, 0x82C3AFF5U,
+    0x9F5D80BEU, 0x69D0937CU, 0x6FD52DA9U, 0xCF2512B3U, 0xC8AC993BU, 0x10187DA7U, 0xE89C636EU, 0xDB3BBB7BU,
+    0xCD267809U, 0x6E5918F4U, 0xEC9AB701U, 0x834F9AA8U, 0xE6956E65U, 0xAAFFE67EU, 0x21BCCF08U, 0xEF15E8E6U,
+    0xBAE79BD9U, 0x4A6F36CEU, 0xEA9F09D4U, 0x29B07CD6U, 0x31A4B2AFU, 0x2A3F2331U, 0xC6A59430U, 0x35A266C0U,
+    0x744EBC37U, 0xFC82CAA6U, 0xE090D0B0U, 0x33A7D815U, 0xF104984AU, 0x41ECDAF7U, 0x7FCD500EU, 0x1791F62FU,
+    0x764DD68DU, 0x43EFB04DU, 0xCCAA4D54U, 0xE49604DFU, 0x9ED1B5E3U, 0x4C6A881BU, 0xC12C1FB8U, 0x4665517FU,
+    0x9D5EEA04U, 0x018C355DU, 0xFA877473U, 0xFB0B412EU, 0xB3671D5AU, 0x92DBD252U, 0xE9105633U, 0x6DD64713U,
+    0x9AD7618CU, 0x37A10C7AU, 0x59F8148EU, 0xEB133C89U, 0xCEA927EEU, 0xB761C935U, 0xE11CE5EDU, 0x7A47B13CU,
+    0x9CD2DF59U, 0x55F2733FU, 0x1814CE79U, 0x73C737BFU, 0x53F7CDEAU, 0x5FFDAA5BU, 0xDF3D6F14U, 0x7844DB86U,
+    0xCAAFF381U, 0xB968C43EU, 0x3824342CU, 0xC2A3405FU, 0x161DC372U, 0xBCE2250CU, 0x283C498BU, 0xFF0D9541U,
+    0x39A80171U, 0x080CB3DEU, 0xD8B4E49CU, 0x6456C190U, 0x7BCB8461U, 0xD532B670U, 0x486C5C74U, 0xD0B85742U,
+};
+
+static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+
+/* GCM reduction of the four bits shifted out of a 128-bit product, Shoup's table */
+static const uint16_t last4[16] = {
+    0x0000, 0x1C20, 0x3840, 0x2460, 0x7080, 0x6CA0, 0x48C0, 0x54E0,
+    0xE100, 0xFD20, 0xD940, 0xC560, 0x9180, 0x8DA0, 0xA9C0, 0xB5E0,
+};
+
+static uint32_t ror(uint32_t x, uint32_t n)
+{
+    return (x >> n) | (x << (32U - n));
+}
+
+static uint32_t load_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint64_t load_be64(const uint8_t* p)
+{
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static void store_be64(uint8_t* p, uint64_t v)
+{
+    store_be32(p, (uint32_t)(v >> 32));
+    store_be32(p + 4, (uint32_t)v);
+}
+
+static uint32_t sub_word(uint32_t w)
+{
+    return ((uint32_t)sbox[w >> 24] << 24) | ((uint32_t)sbox[(w >> 16) & 0xFFU] << 16) |
+           ((uint32_t)sbox[(w >> 8) & 0xFFU] << 8) | sbox[w & 0xFFU];
+}
+
+/* InvMixColumns of a round key word: td0 undoes the S-box it builds in, so apply the S-box first */
+static uint32_t inv_mix_column(uint32_t w)
+{
+    return td0[sbox[w >> 24]] ^ ror(td0[sbox[(w >> 16) & 0xFFU]], 8) ^ ror(td0[sbox[(w >> 8) & 0xFFU]], 16) ^
+           ror(td0[sbox[w & 0xFFU]], 24);
+}
+
+status_t aes_set_key(aes_key_t* key, const uint8_t* bytes, size_t length)
+{
+    if (length != 16U && length != 24U && length != 32U) {
+        return FAILURE;
+    }
+    uint32_t nk = (uint32_t)length / 4U;
+    uint32_t words = 4U * (nk + 7U);
+    uint32_t* rk = key->encrypt;
+    key->rounds = (uint8_t)(nk + 6U);
+
+    for (uint32_t i = 0; i < nk; i++) {
+        rk[i] = load_be32(bytes + 4U * i);
+    }
+    for (uint32_t i = nk; i < words; i++) {
+        uint32_t t = rk[i - 1U];
+        if (i % nk == 0U) {
+            t = sub_word((t << 8) | (t >> 24)) ^ ((uint32_t)rcon[i / nk - 1U] << 24);
+        } else if (nk > 6U && i % nk == 4U) {
+            t = sub_word(t);
+        }
+        rk[i] = rk[i - nk] ^ t;
+    }
+
+    /* The decryption schedule runs backwards, with InvMixColumns on all but the outer round keys */
+    uint32_t* dk = key->decrypt;
+    for (uint32_t round = 0; round <= key->rounds; round++) {
+        const uint32_t* src = rk + 4U * (key->rounds - round);
+        for (uint32_t j = 0; j < 4U; j++) {
+            dk[4U * round + j] = (round == 0U || round == key->rounds) ? src[j] : inv_mix_column(src[j]);
+        }
+    }
+    return SUCCESS;
+}
+
+void aes_encrypt_block(const aes_key_t* key, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE])
+{
+    const uint32_t* rk = key->encrypt;
+    uint32_t s0 = load_be32(in) ^ rk[0];
+    uint32_t s1 = load_be32(in + 4) ^ rk[1];
+    uint32_t s2 = load_be32(in + 8) ^ rk[2];
+    uint32_t s3 = load_be32(in + 12) ^ rk[3];
+
+    for (uint32_t round = 1; round < key->rounds; round++) {
+        rk += 4;
+        uint32_t t0 = te0[s0 >> 24] ^ ror(te0[(s1 >> 16) & 0xFFU], 8) ^ ror(te0[(s2 >> 8) & 0xFFU], 16) ^
+                      ror(te0[s3 & 0xFFU], 24) ^ rk[0];
+        uint32_t t1 = te0[s1 >> 24] ^ ror(te0[(s2 >> 16) & 0xFFU], 8) ^ ror(te0[(s3 >> 8) & 0xFFU], 16) ^
+                      ror(te0[s0 & 0xFFU], 24) ^ rk[1];
+        uint32_t t2 = te0[s2 >> 24] ^ ror(te0[(s3 >> 16) & 0xFFU], 8) ^ ror(te0[(s0 >> 8) & 0xFFU], 16) ^
+                      ror(te0[s1 & 0xFFU], 24) ^ rk[2];
+        uint32_t t3 = te0[s3 >> 24] ^ ror(te0[(s0 >> 16) & 0xFFU], 8) ^ ror(te0[(s1 >> 8) & 0xFFU], 16) ^
+                      ror(te0[s2 & 0xFFU], 24) ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    /* The last round has no MixColumns */
+    rk += 4;
+    uint32_t state[4] = { s0, s1, s2, s3 };
+    for (uint32_t j = 0; j < 4U; j++) {
+        uint32_t w = ((uint32_t)sbox[state[j] >> 24] << 24) |
+                     ((uint32_t)sbox[(state[(j + 1U) & 3U] >> 16) & 0xFFU] << 16) |
+                     ((uint32_t)sbox[(state[(j + 2U) & 3U] >> 8) & 0xFFU] << 8) | sbox[state[(j + 3U) & 3U] & 0xFFU];
+        store_be32(out + 4U * j, w ^ rk[j]);
+    }
+}
+
+void aes_decrypt_block(const aes_key_t* key, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE])
+{
+    const uint32_t* rk = key->decrypt;
+    uint32_t s0 = load_be32(in) ^ rk[0];
+    uint32_t s1 = load_be32(in + 4) ^ rk[1];
+    uint32_t s2 = load_be32(in + 8) ^ rk[2];
+    uint32_t s3 = load_be32(in + 12) ^ rk[3];
+
+    for (uint32_t round = 1; round < key->rounds; round++) {
+        rk += 4;
+        uint32_t t0 = td0[s0 >> 24] ^ ror(td0[(s3 >> 16) & 0xFFU], 8) ^ ror(td0[(s2 >> 8) & 0xFFU], 16) ^
+                      ror(td0[s1 & 0xFFU], 24) ^ rk[0];
+        uint32_t t1 = td0[s1 >> 24] ^ ror(td0[(s0 >> 16) & 0xFFU], 8) ^ ror(td0[(s3 >> 8) & 0xFFU], 16) ^
+                      ror(td0[s2 & 0xFFU], 24) ^ rk[1];
+        uint32_t t2 = td0[s2 >> 24] ^ ror(td0[(s1 >> 16) & 0xFFU], 8) ^ ror(td0[(s0 >> 8) & 0xFFU], 16) ^
+                      ror(td0[s3 & 0xFFU], 24) ^ rk[2];
+        uint32_t t3 = td0[s3 >> 24] ^ ror(td0[(s2 >> 16) & 0xFFU], 8) ^ ror(td0[(s1 >> 8) & 0xFFU], 16) ^
+                      ror(td0[s0 & 0xFFU], 24) ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    rk += 4;
+    uint32_t state[4] = { s0, s1, s2, s3 };
+    for (uint32_t j = 0; j < 4U; j++) {
+        uint32_t w = ((uint32_t)inv_sbox[state[j] >> 24] << 24) |
+                     ((uint32_t)inv_sbox[(state[(j + 3U) & 3U] >> 16) & 0xFFU] << 16) |
+                     ((uint32_t)inv_sbox[(state[(j + 2U) & 3U] >> 8) & 0xFFU] << 8) |
+                     inv_sbox[state[(j + 1U) & 3U] & 0xFFU];
+        store_be32(out + 4U * j, w ^ rk[j]);
+    }
+}
+
+static void xor_block(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+void aes_cbc_encrypt(const aes_key_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out,
+                     size_t length)
+{
+    for (; length >= AES_BLOCK_SIZE; length -= AES_BLOCK_SIZE, in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE) {
+        xor_block(iv, iv, in, AES_BLOCK_SIZE);
+        aes_encrypt_block(key, iv, iv);
+        memcpy(out, iv, AES_BLOCK_SIZE);
+    }
+}
+
+void aes_cbc_decrypt(const aes_key_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out,
+                     size_t length)
+{
+    uint8_t block[AES_BLOCK_SIZE];
+    uint8_t next[AES_BLOCK_SIZE];
+    for (; length >= AES_BLOCK_SIZE; length -= AES_BLOCK_SIZE, in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE) {
+        memcpy(next, in, AES_BLOCK_SIZE);
+        aes_decrypt_block(key, in, block);
+        xor_block(out, block, iv, AES_BLOCK_SIZE);
+        memcpy(iv, next, AES_BLOCK_SIZE);
+    }
+}
+
+void aes_increment(uint8_t counter[AES_BLOCK_SIZE])
+{
+    store_be32(counter + 12, load_be32(counter + 12) + 1U);
+}
+
+void aes_ctr(const aes_key_t* key, uint8_t counter[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out,
+             size_t length)
+{
+    uint8_t stream[AES_BLOCK_SIZE];
+    while (length > 0U) {
+        size_t n = (length < AES_BLOCK_SIZE) ? length : AES_BLOCK_SIZE;
+        aes_encrypt_block(key, counter, stream);
+        aes_increment(counter);
+        xor_block(out, in, stream, n);
+        in += n;
+        out += n;
+        length -= n;
+    }
+}
+
+void aes_ghash_init(aes_ghash_t* ghash, const uint8_t h[AES_BLOCK_SIZE])
+{
+    uint64_t high = load_be64(h);
+    uint64_t low = load_be64(h + 8);
+    ghash->high[0] = 0;
+    ghash->low[0] = 0;
+    ghash->high[8] = high;
+    ghash->low[8] = low;
+
+    /* H times x, x^2 and x^3, for the single bits of a nibble (most significant first) */
+    for (uint32_t i = 4; i > 0U; i >>= 1) {
+        uint64_t reduce = (low & 1U) ? 0xE100000000000000ULL : 0U;
+        low = (high << 63) | (low >> 1);
+        high = (high >> 1) ^ reduce;
+        ghash->high[i] = high;
+        ghash->low[i] = low;
+    }
+    for (uint32_t i = 2; i <= 8U; i *= 2U) {
+        for (uint32_t j = 1; j < i; j++) {
+            ghash->high[i + j] = ghash->high[i] ^ ghash->high[j];
+            ghash->low[i + j] = ghash->low[i] ^ ghash->low[j];
+        }
+    }
+}
+
+/* x = x * H in GF(2^128), a nibble at a time from the last byte */
+static void ghash_multiply(const aes_ghash_t* ghash, uint8_t x[AES_BLOCK_SIZE])
+{
+    uint64_t high = 0;
+    uint64_t low = 0;
+    for (int32_t i = 15; i >= 0; i--) {
+        for (uint32_t half = 0; half < 2U; half++) {
+            uint32_t nibble = half ? (uint32_t)(x[i] >> 4) : (uint32_t)(x[i] & 0x0FU);
+            if (i != 15 || half != 0U) {
+                uint32_t rem = (uint32_t)(low & 0x0FU);
+                low = (high << 60) | (low >> 4);
+                high = (high >> 4) ^ ((uint64_t)last4[rem] << 48);
+            }
+            high ^= ghash->high[nibble];
+            low ^= ghash->low[nibble];
+        }
+    }
+    store_be64(x, high);
+    store_be64(x + 8, low);
+}
+
+void aes_ghash_update(const aes_ghash_t* ghash, uint8_t x[AES_BLOCK_SIZE], const uint8_t* data, size_t length)
+{
+    while (length > 0U) {
+        size_t n = (length < AES_BLOCK_SIZE) ? length : AES_BLOCK_SIZE;
+        xor_block(x, x, data, n);
+        ghash_multiply(ghash, x);
+        data += n;
+        length -= n;
+    }
+}
+
+uint8_t aes_compare(const uint8_t* a, const uint8_t* b, size_t n)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < n; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff;
+}
+
+/* H, the pre-counter block J0 = IV || 1 and the hash of the lengths, shared by both directions */
+static void gcm_begin(const aes_key_t* key, const uint8_t iv[AES_GCM_IV_SIZE], aes_ghash_t* ghash,
+                      uint8_t j0[AES_BLOCK_SIZE])
+{
+    uint8_t h[AES_BLOCK_SIZE];
+    memset(h, 0, sizeof(h));
+    aes_encrypt_block(key, h, h);
+    aes_ghash_init(ghash, h);
+    memcpy(j0, iv, AES_GCM_IV_SIZE);
+    store_be32(j0 + 12, 1);
+}
+
+static void gcm_tag(const aes_key_t* key, const aes_ghash_t* ghash, const uint8_t j0[AES_BLOCK_SIZE],
+                    uint8_t x[AES_BLOCK_SIZE], size_t aad_length, size_t length, uint8_t tag[AES_GCM_TAG_SIZE])
+{
+    uint8_t lengths[AES_BLOCK_SIZE];
+    store_be64(lengths, (uint64_t)aad_length * 8U);
+    store_be64(lengths + 8, (uint64_t)length * 8U);
+    aes_ghash_update(ghash, x, lengths, sizeof(lengths));
+    aes_encrypt_block(key, j0, tag);
+    xor_block(tag, tag, x, AES_GCM_TAG_SIZE);
+}
+
+void aes_gcm_encrypt(const aes_key_t* key, const uint8_t iv[AES_GCM_IV_SIZE], const uint8_t* aad,
+                     size_t aad_length, const uint8_t* in, uint8_t* out, size_t length,
+                     uint8_t tag[AES_GCM_TAG_SIZE])
+{
+    aes_ghash_t ghash;
+    uint8_t j0[AES_BLOCK_SIZE];
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t x[AES_BLOCK_SIZE];
+    gcm_begin(key, iv, &ghash, j0);
+    memset(x, 0, sizeof(x));
+    aes_ghash_update(&ghash, x, aad, aad_length);
+
+    memcpy(counter, j0, sizeof(counter));
+    aes_increment(counter);
+    aes_ctr(key, counter, in, out, length);
+    aes_ghash_update(&ghash, x, out, length);
+    gcm_tag(key, &ghash, j0, x, aad_length, length, tag);
+}
+
+status_t aes_gcm_decrypt(const aes_key_t* key, const uint8_t iv[AES_GCM_IV_SIZE], const uint8_t* aad,
+                         size_t aad_length, const uint8_t* in, uint8_t* out, size_t length,
+                         const uint8_t tag[AES_GCM_TAG_SIZE])
+{
+    aes_ghash_t ghash;
+    uint8_t j0[AES_BLOCK_SIZE];
+    uint8_t counter[AES_BLOCK_SIZE];
+    uint8_t x[AES_BLOCK_SIZE];
+    uint8_t expected[AES_GCM_TAG_SIZE];
+    gcm_begin(key, iv, &ghash, j0);
+    memset(x, 0, sizeof(x));
+    aes_ghash_update(&ghash, x, aad, aad_length);
+    aes_ghash_update(&ghash, x, in, length);
+    gcm_tag(key, &ghash, j0, x, aad_length, length, expected);
+    if (aes_compare(expected, tag, AES_GCM_TAG_SIZE) != 0U) {
+        memset(out, 0, length);
+        return FAILURE;
+    }
+
+    memcpy(counter, j0, sizeof(counter));
+    aes_increment(counter);
+    aes_ctr(key, counter, in, out, length);
+    return SUCCESS;
+}
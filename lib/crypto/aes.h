@@ -0,0 +1,98 @@
+#ifndef AES_H
+#define AES_H
+
+#include "linked_list.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AES in software: the block cipher for 128, 192 and 256-bit keys, and the
+ * CBC, CTR and GCM modes the CRYP driver offers in hardware. It is the
+ * fallback on parts without the CRYP core, and what the host model of the
+ * core computes with.
+ *
+ * Rounds use one table of MixColumns columns (1 KiB) and one of
+ * InvMixColumns columns, rotated for the other three byte positions, which
+ * costs the M4 nothing in its barrel shifter. Like the core, CTR counts in
+ * the low 32 bits of the counter block only, and GCM takes 96-bit IVs.
+ */
+
+#define AES_BLOCK_SIZE 16U
+#define AES_GCM_IV_SIZE 12U
+#define AES_GCM_TAG_SIZE 16U
+
+typedef struct {
+    uint32_t encrypt[60];
+    uint32_t decrypt[60];       /**< For the equivalent inverse cipher */
+    uint8_t rounds;             /**< 10, 12 or 14 */
+} aes_key_t;
+
+/** GHASH multiplication by H, 4 bits at a time (Shoup's tables) */
+typedef struct {
+    uint64_t high[16];
+    uint64_t low[16];
+} aes_ghash_t;
+
+/**
+ * @brief Expands a key of 16, 24 or 32 bytes for both directions.
+ *
+ * @return FAILURE for any other length.
+ */
+status_t aes_set_key(aes_key_t* key, const uint8_t* bytes, size_t length);
+
+void aes_encrypt_block(const aes_key_t* key, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]);
+void aes_decrypt_block(const aes_key_t* key, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]);
+
+/**
+ * @brief CBC over length bytes, a multiple of the block size; in and out
+ * may be the same buffer. iv is left holding the last ciphertext block, to
+ * continue the chain.
+ */
+void aes_cbc_encrypt(const aes_key_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out,
+                     size_t length);
+void aes_cbc_decrypt(const aes_key_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out,
+                     size_t length);
+
+/**
+ * @brief CTR over length bytes, either way; in and out may be the same
+ * buffer. counter is left at the next unused block: a partial last block
+ * uses one up.
+ */
+void aes_ctr(const aes_key_t* key, uint8_t counter[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out,
+             size_t length);
+
+/** Seals length bytes and authenticates them with aad_length bytes of aad. */
+void aes_gcm_encrypt(const aes_key_t* key, const uint8_t iv[AES_GCM_IV_SIZE], const uint8_t* aad,
+                     size_t aad_length, const uint8_t* in, uint8_t* out, size_t length,
+                     uint8_t tag[AES_GCM_TAG_SIZE]);
+
+/**
+ * @brief Opens length bytes sealed by aes_gcm_encrypt.
+ *
+ * @return FAILURE if tag does not match, in which case out is zeroed.
+ */
+status_t aes_gcm_decrypt(const aes_key_t* key, const uint8_t iv[AES_GCM_IV_SIZE], const uint8_t* aad,
+                         size_t aad_length, const uint8_t* in, uint8_t* out, size_t length,
+                         const uint8_t tag[AES_GCM_TAG_SIZE]);
+
+/* GCM building blocks, shared with the CRYP model */
+void aes_ghash_init(aes_ghash_t* ghash, const uint8_t h[AES_BLOCK_SIZE]);
+
+/** Folds length bytes into x, the last partial block padded with zeros. */
+void aes_ghash_update(const aes_ghash_t* ghash, uint8_t x[AES_BLOCK_SIZE], const uint8_t* data, size_t length);
+
+/** Adds one to the low 32 bits of a counter block. */
+void aes_increment(uint8_t counter[AES_BLOCK_SIZE]);
+
+/** Compares n bytes in time independent of their contents: 0 if equal. */
+uint8_t aes_compare(const uint8_t* a, const uint8_t* b, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AES_H
@@ -0,0 +1,413 @@
+#include "cryp.h"
+#include "feature_hooks.h"
+#include <string.h>
+
+#define RCC_AHB2ENR_CRYPEN (1U << 4)
+#define DMA_MAX_WORDS 65532U    /* Whole blocks */
+
+#if !defined(STM32F407xx)
+cryp_regs_t cryp_sim_regs;
+#endif
+
+static dma_stream_t dma_in;
+static dma_stream_t dma_out;
+static cryp_stats_t stats;
+static uint8_t initialized;
+static uint8_t dma_ready;
+static uint8_t busy;            /* The core is taken, by cryp_run or a background job */
+
+/* The job on the core, and how it was set up */
+static cryp_job_t* job;
+static size_t job_done;         /* Payload bytes started through the core */
+static uint32_t job_cr;         /* CR without CRYPEN or the GCM phase */
+static uint8_t job_chain[AES_BLOCK_SIZE]; /* CBC decryption: the last input block, kept for the IV */
+static cryp_callback_t job_callback;
+static void* job_context;
+
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    cryp_sim_write(reg, value);
+#endif
+}
+
+static uint32_t read_reg(volatile uint32_t* reg)
+{
+#if defined(STM32F407xx)
+    return REG_READ(*reg);
+#else
+    return cryp_sim_read(reg);
+#endif
+}
+
+static uint32_t load_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint8_t claim(void)
+{
+    return __atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE) == 0U;
+}
+
+static void release(void)
+{
+    __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+}
+
+static status_t check(const cryp_job_t* j)
+{
+    if (j == NULL || j->key == NULL || j->iv == NULL ||
+        (j->key_length != 16U && j->key_length != 24U && j->key_length != 32U) ||
+        (j->length > 0U && (j->in == NULL || j->out == NULL))) {
+        return FAILURE;
+    }
+    if (j->mode == CRYP_CBC && (j->length % AES_BLOCK_SIZE) != 0U) {
+        return FAILURE;
+    }
+    if (j->mode == CRYP_GCM && (j->tag == NULL || (j->aad_length > 0U && j->aad == NULL))) {
+        return FAILURE;
+    }
+    return (j->mode <= CRYP_GCM) ? SUCCESS : FAILURE;
+}
+
+/* Whether the core can compute the job right, counting the case it cannot */
+static uint8_t core_can_run(const cryp_job_t* j)
+{
+    if (j->mode == CRYP_GCM && !j->decrypt && (j->length % AES_BLOCK_SIZE) != 0U) {
+        STAT_INC(stats.erratum_fallbacks);
+        return 0;
+    }
+    return CRYPTO_HW;
+}
+
+static status_t run_software(cryp_job_t* j)
+{
+    aes_key_t key;
+    status_t status = SUCCESS;
+    (void)aes_set_key(&key, j->key, j->key_length);
+    STAT_ADD(stats.software_bytes, j->length);
+    switch (j->mode) {
+    case CRYP_CBC:
+        if (j->decrypt) {
+            aes_cbc_decrypt(&key, j->iv, j->in, j->out, j->length);
+        } else {
+            aes_cbc_encrypt(&key, j->iv, j->in, j->out, j->length);
+        }
+        break;
+    case CRYP_CTR:
+        aes_ctr(&key, j->iv, j->in, j->out, j->length);
+        break;
+    case CRYP_GCM:
+        if (j->decrypt) {
+            status = aes_gcm_decrypt(&key, j->iv, j->aad, j->aad_length, j->in, j->out, j->length, j->tag);
+        } else {
+            aes_gcm_encrypt(&key, j->iv, j->aad, j->aad_length, j->in, j->out, j->length, j->tag);
+        }
+        break;
+    }
+    if (status != SUCCESS) {
+        STAT_INC(stats.auth_failures);
+    }
+    return status;
+}
+
+/* One block through the FIFOs; a partial one goes in padded with zeros and comes out cut to size */
+static void process_block(const uint8_t* in, uint8_t* out, size_t n)
+{
+    cryp_regs_t* regs = CRYP_REGS;
+    uint32_t words[4] = { 0, 0, 0, 0 };
+    memcpy(words, in, n);
+    for (uint32_t i = 0; i < 4U; i++) {
+        write_reg(&regs->DIN, words[i]);
+    }
+    if (out == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < 4U; i++) {
+        while ((REG_READ(regs->SR) & CRYP_SR_OFNE) == 0U) {
+        }
+        words[i] = read_reg(&regs->DOUT);
+    }
+    memcpy(out, words, n);
+}
+
+static void feed(const uint8_t* in, uint8_t* out, size_t length)
+{
+    STAT_ADD(stats.hardware_bytes, length);
+    for (size_t i = 0; i < length; i += AES_BLOCK_SIZE) {
+        size_t n = (length - i < AES_BLOCK_SIZE) ? length - i : AES_BLOCK_SIZE;
+        process_block(in + i, out + i, n);
+    }
+}
+
+static void wait_idle(void)
+{
+    while (REG_READ(CRYP_REGS->SR) & CRYP_SR_BUSY) {
+    }
+}
+
+/*
+ * Key, IV and mode, up to the point where the core takes the payload. For
+ * GCM that includes the init phase (the core computes H) and the header.
+ */
+static void begin(cryp_job_t* j)
+{
+    cryp_regs_t* regs = CRYP_REGS;
+    uint32_t keysize = ((uint32_t)j->key_length / 8U - 2U) << CRYP_CR_KEYSIZE_Pos;
+    uint32_t first = 8U - (uint32_t)j->key_length / 4U;     /* A 128-bit key goes in K2LR..K3RR */
+    uint32_t cr = CRYP_CR_DATATYPE_BYTE | keysize;
+
+    job = j;
+    job_done = 0;
+    write_reg(&regs->CR, cr);
+    for (uint32_t i = 0; i < (uint32_t)j->key_length / 4U; i++) {
+        write_reg(&regs->K[first + i], load_be32(j->key + 4U * i));
+    }
+
+    if (j->mode == CRYP_GCM) {
+        /* The IV registers hold the first payload counter; J0, one less, is the core's to derive */
+        for (uint32_t i = 0; i < 3U; i++) {
+            write_reg(&regs->IV[i], load_be32(j->iv + 4U * i));
+        }
+        write_reg(&regs->IV[3], 2U);
+        cr |= CRYP_CR_ALGOMODE_AES_GCM;
+        write_reg(&regs->CR, cr | CRYP_CR_GCM_INIT | CRYP_CR_CRYPEN);
+        while (REG_READ(regs->CR) & CRYP_CR_CRYPEN) {
+        }
+
+        write_reg(&regs->CR, cr | CRYP_CR_GCM_HEADER | CRYP_CR_FFLUSH);
+        write_reg(&regs->CR, cr | CRYP_CR_GCM_HEADER | CRYP_CR_CRYPEN);
+        for (size_t i = 0; i < j->aad_length; i += AES_BLOCK_SIZE) {
+            size_t n = (j->aad_length - i < AES_BLOCK_SIZE) ? j->aad_length - i : AES_BLOCK_SIZE;
+            process_block(j->aad + i, NULL, n);
+        }
+        wait_idle();
+
+        job_cr = cr;
+        cr |= CRYP_CR_GCM_PAYLOAD | (j->decrypt ? CRYP_CR_ALGODIR : 0U);
+        write_reg(&regs->CR, cr);
+        write_reg(&regs->CR, cr | CRYP_CR_CRYPEN);
+        return;
+    }
+
+    if (j->mode == CRYP_CBC && j->decrypt) {
+        /* The core derives the decryption key schedule itself */
+        write_reg(&regs->CR, cr | CRYP_CR_ALGOMODE_AES_KEY | CRYP_CR_CRYPEN);
+        wait_idle();
+        cr |= CRYP_CR_ALGODIR;
+        if (j->length > 0U) {
+            memcpy(job_chain, j->in + j->length - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        }
+    }
+    for (uint32_t i = 0; i < 4U; i++) {
+        write_reg(&regs->IV[i], load_be32(j->iv + 4U * i));
+    }
+    cr |= (j->mode == CRYP_CBC) ? CRYP_CR_ALGOMODE_AES_CBC : CRYP_CR_ALGOMODE_AES_CTR;
+    job_cr = cr;
+    write_reg(&regs->CR, cr | CRYP_CR_FFLUSH);
+    write_reg(&regs->CR, cr | CRYP_CR_CRYPEN);
+}
+
+/* After the payload: the GCM tag, or the IV to continue CBC or CTR; the core is left disabled */
+static status_t end(void)
+{
+    cryp_regs_t* regs = CRYP_REGS;
+    cryp_job_t* j = job;
+    status_t status = SUCCESS;
+
+    if (j->mode == CRYP_GCM) {
+        uint8_t lengths[AES_BLOCK_SIZE];
+        uint8_t tag[AES_GCM_TAG_SIZE];
+        uint64_t aad_bits = (uint64_t)j->aad_length * 8U;
+        uint64_t bits = (uint64_t)j->length * 8U;
+        store_be32(lengths, (uint32_t)(aad_bits >> 32));
+        store_be32(lengths + 4, (uint32_t)aad_bits);
+        store_be32(lengths + 8, (uint32_t)(bits >> 32));
+        store_be32(lengths + 12, (uint32_t)bits);
+
+        wait_idle();
+        write_reg(&regs->CR, job_cr | CRYP_CR_GCM_FINAL);
+        write_reg(&regs->CR, job_cr | CRYP_CR_GCM_FINAL | CRYP_CR_CRYPEN);
+        process_block(lengths, tag, sizeof(lengths));
+        if (!j->decrypt) {
+            memcpy(j->tag, tag, sizeof(tag));
+        } else if (aes_compare(tag, j->tag, sizeof(tag)) != 0U) {
+            memset(j->out, 0, j->length);
+            STAT_INC(stats.auth_failures);
+            status = FAILURE;
+        }
+    } else if (j->mode == CRYP_CBC && j->length > 0U) {
+        memcpy(j->iv, j->decrypt ? job_chain : j->out + j->length - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    } else if (j->mode == CRYP_CTR) {
+        uint32_t blocks = (uint32_t)((j->length + AES_BLOCK_SIZE - 1U) / AES_BLOCK_SIZE);
+        store_be32(j->iv + 12, load_be32(j->iv + 12) + blocks);
+    }
+    write_reg(&regs->CR, 0);
+    job = NULL;
+    return status;
+}
+
+static status_t run_core(cryp_job_t* j)
+{
+    begin(j);
+    feed(j->in, j->out, j->length);
+    return end();
+}
+
+static void finish(status_t status)
+{
+    cryp_callback_t callback = job_callback;
+    void* context = job_context;
+    release();
+    callback(status, context);
+}
+
+/* Starts the next transfer of whole blocks, or ends the job with the partial block from the CPU */
+static void next_transfer(void)
+{
+    cryp_regs_t* regs = CRYP_REGS;
+    size_t whole = job->length - job->length % AES_BLOCK_SIZE;
+    if (job_done == whole) {
+        write_reg(&regs->DMACR, 0);
+        feed(job->in + whole, job->out + whole, job->length - whole);
+        finish(end());
+        return;
+    }
+
+    size_t words = (whole - job_done) / 4U;
+    uint32_t count = (words < DMA_MAX_WORDS) ? (uint32_t)words : DMA_MAX_WORDS;
+    const uint8_t* in = job->in + job_done;
+    uint8_t* out = job->out + job_done;
+    job_done += count * 4U;
+    STAT_ADD(stats.hardware_bytes, count * 4U);
+    STAT_ADD(stats.dma_bytes, count * 4U);
+    /* Output first, so it is ready for the first block the input lets through */
+    dma_start(&dma_out, (uintptr_t)&regs->DOUT, out, count);
+    dma_start(&dma_in, (uintptr_t)&regs->DIN, (void*)(uintptr_t)in, count);
+    write_reg(&regs->DMACR, CRYP_DMACR_DIEN | CRYP_DMACR_DOEN);
+#if !defined(STM32F407xx)
+    cryp_sim_dma();
+#endif
+}
+
+static void dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)buffer;
+    (void)context;
+    if (job == NULL) {
+        return;
+    }
+    if (event == DMA_EVENT_ERROR) {
+        /* The output may already overwrite the input, so there is nothing to redo the job from */
+        STAT_INC(stats.dma_errors);
+        dma_stop(&dma_in);
+        dma_stop(&dma_out);
+        write_reg(&CRYP_REGS->DMACR, 0);
+        write_reg(&CRYP_REGS->CR, 0);
+        job = NULL;
+        finish(FAILURE);
+    } else if (event == DMA_EVENT_COMPLETE && stream == &dma_out) {
+        next_transfer();
+    }
+}
+
+status_t cryp_start(cryp_job_t* j, cryp_callback_t callback, void* context)
+{
+    if (callback == NULL || !initialized || check(j) != SUCCESS) {
+        return FAILURE;
+    }
+    if (!core_can_run(j)) {
+        STAT_INC(stats.jobs);
+        callback(run_software(j), context);
+        return SUCCESS;
+    }
+    if (!claim()) {
+        return FAILURE;
+    }
+
+    STAT_INC(stats.jobs);
+    job_callback = callback;
+    job_context = context;
+    if (!dma_ready || j->length < CRYP_DMA_MIN_BYTES || ((uintptr_t)j->in % 4U) != 0U ||
+        ((uintptr_t)j->out % 4U) != 0U) {
+        finish(run_core(j));
+        return SUCCESS;
+    }
+    begin(j);
+    next_transfer();
+    return SUCCESS;
+}
+
+status_t cryp_run(cryp_job_t* j)
+{
+    if (check(j) != SUCCESS) {
+        return FAILURE;
+    }
+    STAT_INC(stats.jobs);
+    if (!initialized || !core_can_run(j)) {
+        return run_software(j);
+    }
+    if (!claim()) {
+        STAT_INC(stats.busy_fallbacks);
+        return run_software(j);
+    }
+    status_t status = run_core(j);
+    release();
+    return status;
+}
+
+status_t cryp_init(void)
+{
+    if (!initialized) {
+#if CRYPTO_HW
+        REG_SET(HAL_RCC->AHB2ENR, RCC_AHB2ENR_CRYPEN);
+        write_reg(&CRYP_REGS->CR, 0);
+#endif
+        initialized = 1;
+    }
+    if (!CRYPTO_HW || dma_ready) {
+        return SUCCESS;
+    }
+
+    /* Four-word bursts, a block at a time, each way */
+    dma_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.channel = CRYP_DMA_CHANNEL;
+    config.priority = 2;
+    config.direction = DMA_MEMORY_TO_PERIPH;
+    config.mode = DMA_MODE_NORMAL;
+    config.peripheral_size = 4;
+    config.memory_size = 4;
+    config.memory_increment = 1;
+    config.fifo_threshold = 4;
+    config.peripheral_burst = 4;
+    config.memory_burst = 4;
+    config.callback = dma_event;
+    if (dma_stream_init(&dma_in, CRYP_DMA_CONTROLLER, CRYP_DMA_IN_STREAM, &config) != SUCCESS) {
+        return FAILURE;
+    }
+    config.direction = DMA_PERIPH_TO_MEMORY;
+    config.priority = 3;
+    if (dma_stream_init(&dma_out, CRYP_DMA_CONTROLLER, CRYP_DMA_OUT_STREAM, &config) != SUCCESS) {
+        dma_stream_release(&dma_in);
+        return FAILURE;
+    }
+    dma_ready = 1;
+    return SUCCESS;
+}
+
+const cryp_stats_t* cryp_get_stats(void)
+{
+    return &stats;
+}
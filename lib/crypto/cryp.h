@@ -0,0 +1,202 @@
+#ifndef CRYP_H
+#define CRYP_H
+
+#include "aes.h"
+#include "dma.h"
+#include "hal_reg.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AES-CBC, CTR and GCM on the CRYP core, fed by DMA.
+ *
+ * A job names the mode, direction, key, IV and buffers. cryp_start hands
+ * its payload to DMA2 stream 6 (into DIN) and stream 5 (out of DOUT),
+ * channel 2 both, and returns; the output stream's interrupt starts each
+ * following transfer of up to 65532 words and, after the last, runs the
+ * callback. The CPU only writes the key and IV, the GCM header, a partial
+ * last CTR or GCM block and the GCM length block, and reads the tag.
+ * Buffers that are not word-aligned, and payloads under CRYP_DMA_MIN_BYTES,
+ * go through the FIFOs from the CPU at once instead, callback included.
+ * cryp_run does the same for a caller that would rather wait.
+ *
+ * The core takes data as bytes (DATATYPE 10): it swaps each word it is
+ * given, so buffers go in and come out in memory order. CTR counts in the
+ * low 32 bits of the counter block and GCM takes 96-bit IVs, as the
+ * software in aes.h does. CBC payloads are whole blocks.
+ *
+ * The core is on the F415/417 and F43x only; this register map is the
+ * F43x one, with GCM. Builds for a part without it (CRYPTO_HW 0, the
+ * default for STM32F407xx) compute every job with aes.h, still reporting
+ * through the callback. So does a job that finds the core in use, from
+ * cryp_run, and a GCM encryption whose payload ends in a partial block:
+ * the F43x hashes the whole last output block into the tag then, bytes
+ * past the end included (a published erratum), so the tag comes out wrong.
+ *
+ * Stream 5 is shared with USART1 RX and stream 6 with SDIO and USART6 TX;
+ * cryp_init fails if either is claimed.
+ */
+
+#ifndef CRYPTO_HW
+#if defined(STM32F407xx)
+#define CRYPTO_HW 0
+#else
+#define CRYPTO_HW 1
+#endif
+#endif
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t SR;
+    volatile uint32_t DIN;
+    volatile uint32_t DOUT;
+    volatile uint32_t DMACR;
+    volatile uint32_t IMSCR;
+    volatile uint32_t RISR;
+    volatile uint32_t MISR;
+    volatile uint32_t K[8];             /**< K0LR, K0RR ... K3RR */
+    volatile uint32_t IV[4];            /**< IV0LR, IV0RR, IV1LR, IV1RR */
+    volatile uint32_t CSGCMCCM[8];
+    volatile uint32_t CSGCM[8];
+} cryp_regs_t;
+
+#if !defined(STM32F407xx)
+extern cryp_regs_t cryp_sim_regs;
+#endif
+
+#define CRYP_REGS HAL_PERIPH(cryp_regs_t, 0x50060000U, cryp_sim_regs)
+
+#define CRYP_CR_ALGODIR (1U << 2)       /**< Decrypt */
+#define CRYP_CR_ALGOMODE_Pos 3U
+#define CRYP_CR_ALGOMODE_Msk ((7U << CRYP_CR_ALGOMODE_Pos) | (1U << 19))
+#define CRYP_CR_ALGOMODE_AES_ECB (4U << CRYP_CR_ALGOMODE_Pos)
+#define CRYP_CR_ALGOMODE_AES_CBC (5U << CRYP_CR_ALGOMODE_Pos)
+#define CRYP_CR_ALGOMODE_AES_CTR (6U << CRYP_CR_ALGOMODE_Pos)
+#define CRYP_CR_ALGOMODE_AES_KEY (7U << CRYP_CR_ALGOMODE_Pos)
+#define CRYP_CR_ALGOMODE_AES_GCM (1U << 19)
+#define CRYP_CR_DATATYPE_BYTE (2U << 6)
+#define CRYP_CR_KEYSIZE_Pos 8U          /**< 0: 128, 1: 192, 2: 256 bits */
+#define CRYP_CR_KEYSIZE_Msk (3U << CRYP_CR_KEYSIZE_Pos)
+#define CRYP_CR_FFLUSH (1U << 14)
+#define CRYP_CR_CRYPEN (1U << 15)
+#define CRYP_CR_GCM_CCMPH_Pos 16U
+#define CRYP_CR_GCM_CCMPH_Msk (3U << CRYP_CR_GCM_CCMPH_Pos)
+#define CRYP_CR_GCM_INIT (0U << CRYP_CR_GCM_CCMPH_Pos)
+#define CRYP_CR_GCM_HEADER (1U << CRYP_CR_GCM_CCMPH_Pos)
+#define CRYP_CR_GCM_PAYLOAD (2U << CRYP_CR_GCM_CCMPH_Pos)
+#define CRYP_CR_GCM_FINAL (3U << CRYP_CR_GCM_CCMPH_Pos)
+
+#define CRYP_SR_IFEM (1U << 0)
+#define CRYP_SR_IFNF (1U << 1)
+#define CRYP_SR_OFNE (1U << 2)
+#define CRYP_SR_OFFU (1U << 3)
+#define CRYP_SR_BUSY (1U << 4)
+
+#define CRYP_DMACR_DIEN (1U << 0)
+#define CRYP_DMACR_DOEN (1U << 1)
+
+/** DMA2 streams, both on channel 2 */
+#define CRYP_DMA_CONTROLLER 2U
+#define CRYP_DMA_OUT_STREAM 5U
+#define CRYP_DMA_IN_STREAM 6U
+#define CRYP_DMA_CHANNEL 2U
+
+#ifndef CRYP_DMA_MIN_BYTES
+#define CRYP_DMA_MIN_BYTES 256U         /**< Below this cryp_start feeds the core from the CPU */
+#endif
+
+typedef enum {
+    CRYP_CBC,
+    CRYP_CTR,
+    CRYP_GCM,
+} cryp_mode_t;
+
+typedef struct {
+    cryp_mode_t mode;
+    uint8_t decrypt;
+    const uint8_t* key;
+    size_t key_length;          /**< 16, 24 or 32 */
+    uint8_t* iv;                /**< CBC and CTR: 16 bytes, left ready to continue; GCM: 12 bytes */
+    const uint8_t* aad;         /**< GCM only */
+    size_t aad_length;
+    const uint8_t* in;
+    uint8_t* out;               /**< May be in */
+    size_t length;
+    uint8_t* tag;               /**< GCM: written when encrypting, checked when decrypting */
+} cryp_job_t;
+
+/**
+ * @brief Receives the end of a job, from the DMA stream interrupt or from
+ * within cryp_start. status is FAILURE if a GCM tag did not match (out is
+ * zeroed then) or a DMA error cut the job short.
+ */
+typedef void (*cryp_callback_t)(status_t status, void* context);
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t hardware_bytes;    /**< Payload through the core, by the CPU or DMA */
+    uint32_t dma_bytes;         /**< Of those, moved by DMA */
+    uint32_t software_bytes;    /**< Payload computed with aes.h */
+    uint32_t busy_fallbacks;    /**< cryp_run calls that found the core in use */
+    uint32_t erratum_fallbacks; /**< GCM encryptions with a partial last block */
+    uint32_t auth_failures;
+    uint32_t dma_errors;
+} cryp_stats_t;
+
+/**
+ * @brief Clocks the core and claims its two DMA streams.
+ *
+ * @return FAILURE if a stream is taken; jobs then go through the FIFOs
+ * from the CPU.
+ */
+status_t cryp_init(void);
+
+/**
+ * @brief Starts a job. Everything it points to must stay put until
+ * callback runs.
+ *
+ * @return FAILURE, without running callback, if callback is NULL, the key
+ * length or the mode's lengths are invalid, cryp_init has not run or the
+ * core is in use.
+ */
+status_t cryp_start(cryp_job_t* job, cryp_callback_t callback, void* context);
+
+/**
+ * @brief Runs a job to the end: on the core from the CPU if it is free,
+ * with aes.h if not (from an interrupt that preempted a job).
+ *
+ * @return FAILURE for invalid lengths or a GCM tag that does not match.
+ */
+status_t cryp_run(cryp_job_t* job);
+
+const cryp_stats_t* cryp_get_stats(void);
+
+#if !defined(STM32F407xx)
+/** Host model: a write to a register with side effects in the hardware. */
+void cryp_sim_write(volatile uint32_t* reg, uint32_t value);
+
+/** Host model: a read that pops the output FIFO. */
+uint32_t cryp_sim_read(volatile uint32_t* reg);
+
+/**
+ * @brief Host model: the input stream stops after words more words, as if
+ * held off the bus, leaving a job in progress.
+ */
+void cryp_sim_dma_hold(uint32_t words);
+
+/** Host model: lets a held job run on. */
+void cryp_sim_dma_resume(void);
+
+/* Hook used by cryp.c in place of the two streams running */
+void cryp_sim_dma(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRYP_H
@@ -0,0 +1,265 @@
+#include "cryp.h"
+#include <string.h>
+
+#if !defined(STM32F407xx)
+
+#define OUT_FIFO_WORDS 8U
+
+/*
+ * The core as the driver uses it: bytes data type, AES in ECB, CBC, CTR
+ * and the four GCM phases, computed with aes.h a block at a time as each
+ * fourth word reaches DIN. It answers at once, so BUSY never shows. A GCM
+ * payload block is hashed whole, as the F43x does, wrong tag and all when
+ * an encryption ends in a partial block.
+ */
+
+static aes_key_t key;
+static aes_ghash_t ghash;
+static uint8_t chain[AES_BLOCK_SIZE];   /* CBC: the last ciphertext block; CTR and GCM: the counter */
+static uint8_t j0[AES_BLOCK_SIZE];
+static uint8_t x[AES_BLOCK_SIZE];
+static uint32_t in_words[4];
+static uint32_t in_count;
+static uint32_t out_fifo[OUT_FIFO_WORDS];
+static uint32_t out_head;
+static uint32_t out_count;
+
+static void update_status(void)
+{
+    cryp_regs_t* regs = &cryp_sim_regs;
+    regs->SR = CRYP_SR_IFNF | ((in_count == 0U) ? CRYP_SR_IFEM : 0U) | ((out_count > 0U) ? CRYP_SR_OFNE : 0U) |
+               ((out_count == OUT_FIFO_WORDS) ? CRYP_SR_OFFU : 0U);
+}
+
+static void push_block(const uint8_t block[AES_BLOCK_SIZE])
+{
+    for (uint32_t i = 0; i < 4U && out_count < OUT_FIFO_WORDS; i++) {
+        memcpy(&out_fifo[(out_head + out_count) % OUT_FIFO_WORDS], block + 4U * i, 4);
+        out_count++;
+    }
+}
+
+static uint32_t pop_word(void)
+{
+    uint32_t word = out_fifo[out_head];
+    out_head = (out_head + 1U) % OUT_FIFO_WORDS;
+    out_count--;
+    return word;
+}
+
+static void load_key(void)
+{
+    cryp_regs_t* regs = &cryp_sim_regs;
+    uint8_t bytes[32];
+    uint32_t words = 4U + 2U * ((regs->CR & CRYP_CR_KEYSIZE_Msk) >> CRYP_CR_KEYSIZE_Pos);
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t word = regs->K[8U - words + i];
+        bytes[4U * i] = (uint8_t)(word >> 24);
+        bytes[4U * i + 1U] = (uint8_t)(word >> 16);
+        bytes[4U * i + 2U] = (uint8_t)(word >> 8);
+        bytes[4U * i + 3U] = (uint8_t)word;
+    }
+    (void)aes_set_key(&key, bytes, 4U * words);
+}
+
+static void load_iv(uint8_t block[AES_BLOCK_SIZE])
+{
+    for (uint32_t i = 0; i < 4U; i++) {
+        uint32_t word = cryp_sim_regs.IV[i];
+        block[4U * i] = (uint8_t)(word >> 24);
+        block[4U * i + 1U] = (uint8_t)(word >> 16);
+        block[4U * i + 2U] = (uint8_t)(word >> 8);
+        block[4U * i + 3U] = (uint8_t)word;
+    }
+}
+
+/* CRYPEN going high: what the core latches for the mode */
+static void enable(uint32_t cr)
+{
+    uint32_t mode = cr & CRYP_CR_ALGOMODE_Msk;
+    if (mode == CRYP_CR_ALGOMODE_AES_GCM) {
+        if ((cr & CRYP_CR_GCM_CCMPH_Msk) == CRYP_CR_GCM_INIT) {
+            uint8_t h[AES_BLOCK_SIZE];
+            load_key();
+            memset(h, 0, sizeof(h));
+            aes_encrypt_block(&key, h, h);
+            aes_ghash_init(&ghash, h);
+            memset(x, 0, sizeof(x));
+            load_iv(chain);
+            memcpy(j0, chain, sizeof(j0));
+            j0[15]--;
+            /* Done with H: the core clears CRYPEN itself */
+            cryp_sim_regs.CR &= ~CRYP_CR_CRYPEN;
+        }
+        return;
+    }
+    load_key();
+    if (mode != CRYP_CR_ALGOMODE_AES_KEY) {
+        load_iv(chain);
+    }
+}
+
+static void process(void)
+{
+    uint32_t cr = cryp_sim_regs.CR;
+    uint8_t decrypt = (cr & CRYP_CR_ALGODIR) != 0U;
+    uint8_t block[AES_BLOCK_SIZE];
+    uint8_t out[AES_BLOCK_SIZE];
+    uint8_t stream[AES_BLOCK_SIZE];
+    memcpy(block, in_words, sizeof(block));
+    in_count = 0;
+
+    switch (cr & CRYP_CR_ALGOMODE_Msk) {
+    case CRYP_CR_ALGOMODE_AES_ECB:
+        if (decrypt) {
+            aes_decrypt_block(&key, block, out);
+        } else {
+            aes_encrypt_block(&key, block, out);
+        }
+        break;
+    case CRYP_CR_ALGOMODE_AES_CBC:
+        if (decrypt) {
+            aes_decrypt_block(&key, block, out);
+            for (uint32_t i = 0; i < AES_BLOCK_SIZE; i++) {
+                out[i] ^= chain[i];
+            }
+            memcpy(chain, block, sizeof(chain));
+        } else {
+            for (uint32_t i = 0; i < AES_BLOCK_SIZE; i++) {
+                block[i] ^= chain[i];
+            }
+            aes_encrypt_block(&key, block, out);
+            memcpy(chain, out, sizeof(chain));
+        }
+        break;
+    case CRYP_CR_ALGOMODE_AES_CTR:
+        aes_encrypt_block(&key, chain, stream);
+        aes_increment(chain);
+        for (uint32_t i = 0; i < AES_BLOCK_SIZE; i++) {
+            out[i] = block[i] ^ stream[i];
+        }
+        break;
+    case CRYP_CR_ALGOMODE_AES_GCM:
+        switch (cr & CRYP_CR_GCM_CCMPH_Msk) {
+        case CRYP_CR_GCM_HEADER:
+            aes_ghash_update(&ghash, x, block, sizeof(block));
+            return;
+        case CRYP_CR_GCM_PAYLOAD:
+            aes_encrypt_block(&key, chain, stream);
+            aes_increment(chain);
+            for (uint32_t i = 0; i < AES_BLOCK_SIZE; i++) {
+                out[i] = block[i] ^ stream[i];
+            }
+            aes_ghash_update(&ghash, x, decrypt ? block : out, sizeof(block));
+            break;
+        case CRYP_CR_GCM_FINAL:
+            aes_ghash_update(&ghash, x, block, sizeof(block));
+            aes_encrypt_block(&key, j0, out);
+            for (uint32_t i = 0; i < AES_BLOCK_SIZE; i++) {
+                out[i] ^= x[i];
+            }
+            break;
+        default:
+            return;
+        }
+        break;
+    default:
+        return;
+    }
+    push_block(out);
+}
+
+/* A word reaching DIN, from the CPU or the input stream */
+static void take_word(uint32_t word)
+{
+    if ((cryp_sim_regs.CR & CRYP_CR_CRYPEN) == 0U) {
+        return;
+    }
+    in_words[in_count++] = word;
+    if (in_count == 4U) {
+        process();
+    }
+    update_status();
+}
+
+void cryp_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    cryp_regs_t* regs = &cryp_sim_regs;
+    if (reg == &regs->DIN) {
+        hal_reg_write(reg, value);
+        take_word(value);
+    } else if (reg == &regs->CR) {
+        uint32_t before = regs->CR;
+        hal_reg_write(reg, value);
+        if (value & CRYP_CR_FFLUSH) {
+            in_count = 0;
+            out_count = 0;
+            regs->CR &= ~CRYP_CR_FFLUSH;
+        }
+        if ((value & CRYP_CR_CRYPEN) && !(before & CRYP_CR_CRYPEN)) {
+            enable(value);
+        }
+        update_status();
+    } else {
+        hal_reg_write(reg, value);
+    }
+}
+
+uint32_t cryp_sim_read(volatile uint32_t* reg)
+{
+    cryp_regs_t* regs = &cryp_sim_regs;
+    if (reg == &regs->DOUT) {
+        if (out_count > 0U) {
+            regs->DOUT = pop_word();
+            update_status();
+        }
+    }
+    return *reg;
+}
+
+static uint32_t hold_after = UINT32_MAX;
+
+/*
+ * The input stream hands DIN a word at a time for as long as DIEN is set;
+ * each block the core finishes goes out through the output stream, whose
+ * last completion may start the next transfer, and this again, from inside.
+ */
+static void run(void)
+{
+    cryp_regs_t* regs = &cryp_sim_regs;
+    while ((regs->DMACR & CRYP_DMACR_DIEN) && hold_after > 0U) {
+        uint32_t word;
+        if (dma_sim_drain(CRYP_DMA_CONTROLLER, CRYP_DMA_IN_STREAM, &word, 1) != 1U) {
+            return;
+        }
+        if (hold_after != UINT32_MAX) {
+            hold_after--;
+        }
+        take_word(word);
+        while ((regs->DMACR & CRYP_DMACR_DOEN) && out_count > 0U) {
+            uint32_t out = pop_word();
+            update_status();
+            if (dma_sim_transfer(CRYP_DMA_CONTROLLER, CRYP_DMA_OUT_STREAM, &out, 1) != 1U) {
+                return;
+            }
+        }
+    }
+}
+
+void cryp_sim_dma(void)
+{
+    run();
+}
+
+void cryp_sim_dma_hold(uint32_t words)
+{
+    hold_after = words;
+}
+
+void cryp_sim_dma_resume(void)
+{
+    hold_after = UINT32_MAX;
+    run();
+}
+
+#endif
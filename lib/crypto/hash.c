@@ -0,0 +1,298 @@
+#include "hash.h"
+#include "feature_hooks.h"
+#include <string.h>
+
+#define RCC_AHB2ENR_HASHEN (1U << 5)
+#define HASH_RNG_IRQN 80U
+#define DMA_MAX_WORDS 65535U
+
+#if !defined(STM32F407xx)
+hash_regs_t hash_sim_regs;
+#endif
+
+static dma_stream_t dma;
+static hash_stats_t stats;
+static uint8_t initialized;
+static uint8_t dma_ready;
+static uint8_t busy;            /* The core is taken, by hash_run or a background job */
+
+/* The background job in progress */
+static uint8_t job_active;
+static sha_algo_t job_algo;
+static const uint8_t* job_key;
+static size_t job_key_length;
+static const uint8_t* job_start;
+static size_t job_length;
+static const uint8_t* job_next;
+static uint32_t job_words;      /* Still to be started after the current transfer */
+static uint8_t* job_digest;
+static hash_callback_t job_callback;
+static void* job_context;
+
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    hash_sim_write(reg, value);
+#endif
+}
+
+static uint32_t load_word(const uint8_t* p)
+{
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static uint8_t claim(void)
+{
+    return __atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE) == 0U;
+}
+
+static void release(void)
+{
+    __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+}
+
+static void run_software(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length,
+                         uint8_t* digest)
+{
+    STAT_ADD(stats.software_bytes, length);
+    if (key != NULL) {
+        hmac(algo, key, key_length, data, length, digest);
+    } else {
+        sha_digest(algo, data, length, digest);
+    }
+}
+
+static void begin(sha_algo_t algo, const uint8_t* key, size_t key_length)
+{
+    uint32_t cr = HASH_CR_DATATYPE_BYTE | ((algo == SHA_256) ? HASH_CR_ALGO_SHA256 : HASH_CR_ALGO_SHA1);
+    if (key != NULL) {
+        cr |= HASH_CR_MODE_HMAC | ((key_length > SHA_BLOCK_SIZE) ? HASH_CR_LKEY : 0U);
+    }
+    write_reg(&HASH_REGS->CR, cr | HASH_CR_INIT);
+}
+
+/* The last bytes of a message, from the CPU, then DCAL; the core stalls the bus while its FIFO is full */
+static void feed_last(const uint8_t* p, size_t length)
+{
+    hash_regs_t* regs = HASH_REGS;
+    uint32_t nblw = (uint32_t)(length % 4U) * 8U;
+    write_reg(&regs->STR, nblw);
+    for (; length >= 4U; length -= 4U, p += 4) {
+        write_reg(&regs->DIN, load_word(p));
+    }
+    if (length > 0U) {
+        uint32_t word = 0;
+        memcpy(&word, p, length);
+        write_reg(&regs->DIN, word);
+    }
+    write_reg(&regs->STR, nblw | HASH_STR_DCAL);
+}
+
+static void wait_idle(void)
+{
+    while (REG_READ(HASH_REGS->SR) & HASH_SR_BUSY) {
+    }
+}
+
+static void read_digest(sha_algo_t algo, uint8_t* digest)
+{
+    hash_regs_t* regs = HASH_REGS;
+    for (size_t i = 0; i < sha_digest_size(algo) / 4U; i++) {
+        uint32_t word = REG_READ(regs->HR_DIGEST[i]);
+        digest[4U * i] = (uint8_t)(word >> 24);
+        digest[4U * i + 1U] = (uint8_t)(word >> 16);
+        digest[4U * i + 2U] = (uint8_t)(word >> 8);
+        digest[4U * i + 3U] = (uint8_t)word;
+    }
+}
+
+static void run_core(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length,
+                     uint8_t* digest)
+{
+    STAT_ADD(stats.hardware_bytes, length);
+    begin(algo, key, key_length);
+    if (key != NULL) {
+        feed_last(key, key_length);
+        wait_idle();
+    }
+    feed_last((const uint8_t*)data, length);
+    if (key != NULL) {
+        wait_idle();
+        feed_last(key, key_length);
+    }
+    while ((REG_READ(HASH_REGS->SR) & HASH_IT_DCI) == 0U) {
+    }
+    read_digest(algo, digest);
+}
+
+static void finish(void)
+{
+    hash_callback_t callback = job_callback;
+    void* context = job_context;
+    uint8_t* digest = job_digest;
+    job_active = 0;
+    release();
+    callback(digest, context);
+}
+
+/* Starts the next transfer of at most 65535 words, or ends the message from the CPU */
+static void next_transfer(void)
+{
+    hash_regs_t* regs = HASH_REGS;
+    if (job_words == 0U) {
+        write_reg(&regs->CR, REG_READ(regs->CR) & ~HASH_CR_DMAE);
+        feed_last(job_next, job_length % 4U);
+        if (job_key != NULL) {
+            wait_idle();
+            feed_last(job_key, job_key_length);
+        }
+        return;
+    }
+
+    const uint8_t* words = job_next;
+    uint32_t count = (job_words < DMA_MAX_WORDS) ? job_words : DMA_MAX_WORDS;
+    job_next += count * 4U;
+    job_words -= count;
+    STAT_ADD(stats.dma_bytes, count * 4U);
+    dma_start(&dma, (uintptr_t)&regs->DIN, (void*)(uintptr_t)words, count);
+#if !defined(STM32F407xx)
+    hash_sim_dma(words, count);
+#endif
+}
+
+static void dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    (void)context;
+    if (!job_active) {
+        return;
+    }
+    if (event == DMA_EVENT_ERROR) {
+        /* How far the core got is unknown; the message is all still there */
+        STAT_INC(stats.dma_errors);
+        write_reg(&HASH_REGS->IMR, 0);
+        write_reg(&HASH_REGS->CR, 0);
+        run_software(job_algo, job_key, job_key_length, job_start, job_length, job_digest);
+        finish();
+    } else if (event == DMA_EVENT_COMPLETE) {
+        next_transfer();
+    }
+}
+
+void hash_irq(void)
+{
+    hash_regs_t* regs = HASH_REGS;
+    if ((REG_READ(regs->SR) & REG_READ(regs->IMR) & HASH_IT_DCI) == 0U || !job_active) {
+        return;
+    }
+    write_reg(&regs->IMR, 0);
+    read_digest(job_algo, job_digest);
+    finish();
+}
+
+status_t hash_start(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length,
+                    uint8_t* digest, hash_callback_t callback, void* context)
+{
+    if (callback == NULL || digest == NULL || !initialized) {
+        return FAILURE;
+    }
+    if (!CRYPTO_HW) {
+        STAT_INC(stats.jobs);
+        run_software(algo, key, key_length, data, length, digest);
+        callback(digest, context);
+        return SUCCESS;
+    }
+    if (!claim()) {
+        return FAILURE;
+    }
+
+    STAT_INC(stats.jobs);
+    if (!dma_ready || length < HASH_DMA_MIN_BYTES || ((uintptr_t)data % 4U) != 0U) {
+        run_core(algo, key, key_length, data, length, digest);
+        release();
+        callback(digest, context);
+        return SUCCESS;
+    }
+
+    job_algo = algo;
+    job_key = key;
+    job_key_length = key_length;
+    job_start = (const uint8_t*)data;
+    job_length = length;
+    job_next = job_start;
+    job_words = (uint32_t)(length / 4U);
+    job_digest = digest;
+    job_callback = callback;
+    job_context = context;
+    job_active = 1;
+    STAT_ADD(stats.hardware_bytes, length);
+
+    begin(algo, key, key_length);
+    if (key != NULL) {
+        feed_last(key, key_length);
+        wait_idle();
+    }
+    write_reg(&HASH_REGS->IMR, HASH_IT_DCI);
+    write_reg(&HASH_REGS->CR, REG_READ(HASH_REGS->CR) | HASH_CR_DMAE | HASH_CR_MDMAT);
+    next_transfer();
+    return SUCCESS;
+}
+
+void hash_run(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length,
+              uint8_t* digest)
+{
+    STAT_INC(stats.jobs);
+    if (!CRYPTO_HW || !initialized) {
+        run_software(algo, key, key_length, data, length, digest);
+        return;
+    }
+    if (!claim()) {
+        STAT_INC(stats.busy_fallbacks);
+        run_software(algo, key, key_length, data, length, digest);
+        return;
+    }
+    run_core(algo, key, key_length, data, length, digest);
+    release();
+}
+
+status_t hash_init(void)
+{
+    if (!initialized) {
+#if CRYPTO_HW
+        REG_SET(HAL_RCC->AHB2ENR, RCC_AHB2ENR_HASHEN);
+        hal_nvic_enable(HASH_RNG_IRQN);
+#endif
+        initialized = 1;
+    }
+    if (!CRYPTO_HW || dma_ready) {
+        return SUCCESS;
+    }
+
+    dma_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.channel = HASH_DMA_CHANNEL;
+    config.priority = 2;
+    config.direction = DMA_MEMORY_TO_PERIPH;
+    config.mode = DMA_MODE_NORMAL;
+    config.peripheral_size = 4;
+    config.memory_size = 4;
+    config.memory_increment = 1;
+    config.fifo_threshold = 4;
+    config.memory_burst = 4;
+    config.callback = dma_event;
+    if (dma_stream_init(&dma, HASH_DMA_CONTROLLER, HASH_DMA_STREAM, &config) != SUCCESS) {
+        return FAILURE;
+    }
+    dma_ready = 1;
+    return SUCCESS;
+}
+
+const hash_stats_t* hash_get_stats(void)
+{
+    return &stats;
+}
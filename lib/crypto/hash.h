@@ -0,0 +1,157 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "sha.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SHA-1, SHA-256 and HMAC over either on the HASH core, fed by DMA.
+ *
+ * hash_start hands the message to DMA2 stream 7, channel 2, in transfers
+ * of up to 65535 whole words with MDMAT set, so the core waits for more
+ * after each. The last transfer's interrupt writes the remaining bytes and
+ * DCAL from the CPU; the core's digest-complete interrupt
+ * (HASH_RNG_IRQHandler, shared with the RNG and defined in rng.c) then
+ * reads the digest and runs the callback. For HMAC the CPU also writes the
+ * key before the message and again after it, waiting out the inner hash's
+ * last block in between.
+ * Messages that are not word-aligned or shorter than HASH_DMA_MIN_BYTES go
+ * through DIN from the CPU at once instead, callback included; hash_run
+ * does the same for a caller that would rather wait.
+ *
+ * The core takes data as bytes (DATATYPE 10), so messages go in memory
+ * order, and hands the digest back as big-endian words. It is on the
+ * F415/417 and F43x only, and SHA-256 on the F43x only: as with the CRYP
+ * driver, builds with CRYPTO_HW 0 (the default for STM32F407xx) compute
+ * with sha.h instead, still reporting through the callback, and so does
+ * hash_run when the core is in use.
+ *
+ * Stream 7 is shared with USART1 TX; hash_init fails if it is claimed.
+ */
+
+#ifndef CRYPTO_HW
+#if defined(STM32F407xx)
+#define CRYPTO_HW 0
+#else
+#define CRYPTO_HW 1
+#endif
+#endif
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t DIN;
+    volatile uint32_t STR;
+    volatile uint32_t HR[5];
+    volatile uint32_t IMR;
+    volatile uint32_t SR;
+    uint32_t reserved0[52];
+    volatile uint32_t CSR[54];
+    uint32_t reserved1[80];
+    volatile uint32_t HR_DIGEST[8];     /**< HASH_DIGEST, at 0x310: all eight words of a SHA-256 digest */
+} hash_regs_t;
+
+#if !defined(STM32F407xx)
+extern hash_regs_t hash_sim_regs;
+#endif
+
+#define HASH_REGS HAL_PERIPH(hash_regs_t, 0x50060400U, hash_sim_regs)
+
+#define HASH_CR_INIT (1U << 2)
+#define HASH_CR_DMAE (1U << 3)
+#define HASH_CR_DATATYPE_BYTE (2U << 4)
+#define HASH_CR_MODE_HMAC (1U << 6)
+#define HASH_CR_ALGO_Msk ((1U << 18) | (1U << 7))
+#define HASH_CR_ALGO_SHA1 0U
+#define HASH_CR_ALGO_SHA256 ((1U << 18) | (1U << 7))
+#define HASH_CR_MDMAT (1U << 13)
+#define HASH_CR_LKEY (1U << 16)         /**< HMAC key longer than a block */
+
+#define HASH_STR_NBLW_Msk 0x1FU         /**< Valid bits in the last word, 0 for all 32 */
+#define HASH_STR_DCAL (1U << 8)
+
+/* IMR and SR */
+#define HASH_IT_DINI (1U << 0)
+#define HASH_IT_DCI (1U << 1)
+#define HASH_SR_DMAS (1U << 2)
+#define HASH_SR_BUSY (1U << 3)
+
+#define HASH_DMA_CONTROLLER 2U
+#define HASH_DMA_STREAM 7U
+#define HASH_DMA_CHANNEL 2U
+
+#ifndef HASH_DMA_MIN_BYTES
+#define HASH_DMA_MIN_BYTES 256U         /**< Below this hash_start feeds the core from the CPU */
+#endif
+
+/** Receives the digest (or MAC) hash_start was given, complete. */
+typedef void (*hash_callback_t)(uint8_t* digest, void* context);
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t hardware_bytes;    /**< Message bytes through the core, by the CPU or DMA */
+    uint32_t dma_bytes;         /**< Of those, moved by DMA */
+    uint32_t software_bytes;    /**< Message bytes hashed with sha.h */
+    uint32_t busy_fallbacks;    /**< hash_run calls that found the core in use */
+    uint32_t dma_errors;        /**< Jobs finished with sha.h after a DMA error */
+} hash_stats_t;
+
+/**
+ * @brief Clocks the core, claims its DMA stream and enables its interrupt.
+ *
+ * @return FAILURE if the stream is taken; messages then go through DIN from
+ * the CPU.
+ */
+status_t hash_init(void);
+
+/**
+ * @brief Starts hashing length bytes of data, or an HMAC of them if key is
+ * not NULL. data, key and digest (sha_digest_size(algo) bytes) must stay
+ * put until callback runs.
+ *
+ * @return FAILURE, without running callback, if callback or digest is NULL,
+ * hash_init has not run or the core is in use.
+ */
+status_t hash_start(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length,
+                    uint8_t* digest, hash_callback_t callback, void* context);
+
+/**
+ * @brief Hashes (or with a key, authenticates) length bytes to the end: on
+ * the core from the CPU if it is free, with sha.h if not.
+ */
+void hash_run(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length,
+              uint8_t* digest);
+
+/** HASH interrupt body (digest complete); HASH_RNG_IRQHandler, in rng.c, calls this. */
+void hash_irq(void);
+
+const hash_stats_t* hash_get_stats(void);
+
+#if !defined(STM32F407xx)
+/** Host model: a write to a register with side effects in the hardware. */
+void hash_sim_write(volatile uint32_t* reg, uint32_t value);
+
+/**
+ * @brief Host model: the DMA stream stops after words more words, as if
+ * held off the bus, leaving a job in progress.
+ */
+void hash_sim_dma_hold(uint32_t words);
+
+/** Host model: lets a held stream move the rest of its words. */
+void hash_sim_dma_resume(void);
+
+/* Hook used by hash.c in place of DMA2 stream 7 moving words into DIN */
+void hash_sim_dma(const void* words, uint32_t count);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HASH_H
@@ -0,0 +1,186 @@
+#include "hash.h"
+#include <string.h>
+
+#if !defined(STM32F407xx)
+
+/*
+ * The core as the driver uses it: bytes data type, SHA-1 or SHA-256, plain
+ * or HMAC, computed with sha.h. The last word written is held back until
+ * DCAL says how many of its bits count. An HMAC goes through the core's
+ * three phases: the key, the message, the key again; each DCAL ends one.
+ * The core answers at once, so BUSY never shows.
+ */
+
+enum {
+    PHASE_HASH,
+    PHASE_KEY,
+    PHASE_MESSAGE,
+    PHASE_OUTER_KEY,
+};
+
+static uint8_t phase;
+static sha_ctx_t sha;           /* The plain hash, or an HMAC key longer than a block */
+static hmac_ctx_t mac;
+static uint8_t key[SHA_BLOCK_SIZE];
+static size_t key_length;
+static uint32_t last_word;
+static uint8_t have_last;
+
+static void raise(uint32_t flags)
+{
+    hash_regs_t* regs = &hash_sim_regs;
+    regs->SR |= flags;
+    if (regs->IMR & flags) {
+        hash_irq();
+    }
+}
+
+static void absorb(const uint8_t* p, size_t n)
+{
+    switch (phase) {
+    case PHASE_HASH:
+        sha_update(&sha, p, n);
+        break;
+    case PHASE_KEY:
+        sha_update(&sha, p, n);
+        if (key_length + n <= sizeof(key)) {
+            memcpy(key + key_length, p, n);
+        }
+        key_length += n;
+        break;
+    case PHASE_MESSAGE:
+        hmac_update(&mac, p, n);
+        break;
+    default:
+        break;
+    }
+}
+
+static void write_digest(const uint8_t* digest, size_t size)
+{
+    for (size_t i = 0; i < size / 4U; i++) {
+        hash_sim_regs.HR_DIGEST[i] = ((uint32_t)digest[4U * i] << 24) | ((uint32_t)digest[4U * i + 1U] << 16) |
+                                     ((uint32_t)digest[4U * i + 2U] << 8) | digest[4U * i + 3U];
+        if (i < 5U) {
+            hash_sim_regs.HR[i] = hash_sim_regs.HR_DIGEST[i];
+        }
+    }
+}
+
+/* A word reaching DIN, from the CPU or the stream */
+static void take_word(uint32_t word)
+{
+    if (have_last) {
+        absorb((const uint8_t*)&last_word, 4);
+    }
+    last_word = word;
+    have_last = 1;
+}
+
+static void calculate(void)
+{
+    hash_regs_t* regs = &hash_sim_regs;
+    uint32_t nblw = regs->STR & HASH_STR_NBLW_Msk;
+    if (have_last) {
+        absorb((const uint8_t*)&last_word, (nblw == 0U) ? 4U : nblw / 8U);
+        have_last = 0;
+    }
+
+    uint8_t digest[SHA_MAX_DIGEST_SIZE];
+    switch (phase) {
+    case PHASE_HASH:
+        sha_final(&sha, digest);
+        write_digest(digest, sha_digest_size(sha.algo));
+        raise(HASH_IT_DCI);
+        break;
+    case PHASE_KEY:
+        if (key_length > SHA_BLOCK_SIZE) {
+            /* LKEY: the core hashes the key first */
+            sha_final(&sha, digest);
+            hmac_init(&mac, sha.algo, digest, sha_digest_size(sha.algo));
+        } else {
+            hmac_init(&mac, sha.algo, key, key_length);
+        }
+        phase = PHASE_MESSAGE;
+        raise(HASH_IT_DINI);
+        break;
+    case PHASE_MESSAGE:
+        phase = PHASE_OUTER_KEY;
+        raise(HASH_IT_DINI);
+        break;
+    default:
+        hmac_final(&mac, digest);
+        write_digest(digest, sha_digest_size(mac.outer.algo));
+        raise(HASH_IT_DCI);
+        break;
+    }
+}
+
+void hash_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    hash_regs_t* regs = &hash_sim_regs;
+    hal_reg_write(reg, value);
+    if (reg == &regs->DIN) {
+        take_word(value);
+    } else if (reg == &regs->STR) {
+        if (value & HASH_STR_DCAL) {
+            regs->STR &= ~HASH_STR_DCAL;
+            calculate();
+        }
+    } else if (reg == &regs->CR && (value & HASH_CR_INIT)) {
+        sha_algo_t algo = ((value & HASH_CR_ALGO_Msk) == HASH_CR_ALGO_SHA256) ? SHA_256 : SHA_1;
+        sha_init(&sha, algo);
+        phase = (value & HASH_CR_MODE_HMAC) ? PHASE_KEY : PHASE_HASH;
+        key_length = 0;
+        have_last = 0;
+        regs->CR &= ~HASH_CR_INIT;
+        regs->SR = HASH_IT_DINI;
+    }
+}
+
+/* Words the stream has yet to move, and how many more it may before holding */
+static const uint8_t* pending;
+static uint32_t pending_count;
+static uint32_t hold_after = UINT32_MAX;
+
+/*
+ * Each word reaches DIN before the stream counts it moved, so that the
+ * last one is in when its completion interrupt ends the message, or starts
+ * the next transfer from inside this one.
+ */
+static void run(void)
+{
+    while (pending_count > 0U && hold_after > 0U) {
+        if (hold_after != UINT32_MAX) {
+            hold_after--;
+        }
+        uint32_t word;
+        memcpy(&word, pending, sizeof(word));
+        pending += 4;
+        pending_count--;
+        take_word(word);
+        if (dma_sim_drain(HASH_DMA_CONTROLLER, HASH_DMA_STREAM, &word, 1) != 1U) {
+            pending_count = 0;
+        }
+    }
+}
+
+void hash_sim_dma(const void* words, uint32_t count)
+{
+    pending = (const uint8_t*)words;
+    pending_count = count;
+    run();
+}
+
+void hash_sim_dma_hold(uint32_t words)
+{
+    hold_after = words;
+}
+
+void hash_sim_dma_resume(void)
+{
+    hold_after = UINT32_MAX;
+    run();
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include "sha.h"
+#include <string.h>
+
+static const uint32_t sha1_init[5] = { 0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U };
+
+static const uint32_t sha256_init[8] = {
+    0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U, 0xA54FF53AU, 0x510E527FU, 0x9B05688CU, 0x1F83D9ABU, 0x5BE0CD19U,
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U, 0x3956C25BU, 0x59F111F1U, 0x923F82A4U, 0xAB1C5ED5U,
+    0xD807AA98U, 0x12835B01U, 0x243185BEU, 0x550C7DC3U, 0x72BE5D74U, 0x80DEB1FEU, 0x9BDC06A7U, 0xC19BF174U,
+    0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU, 0x2DE92C6FU, 0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU,
+    0x983E5152U, 0xA831C66DU, 0xB00327C8U, 0xBF597FC7U, 0xC6E00BF3U, 0xD5A79147U, 0x06CA6351U, 0x14292967U,
+    0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU, 0x53380D13U, 0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U,
+    0xA2BFE8A1U, 0xA81A664BU, 0xC24B8B70U, 0xC76C51A3U, 0xD192E819U, 0xD6990624U, 0xF40E3585U, 0x106AA070U,
+    0x19A4C116U, 0x1E376C08U, 0x2748774CU, 0x34B0BCB5U, 0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU, 0x682E6FF3U,
+    0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U, 0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U, 0xC67178F2U,
+};
+
+static uint32_t rol(uint32_t x, uint32_t n)
+{
+    return (x << n) | (x >> (32U - n));
+}
+
+static uint32_t ror(uint32_t x, uint32_t n)
+{
+    return (x >> n) | (x << (32U - n));
+}
+
+static uint32_t load_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void sha1_block(uint32_t state[8], const uint8_t* p)
+{
+    uint32_t w[16];
+    for (uint32_t i = 0; i < 16U; i++) {
+        w[i] = load_be32(p + 4U * i);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    /* The schedule is kept as a ring of 16 words */
+    for (uint32_t i = 0; i < 80U; i++) {
+        if (i >= 16U) {
+            w[i & 15U] = rol(w[(i + 13U) & 15U] ^ w[(i + 8U) & 15U] ^ w[(i + 2U) & 15U] ^ w[i & 15U], 1);
+        }
+        uint32_t f;
+        uint32_t k;
+        if (i < 20U) {
+            f = d ^ (b & (c ^ d));
+            k = 0x5A827999U;
+        } else if (i < 40U) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1U;
+        } else if (i < 60U) {
+            f = (b & c) | (d & (b | c));
+            k = 0x8F1BBCDCU;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6U;
+        }
+        uint32_t t = rol(a, 5) + f + e + k + w[i & 15U];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+static void sha256_block(uint32_t state[8], const uint8_t* p)
+{
+    uint32_t w[16];
+    for (uint32_t i = 0; i < 16U; i++) {
+        w[i] = load_be32(p + 4U * i);
+    }
+    uint32_t s[8];
+    memcpy(s, state, sizeof(s));
+
+    for (uint32_t i = 0; i < 64U; i++) {
+        if (i >= 16U) {
+            uint32_t w15 = w[(i + 1U) & 15U];
+            uint32_t w2 = w[(i + 14U) & 15U];
+            w[i & 15U] += (ror(w15, 7) ^ ror(w15, 18) ^ (w15 >> 3)) + w[(i + 9U) & 15U] +
+                          (ror(w2, 17) ^ ror(w2, 19) ^ (w2 >> 10));
+        }
+        uint32_t t1 = s[7] + (ror(s[4], 6) ^ ror(s[4], 11) ^ ror(s[4], 25)) + (s[6] ^ (s[4] & (s[5] ^ s[6]))) +
+                      sha256_k[i] + w[i & 15U];
+        uint32_t t2 = (ror(s[0], 2) ^ ror(s[0], 13) ^ ror(s[0], 22)) + ((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+        memmove(s + 1, s, 7U * sizeof(s[0]));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (uint32_t i = 0; i < 8U; i++) {
+        state[i] += s[i];
+    }
+}
+
+static void compress(sha_ctx_t* ctx, const uint8_t* block)
+{
+    if (ctx->algo == SHA_1) {
+        sha1_block(ctx->state, block);
+    } else {
+        sha256_block(ctx->state, block);
+    }
+}
+
+size_t sha_digest_size(sha_algo_t algo)
+{
+    return (algo == SHA_1) ? SHA1_DIGEST_SIZE : SHA256_DIGEST_SIZE;
+}
+
+void sha_init(sha_ctx_t* ctx, sha_algo_t algo)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->algo = algo;
+    if (algo == SHA_1) {
+        memcpy(ctx->state, sha1_init, sizeof(sha1_init));
+    } else {
+        memcpy(ctx->state, sha256_init, sizeof(sha256_init));
+    }
+}
+
+void sha_update(sha_ctx_t* ctx, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    ctx->length += length;
+    if (ctx->used > 0U) {
+        size_t n = SHA_BLOCK_SIZE - ctx->used;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(ctx->block + ctx->used, p, n);
+        ctx->used += (uint32_t)n;
+        p += n;
+        length -= n;
+        if (ctx->used < SHA_BLOCK_SIZE) {
+            return;
+        }
+        compress(ctx, ctx->block);
+        ctx->used = 0;
+    }
+    for (; length >= SHA_BLOCK_SIZE; length -= SHA_BLOCK_SIZE, p += SHA_BLOCK_SIZE) {
+        compress(ctx, p);
+    }
+    memcpy(ctx->block, p, length);
+    ctx->used = (uint32_t)length;
+}
+
+void sha_final(sha_ctx_t* ctx, uint8_t* digest)
+{
+    uint64_t bits = ctx->length * 8U;
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > SHA_BLOCK_SIZE - 8U) {
+        memset(ctx->block + ctx->used, 0, SHA_BLOCK_SIZE - ctx->used);
+        compress(ctx, ctx->block);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, SHA_BLOCK_SIZE - 8U - ctx->used);
+    for (uint32_t i = 0; i < 8U; i++) {
+        ctx->block[SHA_BLOCK_SIZE - 1U - i] = (uint8_t)(bits >> (8U * i));
+    }
+    compress(ctx, ctx->block);
+
+    for (size_t i = 0; i < sha_digest_size(ctx->algo) / 4U; i++) {
+        digest[4U * i] = (uint8_t)(ctx->state[i] >> 24);
+        digest[4U * i + 1U] = (uint8_t)(ctx->state[i] >> 16);
+        digest[4U * i + 2U] = (uint8_t)(ctx->state[i] >> 8);
+        digest[4U * i + 3U] = (uint8_t)ctx->state[i];
+    }
+}
+
+void sha_digest(sha_algo_t algo, const void* data, size_t length, uint8_t* digest)
+{
+    sha_ctx_t ctx;
+    sha_init(&ctx, algo);
+    sha_update(&ctx, data, length);
+    sha_final(&ctx, digest);
+}
+
+void hmac_init(hmac_ctx_t* ctx, sha_algo_t algo, const uint8_t* key, size_t key_length)
+{
+    uint8_t pad[SHA_BLOCK_SIZE];
+    memset(pad, 0, sizeof(pad));
+    if (key_length > SHA_BLOCK_SIZE) {
+        sha_digest(algo, key, key_length, pad);
+    } else {
+        memcpy(pad, key, key_length);
+    }
+
+    for (uint32_t i = 0; i < SHA_BLOCK_SIZE; i++) {
+        pad[i] ^= 0x36;
+    }
+    sha_init(&ctx->inner, algo);
+    sha_update(&ctx->inner, pad, sizeof(pad));
+    for (uint32_t i = 0; i < SHA_BLOCK_SIZE; i++) {
+        pad[i] ^= 0x36 ^ 0x5C;
+    }
+    sha_init(&ctx->outer, algo);
+    sha_update(&ctx->outer, pad, sizeof(pad));
+}
+
+void hmac_update(hmac_ctx_t* ctx, const void* data, size_t length)
+{
+    sha_update(&ctx->inner, data, length);
+}
+
+void hmac_final(hmac_ctx_t* ctx, uint8_t* mac)
+{
+    uint8_t inner[SHA_MAX_DIGEST_SIZE];
+    sha_final(&ctx->inner, inner);
+    sha_update(&ctx->outer, inner, sha_digest_size(ctx->outer.algo));
+    sha_final(&ctx->outer, mac);
+}
+
+void hmac(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length, uint8_t* mac)
+{
+    hmac_ctx_t ctx;
+    hmac_init(&ctx, algo, key, key_length);
+    hmac_update(&ctx, data, length);
+    hmac_final(&ctx, mac);
+}
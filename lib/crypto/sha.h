@@ -0,0 +1,62 @@
+#ifndef SHA_H
+#define SHA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SHA-1 and SHA-256 in software, and HMAC over either: the fallback of the
+ * HASH driver on parts without the core, and what the host model of the
+ * core computes with. Contexts take data in pieces of any size.
+ */
+
+#define SHA_BLOCK_SIZE 64U
+#define SHA1_DIGEST_SIZE 20U
+#define SHA256_DIGEST_SIZE 32U
+#define SHA_MAX_DIGEST_SIZE SHA256_DIGEST_SIZE
+
+typedef enum {
+    SHA_1,
+    SHA_256,
+} sha_algo_t;
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;            /**< Bytes so far */
+    uint8_t block[SHA_BLOCK_SIZE];
+    uint32_t used;              /**< Bytes waiting in block */
+    sha_algo_t algo;
+} sha_ctx_t;
+
+typedef struct {
+    sha_ctx_t inner;
+    sha_ctx_t outer;            /**< Already holds the outer padded key */
+} hmac_ctx_t;
+
+/** 20 or 32. */
+size_t sha_digest_size(sha_algo_t algo);
+
+void sha_init(sha_ctx_t* ctx, sha_algo_t algo);
+void sha_update(sha_ctx_t* ctx, const void* data, size_t length);
+
+/** Writes sha_digest_size() bytes; the context must be initialized again to be reused. */
+void sha_final(sha_ctx_t* ctx, uint8_t* digest);
+
+void sha_digest(sha_algo_t algo, const void* data, size_t length, uint8_t* digest);
+
+/** Keys longer than a block are hashed first, as RFC 2104 has it. */
+void hmac_init(hmac_ctx_t* ctx, sha_algo_t algo, const uint8_t* key, size_t key_length);
+void hmac_update(hmac_ctx_t* ctx, const void* data, size_t length);
+void hmac_final(hmac_ctx_t* ctx, uint8_t* mac);
+
+void hmac(sha_algo_t algo, const uint8_t* key, size_t key_length, const void* data, size_t length, uint8_t* mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHA_H
@@ -0,0 +1,306 @@
+#include "dcmi.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define RCC_AHB2ENR_DCMIEN (1U << 0)
+#define DCMI_IRQN 78U
+#define FRAME_SKIP_MAX 2U
+
+#if !defined(STM32F407xx)
+dcmi_regs_t dcmi_sim_regs;
+#endif
+
+static dcmi_t* active;
+
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    dcmi_sim_write(reg, value);
+#endif
+}
+
+static uint32_t capture_cr(const dcmi_t* dcmi)
+{
+    return dcmi->config.sync | ((uint32_t)dcmi->config.frame_skip << DCMI_CR_FCRC_Pos) | DCMI_CR_ENABLE |
+           DCMI_CR_CAPTURE;
+}
+
+static status_t arm_dma(dcmi_t* dcmi, void* memory0, void* memory1)
+{
+    return dma_start_double_buffer(&dcmi->dma, (uintptr_t)&dcmi->regs->DR, memory0, memory1, dcmi->block_words);
+}
+
+/* The DCMI waits for the next frame start once enabled, so capture resumes on a frame boundary */
+static void enable_capture(dcmi_t* dcmi)
+{
+    write_reg(&dcmi->regs->CR, capture_cr(dcmi) & ~DCMI_CR_CAPTURE);
+    write_reg(&dcmi->regs->CR, capture_cr(dcmi));
+}
+
+static uint8_t frame_started(dcmi_t* dcmi)
+{
+    return dcmi->frame_blocks > 0U || dma_remaining(&dcmi->dma) != dcmi->block_words;
+}
+
+static void end_frame(dcmi_t* dcmi, uint8_t whole)
+{
+    dcmi_frame_t frame = { dcmi->frame_number, dcmi->frame_handed, (uint8_t)(whole && !dcmi->frame_lost), 0 };
+    if (frame.complete) {
+        STAT_INC(dcmi->stats.frames);
+        if (dcmi->config.clock != NULL) {
+            uint32_t now = dcmi->config.clock();
+            if (dcmi->timed) {
+                frame.interval_us = now - dcmi->last_frame_us;
+                STAT_SET(dcmi->stats.frame_interval_us, frame.interval_us);
+                STAT_MIN(dcmi->stats.min_frame_interval_us, frame.interval_us);
+                STAT_MAX(dcmi->stats.max_frame_interval_us, frame.interval_us);
+            }
+            dcmi->last_frame_us = now;
+            dcmi->timed = 1;
+        }
+    } else {
+        STAT_INC(dcmi->stats.dropped_frames);
+    }
+
+    dcmi->frame_number++;
+    dcmi->frame_blocks = 0;
+    dcmi->frame_handed = 0;
+    dcmi->frame_lost = 0;
+    if (dcmi->config.on_frame != NULL) {
+        dcmi->config.on_frame(&frame, dcmi->config.context);
+    }
+}
+
+/* Drops the frame in progress and starts over on the next one, from the start of the current buffers */
+static void restart(dcmi_t* dcmi)
+{
+    write_reg(&dcmi->regs->CR, capture_cr(dcmi) & ~(DCMI_CR_CAPTURE | DCMI_CR_ENABLE));
+    uint8_t started = frame_started(dcmi);
+    dma_stop(&dcmi->dma);
+    write_reg(&dcmi->regs->ICR, DCMI_IT_ALL);
+    if (started) {
+        end_frame(dcmi, 0);
+    }
+    arm_dma(dcmi, dcmi->dma.memory[0], dcmi->dma.memory[1]);
+    enable_capture(dcmi);
+}
+
+static void dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    dcmi_t* dcmi = (dcmi_t*)context;
+    if (event == DMA_EVENT_ERROR) {
+        STAT_INC(dcmi->stats.dma_errors);
+        if (dcmi->running) {
+            restart(dcmi);
+        }
+        return;
+    }
+    if (event != DMA_EVENT_COMPLETE) {
+        return;
+    }
+
+    const dcmi_config_t* config = &dcmi->config;
+    dcmi_lines_t lines = { dcmi->frame_number, (uint16_t)(dcmi->frame_blocks * config->lines_per_block),
+                           config->lines_per_block };
+    dcmi->frame_blocks++;
+
+    /* The hardware has moved on to the other buffer; this one must be replaced before it comes back */
+    msg_t* fresh = msg_alloc(config->pool);
+    if (fresh == NULL) {
+        STAT_INC(dcmi->stats.dropped_blocks);
+        dcmi->frame_lost = 1;
+    } else {
+        dma_set_idle_buffer(stream, msg_payload(fresh));
+        msg_t* block = msg_from_payload(buffer);
+        block->length = (uint16_t)(dcmi->block_words * 4U);
+        block->type = lines.first_line;
+        dcmi->frame_handed++;
+        STAT_INC(dcmi->stats.blocks);
+        config->on_lines(block, &lines, config->context);
+    }
+
+    if (dcmi->frame_blocks == dcmi->blocks_per_frame) {
+        end_frame(dcmi, 1);
+    }
+}
+
+/*
+ * At the frame interrupt the blocks should have just wrapped to the next
+ * frame. The last few words may still be on their way through the FIFOs,
+ * with the last block's completion to come; anything else means lines were
+ * lost or gained and the blocks no longer line up with the frames.
+ */
+static uint8_t frame_in_step(dcmi_t* dcmi)
+{
+    uint32_t remaining = dma_remaining(&dcmi->dma);
+    if (dcmi->frame_blocks == 0U && remaining == dcmi->block_words) {
+        return 1;
+    }
+    /* The DCMI FIFO and the four words of the stream's, and never a whole line */
+    return dcmi->frame_blocks == dcmi->blocks_per_frame - 1U && remaining <= DCMI_FIFO_WORDS + 4U &&
+           remaining < dcmi->line_words;
+}
+
+void dcmi_irq(void)
+{
+    dcmi_t* dcmi = active;
+    if (dcmi == NULL || dcmi->regs == NULL) {
+        return;
+    }
+    dcmi_regs_t* regs = dcmi->regs;
+    uint32_t mis = REG_READ(regs->MIS);
+    write_reg(&regs->ICR, mis);
+    if (!dcmi->running) {
+        return;
+    }
+    if (mis & DCMI_IT_OVR) {
+        STAT_INC(dcmi->stats.overruns);
+        restart(dcmi);
+        return;
+    }
+    if ((mis & DCMI_IT_FRAME) && !frame_in_step(dcmi)) {
+        STAT_INC(dcmi->stats.sync_errors);
+        restart(dcmi);
+    }
+}
+
+status_t dcmi_init(dcmi_t* dcmi, const dcmi_config_t* config)
+{
+    if (dcmi == NULL || config == NULL || config->on_lines == NULL || config->pool == NULL || config->width == 0U ||
+        config->height == 0U || (config->bytes_per_pixel != 1U && config->bytes_per_pixel != 2U) ||
+        config->lines_per_block == 0U || (config->height % config->lines_per_block) != 0U ||
+        config->frame_skip > FRAME_SKIP_MAX || (config->sync & ~DCMI_CR_SYNC_Msk) != 0U) {
+        return FAILURE;
+    }
+    /* The DMA moves words, so lines must not split one */
+    uint32_t line_bytes = (uint32_t)config->width * config->bytes_per_pixel;
+    uint32_t block_bytes = line_bytes * config->lines_per_block;
+    if ((line_bytes % 4U) != 0U || block_bytes / 4U > UINT16_MAX || block_bytes > config->pool->payload_size) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (active != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    active = dcmi;
+    hal_irq_restore(primask);
+
+    memset(dcmi, 0, sizeof(*dcmi));
+    dcmi->config = *config;
+    dcmi->line_words = line_bytes / 4U;
+    dcmi->block_words = block_bytes / 4U;
+    dcmi->blocks_per_frame = config->height / config->lines_per_block;
+
+    /* Words out of the DCMI, gathered in a full DMA FIFO before each write to memory */
+    dma_config_t dma_config;
+    memset(&dma_config, 0, sizeof(dma_config));
+    dma_config.channel = DCMI_DMA_CHANNEL;
+    dma_config.priority = 3; /* The DCMI FIFO holds eight words; a late request loses pixels */
+    dma_config.direction = DMA_PERIPH_TO_MEMORY;
+    dma_config.mode = DMA_MODE_DOUBLE_BUFFER;
+    dma_config.peripheral_size = 4;
+    dma_config.memory_size = 4;
+    dma_config.memory_increment = 1;
+    dma_config.fifo_threshold = 4;
+    dma_config.callback = dma_event;
+    dma_config.context = dcmi;
+    if (dma_stream_init(&dcmi->dma, DCMI_DMA_CONTROLLER, DCMI_DMA_STREAM, &dma_config) != SUCCESS) {
+        active = NULL;
+        return FAILURE;
+    }
+
+    REG_SET(HAL_RCC->AHB2ENR, RCC_AHB2ENR_DCMIEN);
+    dcmi->regs = DCMI_REGS;
+    /* Continuous capture of the whole frame, 8 bits per pixel clock, hardware sync */
+    write_reg(&dcmi->regs->CR, capture_cr(dcmi) & ~(DCMI_CR_CAPTURE | DCMI_CR_ENABLE));
+    write_reg(&dcmi->regs->ICR, DCMI_IT_ALL);
+    write_reg(&dcmi->regs->IER, DCMI_IT_FRAME | DCMI_IT_OVR);
+
+    hal_nvic_enable(DCMI_IRQN);
+    return SUCCESS;
+}
+
+void dcmi_deinit(dcmi_t* dcmi)
+{
+    if (dcmi == NULL || dcmi->regs == NULL) {
+        return;
+    }
+    hal_nvic_disable(DCMI_IRQN);
+
+    uint32_t primask = hal_irq_mask();
+    dcmi_stop(dcmi);
+    write_reg(&dcmi->regs->IER, 0);
+    write_reg(&dcmi->regs->ICR, DCMI_IT_ALL);
+    dma_stream_release(&dcmi->dma);
+    REG_CLEAR(HAL_RCC->AHB2ENR, RCC_AHB2ENR_DCMIEN);
+    dcmi->regs = NULL;
+    active = NULL;
+    hal_irq_restore(primask);
+}
+
+status_t dcmi_start(dcmi_t* dcmi)
+{
+    if (dcmi == NULL || dcmi->regs == NULL || dcmi->running) {
+        return FAILURE;
+    }
+    msg_t* first = msg_alloc(dcmi->config.pool);
+    msg_t* second = msg_alloc(dcmi->config.pool);
+    if (first == NULL || second == NULL) {
+        if (first != NULL) {
+            msg_free(first);
+        }
+        if (second != NULL) {
+            msg_free(second);
+        }
+        return FAILURE;
+    }
+
+    dcmi->frame_blocks = 0;
+    dcmi->frame_handed = 0;
+    dcmi->frame_lost = 0;
+    dcmi->timed = 0;
+    arm_dma(dcmi, msg_payload(first), msg_payload(second));
+    dcmi->running = 1;
+    enable_capture(dcmi);
+    return SUCCESS;
+}
+
+void dcmi_stop(dcmi_t* dcmi)
+{
+    if (dcmi == NULL) {
+        return;
+    }
+    /* A block completing between frame_started() and dma_stop() would end the frame twice */
+    uint32_t primask = hal_irq_mask();
+    if (!dcmi->running) {
+        hal_irq_restore(primask);
+        return;
+    }
+    write_reg(&dcmi->regs->CR, capture_cr(dcmi) & ~(DCMI_CR_CAPTURE | DCMI_CR_ENABLE));
+    uint8_t started = frame_started(dcmi);
+    dma_stop(&dcmi->dma);
+    dcmi->running = 0;
+    if (started) {
+        end_frame(dcmi, 0);
+    }
+    msg_free(msg_from_payload(dcmi->dma.memory[0]));
+    msg_free(msg_from_payload(dcmi->dma.memory[1]));
+    hal_irq_restore(primask);
+}
+
+const dcmi_stats_t* dcmi_get_stats(const dcmi_t* dcmi)
+{
+    return &dcmi->stats;
+}
+
+#if defined(STM32F407xx)
+void DCMI_IRQHandler(void)
+{
+    dcmi_irq();
+}
+#endif
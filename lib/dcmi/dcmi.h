@@ -0,0 +1,238 @@
+#ifndef DCMI_H
+#define DCMI_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "mailbox.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Continuous camera capture through the DCMI.
+ *
+ * The sensor's frames arrive with hardware HSYNC/VSYNC on an 8-bit bus and
+ * DMA2 stream 1 moves them in double-buffer mode into blocks of a few lines
+ * each. Blocks are message payloads from a pool, as in the ADC driver: when
+ * the hardware finishes one, the stream interrupt swaps a fresh message in
+ * as the next idle buffer and hands the full one to the lines callback,
+ * which owns it from then on and frees it (or posts it on) when done. A
+ * QVGA RGB565 frame is 150 KiB, so two of them do not fit in SRAM next to
+ * anything else; strips of lines keep the pipeline in a few buffers. A
+ * block of a whole frame works the same way for formats small enough.
+ *
+ * When the last block of a frame has been handed off the frame callback
+ * reports it, with the time since the previous frame if a clock is given.
+ *
+ * If the pool is empty when a block completes, that block is dropped and
+ * refilled in place, and its frame is reported incomplete. A FIFO overrun,
+ * a DMA error or a frame whose end does not fall on the end of a block (the
+ * sensor sent a different number of lines than configured) drop the frame
+ * in progress and restart capture at the next frame start, from the start of
+ * the current buffers. All of these are counted in dcmi_stats_t.
+ *
+ * Stream 1 is shared with USART6 RX (stream 7, the alternative, with USART1
+ * TX). The pins and the sensor's own configuration (over I2C, usually) are
+ * the application's.
+ */
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t SR;
+    volatile uint32_t RIS;
+    volatile uint32_t IER;
+    volatile uint32_t MIS;
+    volatile uint32_t ICR;
+    volatile uint32_t ESCR;
+    volatile uint32_t ESUR;
+    volatile uint32_t CWSTRT;
+    volatile uint32_t CWSIZE;
+    volatile uint32_t DR;
+} dcmi_regs_t;
+
+#if !defined(STM32F407xx)
+extern dcmi_regs_t dcmi_sim_regs;
+#endif
+
+#define DCMI_REGS HAL_PERIPH(dcmi_regs_t, 0x50050000U, dcmi_sim_regs)
+
+#define DCMI_CR_CAPTURE (1U << 0)
+#define DCMI_CR_CM (1U << 1)
+#define DCMI_CR_CROP (1U << 2)
+#define DCMI_CR_JPEG (1U << 3)
+#define DCMI_CR_ESS (1U << 4)
+#define DCMI_CR_PCKPOL (1U << 5)   /**< Sample on the rising pixel clock edge */
+#define DCMI_CR_HSPOL (1U << 6)    /**< HSYNC active (blanking) high */
+#define DCMI_CR_VSPOL (1U << 7)    /**< VSYNC active (blanking) high */
+#define DCMI_CR_FCRC_Pos 8U
+#define DCMI_CR_FCRC_Msk (3U << DCMI_CR_FCRC_Pos)
+#define DCMI_CR_EDM_Pos 10U
+#define DCMI_CR_ENABLE (1U << 14)
+#define DCMI_CR_SYNC_Msk (DCMI_CR_PCKPOL | DCMI_CR_HSPOL | DCMI_CR_VSPOL)
+
+/* RIS, IER, MIS and ICR */
+#define DCMI_IT_FRAME (1U << 0)
+#define DCMI_IT_OVR (1U << 1)
+#define DCMI_IT_ERR (1U << 2)
+#define DCMI_IT_VSYNC (1U << 3)
+#define DCMI_IT_LINE (1U << 4)
+#define DCMI_IT_ALL 0x1FU
+
+/** DMA request mapping of the DCMI */
+#define DCMI_DMA_CONTROLLER 2U
+#define DCMI_DMA_STREAM 1U
+#define DCMI_DMA_CHANNEL 1U
+
+/** Words the DCMI FIFO holds */
+#define DCMI_FIFO_WORDS 8U
+
+typedef struct {
+    uint32_t frame;             /**< Number of the frame the lines belong to */
+    uint16_t first_line;
+    uint16_t lines;
+} dcmi_lines_t;
+
+typedef struct {
+    uint32_t number;            /**< Counts every frame started, dropped ones included */
+    uint16_t blocks;            /**< Blocks of the frame handed off */
+    uint8_t complete;           /**< Every line of the frame was handed off */
+    uint32_t interval_us;       /**< Since the previous frame ended; 0 for the first, or without a clock */
+} dcmi_frame_t;
+
+/**
+ * @brief Receives a full block, and its ownership, from the stream
+ * interrupt. block->length is the bytes captured and block->type the first
+ * line, so both survive the block being posted on.
+ */
+typedef void (*dcmi_lines_callback_t)(msg_t* block, const dcmi_lines_t* lines, void* context);
+
+/** Reports the end of a frame from interrupt context, delivered or dropped. */
+typedef void (*dcmi_frame_callback_t)(const dcmi_frame_t* frame, void* context);
+
+/** Microseconds from a free-running clock, for the frame timing counters */
+typedef uint32_t (*dcmi_clock_t)(void);
+
+typedef struct {
+    uint16_t width;             /**< Pixels per line */
+    uint16_t height;            /**< Lines per frame */
+    uint8_t bytes_per_pixel;    /**< 1 (raw, Y only) or 2 (RGB565, YCbCr 4:2:2) */
+    uint8_t lines_per_block;    /**< Lines in each block handed off; a divisor of height */
+    uint8_t frame_skip;         /**< Capture every frame (0), every other (1) or one in four (2) */
+    uint32_t sync;              /**< DCMI_CR_PCKPOL, _HSPOL and _VSPOL as the sensor needs */
+    msg_pool_t* pool;           /**< Payloads of at least one block */
+    dcmi_lines_callback_t on_lines;
+    dcmi_frame_callback_t on_frame; /**< May be NULL */
+    dcmi_clock_t clock;             /**< May be NULL: no frame timing */
+    void* context;
+} dcmi_config_t;
+
+typedef struct {
+    uint32_t frames;            /**< Frames handed off whole */
+    uint32_t dropped_frames;    /**< Frames with a block dropped, or cut short by a restart */
+    uint32_t blocks;            /**< Blocks handed off */
+    uint32_t dropped_blocks;    /**< Blocks overwritten because the pool was empty */
+    uint32_t overruns;          /**< DCMI FIFO overruns, each followed by a restart */
+    uint32_t sync_errors;       /**< Frames ending out of step with the blocks, each followed by a restart */
+    uint32_t dma_errors;        /**< DMA errors, each followed by a restart */
+    uint32_t frame_interval_us; /**< Between the last two frames handed off whole */
+    uint32_t min_frame_interval_us;
+    uint32_t max_frame_interval_us;
+} dcmi_stats_t;
+
+typedef struct {
+    dcmi_regs_t* regs;          /**< NULL until initialized */
+    dma_stream_t dma;
+    uint32_t line_words;
+    uint32_t block_words;
+    uint32_t blocks_per_frame;
+    uint8_t running;
+    uint8_t timed;              /**< last_frame_us holds the end of a frame */
+    uint8_t frame_lost;         /**< A block of the frame in progress was dropped */
+    uint16_t frame_handed;      /**< Blocks of the frame in progress handed off */
+    uint32_t frame_number;
+    uint32_t frame_blocks;      /**< Blocks of the frame in progress completed, dropped ones included */
+    uint32_t last_frame_us;
+    dcmi_config_t config;
+    dcmi_stats_t stats;
+} dcmi_t;
+
+/**
+ * @brief Configures the DCMI and its DMA stream; does not start capture.
+ *
+ * @return FAILURE if the configuration is invalid (no lines callback, a
+ * line that is not a whole number of words, lines_per_block not dividing
+ * height, a block over 65535 words or not fitting a pool payload), the
+ * driver is in use or the DMA stream is taken.
+ */
+status_t dcmi_init(dcmi_t* dcmi, const dcmi_config_t* config);
+
+/** Stops capture as dcmi_stop does and releases the DCMI and its stream. */
+void dcmi_deinit(dcmi_t* dcmi);
+
+/**
+ * @brief Takes two blocks from the pool and starts capturing at the next
+ * frame start.
+ *
+ * @return FAILURE if not initialized, already running, or the pool cannot
+ * supply two blocks.
+ */
+status_t dcmi_start(dcmi_t* dcmi);
+
+/**
+ * @brief Stops capture at once and returns the blocks in flight to the
+ * pool. A frame in progress is reported dropped.
+ */
+void dcmi_stop(dcmi_t* dcmi);
+
+/** DCMI interrupt body (frame end and overrun); DCMI_IRQHandler calls this. */
+void dcmi_irq(void);
+
+const dcmi_stats_t* dcmi_get_stats(const dcmi_t* dcmi);
+
+#if !defined(STM32F407xx)
+/**
+ * @brief Host model: sets the sensor timing. Each line takes its bytes
+ * plus hblank pixel clocks, each frame its lines plus vblank lines. The
+ * default is a 12 MHz pixel clock, 160 clocks of horizontal and 20 lines of
+ * vertical blanking.
+ */
+void dcmi_sim_timing(uint32_t pixel_clock_hz, uint32_t hblank, uint32_t vblank);
+
+/**
+ * @brief Host model: the sensor sends one frame of lines lines of
+ * line_bytes each, from image, advancing the modelled time as it goes. The
+ * DCMI captures it if it is enabled for capture at the frame start and the
+ * frame is not skipped; data the DMA stream does not take overruns the
+ * FIFO.
+ *
+ * @return Bytes captured and taken by DMA.
+ */
+uint32_t dcmi_sim_frame(const void* image, uint32_t line_bytes, uint32_t lines);
+
+/**
+ * @brief Host model: runs hook after each line the sensor sends, with the
+ * modelled time at the line's end, e.g. for a consumer model to catch up;
+ * NULL for none.
+ */
+void dcmi_sim_line_hook(void (*hook)(void* context), void* context);
+
+/** Host model: raises an overrun as if the FIFO had filled. */
+void dcmi_sim_overrun(void);
+
+/** Host model: the modelled time, in microseconds; usable as the clock. */
+uint32_t dcmi_sim_time_us(void);
+
+/** Host model: the modelled time in nanoseconds. */
+uint64_t dcmi_sim_time_ns(void);
+
+/** Host model: a write to a register with side effects in the hardware. */
+void dcmi_sim_write(volatile uint32_t* reg, uint32_t value);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DCMI_H
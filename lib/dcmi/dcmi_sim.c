@@ -0,0 +1,124 @@
+#include "dcmi.h"
+
+#if !defined(STM32F407xx)
+
+#define CAPTURE_ENABLED (DCMI_CR_ENABLE | DCMI_CR_CAPTURE)
+
+static uint32_t pixel_clock_hz = 12000000U;
+static uint32_t hblank_clocks = 160U;
+static uint32_t vblank_lines = 20U;
+static uint64_t time_ns;
+static void (*line_hook)(void* context);
+static void* line_hook_context;
+
+static uint8_t capturing;       /* The DCMI caught the start of the frame on the bus */
+static uint32_t frames_offered; /* Frame starts since capture was enabled, for FCRC */
+
+static void spend_clocks(uint64_t clocks)
+{
+    time_ns += clocks * 1000000000ULL / pixel_clock_hz;
+}
+
+static void raise(uint32_t flags)
+{
+    dcmi_regs_t* regs = &dcmi_sim_regs;
+    regs->RIS |= flags;
+    regs->MIS = regs->RIS & regs->IER;
+    if (regs->MIS & flags) {
+        dcmi_irq();
+    }
+}
+
+void dcmi_sim_timing(uint32_t pixel_clock, uint32_t hblank, uint32_t vblank)
+{
+    pixel_clock_hz = pixel_clock;
+    hblank_clocks = hblank;
+    vblank_lines = vblank;
+}
+
+uint32_t dcmi_sim_frame(const void* image, uint32_t line_bytes, uint32_t lines)
+{
+    dcmi_regs_t* regs = &dcmi_sim_regs;
+    const uint8_t* data = (const uint8_t*)image;
+    uint32_t taken = 0;
+
+    /* VSYNC ends: a capturing DCMI takes the frame unless FCRC skips it */
+    capturing = 0;
+    if ((regs->CR & CAPTURE_ENABLED) == CAPTURE_ENABLED) {
+        uint32_t fcrc = (regs->CR & DCMI_CR_FCRC_Msk) >> DCMI_CR_FCRC_Pos;
+        uint32_t every = (fcrc == 0U) ? 1U : (fcrc == 1U) ? 2U : 4U;
+        capturing = (frames_offered % every) == 0U;
+        frames_offered++;
+    }
+
+    uint8_t overrun = 0;
+    for (uint32_t line = 0; line < lines; line++) {
+        spend_clocks(line_bytes + hblank_clocks);
+        if (line_hook != NULL) {
+            line_hook(line_hook_context);
+        }
+        if (!capturing) {
+            continue;
+        }
+        /* Four pixel clocks make a word; a stream that stops taking them lets the FIFO overflow */
+        const uint8_t* word = data + line * line_bytes;
+        for (uint32_t i = 0; i < line_bytes / 4U && capturing; i++, word += 4) {
+            if (dma_sim_transfer(DCMI_DMA_CONTROLLER, DCMI_DMA_STREAM, word, 1) == 1U) {
+                taken += 4U;
+            } else if (!overrun) {
+                overrun = 1;
+                raise(DCMI_IT_OVR);
+            }
+        }
+        if (capturing) {
+            regs->RIS |= DCMI_IT_LINE;
+        }
+    }
+
+    spend_clocks((uint64_t)vblank_lines * (line_bytes + hblank_clocks));
+    regs->RIS |= DCMI_IT_VSYNC;
+    if (capturing) {
+        capturing = 0;
+        raise(DCMI_IT_FRAME);
+    }
+    return taken;
+}
+
+void dcmi_sim_line_hook(void (*hook)(void* context), void* context)
+{
+    line_hook = hook;
+    line_hook_context = context;
+}
+
+void dcmi_sim_overrun(void)
+{
+    raise(DCMI_IT_OVR);
+}
+
+uint32_t dcmi_sim_time_us(void)
+{
+    return (uint32_t)(time_ns / 1000U);
+}
+
+uint64_t dcmi_sim_time_ns(void)
+{
+    return time_ns;
+}
+
+void dcmi_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    dcmi_regs_t* regs = &dcmi_sim_regs;
+    hal_reg_write(reg, value);
+    if (reg == &regs->ICR) {
+        regs->RIS &= ~(value & DCMI_IT_ALL);
+        regs->MIS = regs->RIS & regs->IER;
+    } else if (reg == &regs->IER) {
+        regs->MIS = regs->RIS & regs->IER;
+    } else if (reg == &regs->CR && (value & CAPTURE_ENABLED) != CAPTURE_ENABLED) {
+        /* Disabled mid-frame, the rest of it is lost; capture resumes at a frame start */
+        capturing = 0;
+        frames_offered = 0;
+    }
+}
+
+#endif
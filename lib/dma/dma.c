@@ -0,0 +1,433 @@
+#include "dma.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define RCC_AHB1ENR_DMA1EN (1U << 21)
+#define RCC_AHB1ENR_DMA2EN (1U << 22)
+
+/* Flag positions of streams 0-3 in LISR/LIFCR, and of 4-7 in HISR/HIFCR */
+static const uint8_t flag_shift[4] = { 0, 6, 16, 22 };
+
+static const uint8_t stream_irqn[DMA_CONTROLLERS][DMA_STREAMS_PER_CONTROLLER] = {
+    { 11, 12, 13, 14, 15, 16, 17, 47 },
+    { 56, 57, 58, 59, 60, 68, 69, 70 },
+};
+
+#if !defined(STM32F407xx)
+dma_regs_t dma_sim_regs[DMA_CONTROLLERS];
+#endif
+
+static dma_stream_t* streams[DMA_CONTROLLERS][DMA_STREAMS_PER_CONTROLLER];
+
+static dma_regs_t* controller_regs(uint8_t controller)
+{
+    return (controller == 1U) ? DMA1_REGS : DMA2_REGS;
+}
+
+/* Maps 1/2/4 bytes to the PSIZE/MSIZE encoding, or -1 */
+static int32_t encode_size(uint8_t size)
+{
+    switch (size) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    default: return -1;
+    }
+}
+
+/* Maps 1/4/8/16 beats to the PBURST/MBURST encoding, or -1 */
+static int32_t encode_burst(uint8_t beats)
+{
+    switch (beats) {
+    case 0:
+    case 1: return 0;
+    case 4: return 1;
+    case 8: return 2;
+    case 16: return 3;
+    default: return -1;
+    }
+}
+
+static status_t build_config(dma_stream_t* stream, uint8_t controller, const dma_config_t* config)
+{
+    int32_t psize = encode_size(config->peripheral_size);
+    int32_t msize = encode_size(config->memory_size);
+    int32_t pburst = encode_burst(config->peripheral_burst);
+    int32_t mburst = encode_burst(config->memory_burst);
+
+    if (config->channel > 7U || config->priority > 3U || config->direction > DMA_MEMORY_TO_MEMORY ||
+        config->mode > DMA_MODE_DOUBLE_BUFFER || config->fifo_threshold > 4U || psize < 0 || msize < 0 ||
+        pburst < 0 || mburst < 0) {
+        return FAILURE;
+    }
+    if (config->direction == DMA_MEMORY_TO_MEMORY &&
+        (controller != 2U || config->mode != DMA_MODE_NORMAL || config->fifo_threshold == 0U)) {
+        return FAILURE;
+    }
+
+    /* Only the SDIO can end a transfer, and only a one-shot one */
+    if (config->peripheral_flow &&
+        (config->direction == DMA_MEMORY_TO_MEMORY || config->mode != DMA_MODE_NORMAL)) {
+        return FAILURE;
+    }
+
+    uint32_t fcr;
+    if (config->fifo_threshold == 0U) {
+        /* Direct mode: no packing and no bursts */
+        if (psize != msize || pburst != 0 || mburst != 0) {
+            return FAILURE;
+        }
+        fcr = 0;
+    } else {
+        /* A memory burst has to divide the threshold; a peripheral burst has to fit the 16-byte FIFO */
+        uint32_t threshold_bytes = config->fifo_threshold * 4U;
+        uint32_t mburst_bytes = (config->memory_burst > 1U ? config->memory_burst : 1U) * config->memory_size;
+        uint32_t pburst_bytes = (config->peripheral_burst > 1U ? config->peripheral_burst : 1U) *
+                                config->peripheral_size;
+        if (mburst_bytes > threshold_bytes || (threshold_bytes % mburst_bytes) != 0U || pburst_bytes > 16U) {
+            return FAILURE;
+        }
+        fcr = DMA_SxFCR_DMDIS | ((uint32_t)(config->fifo_threshold - 1U) << DMA_SxFCR_FTH_Pos);
+    }
+
+    uint32_t cr = ((uint32_t)config->channel << DMA_SxCR_CHSEL_Pos) |
+                  ((uint32_t)config->priority << DMA_SxCR_PL_Pos) |
+                  ((uint32_t)config->direction << DMA_SxCR_DIR_Pos) | ((uint32_t)psize << DMA_SxCR_PSIZE_Pos) |
+                  ((uint32_t)msize << DMA_SxCR_MSIZE_Pos) | ((uint32_t)pburst << DMA_SxCR_PBURST_Pos) |
+                  ((uint32_t)mburst << DMA_SxCR_MBURST_Pos) | DMA_SxCR_TCIE | DMA_SxCR_TEIE | DMA_SxCR_DMEIE;
+    if (config->peripheral_increment) {
+        cr |= DMA_SxCR_PINC;
+    }
+    if (config->memory_increment) {
+        cr |= DMA_SxCR_MINC;
+    }
+    if (config->half_transfer) {
+        cr |= DMA_SxCR_HTIE;
+    }
+    if (config->peripheral_flow) {
+        cr |= DMA_SxCR_PFCTRL;
+    }
+    if (config->mode == DMA_MODE_CIRCULAR) {
+        cr |= DMA_SxCR_CIRC;
+    } else if (config->mode == DMA_MODE_DOUBLE_BUFFER) {
+        cr |= DMA_SxCR_DBM | DMA_SxCR_CIRC;
+    }
+
+    stream->cr = cr;
+    stream->fcr = fcr;
+    return SUCCESS;
+}
+
+status_t dma_stream_init(dma_stream_t* stream, uint8_t controller, uint8_t stream_index, const dma_config_t* config)
+{
+    if (stream == NULL || config == NULL || controller < 1U || controller > DMA_CONTROLLERS ||
+        stream_index >= DMA_STREAMS_PER_CONTROLLER) {
+        return FAILURE;
+    }
+
+    memset(stream, 0, sizeof(*stream));
+    if (build_config(stream, controller, config) != SUCCESS) {
+        return FAILURE;
+    }
+
+    /* Claiming a stream may race with another driver's init from a task */
+    uint32_t primask = hal_irq_mask();
+    if (streams[controller - 1U][stream_index] != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    streams[controller - 1U][stream_index] = stream;
+    hal_irq_restore(primask);
+
+    stream->controller = controller_regs(controller);
+    stream->regs = &stream->controller->S[stream_index];
+    stream->controller_index = controller;
+    stream->stream_index = stream_index;
+    stream->mode = config->mode;
+    stream->callback = config->callback;
+    stream->context = config->context;
+
+    REG_SET(HAL_RCC->AHB1ENR, (controller == 1U) ? RCC_AHB1ENR_DMA1EN : RCC_AHB1ENR_DMA2EN);
+    hal_nvic_enable(stream_irqn[controller - 1U][stream_index]);
+    return SUCCESS;
+}
+
+void dma_stream_release(dma_stream_t* stream)
+{
+    dma_stop(stream);
+    hal_nvic_disable(stream_irqn[stream->controller_index - 1U][stream->stream_index]);
+
+    uint32_t primask = hal_irq_mask();
+    streams[stream->controller_index - 1U][stream->stream_index] = NULL;
+    hal_irq_restore(primask);
+}
+
+/* Writing xIFCR clears the flags in xISR; the host model does that here */
+static void write_ifcr(dma_regs_t* regs, uint8_t stream_index, uint32_t bits)
+{
+    if (stream_index < 4U) {
+        REG_WRITE(regs->LIFCR, bits);
+#if !defined(STM32F407xx)
+        regs->LISR &= ~bits;
+#endif
+    } else {
+        REG_WRITE(regs->HIFCR, bits);
+#if !defined(STM32F407xx)
+        regs->HISR &= ~bits;
+#endif
+    }
+}
+
+static void clear_flags(dma_stream_t* stream)
+{
+    write_ifcr(stream->controller, stream->stream_index, DMA_FLAG_ALL << flag_shift[stream->stream_index & 3U]);
+}
+
+void dma_stop(dma_stream_t* stream)
+{
+    dma_stream_regs_t* regs = stream->regs;
+    if (REG_READ(regs->CR) & DMA_SxCR_EN) {
+        REG_CLEAR(regs->CR, DMA_SxCR_EN);
+        /* EN stays set until the current beat has finished */
+        while (REG_READ(regs->CR) & DMA_SxCR_EN) {
+        }
+    }
+    clear_flags(stream);
+    stream->active = 0;
+}
+
+static status_t start(dma_stream_t* stream, uintptr_t peripheral, void* memory0, void* memory1, uint32_t count)
+{
+    if (count == 0U || count > UINT16_MAX) {
+        return FAILURE;
+    }
+
+    dma_stop(stream);
+    stream->memory[0] = memory0;
+    stream->memory[1] = memory1;
+    stream->count = count;
+
+    /* Sequence from RM0090 9.3.18: addresses, count, FIFO, control, then enable */
+    dma_stream_regs_t* regs = stream->regs;
+    REG_WRITE(regs->PAR, peripheral);
+    REG_WRITE(regs->M0AR, (uintptr_t)memory0);
+    if (stream->mode == DMA_MODE_DOUBLE_BUFFER) {
+        REG_WRITE(regs->M1AR, (uintptr_t)memory1);
+    }
+    REG_WRITE(regs->NDTR, count);
+    REG_WRITE(regs->FCR, stream->fcr);
+    REG_WRITE(regs->CR, stream->cr);
+
+    stream->active = 1;
+    REG_WRITE(regs->CR, stream->cr | DMA_SxCR_EN);
+    return SUCCESS;
+}
+
+status_t dma_start(dma_stream_t* stream, uintptr_t peripheral, void* memory, uint32_t count)
+{
+    if (stream == NULL || memory == NULL || stream->mode == DMA_MODE_DOUBLE_BUFFER) {
+        return FAILURE;
+    }
+    return start(stream, peripheral, memory, NULL, count);
+}
+
+status_t dma_start_double_buffer(dma_stream_t* stream, uintptr_t peripheral, void* memory0, void* memory1,
+                                 uint32_t count)
+{
+    if (stream == NULL || memory0 == NULL || memory1 == NULL || stream->mode != DMA_MODE_DOUBLE_BUFFER) {
+        return FAILURE;
+    }
+    return start(stream, peripheral, memory0, memory1, count);
+}
+
+status_t dma_set_idle_buffer(dma_stream_t* stream, void* memory)
+{
+    if (stream == NULL || memory == NULL || stream->mode != DMA_MODE_DOUBLE_BUFFER) {
+        return FAILURE;
+    }
+    /* The hardware only accepts a write to the address register it is not using */
+    if (REG_READ(stream->regs->CR) & DMA_SxCR_CT) {
+        stream->memory[0] = memory;
+        REG_WRITE(stream->regs->M0AR, (uintptr_t)memory);
+    } else {
+        stream->memory[1] = memory;
+        REG_WRITE(stream->regs->M1AR, (uintptr_t)memory);
+    }
+    return SUCCESS;
+}
+
+void dma_set_memory_increment(dma_stream_t* stream, uint8_t enable)
+{
+    if (enable) {
+        stream->cr |= DMA_SxCR_MINC;
+    } else {
+        stream->cr &= ~DMA_SxCR_MINC;
+    }
+}
+
+status_t dma_set_direction(dma_stream_t* stream, dma_direction_t direction)
+{
+    uint32_t mask = 3U << DMA_SxCR_DIR_Pos;
+    if (direction == DMA_MEMORY_TO_MEMORY ||
+        (stream->cr & mask) == ((uint32_t)DMA_MEMORY_TO_MEMORY << DMA_SxCR_DIR_Pos)) {
+        return FAILURE;
+    }
+    stream->cr = (stream->cr & ~mask) | ((uint32_t)direction << DMA_SxCR_DIR_Pos);
+    return SUCCESS;
+}
+
+uint32_t dma_remaining(const dma_stream_t* stream)
+{
+    return REG_READ(stream->regs->NDTR) & 0xFFFFU;
+}
+
+uint32_t dma_current_buffer(const dma_stream_t* stream)
+{
+    return (REG_READ(stream->regs->CR) & DMA_SxCR_CT) ? 1U : 0U;
+}
+
+static void notify(dma_stream_t* stream, dma_event_t event, void* buffer)
+{
+    if (stream->callback != NULL) {
+        stream->callback(stream, event, buffer, stream->context);
+    }
+}
+
+void dma_stream_irq(uint8_t controller, uint8_t stream_index)
+{
+    dma_regs_t* regs = controller_regs(controller);
+    uint32_t shift = flag_shift[stream_index & 3U];
+    uint32_t flags;
+
+    if (stream_index < 4U) {
+        flags = (REG_READ(regs->LISR) >> shift) & DMA_FLAG_ALL;
+    } else {
+        flags = (REG_READ(regs->HISR) >> shift) & DMA_FLAG_ALL;
+    }
+    write_ifcr(regs, stream_index, flags << shift);
+
+    dma_stream_t* stream = streams[controller - 1U][stream_index];
+    if (stream == NULL || flags == 0U) {
+        return;
+    }
+
+    /* FIFO errors are not enabled as interrupts; they only ride along and are counted */
+    if (flags & DMA_FLAG_FE) {
+        STAT_INC(stream->stats.fifo_errors);
+    }
+    if (flags & (DMA_FLAG_TE | DMA_FLAG_DME)) {
+        if (flags & DMA_FLAG_TE) {
+            STAT_INC(stream->stats.transfer_errors);
+        }
+        if (flags & DMA_FLAG_DME) {
+            STAT_INC(stream->stats.direct_mode_errors);
+        }
+        /* A transfer error has already cleared EN; a direct mode error has not */
+        dma_stop(stream);
+        notify(stream, DMA_EVENT_ERROR, stream->memory[dma_current_buffer(stream)]);
+        return;
+    }
+
+    uint32_t current = (stream->mode == DMA_MODE_DOUBLE_BUFFER) ? dma_current_buffer(stream) : 0U;
+    /* HTIF is set whether or not the half-transfer interrupt is wanted */
+    if ((flags & DMA_FLAG_HT) && (stream->cr & DMA_SxCR_HTIE)) {
+        STAT_INC(stream->stats.half_transfers);
+        notify(stream, DMA_EVENT_HALF, stream->memory[current]);
+    }
+    if (flags & DMA_FLAG_TC) {
+        STAT_INC(stream->stats.transfers);
+        if (stream->mode == DMA_MODE_NORMAL) {
+            stream->active = 0;
+        }
+        /* CT has already switched, so the finished buffer is the other one */
+        notify(stream, DMA_EVENT_COMPLETE, stream->memory[current ^ (stream->mode == DMA_MODE_DOUBLE_BUFFER)]);
+    }
+}
+
+#if !defined(STM32F407xx)
+/* One request at a time, in either direction: to_memory copies from data, otherwise into it */
+static uint32_t sim_run(uint8_t controller, uint8_t stream_index, uint8_t* data, uint32_t count, uint8_t to_memory)
+{
+    dma_regs_t* controller_block = controller_regs(controller);
+    dma_stream_regs_t* regs = &controller_block->S[stream_index];
+    dma_stream_t* stream = streams[controller - 1U][stream_index];
+    volatile uint32_t* isr = (stream_index < 4U) ? &controller_block->LISR : &controller_block->HISR;
+    uint32_t shift = flag_shift[stream_index & 3U];
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (stream == NULL || (regs->CR & DMA_SxCR_EN) == 0U) {
+            return i;
+        }
+        uint32_t size = 1U << ((regs->CR >> DMA_SxCR_MSIZE_Pos) & 3U);
+        uint32_t remaining = regs->NDTR;
+        uint32_t offset = (regs->CR & DMA_SxCR_MINC) ? (stream->count - remaining) * size : 0U;
+
+        /* The address registers are 32 bits wide, too narrow for host pointers */
+        uint8_t* memory = (uint8_t*)stream->memory[(regs->CR & DMA_SxCR_CT) ? 1U : 0U];
+        if (to_memory) {
+            memcpy(memory + offset, data + i * size, size);
+        } else {
+            memcpy(data + i * size, memory + offset, size);
+        }
+
+        remaining--;
+        uint32_t flags = 0;
+        if (remaining == stream->count / 2U) {
+            flags |= DMA_FLAG_HT;
+        }
+        if (remaining == 0U) {
+            flags |= DMA_FLAG_TC;
+            if (regs->CR & DMA_SxCR_CIRC) {
+                remaining = stream->count;
+                if (regs->CR & DMA_SxCR_DBM) {
+                    regs->CR ^= DMA_SxCR_CT;
+                }
+            } else {
+                regs->CR &= ~DMA_SxCR_EN;
+            }
+        }
+        regs->NDTR = remaining;
+
+        if (flags != 0U) {
+            *isr |= flags << shift;
+            if (regs->CR & (DMA_SxCR_TCIE | DMA_SxCR_HTIE)) {
+                dma_stream_irq(controller, stream_index);
+            }
+            /* Stands in for the flag clear the interrupt wrote to xIFCR */
+            *isr &= ~(DMA_FLAG_ALL << shift);
+        }
+    }
+    return count;
+}
+
+uint32_t dma_sim_transfer(uint8_t controller, uint8_t stream_index, const void* data, uint32_t count)
+{
+    /* Only read through when to_memory is set */
+    return sim_run(controller, stream_index, (uint8_t*)(uintptr_t)data, count, 1);
+}
+
+uint32_t dma_sim_drain(uint8_t controller, uint8_t stream_index, void* data, uint32_t count)
+{
+    return sim_run(controller, stream_index, (uint8_t*)data, count, 0);
+}
+#endif
+
+#if defined(STM32F407xx)
+void DMA1_Stream0_IRQHandler(void) { dma_stream_irq(1, 0); }
+void DMA1_Stream1_IRQHandler(void) { dma_stream_irq(1, 1); }
+void DMA1_Stream2_IRQHandler(void) { dma_stream_irq(1, 2); }
+void DMA1_Stream3_IRQHandler(void) { dma_stream_irq(1, 3); }
+void DMA1_Stream4_IRQHandler(void) { dma_stream_irq(1, 4); }
+void DMA1_Stream5_IRQHandler(void) { dma_stream_irq(1, 5); }
+void DMA1_Stream6_IRQHandler(void) { dma_stream_irq(1, 6); }
+void DMA1_Stream7_IRQHandler(void) { dma_stream_irq(1, 7); }
+void DMA2_Stream0_IRQHandler(void) { dma_stream_irq(2, 0); }
+void DMA2_Stream1_IRQHandler(void) { dma_stream_irq(2, 1); }
+void DMA2_Stream2_IRQHandler(void) { dma_stream_irq(2, 2); }
+void DMA2_Stream3_IRQHandler(void) { dma_stream_irq(2, 3); }
+void DMA2_Stream4_IRQHandler(void) { dma_stream_irq(2, 4); }
+void DMA2_Stream5_IRQHandler(void) { dma_stream_irq(2, 5); }
+void DMA2_Stream6_IRQHandler(void) { dma_stream_irq(2, 6); }
+void DMA2_Stream7_IRQHandler(void) { dma_stream_irq(2, 7); }
+#endif
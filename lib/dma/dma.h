@@ -0,0 +1,257 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DMA stream engine for DMA1 and DMA2.
+ *
+ * A driver claims one of the sixteen streams with dma_stream_init(), naming
+ * the request channel its peripheral is wired to and the arbitration
+ * priority the stream should have against the other streams of the same
+ * controller. A claimed stream then moves blocks between the peripheral and
+ * memory as a one-shot transfer, a circular transfer that restarts on its
+ * own, or a double-buffer (ping-pong) transfer where the hardware alternates
+ * between two memory buffers and the driver refills the idle one.
+ *
+ * Progress is reported from the stream interrupt through the callback:
+ * an error first (the hardware has then stopped the stream), then half
+ * transfer, then transfer complete, in that order when several are pending.
+ */
+
+#define DMA_CONTROLLERS 2U
+#define DMA_STREAMS_PER_CONTROLLER 8U
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t NDTR;
+    volatile uint32_t PAR;
+    volatile uint32_t M0AR;
+    volatile uint32_t M1AR;
+    volatile uint32_t FCR;
+} dma_stream_regs_t;
+
+typedef struct {
+    volatile uint32_t LISR;
+    volatile uint32_t HISR;
+    volatile uint32_t LIFCR;
+    volatile uint32_t HIFCR;
+    dma_stream_regs_t S[DMA_STREAMS_PER_CONTROLLER];
+} dma_regs_t;
+
+#if !defined(STM32F407xx)
+extern dma_regs_t dma_sim_regs[DMA_CONTROLLERS];
+#endif
+
+#define DMA1_REGS HAL_PERIPH(dma_regs_t, 0x40026000U, dma_sim_regs[0])
+#define DMA2_REGS HAL_PERIPH(dma_regs_t, 0x40026400U, dma_sim_regs[1])
+
+#define DMA_SxCR_EN (1U << 0)
+#define DMA_SxCR_DMEIE (1U << 1)
+#define DMA_SxCR_TEIE (1U << 2)
+#define DMA_SxCR_HTIE (1U << 3)
+#define DMA_SxCR_TCIE (1U << 4)
+#define DMA_SxCR_PFCTRL (1U << 5)
+#define DMA_SxCR_DIR_Pos 6U
+#define DMA_SxCR_CIRC (1U << 8)
+#define DMA_SxCR_PINC (1U << 9)
+#define DMA_SxCR_MINC (1U << 10)
+#define DMA_SxCR_PSIZE_Pos 11U
+#define DMA_SxCR_MSIZE_Pos 13U
+#define DMA_SxCR_PL_Pos 16U
+#define DMA_SxCR_DBM (1U << 18)
+#define DMA_SxCR_CT (1U << 19)
+#define DMA_SxCR_PBURST_Pos 21U
+#define DMA_SxCR_MBURST_Pos 23U
+#define DMA_SxCR_CHSEL_Pos 25U
+
+#define DMA_SxFCR_FTH_Pos 0U
+#define DMA_SxFCR_DMDIS (1U << 2)
+#define DMA_SxFCR_FEIE (1U << 7)
+
+/* Per-stream flags, before shifting into LISR/HISR */
+#define DMA_FLAG_FE (1U << 0)
+#define DMA_FLAG_DME (1U << 2)
+#define DMA_FLAG_TE (1U << 3)
+#define DMA_FLAG_HT (1U << 4)
+#define DMA_FLAG_TC (1U << 5)
+#define DMA_FLAG_ALL (DMA_FLAG_FE | DMA_FLAG_DME | DMA_FLAG_TE | DMA_FLAG_HT | DMA_FLAG_TC)
+
+typedef enum {
+    DMA_PERIPH_TO_MEMORY = 0,
+    DMA_MEMORY_TO_PERIPH = 1,
+    DMA_MEMORY_TO_MEMORY = 2,
+} dma_direction_t;
+
+typedef enum {
+    DMA_MODE_NORMAL = 0,
+    DMA_MODE_CIRCULAR,
+    DMA_MODE_DOUBLE_BUFFER,
+} dma_mode_t;
+
+typedef enum {
+    DMA_EVENT_ERROR = 0,
+    DMA_EVENT_HALF,
+    DMA_EVENT_COMPLETE,
+} dma_event_t;
+
+typedef struct dma_stream dma_stream_t;
+
+/**
+ * @brief Called from the stream interrupt.
+ *
+ * buffer is the memory buffer the event refers to: for HALF the one being
+ * filled, for COMPLETE the one just finished. In double-buffer mode that is
+ * the buffer the hardware has left, which may now be refilled or handed on.
+ */
+typedef void (*dma_callback_t)(dma_stream_t* stream, dma_event_t event, void* buffer, void* context);
+
+typedef struct {
+    uint8_t channel;           /**< Request channel 0-7 (CHSEL) */
+    uint8_t priority;          /**< Arbitration priority 0 (low) - 3 (very high) */
+    uint8_t direction;         /**< dma_direction_t */
+    uint8_t mode;              /**< dma_mode_t */
+    uint8_t peripheral_size;   /**< 1, 2 or 4 bytes */
+    uint8_t memory_size;       /**< 1, 2 or 4 bytes */
+    uint8_t peripheral_increment;
+    uint8_t memory_increment;
+    uint8_t fifo_threshold;    /**< 0 for direct mode, else 1-4 quarters of the FIFO */
+    uint8_t peripheral_burst;  /**< Beats per burst: 1, 4, 8 or 16 */
+    uint8_t memory_burst;      /**< Beats per burst: 1, 4, 8 or 16 */
+    uint8_t half_transfer;     /**< Report DMA_EVENT_HALF */
+    uint8_t peripheral_flow;   /**< The peripheral ends the transfer (SDIO); normal mode only */
+    dma_callback_t callback;
+    void* context;
+} dma_config_t;
+
+typedef struct {
+    uint32_t transfers;        /**< Transfer-complete events */
+    uint32_t half_transfers;
+    uint32_t transfer_errors;
+    uint32_t direct_mode_errors;
+    uint32_t fifo_errors;
+} dma_stats_t;
+
+struct dma_stream {
+    dma_regs_t* controller;
+    dma_stream_regs_t* regs;
+    uint8_t controller_index;
+    uint8_t stream_index;
+    uint8_t mode;
+    uint8_t active;
+    uint32_t cr;               /**< Configuration, written with each start */
+    uint32_t fcr;
+    uint32_t count;            /**< Items per block */
+    void* memory[2];
+    dma_callback_t callback;
+    void* context;
+    dma_stats_t stats;
+};
+
+/**
+ * @brief Claims a stream and validates its configuration.
+ *
+ * @param controller 1 or 2.
+ * @param stream_index 0-7.
+ * @return FAILURE if the stream is already claimed or the configuration is
+ * not one the hardware accepts (memory-to-memory outside DMA2 or with a
+ * repeating mode, bursts in direct mode, a burst crossing the FIFO size,
+ * peripheral flow control outside normal peripheral transfers).
+ */
+status_t dma_stream_init(dma_stream_t* stream, uint8_t controller, uint8_t stream_index, const dma_config_t* config);
+
+/** Stops the stream and gives it back to the pool of free streams. */
+void dma_stream_release(dma_stream_t* stream);
+
+/**
+ * @brief Starts a normal or circular transfer of count items.
+ *
+ * In memory-to-memory mode peripheral is the source address and memory the
+ * destination. Under peripheral flow control the hardware ignores count and
+ * stops when the peripheral signals the last item; the host model still
+ * moves exactly count.
+ *
+ * @return FAILURE if the stream is in double-buffer mode, count is 0 or
+ * above 65535.
+ */
+status_t dma_start(dma_stream_t* stream, uintptr_t peripheral, void* memory, uint32_t count);
+
+/**
+ * @brief Starts a double-buffer transfer of count items into (or from)
+ * memory0, then memory1, then memory0 again until stopped.
+ */
+status_t dma_start_double_buffer(dma_stream_t* stream, uintptr_t peripheral, void* memory0, void* memory1,
+                                 uint32_t count);
+
+/**
+ * @brief Replaces the buffer the hardware is not currently using, normally
+ * from the COMPLETE callback after the finished buffer has been handed on.
+ *
+ * @return FAILURE outside double-buffer mode.
+ */
+status_t dma_set_idle_buffer(dma_stream_t* stream, void* memory);
+
+/**
+ * @brief Turns memory address increment on or off for the following
+ * starts, for drivers that sometimes send a fixed fill item or discard what
+ * they read into a single item.
+ */
+void dma_set_memory_increment(dma_stream_t* stream, uint8_t enable);
+
+/**
+ * @brief Switches a stream between peripheral-to-memory and
+ * memory-to-peripheral for the following starts, for peripherals with a
+ * single request line for both directions.
+ *
+ * @return FAILURE for memory-to-memory, either way.
+ */
+status_t dma_set_direction(dma_stream_t* stream, dma_direction_t direction);
+
+/** Disables the stream, waits for the hardware to release it and clears its flags. */
+void dma_stop(dma_stream_t* stream);
+
+/** Items left in the current block. */
+uint32_t dma_remaining(const dma_stream_t* stream);
+
+/** Index (0 or 1) of the buffer the hardware is using in double-buffer mode. */
+uint32_t dma_current_buffer(const dma_stream_t* stream);
+
+/**
+ * @brief Stream interrupt body: reads and clears the stream's flags and
+ * runs the callback. The DMAx_StreamN_IRQHandler vectors call this.
+ */
+void dma_stream_irq(uint8_t controller, uint8_t stream_index);
+
+#if !defined(STM32F407xx)
+/**
+ * @brief Host model of the data path: moves count items from data into a
+ * peripheral-to-memory stream the way the hardware would, one request at a
+ * time, updating NDTR and CT, and raising half/complete interrupts.
+ *
+ * @return Items accepted; fewer than count if the stream is or becomes
+ * disabled.
+ */
+uint32_t dma_sim_transfer(uint8_t controller, uint8_t stream_index, const void* data, uint32_t count);
+
+/**
+ * @brief Host model of the other direction: lets a memory-to-peripheral
+ * stream deliver up to count items into data, with the same register and
+ * interrupt behaviour.
+ *
+ * @return Items delivered; fewer than count if the stream is or becomes
+ * disabled.
+ */
+uint32_t dma_sim_drain(uint8_t controller, uint8_t stream_index, void* data, uint32_t count);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DMA_H
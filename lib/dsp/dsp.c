@@ -0,0 +1,416 @@
+#include "dsp.h"
+#include "dsp_intrinsics.h"
+#include <stddef.h>
+#include <string.h>
+
+void dsp_add_q15(const q15_t* a, const q15_t* b, q15_t* out, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        uint32_t a01 = read_q15x2(a + i);
+        uint32_t a23 = read_q15x2(a + i + 2U);
+        uint32_t b01 = read_q15x2(b + i);
+        uint32_t b23 = read_q15x2(b + i + 2U);
+        write_q15x2(out + i, qadd16(a01, b01));
+        write_q15x2(out + i + 2U, qadd16(a23, b23));
+    }
+    for (; i < count; i++) {
+        out[i] = sat_q15((int32_t)a[i] + b[i]);
+    }
+}
+
+void dsp_add_q31(const q31_t* a, const q31_t* b, q31_t* out, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        q31_t r0 = qadd(a[i], b[i]);
+        q31_t r1 = qadd(a[i + 1U], b[i + 1U]);
+        q31_t r2 = qadd(a[i + 2U], b[i + 2U]);
+        q31_t r3 = qadd(a[i + 3U], b[i + 3U]);
+        out[i] = r0;
+        out[i + 1U] = r1;
+        out[i + 2U] = r2;
+        out[i + 3U] = r3;
+    }
+    for (; i < count; i++) {
+        out[i] = qadd(a[i], b[i]);
+    }
+}
+
+void dsp_add_f32(const float32_t* a, const float32_t* b, float32_t* out, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        float32_t r0 = a[i] + b[i];
+        float32_t r1 = a[i + 1U] + b[i + 1U];
+        float32_t r2 = a[i + 2U] + b[i + 2U];
+        float32_t r3 = a[i + 3U] + b[i + 3U];
+        out[i] = r0;
+        out[i + 1U] = r1;
+        out[i + 2U] = r2;
+        out[i + 3U] = r3;
+    }
+    for (; i < count; i++) {
+        out[i] = a[i] + b[i];
+    }
+}
+
+void dsp_scale_q15(const q15_t* in, q15_t scale, int8_t shift, q15_t* out, uint32_t count)
+{
+    int32_t right = 15 - shift;
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        q15_t r0 = sat_q15(shift_right((int32_t)in[i] * scale, right));
+        q15_t r1 = sat_q15(shift_right((int32_t)in[i + 1U] * scale, right));
+        q15_t r2 = sat_q15(shift_right((int32_t)in[i + 2U] * scale, right));
+        q15_t r3 = sat_q15(shift_right((int32_t)in[i + 3U] * scale, right));
+        write_q15x2(out + i, pack_q15x2(r0, r1));
+        write_q15x2(out + i + 2U, pack_q15x2(r2, r3));
+    }
+    for (; i < count; i++) {
+        out[i] = sat_q15(shift_right((int32_t)in[i] * scale, right));
+    }
+}
+
+void dsp_scale_q31(const q31_t* in, q31_t scale, int8_t shift, q31_t* out, uint32_t count)
+{
+    int32_t right = 31 - shift;
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        q31_t r0 = sat_q31(shift_right((int64_t)in[i] * scale, right));
+        q31_t r1 = sat_q31(shift_right((int64_t)in[i + 1U] * scale, right));
+        q31_t r2 = sat_q31(shift_right((int64_t)in[i + 2U] * scale, right));
+        q31_t r3 = sat_q31(shift_right((int64_t)in[i + 3U] * scale, right));
+        out[i] = r0;
+        out[i + 1U] = r1;
+        out[i + 2U] = r2;
+        out[i + 3U] = r3;
+    }
+    for (; i < count; i++) {
+        out[i] = sat_q31(shift_right((int64_t)in[i] * scale, right));
+    }
+}
+
+void dsp_scale_f32(const float32_t* in, float32_t scale, float32_t* out, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        float32_t r0 = in[i] * scale;
+        float32_t r1 = in[i + 1U] * scale;
+        float32_t r2 = in[i + 2U] * scale;
+        float32_t r3 = in[i + 3U] * scale;
+        out[i] = r0;
+        out[i + 1U] = r1;
+        out[i + 2U] = r2;
+        out[i + 3U] = r3;
+    }
+    for (; i < count; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+q63_t dsp_dot_q15(const q15_t* a, const q15_t* b, uint32_t count)
+{
+    int64_t acc = 0;
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        acc = smlald(read_q15x2(a + i), read_q15x2(b + i), acc);
+        acc = smlald(read_q15x2(a + i + 2U), read_q15x2(b + i + 2U), acc);
+    }
+    for (; i < count; i++) {
+        acc += (int32_t)a[i] * b[i];
+    }
+    return acc;
+}
+
+q63_t dsp_dot_q31(const q31_t* a, const q31_t* b, uint32_t count)
+{
+    int64_t acc = 0;
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        acc += ((int64_t)a[i] * b[i]) >> 14;
+        acc += ((int64_t)a[i + 1U] * b[i + 1U]) >> 14;
+        acc += ((int64_t)a[i + 2U] * b[i + 2U]) >> 14;
+        acc += ((int64_t)a[i + 3U] * b[i + 3U]) >> 14;
+    }
+    for (; i < count; i++) {
+        acc += ((int64_t)a[i] * b[i]) >> 14;
+    }
+    return acc;
+}
+
+float32_t dsp_dot_f32(const float32_t* a, const float32_t* b, uint32_t count)
+{
+    float32_t acc = 0.0f;
+    uint32_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        acc += a[i] * b[i];
+        acc += a[i + 1U] * b[i + 1U];
+        acc += a[i + 2U] * b[i + 2U];
+        acc += a[i + 3U] * b[i + 3U];
+    }
+    for (; i < count; i++) {
+        acc += a[i] * b[i];
+    }
+    return acc;
+}
+
+status_t dsp_fir_init_q15(dsp_fir_q15_t* fir, const q15_t* coeffs, uint16_t taps, q15_t* state, uint16_t block_size)
+{
+    if (fir == NULL || coeffs == NULL || state == NULL || taps == 0U || block_size == 0U) {
+        return FAILURE;
+    }
+    fir->coeffs = coeffs;
+    fir->state = state;
+    fir->taps = taps;
+    fir->block_size = block_size;
+    memset(state, 0, (taps - 1U) * sizeof(q15_t));
+    return SUCCESS;
+}
+
+status_t dsp_fir_init_q31(dsp_fir_q31_t* fir, const q31_t* coeffs, uint16_t taps, q31_t* state, uint16_t block_size)
+{
+    if (fir == NULL || coeffs == NULL || state == NULL || taps == 0U || block_size == 0U) {
+        return FAILURE;
+    }
+    fir->coeffs = coeffs;
+    fir->state = state;
+    fir->taps = taps;
+    fir->block_size = block_size;
+    memset(state, 0, (taps - 1U) * sizeof(q31_t));
+    return SUCCESS;
+}
+
+status_t dsp_fir_init_f32(dsp_fir_f32_t* fir, const float32_t* coeffs, uint16_t taps, float32_t* state,
+                          uint16_t block_size)
+{
+    if (fir == NULL || coeffs == NULL || state == NULL || taps == 0U || block_size == 0U) {
+        return FAILURE;
+    }
+    fir->coeffs = coeffs;
+    fir->state = state;
+    fir->taps = taps;
+    fir->block_size = block_size;
+    memset(state, 0, (taps - 1U) * sizeof(float32_t));
+    return SUCCESS;
+}
+
+/*
+ * The FIR kernels append the block to the history and then, for output k,
+ * walk the window x = state + k whose newest sample is x[taps - 1]; the
+ * history for the next call is the last taps - 1 samples of the window.
+ */
+
+void dsp_fir_q15(dsp_fir_q15_t* fir, const q15_t* in, q15_t* out, uint32_t count)
+{
+    const q15_t* coeffs = fir->coeffs;
+    uint32_t taps = fir->taps;
+    memcpy(fir->state + taps - 1U, in, count * sizeof(q15_t));
+
+    for (uint32_t k = 0; k < count; k++) {
+        const q15_t* x = fir->state + k;
+        int64_t acc = 0;
+        uint32_t i = 0;
+        /* The pair (c[i], c[i+1]) meets (x[taps-2-i], x[taps-1-i]) crossed, hence the X form */
+        for (; i + 4U <= taps; i += 4U) {
+            acc = smlaldx(read_q15x2(coeffs + i), read_q15x2(x + taps - 2U - i), acc);
+            acc = smlaldx(read_q15x2(coeffs + i + 2U), read_q15x2(x + taps - 4U - i), acc);
+        }
+        for (; i < taps; i++) {
+            acc += (int32_t)coeffs[i] * x[taps - 1U - i];
+        }
+        out[k] = sat_q15(acc >> 15);
+    }
+    memmove(fir->state, fir->state + count, (taps - 1U) * sizeof(q15_t));
+}
+
+void dsp_fir_q31(dsp_fir_q31_t* fir, const q31_t* in, q31_t* out, uint32_t count)
+{
+    const q31_t* coeffs = fir->coeffs;
+    uint32_t taps = fir->taps;
+    memcpy(fir->state + taps - 1U, in, count * sizeof(q31_t));
+
+    for (uint32_t k = 0; k < count; k++) {
+        const q31_t* x = fir->state + k + taps - 1U;
+        int64_t acc = 0;
+        uint32_t i = 0;
+        for (; i + 4U <= taps; i += 4U) {
+            acc += (int64_t)coeffs[i] * x[-(int32_t)i];
+            acc += (int64_t)coeffs[i + 1U] * x[-(int32_t)i - 1];
+            acc += (int64_t)coeffs[i + 2U] * x[-(int32_t)i - 2];
+            acc += (int64_t)coeffs[i + 3U] * x[-(int32_t)i - 3];
+        }
+        for (; i < taps; i++) {
+            acc += (int64_t)coeffs[i] * x[-(int32_t)i];
+        }
+        out[k] = sat_q31(acc >> 31);
+    }
+    memmove(fir->state, fir->state + count, (taps - 1U) * sizeof(q31_t));
+}
+
+void dsp_fir_f32(dsp_fir_f32_t* fir, const float32_t* in, float32_t* out, uint32_t count)
+{
+    const float32_t* coeffs = fir->coeffs;
+    uint32_t taps = fir->taps;
+    memcpy(fir->state + taps - 1U, in, count * sizeof(float32_t));
+
+    for (uint32_t k = 0; k < count; k++) {
+        const float32_t* x = fir->state + k + taps - 1U;
+        float32_t acc = 0.0f;
+        uint32_t i = 0;
+        for (; i + 4U <= taps; i += 4U) {
+            acc += coeffs[i] * x[-(int32_t)i];
+            acc += coeffs[i + 1U] * x[-(int32_t)i - 1];
+            acc += coeffs[i + 2U] * x[-(int32_t)i - 2];
+            acc += coeffs[i + 3U] * x[-(int32_t)i - 3];
+        }
+        for (; i < taps; i++) {
+            acc += coeffs[i] * x[-(int32_t)i];
+        }
+        out[k] = acc;
+    }
+    memmove(fir->state, fir->state + count, (taps - 1U) * sizeof(float32_t));
+}
+
+status_t dsp_biquad_init_q15(dsp_biquad_q15_t* biquad, uint8_t stages, const q15_t* coeffs, q15_t* state,
+                             uint8_t post_shift)
+{
+    if (biquad == NULL || coeffs == NULL || state == NULL || stages == 0U || post_shift > 15U) {
+        return FAILURE;
+    }
+    biquad->coeffs = coeffs;
+    biquad->state = state;
+    biquad->stages = stages;
+    biquad->post_shift = post_shift;
+    memset(state, 0, stages * 4U * sizeof(q15_t));
+    return SUCCESS;
+}
+
+status_t dsp_biquad_init_q31(dsp_biquad_q31_t* biquad, uint8_t stages, const q31_t* coeffs, q31_t* state,
+                             uint8_t post_shift)
+{
+    if (biquad == NULL || coeffs == NULL || state == NULL || stages == 0U || post_shift > 31U) {
+        return FAILURE;
+    }
+    biquad->coeffs = coeffs;
+    biquad->state = state;
+    biquad->stages = stages;
+    biquad->post_shift = post_shift;
+    memset(state, 0, stages * 4U * sizeof(q31_t));
+    return SUCCESS;
+}
+
+status_t dsp_biquad_init_f32(dsp_biquad_f32_t* biquad, uint8_t stages, const float32_t* coeffs, float32_t* state)
+{
+    if (biquad == NULL || coeffs == NULL || state == NULL || stages == 0U) {
+        return FAILURE;
+    }
+    biquad->coeffs = coeffs;
+    biquad->state = state;
+    biquad->stages = stages;
+    memset(state, 0, stages * 2U * sizeof(float32_t));
+    return SUCCESS;
+}
+
+void dsp_biquad_q15(dsp_biquad_q15_t* biquad, const q15_t* in, q15_t* out, uint32_t count)
+{
+    uint32_t shift = 15U - biquad->post_shift;
+    const q15_t* coeffs = biquad->coeffs;
+    q15_t* state = biquad->state;
+
+    for (uint32_t stage = 0; stage < biquad->stages; stage++) {
+        int32_t b0 = coeffs[0];
+        uint32_t b12 = read_q15x2(coeffs + 1);
+        uint32_t a12 = read_q15x2(coeffs + 3);
+        /* Histories packed as (newest, older) so each update is one shift */
+        uint32_t x12 = pack_q15x2(state[0], state[1]);
+        uint32_t y12 = pack_q15x2(state[2], state[3]);
+
+        for (uint32_t n = 0; n < count; n++) {
+            q15_t x0 = in[n];
+            int64_t acc = (int64_t)(b0 * x0);
+            acc = smlald(b12, x12, acc);
+            acc = smlald(a12, y12, acc);
+            q15_t y0 = sat_q15(acc >> shift);
+            x12 = (x12 << 16) | (uint16_t)x0;
+            y12 = (y12 << 16) | (uint16_t)y0;
+            out[n] = y0;
+        }
+
+        state[0] = (q15_t)x12;
+        state[1] = (q15_t)(x12 >> 16);
+        state[2] = (q15_t)y12;
+        state[3] = (q15_t)(y12 >> 16);
+        coeffs += 5;
+        state += 4;
+        in = out;
+    }
+}
+
+void dsp_biquad_q31(dsp_biquad_q31_t* biquad, const q31_t* in, q31_t* out, uint32_t count)
+{
+    uint32_t shift = 31U - biquad->post_shift;
+    const q31_t* coeffs = biquad->coeffs;
+    q31_t* state = biquad->state;
+
+    for (uint32_t stage = 0; stage < biquad->stages; stage++) {
+        int64_t b0 = coeffs[0];
+        int64_t b1 = coeffs[1];
+        int64_t b2 = coeffs[2];
+        int64_t a1 = coeffs[3];
+        int64_t a2 = coeffs[4];
+        q31_t x1 = state[0];
+        q31_t x2 = state[1];
+        q31_t y1 = state[2];
+        q31_t y2 = state[3];
+
+        for (uint32_t n = 0; n < count; n++) {
+            q31_t x0 = in[n];
+            int64_t acc = b0 * x0 + b1 * x1 + b2 * x2 + a1 * y1 + a2 * y2;
+            q31_t y0 = sat_q31(acc >> shift);
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = y0;
+            out[n] = y0;
+        }
+
+        state[0] = x1;
+        state[1] = x2;
+        state[2] = y1;
+        state[3] = y2;
+        coeffs += 5;
+        state += 4;
+        in = out;
+    }
+}
+
+void dsp_biquad_f32(dsp_biquad_f32_t* biquad, const float32_t* in, float32_t* out, uint32_t count)
+{
+    const float32_t* coeffs = biquad->coeffs;
+    float32_t* state = biquad->state;
+
+    for (uint32_t stage = 0; stage < biquad->stages; stage++) {
+        float32_t b0 = coeffs[0];
+        float32_t b1 = coeffs[1];
+        float32_t b2 = coeffs[2];
+        float32_t a1 = coeffs[3];
+        float32_t a2 = coeffs[4];
+        float32_t d1 = state[0];
+        float32_t d2 = state[1];
+
+        for (uint32_t n = 0; n < count; n++) {
+            float32_t x0 = in[n];
+            float32_t y0 = b0 * x0 + d1;
+            d1 = b1 * x0 + a1 * y0 + d2;
+            d2 = b2 * x0 + a2 * y0;
+            out[n] = y0;
+        }
+
+        state[0] = d1;
+        state[1] = d2;
+        coeffs += 5;
+        state += 2;
+        in = out;
+    }
+}
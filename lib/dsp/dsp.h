@@ -0,0 +1,158 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed- and floating-point signal processing kernels.
+ *
+ * Q15 and Q31 kernels pair 16-bit operands into one 32-bit word and use the
+ * Cortex-M4 dual-MAC and saturating instructions (SMLALD, SMLALDX, QADD16,
+ * SSAT) on target; on the host the same code runs on portable emulations of
+ * those instructions, so results are bit-identical on both. Fixed-point
+ * products accumulate in 64 bits and saturate once when the result is
+ * stored. Float kernels accumulate in input order, so they match a plain
+ * loop exactly as long as the compiler does not contract into FMA.
+ *
+ * Buffers may be unaligned; none of in, out and state may overlap unless a
+ * function says otherwise.
+ */
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+typedef int64_t q63_t;
+typedef float float32_t;
+
+/* ---- Vector arithmetic -------------------------------------------------- */
+
+/** out[i] = sat(a[i] + b[i]); out may alias a or b. */
+void dsp_add_q15(const q15_t* a, const q15_t* b, q15_t* out, uint32_t count);
+void dsp_add_q31(const q31_t* a, const q31_t* b, q31_t* out, uint32_t count);
+void dsp_add_f32(const float32_t* a, const float32_t* b, float32_t* out, uint32_t count);
+
+/**
+ * @brief out[i] = sat((in[i] * scale) >> (15 - shift)): multiplies by the
+ * Q15 factor scale * 2^shift. out may alias in.
+ */
+void dsp_scale_q15(const q15_t* in, q15_t scale, int8_t shift, q15_t* out, uint32_t count);
+
+/** out[i] = sat((in[i] * scale) >> (31 - shift)). out may alias in. */
+void dsp_scale_q31(const q31_t* in, q31_t scale, int8_t shift, q31_t* out, uint32_t count);
+
+void dsp_scale_f32(const float32_t* in, float32_t scale, float32_t* out, uint32_t count);
+
+/* ---- Dot product --------------------------------------------------------- */
+
+/** Sum of a[i] * b[i] as an unsaturated Q30 value in 64 bits. */
+q63_t dsp_dot_q15(const q15_t* a, const q15_t* b, uint32_t count);
+
+/** Sum of (a[i] * b[i]) >> 14, a Q48 value in 64 bits; cannot overflow below 2^15 terms. */
+q63_t dsp_dot_q31(const q31_t* a, const q31_t* b, uint32_t count);
+
+float32_t dsp_dot_f32(const float32_t* a, const float32_t* b, uint32_t count);
+
+/* ---- FIR filters --------------------------------------------------------- */
+
+/*
+ * y[n] = sum over i of coeffs[i] * x[n - i], in natural coefficient order.
+ * The state buffer keeps the last taps - 1 inputs between calls and needs
+ * room for taps - 1 + block_size samples; block_size bounds the count of
+ * each call.
+ */
+
+typedef struct {
+    const q15_t* coeffs;
+    q15_t* state;
+    uint16_t taps;
+    uint16_t block_size;
+} dsp_fir_q15_t;
+
+typedef struct {
+    const q31_t* coeffs;
+    q31_t* state;
+    uint16_t taps;
+    uint16_t block_size;
+} dsp_fir_q31_t;
+
+typedef struct {
+    const float32_t* coeffs;
+    float32_t* state;
+    uint16_t taps;
+    uint16_t block_size;
+} dsp_fir_f32_t;
+
+#define DSP_FIR_STATE_LENGTH(taps, block_size) ((taps) - 1U + (block_size))
+
+/** Clears the history. @return FAILURE on NULL buffers or zero taps/block_size. */
+status_t dsp_fir_init_q15(dsp_fir_q15_t* fir, const q15_t* coeffs, uint16_t taps, q15_t* state, uint16_t block_size);
+status_t dsp_fir_init_q31(dsp_fir_q31_t* fir, const q31_t* coeffs, uint16_t taps, q31_t* state, uint16_t block_size);
+status_t dsp_fir_init_f32(dsp_fir_f32_t* fir, const float32_t* coeffs, uint16_t taps, float32_t* state,
+                          uint16_t block_size);
+
+/** Filters count samples (at most block_size); out[n] is sat(acc >> 15). */
+void dsp_fir_q15(dsp_fir_q15_t* fir, const q15_t* in, q15_t* out, uint32_t count);
+
+/**
+ * @brief Filters count samples (at most block_size); out[n] is sat(acc >> 31).
+ * The 64-bit accumulator has one guard bit, so the absolute coefficient sum
+ * must stay below 2.0.
+ */
+void dsp_fir_q31(dsp_fir_q31_t* fir, const q31_t* in, q31_t* out, uint32_t count);
+
+void dsp_fir_f32(dsp_fir_f32_t* fir, const float32_t* in, float32_t* out, uint32_t count);
+
+/* ---- Biquad cascades ------------------------------------------------------ */
+
+/*
+ * Each stage has five coefficients {b0, b1, b2, a1, a2} computing
+ *     y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2],
+ * so a1 and a2 are the negated denominator coefficients. Fixed-point
+ * coefficients are scaled down by 2^post_shift to fit coefficients of
+ * magnitude up to 2^post_shift; the fixed-point stages are direct form I
+ * (four state values per stage), the float stages transposed direct form II
+ * (two per stage). out may alias in.
+ *
+ * The Q31 accumulator has one guard bit: the five products of a stage must
+ * not sum beyond twice full scale.
+ */
+
+typedef struct {
+    const q15_t* coeffs;
+    q15_t* state;
+    uint8_t stages;
+    uint8_t post_shift;
+} dsp_biquad_q15_t;
+
+typedef struct {
+    const q31_t* coeffs;
+    q31_t* state;
+    uint8_t stages;
+    uint8_t post_shift;
+} dsp_biquad_q31_t;
+
+typedef struct {
+    const float32_t* coeffs;
+    float32_t* state;
+    uint8_t stages;
+} dsp_biquad_f32_t;
+
+status_t dsp_biquad_init_q15(dsp_biquad_q15_t* biquad, uint8_t stages, const q15_t* coeffs, q15_t* state,
+                             uint8_t post_shift);
+status_t dsp_biquad_init_q31(dsp_biquad_q31_t* biquad, uint8_t stages, const q31_t* coeffs, q31_t* state,
+                             uint8_t post_shift);
+status_t dsp_biquad_init_f32(dsp_biquad_f32_t* biquad, uint8_t stages, const float32_t* coeffs, float32_t* state);
+
+void dsp_biquad_q15(dsp_biquad_q15_t* biquad, const q15_t* in, q15_t* out, uint32_t count);
+void dsp_biquad_q31(dsp_biquad_q31_t* biquad, const q31_t* in, q31_t* out, uint32_t count);
+void dsp_biquad_f32(dsp_biquad_f32_t* biquad, const float32_t* in, float32_t* out, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DSP_H
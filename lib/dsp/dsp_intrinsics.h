@@ -0,0 +1,119 @@
+#ifndef DSP_INTRINSICS_H
+#define DSP_INTRINSICS_H
+
+#include "dsp.h"
+#include <string.h>
+
+/*
+ * Instruction wrappers: the DSP extension on target, the same arithmetic in
+ * C on the host. Pairs of q15_t are packed low half first, which is how a
+ * little-endian 32-bit load sees two consecutive samples.
+ */
+
+static inline uint32_t read_q15x2(const q15_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v)); /* LDR tolerates unaligned addresses on M4 */
+    return v;
+}
+
+static inline void write_q15x2(q15_t* p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t pack_q15x2(q15_t lo, q15_t hi)
+{
+    return (uint32_t)(uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+static inline q15_t sat_q15(int64_t v)
+{
+    return (q15_t)((v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v);
+}
+
+static inline q31_t sat_q31(int64_t v)
+{
+    return (q31_t)((v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : v);
+}
+
+/* acc + x.lo * y.lo + x.hi * y.hi */
+static inline int64_t smlald(uint32_t x, uint32_t y, int64_t acc)
+{
+#if defined(STM32F407xx)
+    uint32_t lo = (uint32_t)acc;
+    uint32_t hi = (uint32_t)((uint64_t)acc >> 32);
+    __asm("smlald %0, %1, %2, %3" : "+r"(lo), "+r"(hi) : "r"(x), "r"(y));
+    return (int64_t)(((uint64_t)hi << 32) | lo);
+#else
+    return acc + (int32_t)(int16_t)x * (int16_t)y + (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+#endif
+}
+
+/* acc + x.lo * y.hi + x.hi * y.lo */
+static inline int64_t smlaldx(uint32_t x, uint32_t y, int64_t acc)
+{
+#if defined(STM32F407xx)
+    uint32_t lo = (uint32_t)acc;
+    uint32_t hi = (uint32_t)((uint64_t)acc >> 32);
+    __asm("smlaldx %0, %1, %2, %3" : "+r"(lo), "+r"(hi) : "r"(x), "r"(y));
+    return (int64_t)(((uint64_t)hi << 32) | lo);
+#else
+    return acc + (int32_t)(int16_t)x * (int16_t)(y >> 16) + (int32_t)(int16_t)(x >> 16) * (int16_t)y;
+#endif
+}
+
+/* Two saturating 16-bit additions */
+static inline uint32_t qadd16(uint32_t a, uint32_t b)
+{
+#if defined(STM32F407xx)
+    uint32_t r;
+    __asm("qadd16 %0, %1, %2" : "=r"(r) : "r"(a), "r"(b));
+    return r;
+#else
+    return pack_q15x2(sat_q15((int16_t)a + (int16_t)b), sat_q15((int16_t)(a >> 16) + (int16_t)(b >> 16)));
+#endif
+}
+
+static inline q31_t qadd(q31_t a, q31_t b)
+{
+#if defined(STM32F407xx)
+    q31_t r;
+    __asm("qadd %0, %1, %2" : "=r"(r) : "r"(a), "r"(b));
+    return r;
+#else
+    return sat_q31((int64_t)a + b);
+#endif
+}
+
+/* Arithmetic shift right by shift, or left for a negative shift */
+static inline int64_t shift_right(int64_t v, int32_t shift)
+{
+    return (shift >= 0) ? (v >> shift) : (int64_t)((uint64_t)v << -shift);
+}
+
+/* x.lo * y.lo + x.hi * y.hi */
+static inline int32_t smuad(uint32_t x, uint32_t y)
+{
+#if defined(STM32F407xx)
+    int32_t r;
+    __asm("smuad %0, %1, %2" : "=r"(r) : "r"(x), "r"(y));
+    return r;
+#else
+    return (int32_t)(int16_t)x * (int16_t)y + (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+#endif
+}
+
+/* x.lo * y.hi - x.hi * y.lo */
+static inline int32_t smusdx(uint32_t x, uint32_t y)
+{
+#if defined(STM32F407xx)
+    int32_t r;
+    __asm("smusdx %0, %1, %2" : "=r"(r) : "r"(x), "r"(y));
+    return r;
+#else
+    return (int32_t)(int16_t)x * (int16_t)(y >> 16) - (int32_t)(int16_t)(x >> 16) * (int16_t)y;
+#endif
+}
+
+#endif // DSP_INTRINSICS_H
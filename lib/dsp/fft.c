@@ -0,0 +1,310 @@
+#include "fft.h"
+#include "dsp_intrinsics.h"
+#include <stddef.h>
+
+/*
+ * Stage layout, decimation in frequency: a radix-4 pass over groups of
+ * 4q points computes, for j < q and W = exp(-2 pi i / 4q),
+ *
+ *   x[j]      = (a0 + a2) + (a1 + a3)
+ *   x[j + q]  = ((a0 + a2) - (a1 + a3)) W^2j
+ *   x[j + 2q] = ((a0 - a2) - i (a1 - a3)) W^j
+ *   x[j + 3q] = ((a0 - a2) + i (a1 - a3)) W^3j
+ *
+ * which is two radix-2 passes fused, so the output order stays plain
+ * bit-reversed. W^k of a group of L points is table entry k * TABLE_SIZE / L.
+ * The j == 0 butterflies need no multiplies; the last pass has nothing else.
+ * An odd power of two finishes with a radix-2 pass over pairs rather than
+ * starting with one: that pass has no twiddles, and in Q15 a rotated
+ * radix-2 difference would clip on full-scale input.
+ */
+
+static uint32_t fft_log2(uint32_t n)
+{
+    return 31U - (uint32_t)__builtin_clz(n);
+}
+
+static uint8_t fft_size_valid(uint32_t n)
+{
+    return (n >= FFT_MIN_SIZE) && (n <= FFT_MAX_SIZE) && ((n & (n - 1U)) == 0U);
+}
+
+/* ---------------------------------------------------------------- Q15 --- */
+
+/* (v + 2^(shift-1)) >> shift, saturated */
+static inline q15_t round_q15(int32_t v, uint32_t shift)
+{
+    return sat_q15((v + (int32_t)(1U << (shift - 1U))) >> shift);
+}
+
+/* x * (cos - i sin), both packed {re, im} */
+static inline uint32_t twiddle_q15(uint32_t x, uint32_t w)
+{
+    return pack_q15x2(round_q15(smuad(x, w), 15U), round_q15(smusdx(w, x), 15U));
+}
+
+static void conjugate_q15(q15_t* data, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        data[2U * i + 1U] = sat_q15(-(int32_t)data[2U * i + 1U]);
+    }
+}
+
+static void bitrev_q15(q15_t* data, uint32_t n, uint32_t bits)
+{
+    uint32_t shift = FFT_TABLE_BITS - bits;
+    for (uint32_t i = 1; i < n - 1U; i++) {
+        uint32_t r = (uint32_t)fft_bitrev[i] >> shift;
+        if (i < r) {
+            uint32_t t = read_q15x2(data + 2U * i);
+            write_q15x2(data + 2U * i, read_q15x2(data + 2U * r));
+            write_q15x2(data + 2U * r, t);
+        }
+    }
+}
+
+/* Final radix-2 pass over pairs, which needs no twiddles; output halved */
+static void radix2_q15(q15_t* data, uint32_t n)
+{
+    for (uint32_t j = 0; j < n; j += 2U) {
+        q15_t* a = data + 2U * j;
+        int32_t ar = a[0], ai = a[1], br = a[2], bi = a[3];
+        write_q15x2(a, pack_q15x2(round_q15(ar + br, 1U), round_q15(ai + bi, 1U)));
+        write_q15x2(a + 2U, pack_q15x2(round_q15(ar - br, 1U), round_q15(ai - bi, 1U)));
+    }
+}
+
+/*
+ * Radix-4 passes from groups of n points down to 4 or 8; each quarters its
+ * output, and the first shifts right by `extra` more bits.
+ */
+static void radix4_q15(q15_t* data, uint32_t n, uint32_t extra)
+{
+    uint32_t shift = 2U + extra;
+    for (uint32_t size = n; size >= 4U; size /= 4U, shift = 2U) {
+        uint32_t q = size / 4U;
+        uint32_t stride = FFT_TABLE_SIZE / size;
+        for (uint32_t j = 0; j < q; j++) {
+            uint32_t w1 = read_q15x2(fft_twiddle_q15 + 2U * j * stride);
+            uint32_t w2 = read_q15x2(fft_twiddle_q15 + 4U * j * stride);
+            uint32_t w3 = read_q15x2(fft_twiddle_q15 + 6U * j * stride);
+            for (uint32_t base = j; base < n; base += size) {
+                q15_t* p0 = data + 2U * base;
+                q15_t* p1 = p0 + 2U * q;
+                q15_t* p2 = p1 + 2U * q;
+                q15_t* p3 = p2 + 2U * q;
+                int32_t s02r = (int32_t)p0[0] + p2[0], s02i = (int32_t)p0[1] + p2[1];
+                int32_t d02r = (int32_t)p0[0] - p2[0], d02i = (int32_t)p0[1] - p2[1];
+                int32_t s13r = (int32_t)p1[0] + p3[0], s13i = (int32_t)p1[1] + p3[1];
+                int32_t d13r = (int32_t)p1[0] - p3[0], d13i = (int32_t)p1[1] - p3[1];
+
+                uint32_t y0 = pack_q15x2(round_q15(s02r + s13r, shift), round_q15(s02i + s13i, shift));
+                uint32_t y1 = pack_q15x2(round_q15(s02r - s13r, shift), round_q15(s02i - s13i, shift));
+                uint32_t y2 = pack_q15x2(round_q15(d02r + d13i, shift), round_q15(d02i - d13r, shift));
+                uint32_t y3 = pack_q15x2(round_q15(d02r - d13i, shift), round_q15(d02i + d13r, shift));
+                if (j != 0U) {
+                    y1 = twiddle_q15(y1, w2);
+                    y2 = twiddle_q15(y2, w1);
+                    y3 = twiddle_q15(y3, w3);
+                }
+                write_q15x2(p0, y0);
+                write_q15x2(p1, y1);
+                write_q15x2(p2, y2);
+                write_q15x2(p3, y3);
+            }
+        }
+    }
+}
+
+static void transform_q15(q15_t* data, uint32_t n, uint32_t extra)
+{
+    uint32_t bits = fft_log2(n);
+    radix4_q15(data, n, extra);
+    if (bits & 1U) {
+        radix2_q15(data, n);
+    }
+    bitrev_q15(data, n, bits);
+}
+
+status_t fft_complex_q15(q15_t* data, uint32_t n, uint8_t inverse)
+{
+    if ((data == NULL) || !fft_size_valid(n)) {
+        return FAILURE;
+    }
+    if (inverse) {
+        conjugate_q15(data, n);
+    }
+    transform_q15(data, n, 0);
+    if (inverse) {
+        conjugate_q15(data, n);
+    }
+    return SUCCESS;
+}
+
+/*
+ * The n real samples are the n/2 complex points z[t] = x[2t] + i x[2t+1].
+ * With Z their transform, A = Z[k] and B = conj(Z[n/2 - k]), the even and
+ * odd halves are E = (A + B) / 2 and O = (A - B) / 2i, and
+ * X[k] = E + W^k O, X[n/2 - k] = conj(E - W^k O) with W = exp(-2 pi i / n).
+ * The Q15 version halves once more so the result is X / n like the complex
+ * transform, and does it in the first pass: two full-scale samples make a
+ * point of magnitude sqrt(2), which would otherwise clip in a rotation.
+ */
+status_t fft_real_q15(q15_t* data, uint32_t n)
+{
+    if ((data == NULL) || !fft_size_valid(n) || (n < 2U * FFT_MIN_SIZE)) {
+        return FAILURE;
+    }
+    uint32_t m = n / 2U;
+    uint32_t stride = FFT_TABLE_SIZE / n;
+    transform_q15(data, m, 1U);
+
+    int32_t z0r = data[0], z0i = data[1];
+    data[0] = sat_q15(z0r + z0i);
+    data[1] = sat_q15(z0r - z0i);
+    for (uint32_t k = 1; k <= m / 2U; k++) {
+        q15_t* a = data + 2U * k;
+        q15_t* b = data + 2U * (m - k);
+        int32_t ar = a[0], ai = a[1], br = b[0], bi = -(int32_t)b[1];
+        q15_t er = round_q15(ar + br, 1U), ei = round_q15(ai + bi, 1U);
+        uint32_t o = pack_q15x2(round_q15(ar - br, 1U), round_q15(ai - bi, 1U));
+        uint32_t t = twiddle_q15(o, read_q15x2(fft_twiddle_q15 + 2U * k * stride));
+        int32_t tr = (int16_t)t, ti = (int16_t)(t >> 16);
+        a[0] = sat_q15((int32_t)er + ti);
+        a[1] = sat_q15((int32_t)ei - tr);
+        b[0] = sat_q15((int32_t)er - ti);
+        b[1] = sat_q15(-((int32_t)ei + tr));
+    }
+    return SUCCESS;
+}
+
+/* ---------------------------------------------------------------- f32 --- */
+
+static void conjugate_f32(float32_t* data, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        data[2U * i + 1U] = -data[2U * i + 1U];
+    }
+}
+
+static void bitrev_f32(float32_t* data, uint32_t n, uint32_t bits)
+{
+    uint32_t shift = FFT_TABLE_BITS - bits;
+    for (uint32_t i = 1; i < n - 1U; i++) {
+        uint32_t r = (uint32_t)fft_bitrev[i] >> shift;
+        if (i < r) {
+            float32_t tr = data[2U * i], ti = data[2U * i + 1U];
+            data[2U * i] = data[2U * r];
+            data[2U * i + 1U] = data[2U * r + 1U];
+            data[2U * r] = tr;
+            data[2U * r + 1U] = ti;
+        }
+    }
+}
+
+static void radix2_f32(float32_t* data, uint32_t n)
+{
+    for (uint32_t j = 0; j < n; j += 2U) {
+        float32_t* a = data + 2U * j;
+        float32_t dr = a[0] - a[2], di = a[1] - a[3];
+        a[0] += a[2];
+        a[1] += a[3];
+        a[2] = dr;
+        a[3] = di;
+    }
+}
+
+static void radix4_f32(float32_t* data, uint32_t n)
+{
+    for (uint32_t size = n; size >= 4U; size /= 4U) {
+        uint32_t q = size / 4U;
+        uint32_t stride = FFT_TABLE_SIZE / size;
+        for (uint32_t j = 0; j < q; j++) {
+            const float32_t* w1 = fft_twiddle_f32 + 2U * j * stride;
+            const float32_t* w2 = fft_twiddle_f32 + 4U * j * stride;
+            const float32_t* w3 = fft_twiddle_f32 + 6U * j * stride;
+            for (uint32_t base = j; base < n; base += size) {
+                float32_t* p0 = data + 2U * base;
+                float32_t* p1 = p0 + 2U * q;
+                float32_t* p2 = p1 + 2U * q;
+                float32_t* p3 = p2 + 2U * q;
+                float32_t s02r = p0[0] + p2[0], s02i = p0[1] + p2[1];
+                float32_t d02r = p0[0] - p2[0], d02i = p0[1] - p2[1];
+                float32_t s13r = p1[0] + p3[0], s13i = p1[1] + p3[1];
+                float32_t d13r = p1[0] - p3[0], d13i = p1[1] - p3[1];
+
+                float32_t y1r = s02r - s13r, y1i = s02i - s13i;
+                float32_t y2r = d02r + d13i, y2i = d02i - d13r;
+                float32_t y3r = d02r - d13i, y3i = d02i + d13r;
+                p0[0] = s02r + s13r;
+                p0[1] = s02i + s13i;
+                if (j == 0U) {
+                    p1[0] = y1r;
+                    p1[1] = y1i;
+                    p2[0] = y2r;
+                    p2[1] = y2i;
+                    p3[0] = y3r;
+                    p3[1] = y3i;
+                } else {
+                    p1[0] = y1r * w2[0] + y1i * w2[1];
+                    p1[1] = y1i * w2[0] - y1r * w2[1];
+                    p2[0] = y2r * w1[0] + y2i * w1[1];
+                    p2[1] = y2i * w1[0] - y2r * w1[1];
+                    p3[0] = y3r * w3[0] + y3i * w3[1];
+                    p3[1] = y3i * w3[0] - y3r * w3[1];
+                }
+            }
+        }
+    }
+}
+
+status_t fft_complex_f32(float32_t* data, uint32_t n, uint8_t inverse)
+{
+    if ((data == NULL) || !fft_size_valid(n)) {
+        return FAILURE;
+    }
+    uint32_t bits = fft_log2(n);
+    if (inverse) {
+        conjugate_f32(data, n);
+    }
+    radix4_f32(data, n);
+    if (bits & 1U) {
+        radix2_f32(data, n);
+    }
+    bitrev_f32(data, n, bits);
+    if (inverse) {
+        float32_t scale = 1.0f / (float32_t)n;
+        for (uint32_t i = 0; i < n; i++) {
+            data[2U * i] *= scale;
+            data[2U * i + 1U] *= -scale;
+        }
+    }
+    return SUCCESS;
+}
+
+status_t fft_real_f32(float32_t* data, uint32_t n)
+{
+    if ((data == NULL) || !fft_size_valid(n) || (n < 2U * FFT_MIN_SIZE)) {
+        return FAILURE;
+    }
+    uint32_t m = n / 2U;
+    uint32_t stride = FFT_TABLE_SIZE / n;
+    (void)fft_complex_f32(data, m, 0);
+
+    float32_t z0r = data[0], z0i = data[1];
+    data[0] = z0r + z0i;
+    data[1] = z0r - z0i;
+    for (uint32_t k = 1; k <= m / 2U; k++) {
+        float32_t* a = data + 2U * k;
+        float32_t* b = data + 2U * (m - k);
+        float32_t er = 0.5f * (a[0] + b[0]), ei = 0.5f * (a[1] - b[1]);
+        float32_t or_ = 0.5f * (a[0] - b[0]), oi = 0.5f * (a[1] + b[1]);
+        float32_t c = fft_twiddle_f32[2U * k * stride], s = fft_twiddle_f32[2U * k * stride + 1U];
+        float32_t tr = or_ * c + oi * s, ti = oi * c - or_ * s;
+        a[0] = er + ti;
+        a[1] = ei - tr;
+        b[0] = er - ti;
+        b[1] = -(ei + tr);
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include "dsp.h"
+#include "fft_tables.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * In-place FFTs in Q15 and float32.
+ *
+ * Transforms run in the caller's buffer with no scratch memory. The
+ * decimation-in-frequency passes are radix-4, with the two middle outputs
+ * of each butterfly exchanged (radix-2^2) so that the result comes out in
+ * plain bit-reversed order; a transform whose size is an odd power of two
+ * ends with one radix-2 pass. A final permutation through the bit-reversal
+ * table restores natural order.
+ *
+ * Twiddles and the bit-reversal table are generated at build time
+ * (scripts/gen_fft_tables.py) for FFT_TABLE_SIZE points and live in flash;
+ * set the FFT_MAX_SIZE cache variable to change it. Every size from
+ * FFT_MIN_SIZE up to FFT_TABLE_SIZE shares the same tables.
+ *
+ * Complex data is interleaved {re, im}. Q15 transforms scale each pass so
+ * their output is the DFT divided by the size, in both directions; nothing
+ * saturates as long as every complex input has a magnitude of at most 1,
+ * and any real input is fine. Float forward transforms are unscaled and the inverse
+ * divides by the size, so inverse(forward(x)) returns x.
+ */
+
+#define FFT_MIN_SIZE 4U
+#define FFT_MAX_SIZE FFT_TABLE_SIZE
+
+/**
+ * @brief Complex transform of n points (2n values) in place.
+ *
+ * @param n Power of two from FFT_MIN_SIZE to FFT_MAX_SIZE.
+ * @param inverse Non-zero for the inverse transform.
+ * @return FAILURE for an unsupported size.
+ */
+status_t fft_complex_q15(q15_t* data, uint32_t n, uint8_t inverse);
+status_t fft_complex_f32(float32_t* data, uint32_t n, uint8_t inverse);
+
+/**
+ * @brief Forward transform of n real samples in place.
+ *
+ * The n outputs are the non-redundant half of the spectrum: data[0] holds
+ * bin 0 and data[1] bin n/2 (both real), then bins 1 to n/2 - 1 follow as
+ * {re, im} pairs.
+ *
+ * @param n Power of two from 2 * FFT_MIN_SIZE to FFT_MAX_SIZE.
+ * @return FAILURE for an unsupported size.
+ */
+status_t fft_real_q15(q15_t* data, uint32_t n);
+status_t fft_real_f32(float32_t* data, uint32_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFT_H
@@ -0,0 +1,560 @@
+#include "eth.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define ETH_IRQN 61U
+
+/* RCC: ETHMACEN, ETHMACTXEN and ETHMACRXEN on AHB1; SYSCFGEN on APB2 */
+#define RCC_AHB1_ETH (7U << 25)
+#define RCC_AHB1RST_ETH (1U << 25)
+#define RCC_APB2_SYSCFG (1U << 14)
+
+/* The DMA reset finishes once the PHY's clocks run; MDIO takes 64 MDC cycles */
+#define RESET_WAIT_LOOPS 1000000U
+#define MDIO_WAIT_LOOPS 100000U
+
+#define RX_ERRORS (ETH_RDES0_CE | ETH_RDES0_RE | ETH_RDES0_RWT | ETH_RDES0_LCO | ETH_RDES0_OE | ETH_RDES0_DE)
+#define RX_CHECKSUM_ERRORS (ETH_RDES0_IPHCE | ETH_RDES0_PCE)
+
+/* Largest receive buffer one descriptor can describe, a multiple of the bus width */
+#define RX_BUFFER_MAX (ETH_RDES1_RBS1_Msk & ~3U)
+
+#if !defined(STM32F407xx)
+eth_regs_t eth_sim_regs;
+volatile uint32_t eth_sim_syscfg_pmc;
+#endif
+
+static eth_t* active;
+
+/* Writes with a hardware side effect: resets, rc_w1 flags, poll demands, MDIO cycles */
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    eth_sim_write(reg, value);
+#endif
+}
+
+/* ------------------------------------------------------------ buffers --- */
+
+static node_t* buf_link(msg_t* buf)
+{
+    return (node_t*)msg_payload(buf);
+}
+
+msg_t* eth_buf_alloc(msg_pool_t* pool)
+{
+    msg_t* buf = msg_alloc(pool);
+    if (buf != NULL) {
+        buf_link(buf)->data = buf;
+        buf_link(buf)->next = NULL;
+    }
+    return buf;
+}
+
+void eth_buf_append(msg_t* frame, msg_t* tail)
+{
+    msg_t* last = frame;
+    for (msg_t* next = eth_buf_next(last); next != NULL; next = eth_buf_next(last)) {
+        last = next;
+    }
+    buf_link(last)->next = buf_link(tail);
+}
+
+uint32_t eth_buf_total(msg_t* frame)
+{
+    uint32_t total = 0;
+    for (msg_t* buf = frame; buf != NULL; buf = eth_buf_next(buf)) {
+        total += buf->length;
+    }
+    return total;
+}
+
+void eth_buf_free(msg_t* frame)
+{
+    while (frame != NULL) {
+        msg_t* next = eth_buf_next(frame);
+        msg_free(frame);
+        frame = next;
+    }
+}
+
+/* ------------------------------------------------------------ receive --- */
+
+static void rx_discard(eth_t* eth)
+{
+    eth_buf_free(eth->rx_first);
+    eth->rx_first = NULL;
+    eth->rx_last = NULL;
+    eth->rx_length = 0;
+}
+
+/* The last descriptor of a frame: check its status and post the chain */
+static void rx_complete(eth_t* eth, uint32_t status)
+{
+    if (eth->rx_first == NULL) {
+        return;
+    }
+    if (status & RX_ERRORS) {
+        STAT_INC(eth->stats.rx_errors);
+        rx_discard(eth);
+        return;
+    }
+
+    uint16_t type = 0;
+    if (eth->config.checksum_offload && (status & ETH_RDES0_FT)) {
+        if (status & RX_CHECKSUM_ERRORS) {
+            STAT_INC(eth->stats.rx_checksum_errors);
+            rx_discard(eth);
+            return;
+        }
+        type = ETH_RX_CHECKSUM_OK;
+    }
+
+    /* The frame length counts every buffer; the last holds what the others did not */
+    uint32_t length = (status & ETH_RDES0_FL_Msk) >> ETH_RDES0_FL_Pos;
+    eth->rx_last->length = (uint16_t)(length - (eth->rx_length - eth->rx_last->length));
+    eth->rx_first->type = type;
+    STAT_INC(eth->stats.rx_frames);
+    STAT_ADD(eth->stats.rx_bytes, length);
+    mailbox_post(eth->config.rx_output, eth->rx_first);
+    eth->rx_first = NULL;
+    eth->rx_last = NULL;
+    eth->rx_length = 0;
+}
+
+/*
+ * Takes every descriptor the DMA has handed back. Each one's buffer joins
+ * the frame in progress and a fresh buffer takes its place; without a fresh
+ * one, the descriptor keeps its buffer and the rest of the frame is dropped.
+ */
+static void rx_drain(eth_t* eth)
+{
+    for (uint32_t n = 0; n < ETH_RX_RING_LENGTH; n++) {
+        uint8_t index = eth->rx_next;
+        eth_desc_t* desc = &eth->rx_desc[index];
+        uint32_t status = desc->status;
+        if (status & ETH_DES0_OWN) {
+            break;
+        }
+
+        if (status & ETH_RDES0_FS) {
+            /* A frame cut short by a descriptor error never got its last descriptor */
+            rx_discard(eth);
+            eth->rx_dropping = 0;
+        }
+        if (!eth->rx_dropping) {
+            msg_t* fresh = eth_buf_alloc(eth->config.rx_pool);
+            if (fresh == NULL) {
+                STAT_INC(eth->stats.rx_no_buffer);
+                rx_discard(eth);
+                eth->rx_dropping = 1;
+            } else {
+                msg_t* buf = eth->rx_buf[index];
+                buf->length = eth->rx_buffer_size;
+                if (eth->rx_first == NULL) {
+                    eth->rx_first = buf;
+                } else {
+                    buf_link(eth->rx_last)->next = buf_link(buf);
+                }
+                eth->rx_last = buf;
+                eth->rx_length = (uint16_t)(eth->rx_length + eth->rx_buffer_size);
+                eth->rx_buf[index] = fresh;
+                desc->buffer = eth_buf_data(fresh);
+            }
+        }
+        if (status & ETH_RDES0_LS) {
+            rx_complete(eth, status);
+            eth->rx_dropping = 0;
+        }
+
+        desc->status = ETH_DES0_OWN;
+        eth->rx_next = (uint8_t)((index + 1U) % ETH_RX_RING_LENGTH);
+    }
+}
+
+/* ----------------------------------------------------------- transmit --- */
+
+static uint32_t buf_count(msg_t* frame)
+{
+    uint32_t count = 0;
+    for (msg_t* buf = frame; buf != NULL; buf = eth_buf_next(buf)) {
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Points one descriptor at each buffer of a chain; called with interrupts
+ * masked and enough descriptors free. The first descriptor is handed over
+ * last, so the DMA never starts on a half-built frame.
+ */
+static void tx_load(eth_t* eth, msg_t* frame)
+{
+    uint32_t checksum = eth->config.checksum_offload ? ETH_TDES0_CIC_FULL : 0U;
+    eth_desc_t* first = &eth->tx_desc[eth->tx_head];
+    uint32_t first_status = 0;
+
+    for (msg_t* buf = frame; buf != NULL;) {
+        msg_t* next = eth_buf_next(buf);
+        uint8_t index = eth->tx_head;
+        eth_desc_t* desc = &eth->tx_desc[index];
+        uint32_t status = ETH_TDES0_TCH | checksum;
+        status |= (buf == frame) ? ETH_TDES0_FS : 0U;
+        status |= (next == NULL) ? (ETH_TDES0_LS | ETH_TDES0_IC) : 0U;
+
+        eth->tx_buf[index] = buf;
+        desc->buffer = eth_buf_data(buf);
+        desc->control = buf->length;
+        if (desc == first) {
+            first_status = status;
+        } else {
+            desc->status = status | ETH_DES0_OWN;
+        }
+        eth->tx_head = (uint8_t)((index + 1U) % ETH_TX_RING_LENGTH);
+        eth->tx_used++;
+        buf = next;
+    }
+    first->status = first_status | ETH_DES0_OWN;
+
+    /* Wakes the DMA if it suspended on an empty ring */
+    write_reg(&eth->regs->DMATPDR, 0);
+}
+
+static void tx_reclaim(eth_t* eth)
+{
+    while (eth->tx_used != 0U) {
+        uint8_t index = eth->tx_tail;
+        uint32_t status = eth->tx_desc[index].status;
+        if (status & ETH_DES0_OWN) {
+            break;
+        }
+        msg_t* buf = eth->tx_buf[index];
+        STAT_ADD(eth->stats.tx_bytes, buf->length);
+        if (status & ETH_TDES0_LS) {
+            if (status & ETH_TDES0_ES) {
+                STAT_INC(eth->stats.tx_errors);
+            } else {
+                STAT_INC(eth->stats.tx_frames);
+            }
+        }
+        msg_free(buf);
+        eth->tx_buf[index] = NULL;
+        eth->tx_tail = (uint8_t)((index + 1U) % ETH_TX_RING_LENGTH);
+        eth->tx_used--;
+    }
+
+    /* In order: a frame that does not fit yet holds back the ones behind it */
+    while (eth->tx_backlog.head != NULL) {
+        msg_t* frame = (msg_t*)eth->tx_backlog.head->data;
+        if (buf_count(frame) > ETH_TX_RING_LENGTH - (uint32_t)eth->tx_used) {
+            break;
+        }
+        ll_list_remove_head(&eth->tx_backlog);
+        tx_load(eth, frame);
+    }
+}
+
+status_t eth_send(eth_t* eth, msg_t* frame)
+{
+    if (eth == NULL || frame == NULL) {
+        return FAILURE;
+    }
+    uint32_t count = 0;
+    uint32_t total = 0;
+    for (msg_t* buf = frame; buf != NULL; buf = eth_buf_next(buf)) {
+        if (buf->length == 0U || buf->length > ETH_TDES1_TBS1_Msk) {
+            return FAILURE;
+        }
+        count++;
+        total += buf->length;
+    }
+    if (count > ETH_TX_RING_LENGTH || total > ETH_FRAME_MAX) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (eth->regs == NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    if (eth->tx_backlog.head == NULL && count <= ETH_TX_RING_LENGTH - (uint32_t)eth->tx_used) {
+        tx_load(eth, frame);
+    } else {
+        ll_list_insert_at_tail(&eth->tx_backlog, &frame->node);
+        STAT_INC(eth->stats.tx_backlogged);
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+/* ---------------------------------------------------------- interrupt --- */
+
+void eth_irq(void)
+{
+    eth_t* eth = active;
+    if (eth == NULL || eth->regs == NULL) {
+        return;
+    }
+    eth_regs_t* regs = eth->regs;
+    uint32_t status = REG_READ(regs->DMASR) & (ETH_DMASR_TS | ETH_DMASR_RS | ETH_DMASR_RBUS | ETH_DMASR_FBES);
+    write_reg(&regs->DMASR, status | ETH_DMASR_NIS | ETH_DMASR_AIS);
+
+    if (status & (ETH_DMASR_RS | ETH_DMASR_RBUS)) {
+        STAT_INC(eth->stats.rx_interrupts);
+        rx_drain(eth);
+        if (status & ETH_DMASR_RBUS) {
+            /* The DMA suspended on a descriptor it did not own; the drain handed them all back */
+            STAT_INC(eth->stats.rx_ring_full);
+            write_reg(&regs->DMARPDR, 0);
+        }
+    }
+    if (status & ETH_DMASR_TS) {
+        uint32_t primask = hal_irq_mask();
+        tx_reclaim(eth);
+        hal_irq_restore(primask);
+    }
+    if (status & ETH_DMASR_FBES) {
+        /* The DMA has stopped both directions; only eth_deinit() and eth_init() recover */
+        STAT_INC(eth->stats.bus_errors);
+    }
+}
+
+/* --------------------------------------------------------------- MDIO --- */
+
+/* RM0090 33.8.1, CR: MDC must stay at or below 2.5 MHz */
+static status_t mdio_clock_range(uint32_t hclk_hz, uint32_t* range)
+{
+    static const struct {
+        uint32_t max_hz;
+        uint32_t range;
+    } ranges[] = {
+        { 35000000U, 2 }, { 60000000U, 3 }, { 100000000U, 0 }, { 150000000U, 1 }, { 168000000U, 4 },
+    };
+    if (hclk_hz < 20000000U) {
+        return FAILURE;
+    }
+    for (uint32_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        if (hclk_hz <= ranges[i].max_hz) {
+            *range = ranges[i].range;
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+static status_t mdio_wait(const eth_t* eth)
+{
+    for (uint32_t i = 0; i < MDIO_WAIT_LOOPS; i++) {
+        if ((REG_READ(eth->regs->MACMIIAR) & ETH_MACMIIAR_MB) == 0U) {
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+static uint32_t mdio_address(const eth_t* eth, uint8_t phy, uint8_t reg)
+{
+    uint32_t range = 0;
+    mdio_clock_range(eth->config.hclk_hz, &range);
+    return ((uint32_t)(phy & 0x1FU) << ETH_MACMIIAR_PA_Pos) | ((uint32_t)(reg & 0x1FU) << ETH_MACMIIAR_MR_Pos) |
+           (range << ETH_MACMIIAR_CR_Pos) | ETH_MACMIIAR_MB;
+}
+
+status_t eth_phy_read(eth_t* eth, uint8_t phy, uint8_t reg, uint16_t* value)
+{
+    if (eth == NULL || eth->regs == NULL || value == NULL || mdio_wait(eth) != SUCCESS) {
+        return FAILURE;
+    }
+    write_reg(&eth->regs->MACMIIAR, mdio_address(eth, phy, reg));
+    if (mdio_wait(eth) != SUCCESS) {
+        return FAILURE;
+    }
+    *value = (uint16_t)REG_READ(eth->regs->MACMIIDR);
+    return SUCCESS;
+}
+
+status_t eth_phy_write(eth_t* eth, uint8_t phy, uint8_t reg, uint16_t value)
+{
+    if (eth == NULL || eth->regs == NULL || mdio_wait(eth) != SUCCESS) {
+        return FAILURE;
+    }
+    REG_WRITE(eth->regs->MACMIIDR, value);
+    write_reg(&eth->regs->MACMIIAR, mdio_address(eth, phy, reg) | ETH_MACMIIAR_MW);
+    return mdio_wait(eth);
+}
+
+/* ------------------------------------------------------------ control --- */
+
+static uint32_t link_bits(uint8_t speed_100, uint8_t full_duplex)
+{
+    return (speed_100 ? ETH_MACCR_FES : 0U) | (full_duplex ? ETH_MACCR_DM : 0U);
+}
+
+void eth_set_link(eth_t* eth, uint8_t speed_100, uint8_t full_duplex)
+{
+    if (eth == NULL || eth->regs == NULL) {
+        return;
+    }
+    REG_MODIFY(eth->regs->MACCR, ETH_MACCR_FES | ETH_MACCR_DM, link_bits(speed_100, full_duplex));
+    eth->config.speed_100 = speed_100;
+    eth->config.full_duplex = full_duplex;
+}
+
+/* Gives back every buffer the driver holds; called with the DMA stopped */
+static void release_buffers(eth_t* eth)
+{
+    for (uint32_t i = 0; i < ETH_RX_RING_LENGTH; i++) {
+        if (eth->rx_buf[i] != NULL) {
+            msg_free(eth->rx_buf[i]);
+            eth->rx_buf[i] = NULL;
+        }
+    }
+    for (uint32_t i = 0; i < ETH_TX_RING_LENGTH; i++) {
+        if (eth->tx_buf[i] != NULL) {
+            msg_free(eth->tx_buf[i]);
+            eth->tx_buf[i] = NULL;
+        }
+    }
+    for (node_t* node = ll_list_remove_head(&eth->tx_backlog); node != NULL;
+         node = ll_list_remove_head(&eth->tx_backlog)) {
+        eth_buf_free((msg_t*)node->data);
+    }
+    rx_discard(eth);
+    eth->tx_used = 0;
+}
+
+static status_t build_rings(eth_t* eth)
+{
+    uint32_t rx_control = ETH_RDES1_RCH | eth->rx_buffer_size | (eth->config.rx_watchdog ? ETH_RDES1_DIC : 0U);
+    for (uint32_t i = 0; i < ETH_RX_RING_LENGTH; i++) {
+        msg_t* buf = eth_buf_alloc(eth->config.rx_pool);
+        if (buf == NULL) {
+            return FAILURE;
+        }
+        eth->rx_buf[i] = buf;
+        eth->rx_desc[i].buffer = eth_buf_data(buf);
+        eth->rx_desc[i].control = rx_control;
+        eth->rx_desc[i].next = &eth->rx_desc[(i + 1U) % ETH_RX_RING_LENGTH];
+        eth->rx_desc[i].status = ETH_DES0_OWN;
+    }
+    for (uint32_t i = 0; i < ETH_TX_RING_LENGTH; i++) {
+        eth->tx_desc[i].status = ETH_TDES0_TCH;
+        eth->tx_desc[i].next = &eth->tx_desc[(i + 1U) % ETH_TX_RING_LENGTH];
+    }
+    return SUCCESS;
+}
+
+/* DMA reset, rings, MAC and DMA configuration, then both directions on */
+static status_t start(eth_t* eth)
+{
+    eth_regs_t* regs = eth->regs;
+    const eth_config_t* config = &eth->config;
+
+    write_reg(&regs->DMABMR, ETH_DMABMR_SR);
+    uint32_t loops = 0;
+    while ((REG_READ(regs->DMABMR) & ETH_DMABMR_SR) && loops < RESET_WAIT_LOOPS) {
+        loops++;
+    }
+    if ((REG_READ(regs->DMABMR) & ETH_DMABMR_SR) || build_rings(eth) != SUCCESS) {
+        return FAILURE;
+    }
+
+    /* Both FCS stripping bits, so no received frame carries one */
+    REG_WRITE(regs->MACCR, link_bits(config->speed_100, config->full_duplex) | ETH_MACCR_CSTF | ETH_MACCR_APCS |
+                               (config->checksum_offload ? ETH_MACCR_IPCO : 0U));
+    REG_WRITE(regs->MACFFR, (config->promiscuous ? ETH_MACFFR_PM : 0U) | (config->all_multicast ? ETH_MACFFR_PAM : 0U));
+    REG_WRITE(regs->MACA0HR, (uint32_t)config->mac[4] | ((uint32_t)config->mac[5] << 8));
+    REG_WRITE(regs->MACA0LR, (uint32_t)config->mac[0] | ((uint32_t)config->mac[1] << 8) |
+                                 ((uint32_t)config->mac[2] << 16) | ((uint32_t)config->mac[3] << 24));
+
+    /* Address-aligned fixed 32-beat bursts each way */
+    REG_WRITE(regs->DMABMR, ETH_DMABMR_AAB | ETH_DMABMR_FB | ETH_DMABMR_USP | (32U << ETH_DMABMR_RDP_Pos) |
+                                (32U << ETH_DMABMR_PBL_Pos));
+    write_reg(&regs->DMARDLAR, (uint32_t)(uintptr_t)&eth->rx_desc[0]);
+    write_reg(&regs->DMATDLAR, (uint32_t)(uintptr_t)&eth->tx_desc[0]);
+    REG_WRITE(regs->DMARSWTR, config->rx_watchdog);
+    REG_WRITE(regs->DMAIER, ETH_DMAIER_NISE | ETH_DMAIER_AISE | ETH_DMAIER_RIE | ETH_DMAIER_TIE | ETH_DMAIER_RBUIE |
+                                ETH_DMAIER_FBEIE);
+
+    /* Store and forward both ways: the checksum engine needs whole frames */
+    REG_WRITE(regs->DMAOMR, ETH_DMAOMR_TSF | ETH_DMAOMR_RSF);
+    REG_SET(regs->MACCR, ETH_MACCR_TE | ETH_MACCR_RE);
+    REG_SET(regs->DMAOMR, ETH_DMAOMR_ST | ETH_DMAOMR_SR);
+    return SUCCESS;
+}
+
+status_t eth_init(eth_t* eth, const eth_config_t* config)
+{
+    if (eth == NULL || config == NULL || config->rx_pool == NULL || config->rx_output == NULL ||
+        config->rx_pool->count <= ETH_RX_RING_LENGTH ||
+        config->rx_pool->payload_size < ETH_BUF_PAYLOAD(ETH_RX_BUFFER_MIN)) {
+        return FAILURE;
+    }
+    uint32_t range;
+    if (mdio_clock_range(config->hclk_hz, &range) != SUCCESS) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (active != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    active = eth;
+    hal_irq_restore(primask);
+
+    memset(eth, 0, sizeof(*eth));
+    eth->config = *config;
+    eth->regs = ETH_REGS;
+    ll_list_init(&eth->tx_backlog);
+    uint32_t size = (config->rx_pool->payload_size - ETH_BUF_HEADER) & ~3U;
+    eth->rx_buffer_size = (uint16_t)((size < RX_BUFFER_MAX) ? size : RX_BUFFER_MAX);
+
+    /* The PHY interface is latched from SYSCFG while the MAC is held in reset */
+    REG_SET(HAL_RCC->APB2ENR, RCC_APB2_SYSCFG);
+    REG_SET(HAL_RCC->AHB1RSTR, RCC_AHB1RST_ETH);
+    REG_MODIFY(*ETH_SYSCFG_PMC, ETH_SYSCFG_PMC_RMII, config->rmii ? ETH_SYSCFG_PMC_RMII : 0U);
+    REG_SET(HAL_RCC->AHB1ENR, RCC_AHB1_ETH);
+    REG_CLEAR(HAL_RCC->AHB1RSTR, RCC_AHB1RST_ETH);
+
+    if (start(eth) != SUCCESS) {
+        release_buffers(eth);
+        REG_CLEAR(HAL_RCC->AHB1ENR, RCC_AHB1_ETH);
+        eth->regs = NULL;
+        active = NULL;
+        return FAILURE;
+    }
+    hal_nvic_enable(ETH_IRQN);
+    return SUCCESS;
+}
+
+void eth_deinit(eth_t* eth)
+{
+    if (eth == NULL || eth->regs == NULL) {
+        return;
+    }
+    hal_nvic_disable(ETH_IRQN);
+
+    uint32_t primask = hal_irq_mask();
+    eth_regs_t* regs = eth->regs;
+    REG_CLEAR(regs->DMAOMR, ETH_DMAOMR_ST | ETH_DMAOMR_SR);
+    REG_CLEAR(regs->MACCR, ETH_MACCR_TE | ETH_MACCR_RE);
+    REG_WRITE(regs->DMAIER, 0);
+    release_buffers(eth);
+    REG_CLEAR(HAL_RCC->AHB1ENR, RCC_AHB1_ETH);
+    eth->regs = NULL;
+    active = NULL;
+    hal_irq_restore(primask);
+}
+
+const eth_stats_t* eth_get_stats(const eth_t* eth)
+{
+    return &eth->stats;
+}
+
+#if defined(STM32F407xx)
+void ETH_IRQHandler(void) { eth_irq(); }
+#endif
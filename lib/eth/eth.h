@@ -0,0 +1,388 @@
+#ifndef ETH_H
+#define ETH_H
+
+#include "hal_reg.h"
+#include "linked_list.h"
+#include "mailbox.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ethernet MAC with chained DMA descriptor rings and zero-copy buffers.
+ *
+ * Buffers: every frame buffer is a message from a msg_pool_t. The first
+ * ETH_BUF_HEADER bytes of its payload hold a node_t that links the buffers
+ * of one frame into a chain, the rest holds frame data; msg->length is the
+ * number of data bytes in that buffer. A frame is passed around by its first
+ * buffer, so only that message's own link is used for queues and mailboxes.
+ *
+ * Receive: each RX descriptor owns a buffer from the receive pool. When the
+ * DMA hands a descriptor back, the interrupt takes its buffer into the frame
+ * being assembled and gives the descriptor a fresh buffer from the pool, so
+ * frame data is never copied; a frame larger than one buffer spans several
+ * descriptors and arrives as a chain. Complete frames are posted to the
+ * receive mailbox. If the pool is empty, the descriptor keeps its buffer and
+ * the frame is dropped, so the ring never runs dry because the application
+ * holds on to buffers. With rx_watchdog set, descriptors suppress their
+ * completion interrupt and the receive watchdog raises one after a burst
+ * instead, so a burst of frames costs one interrupt.
+ *
+ * Transmit: eth_send() takes a chain and points one TX descriptor at each of
+ * its buffers; the buffers go back to their pools from the interrupt once
+ * sent. Chains that do not fit in the free descriptors wait in a backlog
+ * that the interrupt feeds into the ring.
+ *
+ * Checksums: with checksum_offload set, the MAC inserts IPv4 header and
+ * TCP/UDP/ICMP checksums into outgoing frames (whatever the checksum fields
+ * hold is replaced) and verifies them on incoming ones; frames that fail
+ * are dropped and counted, frames that pass are posted with
+ * ETH_RX_CHECKSUM_OK in msg->type.
+ *
+ * Descriptors live in eth_t and buffers in the pools; both must be in
+ * memory the Ethernet DMA reaches, i.e. not in CCM RAM. The MAC strips the
+ * FCS from received frames and appends it to sent ones. The pins and the
+ * PHY (beyond the MDIO accessors) are the application's.
+ */
+
+/** Descriptors per ring */
+#ifndef ETH_RX_RING_LENGTH
+#define ETH_RX_RING_LENGTH 8
+#endif
+#ifndef ETH_TX_RING_LENGTH
+#define ETH_TX_RING_LENGTH 8
+#endif
+
+/** Payload bytes ahead of the frame data in each buffer: the chain link */
+#define ETH_BUF_HEADER ((uint32_t)sizeof(node_t))
+
+/** Pool payload size for buffers of data_size frame bytes */
+#define ETH_BUF_PAYLOAD(data_size) (ETH_BUF_HEADER + (data_size))
+
+/** Largest frame without FCS: 1500 bytes of payload, a VLAN tag and the header */
+#define ETH_FRAME_MAX 1518U
+
+/** Smallest receive buffer the driver accepts */
+#define ETH_RX_BUFFER_MIN 128U
+
+/** msg->type of a received frame whose IP checksums the MAC verified */
+#define ETH_RX_CHECKSUM_OK (1U << 0)
+
+typedef struct {
+    volatile uint32_t MACCR;
+    volatile uint32_t MACFFR;
+    volatile uint32_t MACHTHR;
+    volatile uint32_t MACHTLR;
+    volatile uint32_t MACMIIAR;
+    volatile uint32_t MACMIIDR;
+    volatile uint32_t MACFCR;
+    volatile uint32_t MACVLANTR;
+    uint32_t reserved0[2];
+    volatile uint32_t MACRWUFFR;
+    volatile uint32_t MACPMTCSR;
+    uint32_t reserved1;
+    volatile uint32_t MACDBGR;
+    volatile uint32_t MACSR;
+    volatile uint32_t MACIMR;
+    volatile uint32_t MACA0HR;
+    volatile uint32_t MACA0LR;
+    uint32_t reserved2[1006];       /* MAC address 1-3, MMC and PTP */
+    volatile uint32_t DMABMR;       /* 0x1000 */
+    volatile uint32_t DMATPDR;
+    volatile uint32_t DMARPDR;
+    volatile uint32_t DMARDLAR;
+    volatile uint32_t DMATDLAR;
+    volatile uint32_t DMASR;
+    volatile uint32_t DMAOMR;
+    volatile uint32_t DMAIER;
+    volatile uint32_t DMAMFBOCR;
+    volatile uint32_t DMARSWTR;
+    uint32_t reserved3[8];
+    volatile uint32_t DMACHTDR;
+    volatile uint32_t DMACHRDR;
+    volatile uint32_t DMACHTBAR;
+    volatile uint32_t DMACHRBAR;
+} eth_regs_t;
+
+#if !defined(STM32F407xx)
+extern eth_regs_t eth_sim_regs;
+extern volatile uint32_t eth_sim_syscfg_pmc;
+#endif
+
+#define ETH_REGS HAL_PERIPH(eth_regs_t, 0x40028000U, eth_sim_regs)
+#define ETH_SYSCFG_PMC HAL_PERIPH(volatile uint32_t, 0x40013804U, eth_sim_syscfg_pmc)
+
+#define ETH_SYSCFG_PMC_RMII (1U << 23)
+
+#define ETH_MACCR_RE (1U << 2)
+#define ETH_MACCR_TE (1U << 3)
+#define ETH_MACCR_APCS (1U << 7)
+#define ETH_MACCR_IPCO (1U << 10)
+#define ETH_MACCR_DM (1U << 11)
+#define ETH_MACCR_FES (1U << 14)
+#define ETH_MACCR_CSTF (1U << 25)
+
+#define ETH_MACFFR_PM (1U << 0)
+#define ETH_MACFFR_PAM (1U << 4)
+
+#define ETH_MACMIIAR_MB (1U << 0)
+#define ETH_MACMIIAR_MW (1U << 1)
+#define ETH_MACMIIAR_CR_Pos 2U
+#define ETH_MACMIIAR_MR_Pos 6U
+#define ETH_MACMIIAR_PA_Pos 11U
+
+#define ETH_DMABMR_SR (1U << 0)
+#define ETH_DMABMR_PBL_Pos 8U
+#define ETH_DMABMR_FB (1U << 16)
+#define ETH_DMABMR_RDP_Pos 17U
+#define ETH_DMABMR_USP (1U << 23)
+#define ETH_DMABMR_AAB (1U << 25)
+
+#define ETH_DMASR_TS (1U << 0)
+#define ETH_DMASR_TBUS (1U << 2)
+#define ETH_DMASR_RS (1U << 6)
+#define ETH_DMASR_RBUS (1U << 7)
+#define ETH_DMASR_FBES (1U << 13)
+#define ETH_DMASR_AIS (1U << 15)
+#define ETH_DMASR_NIS (1U << 16)
+
+#define ETH_DMAOMR_SR (1U << 1)
+#define ETH_DMAOMR_ST (1U << 13)
+#define ETH_DMAOMR_FTF (1U << 20)
+#define ETH_DMAOMR_TSF (1U << 21)
+#define ETH_DMAOMR_RSF (1U << 25)
+
+/* DMAIER bits sit where the DMASR bits they enable do, with an E suffix */
+#define ETH_DMAIER_TIE ETH_DMASR_TS
+#define ETH_DMAIER_RIE ETH_DMASR_RS
+#define ETH_DMAIER_RBUIE ETH_DMASR_RBUS
+#define ETH_DMAIER_FBEIE ETH_DMASR_FBES
+#define ETH_DMAIER_AISE ETH_DMASR_AIS
+#define ETH_DMAIER_NISE ETH_DMASR_NIS
+
+/* Normal descriptors, chained: RM0090 33.6.7-33.6.8 */
+#define ETH_TDES0_DB (1U << 0)
+#define ETH_TDES0_UF (1U << 1)
+#define ETH_TDES0_EC (1U << 8)
+#define ETH_TDES0_LCO (1U << 9)
+#define ETH_TDES0_NC (1U << 10)
+#define ETH_TDES0_LCA (1U << 11)
+#define ETH_TDES0_IPE (1U << 12)
+#define ETH_TDES0_IHE (1U << 16)
+#define ETH_TDES0_ES (1U << 15)
+#define ETH_TDES0_TCH (1U << 20)
+#define ETH_TDES0_CIC_FULL (3U << 22)
+#define ETH_TDES0_FS (1U << 28)
+#define ETH_TDES0_LS (1U << 29)
+#define ETH_TDES0_IC (1U << 30)
+#define ETH_DES0_OWN (1U << 31)
+
+#define ETH_TDES1_TBS1_Msk 0x1FFFU
+
+#define ETH_RDES0_PCE (1U << 0)
+#define ETH_RDES0_CE (1U << 1)
+#define ETH_RDES0_RE (1U << 3)
+#define ETH_RDES0_RWT (1U << 4)
+#define ETH_RDES0_FT (1U << 5)
+#define ETH_RDES0_LCO (1U << 6)
+#define ETH_RDES0_IPHCE (1U << 7)
+#define ETH_RDES0_LS (1U << 8)
+#define ETH_RDES0_FS (1U << 9)
+#define ETH_RDES0_OE (1U << 11)
+#define ETH_RDES0_DE (1U << 14)
+#define ETH_RDES0_ES (1U << 15)
+#define ETH_RDES0_FL_Pos 16U
+#define ETH_RDES0_FL_Msk (0x3FFFU << ETH_RDES0_FL_Pos)
+
+#define ETH_RDES1_RBS1_Msk 0x1FFFU
+#define ETH_RDES1_RCH (1U << 14)
+#define ETH_RDES1_DIC (1U << 31)
+
+/**
+ * @brief DMA descriptor. On target the pointers are 32 bits and this is the
+ * hardware's four-word layout; the host model uses the same fields.
+ */
+typedef struct eth_desc {
+    volatile uint32_t status;           /**< TDES0/RDES0 */
+    volatile uint32_t control;          /**< TDES1/RDES1 */
+    void* volatile buffer;              /**< Buffer 1 */
+    struct eth_desc* volatile next;     /**< Chained mode: the next descriptor */
+} eth_desc_t;
+
+typedef struct {
+    uint32_t hclk_hz;           /**< Sets the MDIO clock divider, 20-168 MHz */
+    uint8_t mac[6];
+    uint8_t rmii;               /**< RMII rather than MII to the PHY */
+    uint8_t speed_100;          /**< Initial link settings; see eth_set_link() */
+    uint8_t full_duplex;
+    uint8_t checksum_offload;
+    uint8_t promiscuous;        /**< Pass every frame, whatever its destination */
+    uint8_t all_multicast;      /**< Pass every multicast frame */
+    uint8_t rx_watchdog;        /**< 0, or receive interrupt delay in units of 256 HCLK cycles */
+    msg_pool_t* rx_pool;        /**< Receive buffers, at least ETH_RX_RING_LENGTH + 1 */
+    mailbox_t* rx_output;       /**< Receives the first buffer of each frame */
+} eth_config_t;
+
+typedef struct {
+    uint32_t rx_frames;         /**< Posted */
+    uint32_t rx_bytes;          /**< Frame bytes in posted frames */
+    uint32_t rx_interrupts;     /**< Receive interrupts serviced */
+    uint32_t rx_errors;         /**< Dropped for a CRC, receive, length, collision or overflow error */
+    uint32_t rx_checksum_errors; /**< Dropped because the MAC found a bad IP header or payload checksum */
+    uint32_t rx_no_buffer;      /**< Dropped because the pool was empty */
+    uint32_t rx_ring_full;      /**< Times the DMA found no free descriptor */
+    uint32_t tx_frames;         /**< Sent */
+    uint32_t tx_bytes;
+    uint32_t tx_errors;         /**< Sent with an error status: collisions, carrier loss, underflow */
+    uint32_t tx_backlogged;     /**< Frames that waited for free descriptors */
+    uint32_t bus_errors;        /**< Fatal DMA bus errors; the DMA stops */
+} eth_stats_t;
+
+typedef struct {
+    eth_regs_t* regs;
+    uint16_t rx_buffer_size;    /**< Frame bytes per receive buffer */
+    uint8_t rx_next;            /**< Next receive descriptor the DMA hands back */
+    uint8_t rx_dropping;        /**< The frame in progress is being dropped */
+    uint8_t tx_head;            /**< Next transmit descriptor to fill */
+    uint8_t tx_tail;            /**< Oldest transmit descriptor not yet reclaimed */
+    uint8_t tx_used;            /**< Transmit descriptors owned by the driver's frames */
+    uint16_t rx_length;         /**< Bytes of the frame in progress so far */
+    msg_t* rx_first;            /**< Frame in progress, NULL between frames */
+    msg_t* rx_last;
+    eth_desc_t rx_desc[ETH_RX_RING_LENGTH];
+    eth_desc_t tx_desc[ETH_TX_RING_LENGTH];
+    msg_t* rx_buf[ETH_RX_RING_LENGTH];
+    msg_t* tx_buf[ETH_TX_RING_LENGTH];
+    list_t tx_backlog;          /**< Chains waiting for descriptors, by their first buffer */
+    eth_config_t config;
+    eth_stats_t stats;
+} eth_t;
+
+/** Frame data of a buffer. */
+static inline uint8_t* eth_buf_data(msg_t* buf)
+{
+    return (uint8_t*)msg_payload(buf) + ETH_BUF_HEADER;
+}
+
+/** The buffer after this one in its frame, or NULL on the last. */
+static inline msg_t* eth_buf_next(msg_t* buf)
+{
+    node_t* next = ((node_t*)msg_payload(buf))->next;
+    return (next != NULL) ? (msg_t*)next->data : NULL;
+}
+
+/**
+ * @brief Takes a buffer from a pool as a one-buffer frame.
+ *
+ * @return The buffer, with length 0, or NULL if the pool is empty.
+ */
+msg_t* eth_buf_alloc(msg_pool_t* pool);
+
+/** Appends the chain starting at tail after the last buffer of frame. */
+void eth_buf_append(msg_t* frame, msg_t* tail);
+
+/** Frame bytes in a chain. */
+uint32_t eth_buf_total(msg_t* frame);
+
+/** Returns every buffer of a chain to its pool. */
+void eth_buf_free(msg_t* frame);
+
+/**
+ * @brief Resets the MAC and its DMA, fills the receive ring and starts both
+ * directions.
+ *
+ * @return FAILURE if the configuration is invalid (receive buffers smaller
+ * than ETH_RX_BUFFER_MIN or fewer than a ring's worth plus one, HCLK out of
+ * range), the driver is in use or the DMA does not come out of reset.
+ */
+status_t eth_init(eth_t* eth, const eth_config_t* config);
+
+/**
+ * @brief Stops both directions. Buffers in the rings, the backlog and a
+ * partly received frame go back to their pools.
+ */
+void eth_deinit(eth_t* eth);
+
+/**
+ * @brief Queues a frame for transmission and passes ownership of its chain
+ * to the driver. Safe from any context.
+ *
+ * @return FAILURE on invalid arguments (an empty buffer, more buffers than
+ * ETH_TX_RING_LENGTH, more than ETH_FRAME_MAX bytes); the caller keeps the
+ * chain.
+ */
+status_t eth_send(eth_t* eth, msg_t* frame);
+
+/** Sets the MAC to the speed and duplex the PHY negotiated. */
+void eth_set_link(eth_t* eth, uint8_t speed_100, uint8_t full_duplex);
+
+/**
+ * @brief Reads a PHY register over MDIO.
+ *
+ * @return FAILURE if the management interface stays busy.
+ */
+status_t eth_phy_read(eth_t* eth, uint8_t phy, uint8_t reg, uint16_t* value);
+
+/** Writes a PHY register over MDIO; FAILURE if the interface stays busy. */
+status_t eth_phy_write(eth_t* eth, uint8_t phy, uint8_t reg, uint16_t value);
+
+/** DMA interrupt body; ETH_IRQHandler calls this. */
+void eth_irq(void);
+
+const eth_stats_t* eth_get_stats(const eth_t* eth);
+
+#if !defined(STM32F407xx)
+/** Host model: the PHY's registers, as seen over MDIO at any address. */
+extern uint16_t eth_sim_phy[32];
+
+/**
+ * @brief Host model: one frame (without FCS) arrives from the wire and goes
+ * through the address filter, the checksum engine and the receive ring. A
+ * frame that does not fit in the free descriptors is dropped, where the
+ * hardware would hold it in its FIFO.
+ *
+ * @return 1 if the frame was written to the ring, 0 if it was filtered or
+ * dropped, or the receiver is off.
+ */
+uint32_t eth_sim_receive(eth_t* eth, const uint8_t* frame, uint32_t length);
+
+/**
+ * @brief Host model: the receive watchdog expires, as after a burst of
+ * frames with their completion interrupts suppressed.
+ */
+void eth_sim_rx_watchdog(eth_t* eth);
+
+/**
+ * @brief Host model: plays back the Ethernet frames of a pcap capture held
+ * in memory through eth_sim_receive(), then lets the receive watchdog
+ * expire. Both byte orders and nanosecond captures are accepted; timestamps
+ * are ignored.
+ *
+ * @return Frames taken by the ring, or -1 if the capture is malformed or not
+ * of Ethernet frames.
+ */
+int32_t eth_sim_play_pcap(eth_t* eth, const void* capture, size_t size);
+
+/** Host model: eth_sim_play_pcap() on a capture file. */
+int32_t eth_sim_play_pcap_file(eth_t* eth, const char* path);
+
+/**
+ * @brief Host model: the MAC sends the next frame of the transmit ring,
+ * inserting checksums if the descriptor asks for it, into out.
+ *
+ * @return Frame bytes, 0 if no complete frame is ready or it does not fit in max.
+ */
+uint32_t eth_sim_transmit(eth_t* eth, uint8_t* out, uint32_t max);
+
+/** Host model: a write to a register with side effects in the hardware. */
+void eth_sim_write(volatile uint32_t* reg, uint32_t value);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ETH_H
@@ -0,0 +1,428 @@
+#include "eth.h"
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(STM32F407xx)
+
+#define PCAP_MAGIC 0xA1B2C3D4U
+#define PCAP_MAGIC_NS 0xA1B23C4DU
+#define PCAP_LINKTYPE_ETHERNET 1U
+#define PCAP_HEADER 24U
+#define PCAP_RECORD 16U
+
+#define ETHERTYPE_VLAN 0x8100U
+#define ETHERTYPE_IPV4 0x0800U
+#define ETH_MIN_FRAME 60U
+
+uint16_t eth_sim_phy[32];
+
+/* What the DMA tracks besides its registers */
+static struct {
+    eth_desc_t* rx_current;
+    eth_desc_t* tx_current;
+    uint8_t rx_reload;      /* DMARDLAR was written; fetch from the list start */
+    uint8_t tx_reload;
+    uint8_t rx_suspended;   /* Found a descriptor it did not own; waits for a poll demand */
+    uint8_t rx_watchdog;    /* Frames written with their interrupt suppressed */
+} dma;
+
+static void raise(eth_t* eth)
+{
+    const eth_regs_t* regs = &eth_sim_regs;
+    if (eth->regs != NULL && (regs->DMASR & regs->DMAIER & (ETH_DMASR_NIS | ETH_DMASR_AIS))) {
+        eth_irq();
+    }
+}
+
+static void set_status(uint32_t bits)
+{
+    uint32_t summary = (bits & (ETH_DMASR_TS | ETH_DMASR_RS)) ? ETH_DMASR_NIS : ETH_DMASR_AIS;
+    eth_sim_regs.DMASR |= bits | summary;
+}
+
+/* The DMA reads the list address from DMARDLAR, which on the host holds only 32 bits of it */
+static void reload(eth_t* eth)
+{
+    if (dma.rx_reload) {
+        dma.rx_current = eth->rx_desc;
+        dma.rx_reload = 0;
+    }
+    if (dma.tx_reload) {
+        dma.tx_current = eth->tx_desc;
+        dma.tx_reload = 0;
+    }
+}
+
+/* ---------------------------------------------------------- checksums --- */
+
+static uint32_t sum16(const uint8_t* data, uint32_t length, uint32_t sum)
+{
+    for (uint32_t i = 0; i + 1U < length; i += 2U) {
+        sum += ((uint32_t)data[i] << 8) | data[i + 1U];
+    }
+    if (length & 1U) {
+        sum += (uint32_t)data[length - 1U] << 8;
+    }
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFFU) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+typedef struct {
+    uint32_t ip;            /* Offset of the IPv4 header, 0 if there is none */
+    uint32_t header;        /* IPv4 header bytes */
+    uint32_t payload;       /* Bytes after the header, by the IP total length */
+    uint8_t protocol;
+    uint8_t checked;        /* The engine handles the payload: TCP, UDP or ICMP, unfragmented */
+} ip_layout_t;
+
+static uint32_t ip_layout(const uint8_t* frame, uint32_t length, ip_layout_t* ip)
+{
+    memset(ip, 0, sizeof(*ip));
+    uint32_t offset = 12;
+    uint32_t type = ((uint32_t)frame[12] << 8) | frame[13];
+    if (type == ETHERTYPE_VLAN && length >= 18U) {
+        offset = 16;
+        type = ((uint32_t)frame[16] << 8) | frame[17];
+    }
+    offset += 2U;
+    if (type != ETHERTYPE_IPV4 || length < offset + 20U || (frame[offset] >> 4) != 4U) {
+        return type;
+    }
+    uint32_t header = (frame[offset] & 0xFU) * 4U;
+    uint32_t total = ((uint32_t)frame[offset + 2U] << 8) | frame[offset + 3U];
+    if (header < 20U || total < header || offset + total > length) {
+        return type;
+    }
+    uint32_t fragment = (((uint32_t)frame[offset + 6U] << 8) | frame[offset + 7U]) & 0x3FFFU;
+    ip->ip = offset;
+    ip->header = header;
+    ip->payload = total - header;
+    ip->protocol = frame[offset + 9U];
+    ip->checked = fragment == 0U && (ip->protocol == 1U || ip->protocol == 6U || ip->protocol == 17U);
+    return type;
+}
+
+/* Offset of the checksum field within the payload */
+static uint32_t checksum_field(uint8_t protocol)
+{
+    return (protocol == 1U) ? 2U : ((protocol == 6U) ? 16U : 6U);
+}
+
+static uint32_t payload_sum(const uint8_t* frame, const ip_layout_t* ip)
+{
+    const uint8_t* header = frame + ip->ip;
+    uint32_t sum = sum16(header + ip->header, ip->payload, 0);
+    if (ip->protocol != 1U) {
+        /* Pseudo-header: addresses, protocol, length */
+        sum = sum16(header + 12, 8, sum) + ip->protocol + ip->payload;
+    }
+    return sum;
+}
+
+/* RDES0 FT, IPHCE and PCE as the checksum engine sets them (RM0090 table 186) */
+static uint32_t rx_checksum_status(const uint8_t* frame, uint32_t length)
+{
+    ip_layout_t ip;
+    uint32_t type = ip_layout(frame, length, &ip);
+    if (type < 0x600U) {
+        return 0;
+    }
+    if (ip.ip == 0U) {
+        /* Neither IPv4 nor checkable (IPv6 is not modelled): bypassed */
+        return ETH_RDES0_IPHCE | ETH_RDES0_PCE;
+    }
+    uint8_t header_ok = fold(sum16(frame + ip.ip, ip.header, 0)) == 0xFFFFU;
+    if (!ip.checked) {
+        return header_ok ? ETH_RDES0_PCE : (ETH_RDES0_FT | ETH_RDES0_IPHCE);
+    }
+    const uint8_t* payload = frame + ip.ip + ip.header;
+    uint8_t unused = ip.protocol == 17U && payload[6] == 0U && payload[7] == 0U;
+    uint8_t payload_ok = unused || fold(payload_sum(frame, &ip)) == 0xFFFFU;
+    return ETH_RDES0_FT | (header_ok ? 0U : ETH_RDES0_IPHCE) | (payload_ok ? 0U : ETH_RDES0_PCE);
+}
+
+/* TDES0 CIC = 3: header checksum, then payload checksum with the pseudo-header */
+static uint32_t tx_insert_checksums(uint8_t* frame, uint32_t length)
+{
+    ip_layout_t ip;
+    ip_layout(frame, length, &ip);
+    if (ip.ip == 0U) {
+        return ETH_TDES0_IHE;
+    }
+    uint8_t* header = frame + ip.ip;
+    header[10] = 0;
+    header[11] = 0;
+    uint16_t sum = (uint16_t)~fold(sum16(header, ip.header, 0));
+    header[10] = (uint8_t)(sum >> 8);
+    header[11] = (uint8_t)sum;
+
+    if (!ip.checked) {
+        return 0;
+    }
+    uint8_t* field = header + ip.header + checksum_field(ip.protocol);
+    if (ip.payload < checksum_field(ip.protocol) + 2U) {
+        return ETH_TDES0_IPE;
+    }
+    field[0] = 0;
+    field[1] = 0;
+    sum = (uint16_t)~fold(payload_sum(frame, &ip));
+    if (sum == 0U && ip.protocol == 17U) {
+        sum = 0xFFFFU;
+    }
+    field[0] = (uint8_t)(sum >> 8);
+    field[1] = (uint8_t)sum;
+    return 0;
+}
+
+/* ------------------------------------------------------------ receive --- */
+
+static uint8_t address_match(const eth_regs_t* regs, const uint8_t* frame)
+{
+    static const uint8_t broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    if (regs->MACFFR & ETH_MACFFR_PM) {
+        return 1;
+    }
+    if (frame[0] & 1U) {
+        return memcmp(frame, broadcast, 6) == 0 || (regs->MACFFR & ETH_MACFFR_PAM);
+    }
+    uint32_t high = (uint32_t)frame[4] | ((uint32_t)frame[5] << 8);
+    uint32_t low = (uint32_t)frame[0] | ((uint32_t)frame[1] << 8) | ((uint32_t)frame[2] << 16) |
+                   ((uint32_t)frame[3] << 24);
+    return high == (regs->MACA0HR & 0xFFFFU) && low == regs->MACA0LR;
+}
+
+uint32_t eth_sim_receive(eth_t* eth, const uint8_t* frame, uint32_t length)
+{
+    eth_regs_t* regs = &eth_sim_regs;
+    if (!(regs->MACCR & ETH_MACCR_RE) || !(regs->DMAOMR & ETH_DMAOMR_SR) || length < 14U ||
+        length > ETH_FRAME_MAX || !address_match(regs, frame)) {
+        return 0;
+    }
+    reload(eth);
+
+    /* Store and forward: the whole frame must fit in descriptors the DMA owns */
+    eth_desc_t* desc = dma.rx_current;
+    uint32_t room = 0;
+    while (!dma.rx_suspended && room < length) {
+        if (desc == NULL || !(desc->status & ETH_DES0_OWN)) {
+            dma.rx_suspended = 1;
+            break;
+        }
+        room += desc->control & ETH_RDES1_RBS1_Msk;
+        desc = desc->next;
+    }
+    if (dma.rx_suspended) {
+        regs->DMAMFBOCR++;
+        set_status(ETH_DMASR_RBUS);
+        raise(eth);
+        return 0;
+    }
+
+    uint32_t type = ((uint32_t)frame[12] << 8) | frame[13];
+    uint32_t status = (length << ETH_RDES0_FL_Pos) | ETH_RDES0_LS | ((type >= 0x600U) ? ETH_RDES0_FT : 0U);
+    if (regs->MACCR & ETH_MACCR_IPCO) {
+        status = (status & ~ETH_RDES0_FT) | rx_checksum_status(frame, length);
+    }
+
+    uint32_t done = 0;
+    uint32_t control = 0;
+    desc = dma.rx_current;
+    while (done < length) {
+        uint32_t size = desc->control & ETH_RDES1_RBS1_Msk;
+        uint32_t chunk = (length - done < size) ? length - done : size;
+        memcpy(desc->buffer, frame + done, chunk);
+        uint32_t first = (done == 0U) ? ETH_RDES0_FS : 0U;
+        done += chunk;
+        control = desc->control;
+        /* Status is valid in the last descriptor; the others only mark their place */
+        desc->status = (done == length) ? (status | first) : first;
+        desc = desc->next;
+    }
+    dma.rx_current = desc;
+
+    if (control & ETH_RDES1_DIC) {
+        dma.rx_watchdog = 1;
+    } else {
+        set_status(ETH_DMASR_RS);
+        raise(eth);
+    }
+    return 1;
+}
+
+void eth_sim_rx_watchdog(eth_t* eth)
+{
+    if (dma.rx_watchdog && eth_sim_regs.DMARSWTR != 0U) {
+        dma.rx_watchdog = 0;
+        set_status(ETH_DMASR_RS);
+        raise(eth);
+    }
+}
+
+/* -------------------------------------------------------------- pcap --- */
+
+static uint32_t read32(const uint8_t* p, uint8_t swapped)
+{
+    uint32_t value = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+/* Returns whether the file header is usable and its byte order */
+static uint8_t pcap_header(const uint8_t* header, uint8_t* swapped)
+{
+    uint32_t magic = read32(header, 0);
+    *swapped = magic == __builtin_bswap32(PCAP_MAGIC) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    if (!*swapped && magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS) {
+        return 0;
+    }
+    return (read32(header + 20, *swapped) & 0xFFFFU) == PCAP_LINKTYPE_ETHERNET;
+}
+
+int32_t eth_sim_play_pcap(eth_t* eth, const void* capture, size_t size)
+{
+    const uint8_t* data = (const uint8_t*)capture;
+    uint8_t swapped;
+    if (data == NULL || size < PCAP_HEADER || !pcap_header(data, &swapped)) {
+        return -1;
+    }
+    int32_t taken = 0;
+    size_t offset = PCAP_HEADER;
+    while (offset < size) {
+        if (size - offset < PCAP_RECORD) {
+            return -1;
+        }
+        uint32_t length = read32(data + offset + 8, swapped);
+        offset += PCAP_RECORD;
+        if (length > size - offset) {
+            return -1;
+        }
+        taken += (int32_t)eth_sim_receive(eth, data + offset, length);
+        offset += length;
+    }
+    eth_sim_rx_watchdog(eth);
+    return taken;
+}
+
+int32_t eth_sim_play_pcap_file(eth_t* eth, const char* path)
+{
+    static uint8_t frame[65536];
+    uint8_t header[PCAP_HEADER];
+    uint8_t swapped;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    int32_t taken = 0;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || !pcap_header(header, &swapped)) {
+        taken = -1;
+    }
+    while (taken >= 0 && fread(header, 1, PCAP_RECORD, file) == PCAP_RECORD) {
+        uint32_t length = read32(header + 8, swapped);
+        if (length > sizeof(frame) || fread(frame, 1, length, file) != length) {
+            taken = -1;
+        } else {
+            taken += (int32_t)eth_sim_receive(eth, frame, length);
+        }
+    }
+    fclose(file);
+    eth_sim_rx_watchdog(eth);
+    return taken;
+}
+
+/* ----------------------------------------------------------- transmit --- */
+
+uint32_t eth_sim_transmit(eth_t* eth, uint8_t* out, uint32_t max)
+{
+    eth_regs_t* regs = &eth_sim_regs;
+    if (!(regs->MACCR & ETH_MACCR_TE) || !(regs->DMAOMR & ETH_DMAOMR_ST)) {
+        return 0;
+    }
+    reload(eth);
+
+    /* Store and forward: gather the whole frame before anything goes out */
+    eth_desc_t* desc = dma.tx_current;
+    uint32_t length = 0;
+    while (1) {
+        if (desc == NULL || !(desc->status & ETH_DES0_OWN)) {
+            set_status(ETH_DMASR_TBUS);
+            return 0;
+        }
+        uint32_t size = desc->control & ETH_TDES1_TBS1_Msk;
+        if (length + size > max) {
+            return 0;
+        }
+        memcpy(out + length, desc->buffer, size);
+        length += size;
+        if (desc->status & ETH_TDES0_LS) {
+            break;
+        }
+        desc = desc->next;
+    }
+
+    uint32_t first = dma.tx_current->status;
+    uint32_t errors = 0;
+    if ((first & ETH_TDES0_CIC_FULL) == ETH_TDES0_CIC_FULL) {
+        errors = tx_insert_checksums(out, length);
+    }
+    if (length < ETH_MIN_FRAME && max >= ETH_MIN_FRAME) {
+        memset(out + length, 0, ETH_MIN_FRAME - length);
+        length = ETH_MIN_FRAME;
+    }
+
+    /* Descriptors go back in order; the status lands in the last one */
+    uint32_t last = 0;
+    for (desc = dma.tx_current; !last; desc = desc->next) {
+        last = desc->status & ETH_TDES0_LS;
+        desc->status = (desc->status & ~ETH_DES0_OWN) | (last ? errors : 0U);
+        if (last && (desc->status & ETH_TDES0_IC)) {
+            set_status(ETH_DMASR_TS);
+        }
+        dma.tx_current = desc->next;
+    }
+    raise(eth);
+    return length;
+}
+
+/* --------------------------------------------------------- registers --- */
+
+void eth_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    eth_regs_t* regs = &eth_sim_regs;
+    uint32_t old = *reg;
+    hal_reg_write(reg, value);
+
+    if (reg == &regs->DMABMR) {
+        if (value & ETH_DMABMR_SR) {
+            /* Resets the MAC and the DMA; the bit clears once done, here at once */
+            memset(regs, 0, sizeof(*regs));
+            regs->MACA0HR = 0x8000FFFFU;
+            regs->MACA0LR = 0xFFFFFFFFU;
+            regs->DMABMR = 0x00002100U;
+            memset(&dma, 0, sizeof(dma));
+        }
+    } else if (reg == &regs->DMASR) {
+        *reg = old & ~(value & 0x1E7FFU);
+    } else if (reg == &regs->DMARPDR) {
+        dma.rx_suspended = 0;
+    } else if (reg == &regs->DMARDLAR) {
+        dma.rx_reload = 1;
+    } else if (reg == &regs->DMATDLAR) {
+        dma.tx_reload = 1;
+    } else if (reg == &regs->MACMIIAR && (value & ETH_MACMIIAR_MB)) {
+        uint32_t index = (value >> ETH_MACMIIAR_MR_Pos) & 0x1FU;
+        if (value & ETH_MACMIIAR_MW) {
+            eth_sim_phy[index] = (uint16_t)regs->MACMIIDR;
+        } else {
+            regs->MACMIIDR = eth_sim_phy[index];
+        }
+        *reg = value & ~ETH_MACMIIAR_MB;
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "feature_hooks.h"
+
+#if BUILD_CFG_FEATURE_TRACE
+
+trace_record_t trace_buffer[TRACE_BUFFER_LENGTH];
+uint32_t trace_count;
+
+__attribute__((weak)) void trace_emit(uint16_t event_id, uint32_t arg)
+{
+    trace_record_t* record = &trace_buffer[trace_count % TRACE_BUFFER_LENGTH];
+    record->event_id = event_id;
+    record->arg = arg;
+    trace_count++;
+}
+
+#endif
+
+#if BUILD_CFG_FEATURE_LOGGING
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#if BUILD_CFG_LOG_BACKEND == LOG_BACKEND_ID_itm && defined(STM32F407xx)
+
+#define ITM_STIM0 (*(volatile uint32_t*)0xE0000000U)
+#define ITM_TER (*(volatile uint32_t*)0xE0000E00U)
+#define ITM_TCR (*(volatile uint32_t*)0xE0000E80U)
+#define ITM_TCR_ITMENA (1U << 0)
+
+#define LOG_LINE_MAX 128
+
+static void itm_putc(char c)
+{
+    if (((ITM_TCR & ITM_TCR_ITMENA) == 0) || ((ITM_TER & 1U) == 0)) {
+        return;
+    }
+    while (ITM_STIM0 == 0) {
+    }
+    *(volatile uint8_t*)&ITM_STIM0 = (uint8_t)c;
+}
+
+int log_write(const char* format, ...)
+{
+    char line[LOG_LINE_MAX];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (length < 0) {
+        return length;
+    }
+    if (length >= (int)sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+    for (int i = 0; i < length; i++) {
+        itm_putc(line[i]);
+    }
+    return length;
+}
+
+#else
+
+int log_write(const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    int length = vprintf(format, args);
+    va_end(args);
+    return length;
+}
+
+#endif
+
+#endif
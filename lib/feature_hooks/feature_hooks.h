@@ -0,0 +1,159 @@
+#ifndef FEATURE_HOOKS_H
+#define FEATURE_HOOKS_H
+
+#include "build_config.h"
+#include "hal_reg.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Feature hooks driven by the generated build_config.h. Every hook expands to
+ * nothing when its feature is disabled, so arguments are not even evaluated.
+ */
+
+/* ------------------------------------------------------------------------- */
+/* Tracing                                                                   */
+/* ------------------------------------------------------------------------- */
+
+#if BUILD_CFG_FEATURE_TRACE
+#define TRACE_BUFFER_LENGTH 64
+
+typedef struct {
+    uint16_t event_id;
+    uint32_t arg;
+} trace_record_t;
+
+/**
+ * @brief Last TRACE_BUFFER_LENGTH events recorded by the default trace_emit(),
+ * oldest overwritten first. Meant to be read from a debugger.
+ */
+extern trace_record_t trace_buffer[TRACE_BUFFER_LENGTH];
+extern uint32_t trace_count;
+
+/**
+ * @brief Records one trace event. Weak, so the application can route events elsewhere.
+ *
+ * @param event_id Module specific event identifier.
+ * @param arg Event argument.
+ */
+void trace_emit(uint16_t event_id, uint32_t arg);
+
+#define TRACE(event_id, arg) trace_emit((uint16_t)(event_id), (uint32_t)(arg))
+#else
+#define TRACE(event_id, arg) ((void)0)
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Logging                                                                   */
+/* ------------------------------------------------------------------------- */
+
+/* Unless the client's config sets a level: errors only in prod, warnings too in test */
+#ifndef BUILD_CFG_LOG_LEVEL
+#if BUILD_CFG_ENVIRONMENT_ID == ENVIRONMENT_ID_prod
+#define BUILD_CFG_LOG_LEVEL LOG_LEVEL_ERROR
+#elif BUILD_CFG_ENVIRONMENT_ID == ENVIRONMENT_ID_test
+#define BUILD_CFG_LOG_LEVEL LOG_LEVEL_WARN
+#else
+#define BUILD_CFG_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#if BUILD_CFG_FEATURE_LOGGING
+/**
+ * @brief Formats and writes a log line to the configured backend.
+ *
+ * @param format printf-style format string.
+ * @return int Number of characters written.
+ */
+int log_write(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#define LOG_ERROR(...) log_write("E: " __VA_ARGS__)
+#if BUILD_CFG_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_write("W: " __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+#if BUILD_CFG_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write("I: " __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#else
+#define LOG_ERROR(...) ((void)0)
+#define LOG_WARN(...) ((void)0)
+#define LOG_INFO(...) ((void)0)
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Locking                                                                   */
+/* ------------------------------------------------------------------------- */
+
+#if BUILD_CFG_FEATURE_LOCKING
+/**
+ * @brief Masks interrupts and returns the previous PRIMASK value.
+ *
+ * @return uint32_t State to pass to lock_release().
+ */
+static inline uint32_t lock_acquire(void)
+{
+    return hal_irq_mask();
+}
+
+/**
+ * @brief Restores the PRIMASK value returned by lock_acquire().
+ *
+ * @param state Value returned by the matching lock_acquire().
+ */
+static inline void lock_release(uint32_t state)
+{
+    hal_irq_restore(state);
+}
+
+#define LOCK_STATE(name) uint32_t name
+#define LOCK_ACQUIRE(name) ((name) = lock_acquire())
+#define LOCK_RELEASE(name) lock_release(name)
+#else
+#define LOCK_STATE(name)
+#define LOCK_ACQUIRE(name) ((void)0)
+#define LOCK_RELEASE(name) ((void)0)
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Statistics                                                                */
+/* ------------------------------------------------------------------------- */
+
+#if BUILD_CFG_FEATURE_STATS
+#define STAT_INC(counter) ((counter)++)
+#define STAT_DEC(counter) ((counter)--)
+#define STAT_ADD(counter, value) ((counter) += (value))
+#define STAT_SET(counter, value) ((counter) = (value))
+#define STAT_MAX(counter, value)      \
+    do {                              \
+        if ((value) > (counter)) {    \
+            (counter) = (value);      \
+        }                             \
+    } while (0)
+/* A counter still at 0 has no value yet, and takes the first one */
+#define STAT_MIN(counter, value)                          \
+    do {                                                  \
+        if ((counter) == 0U || (value) < (counter)) {     \
+            (counter) = (value);                          \
+        }                                                 \
+    } while (0)
+#else
+#define STAT_INC(counter) ((void)0)
+#define STAT_DEC(counter) ((void)0)
+#define STAT_ADD(counter, value) ((void)0)
+#define STAT_SET(counter, value) ((void)0)
+#define STAT_MAX(counter, value) ((void)0)
+#define STAT_MIN(counter, value) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FEATURE_HOOKS_H
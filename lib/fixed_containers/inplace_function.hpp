@@ -0,0 +1,132 @@
+#ifndef INPLACE_FUNCTION_HPP
+#define INPLACE_FUNCTION_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace fixed {
+
+template <typename Signature, std::size_t Bytes = 2 * sizeof(void*)>
+class inplace_function;
+
+/**
+ * @brief Type-erased callable stored inline in Bytes of storage.
+ *
+ * A drop-in for std::function that never allocates: callables that do not
+ * fit are rejected at compile time. Trivially copyable callables (plain
+ * function pointers, lambdas capturing pointers and integers) are copied
+ * with memcpy and need no destructor call. Calling an empty function is
+ * undefined; check it with operator bool first.
+ *
+ * @tparam R Return type.
+ * @tparam Args Argument types.
+ * @tparam Bytes Inline storage size.
+ */
+template <typename R, typename... Args, std::size_t Bytes>
+class inplace_function<R(Args...), Bytes> {
+public:
+    constexpr inplace_function() noexcept
+        : storage_()
+        , invoke_(nullptr)
+        , manage_(nullptr)
+    {
+    }
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, inplace_function>::value>>
+    inplace_function(F&& callable) noexcept
+        : inplace_function()
+    {
+        using Callable = std::decay_t<F>;
+        static_assert(sizeof(Callable) <= Bytes, "callable does not fit in inplace_function storage");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t), "callable is over-aligned");
+
+        new (storage_) Callable(std::forward<F>(callable));
+        invoke_ = &invoke<Callable>;
+        if constexpr (!std::is_trivially_copyable<Callable>::value) {
+            manage_ = &manage<Callable>;
+        }
+    }
+
+    inplace_function(const inplace_function& other) noexcept
+        : inplace_function()
+    {
+        copy_from(other);
+    }
+
+    inplace_function& operator=(const inplace_function& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    ~inplace_function()
+    {
+        reset();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return invoke_ != nullptr;
+    }
+
+    R operator()(Args... args) const
+    {
+        return invoke_(storage_, std::forward<Args>(args)...);
+    }
+
+    void reset() noexcept
+    {
+        if (manage_ != nullptr) {
+            manage_(storage_, nullptr);
+        }
+        invoke_ = nullptr;
+        manage_ = nullptr;
+    }
+
+private:
+    using invoke_fn = R (*)(const void*, Args&&...);
+    // Copies from source into destination, or destroys destination when source is null
+    using manage_fn = void (*)(void* destination, const void* source);
+
+    template <typename Callable>
+    static R invoke(const void* storage, Args&&... args)
+    {
+        Callable& callable = *const_cast<Callable*>(static_cast<const Callable*>(storage));
+        return callable(std::forward<Args>(args)...);
+    }
+
+    template <typename Callable>
+    static void manage(void* destination, const void* source)
+    {
+        if (source == nullptr) {
+            static_cast<Callable*>(destination)->~Callable();
+        } else {
+            new (destination) Callable(*static_cast<const Callable*>(source));
+        }
+    }
+
+    void copy_from(const inplace_function& other) noexcept
+    {
+        if (other.manage_ == nullptr) {
+            std::memcpy(storage_, other.storage_, Bytes);
+        } else {
+            other.manage_(storage_, other.storage_);
+        }
+        invoke_ = other.invoke_;
+        manage_ = other.manage_;
+    }
+
+    alignas(std::max_align_t) mutable unsigned char storage_[Bytes];
+    invoke_fn invoke_;
+    manage_fn manage_;
+};
+
+} // namespace fixed
+
+#endif // INPLACE_FUNCTION_HPP
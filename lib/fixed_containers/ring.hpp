@@ -0,0 +1,151 @@
+#ifndef RING_HPP
+#define RING_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace fixed {
+
+/**
+ * @brief FIFO ring buffer with inline storage for N elements.
+ *
+ * N must be a power of two so that indices wrap with a mask. The read and
+ * write counters run freely and only their difference is the fill level,
+ * which keeps one slot from being wasted. Bulk operations on trivially
+ * copyable types copy at most two contiguous segments with memcpy.
+ *
+ * Not synchronized; wrap accesses in hal_irq_mask()/hal_irq_restore() when
+ * producer and consumer run at different interrupt priorities.
+ *
+ * @tparam T Element type, must be trivially copyable.
+ * @tparam N Capacity, a power of two.
+ */
+template <typename T, std::size_t N>
+class ring {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "ring elements must be trivially copyable");
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+    constexpr ring() noexcept
+        : buffer_()
+        , read_(0)
+        , write_(0)
+    {
+    }
+
+    static constexpr size_type capacity() noexcept
+    {
+        return N;
+    }
+
+    constexpr size_type size() const noexcept
+    {
+        return write_ - read_;
+    }
+
+    constexpr bool empty() const noexcept
+    {
+        return write_ == read_;
+    }
+
+    constexpr bool full() const noexcept
+    {
+        return size() == N;
+    }
+
+    bool push(const T& value) noexcept
+    {
+        if (full()) {
+            return false;
+        }
+        buffer_[write_ & mask] = value;
+        write_++;
+        return true;
+    }
+
+    bool pop(T& value) noexcept
+    {
+        if (empty()) {
+            return false;
+        }
+        value = buffer_[read_ & mask];
+        read_++;
+        return true;
+    }
+
+    /**
+     * @brief Oldest element, only valid when not empty.
+     */
+    T& front() noexcept
+    {
+        return buffer_[read_ & mask];
+    }
+
+    /**
+     * @brief Appends up to count elements.
+     *
+     * @return size_type Number of elements actually written.
+     */
+    size_type push_n(const T* values, size_type count) noexcept
+    {
+        size_type free_slots = N - size();
+        if (count > free_slots) {
+            count = free_slots;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        size_type start = write_ & mask;
+        size_type first = (count < N - start) ? count : N - start;
+        std::memcpy(&buffer_[start], values, first * sizeof(T));
+        if (count != first) {
+            std::memcpy(&buffer_[0], values + first, (count - first) * sizeof(T));
+        }
+        write_ += count;
+        return count;
+    }
+
+    /**
+     * @brief Removes up to count elements into values.
+     *
+     * @return size_type Number of elements actually read.
+     */
+    size_type pop_n(T* values, size_type count) noexcept
+    {
+        size_type used = size();
+        if (count > used) {
+            count = used;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        size_type start = read_ & mask;
+        size_type first = (count < N - start) ? count : N - start;
+        std::memcpy(values, &buffer_[start], first * sizeof(T));
+        if (count != first) {
+            std::memcpy(values + first, &buffer_[0], (count - first) * sizeof(T));
+        }
+        read_ += count;
+        return count;
+    }
+
+    void clear() noexcept
+    {
+        read_ = write_;
+    }
+
+private:
+    static constexpr size_type mask = N - 1;
+
+    T buffer_[N];
+    size_type read_;
+    size_type write_;
+};
+
+} // namespace fixed
+
+#endif // RING_HPP
@@ -0,0 +1,135 @@
+#ifndef STATIC_STRING_HPP
+#define STATIC_STRING_HPP
+
+#include <cstddef>
+#include <cstring>
+
+namespace fixed {
+
+/**
+ * @brief NUL-terminated string with inline storage for N characters.
+ *
+ * Appends that do not fit are truncated and reported by returning false.
+ * Construction from a string literal checks the length at compile time.
+ *
+ * @tparam N Maximum length, not counting the terminator.
+ */
+template <std::size_t N>
+class static_string {
+    static_assert(N > 0, "static_string capacity must be non-zero");
+
+public:
+    using size_type = std::size_t;
+
+    constexpr static_string() noexcept
+        : buffer_()
+        , length_(0)
+    {
+    }
+
+    template <std::size_t M>
+    static_string(const char (&literal)[M]) noexcept
+        : buffer_()
+        , length_(0)
+    {
+        static_assert(M - 1 <= N, "string literal exceeds static_string capacity");
+        append(literal, M - 1);
+    }
+
+    static constexpr size_type capacity() noexcept
+    {
+        return N;
+    }
+
+    constexpr size_type size() const noexcept
+    {
+        return length_;
+    }
+
+    constexpr bool empty() const noexcept
+    {
+        return length_ == 0;
+    }
+
+    constexpr const char* c_str() const noexcept
+    {
+        return buffer_;
+    }
+
+    char operator[](size_type index) const noexcept
+    {
+        return buffer_[index];
+    }
+
+    /**
+     * @brief Appends count characters from text.
+     *
+     * @return bool false if the result had to be truncated.
+     */
+    bool append(const char* text, size_type count) noexcept
+    {
+        bool fits = count <= N - length_;
+        if (!fits) {
+            count = N - length_;
+        }
+        std::memcpy(buffer_ + length_, text, count);
+        length_ += count;
+        buffer_[length_] = '\0';
+        return fits;
+    }
+
+    bool append(const char* text) noexcept
+    {
+        return append(text, std::strlen(text));
+    }
+
+    template <std::size_t M>
+    bool append(const static_string<M>& other) noexcept
+    {
+        return append(other.c_str(), other.size());
+    }
+
+    bool push_back(char c) noexcept
+    {
+        return append(&c, 1);
+    }
+
+    static_string& operator+=(const char* text) noexcept
+    {
+        append(text);
+        return *this;
+    }
+
+    void clear() noexcept
+    {
+        length_ = 0;
+        buffer_[0] = '\0';
+    }
+
+    void truncate(size_type length) noexcept
+    {
+        if (length < length_) {
+            length_ = length;
+            buffer_[length_] = '\0';
+        }
+    }
+
+    bool operator==(const char* text) const noexcept
+    {
+        return std::strcmp(buffer_, text) == 0;
+    }
+
+    template <std::size_t M>
+    bool operator==(const static_string<M>& other) const noexcept
+    {
+        return length_ == other.size() && std::memcmp(buffer_, other.c_str(), length_) == 0;
+    }
+
+private:
+    char buffer_[N + 1];
+    size_type length_;
+};
+
+} // namespace fixed
+
+#endif // STATIC_STRING_HPP
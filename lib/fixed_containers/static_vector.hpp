@@ -0,0 +1,258 @@
+#ifndef STATIC_VECTOR_HPP
+#define STATIC_VECTOR_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace fixed {
+
+/**
+ * @brief Vector with inline storage for up to N elements.
+ *
+ * Never allocates. Operations that would exceed the capacity fail and
+ * return false instead of throwing. Copies and element shifts of
+ * trivially copyable types are done with memcpy/memmove.
+ *
+ * @tparam T Element type.
+ * @tparam N Capacity.
+ */
+template <typename T, std::size_t N>
+class static_vector {
+    static_assert(N > 0, "static_vector capacity must be non-zero");
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    static constexpr bool trivial = std::is_trivially_copyable<T>::value;
+
+    constexpr static_vector() noexcept
+        : size_(0)
+    {
+    }
+
+    /**
+     * @brief Builds a vector from a braced array, checking the size at compile time.
+     */
+    template <std::size_t M>
+    explicit static_vector(const T (&values)[M]) noexcept
+        : size_(0)
+    {
+        static_assert(M <= N, "initializer exceeds static_vector capacity");
+        assign(values, M);
+    }
+
+    static_vector(const static_vector& other) noexcept
+        : size_(0)
+    {
+        assign(other.data(), other.size());
+    }
+
+    static_vector& operator=(const static_vector& other) noexcept
+    {
+        if (this != &other) {
+            assign(other.data(), other.size());
+        }
+        return *this;
+    }
+
+    ~static_vector()
+    {
+        clear();
+    }
+
+    static constexpr size_type capacity() noexcept
+    {
+        return N;
+    }
+
+    constexpr size_type size() const noexcept
+    {
+        return size_;
+    }
+
+    constexpr bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    constexpr bool full() const noexcept
+    {
+        return size_ == N;
+    }
+
+    T* data() noexcept
+    {
+        return reinterpret_cast<T*>(storage_);
+    }
+
+    const T* data() const noexcept
+    {
+        return reinterpret_cast<const T*>(storage_);
+    }
+
+    T& operator[](size_type index) noexcept
+    {
+        return data()[index];
+    }
+
+    const T& operator[](size_type index) const noexcept
+    {
+        return data()[index];
+    }
+
+    T& front() noexcept
+    {
+        return data()[0];
+    }
+
+    T& back() noexcept
+    {
+        return data()[size_ - 1];
+    }
+
+    iterator begin() noexcept
+    {
+        return data();
+    }
+
+    iterator end() noexcept
+    {
+        return data() + size_;
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return data();
+    }
+
+    const_iterator end() const noexcept
+    {
+        return data() + size_;
+    }
+
+    bool push_back(const T& value) noexcept
+    {
+        return emplace_back(value) != nullptr;
+    }
+
+    /**
+     * @brief Constructs an element in place at the end.
+     *
+     * @return T* The new element, or nullptr if the vector is full.
+     */
+    template <typename... Args>
+    T* emplace_back(Args&&... args) noexcept
+    {
+        if (size_ == N) {
+            return nullptr;
+        }
+        T* element = new (data() + size_) T(std::forward<Args>(args)...);
+        size_++;
+        return element;
+    }
+
+    void pop_back() noexcept
+    {
+        if (size_ != 0) {
+            size_--;
+            data()[size_].~T();
+        }
+    }
+
+    /**
+     * @brief Replaces the contents with count elements copied from values.
+     *
+     * @return bool false (and unchanged contents) if count exceeds the capacity.
+     */
+    bool assign(const T* values, size_type count) noexcept
+    {
+        if (count > N) {
+            return false;
+        }
+        clear();
+        if constexpr (trivial) {
+            if (count != 0) {
+                std::memcpy(storage_, values, count * sizeof(T));
+            }
+        } else {
+            for (size_type i = 0; i < count; i++) {
+                new (data() + i) T(values[i]);
+            }
+        }
+        size_ = count;
+        return true;
+    }
+
+    /**
+     * @brief Inserts a copy of value before position index.
+     */
+    bool insert(size_type index, const T& value) noexcept
+    {
+        if (size_ == N || index > size_) {
+            return false;
+        }
+        if constexpr (trivial) {
+            T copy = value;
+            std::memmove(data() + index + 1, data() + index, (size_ - index) * sizeof(T));
+            std::memcpy(data() + index, &copy, sizeof(T));
+        } else {
+            /* value may be an element the shift moves */
+            T copy(value);
+            if (index == size_) {
+                new (data() + size_) T(std::move(copy));
+            } else {
+                new (data() + size_) T(std::move(data()[size_ - 1]));
+                for (size_type i = size_ - 1; i > index; i--) {
+                    data()[i] = std::move(data()[i - 1]);
+                }
+                data()[index] = std::move(copy);
+            }
+        }
+        size_++;
+        return true;
+    }
+
+    /**
+     * @brief Removes the element at position index, keeping the order of the rest.
+     */
+    bool erase(size_type index) noexcept
+    {
+        if (index >= size_) {
+            return false;
+        }
+        if constexpr (trivial) {
+            std::memmove(data() + index, data() + index + 1, (size_ - index - 1) * sizeof(T));
+        } else {
+            for (size_type i = index; i + 1 < size_; i++) {
+                data()[i] = std::move(data()[i + 1]);
+            }
+            data()[size_ - 1].~T();
+        }
+        size_--;
+        return true;
+    }
+
+    void clear() noexcept
+    {
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            for (size_type i = 0; i < size_; i++) {
+                data()[i].~T();
+            }
+        }
+        size_ = 0;
+    }
+
+private:
+    alignas(T) unsigned char storage_[N * sizeof(T)];
+    size_type size_;
+};
+
+} // namespace fixed
+
+#endif // STATIC_VECTOR_HPP
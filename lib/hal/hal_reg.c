@@ -0,0 +1,38 @@
+#include "hal_reg.h"
+
+#if !defined(STM32F407xx)
+
+hal_rcc_regs_t hal_sim_rcc;
+hal_nvic_regs_t hal_sim_nvic;
+hal_gpio_regs_t hal_sim_gpio[HAL_GPIO_PORTS];
+
+hal_reg_trace_entry_t hal_reg_trace[HAL_REG_TRACE_LENGTH];
+uint32_t hal_reg_trace_count;
+
+void hal_reg_write(volatile uint32_t* reg, uint32_t value)
+{
+    *reg = value;
+    if (hal_reg_trace_count < HAL_REG_TRACE_LENGTH) {
+        hal_reg_trace[hal_reg_trace_count].reg = reg;
+        hal_reg_trace[hal_reg_trace_count].value = value;
+    }
+    hal_reg_trace_count++;
+}
+
+void hal_reg_trace_reset(void)
+{
+    hal_reg_trace_count = 0;
+}
+
+int32_t hal_reg_trace_find(volatile uint32_t* reg, uint32_t start)
+{
+    uint32_t end = (hal_reg_trace_count < HAL_REG_TRACE_LENGTH) ? hal_reg_trace_count : HAL_REG_TRACE_LENGTH;
+    for (uint32_t i = start; i < end; i++) {
+        if (hal_reg_trace[i].reg == reg) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+#endif
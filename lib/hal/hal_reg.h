@@ -0,0 +1,187 @@
+#ifndef HAL_REG_H
+#define HAL_REG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Register access for peripheral drivers.
+ *
+ * Drivers describe each peripheral as a struct of volatile registers and
+ * reach it through HAL_PERIPH(): the fixed bus address on target, a plain
+ * RAM instance on the host. Writes go through REG_WRITE() and friends, which
+ * are plain stores on target; on the host they also append to a trace, so
+ * tests can check the exact register sequence a driver produced. Hardware
+ * behaviour the driver waits on (status flags, counters) is set up by the
+ * test in the RAM instance.
+ */
+
+#if defined(STM32F407xx)
+#define HAL_PERIPH(type, address, sim) ((type*)(address))
+#define REG_WRITE(reg, value) ((reg) = (value))
+#else
+#define HAL_PERIPH(type, address, sim) (&(sim))
+#define REG_WRITE(reg, value) hal_reg_write(&(reg), (uint32_t)(value))
+#endif
+
+#define REG_READ(reg) (reg)
+#define REG_SET(reg, bits) REG_WRITE(reg, REG_READ(reg) | (bits))
+#define REG_CLEAR(reg, bits) REG_WRITE(reg, REG_READ(reg) & ~(uint32_t)(bits))
+#define REG_MODIFY(reg, clear, set) REG_WRITE(reg, (REG_READ(reg) & ~(uint32_t)(clear)) | (set))
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t PLLCFGR;
+    volatile uint32_t CFGR;
+    volatile uint32_t CIR;
+    volatile uint32_t AHB1RSTR;
+    volatile uint32_t AHB2RSTR;
+    volatile uint32_t AHB3RSTR;
+    uint32_t reserved0;
+    volatile uint32_t APB1RSTR;
+    volatile uint32_t APB2RSTR;
+    uint32_t reserved1[2];
+    volatile uint32_t AHB1ENR;
+    volatile uint32_t AHB2ENR;
+    volatile uint32_t AHB3ENR;
+    uint32_t reserved2;
+    volatile uint32_t APB1ENR;
+    volatile uint32_t APB2ENR;
+    uint32_t reserved3[2];
+    volatile uint32_t AHB1LPENR;
+    volatile uint32_t AHB2LPENR;
+    volatile uint32_t AHB3LPENR;
+    uint32_t reserved4;
+    volatile uint32_t APB1LPENR;
+    volatile uint32_t APB2LPENR;
+    uint32_t reserved5[2];
+    volatile uint32_t BDCR;
+    volatile uint32_t CSR;
+} hal_rcc_regs_t;
+
+typedef struct {
+    volatile uint32_t ISER[8];
+    uint32_t reserved0[24];
+    volatile uint32_t ICER[8];
+} hal_nvic_regs_t;
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+    volatile uint32_t LCKR;
+    volatile uint32_t AFR[2];
+} hal_gpio_regs_t;
+
+/** GPIOA-GPIOI */
+#define HAL_GPIO_PORTS 9U
+
+#if !defined(STM32F407xx)
+extern hal_rcc_regs_t hal_sim_rcc;
+extern hal_nvic_regs_t hal_sim_nvic;
+extern hal_gpio_regs_t hal_sim_gpio[HAL_GPIO_PORTS];
+
+/** One recorded register write. */
+typedef struct {
+    volatile uint32_t* reg;
+    uint32_t value;
+} hal_reg_trace_entry_t;
+
+#define HAL_REG_TRACE_LENGTH 256
+
+extern hal_reg_trace_entry_t hal_reg_trace[HAL_REG_TRACE_LENGTH];
+extern uint32_t hal_reg_trace_count;
+
+/** Stores a value and records the write; only the first HAL_REG_TRACE_LENGTH are kept. */
+void hal_reg_write(volatile uint32_t* reg, uint32_t value);
+
+/** Forgets the recorded writes. */
+void hal_reg_trace_reset(void);
+
+/**
+ * @brief Returns the index of the first recorded write to reg at or after
+ * start, or -1 if there is none.
+ */
+int32_t hal_reg_trace_find(volatile uint32_t* reg, uint32_t start);
+#endif
+
+#define HAL_RCC HAL_PERIPH(hal_rcc_regs_t, 0x40023800U, hal_sim_rcc)
+#define HAL_NVIC HAL_PERIPH(hal_nvic_regs_t, 0xE000E100U, hal_sim_nvic)
+#define HAL_GPIO(port) HAL_PERIPH(hal_gpio_regs_t, (uintptr_t)0x40020000U + 0x400U * (port), hal_sim_gpio[port])
+
+/** Enables an external interrupt line in the NVIC. */
+static inline void hal_nvic_enable(uint32_t irqn)
+{
+    REG_WRITE(HAL_NVIC->ISER[irqn >> 5], 1U << (irqn & 31U));
+}
+
+/** Disables an external interrupt line in the NVIC. */
+static inline void hal_nvic_disable(uint32_t irqn)
+{
+    REG_WRITE(HAL_NVIC->ICER[irqn >> 5], 1U << (irqn & 31U));
+}
+
+/**
+ * @brief Masks interrupts and returns the previous PRIMASK value.
+ *
+ * Unlike LOCK_ACQUIRE this does not depend on FEATURE_LOCKING: it is for
+ * state a driver shares with its own interrupt handler, which needs the
+ * mask whatever the build. Nests; a no-op on the host.
+ */
+static inline uint32_t hal_irq_mask(void)
+{
+#if defined(STM32F407xx)
+    uint32_t primask;
+    __asm volatile("mrs %0, primask\n"
+                   "cpsid i"
+                   : "=r"(primask)
+                   :
+                   : "memory");
+    return primask;
+#else
+    return 0;
+#endif
+}
+
+/** Restores the PRIMASK value returned by hal_irq_mask(). */
+static inline void hal_irq_restore(uint32_t primask)
+{
+#if defined(STM32F407xx)
+    __asm volatile("msr primask, %0" : : "r"(primask) : "memory");
+#else
+    (void)primask;
+#endif
+}
+
+/** Drives a pin high or low through BSRR, without a read-modify-write of ODR. */
+static inline void hal_gpio_write(uint32_t port, uint32_t pin, uint32_t level)
+{
+    uint32_t bit = 1U << pin;
+    REG_WRITE(HAL_GPIO(port)->BSRR, level ? bit : bit << 16);
+#if !defined(STM32F407xx)
+    /* BSRR acts on ODR in hardware; the RAM instance needs it done by hand */
+    hal_sim_gpio[port].ODR = level ? (hal_sim_gpio[port].ODR | bit) : (hal_sim_gpio[port].ODR & ~bit);
+#endif
+}
+
+/** Clocks a port and makes a pin a push-pull output at the given level. */
+static inline void hal_gpio_output(uint32_t port, uint32_t pin, uint32_t level)
+{
+    REG_SET(HAL_RCC->AHB1ENR, 1U << port);
+    hal_gpio_write(port, pin, level);
+    REG_CLEAR(HAL_GPIO(port)->OTYPER, 1U << pin);
+    REG_MODIFY(HAL_GPIO(port)->MODER, 3U << (pin * 2U), 1U << (pin * 2U));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_REG_H
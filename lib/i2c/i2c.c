@@ -0,0 +1,554 @@
+#include "i2c.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define GPIO_MODE_OUTPUT 1U
+#define GPIO_MODE_ALTERNATE 2U
+
+/* A device can hold SDA for at most the eight remaining bits of a byte and its acknowledge */
+#define BUS_CLEAR_PULSES 9U
+
+typedef struct {
+    uint8_t rcc_bit;
+    uint8_t ev_irqn;
+    uint8_t er_irqn;
+    uint8_t dma_channel;
+    uint8_t rx_stream;
+    uint8_t tx_stream;
+} i2c_instance_t;
+
+/*
+ * RM0090 tables 42 and 61; all three are on APB1 and DMA1. I2C2 receives on
+ * stream 3 rather than 2, the stream I2C3 must use, so the three can run
+ * together. Their streams are also wanted by USART2-3, UART4-5 and SPI2-3,
+ * and whichever driver claims one second fails to init.
+ */
+static const i2c_instance_t instances[I2C_INSTANCES] = {
+    { 21, 31, 32, 1, 0, 6 }, /* I2C1 */
+    { 22, 33, 34, 7, 3, 7 }, /* I2C2 */
+    { 23, 72, 73, 3, 2, 4 }, /* I2C3 */
+};
+
+#if !defined(STM32F407xx)
+i2c_regs_t i2c_sim_regs[I2C_INSTANCES];
+#endif
+
+static i2c_bus_t* buses[I2C_INSTANCES];
+
+static i2c_regs_t* instance_regs(uint8_t instance)
+{
+    switch (instance) {
+    case 1: return I2C1_REGS;
+    case 2: return I2C2_REGS;
+    default: return I2C3_REGS;
+    }
+}
+
+/*
+ * RM0090 27.6.8-9: in standard mode SCL high and low each last CCR PCLK
+ * periods; in fast mode (DUTY = 0) high lasts CCR and low 2 * CCR. CCR is
+ * rounded up so that SCL never runs above speed_hz. TRISE is the maximum
+ * rise time in PCLK periods plus one: 1000 ns, or 300 ns in fast mode.
+ */
+static status_t timing(uint32_t clock_hz, uint32_t speed_hz, uint32_t* ccr, uint32_t* trise)
+{
+    uint32_t freq = clock_hz / 1000000U;
+    if (freq < 2U || freq > 42U || speed_hz == 0U || speed_hz > 400000U) {
+        return FAILURE;
+    }
+    if (speed_hz <= 100000U) {
+        uint32_t divider = (clock_hz + 2U * speed_hz - 1U) / (2U * speed_hz);
+        *ccr = (divider < 4U) ? 4U : divider;
+        *trise = freq + 1U;
+    } else {
+        *ccr = (clock_hz + 3U * speed_hz - 1U) / (3U * speed_hz);
+        *trise = freq * 300U / 1000U + 1U;
+    }
+    if (*ccr > 0xFFFU) {
+        return FAILURE;
+    }
+    if (speed_hz > 100000U) {
+        *ccr |= I2C_CCR_FS;
+    }
+    return SUCCESS;
+}
+
+static void configure(i2c_bus_t* bus)
+{
+    uint32_t ccr = 0;
+    uint32_t trise = 0;
+    i2c_regs_t* regs = bus->regs;
+    timing(bus->config.clock_hz, bus->config.speed_hz, &ccr, &trise);
+    REG_WRITE(regs->CR1, 0);
+    REG_WRITE(regs->CR2, (bus->config.clock_hz / 1000000U) | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+    REG_WRITE(regs->CCR, ccr);
+    REG_WRITE(regs->TRISE, trise);
+    REG_WRITE(regs->CR1, I2C_CR1_PE);
+}
+
+/* ------------------------------------------------------------ recovery --- */
+
+static void pin_mode(const i2c_pin_t* pin, uint32_t mode)
+{
+    REG_MODIFY(HAL_GPIO(pin->port)->MODER, 3U << (pin->pin * 2U), mode << (pin->pin * 2U));
+}
+
+static void half_period(const i2c_bus_t* bus)
+{
+    for (volatile uint32_t i = bus->delay_loops; i > 0U; i--) {
+    }
+}
+
+/*
+ * A device reset in the middle of a read can be left driving SDA low,
+ * waiting for clocks that never come; the peripheral then sees a busy bus
+ * and will not generate a START. Clocking SCL by hand lets the device
+ * finish its byte and release SDA, and a STOP then resets every device's
+ * bus state (NXP UM10204 3.1.16).
+ */
+static void bus_clear(i2c_bus_t* bus)
+{
+    const i2c_pin_t* scl = &bus->config.scl;
+    const i2c_pin_t* sda = &bus->config.sda;
+
+    REG_WRITE(bus->regs->CR1, 0);
+    REG_SET(HAL_GPIO(scl->port)->OTYPER, 1U << scl->pin);
+    REG_SET(HAL_GPIO(sda->port)->OTYPER, 1U << sda->pin);
+    hal_gpio_write(scl->port, scl->pin, 1);
+    hal_gpio_write(sda->port, sda->pin, 1);
+    pin_mode(scl, GPIO_MODE_OUTPUT);
+    pin_mode(sda, GPIO_MODE_OUTPUT);
+
+    for (uint32_t pulse = 0; pulse < BUS_CLEAR_PULSES; pulse++) {
+        if (REG_READ(HAL_GPIO(sda->port)->IDR) & (1U << sda->pin)) {
+            break;
+        }
+        hal_gpio_write(scl->port, scl->pin, 0);
+        half_period(bus);
+        hal_gpio_write(scl->port, scl->pin, 1);
+        half_period(bus);
+#if !defined(STM32F407xx)
+        i2c_sim_scl_pulse(bus->instance);
+#endif
+    }
+
+    /* SDA rising while SCL is high */
+    hal_gpio_write(sda->port, sda->pin, 0);
+    half_period(bus);
+    hal_gpio_write(sda->port, sda->pin, 1);
+    half_period(bus);
+#if !defined(STM32F407xx)
+    i2c_sim_manual_stop(bus->instance);
+#endif
+
+    pin_mode(scl, GPIO_MODE_ALTERNATE);
+    pin_mode(sda, GPIO_MODE_ALTERNATE);
+    REG_WRITE(bus->regs->CR1, I2C_CR1_SWRST);
+    REG_WRITE(bus->regs->CR1, 0);
+    configure(bus);
+}
+
+/* ------------------------------------------------------------ batching --- */
+
+static void begin_transfer(i2c_bus_t* bus, i2c_transfer_t* transfer)
+{
+    bus->transfer = transfer;
+    bus->reading = (transfer->write_length == 0U);
+    bus->index = 0;
+}
+
+/* Puts a batch on the bus; called with interrupts masked and the bus idle */
+static void start_batch(i2c_bus_t* bus, i2c_batch_t* batch)
+{
+    bus->batch = batch;
+    bus->idle_ticks = 0;
+    begin_transfer(bus, (i2c_transfer_t*)batch->transfers.head->data);
+#if defined(STM32F407xx)
+    /* A START written while the previous batch's STOP is still pending would replace it */
+    while (REG_READ(bus->regs->CR1) & I2C_CR1_STOP) {
+    }
+#endif
+    REG_SET(bus->regs->CR1, I2C_CR1_START);
+}
+
+/* Completes the batch on the bus and starts the next one, before the callback runs */
+static void batch_done(i2c_bus_t* bus)
+{
+    i2c_batch_t* done = bus->batch;
+    bus->batch = NULL;
+    bus->transfer = NULL;
+    STAT_INC(bus->stats.batches);
+
+    node_t* next = ll_list_remove_head(&bus->queue);
+    if (next != NULL) {
+        start_batch(bus, (i2c_batch_t*)next->data);
+    }
+    if (done->callback != NULL) {
+        done->callback(done);
+    }
+}
+
+/*
+ * What follows the current transfer once its last byte is on its way: a
+ * repeated START for the next transfer of the batch, or the batch's STOP.
+ */
+static void end_condition(i2c_bus_t* bus)
+{
+    REG_SET(bus->regs->CR1, (bus->transfer->node.next != NULL) ? I2C_CR1_START : I2C_CR1_STOP);
+}
+
+static void transfer_done(i2c_bus_t* bus, status_t result)
+{
+    i2c_transfer_t* transfer = bus->transfer;
+    transfer->result = result;
+    if (result == SUCCESS) {
+        STAT_INC(bus->stats.transfers);
+        STAT_ADD(bus->stats.bytes, (uint32_t)transfer->write_length + transfer->read_length);
+    } else {
+        bus->batch->failed++;
+    }
+    if (transfer->node.next != NULL) {
+        begin_transfer(bus, (i2c_transfer_t*)transfer->node.next->data);
+    } else {
+        batch_done(bus);
+    }
+}
+
+/* Fails the current transfer and the rest of the batch, without a callback */
+static void fail_remaining(i2c_batch_t* batch, i2c_transfer_t* transfer)
+{
+    for (node_t* node = &transfer->node; node != NULL; node = node->next) {
+        ((i2c_transfer_t*)node->data)->result = FAILURE;
+        batch->failed++;
+    }
+}
+
+/* Bus error, lost arbitration, DMA error or timeout; called with interrupts masked */
+static void recover(i2c_bus_t* bus)
+{
+    STAT_INC(bus->stats.recoveries);
+    dma_stop(&bus->tx_dma);
+    dma_stop(&bus->rx_dma);
+    bus_clear(bus);
+    if (bus->batch != NULL) {
+        fail_remaining(bus->batch, bus->transfer);
+        batch_done(bus);
+    }
+}
+
+void i2c_batch_init(i2c_batch_t* batch, i2c_callback_t callback, void* context)
+{
+    ll_list_init(&batch->transfers);
+    batch->failed = 0;
+    batch->callback = callback;
+    batch->context = context;
+}
+
+status_t i2c_batch_add(i2c_batch_t* batch, i2c_transfer_t* transfer)
+{
+    if (batch == NULL || transfer == NULL || (transfer->write_length == 0U && transfer->read_length == 0U) ||
+        (transfer->write_length != 0U && transfer->write == NULL) ||
+        (transfer->read_length != 0U && transfer->read == NULL) || transfer->address > 0x7FU) {
+        return FAILURE;
+    }
+    transfer->node.data = transfer;
+    transfer->result = FAILURE;
+    return ll_list_insert_at_tail(&batch->transfers, &transfer->node);
+}
+
+status_t i2c_submit(i2c_bus_t* bus, i2c_batch_t* batch)
+{
+    if (bus == NULL || batch == NULL || bus->regs == NULL || batch->transfers.head == NULL) {
+        return FAILURE;
+    }
+    batch->node.data = batch;
+    batch->failed = 0;
+
+    uint32_t primask = hal_irq_mask();
+    if (bus->batch == NULL) {
+        start_batch(bus, batch);
+    } else {
+        ll_list_insert_at_tail(&bus->queue, &batch->node);
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+uint8_t i2c_busy(const i2c_bus_t* bus)
+{
+    return bus->batch != NULL;
+}
+
+/* ----------------------------------------------------------- interrupts --- */
+
+/* EV6: the address was acknowledged; the flag clears on the SR2 read, after which the data phase starts */
+static void address_acknowledged(i2c_bus_t* bus, i2c_transfer_t* transfer)
+{
+    i2c_regs_t* regs = bus->regs;
+    if (!bus->reading) {
+        if (transfer->write_length >= I2C_DMA_MIN) {
+            REG_SET(regs->CR2, I2C_CR2_DMAEN);
+            dma_start(&bus->tx_dma, (uintptr_t)&regs->DR, (void*)(uintptr_t)transfer->write, transfer->write_length);
+        } else {
+            REG_SET(regs->CR2, I2C_CR2_ITBUFEN);
+        }
+        (void)REG_READ(regs->SR2);
+    } else if (transfer->read_length == 1U) {
+        /* EV6_3: NACK and the end condition have to be set before the byte arrives */
+        REG_CLEAR(regs->CR1, I2C_CR1_ACK);
+        (void)REG_READ(regs->SR2);
+        end_condition(bus);
+        REG_SET(regs->CR2, I2C_CR2_ITBUFEN);
+    } else {
+        /* LAST makes the hardware NACK the byte that completes the stream */
+        REG_SET(regs->CR1, I2C_CR1_ACK);
+        REG_SET(regs->CR2, I2C_CR2_DMAEN | I2C_CR2_LAST);
+        dma_start(&bus->rx_dma, (uintptr_t)&regs->DR, transfer->read, transfer->read_length);
+        (void)REG_READ(regs->SR2);
+    }
+}
+
+/* EV8_2: the last written byte has been acknowledged */
+static void write_finished(i2c_bus_t* bus, i2c_transfer_t* transfer)
+{
+    REG_CLEAR(bus->regs->CR2, I2C_CR2_DMAEN);
+    if (transfer->read_length != 0U) {
+        bus->reading = 1;
+        REG_SET(bus->regs->CR1, I2C_CR1_START);
+    } else {
+        end_condition(bus);
+        transfer_done(bus, SUCCESS);
+    }
+}
+
+void i2c_ev_irq(uint8_t instance)
+{
+    i2c_bus_t* bus = buses[instance - 1U];
+    if (bus == NULL) {
+        return;
+    }
+    uint32_t primask = hal_irq_mask();
+    i2c_regs_t* regs = bus->regs;
+    i2c_transfer_t* transfer = bus->transfer;
+    uint32_t sr1 = REG_READ(regs->SR1);
+    STAT_INC(bus->stats.interrupts);
+    bus->idle_ticks = 0;
+
+    if (transfer == NULL) {
+        /* Nothing in progress: a late flag from an aborted transfer */
+    } else if (sr1 & I2C_SR1_SB) {
+        REG_WRITE(regs->DR, ((uint32_t)transfer->address << 1) | bus->reading);
+    } else if (sr1 & I2C_SR1_ADDR) {
+        address_acknowledged(bus, transfer);
+    } else if (bus->reading) {
+        if (sr1 & I2C_SR1_RXNE) {
+            transfer->read[0] = (uint8_t)REG_READ(regs->DR);
+            REG_CLEAR(regs->CR2, I2C_CR2_ITBUFEN);
+            transfer_done(bus, SUCCESS);
+        }
+    } else if ((sr1 & I2C_SR1_TXE) && (REG_READ(regs->CR2) & I2C_CR2_ITBUFEN)) {
+        REG_WRITE(regs->DR, transfer->write[bus->index++]);
+        if (bus->index == transfer->write_length) {
+            REG_CLEAR(regs->CR2, I2C_CR2_ITBUFEN);
+        }
+    } else if (sr1 & I2C_SR1_BTF) {
+        write_finished(bus, transfer);
+    }
+    hal_irq_restore(primask);
+}
+
+void i2c_er_irq(uint8_t instance)
+{
+    i2c_bus_t* bus = buses[instance - 1U];
+    if (bus == NULL) {
+        return;
+    }
+    uint32_t primask = hal_irq_mask();
+    i2c_regs_t* regs = bus->regs;
+    uint32_t sr1 = REG_READ(regs->SR1);
+    STAT_INC(bus->stats.interrupts);
+    bus->idle_ticks = 0;
+
+    /* Error flags clear by writing 0 to them */
+    REG_WRITE(regs->SR1, sr1 & ~(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF));
+    if (sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO)) {
+        if (sr1 & I2C_SR1_BERR) {
+            STAT_INC(bus->stats.bus_errors);
+        }
+        if (sr1 & I2C_SR1_ARLO) {
+            STAT_INC(bus->stats.arbitration_lost);
+        }
+        recover(bus);
+    } else if ((sr1 & I2C_SR1_AF) && bus->transfer != NULL) {
+        /* The device refused its address or a byte: only this transfer fails */
+        STAT_INC(bus->stats.nacks);
+        dma_stop(&bus->tx_dma);
+        dma_stop(&bus->rx_dma);
+        REG_CLEAR(regs->CR2, I2C_CR2_DMAEN | I2C_CR2_LAST | I2C_CR2_ITBUFEN);
+        end_condition(bus);
+        transfer_done(bus, FAILURE);
+    }
+    hal_irq_restore(primask);
+}
+
+static void rx_dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    i2c_bus_t* bus = (i2c_bus_t*)context;
+    uint32_t primask = hal_irq_mask();
+    if (event == DMA_EVENT_ERROR) {
+        recover(bus);
+    } else if (event == DMA_EVENT_COMPLETE && bus->transfer != NULL) {
+        /* EV7_1 is handled by LAST; the STOP or repeated START goes in the DMA end-of-transfer interrupt */
+        REG_CLEAR(bus->regs->CR2, I2C_CR2_DMAEN | I2C_CR2_LAST);
+        end_condition(bus);
+        transfer_done(bus, SUCCESS);
+    }
+    hal_irq_restore(primask);
+}
+
+static void tx_dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    i2c_bus_t* bus = (i2c_bus_t*)context;
+    /* A write ends at BTF, once its last byte is acknowledged, not when the stream has emptied */
+    if (event == DMA_EVENT_ERROR) {
+        uint32_t primask = hal_irq_mask();
+        recover(bus);
+        hal_irq_restore(primask);
+    }
+}
+
+void i2c_tick(uint32_t ticks)
+{
+    for (uint32_t i = 0; i < I2C_INSTANCES; i++) {
+        uint32_t primask = hal_irq_mask();
+        i2c_bus_t* bus = buses[i];
+        if (bus != NULL && bus->batch != NULL) {
+            bus->idle_ticks += ticks;
+            if (bus->idle_ticks >= bus->config.timeout_ticks) {
+                STAT_INC(bus->stats.timeouts);
+                recover(bus);
+            }
+        }
+        hal_irq_restore(primask);
+    }
+}
+
+/* ------------------------------------------------------------- control --- */
+
+static status_t claim_streams(i2c_bus_t* bus, const i2c_instance_t* info)
+{
+    dma_config_t dma_config;
+    memset(&dma_config, 0, sizeof(dma_config));
+    dma_config.channel = info->dma_channel;
+    dma_config.priority = 1;
+    dma_config.direction = DMA_PERIPH_TO_MEMORY;
+    dma_config.mode = DMA_MODE_NORMAL;
+    dma_config.peripheral_size = 1;
+    dma_config.memory_size = 1;
+    dma_config.memory_increment = 1;
+    dma_config.callback = rx_dma_event;
+    dma_config.context = bus;
+    if (dma_stream_init(&bus->rx_dma, 1, info->rx_stream, &dma_config) != SUCCESS) {
+        return FAILURE;
+    }
+
+    dma_config.direction = DMA_MEMORY_TO_PERIPH;
+    dma_config.callback = tx_dma_event;
+    if (dma_stream_init(&bus->tx_dma, 1, info->tx_stream, &dma_config) != SUCCESS) {
+        dma_stream_release(&bus->rx_dma);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+status_t i2c_init(i2c_bus_t* bus, uint8_t instance, const i2c_config_t* config)
+{
+    uint32_t ccr;
+    uint32_t trise;
+    if (bus == NULL || config == NULL || instance < 1U || instance > I2C_INSTANCES || config->timeout_ticks == 0U ||
+        config->scl.port >= HAL_GPIO_PORTS || config->scl.pin > 15U || config->sda.port >= HAL_GPIO_PORTS ||
+        config->sda.pin > 15U || timing(config->clock_hz, config->speed_hz, &ccr, &trise) != SUCCESS) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (buses[instance - 1U] != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    buses[instance - 1U] = bus;
+    hal_irq_restore(primask);
+
+    const i2c_instance_t* info = &instances[instance - 1U];
+    memset(bus, 0, sizeof(*bus));
+    bus->config = *config;
+    bus->instance = instance;
+    /* A loop iteration takes at least two cycles of a core at least as fast as PCLK1 */
+    bus->delay_loops = config->clock_hz / config->speed_hz / 4U;
+    if (claim_streams(bus, info) != SUCCESS) {
+        buses[instance - 1U] = NULL;
+        return FAILURE;
+    }
+    ll_list_init(&bus->queue);
+    bus->regs = instance_regs(instance);
+
+    REG_SET(HAL_RCC->APB1ENR, 1U << info->rcc_bit);
+    REG_SET(HAL_RCC->AHB1ENR, (1U << config->scl.port) | (1U << config->sda.port));
+    configure(bus);
+    hal_nvic_enable(info->ev_irqn);
+    hal_nvic_enable(info->er_irqn);
+    return SUCCESS;
+}
+
+void i2c_deinit(i2c_bus_t* bus)
+{
+    if (bus == NULL || bus->regs == NULL) {
+        return;
+    }
+    const i2c_instance_t* info = &instances[bus->instance - 1U];
+    hal_nvic_disable(info->ev_irqn);
+    hal_nvic_disable(info->er_irqn);
+
+    uint32_t primask = hal_irq_mask();
+    dma_stream_release(&bus->tx_dma);
+    dma_stream_release(&bus->rx_dma);
+    REG_WRITE(bus->regs->CR2, 0);
+    REG_WRITE(bus->regs->CR1, 0);
+    buses[bus->instance - 1U] = NULL;
+    bus->regs = NULL; /* Callbacks submitting from here on are refused */
+
+    i2c_batch_t* cancelled = bus->batch;
+    i2c_transfer_t* from = bus->transfer;
+    bus->batch = NULL;
+    bus->transfer = NULL;
+    /* The queue is only ever non-empty behind a batch in progress */
+    while (cancelled != NULL) {
+        fail_remaining(cancelled, from);
+        if (cancelled->callback != NULL) {
+            cancelled->callback(cancelled);
+        }
+        node_t* next = ll_list_remove_head(&bus->queue);
+        cancelled = (next != NULL) ? (i2c_batch_t*)next->data : NULL;
+        from = (cancelled != NULL) ? (i2c_transfer_t*)cancelled->transfers.head->data : NULL;
+    }
+    hal_irq_restore(primask);
+}
+
+const i2c_stats_t* i2c_get_stats(const i2c_bus_t* bus)
+{
+    return &bus->stats;
+}
+
+#if defined(STM32F407xx)
+void I2C1_EV_IRQHandler(void) { i2c_ev_irq(1); }
+void I2C1_ER_IRQHandler(void) { i2c_er_irq(1); }
+void I2C2_EV_IRQHandler(void) { i2c_ev_irq(2); }
+void I2C2_ER_IRQHandler(void) { i2c_er_irq(2); }
+void I2C3_EV_IRQHandler(void) { i2c_ev_irq(3); }
+void I2C3_ER_IRQHandler(void) { i2c_er_irq(3); }
+#endif
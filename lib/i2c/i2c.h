@@ -0,0 +1,287 @@
+#ifndef I2C_H
+#define I2C_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * I2C1-3 as bus masters, driven entirely from the event and error
+ * interrupts with DMA for payloads.
+ *
+ * The unit of work is a batch: a list of transfers, each one an optional
+ * write to a device followed by an optional read from it (the common
+ * "write the register address, read the register" access). A batch holds
+ * the bus from its first START to its one STOP: the transfers follow each
+ * other with repeated STARTs, whatever device each one addresses, and the
+ * batch's callback runs once, when the last transfer has finished. Reading
+ * a dozen sensor registers across several devices is then one submit, one
+ * STOP and one wakeup. Batches queue behind each other and are started
+ * from the interrupt that completes the previous one.
+ *
+ * Reads of two bytes or more and writes of I2C_DMA_MIN bytes or more use
+ * the DMA (with LAST, so the hardware NACKs the final byte itself);
+ * shorter payloads are moved by the event interrupt, which costs less
+ * than setting up a stream.
+ *
+ * A device that does not acknowledge its address or a written byte fails
+ * only its own transfer; the batch carries on. A bus error, lost
+ * arbitration or a bus that stops producing events for timeout_ticks
+ * (a device holding SCL low, a missed interrupt) fails the rest of the
+ * batch and recovers the bus: the peripheral is switched off, SCL is
+ * pulsed as a GPIO until a device holding SDA low lets go (at most nine
+ * pulses), a STOP is driven by hand and the peripheral is reset and
+ * reprogrammed. Recovery busy-waits for up to ten SCL periods, from the
+ * interrupt or tick that detected the fault.
+ */
+
+#define I2C_INSTANCES 3U
+
+/** Writes shorter than this are fed to DR by the event interrupt */
+#define I2C_DMA_MIN 4U
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t OAR1;
+    volatile uint32_t OAR2;
+    volatile uint32_t DR;
+    volatile uint32_t SR1;
+    volatile uint32_t SR2;
+    volatile uint32_t CCR;
+    volatile uint32_t TRISE;
+    volatile uint32_t FLTR;
+} i2c_regs_t;
+
+#if !defined(STM32F407xx)
+extern i2c_regs_t i2c_sim_regs[I2C_INSTANCES];
+#endif
+
+#define I2C1_REGS HAL_PERIPH(i2c_regs_t, 0x40005400U, i2c_sim_regs[0])
+#define I2C2_REGS HAL_PERIPH(i2c_regs_t, 0x40005800U, i2c_sim_regs[1])
+#define I2C3_REGS HAL_PERIPH(i2c_regs_t, 0x40005C00U, i2c_sim_regs[2])
+
+#define I2C_CR1_PE (1U << 0)
+#define I2C_CR1_START (1U << 8)
+#define I2C_CR1_STOP (1U << 9)
+#define I2C_CR1_ACK (1U << 10)
+#define I2C_CR1_SWRST (1U << 15)
+
+#define I2C_CR2_FREQ_Msk 0x3FU
+#define I2C_CR2_ITERREN (1U << 8)
+#define I2C_CR2_ITEVTEN (1U << 9)
+#define I2C_CR2_ITBUFEN (1U << 10)
+#define I2C_CR2_DMAEN (1U << 11)
+#define I2C_CR2_LAST (1U << 12)
+
+#define I2C_SR1_SB (1U << 0)
+#define I2C_SR1_ADDR (1U << 1)
+#define I2C_SR1_BTF (1U << 2)
+#define I2C_SR1_RXNE (1U << 6)
+#define I2C_SR1_TXE (1U << 7)
+#define I2C_SR1_BERR (1U << 8)
+#define I2C_SR1_ARLO (1U << 9)
+#define I2C_SR1_AF (1U << 10)
+
+#define I2C_SR2_MSL (1U << 0)
+#define I2C_SR2_BUSY (1U << 1)
+#define I2C_SR2_TRA (1U << 2)
+
+#define I2C_CCR_FS (1U << 15)
+
+typedef struct {
+    node_t node;                /**< Link in the batch, see i2c_batch_add() */
+    uint8_t address;            /**< 7-bit device address */
+    status_t result;            /**< Set before the batch callback */
+    uint16_t write_length;      /**< Bytes of write, sent first; 0 for a plain read */
+    uint16_t read_length;       /**< Bytes of read, after a repeated START; 0 for a plain write */
+    const uint8_t* write;
+    uint8_t* read;
+} i2c_transfer_t;
+
+typedef struct i2c_batch i2c_batch_t;
+
+/** Called from interrupt context once every transfer of the batch has a result. */
+typedef void (*i2c_callback_t)(i2c_batch_t* batch);
+
+struct i2c_batch {
+    node_t node;                /**< Queue link, owned by the driver from submit to callback */
+    list_t transfers;
+    uint16_t failed;            /**< Transfers that ended in FAILURE */
+    i2c_callback_t callback;    /**< Optional */
+    void* context;              /**< For the callback */
+};
+
+typedef struct {
+    uint8_t port;               /**< 0-8 for GPIOA-GPIOI */
+    uint8_t pin;                /**< 0-15 */
+} i2c_pin_t;
+
+typedef struct {
+    uint32_t clock_hz;          /**< PCLK1, 2-42 MHz */
+    uint32_t speed_hz;          /**< SCL, up to 100 kHz standard mode or 400 kHz fast mode */
+    uint32_t timeout_ticks;     /**< Longest wait for a bus event, in i2c_tick() ticks */
+    i2c_pin_t scl;              /**< Set to the I2C alternate function, open drain, by the application */
+    i2c_pin_t sda;
+} i2c_config_t;
+
+typedef struct {
+    uint32_t batches;           /**< Completed, with or without failed transfers */
+    uint32_t transfers;         /**< Completed successfully */
+    uint32_t bytes;             /**< Written and read by successful transfers */
+    uint32_t nacks;             /**< Transfers failed by an unacknowledged address or byte */
+    uint32_t bus_errors;
+    uint32_t arbitration_lost;
+    uint32_t timeouts;
+    uint32_t recoveries;        /**< Bus clears, one per bus error, lost arbitration or timeout */
+    uint32_t interrupts;        /**< Event and error interrupts serviced */
+} i2c_stats_t;
+
+typedef struct {
+    i2c_regs_t* regs;
+    uint8_t instance;
+    uint8_t reading;            /**< The current transfer is in its read phase */
+    uint16_t index;             /**< Next byte of an interrupt-driven write */
+    uint32_t idle_ticks;        /**< Ticks since the last bus event of the current batch */
+    uint32_t delay_loops;       /**< Busy-wait iterations per half SCL period in a bus clear */
+    i2c_batch_t* batch;         /**< On the bus, NULL when idle */
+    i2c_transfer_t* transfer;   /**< Transfer of batch in progress */
+    list_t queue;
+    dma_stream_t rx_dma;
+    dma_stream_t tx_dma;
+    i2c_config_t config;
+    i2c_stats_t stats;
+} i2c_bus_t;
+
+/** Empties a batch for reuse. */
+void i2c_batch_init(i2c_batch_t* batch, i2c_callback_t callback, void* context);
+
+/**
+ * @brief Appends a transfer to a batch that has not been submitted.
+ *
+ * @return FAILURE if the transfer moves no bytes, or reads or writes
+ * without a buffer.
+ */
+status_t i2c_batch_add(i2c_batch_t* batch, i2c_transfer_t* transfer);
+
+/**
+ * @brief Configures an instance as master.
+ *
+ * @param instance 1-3.
+ * @return FAILURE if the configuration is invalid (clock out of range, SCL
+ * above 400 kHz, no timeout), the instance is in use or one of its DMA
+ * streams is taken.
+ */
+status_t i2c_init(i2c_bus_t* bus, uint8_t instance, const i2c_config_t* config);
+
+/**
+ * @brief Stops the bus and releases the DMA streams; the batch in progress
+ * and every queued one complete with all their remaining transfers failed.
+ */
+void i2c_deinit(i2c_bus_t* bus);
+
+/**
+ * @brief Queues a batch, starting it if the bus is idle. The driver owns the
+ * batch and its transfers until the callback. Safe from any context,
+ * including callbacks.
+ *
+ * @return FAILURE for an empty batch or an instance that is not running.
+ */
+status_t i2c_submit(i2c_bus_t* bus, i2c_batch_t* batch);
+
+/** Whether a batch is in progress or queued. */
+uint8_t i2c_busy(const i2c_bus_t* bus);
+
+/**
+ * @brief Advances the bus timeouts of every instance; call from the tick
+ * handler with the ticks elapsed.
+ */
+void i2c_tick(uint32_t ticks);
+
+/** Event interrupt body; the I2Cn_EV_IRQHandler vectors call this. */
+void i2c_ev_irq(uint8_t instance);
+
+/** Error interrupt body; the I2Cn_ER_IRQHandler vectors call this. */
+void i2c_er_irq(uint8_t instance);
+
+const i2c_stats_t* i2c_get_stats(const i2c_bus_t* bus);
+
+#if !defined(STM32F407xx)
+/*
+ * Host model of the peripheral and the bus. Time advances in SCL periods:
+ * one for a START or a STOP, nine for a byte and its acknowledge bit. The
+ * model raises SB, ADDR, TXE, RXNE, BTF and AF in the order RM0090 (27.3.3)
+ * gives for master transmitter and receiver, at the SCL period they occur
+ * in, and runs the event, error and DMA interrupts there; the flags the
+ * driver clears by reading SR1 and SR2 are cleared by the model once the
+ * interrupt returns. Each bus action is logged with its period.
+ */
+
+/** A device on the bus: a register file addressed by the first byte written. */
+typedef struct {
+    uint8_t address;            /**< 7-bit */
+    uint8_t nack_data;          /**< Acknowledges its address but NACKs written bytes */
+    uint8_t hold;               /**< Holds SCL low after its address: the bus stops */
+    uint16_t size;
+    uint16_t pointer;           /**< Register read or written next */
+    uint8_t* memory;
+} i2c_sim_device_t;
+
+typedef enum {
+    I2C_SIM_START = 0,
+    I2C_SIM_ADDRESS,            /**< data is the address byte, R/W in bit 0 */
+    I2C_SIM_WRITE,
+    I2C_SIM_READ,
+    I2C_SIM_STOP,
+} i2c_sim_action_t;
+
+typedef struct {
+    uint32_t cycle;             /**< SCL period the action ended in */
+    uint8_t action;             /**< i2c_sim_action_t */
+    uint8_t data;
+    uint8_t ack;                /**< For ADDRESS, WRITE and READ: the ninth bit was an ACK */
+} i2c_sim_trace_t;
+
+typedef struct {
+    i2c_sim_device_t* devices;
+    uint8_t device_count;
+    uint8_t sda_stuck;          /**< SCL pulses until a device releases SDA; 0 when released */
+    i2c_sim_trace_t* trace;     /**< Optional log */
+    uint32_t trace_size;
+    uint32_t trace_count;
+    uint64_t cycles;            /**< SCL periods since attach */
+    /* Bus state, managed by the model */
+    uint8_t state;
+    uint8_t write_started;      /**< The device's register pointer has been written this transfer */
+    i2c_sim_device_t* device;   /**< Addressed device */
+} i2c_sim_t;
+
+/** Host model: puts the model on the bus of an initialised instance, with SCL and SDA high. */
+void i2c_sim_attach(i2c_bus_t* bus, i2c_sim_t* sim);
+
+/**
+ * @brief Host model: runs the bus for up to max_cycles SCL periods, or until
+ * it is idle with nothing to do or stalled.
+ *
+ * @return SCL periods that passed.
+ */
+uint64_t i2c_sim_run(i2c_bus_t* bus, uint64_t max_cycles);
+
+/** Host model: the peripheral raises the given SR1 error flags (BERR, ARLO). */
+void i2c_sim_error(i2c_bus_t* bus, uint32_t errors);
+
+/* Hooks used by i2c.c in place of the devices watching the pins during a bus clear */
+void i2c_sim_scl_pulse(uint8_t instance);
+void i2c_sim_manual_stop(uint8_t instance);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // I2C_H
@@ -0,0 +1,304 @@
+#include "i2c.h"
+#include <stddef.h>
+
+#if !defined(STM32F407xx)
+
+/* DR holds bytes; a value above 0xFF stands for "not written since the model emptied it" */
+#define DR_EMPTY 0x100U
+
+enum {
+    STATE_IDLE = 0,
+    STATE_ADDRESS,  /* START sent, SB raised, waiting for the address in DR */
+    STATE_TRANSMIT,
+    STATE_RECEIVE,
+    STATE_HOLD,     /* Byte boundary after a NACK, waiting for STOP or START */
+    STATE_STALLED,  /* A device holds SCL low */
+};
+
+static i2c_sim_t* models[I2C_INSTANCES];
+static i2c_bus_t* attached[I2C_INSTANCES];
+
+static void trace(i2c_sim_t* sim, uint8_t action, uint8_t data, uint8_t ack)
+{
+    if (sim->trace != NULL && sim->trace_count < sim->trace_size) {
+        i2c_sim_trace_t* entry = &sim->trace[sim->trace_count++];
+        entry->cycle = (uint32_t)sim->cycles;
+        entry->action = action;
+        entry->data = data;
+        entry->ack = ack;
+    }
+}
+
+/* TXE and RXNE interrupt only with ITBUFEN as well as ITEVTEN */
+static void raise_event(i2c_bus_t* bus, uint32_t flags, uint8_t buffer)
+{
+    i2c_regs_t* regs = bus->regs;
+    uint32_t needed = I2C_CR2_ITEVTEN | (buffer ? I2C_CR2_ITBUFEN : 0U);
+    regs->SR1 |= flags;
+    if ((regs->CR2 & needed) == needed) {
+        i2c_ev_irq(bus->instance);
+    }
+}
+
+static void raise_error(i2c_bus_t* bus, uint32_t flags)
+{
+    bus->regs->SR1 |= flags;
+    if (bus->regs->CR2 & I2C_CR2_ITERREN) {
+        i2c_er_irq(bus->instance);
+    }
+}
+
+static i2c_sim_device_t* find(i2c_sim_t* sim, uint8_t address)
+{
+    for (uint32_t i = 0; i < sim->device_count; i++) {
+        if (sim->devices[i].address == address) {
+            return &sim->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t stream_enabled(const dma_stream_t* stream)
+{
+    return (stream->regs->CR & DMA_SxCR_EN) != 0U;
+}
+
+/* TXE is up: the DMA or the driver may refill DR */
+static void request_byte(i2c_bus_t* bus)
+{
+    i2c_regs_t* regs = bus->regs;
+    if ((regs->CR2 & I2C_CR2_DMAEN) && stream_enabled(&bus->tx_dma)) {
+        uint8_t byte;
+        if (dma_sim_drain(bus->tx_dma.controller_index, bus->tx_dma.stream_index, &byte, 1) == 1U) {
+            regs->DR = byte;
+        }
+    } else {
+        raise_event(bus, I2C_SR1_TXE, 1);
+    }
+    if (regs->DR != DR_EMPTY) {
+        regs->SR1 &= ~I2C_SR1_TXE;
+    }
+}
+
+static uint8_t device_write(i2c_sim_t* sim, uint8_t byte)
+{
+    i2c_sim_device_t* device = sim->device;
+    if (device->nack_data) {
+        return 0;
+    }
+    if (!sim->write_started) {
+        device->pointer = byte;
+        sim->write_started = 1;
+    } else if (device->pointer < device->size) {
+        device->memory[device->pointer++] = byte;
+    }
+    return 1;
+}
+
+static uint8_t device_read(i2c_sim_t* sim)
+{
+    i2c_sim_device_t* device = sim->device;
+    return (device->pointer < device->size) ? device->memory[device->pointer++] : 0xFFU;
+}
+
+void i2c_sim_attach(i2c_bus_t* bus, i2c_sim_t* sim)
+{
+    models[bus->instance - 1U] = sim;
+    attached[bus->instance - 1U] = bus;
+    sim->state = STATE_IDLE;
+    sim->device = NULL;
+    sim->cycles = 0;
+    sim->trace_count = 0;
+    bus->regs->DR = DR_EMPTY;
+    bus->regs->SR1 = 0;
+    bus->regs->SR2 = 0;
+    hal_sim_gpio[bus->config.scl.port].IDR |= 1U << bus->config.scl.pin;
+    if (sim->sda_stuck) {
+        hal_sim_gpio[bus->config.sda.port].IDR &= ~(1U << bus->config.sda.pin);
+    } else {
+        hal_sim_gpio[bus->config.sda.port].IDR |= 1U << bus->config.sda.pin;
+    }
+}
+
+/* One bus step; returns 0 when nothing can happen until something outside the model changes */
+static uint8_t step(i2c_bus_t* bus, i2c_sim_t* sim)
+{
+    i2c_regs_t* regs = bus->regs;
+    uint32_t cr1 = regs->CR1;
+    if ((cr1 & I2C_CR1_PE) == 0U) {
+        return 0;
+    }
+
+    /* STOP and START go out between bytes: after a NACK, or once a write has drained (BTF) */
+    uint8_t boundary = sim->state == STATE_IDLE || sim->state == STATE_HOLD ||
+                       (sim->state == STATE_TRANSMIT && (regs->SR1 & I2C_SR1_BTF));
+    if (boundary && (cr1 & I2C_CR1_STOP) && sim->state != STATE_IDLE) {
+        regs->CR1 &= ~I2C_CR1_STOP;
+        sim->cycles += 1U;
+        trace(sim, I2C_SIM_STOP, 0, 0);
+        regs->SR1 &= ~(I2C_SR1_BTF | I2C_SR1_TXE);
+        regs->SR2 = 0;
+        sim->state = STATE_IDLE;
+        sim->device = NULL;
+        return 1;
+    }
+    if (boundary && (cr1 & I2C_CR1_START)) {
+        regs->CR1 &= ~I2C_CR1_START;
+        sim->cycles += 1U;
+        trace(sim, I2C_SIM_START, 0, 0);
+        regs->SR1 &= ~(I2C_SR1_BTF | I2C_SR1_TXE);
+        regs->SR2 |= I2C_SR2_MSL | I2C_SR2_BUSY;
+        regs->DR = DR_EMPTY;
+        sim->state = STATE_ADDRESS;
+        /* EV5: SB clears when the driver writes the address */
+        raise_event(bus, I2C_SR1_SB, 0);
+        if (regs->DR != DR_EMPTY) {
+            regs->SR1 &= ~I2C_SR1_SB;
+        }
+        return 1;
+    }
+
+    switch (sim->state) {
+    case STATE_ADDRESS: {
+        if (regs->DR == DR_EMPTY) {
+            return 0;
+        }
+        uint8_t byte = (uint8_t)regs->DR;
+        regs->DR = DR_EMPTY;
+        regs->SR1 &= ~I2C_SR1_SB;
+        sim->cycles += 9U;
+        sim->device = find(sim, byte >> 1);
+        trace(sim, I2C_SIM_ADDRESS, byte, sim->device != NULL);
+        if (sim->device == NULL) {
+            sim->state = STATE_HOLD;
+            raise_error(bus, I2C_SR1_AF);
+            return 1;
+        }
+        if (sim->device->hold) {
+            sim->state = STATE_STALLED;
+            return 0;
+        }
+        sim->write_started = 0;
+        if (byte & 1U) {
+            sim->state = STATE_RECEIVE;
+            regs->SR2 &= ~I2C_SR2_TRA;
+        } else {
+            sim->state = STATE_TRANSMIT;
+            regs->SR2 |= I2C_SR2_TRA;
+            regs->SR1 |= I2C_SR1_TXE;
+        }
+        /* EV6: the driver's SR1-then-SR2 read clears ADDR */
+        raise_event(bus, I2C_SR1_ADDR, 0);
+        regs->SR1 &= ~I2C_SR1_ADDR;
+        return 1;
+    }
+
+    case STATE_TRANSMIT: {
+        if (regs->DR == DR_EMPTY) {
+            request_byte(bus);
+        }
+        if (regs->DR == DR_EMPTY) {
+            if (regs->SR1 & I2C_SR1_BTF) {
+                return 0; /* SCL is stretched until DR, STOP or START is written */
+            }
+            /* EV8_2: shift register and DR both empty */
+            raise_event(bus, I2C_SR1_BTF, 0);
+            return 1;
+        }
+        uint8_t byte = (uint8_t)regs->DR;
+        regs->DR = DR_EMPTY;
+        regs->SR1 = (regs->SR1 & ~I2C_SR1_BTF) | I2C_SR1_TXE;
+        /* EV8: the next byte is asked for as soon as this one moves into the shift register */
+        request_byte(bus);
+        sim->cycles += 9U;
+        uint8_t ack = device_write(sim, byte);
+        trace(sim, I2C_SIM_WRITE, byte, ack);
+        if (!ack) {
+            sim->state = STATE_HOLD;
+            regs->DR = DR_EMPTY;
+            raise_error(bus, I2C_SR1_AF);
+        }
+        return 1;
+    }
+
+    case STATE_RECEIVE: {
+        if (regs->SR1 & I2C_SR1_RXNE) {
+            return 0; /* The previous byte has not been read: SCL is stretched */
+        }
+        uint8_t dma = (regs->CR2 & I2C_CR2_DMAEN) && stream_enabled(&bus->rx_dma);
+        uint8_t ack = (regs->CR1 & I2C_CR1_ACK) &&
+                      !(dma && (regs->CR2 & I2C_CR2_LAST) && bus->rx_dma.regs->NDTR == 1U);
+        sim->cycles += 9U;
+        uint8_t byte = device_read(sim);
+        trace(sim, I2C_SIM_READ, byte, ack);
+        if (!ack) {
+            sim->state = STATE_HOLD;
+        }
+        regs->DR = byte;
+        regs->SR1 |= I2C_SR1_RXNE;
+        if (dma) {
+            dma_sim_transfer(bus->rx_dma.controller_index, bus->rx_dma.stream_index, &byte, 1);
+            regs->SR1 &= ~I2C_SR1_RXNE;
+        } else if ((regs->CR2 & (I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN)) == (I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN)) {
+            /* EV7: the driver reads DR */
+            raise_event(bus, 0, 1);
+            regs->SR1 &= ~I2C_SR1_RXNE;
+        }
+        return 1;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+uint64_t i2c_sim_run(i2c_bus_t* bus, uint64_t max_cycles)
+{
+    i2c_sim_t* sim = (bus->regs != NULL) ? models[bus->instance - 1U] : NULL;
+    if (sim == NULL) {
+        return 0;
+    }
+    uint64_t start = sim->cycles;
+    while (sim->cycles - start < max_cycles && step(bus, sim)) {
+    }
+    return sim->cycles - start;
+}
+
+void i2c_sim_error(i2c_bus_t* bus, uint32_t errors)
+{
+    if (bus->regs != NULL) {
+        raise_error(bus, errors & (I2C_SR1_BERR | I2C_SR1_ARLO));
+    }
+}
+
+void i2c_sim_scl_pulse(uint8_t instance)
+{
+    i2c_sim_t* sim = models[instance - 1U];
+    if (sim == NULL) {
+        return;
+    }
+    sim->cycles += 1U;
+    if (sim->sda_stuck != 0U && --sim->sda_stuck == 0U) {
+        const i2c_pin_t* sda = &attached[instance - 1U]->config.sda;
+        hal_sim_gpio[sda->port].IDR |= 1U << sda->pin;
+    }
+}
+
+void i2c_sim_manual_stop(uint8_t instance)
+{
+    i2c_sim_t* sim = models[instance - 1U];
+    if (sim == NULL) {
+        return;
+    }
+    /* Every device drops what it was doing; SWRST clears the status registers */
+    sim->cycles += 1U;
+    trace(sim, I2C_SIM_STOP, 0, 0);
+    sim->state = STATE_IDLE;
+    sim->device = NULL;
+    i2c_regs_t* regs = attached[instance - 1U]->regs;
+    regs->SR1 = 0;
+    regs->SR2 = 0;
+    regs->DR = DR_EMPTY;
+}
+
+#endif
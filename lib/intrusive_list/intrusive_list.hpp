@@ -0,0 +1,343 @@
+#ifndef INTRUSIVE_LIST_HPP
+#define INTRUSIVE_LIST_HPP
+
+#include "linked_list.h"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+/*
+ * Typed, allocation-free views over node_t chains.
+ *
+ * An element embeds a node_t hook and is linked through it, so the same
+ * object can be handed to C code as a node_t* and recovered as a T& from
+ * C++ without a void* round trip. Converting between the two adds or
+ * subtracts the hook's offsetof, a compile-time constant. Nothing here
+ * throws, allocates or needs RTTI, so it builds with -fno-exceptions
+ * -fno-rtti.
+ */
+
+/**
+ * @brief Template arguments naming the hook of an element type, as in
+ * ll::intrusive_list<LL_HOOK(event, hook)>.
+ */
+#define LL_HOOK(T, member) T, ::ll::hook_offset<T, decltype(T::member)>(offsetof(T, member))
+
+namespace ll {
+
+/**
+ * @brief Offset of a hook inside its element, checked to be a node_t in a
+ * standard-layout type, the only kind offsetof is defined for. Use through
+ * LL_HOOK.
+ */
+template <typename T, typename Member>
+constexpr std::size_t hook_offset(std::size_t offset) noexcept
+{
+    static_assert(std::is_same<Member, node_t>::value, "the hook must be a node_t member");
+    static_assert(std::is_standard_layout<T>::value, "offsetof needs a standard-layout element type");
+    return offset;
+}
+
+/**
+ * @brief Maps between an element and its embedded node_t hook.
+ *
+ * @tparam T Element type.
+ * @tparam Offset Byte offset of the node_t member used for linking.
+ */
+template <typename T, std::size_t Offset>
+struct hook_traits {
+    static constexpr std::size_t offset = Offset;   /**< Byte offset of the hook inside T */
+
+    /**
+     * @brief Returns the hook embedded in an element.
+     */
+    static constexpr node_t* to_node(T& element) noexcept
+    {
+        return reinterpret_cast<node_t*>(reinterpret_cast<char*>(&element) + Offset);
+    }
+
+    /**
+     * @brief Returns the element that embeds a hook.
+     */
+    static constexpr T* from_node(node_t* node) noexcept
+    {
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(node) - Offset);
+    }
+};
+
+/**
+ * @brief Forward iterator over a node_t chain yielding T&.
+ */
+template <typename T, std::size_t Offset>
+class intrusive_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    constexpr intrusive_iterator() noexcept
+        : node_(nullptr)
+    {
+    }
+
+    constexpr explicit intrusive_iterator(node_t* node) noexcept
+        : node_(node)
+    {
+    }
+
+    reference operator*() const noexcept
+    {
+        return *hook_traits<T, Offset>::from_node(node_);
+    }
+
+    pointer operator->() const noexcept
+    {
+        return hook_traits<T, Offset>::from_node(node_);
+    }
+
+    intrusive_iterator& operator++() noexcept
+    {
+        node_ = node_->next;
+        return *this;
+    }
+
+    intrusive_iterator operator++(int) noexcept
+    {
+        intrusive_iterator previous = *this;
+        node_ = node_->next;
+        return previous;
+    }
+
+    constexpr node_t* node() const noexcept
+    {
+        return node_;
+    }
+
+    friend constexpr bool operator==(const intrusive_iterator& a, const intrusive_iterator& b) noexcept
+    {
+        return a.node_ == b.node_;
+    }
+
+    friend constexpr bool operator!=(const intrusive_iterator& a, const intrusive_iterator& b) noexcept
+    {
+        return a.node_ != b.node_;
+    }
+
+private:
+    node_t* node_;
+};
+
+/**
+ * @brief Non-owning typed view over an existing node_t chain, e.g. the list
+ * returned by ll_get_head().
+ */
+template <typename T, std::size_t Offset>
+class intrusive_range {
+public:
+    using iterator = intrusive_iterator<T, Offset>;
+
+    constexpr explicit intrusive_range(node_t* first) noexcept
+        : first_(first)
+    {
+    }
+
+    constexpr iterator begin() const noexcept
+    {
+        return iterator(first_);
+    }
+
+    constexpr iterator end() const noexcept
+    {
+        return iterator();
+    }
+
+private:
+    node_t* first_;
+};
+
+/**
+ * @brief Singly linked intrusive list with O(1) push at both ends.
+ *
+ * The list owns no memory; elements must outlive their membership. The
+ * chain stays a plain NULL-terminated node_t list, so head() can be passed
+ * to C code that walks node_t::next.
+ *
+ * @tparam T Element type.
+ * @tparam Offset Byte offset of the node_t member used for linking; see LL_HOOK.
+ */
+template <typename T, std::size_t Offset>
+class intrusive_list {
+public:
+    using traits = hook_traits<T, Offset>;
+    using iterator = intrusive_iterator<T, Offset>;
+
+    constexpr intrusive_list() noexcept
+        : head_(nullptr)
+        , tail_(nullptr)
+        , size_(0)
+    {
+    }
+
+    intrusive_list(const intrusive_list&) = delete;
+    intrusive_list& operator=(const intrusive_list&) = delete;
+
+    constexpr bool empty() const noexcept
+    {
+        return head_ == nullptr;
+    }
+
+    constexpr std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    T& front() const noexcept
+    {
+        return *traits::from_node(head_);
+    }
+
+    T& back() const noexcept
+    {
+        return *traits::from_node(tail_);
+    }
+
+    void push_front(T& element) noexcept
+    {
+        node_t* node = traits::to_node(element);
+        node->next = head_;
+        head_ = node;
+        if (tail_ == nullptr) {
+            tail_ = node;
+        }
+        size_++;
+    }
+
+    void push_back(T& element) noexcept
+    {
+        node_t* node = traits::to_node(element);
+        node->next = nullptr;
+        if (tail_ == nullptr) {
+            head_ = node;
+        } else {
+            tail_->next = node;
+        }
+        tail_ = node;
+        size_++;
+    }
+
+    /**
+     * @brief Links element after position, or at the front when position is nullptr.
+     */
+    void insert_after(T* position, T& element) noexcept
+    {
+        if (position == nullptr) {
+            push_front(element);
+            return;
+        }
+        node_t* previous = traits::to_node(*position);
+        node_t* node = traits::to_node(element);
+        node->next = previous->next;
+        previous->next = node;
+        if (tail_ == previous) {
+            tail_ = node;
+        }
+        size_++;
+    }
+
+    /**
+     * @brief Unlinks and returns the first element, or nullptr when empty.
+     */
+    T* pop_front() noexcept
+    {
+        if (head_ == nullptr) {
+            return nullptr;
+        }
+        node_t* node = head_;
+        head_ = node->next;
+        if (head_ == nullptr) {
+            tail_ = nullptr;
+        }
+        node->next = nullptr;
+        size_--;
+        return traits::from_node(node);
+    }
+
+    /**
+     * @brief Unlinks an element; O(n) because the list is singly linked.
+     *
+     * @return true if the element was found and removed.
+     */
+    bool remove(T& element) noexcept
+    {
+        node_t* node = traits::to_node(element);
+        node_t* previous = nullptr;
+        for (node_t* current = head_; current != nullptr; current = current->next) {
+            if (current == node) {
+                if (previous == nullptr) {
+                    head_ = node->next;
+                } else {
+                    previous->next = node->next;
+                }
+                if (tail_ == node) {
+                    tail_ = previous;
+                }
+                node->next = nullptr;
+                size_--;
+                return true;
+            }
+            previous = current;
+        }
+        return false;
+    }
+
+    void clear() noexcept
+    {
+        head_ = nullptr;
+        tail_ = nullptr;
+        size_ = 0;
+    }
+
+    /**
+     * @brief Takes over a NULL-terminated node_t chain built by C code.
+     */
+    void adopt(node_t* first) noexcept
+    {
+        head_ = first;
+        tail_ = nullptr;
+        size_ = 0;
+        for (node_t* node = first; node != nullptr; node = node->next) {
+            tail_ = node;
+            size_++;
+        }
+    }
+
+    /**
+     * @brief First node of the chain, for C code that walks node_t::next.
+     */
+    constexpr node_t* head() const noexcept
+    {
+        return head_;
+    }
+
+    iterator begin() const noexcept
+    {
+        return iterator(head_);
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator();
+    }
+
+private:
+    node_t* head_;
+    node_t* tail_;
+    std::size_t size_;
+};
+
+} // namespace ll
+
+#endif // INTRUSIVE_LIST_HPP
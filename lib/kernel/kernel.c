@@ -0,0 +1,396 @@
+#include "kernel.h"
+#include "feature_hooks.h"
+#include "kernel_port.h"
+#include <stddef.h>
+#include <string.h>
+
+#if KERNEL_PRIORITIES > 32 || KERNEL_PRIORITIES < 2
+#error "KERNEL_PRIORITIES must be between 2 and 32"
+#endif
+
+#define KERNEL_TRACE_SWITCH 0x0301
+
+#define IDLE_PRIORITY 0U
+#define MIN_STACK_WORDS 32U
+
+#define THREAD_OF(n) ((kernel_thread_t*)(n)->data)
+#define MUTEX_OF(n) ((kernel_mutex_t*)(n)->data)
+
+kernel_thread_t* volatile kernel_current_thread;
+
+static list_t ready_lists[KERNEL_PRIORITIES];
+static uint32_t ready_mask;
+static list_t sleepers; /* Ordered by wake_tick */
+static volatile uint32_t tick_count;
+static uint8_t started;
+static kernel_stats_t stats;
+
+static kernel_thread_t idle_thread;
+static uint32_t idle_stack[KERNEL_IDLE_STACK_WORDS] __attribute__((aligned(8)));
+
+static void ready_insert(kernel_thread_t* thread)
+{
+    thread->state = KERNEL_THREAD_READY;
+    ll_list_insert_at_tail(&ready_lists[thread->priority], &thread->node);
+    ready_mask |= 1U << thread->priority;
+}
+
+static void ready_remove(kernel_thread_t* thread)
+{
+    list_t* list = &ready_lists[thread->priority];
+    ll_list_remove(list, &thread->node);
+    if (list->head == NULL) {
+        ready_mask &= ~(1U << thread->priority);
+    }
+}
+
+static kernel_thread_t* highest_ready(void)
+{
+    /* The idle thread is always ready, so the mask is never empty once initialised */
+    uint32_t priority = 31U - (uint32_t)__builtin_clz(ready_mask);
+    return THREAD_OF(ready_lists[priority].head);
+}
+
+static void reschedule(void)
+{
+    if (started && highest_ready() != kernel_current_thread) {
+        kernel_port_request_switch();
+    }
+}
+
+/* Wrap-safe: true if tick a is not after tick b */
+static inline int tick_reached(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) <= 0;
+}
+
+static void sleep_insert(kernel_thread_t* thread)
+{
+    node_t* prev = NULL;
+    for (node_t* n = sleepers.head; n != NULL && tick_reached(THREAD_OF(n)->wake_tick, thread->wake_tick);
+         n = n->next) {
+        prev = n;
+    }
+    ll_list_insert_after(&sleepers, prev, &thread->node);
+}
+
+static void set_priority(kernel_thread_t* thread, uint8_t priority)
+{
+    if (thread->state == KERNEL_THREAD_READY) {
+        ready_remove(thread);
+        thread->priority = priority;
+        ready_insert(thread);
+    } else {
+        thread->priority = priority;
+    }
+}
+
+/* Raises the owner chain of a contended mutex to at least the given priority */
+static void inherit_priority(kernel_thread_t* owner, uint8_t priority)
+{
+    while (owner != NULL && owner->priority < priority) {
+        set_priority(owner, priority);
+        STAT_INC(stats.inheritance_boosts);
+        if (owner->state != KERNEL_THREAD_BLOCKED) {
+            break;
+        }
+        owner = owner->blocked_on->owner;
+    }
+}
+
+/* Effective priority: the base priority or the highest waiter on any held mutex */
+static void update_priority(kernel_thread_t* thread)
+{
+    uint8_t priority = thread->base_priority;
+    for (node_t* m = thread->held.head; m != NULL; m = m->next) {
+        for (node_t* w = MUTEX_OF(m)->waiters.head; w != NULL; w = w->next) {
+            if (THREAD_OF(w)->priority > priority) {
+                priority = THREAD_OF(w)->priority;
+            }
+        }
+    }
+    if (priority != thread->priority) {
+        set_priority(thread, priority);
+    }
+}
+
+static void mutex_take(kernel_mutex_t* mutex, kernel_thread_t* thread)
+{
+    mutex->owner = thread;
+    ll_list_insert_at_tail(&thread->held, &mutex->node);
+}
+
+static void mutex_release(kernel_mutex_t* mutex, kernel_thread_t* owner)
+{
+    ll_list_remove(&owner->held, &mutex->node);
+    mutex->owner = NULL;
+
+    /* Hand over directly so a woken waiter never has to race for the mutex */
+    kernel_thread_t* next = NULL;
+    for (node_t* w = mutex->waiters.head; w != NULL; w = w->next) {
+        if (next == NULL || THREAD_OF(w)->priority > next->priority) {
+            next = THREAD_OF(w);
+        }
+    }
+    if (next != NULL) {
+        ll_list_remove(&mutex->waiters, &next->node);
+        next->blocked_on = NULL;
+        mutex_take(mutex, next);
+        ready_insert(next);
+        update_priority(next);
+    }
+    update_priority(owner);
+}
+
+static void thread_setup(kernel_thread_t* thread, kernel_entry_t entry, void* arg, uint32_t* stack,
+                         uint32_t stack_words, uint8_t priority, const char* name)
+{
+    memset(thread, 0, sizeof(*thread));
+    thread->sp = kernel_port_stack_init(stack + stack_words, entry, arg);
+    thread->node.data = thread;
+    thread->name = name;
+    thread->priority = priority;
+    thread->base_priority = priority;
+    thread->slice = KERNEL_TIME_SLICE_TICKS;
+    ll_list_init(&thread->held);
+}
+
+static void idle_entry(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        kernel_port_idle(kernel_idle_ticks());
+    }
+}
+
+status_t kernel_init(void)
+{
+    for (uint32_t i = 0; i < KERNEL_PRIORITIES; i++) {
+        ll_list_init(&ready_lists[i]);
+    }
+    ll_list_init(&sleepers);
+    ready_mask = 0;
+    tick_count = 0;
+    started = 0;
+    kernel_current_thread = NULL;
+    memset(&stats, 0, sizeof(stats));
+
+    thread_setup(&idle_thread, idle_entry, NULL, idle_stack, KERNEL_IDLE_STACK_WORDS, IDLE_PRIORITY, "idle");
+    ready_insert(&idle_thread);
+    return SUCCESS;
+}
+
+status_t kernel_thread_create(kernel_thread_t* thread, kernel_entry_t entry, void* arg, uint32_t* stack,
+                              uint32_t stack_words, uint8_t priority, const char* name)
+{
+    if (thread == NULL || entry == NULL || stack == NULL || stack_words < MIN_STACK_WORDS ||
+        priority == IDLE_PRIORITY || priority >= KERNEL_PRIORITIES) {
+        return FAILURE;
+    }
+
+    thread_setup(thread, entry, arg, stack, stack_words, priority, name);
+
+    uint32_t state = kernel_port_irq_mask();
+    ready_insert(thread);
+    reschedule();
+    kernel_port_irq_restore(state);
+    return SUCCESS;
+}
+
+void kernel_start(void)
+{
+    uint32_t state = kernel_port_irq_mask();
+    kernel_switch_context();
+    started = 1;
+    kernel_port_irq_restore(state);
+    kernel_port_start();
+}
+
+void kernel_switch_context(void)
+{
+    kernel_thread_t* next = highest_ready();
+    kernel_thread_t* prev = kernel_current_thread;
+
+    if (next != prev) {
+        STAT_INC(stats.switches);
+        if (prev != NULL && prev->state == KERNEL_THREAD_READY) {
+            STAT_INC(stats.preemptions);
+        }
+        next->slice = KERNEL_TIME_SLICE_TICKS;
+        kernel_current_thread = next;
+        TRACE(KERNEL_TRACE_SWITCH, (uintptr_t)next);
+    }
+}
+
+kernel_thread_t* kernel_current(void)
+{
+    return kernel_current_thread;
+}
+
+void kernel_yield(void)
+{
+    uint32_t state = kernel_port_irq_mask();
+    kernel_thread_t* self = kernel_current_thread;
+    ready_remove(self);
+    ready_insert(self);
+    reschedule();
+    kernel_port_irq_restore(state);
+}
+
+void kernel_sleep(uint32_t ticks)
+{
+    if (ticks == 0) {
+        kernel_yield();
+        return;
+    }
+
+    uint32_t state = kernel_port_irq_mask();
+    kernel_thread_t* self = kernel_current_thread;
+    ready_remove(self);
+    self->state = KERNEL_THREAD_SLEEPING;
+    self->wake_tick = tick_count + ticks;
+    sleep_insert(self);
+    reschedule();
+    kernel_port_irq_restore(state);
+}
+
+void kernel_exit(void)
+{
+    uint32_t state = kernel_port_irq_mask();
+    kernel_thread_t* self = kernel_current_thread;
+    while (self->held.head != NULL) {
+        mutex_release(MUTEX_OF(self->held.head), self);
+    }
+    ready_remove(self);
+    self->state = KERNEL_THREAD_TERMINATED;
+    reschedule();
+    kernel_port_irq_restore(state);
+
+#if defined(STM32F407xx)
+    /* The pending switch never comes back here */
+    for (;;) {
+    }
+#endif
+}
+
+uint32_t kernel_ticks(void)
+{
+    return tick_count;
+}
+
+void kernel_tick_announce(uint32_t ticks)
+{
+    if (ticks == 0) {
+        return;
+    }
+
+    uint32_t state = kernel_port_irq_mask();
+    tick_count += ticks;
+    if (ticks > 1U) {
+        STAT_ADD(stats.idle_ticks_skipped, ticks - 1U);
+    }
+
+    while (sleepers.head != NULL && tick_reached(THREAD_OF(sleepers.head)->wake_tick, tick_count)) {
+        ready_insert(THREAD_OF(ll_list_remove_head(&sleepers)));
+    }
+
+    kernel_thread_t* self = kernel_current_thread;
+    if (self != NULL && self->state == KERNEL_THREAD_READY && self->priority != IDLE_PRIORITY) {
+        if (self->slice > ticks) {
+            self->slice -= (uint8_t)ticks;
+        } else {
+            self->slice = KERNEL_TIME_SLICE_TICKS;
+            if (ready_lists[self->priority].count > 1U) {
+                ready_remove(self);
+                ready_insert(self);
+            }
+        }
+    }
+
+    reschedule();
+    kernel_port_irq_restore(state);
+}
+
+uint32_t kernel_idle_ticks(void)
+{
+    uint32_t state = kernel_port_irq_mask();
+    uint32_t ticks;
+    if ((ready_mask & ~(1U << IDLE_PRIORITY)) != 0) {
+        ticks = 0;
+    } else if (sleepers.head == NULL) {
+        ticks = UINT32_MAX;
+    } else {
+        uint32_t wake = THREAD_OF(sleepers.head)->wake_tick;
+        ticks = tick_reached(wake, tick_count) ? 0 : wake - tick_count;
+    }
+    kernel_port_irq_restore(state);
+    return ticks;
+}
+
+status_t kernel_mutex_init(kernel_mutex_t* mutex)
+{
+    if (mutex == NULL) {
+        return FAILURE;
+    }
+    memset(mutex, 0, sizeof(*mutex));
+    mutex->node.data = mutex;
+    ll_list_init(&mutex->waiters);
+    return SUCCESS;
+}
+
+status_t kernel_mutex_lock(kernel_mutex_t* mutex)
+{
+    uint32_t state = kernel_port_irq_mask();
+    kernel_thread_t* self = kernel_current_thread;
+    status_t result = SUCCESS;
+
+    if (mutex->owner == NULL) {
+        mutex_take(mutex, self);
+    } else if (mutex->owner == self) {
+        result = FAILURE;
+    } else {
+        ready_remove(self);
+        self->state = KERNEL_THREAD_BLOCKED;
+        self->blocked_on = mutex;
+        ll_list_insert_at_tail(&mutex->waiters, &self->node);
+        inherit_priority(mutex->owner, self->priority);
+        reschedule();
+    }
+
+    kernel_port_irq_restore(state);
+    return result;
+}
+
+status_t kernel_mutex_try_lock(kernel_mutex_t* mutex)
+{
+    uint32_t state = kernel_port_irq_mask();
+    status_t result = FAILURE;
+    if (mutex->owner == NULL) {
+        mutex_take(mutex, kernel_current_thread);
+        result = SUCCESS;
+    }
+    kernel_port_irq_restore(state);
+    return result;
+}
+
+status_t kernel_mutex_unlock(kernel_mutex_t* mutex)
+{
+    uint32_t state = kernel_port_irq_mask();
+    kernel_thread_t* self = kernel_current_thread;
+    status_t result = FAILURE;
+    if (mutex->owner == self) {
+        mutex_release(mutex, self);
+        reschedule();
+        result = SUCCESS;
+    }
+    kernel_port_irq_restore(state);
+    return result;
+}
+
+kernel_stats_t kernel_get_stats(void)
+{
+    uint32_t state = kernel_port_irq_mask();
+    kernel_stats_t snapshot = stats;
+    kernel_port_irq_restore(state);
+    return snapshot;
+}
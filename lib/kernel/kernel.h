@@ -0,0 +1,187 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "build_config.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Preemptive priority kernel.
+ *
+ * Every thread has its own stack and runs until a higher-priority thread
+ * becomes ready, it blocks, or its time slice ends (threads of equal
+ * priority round-robin on the tick). Ready threads wait in one list per
+ * priority; the highest non-empty list is found in O(1) from a bitmap.
+ *
+ * The context switch itself lives in a port: on the Cortex-M4 it runs in
+ * PendSV and saves the FPU registers only for threads that used the FPU,
+ * and the idle thread sleeps tickless through the timebase. The host port
+ * makes the same scheduling decisions synchronously without switching
+ * stacks, so the kernel logic can be tested off target; there a blocking
+ * call returns as soon as the caller stops being the current thread.
+ *
+ * Kernel calls are made from threads, except kernel_tick_announce(), which
+ * the port calls from its timer interrupt.
+ */
+
+/** Number of priority levels; higher numbers run first. Level 0 belongs to the idle thread. */
+#ifndef KERNEL_PRIORITIES
+#define KERNEL_PRIORITIES 16
+#endif
+
+/** Ticks a thread runs before yielding to the next ready thread of its priority. */
+#ifndef KERNEL_TIME_SLICE_TICKS
+#define KERNEL_TIME_SLICE_TICKS 10U
+#endif
+
+/** Stack size of the idle thread, in words. */
+#ifndef KERNEL_IDLE_STACK_WORDS
+#define KERNEL_IDLE_STACK_WORDS 128U
+#endif
+
+typedef enum {
+    KERNEL_THREAD_READY,
+    KERNEL_THREAD_BLOCKED,
+    KERNEL_THREAD_SLEEPING,
+    KERNEL_THREAD_TERMINATED
+} kernel_thread_state_t;
+
+typedef struct kernel_mutex kernel_mutex_t;
+
+typedef void (*kernel_entry_t)(void* arg);
+
+typedef struct kernel_thread {
+    uint32_t* sp;                 /* Saved stack pointer; the port relies on it being first */
+    node_t node;                  /* Ready, sleep or mutex wait list link; node.data = thread */
+    const char* name;
+    uint8_t priority;             /* Effective priority, raised by inheritance */
+    uint8_t base_priority;
+    uint8_t state;
+    uint8_t slice;
+    uint32_t wake_tick;
+    kernel_mutex_t* blocked_on;
+    list_t held;                  /* Mutexes owned by this thread */
+} kernel_thread_t;
+
+struct kernel_mutex {
+    node_t node;                  /* Link in the owner's held list; node.data = mutex */
+    kernel_thread_t* owner;
+    list_t waiters;
+};
+
+typedef struct {
+    uint32_t switches;
+    uint32_t preemptions;
+    uint32_t idle_ticks_skipped;
+    uint32_t inheritance_boosts;
+} kernel_stats_t;
+
+/**
+ * @brief Resets the kernel and creates the idle thread.
+ *
+ * @return status_t SUCCESS.
+ */
+status_t kernel_init(void);
+
+/**
+ * @brief Prepares a thread and makes it ready.
+ *
+ * @param thread Thread control block, owned by the caller.
+ * @param entry Thread function; returning from it terminates the thread.
+ * @param arg Argument passed to entry.
+ * @param stack Stack memory, 8-byte aligned.
+ * @param stack_words Stack size in words.
+ * @param priority Priority, 1 to KERNEL_PRIORITIES - 1.
+ * @param name Name for debugging, may be NULL.
+ * @return status_t SUCCESS, or FAILURE if an argument is invalid.
+ */
+status_t kernel_thread_create(kernel_thread_t* thread, kernel_entry_t entry, void* arg, uint32_t* stack,
+                              uint32_t stack_words, uint8_t priority, const char* name);
+
+/**
+ * @brief Starts the tick and switches to the highest-priority ready thread.
+ * Never returns on target; the host port returns once the first thread is selected.
+ */
+void kernel_start(void);
+
+/**
+ * @brief Returns the running thread.
+ */
+kernel_thread_t* kernel_current(void);
+
+/**
+ * @brief Moves the running thread behind the other ready threads of its priority.
+ */
+void kernel_yield(void);
+
+/**
+ * @brief Blocks the running thread for a number of ticks; zero yields.
+ */
+void kernel_sleep(uint32_t ticks);
+
+/**
+ * @brief Terminates the running thread. Also reached when a thread function returns.
+ */
+void kernel_exit(void);
+
+/**
+ * @brief Returns the tick counter.
+ */
+uint32_t kernel_ticks(void);
+
+/**
+ * @brief Advances time by a number of ticks, waking sleepers and rotating time slices.
+ * Called by the port from the timer interrupt, or after a tickless sleep.
+ */
+void kernel_tick_announce(uint32_t ticks);
+
+/**
+ * @brief Returns how many ticks may pass before the kernel needs the next tick:
+ * zero if a thread other than idle is ready, UINT32_MAX if nothing sleeps.
+ */
+uint32_t kernel_idle_ticks(void);
+
+/**
+ * @brief Prepares a mutex.
+ *
+ * @return status_t SUCCESS, or FAILURE if mutex is NULL.
+ */
+status_t kernel_mutex_init(kernel_mutex_t* mutex);
+
+/**
+ * @brief Acquires a mutex, blocking while another thread owns it. While blocked,
+ * the owner inherits the caller's priority if it is higher than its own.
+ *
+ * @return status_t SUCCESS, or FAILURE if the caller already owns the mutex.
+ */
+status_t kernel_mutex_lock(kernel_mutex_t* mutex);
+
+/**
+ * @brief Acquires a mutex only if it is free.
+ *
+ * @return status_t SUCCESS if acquired, FAILURE otherwise.
+ */
+status_t kernel_mutex_try_lock(kernel_mutex_t* mutex);
+
+/**
+ * @brief Releases a mutex, handing it to its highest-priority waiter, and drops
+ * any priority the caller inherited through it.
+ *
+ * @return status_t SUCCESS, or FAILURE if the caller is not the owner.
+ */
+status_t kernel_mutex_unlock(kernel_mutex_t* mutex);
+
+/**
+ * @brief Returns a snapshot of the kernel counters.
+ */
+kernel_stats_t kernel_get_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KERNEL_H
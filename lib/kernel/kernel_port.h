@@ -0,0 +1,42 @@
+#ifndef KERNEL_PORT_H
+#define KERNEL_PORT_H
+
+#include "kernel.h"
+#include <stdint.h>
+
+/*
+ * Interface between the portable kernel and its port. One port is compiled
+ * per build: kernel_port_cm4.c on target, kernel_port_host.c on the host.
+ */
+
+/* Thread whose context is live; the target port's switch code reads and writes it */
+extern kernel_thread_t* volatile kernel_current_thread;
+
+/**
+ * @brief Picks the thread to run next and makes it current. The port calls it
+ * with interrupts masked while no thread context is live.
+ */
+void kernel_switch_context(void);
+
+/** Masks interrupts, returning the previous mask state. */
+uint32_t kernel_port_irq_mask(void);
+
+/** Restores the mask state returned by kernel_port_irq_mask(). */
+void kernel_port_irq_restore(uint32_t state);
+
+/** Requests a context switch, performed once interrupts are unmasked. */
+void kernel_port_request_switch(void);
+
+/** Builds the initial frame of a thread and returns its stack pointer. */
+uint32_t* kernel_port_stack_init(uint32_t* stack_top, kernel_entry_t entry, void* arg);
+
+/** Starts the tick and enters the current thread. */
+void kernel_port_start(void);
+
+/**
+ * @brief Idle thread body: sleeps until an interrupt, suppressing up to
+ * idle_ticks ticks, and announces the ticks that elapsed.
+ */
+void kernel_port_idle(uint32_t idle_ticks);
+
+#endif // KERNEL_PORT_H
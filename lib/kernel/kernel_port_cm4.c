@@ -0,0 +1,149 @@
+#include "kernel_port.h"
+#include "hal_reg.h"
+#include "timebase.h"
+
+#if defined(STM32F407xx)
+
+/*
+ * Cortex-M4F port.
+ *
+ * Threads run on the process stack; exceptions run on the main stack.
+ * PendSV, at the lowest priority, performs every switch so a switch
+ * requested from an interrupt happens only once all interrupts have
+ * returned. The hardware stacks r0-r3, r12, lr, pc and xPSR; PendSV adds
+ * r4-r11 and the EXC_RETURN value. With lazy stacking enabled the core only
+ * reserves room for s0-s15 and stores them if the handler touches the FPU,
+ * and PendSV saves s16-s31 only when EXC_RETURN bit 4 says the outgoing
+ * thread has an FPU context, so integer-only threads never pay for it.
+ *
+ * Ticks come from the timebase module; the idle thread sleeps through it,
+ * so an idle system takes no tick interrupts until its next deadline.
+ */
+
+#define SCB_ICSR (*(volatile uint32_t*)0xE000ED04U)
+#define SCB_ICSR_PENDSVSET (1U << 28)
+#define SCB_SHPR3 (*(volatile uint32_t*)0xE000ED20U)
+#define SCB_SHPR3_PENDSV_SYSTICK_LOWEST (0xFFFF0000U)
+#define FPU_FPCCR (*(volatile uint32_t*)0xE000EF34U)
+#define FPU_FPCCR_ASPEN (1U << 31)
+#define FPU_FPCCR_LSPEN (1U << 30)
+
+#define INITIAL_XPSR 0x01000000U           /* Thumb state */
+#define EXC_RETURN_THREAD_PSP 0xFFFFFFFDU  /* Thread mode, process stack, no FPU context */
+
+uint32_t kernel_port_irq_mask(void)
+{
+    return hal_irq_mask();
+}
+
+void kernel_port_irq_restore(uint32_t state)
+{
+    hal_irq_restore(state);
+}
+
+void kernel_port_request_switch(void)
+{
+    SCB_ICSR = SCB_ICSR_PENDSVSET;
+    __asm volatile("dsb\n"
+                   "isb"
+                   :
+                   :
+                   : "memory");
+}
+
+uint32_t* kernel_port_stack_init(uint32_t* stack_top, kernel_entry_t entry, void* arg)
+{
+    /* AAPCS wants an 8-byte aligned stack at every public interface */
+    uint32_t* sp = (uint32_t*)((uintptr_t)stack_top & ~(uintptr_t)7U);
+
+    *--sp = INITIAL_XPSR;
+    *--sp = (uint32_t)(uintptr_t)entry & ~1U; /* pc */
+    *--sp = (uint32_t)(uintptr_t)kernel_exit; /* lr: returning from entry ends the thread */
+    *--sp = 0;                                /* r12 */
+    *--sp = 0;                                /* r3 */
+    *--sp = 0;                                /* r2 */
+    *--sp = 0;                                /* r1 */
+    *--sp = (uint32_t)(uintptr_t)arg;         /* r0 */
+    *--sp = EXC_RETURN_THREAD_PSP;            /* Restored into lr by the switch code */
+    for (uint32_t i = 0; i < 8U; i++) {
+        *--sp = 0;                            /* r11 down to r4 */
+    }
+    return sp;
+}
+
+void kernel_port_start(void)
+{
+    SCB_SHPR3 |= SCB_SHPR3_PENDSV_SYSTICK_LOWEST;
+    FPU_FPCCR |= FPU_FPCCR_ASPEN | FPU_FPCCR_LSPEN;
+
+    timebase_init(kernel_tick_announce, kernel_idle_ticks);
+
+    /* Reclaim the main stack, drop any FPU context main() left behind and enter the first thread */
+    __asm volatile("ldr r0, =0xE000ED08\n"
+                   "ldr r0, [r0]\n"
+                   "ldr r0, [r0]\n"
+                   "msr msp, r0\n"
+                   "mov r0, #0\n"
+                   "msr control, r0\n"
+                   "isb\n"
+                   "cpsie i\n"
+                   "dsb\n"
+                   "isb\n"
+                   "svc 0\n"
+                   :
+                   :
+                   : "r0", "memory");
+    for (;;) {
+    }
+}
+
+__attribute__((naked)) void SVC_Handler(void)
+{
+    __asm volatile("ldr r3, =kernel_current_thread\n"
+                   "ldr r1, [r3]\n"
+                   "ldr r0, [r1]\n"
+                   "ldmia r0!, {r4-r11, r14}\n"
+                   "msr psp, r0\n"
+                   "isb\n"
+                   "bx r14\n"
+                   ".ltorg\n");
+}
+
+__attribute__((naked)) void PendSV_Handler(void)
+{
+    __asm volatile("mrs r0, psp\n"
+                   "isb\n"
+                   "ldr r3, =kernel_current_thread\n"
+                   "ldr r2, [r3]\n"
+                   "tst r14, #0x10\n"
+                   "it eq\n"
+                   "vstmdbeq r0!, {s16-s31}\n"
+                   "stmdb r0!, {r4-r11, r14}\n"
+                   "str r0, [r2]\n"
+                   "stmdb sp!, {r0, r3}\n"
+                   "cpsid i\n"
+                   "bl kernel_switch_context\n"
+                   "cpsie i\n"
+                   "ldmia sp!, {r0, r3}\n"
+                   "ldr r1, [r3]\n"
+                   "ldr r0, [r1]\n"
+                   "ldmia r0!, {r4-r11, r14}\n"
+                   "tst r14, #0x10\n"
+                   "it eq\n"
+                   "vldmiaeq r0!, {s16-s31}\n"
+                   "msr psp, r0\n"
+                   "isb\n"
+                   "bx r14\n"
+                   ".ltorg\n");
+}
+
+void kernel_port_idle(uint32_t idle_ticks)
+{
+    /* The timebase asks the kernel again once interrupts are masked */
+    (void)idle_ticks;
+    uint32_t state = kernel_port_irq_mask();
+    timebase_sleep();
+    kernel_port_irq_restore(state);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include "kernel_port.h"
+
+#if !defined(STM32F407xx)
+
+/*
+ * Host port: there is only one stack, so a switch just makes the chosen
+ * thread current and the caller carries on as that thread. Time only moves
+ * when the test announces ticks or calls kernel_port_idle().
+ */
+
+uint32_t kernel_port_irq_mask(void)
+{
+    return 0;
+}
+
+void kernel_port_irq_restore(uint32_t state)
+{
+    (void)state;
+}
+
+void kernel_port_request_switch(void)
+{
+    kernel_switch_context();
+}
+
+uint32_t* kernel_port_stack_init(uint32_t* stack_top, kernel_entry_t entry, void* arg)
+{
+    (void)entry;
+    (void)arg;
+    return stack_top;
+}
+
+void kernel_port_start(void)
+{
+}
+
+void kernel_port_idle(uint32_t idle_ticks)
+{
+    /* Sleep straight through to the next deadline, as the tickless target port would */
+    if (idle_ticks != 0 && idle_ticks != UINT32_MAX) {
+        kernel_tick_announce(idle_ticks);
+    }
+}
+
+#endif
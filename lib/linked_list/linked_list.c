@@ -1,6 +1,12 @@
 #include "linked_list.h"
+#include "feature_hooks.h"
 #include <stddef.h>
 
+#define LL_TRACE_INSERT_AT_HEAD 0x0101
+#define LL_TRACE_INSERT_AT_TAIL 0x0102
+#define LL_TRACE_DELETE_AT_HEAD 0x0103
+#define LL_TRACE_DELETE_AT_TAIL 0x0104
+
 static node_t* head = NULL;
 
 status_t ll_init(node_t* initial_node)
@@ -16,23 +22,34 @@ status_t ll_init(node_t* initial_node)
 
 status_t ll_insert_at_head(node_t* new_node)
 {
+    LOCK_STATE(lock);
+
     if (new_node == NULL) {
         return FAILURE;
     }
+    TRACE(LL_TRACE_INSERT_AT_HEAD, (uintptr_t)new_node);
+
+    LOCK_ACQUIRE(lock);
     new_node->next = head;
     head = new_node;
+    LOCK_RELEASE(lock);
     return SUCCESS;
 }
 
 status_t ll_insert_at_tail(node_t* new_node)
 {
+    LOCK_STATE(lock);
+
     if (new_node == NULL) {
         return FAILURE;
     }
+    TRACE(LL_TRACE_INSERT_AT_TAIL, (uintptr_t)new_node);
 
+    LOCK_ACQUIRE(lock);
     if (head == NULL) {
         head = new_node;
         head->next = NULL;
+        LOCK_RELEASE(lock);
         return SUCCESS;
     }
 
@@ -42,27 +59,40 @@ status_t ll_insert_at_tail(node_t* new_node)
     }
     current->next = new_node;
     new_node->next = NULL;
+    LOCK_RELEASE(lock);
     return SUCCESS;
 }
 
 status_t ll_delete_at_head()
 {
+    LOCK_STATE(lock);
+
+    LOCK_ACQUIRE(lock);
     if (head == NULL) {
+        LOCK_RELEASE(lock);
         return FAILURE;
     }
+    TRACE(LL_TRACE_DELETE_AT_HEAD, (uintptr_t)head);
 
     head = head->next;
+    LOCK_RELEASE(lock);
     return SUCCESS;
 }
 
 status_t ll_delete_at_tail()
 {
+    LOCK_STATE(lock);
+
+    LOCK_ACQUIRE(lock);
     if (head == NULL) {
+        LOCK_RELEASE(lock);
         return FAILURE;
     }
+    TRACE(LL_TRACE_DELETE_AT_TAIL, (uintptr_t)head);
 
     if (head->next == NULL) {
         head = NULL;
+        LOCK_RELEASE(lock);
         return SUCCESS;
     }
 
@@ -71,5 +101,113 @@ status_t ll_delete_at_tail()
         current = current->next;
     }
     current->next = NULL;
+    LOCK_RELEASE(lock);
+    return SUCCESS;
+}
+
+node_t* ll_get_head(void)
+{
+    return head;
+}
+
+status_t ll_list_init(list_t* list)
+{
+    if (list == NULL) {
+        return FAILURE;
+    }
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+    return SUCCESS;
+}
+
+status_t ll_list_insert_at_head(list_t* list, node_t* new_node)
+{
+    if (list == NULL || new_node == NULL) {
+        return FAILURE;
+    }
+    new_node->next = list->head;
+    list->head = new_node;
+    if (list->tail == NULL) {
+        list->tail = new_node;
+    }
+    list->count++;
+    return SUCCESS;
+}
+
+status_t ll_list_insert_at_tail(list_t* list, node_t* new_node)
+{
+    if (list == NULL || new_node == NULL) {
+        return FAILURE;
+    }
+    new_node->next = NULL;
+    if (list->tail == NULL) {
+        list->head = new_node;
+    } else {
+        list->tail->next = new_node;
+    }
+    list->tail = new_node;
+    list->count++;
+    return SUCCESS;
+}
+
+status_t ll_list_insert_after(list_t* list, node_t* position, node_t* new_node)
+{
+    if (position == NULL) {
+        return ll_list_insert_at_head(list, new_node);
+    }
+    if (list == NULL || new_node == NULL) {
+        return FAILURE;
+    }
+    new_node->next = position->next;
+    position->next = new_node;
+    if (list->tail == position) {
+        list->tail = new_node;
+    }
+    list->count++;
+    return SUCCESS;
+}
+
+node_t* ll_list_remove_head(list_t* list)
+{
+    if (list == NULL || list->head == NULL) {
+        return NULL;
+    }
+    node_t* node = list->head;
+    list->head = node->next;
+    if (list->head == NULL) {
+        list->tail = NULL;
+    }
+    node->next = NULL;
+    list->count--;
+    return node;
+}
+
+status_t ll_list_remove(list_t* list, node_t* node)
+{
+    if (list == NULL || node == NULL) {
+        return FAILURE;
+    }
+
+    node_t* previous = NULL;
+    node_t* current = list->head;
+    while (current != NULL && current != node) {
+        previous = current;
+        current = current->next;
+    }
+    if (current == NULL) {
+        return FAILURE;
+    }
+
+    if (previous == NULL) {
+        list->head = node->next;
+    } else {
+        previous->next = node->next;
+    }
+    if (list->tail == node) {
+        list->tail = previous;
+    }
+    node->next = NULL;
+    list->count--;
     return SUCCESS;
 }
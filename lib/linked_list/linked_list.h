@@ -1,6 +1,12 @@
 #ifndef LINKED_LIST_H
 #define LINKED_LIST_H
 
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct _Node {
     void* data;
     struct _Node* next;
@@ -8,6 +14,15 @@ struct _Node {
 
 typedef struct _Node node_t;
 
+/**
+ * @brief Independent list instance with O(1) insertion at both ends.
+ */
+typedef struct {
+    node_t* head;
+    node_t* tail;
+    uint32_t count;
+} list_t;
+
 typedef enum {
     SUCCESS,
     FAILURE
@@ -51,4 +66,68 @@ status_t ll_delete_at_head();
  */
 status_t ll_delete_at_tail();
 
+/**
+ * @brief Returns the node at the head of the linked list.
+ *
+ * @return node_t* Head node, or NULL if the list is empty.
+ */
+node_t* ll_get_head(void);
+
+/**
+ * @brief Initializes an empty list instance.
+ *
+ * @param list Pointer to the list to initialize.
+ * @return status_t SUCCESS if initialization is successful, FAILURE otherwise.
+ */
+status_t ll_list_init(list_t* list);
+
+/**
+ * @brief Inserts a node at the head of a list instance.
+ *
+ * @param list Pointer to the list.
+ * @param new_node Pointer to the node to insert.
+ * @return status_t SUCCESS if insertion is successful, FAILURE otherwise.
+ */
+status_t ll_list_insert_at_head(list_t* list, node_t* new_node);
+
+/**
+ * @brief Inserts a node at the tail of a list instance in O(1).
+ *
+ * @param list Pointer to the list.
+ * @param new_node Pointer to the node to insert.
+ * @return status_t SUCCESS if insertion is successful, FAILURE otherwise.
+ */
+status_t ll_list_insert_at_tail(list_t* list, node_t* new_node);
+
+/**
+ * @brief Inserts a node after another node of a list instance.
+ *
+ * @param list Pointer to the list.
+ * @param position Node to insert after, or NULL to insert at the head.
+ * @param new_node Pointer to the node to insert.
+ * @return status_t SUCCESS if insertion is successful, FAILURE otherwise.
+ */
+status_t ll_list_insert_after(list_t* list, node_t* position, node_t* new_node);
+
+/**
+ * @brief Unlinks and returns the node at the head of a list instance.
+ *
+ * @param list Pointer to the list.
+ * @return node_t* The removed node, or NULL if the list is empty.
+ */
+node_t* ll_list_remove_head(list_t* list);
+
+/**
+ * @brief Unlinks a given node from a list instance; O(n).
+ *
+ * @param list Pointer to the list.
+ * @param node Pointer to the node to remove.
+ * @return status_t SUCCESS if the node was found and removed, FAILURE otherwise.
+ */
+status_t ll_list_remove(list_t* list, node_t* node);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
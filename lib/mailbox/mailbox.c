@@ -0,0 +1,125 @@
+#include "mailbox.h"
+#include "feature_hooks.h"
+#include "hal_reg.h"
+#include <string.h>
+
+#define MSG_OF(n) ((msg_t*)(n)->data)
+
+status_t msg_pool_init(msg_pool_t* pool, void* storage, uint32_t payload_size, uint32_t count)
+{
+    if (pool == NULL || storage == NULL || payload_size == 0 || payload_size > UINT16_MAX || count == 0 ||
+        ((uintptr_t)storage & 7U) != 0) {
+        return FAILURE;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    ll_list_init(&pool->free);
+    pool->payload_size = payload_size;
+    pool->count = count;
+
+    uint8_t* block = (uint8_t*)storage;
+    for (uint32_t i = 0; i < count; i++) {
+        msg_t* msg = (msg_t*)block;
+        msg->node.data = msg;
+        msg->pool = pool;
+        ll_list_insert_at_head(&pool->free, &msg->node);
+        block += MSG_BLOCK_SIZE(payload_size);
+    }
+    return SUCCESS;
+}
+
+msg_t* msg_alloc(msg_pool_t* pool)
+{
+    /* The free list is a LIFO touched from any priority; a masked section avoids ABA */
+    uint32_t primask = hal_irq_mask();
+    node_t* node = ll_list_remove_head(&pool->free);
+    if (node != NULL) {
+        pool->in_use++;
+        STAT_MAX(pool->peak, pool->in_use);
+    } else {
+        STAT_INC(pool->alloc_failures);
+    }
+    hal_irq_restore(primask);
+
+    if (node == NULL) {
+        return NULL;
+    }
+    msg_t* msg = MSG_OF(node);
+    msg->length = 0;
+    msg->type = 0;
+    return msg;
+}
+
+void msg_free(msg_t* msg)
+{
+    msg_pool_t* pool = msg->pool;
+    uint32_t primask = hal_irq_mask();
+    ll_list_insert_at_head(&pool->free, &msg->node);
+    pool->in_use--;
+    hal_irq_restore(primask);
+}
+
+status_t mailbox_init(mailbox_t* mailbox, mailbox_wakeup_t wakeup, void* context)
+{
+    if (mailbox == NULL) {
+        return FAILURE;
+    }
+    mailbox->stub.next = NULL;
+    mailbox->stub.data = NULL;
+    mailbox->head = &mailbox->stub;
+    mailbox->tail = &mailbox->stub;
+    mailbox->wakeup = wakeup;
+    mailbox->wakeup_context = context;
+    return SUCCESS;
+}
+
+static void push(mailbox_t* mailbox, node_t* node)
+{
+    node->next = NULL;
+    node_t* prev = __atomic_exchange_n(&mailbox->head, node, __ATOMIC_ACQ_REL);
+    /* Until this store lands the consumer sees the queue end at prev */
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+status_t mailbox_post(mailbox_t* mailbox, msg_t* msg)
+{
+    if (mailbox == NULL || msg == NULL) {
+        return FAILURE;
+    }
+    push(mailbox, &msg->node);
+    if (mailbox->wakeup != NULL) {
+        mailbox->wakeup(mailbox->wakeup_context);
+    }
+    return SUCCESS;
+}
+
+msg_t* mailbox_fetch(mailbox_t* mailbox)
+{
+    node_t* tail = mailbox->tail;
+    node_t* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &mailbox->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        mailbox->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        mailbox->tail = next;
+        return MSG_OF(tail);
+    }
+
+    /* tail is the last linked node; a post may be between its exchange and its link */
+    if (tail != __atomic_load_n(&mailbox->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    push(mailbox, &mailbox->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        mailbox->tail = next;
+        return MSG_OF(tail);
+    }
+    return NULL;
+}
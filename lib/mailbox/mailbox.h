@@ -0,0 +1,136 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "build_config.h"
+#include "linked_list.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Zero-copy message passing.
+ *
+ * Messages are fixed-size blocks from a pool: the producer allocates one,
+ * writes its payload in place and posts it; the consumer reads it in place
+ * and frees it back to the pool. Only the node_t link moves, so the cost
+ * of a post does not depend on the payload size.
+ *
+ * A mailbox is an intrusive multi-producer, single-consumer queue (Vyukov):
+ * a post is one atomic exchange plus a store, so it is O(1) and lock-free
+ * from thread context and from interrupts of any priority. Only one
+ * context may fetch. Pool allocation and release mask interrupts for a
+ * few instructions and are also usable anywhere.
+ *
+ * An optional wakeup hook runs after every post, e.g. to post a scheduler
+ * event to the consuming task.
+ */
+
+typedef struct msg_pool msg_pool_t;
+
+typedef struct {
+    node_t node;        /* Queue or free-list link; node.data = message */
+    msg_pool_t* pool;
+    uint16_t length;    /* Payload bytes in use, set by the producer */
+    uint16_t type;      /* Free for the application */
+} msg_t;
+
+struct msg_pool {
+    list_t free;
+    uint32_t payload_size;
+    uint32_t count;
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t alloc_failures;
+};
+
+/** Bytes of pool storage per message with the given payload capacity. */
+#define MSG_BLOCK_SIZE(payload_size) ((sizeof(msg_t) + (payload_size) + 7U) & ~(size_t)7U)
+
+/** Declares 8-byte aligned storage for a pool of count messages. */
+#define MSG_POOL_STORAGE(name, payload_size, count) \
+    uint64_t name[(MSG_BLOCK_SIZE(payload_size) * (count)) / sizeof(uint64_t)]
+
+typedef void (*mailbox_wakeup_t)(void* context);
+
+typedef struct {
+    node_t* volatile head;   /* Most recently posted; producers swap themselves in here */
+    node_t* tail;            /* Next to fetch; consumer only */
+    node_t stub;
+    mailbox_wakeup_t wakeup;
+    void* wakeup_context;
+} mailbox_t;
+
+/**
+ * @brief Carves storage into messages and puts them all on the free list.
+ *
+ * @param pool Pool to initialize.
+ * @param storage Memory from MSG_POOL_STORAGE, 8-byte aligned.
+ * @param payload_size Payload capacity of each message, at most 65535.
+ * @param count Number of messages.
+ * @return status_t SUCCESS, or FAILURE on invalid arguments.
+ */
+status_t msg_pool_init(msg_pool_t* pool, void* storage, uint32_t payload_size, uint32_t count);
+
+/**
+ * @brief Takes a message from the pool; safe from any context.
+ *
+ * @return msg_t* The message, with length 0, or NULL if the pool is empty.
+ */
+msg_t* msg_alloc(msg_pool_t* pool);
+
+/**
+ * @brief Returns a message to its pool; safe from any context.
+ */
+void msg_free(msg_t* msg);
+
+/**
+ * @brief Returns the payload of a message.
+ */
+static inline void* msg_payload(msg_t* msg)
+{
+    return (void*)(msg + 1);
+}
+
+/**
+ * @brief Returns the message a payload belongs to, for payloads that have
+ * been handed to hardware or a callback by address only.
+ */
+static inline msg_t* msg_from_payload(void* payload)
+{
+    return (msg_t*)payload - 1;
+}
+
+/**
+ * @brief Prepares an empty mailbox.
+ *
+ * @param mailbox Mailbox to initialize.
+ * @param wakeup Called after each post, may be NULL.
+ * @param context Passed to wakeup.
+ * @return status_t SUCCESS, or FAILURE if mailbox is NULL.
+ */
+status_t mailbox_init(mailbox_t* mailbox, mailbox_wakeup_t wakeup, void* context);
+
+/**
+ * @brief Passes a message, and its ownership, to the mailbox's consumer.
+ * Lock-free; safe from any context.
+ *
+ * @return status_t SUCCESS, or FAILURE on invalid arguments.
+ */
+status_t mailbox_post(mailbox_t* mailbox, msg_t* msg);
+
+/**
+ * @brief Takes the oldest message; consumer context only. The caller owns it
+ * and must free or forward it.
+ *
+ * @return msg_t* The message, or NULL if none is available.
+ */
+msg_t* mailbox_fetch(mailbox_t* mailbox);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAILBOX_H
@@ -0,0 +1,289 @@
+#include "rng.h"
+#include "feature_hooks.h"
+#include "hash.h"
+#include <string.h>
+
+#define RCC_AHB2ENR_RNGEN (1U << 6)
+#define HASH_RNG_IRQN 80U
+#define POOL_MASK (RNG_POOL_WORDS - 1U)
+
+#if (RNG_POOL_WORDS & POOL_MASK) != 0U || RNG_POOL_WORDS <= RNG_WINDOW_WORDS
+#error "RNG_POOL_WORDS must be a power of two larger than RNG_WINDOW_WORDS"
+#endif
+
+#if !defined(STM32F407xx)
+rng_regs_t rng_sim_regs;
+#endif
+
+/*
+ * The pool is a ring with three counters. The interrupt writes words at
+ * staged and moves committed up to it when a window passes, or staged back
+ * down to committed when one fails; rng_getentropy reads from taken up to
+ * committed. Each counter has one writer. The pool being larger than a
+ * window means a full pool always holds either a whole window to commit or
+ * words a reader can take, so it never stops for good.
+ */
+static uint32_t pool[RNG_POOL_WORDS];
+static uint32_t staged;
+static uint32_t committed;
+static uint32_t taken;
+
+static uint32_t previous;
+static uint8_t have_previous;   /* Clear until the first word after enabling */
+static uint32_t window_count;
+static uint32_t window_and;
+static uint32_t window_or;
+static uint8_t failures;        /* In a row, since a window last passed */
+static uint8_t stopped;
+static rng_stats_t stats;
+
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    rng_sim_write(reg, value);
+#endif
+}
+
+static uint32_t read_reg(volatile uint32_t* reg)
+{
+#if defined(STM32F407xx)
+    return REG_READ(*reg);
+#else
+    return rng_sim_read(reg);
+#endif
+}
+
+static void reset_window(void)
+{
+    window_count = 0;
+    window_and = 0xFFFFFFFFU;
+    window_or = 0;
+}
+
+/* Throws away the window in progress; too many in a row and the RNG is stopped */
+static void reject(void)
+{
+    staged = committed;
+    reset_window();
+    if (++failures >= RNG_MAX_FAILURES) {
+        __atomic_store_n(&stopped, 1, __ATOMIC_RELEASE);
+        write_reg(&RNG_REGS->CR, 0);
+    }
+}
+
+static uint8_t pool_full(void)
+{
+    return staged - __atomic_load_n(&taken, __ATOMIC_ACQUIRE) == RNG_POOL_WORDS;
+}
+
+static void take(uint32_t word)
+{
+    if (!have_previous) {
+        /* Only to compare the next one with */
+        previous = word;
+        have_previous = 1;
+        return;
+    }
+    if (word == previous) {
+        STAT_INC(stats.repeats);
+        reject();
+        return;
+    }
+    previous = word;
+
+    pool[staged & POOL_MASK] = word;
+    staged++;
+    window_and &= word;
+    window_or |= word;
+    if (++window_count < RNG_WINDOW_WORDS) {
+        return;
+    }
+    if (window_and != 0U || window_or != 0xFFFFFFFFU) {
+        STAT_INC(stats.stuck_windows);
+        reject();
+        return;
+    }
+    __atomic_store_n(&committed, staged, __ATOMIC_RELEASE);
+    STAT_ADD(stats.words, RNG_WINDOW_WORDS);
+    failures = 0;
+    reset_window();
+}
+
+void rng_irq(void)
+{
+    rng_regs_t* regs = RNG_REGS;
+    uint32_t sr = REG_READ(regs->SR);
+    if (sr & RNG_SR_CEIS) {
+        /* The RNG clock was too slow; the words themselves are still good */
+        STAT_INC(stats.clock_errors);
+        write_reg(&regs->SR, ~RNG_SR_CEIS);
+    }
+    if (sr & RNG_SR_SEIS) {
+        /* Discard the word and start over with a fresh seed */
+        STAT_INC(stats.seed_errors);
+        write_reg(&regs->SR, ~RNG_SR_SEIS);
+        reject();
+        if (!stopped) {
+            STAT_INC(stats.restarts);
+            have_previous = 0;
+            write_reg(&regs->CR, RNG_CR_IE);
+            write_reg(&regs->CR, RNG_CR_RNGEN | RNG_CR_IE);
+        }
+        return;
+    }
+    if (stopped) {
+        /* Only rng_init brings a stopped RNG back; keep DRDY from interrupting over and over */
+        write_reg(&regs->CR, 0);
+        return;
+    }
+    if ((sr & RNG_SR_DRDY) == 0U) {
+        return;
+    }
+    if (!pool_full()) {
+        take(read_reg(&regs->DR));
+    }
+    if (!stopped && pool_full()) {
+        /* Keep generating, but quietly, until a reader makes room */
+        write_reg(&regs->CR, RNG_CR_RNGEN);
+    }
+}
+
+status_t rng_getentropy(void* buffer, size_t length)
+{
+    if (length > RNG_GETENTROPY_MAX || (buffer == NULL && length > 0U) ||
+        __atomic_load_n(&stopped, __ATOMIC_ACQUIRE)) {
+        return FAILURE;
+    }
+    uint32_t words = (uint32_t)((length + 3U) / 4U);
+
+    /*
+     * Masked whatever FEATURE_LOCKING says: the interrupt may stop the RNG
+     * between the check of stopped and the write turning IE back on, which
+     * would start it again.
+     */
+    uint32_t primask = hal_irq_mask();
+    uint32_t first = taken;
+    if (__atomic_load_n(&committed, __ATOMIC_ACQUIRE) - first < words) {
+        hal_irq_restore(primask);
+        STAT_INC(stats.empty_reads);
+        return FAILURE;
+    }
+    uint8_t* out = (uint8_t*)buffer;
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t* slot = &pool[(first + i) & POOL_MASK];
+        size_t n = (length < 4U) ? length : 4U;
+        memcpy(out, slot, n);
+        *slot = 0;
+        out += n;
+        length -= n;
+    }
+    __atomic_store_n(&taken, first + words, __ATOMIC_RELEASE);
+    if (words > 0U && !__atomic_load_n(&stopped, __ATOMIC_ACQUIRE) &&
+        (REG_READ(RNG_REGS->CR) & RNG_CR_IE) == 0U) {
+        write_reg(&RNG_REGS->CR, RNG_CR_RNGEN | RNG_CR_IE);
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+size_t rng_available(void)
+{
+    return (size_t)(__atomic_load_n(&committed, __ATOMIC_ACQUIRE) - __atomic_load_n(&taken, __ATOMIC_ACQUIRE)) * 4U;
+}
+
+uint8_t rng_failed(void)
+{
+    return __atomic_load_n(&stopped, __ATOMIC_ACQUIRE);
+}
+
+void rng_init(void)
+{
+    uint32_t primask = hal_irq_mask();
+    REG_SET(HAL_RCC->AHB2ENR, RCC_AHB2ENR_RNGEN);
+    write_reg(&RNG_REGS->CR, 0);
+    memset(pool, 0, sizeof(pool));
+    staged = 0;
+    committed = 0;
+    taken = 0;
+    have_previous = 0;
+    reset_window();
+    failures = 0;
+    stopped = 0;
+    hal_nvic_enable(HASH_RNG_IRQN);
+    write_reg(&RNG_REGS->CR, RNG_CR_RNGEN | RNG_CR_IE);
+    hal_irq_restore(primask);
+}
+
+const rng_stats_t* rng_get_stats(void)
+{
+    return &stats;
+}
+
+static uint32_t rotl(uint32_t x, uint32_t k)
+{
+    return (x << k) | (x >> (32U - k));
+}
+
+void rng_prng_seed(rng_prng_t* prng, uint64_t seed)
+{
+    /* SplitMix64 is a bijection of its counter, so two outputs in a row are never both zero */
+    for (uint32_t i = 0; i < 2U; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        prng->s[2U * i] = (uint32_t)z;
+        prng->s[2U * i + 1U] = (uint32_t)(z >> 32);
+    }
+}
+
+status_t rng_prng_seed_from_pool(rng_prng_t* prng)
+{
+    /* The repetition test never lets four zero words through */
+    uint32_t s[4];
+    if (rng_getentropy(s, sizeof(s)) != SUCCESS) {
+        return FAILURE;
+    }
+    memcpy(prng->s, s, sizeof(s));
+    return SUCCESS;
+}
+
+uint32_t rng_prng_next(rng_prng_t* prng)
+{
+    uint32_t* s = prng->s;
+    uint32_t result = rotl(s[1] * 5U, 7) * 9U;
+    uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+    return result;
+}
+
+uint32_t rng_prng_below(rng_prng_t* prng, uint32_t bound)
+{
+    /* Lemire's multiply-and-shift, redrawing the few products that would favour small values */
+    uint64_t m = (uint64_t)rng_prng_next(prng) * bound;
+    if ((uint32_t)m < bound) {
+        uint32_t threshold = (0U - bound) % bound;
+        while ((uint32_t)m < threshold) {
+            m = (uint64_t)rng_prng_next(prng) * bound;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+#if defined(STM32F407xx)
+/* Shared with the HASH core, which has no handler of its own */
+void HASH_RNG_IRQHandler(void)
+{
+    rng_irq();
+#if CRYPTO_HW
+    hash_irq();
+#endif
+}
+#endif
@@ -0,0 +1,167 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An entropy pool filled from the RNG, and a fast PRNG seeded from it.
+ *
+ * The RNG's data-ready interrupt (HASH_RNG_IRQHandler, shared with the HASH
+ * core and defined here) moves each word into a ring of RNG_POOL_WORDS
+ * words, and stops itself by clearing IE when the ring is full;
+ * rng_getentropy takes words out without waiting and turns the interrupt
+ * back on. So the pool is refilled in the background after each read and
+ * costs nothing while nobody reads it.
+ *
+ * Words only become available after health tests. Each word is compared
+ * with the one before it, the first after the RNG is enabled serving only
+ * for the comparison (the FIPS 140-2 continuous test the reference manual
+ * asks for); and they are taken in windows of RNG_WINDOW_WORDS, which are
+ * accepted only if every bit position was seen both set and clear in the
+ * window, catching a stuck bit. A repeated word, a stuck window or a seed
+ * error from the RNG throws away the window in progress; seed errors also
+ * restart the RNG, as the reference manual says. RNG_MAX_FAILURES failures
+ * in a row, with no window accepted in between, stop the RNG: every
+ * rng_getentropy fails until rng_init runs again.
+ *
+ * rng_getentropy is meant for keys, nonces and seeds. Anything else that
+ * wants numbers quickly should seed an rng_prng_t (xoshiro128**) from it
+ * once; that is not for secrets.
+ *
+ * The RNG needs the 48 MHz PLL48CLK, which the clock set-up must provide.
+ */
+
+#ifndef RNG_POOL_WORDS
+#define RNG_POOL_WORDS 64U          /**< Pool size, a power of two larger than a window */
+#endif
+
+#ifndef RNG_WINDOW_WORDS
+#define RNG_WINDOW_WORDS 32U        /**< Words per stuck-bit test, and per addition to the pool */
+#endif
+
+#ifndef RNG_MAX_FAILURES
+#define RNG_MAX_FAILURES 3U
+#endif
+
+#define RNG_GETENTROPY_MAX 256U     /**< Most bytes one rng_getentropy call returns, as getentropy(3) */
+
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t SR;
+    volatile uint32_t DR;
+} rng_regs_t;
+
+#if !defined(STM32F407xx)
+extern rng_regs_t rng_sim_regs;
+#endif
+
+#define RNG_REGS HAL_PERIPH(rng_regs_t, 0x50060800U, rng_sim_regs)
+
+#define RNG_CR_RNGEN (1U << 2)
+#define RNG_CR_IE (1U << 3)
+
+#define RNG_SR_DRDY (1U << 0)
+#define RNG_SR_CECS (1U << 1)
+#define RNG_SR_SECS (1U << 2)
+#define RNG_SR_CEIS (1U << 5)       /**< Clock error, cleared by writing 0 */
+#define RNG_SR_SEIS (1U << 6)       /**< Seed error, cleared by writing 0 */
+
+typedef struct {
+    uint32_t words;             /**< Words accepted into the pool */
+    uint32_t repeats;           /**< Words equal to the one before */
+    uint32_t stuck_windows;     /**< Windows with a bit that never changed */
+    uint32_t seed_errors;
+    uint32_t clock_errors;
+    uint32_t empty_reads;       /**< rng_getentropy calls the pool could not cover */
+    uint32_t restarts;          /**< Times the RNG was disabled and enabled again */
+} rng_stats_t;
+
+/** xoshiro128** state; any value but all zeros. */
+typedef struct {
+    uint32_t s[4];
+} rng_prng_t;
+
+/**
+ * @brief Clocks and enables the RNG and its interrupt, emptying the pool.
+ * Also the way back from a stopped RNG.
+ */
+void rng_init(void);
+
+/**
+ * @brief Copies length bytes of tested entropy into buffer, without waiting.
+ * A length that is not a multiple of four still uses up whole words.
+ *
+ * @return FAILURE, taking nothing, if length is over RNG_GETENTROPY_MAX, the
+ * pool holds fewer bytes than asked for, or the RNG has stopped.
+ */
+status_t rng_getentropy(void* buffer, size_t length);
+
+/** Bytes rng_getentropy could return now. */
+size_t rng_available(void);
+
+/** Whether RNG_MAX_FAILURES health test failures in a row have stopped the RNG. */
+uint8_t rng_failed(void);
+
+/** RNG interrupt body (data ready, seed and clock errors); HASH_RNG_IRQHandler calls this. */
+void rng_irq(void);
+
+const rng_stats_t* rng_get_stats(void);
+
+/** Seeds prng from a 64-bit value, spread out by SplitMix64; the same seed gives the same numbers. */
+void rng_prng_seed(rng_prng_t* prng, uint64_t seed);
+
+/**
+ * @brief Seeds prng with 16 bytes from rng_getentropy.
+ *
+ * @return FAILURE, leaving prng as it was, if rng_getentropy does.
+ */
+status_t rng_prng_seed_from_pool(rng_prng_t* prng);
+
+/** The next 32 bits from prng. */
+uint32_t rng_prng_next(rng_prng_t* prng);
+
+/** A number below bound (which must not be 0), with every value equally likely. */
+uint32_t rng_prng_below(rng_prng_t* prng, uint32_t bound);
+
+#if !defined(STM32F407xx)
+/** Host model: a write to a register with side effects in the hardware. */
+void rng_sim_write(volatile uint32_t* reg, uint32_t value);
+
+/** Host model: a read of a register with side effects in the hardware (DR clears DRDY). */
+uint32_t rng_sim_read(volatile uint32_t* reg);
+
+/**
+ * @brief Host model: restarts the model's sequence. Words are xorshift32
+ * steps from seed (seed itself is never a word), so tests can predict them.
+ */
+void rng_sim_seed(uint32_t seed);
+
+/**
+ * @brief Host model: the RNG produces count words, each one interrupting if
+ * RNGEN and IE are set. With IE clear a word waits in DR, the next replacing
+ * it, and interrupts as soon as IE is set again.
+ */
+void rng_sim_generate(uint32_t count);
+
+/** Host model: bits in mask come out as in value until cleared with a mask of 0. */
+void rng_sim_stuck(uint32_t mask, uint32_t value);
+
+/** Host model: the next count words repeat the one before them. */
+void rng_sim_repeat(uint32_t count);
+
+/** Host model: the RNG reports a seed error (SECS and SEIS). */
+void rng_sim_seed_error(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RNG_H
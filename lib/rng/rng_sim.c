@@ -0,0 +1,100 @@
+#include "rng.h"
+
+#if !defined(STM32F407xx)
+
+/*
+ * The RNG as a xorshift32 sequence, one word per rng_sim_generate step,
+ * with faults laid over it: stuck bits, repeated words and seed errors.
+ * IE gates every interrupt, as in the hardware; setting it with a word or an
+ * error pending interrupts straight away.
+ */
+
+static uint32_t state = 1;
+static uint32_t last;
+static uint32_t stuck_mask;
+static uint32_t stuck_value;
+static uint32_t repeats;
+
+static void interrupt(void)
+{
+    rng_regs_t* regs = &rng_sim_regs;
+    uint32_t enabled = RNG_CR_RNGEN | RNG_CR_IE;
+    if ((regs->CR & enabled) == enabled && (regs->SR & (RNG_SR_DRDY | RNG_SR_CEIS | RNG_SR_SEIS))) {
+        rng_irq();
+    }
+}
+
+static uint32_t produce(void)
+{
+    if (repeats > 0U) {
+        repeats--;
+        return last;
+    }
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    last = (state & ~stuck_mask) | (stuck_value & stuck_mask);
+    return last;
+}
+
+void rng_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    rng_regs_t* regs = &rng_sim_regs;
+    if (reg == &regs->SR) {
+        /* Only CEIS and SEIS can be written, and only to clear them */
+        hal_reg_write(reg, regs->SR & (value | ~(RNG_SR_CEIS | RNG_SR_SEIS)));
+        return;
+    }
+    hal_reg_write(reg, value);
+    if (reg == &regs->CR) {
+        if ((value & RNG_CR_RNGEN) == 0U) {
+            /* Disabled: the word in DR is gone, and a fresh seed comes with the next enable */
+            regs->SR &= ~(RNG_SR_DRDY | RNG_SR_SECS);
+        }
+        interrupt();
+    }
+}
+
+uint32_t rng_sim_read(volatile uint32_t* reg)
+{
+    rng_regs_t* regs = &rng_sim_regs;
+    if (reg == &regs->DR) {
+        regs->SR &= ~RNG_SR_DRDY;
+    }
+    return *reg;
+}
+
+void rng_sim_seed(uint32_t seed)
+{
+    state = seed;
+    repeats = 0;
+}
+
+void rng_sim_generate(uint32_t count)
+{
+    rng_regs_t* regs = &rng_sim_regs;
+    for (uint32_t i = 0; i < count && (regs->CR & RNG_CR_RNGEN); i++) {
+        regs->DR = produce();
+        regs->SR |= RNG_SR_DRDY;
+        interrupt();
+    }
+}
+
+void rng_sim_stuck(uint32_t mask, uint32_t value)
+{
+    stuck_mask = mask;
+    stuck_value = value;
+}
+
+void rng_sim_repeat(uint32_t count)
+{
+    repeats = count;
+}
+
+void rng_sim_seed_error(void)
+{
+    rng_sim_regs.SR |= RNG_SR_SECS | RNG_SR_SEIS;
+    interrupt();
+}
+
+#endif
@@ -0,0 +1,349 @@
+#include "scheduler.h"
+#include "feature_hooks.h"
+#include "hal_reg.h"
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(STM32F407xx)
+#include <time.h>
+#endif
+
+#if (SCHED_ISR_QUEUE_LENGTH & (SCHED_ISR_QUEUE_LENGTH - 1)) != 0
+#error "SCHED_ISR_QUEUE_LENGTH must be a power of two"
+#endif
+
+#if SCHED_PRIORITIES > 32
+#error "SCHED_PRIORITIES must not exceed 32"
+#endif
+
+#define ISR_QUEUE_MASK (SCHED_ISR_QUEUE_LENGTH - 1U)
+
+#if defined(STM32F407xx)
+#define DEMCR (*(volatile uint32_t*)0xE000EDFCU)
+#define DEMCR_TRCENA (1U << 24)
+#define DWT_CTRL (*(volatile uint32_t*)0xE0001000U)
+#define DWT_CTRL_CYCCNTENA (1U << 0)
+#define DWT_CYCCNT (*(volatile uint32_t*)0xE0001004U)
+#endif
+
+/* Bounded MPSC queue: each cell's sequence tells producers and the consumer whose turn it is */
+typedef struct {
+    uint32_t sequence;
+    sched_task_t* task;
+    uint32_t events;
+} isr_cell_t;
+
+static list_t run_queues[SCHED_PRIORITIES];
+static uint32_t ready_mask;
+
+static isr_cell_t isr_cells[SCHED_ISR_QUEUE_LENGTH];
+static uint32_t isr_enqueue_pos;
+static uint32_t isr_dequeue_pos;
+
+static list_t timers; /* Ordered by deadline */
+static volatile uint32_t tick_count;
+
+static sched_idle_hook_t idle_hook;
+static sched_stats_t stats;
+
+static void default_idle(void)
+{
+#if defined(STM32F407xx)
+    /* WFI wakes on a pending interrupt even while PRIMASK masks it */
+    __asm volatile("dsb\n"
+                   "wfi"
+                   :
+                   :
+                   : "memory");
+#endif
+}
+
+uint32_t sched_cycles(void)
+{
+#if defined(STM32F407xx)
+    return DWT_CYCCNT;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#endif
+}
+
+status_t sched_init(void)
+{
+    for (uint32_t i = 0; i < SCHED_PRIORITIES; i++) {
+        ll_list_init(&run_queues[i]);
+    }
+    ready_mask = 0;
+
+    for (uint32_t i = 0; i < SCHED_ISR_QUEUE_LENGTH; i++) {
+        isr_cells[i].sequence = i;
+        isr_cells[i].task = NULL;
+    }
+    isr_enqueue_pos = 0;
+    isr_dequeue_pos = 0;
+
+    ll_list_init(&timers);
+    tick_count = 0;
+
+    idle_hook = default_idle;
+    memset(&stats, 0, sizeof(stats));
+
+#if defined(STM32F407xx)
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+    return SUCCESS;
+}
+
+status_t sched_task_init(sched_task_t* task, sched_handler_t handler, void* context, uint8_t priority)
+{
+    if (task == NULL || handler == NULL || priority >= SCHED_PRIORITIES) {
+        return FAILURE;
+    }
+    memset(task, 0, sizeof(*task));
+    task->node.data = task;
+    task->handler = handler;
+    task->context = context;
+    task->priority = priority;
+    return SUCCESS;
+}
+
+static void make_ready(sched_task_t* task, uint32_t events)
+{
+    task->pending |= events;
+    if (task->queued) {
+        return;
+    }
+    task->queued = 1;
+
+    list_t* queue = &run_queues[task->priority];
+    ll_list_insert_at_tail(queue, &task->node);
+    ready_mask |= 1UL << task->priority;
+
+    STAT_INC(stats.queue_depth[task->priority]);
+    STAT_MAX(stats.queue_peak[task->priority], stats.queue_depth[task->priority]);
+}
+
+status_t sched_post(sched_task_t* task, uint32_t events)
+{
+    if (task == NULL || task->handler == NULL) {
+        return FAILURE;
+    }
+    make_ready(task, events);
+    return SUCCESS;
+}
+
+status_t sched_post_from_isr(sched_task_t* task, uint32_t events)
+{
+    if (task == NULL) {
+        return FAILURE;
+    }
+
+    uint32_t pos = __atomic_load_n(&isr_enqueue_pos, __ATOMIC_RELAXED);
+    isr_cell_t* cell;
+    for (;;) {
+        cell = &isr_cells[pos & ISR_QUEUE_MASK];
+        uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(sequence - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&isr_enqueue_pos, &pos, pos + 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            STAT_INC(stats.isr_queue_overflows);
+            return FAILURE;
+        } else {
+            pos = __atomic_load_n(&isr_enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->task = task;
+    cell->events = events;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return SUCCESS;
+}
+
+static void drain_isr_queue(void)
+{
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t depth = __atomic_load_n(&isr_enqueue_pos, __ATOMIC_RELAXED) - isr_dequeue_pos;
+    STAT_MAX(stats.isr_queue_peak, depth);
+#endif
+
+    for (;;) {
+        isr_cell_t* cell = &isr_cells[isr_dequeue_pos & ISR_QUEUE_MASK];
+        uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        if ((int32_t)(sequence - (isr_dequeue_pos + 1)) < 0) {
+            return;
+        }
+        sched_task_t* task = cell->task;
+        uint32_t events = cell->events;
+        __atomic_store_n(&cell->sequence, isr_dequeue_pos + SCHED_ISR_QUEUE_LENGTH, __ATOMIC_RELEASE);
+        isr_dequeue_pos++;
+
+        make_ready(task, events);
+    }
+}
+
+static int isr_queue_empty(void)
+{
+    isr_cell_t* cell = &isr_cells[isr_dequeue_pos & ISR_QUEUE_MASK];
+    uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    return (int32_t)(sequence - (isr_dequeue_pos + 1)) < 0;
+}
+
+uint32_t sched_run_once(void)
+{
+    drain_isr_queue();
+    if (ready_mask == 0) {
+        return 0;
+    }
+
+    uint32_t priority = 31U - (uint32_t)__builtin_clz(ready_mask);
+    list_t* queue = &run_queues[priority];
+    sched_task_t* task = (sched_task_t*)ll_list_remove_head(queue)->data;
+    if (queue->head == NULL) {
+        ready_mask &= ~(1UL << priority);
+    }
+    STAT_DEC(stats.queue_depth[priority]);
+
+    uint32_t events = task->pending;
+    task->pending = 0;
+    task->queued = 0;
+
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t start = sched_cycles();
+    task->handler(task, events);
+    uint32_t elapsed = sched_cycles() - start;
+    task->stats.dispatches++;
+    task->stats.runtime_cycles += elapsed;
+    STAT_MAX(task->stats.max_cycles, elapsed);
+#else
+    task->handler(task, events);
+#endif
+
+    STAT_INC(stats.dispatches);
+    return 1;
+}
+
+void sched_run(void)
+{
+    for (;;) {
+        if (sched_run_once() != 0) {
+            continue;
+        }
+
+        /* Re-check with interrupts masked so a post cannot slip in before WFI */
+        uint32_t primask = hal_irq_mask();
+        if (ready_mask == 0 && isr_queue_empty()) {
+            STAT_INC(stats.idle_entries);
+            idle_hook();
+        }
+        hal_irq_restore(primask);
+    }
+}
+
+/* Wrap-safe: true if tick a is not after tick b */
+static inline int tick_reached(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) <= 0;
+}
+
+static void timer_insert(sched_timer_t* timer)
+{
+    node_t* prev = NULL;
+    for (node_t* n = timers.head; n != NULL && tick_reached(((sched_timer_t*)n->data)->deadline, timer->deadline);
+         n = n->next) {
+        prev = n;
+    }
+    ll_list_insert_after(&timers, prev, &timer->node);
+    timer->active = 1;
+}
+
+status_t sched_timer_start(sched_timer_t* timer, sched_task_t* task, uint32_t events, uint32_t delay_ticks,
+                           uint32_t period_ticks)
+{
+    if (timer == NULL || task == NULL || delay_ticks == 0) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (timer->active) {
+        ll_list_remove(&timers, &timer->node);
+    }
+    timer->node.data = timer;
+    timer->task = task;
+    timer->events = events;
+    timer->period = period_ticks;
+    timer->deadline = tick_count + delay_ticks;
+    timer_insert(timer);
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+status_t sched_timer_stop(sched_timer_t* timer)
+{
+    if (timer == NULL) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (timer->active) {
+        ll_list_remove(&timers, &timer->node);
+        timer->active = 0;
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+void sched_tick_announce(uint32_t ticks)
+{
+    uint32_t primask = hal_irq_mask();
+    tick_count += ticks;
+
+    while (timers.head != NULL && tick_reached(((sched_timer_t*)timers.head->data)->deadline, tick_count)) {
+        sched_timer_t* timer = (sched_timer_t*)ll_list_remove_head(&timers)->data;
+        timer->active = 0;
+        sched_post_from_isr(timer->task, timer->events);
+        STAT_INC(stats.timer_expiries);
+        if (timer->period != 0) {
+            timer->deadline += timer->period;
+            timer_insert(timer);
+        }
+    }
+    hal_irq_restore(primask);
+}
+
+uint32_t sched_ticks(void)
+{
+    return tick_count;
+}
+
+uint32_t sched_idle_ticks(void)
+{
+    uint32_t primask = hal_irq_mask();
+    uint32_t ticks;
+    if (ready_mask != 0 || !isr_queue_empty()) {
+        ticks = 0;
+    } else if (timers.head == NULL) {
+        ticks = UINT32_MAX;
+    } else {
+        uint32_t deadline = ((sched_timer_t*)timers.head->data)->deadline;
+        ticks = tick_reached(deadline, tick_count) ? 0 : deadline - tick_count;
+    }
+    hal_irq_restore(primask);
+    return ticks;
+}
+
+void sched_set_idle_hook(sched_idle_hook_t hook)
+{
+    idle_hook = (hook != NULL) ? hook : default_idle;
+}
+
+const sched_stats_t* sched_get_stats(void)
+{
+    return &stats;
+}
@@ -0,0 +1,192 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "build_config.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Run-to-completion event scheduler.
+ *
+ * Tasks are handlers that run once per dispatch with every event posted to
+ * them since their previous run, and always return. Ready tasks wait in one
+ * FIFO run queue per priority; the highest non-empty queue is found in O(1)
+ * from a bitmap. Interrupt handlers never touch the run queues: they post
+ * through a lock-free queue that the main loop drains before each dispatch.
+ * With nothing to do, the loop calls the idle hook (WFI by default).
+ *
+ * Timers post events to a task after a number of ticks. The tick source
+ * calls sched_tick_announce(); a tickless idle hook asks sched_idle_ticks()
+ * how long it may sleep.
+ */
+
+/** Number of priority levels; higher numbers run first. At most 32. */
+#ifndef SCHED_PRIORITIES
+#define SCHED_PRIORITIES 8
+#endif
+
+/** Capacity of the ISR post queue, a power of two. */
+#ifndef SCHED_ISR_QUEUE_LENGTH
+#define SCHED_ISR_QUEUE_LENGTH 32
+#endif
+
+typedef struct sched_task sched_task_t;
+
+/**
+ * @brief Task handler, called with the events accumulated since its last run.
+ */
+typedef void (*sched_handler_t)(sched_task_t* task, uint32_t events);
+
+/**
+ * @brief Idle hook, called with interrupts masked when no work is pending.
+ * It must return once an interrupt is pending.
+ */
+typedef void (*sched_idle_hook_t)(void);
+
+typedef struct {
+    uint32_t dispatches;
+    uint64_t runtime_cycles;
+    uint32_t max_cycles;
+} sched_task_stats_t;
+
+struct sched_task {
+    node_t node;
+    sched_handler_t handler;
+    void* context;
+    uint8_t priority;
+    uint8_t queued;
+    uint32_t pending;
+#if BUILD_CFG_FEATURE_STATS
+    sched_task_stats_t stats;
+#endif
+};
+
+typedef struct sched_timer {
+    node_t node;            /* Link in the deadline-ordered timer list; node.data = timer */
+    sched_task_t* task;
+    uint32_t events;
+    uint32_t deadline;
+    uint32_t period;        /* Zero for one-shot */
+    uint8_t active;
+} sched_timer_t;
+
+typedef struct {
+    uint32_t dispatches;
+    uint32_t idle_entries;
+    uint32_t timer_expiries;
+    uint32_t queue_depth[SCHED_PRIORITIES];
+    uint32_t queue_peak[SCHED_PRIORITIES];
+    uint32_t isr_queue_peak;
+    uint32_t isr_queue_overflows;
+} sched_stats_t;
+
+/**
+ * @brief Resets the scheduler: empties every queue and restores the default idle hook.
+ *
+ * @return status_t SUCCESS.
+ */
+status_t sched_init(void);
+
+/**
+ * @brief Prepares a task; it becomes ready the first time an event is posted to it.
+ *
+ * @param task Task to initialize.
+ * @param handler Handler run on dispatch.
+ * @param context Opaque pointer for the handler.
+ * @param priority Priority, 0 (lowest) to SCHED_PRIORITIES - 1.
+ * @return status_t SUCCESS, or FAILURE on invalid arguments.
+ */
+status_t sched_task_init(sched_task_t* task, sched_handler_t handler, void* context, uint8_t priority);
+
+/**
+ * @brief Posts events to a task from thread context (including handlers).
+ *
+ * @param task Target task.
+ * @param events Event bits, OR-ed into the pending set.
+ * @return status_t SUCCESS, or FAILURE on invalid arguments.
+ */
+status_t sched_post(sched_task_t* task, uint32_t events);
+
+/**
+ * @brief Posts events to a task from any interrupt priority; lock-free.
+ *
+ * @param task Target task.
+ * @param events Event bits, OR-ed into the pending set when drained.
+ * @return status_t SUCCESS, or FAILURE if the ISR queue is full.
+ */
+status_t sched_post_from_isr(sched_task_t* task, uint32_t events);
+
+/**
+ * @brief Drains the ISR queue and dispatches the highest priority ready task.
+ *
+ * @return uint32_t 1 if a task was dispatched, 0 if there was nothing to do.
+ */
+uint32_t sched_run_once(void);
+
+/**
+ * @brief Runs the event loop forever, idling when there is no work.
+ */
+void sched_run(void) __attribute__((noreturn));
+
+/**
+ * @brief Replaces the idle hook; NULL restores the default (WFI on target).
+ */
+void sched_set_idle_hook(sched_idle_hook_t hook);
+
+/**
+ * @brief Starts (or restarts) a timer that posts events to a task.
+ *
+ * @param timer Timer, owned by the caller.
+ * @param task Task to post to on expiry.
+ * @param events Event bits to post.
+ * @param delay_ticks Ticks until the first expiry, at least 1.
+ * @param period_ticks Ticks between later expiries, or 0 for a one-shot timer.
+ * @return status_t SUCCESS, or FAILURE on invalid arguments.
+ */
+status_t sched_timer_start(sched_timer_t* timer, sched_task_t* task, uint32_t events, uint32_t delay_ticks,
+                           uint32_t period_ticks);
+
+/**
+ * @brief Stops a timer; stopping an inactive timer is harmless.
+ *
+ * @return status_t SUCCESS, or FAILURE if timer is NULL.
+ */
+status_t sched_timer_stop(sched_timer_t* timer);
+
+/**
+ * @brief Advances scheduler time, posting the events of every timer that expires.
+ * Called from the tick interrupt, or with the ticks skipped by a tickless sleep.
+ */
+void sched_tick_announce(uint32_t ticks);
+
+/**
+ * @brief Returns the scheduler tick counter.
+ */
+uint32_t sched_ticks(void);
+
+/**
+ * @brief Returns how many ticks the system may sleep: zero if work is pending,
+ * UINT32_MAX if no timer is running.
+ */
+uint32_t sched_idle_ticks(void);
+
+/**
+ * @brief Returns the scheduler wide statistics.
+ */
+const sched_stats_t* sched_get_stats(void);
+
+/**
+ * @brief Free-running cycle counter used for runtime statistics (DWT on target,
+ * nanoseconds on the host).
+ */
+uint32_t sched_cycles(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCHEDULER_H
@@ -0,0 +1,491 @@
+#include "sdio.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define SDIO_IRQN 49U
+#define RCC_APB2ENR_SDIOEN (1U << 11)
+
+/* SDIO_CK = SDIOCLK / (CLKDIV + 2): 400 kHz for identification */
+#define INIT_CLKDIV (SDIO_CLOCK_HZ / SDIO_INIT_CLOCK_HZ - 2U)
+#define BLOCK_SIZE_CODE 9U
+#define BLOCK_WORDS (SDIO_BLOCK_SIZE / 4U)
+
+/* Data timeouts from the physical layer specification; 500 ms covers SDXC writes */
+#define READ_TIMEOUT_MS 100U
+#define WRITE_TIMEOUT_MS 500U
+
+/* ACMD41 1 ms apart, for the 1 s a card may take to power up */
+#define OP_COND_RETRIES 1000U
+
+/* A CMD13 round trip takes about 5 us at 24 MHz, so this is over 500 ms of programming */
+#define READY_POLLS 100000U
+
+#define PENDING_DATA (1U << 0)
+#define PENDING_DMA (1U << 1)
+
+/* Stands for a DMA error in data_status, next to the SDIO_STA flags */
+#define DATA_DMA_ERROR (1U << 31)
+
+#define RESPONSE_FLAGS (SDIO_STA_CCRCFAIL | SDIO_STA_CTIMEOUT | SDIO_STA_CMDREND | SDIO_STA_CMDSENT)
+
+#if !defined(STM32F407xx)
+sdio_regs_t sdio_sim_regs;
+#endif
+
+static sdio_t* active;
+
+/* Commands and data phases start on register writes; the host model runs the card from there */
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    sdio_sim_write(reg, value);
+#endif
+}
+
+static void delay_ms(const sdio_t* sd, uint32_t ms)
+{
+    for (volatile uint32_t i = sd->delay_loops * ms; i > 0U; i--) {
+    }
+}
+
+/* ----------------------------------------------------------- commands --- */
+
+/*
+ * Sends a command and waits for the command path to finish with it.
+ * response is SDIO_CMD_WAITRESP_SHORT, SDIO_CMD_WAITRESP_LONG or 0.
+ */
+static status_t command(sdio_t* sd, uint32_t index, uint32_t argument, uint32_t response)
+{
+    sdio_regs_t* regs = sd->regs;
+    write_reg(&regs->ICR, RESPONSE_FLAGS);
+    write_reg(&regs->ARG, argument);
+    write_reg(&regs->CMD, index | response | SDIO_CMD_CPSMEN);
+
+    /* The hardware times a missing response out after 64 clocks, so this ends */
+    uint32_t done = (response != 0U) ? (SDIO_STA_CMDREND | SDIO_STA_CCRCFAIL | SDIO_STA_CTIMEOUT) : SDIO_STA_CMDSENT;
+    uint32_t sta;
+    do {
+        sta = REG_READ(regs->STA);
+    } while ((sta & done) == 0U);
+    write_reg(&regs->ICR, RESPONSE_FLAGS);
+
+    if (sta & SDIO_STA_CTIMEOUT) {
+        return FAILURE;
+    }
+    /* R3 carries no CRC, so the controller always reports one failed */
+    if ((sta & SDIO_STA_CCRCFAIL) && index != SD_ACMD_SD_SEND_OP_COND) {
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/* A command with an R1 response, checked for the card's error bits */
+static status_t command_r1(sdio_t* sd, uint32_t index, uint32_t argument)
+{
+    if (command(sd, index, argument, SDIO_CMD_WAITRESP_SHORT) != SUCCESS ||
+        (REG_READ(sd->regs->RESPCMD) & 0x3FU) != index || (REG_READ(sd->regs->RESP[0]) & SD_R1_ERRORS) != 0U) {
+        STAT_INC(sd->stats.command_errors);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+static status_t app_command(sdio_t* sd, uint32_t index, uint32_t argument, uint32_t response)
+{
+    if (command_r1(sd, SD_CMD_APP_CMD, sd->rca) != SUCCESS ||
+        (REG_READ(sd->regs->RESP[0]) & SD_R1_APP_CMD) == 0U) {
+        return FAILURE;
+    }
+    if (command(sd, index, argument, response) != SUCCESS) {
+        STAT_INC(sd->stats.command_errors);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/* Waits out the programming of the last write: CMD13 until the card is back in tran and ready for data */
+static status_t wait_ready(sdio_t* sd)
+{
+    if (!sd->programming) {
+        return SUCCESS;
+    }
+    for (uint32_t polls = 0; polls < READY_POLLS; polls++) {
+        if (command_r1(sd, SD_CMD_SEND_STATUS, sd->rca) != SUCCESS) {
+            return FAILURE;
+        }
+        uint32_t status = REG_READ(sd->regs->RESP[0]);
+        if ((status & SD_R1_READY_FOR_DATA) &&
+            ((status & SD_R1_STATE_Msk) >> SD_R1_STATE_Pos) == SD_STATE_TRAN) {
+            sd->programming = 0;
+            return SUCCESS;
+        }
+        STAT_INC(sd->stats.busy_polls);
+    }
+    return FAILURE;
+}
+
+/* ------------------------------------------------------- identification --- */
+
+static uint32_t csd_blocks(const uint32_t* csd)
+{
+    switch (csd[0] >> 30) {
+    case 0: {
+        /* Version 1: (C_SIZE + 1) * 2^(C_SIZE_MULT + 2) blocks of 2^READ_BL_LEN bytes */
+        uint32_t read_bl_len = (csd[1] >> 16) & 0xFU;
+        uint32_t c_size = ((csd[1] & 0x3FFU) << 2) | (csd[2] >> 30);
+        uint32_t mult = (csd[2] >> 15) & 7U;
+        if (read_bl_len < 9U || read_bl_len > 11U) {
+            return 0;
+        }
+        return (c_size + 1U) << (mult + 2U + read_bl_len - 9U);
+    }
+    case 1: {
+        /* Version 2: C_SIZE in bits 69:48, in units of 512 KiB */
+        uint32_t c_size = ((csd[1] & 0x3FU) << 16) | (csd[2] >> 16);
+        return (c_size + 1U) * 1024U;
+    }
+    default:
+        return 0;
+    }
+}
+
+static uint32_t clock_div(uint32_t max_hz)
+{
+    if (max_hz == 0U) {
+        return 0;
+    }
+    for (uint32_t div = 0; div < SDIO_CLKCR_CLKDIV_Msk; div++) {
+        if (SDIO_CLOCK_HZ / (div + 2U) <= max_hz) {
+            return div;
+        }
+    }
+    return SDIO_CLKCR_CLKDIV_Msk;
+}
+
+static void read_long_response(const sdio_t* sd, uint32_t* out)
+{
+    for (uint32_t i = 0; i < 4U; i++) {
+        out[i] = REG_READ(sd->regs->RESP[i]);
+    }
+}
+
+/* Physical layer specification 4.2: from idle to the transfer state, then up to speed and width */
+static status_t identify(sdio_t* sd)
+{
+    sdio_regs_t* regs = sd->regs;
+    (void)command(sd, SD_CMD_GO_IDLE_STATE, 0, 0);
+
+    /* A version 1 card does not answer CMD8; a version 2 one echoes the pattern if the voltage suits it */
+    uint32_t hcs = 0;
+    if (command(sd, SD_CMD_SEND_IF_COND, SD_CHECK_PATTERN, SDIO_CMD_WAITRESP_SHORT) == SUCCESS) {
+        if ((REG_READ(regs->RESP[0]) & 0xFFFU) != SD_CHECK_PATTERN) {
+            return FAILURE;
+        }
+        hcs = SD_OCR_HCS;
+    }
+
+    uint32_t ocr = 0;
+    for (uint32_t retries = 0; (ocr & SD_OCR_READY) == 0U; retries++) {
+        if (retries == OP_COND_RETRIES) {
+            return FAILURE;
+        }
+        if (retries != 0U) {
+            delay_ms(sd, 1);
+        }
+        if (app_command(sd, SD_ACMD_SD_SEND_OP_COND, SD_OCR_VOLTAGE_3V3 | hcs, SDIO_CMD_WAITRESP_SHORT) !=
+            SUCCESS) {
+            return FAILURE;
+        }
+        ocr = REG_READ(regs->RESP[0]);
+    }
+    sd->high_capacity = (ocr & SD_OCR_HCS) != 0U;
+
+    if (command(sd, SD_CMD_ALL_SEND_CID, 0, SDIO_CMD_WAITRESP_LONG) != SUCCESS) {
+        return FAILURE;
+    }
+    read_long_response(sd, sd->cid);
+    if (command(sd, SD_CMD_SEND_RELATIVE_ADDR, 0, SDIO_CMD_WAITRESP_SHORT) != SUCCESS) {
+        return FAILURE;
+    }
+    sd->rca = REG_READ(regs->RESP[0]) & 0xFFFF0000U;
+    if (command(sd, SD_CMD_SEND_CSD, sd->rca, SDIO_CMD_WAITRESP_LONG) != SUCCESS) {
+        return FAILURE;
+    }
+    read_long_response(sd, sd->csd);
+    sd->blocks = csd_blocks(sd->csd);
+    if (sd->blocks == 0U || command_r1(sd, SD_CMD_SELECT_CARD, sd->rca) != SUCCESS) {
+        return FAILURE;
+    }
+
+    /* Standard capacity cards count bytes and may default to another block length */
+    if (!sd->high_capacity && command_r1(sd, SD_CMD_SET_BLOCKLEN, SDIO_BLOCK_SIZE) != SUCCESS) {
+        return FAILURE;
+    }
+    /* The card-detect pull-up on D3 would skew the data line once the bus is 4 bits wide */
+    if (app_command(sd, SD_ACMD_SET_CLR_CARD_DETECT, 0, SDIO_CMD_WAITRESP_SHORT) != SUCCESS) {
+        return FAILURE;
+    }
+    sd->clkcr = SDIO_CLKCR_CLKEN | clock_div(sd->config.max_clock_hz);
+    if (!sd->config.one_bit) {
+        if (app_command(sd, SD_ACMD_SET_BUS_WIDTH, 2, SDIO_CMD_WAITRESP_SHORT) != SUCCESS) {
+            return FAILURE;
+        }
+        sd->clkcr |= SDIO_CLKCR_WIDBUS_4;
+    }
+    /* No hardware flow control: the errata sheet has it glitching the clock on this part */
+    write_reg(&regs->CLKCR, sd->clkcr);
+    return SUCCESS;
+}
+
+/* ---------------------------------------------------------- transfers --- */
+
+static void dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    sdio_t* sd = (sdio_t*)context;
+    if (event == DMA_EVENT_ERROR) {
+        sd->data_status |= DATA_DMA_ERROR;
+        sd->pending = 0;
+    } else if (event == DMA_EVENT_COMPLETE) {
+        sd->pending &= (uint8_t)~PENDING_DMA;
+    }
+}
+
+void sdio_irq(void)
+{
+    sdio_t* sd = active;
+    if (sd == NULL) {
+        return;
+    }
+    uint32_t sta = REG_READ(sd->regs->STA) & (SDIO_STA_DATA_ERRORS | SDIO_STA_DATAEND | SDIO_STA_DBCKEND);
+    write_reg(&sd->regs->ICR, sta);
+    if (sta & SDIO_STA_DATA_ERRORS) {
+        sd->data_status |= sta & SDIO_STA_DATA_ERRORS;
+        sd->pending = 0;
+    } else if (sta & SDIO_STA_DATAEND) {
+        sd->pending &= (uint8_t)~PENDING_DATA;
+    }
+}
+
+static uint32_t timeout_clocks(const sdio_t* sd, uint32_t ms)
+{
+    uint32_t clock_hz = SDIO_CLOCK_HZ / ((sd->clkcr & SDIO_CLKCR_CLKDIV_Msk) + 2U);
+    return clock_hz / 1000U * ms;
+}
+
+/* One CMD17/18/24/25 and its data phase; count is at most SDIO_MAX_TRANSFER_BLOCKS */
+static status_t transfer(sdio_t* sd, uint32_t lba, uint8_t* data, uint32_t count, uint8_t write)
+{
+    sdio_regs_t* regs = sd->regs;
+    uint8_t multiple = count > 1U;
+    if (wait_ready(sd) != SUCCESS) {
+        return FAILURE;
+    }
+    if (write && multiple) {
+        if (app_command(sd, SD_ACMD_SET_WR_BLK_ERASE_COUNT, count, SDIO_CMD_WAITRESP_SHORT) != SUCCESS) {
+            return FAILURE;
+        }
+        STAT_INC(sd->stats.pre_erases);
+    }
+
+    /* Both directions share the stream; the DMA has to be ready before the data path asks for it */
+    dma_set_direction(&sd->dma, write ? DMA_MEMORY_TO_PERIPH : DMA_PERIPH_TO_MEMORY);
+    sd->data_status = 0;
+    sd->pending = PENDING_DATA | PENDING_DMA;
+    dma_start(&sd->dma, (uintptr_t)&regs->FIFO[0], data, count * BLOCK_WORDS);
+    write_reg(&regs->DTIMER, timeout_clocks(sd, write ? WRITE_TIMEOUT_MS : READ_TIMEOUT_MS));
+    write_reg(&regs->DLEN, count * SDIO_BLOCK_SIZE);
+
+    uint32_t address = sd->high_capacity ? lba : lba * SDIO_BLOCK_SIZE;
+    uint32_t dctrl = SDIO_DCTRL_DTEN | SDIO_DCTRL_DMAEN | (BLOCK_SIZE_CODE << SDIO_DCTRL_DBLOCKSIZE_Pos);
+    status_t result;
+    if (write) {
+        /* The card takes the command before the host starts sending */
+        result = command_r1(sd, multiple ? SD_CMD_WRITE_MULTIPLE_BLOCK : SD_CMD_WRITE_BLOCK, address);
+        if (result == SUCCESS) {
+            write_reg(&regs->DCTRL, dctrl);
+        }
+    } else {
+        /* The receiving data path is armed first, as the card may answer right after the command */
+        write_reg(&regs->DCTRL, dctrl | SDIO_DCTRL_DTDIR);
+        result = command_r1(sd, multiple ? SD_CMD_READ_MULTIPLE_BLOCK : SD_CMD_READ_SINGLE_BLOCK, address);
+    }
+    uint8_t started = result == SUCCESS;
+
+    if (started) {
+        /* Ends with DATAEND and the DMA's completion, or the first error of either */
+        while (sd->pending != 0U) {
+        }
+        if (sd->data_status != 0U) {
+            STAT_INC(sd->stats.data_errors);
+            result = FAILURE;
+        }
+    }
+    if (result != SUCCESS) {
+        write_reg(&regs->DCTRL, 0);
+        dma_stop(&sd->dma);
+        write_reg(&regs->ICR, SDIO_STA_DATA_ERRORS | SDIO_STA_DATAEND | SDIO_STA_DBCKEND);
+        sd->pending = 0;
+    }
+    /* Multi-block transfers run until stopped, finished or not */
+    if (started && multiple && command_r1(sd, SD_CMD_STOP_TRANSMISSION, 0) != SUCCESS) {
+        result = FAILURE;
+    }
+    if (write && started) {
+        sd->programming = 1;
+    }
+
+    if (result == SUCCESS) {
+        if (write) {
+            STAT_INC(sd->stats.write_commands);
+            STAT_ADD(sd->stats.blocks_written, count);
+        } else {
+            STAT_INC(sd->stats.read_commands);
+            STAT_ADD(sd->stats.blocks_read, count);
+        }
+    }
+    return result;
+}
+
+static status_t transfer_all(sdio_t* sd, uint32_t lba, uint8_t* data, uint32_t count, uint8_t write)
+{
+    if (sd == NULL || sd->regs == NULL || data == NULL || ((uintptr_t)data & 3U) != 0U || count == 0U ||
+        lba >= sd->blocks || count > sd->blocks - lba) {
+        return FAILURE;
+    }
+    while (count > 0U) {
+        uint32_t run = (count < SDIO_MAX_TRANSFER_BLOCKS) ? count : SDIO_MAX_TRANSFER_BLOCKS;
+        if (transfer(sd, lba, data, run, write) != SUCCESS) {
+            return FAILURE;
+        }
+        lba += run;
+        data += run * SDIO_BLOCK_SIZE;
+        count -= run;
+    }
+    return SUCCESS;
+}
+
+status_t sdio_read(sdio_t* sd, uint32_t lba, void* data, uint32_t count)
+{
+    return transfer_all(sd, lba, (uint8_t*)data, count, 0);
+}
+
+status_t sdio_write(sdio_t* sd, uint32_t lba, const void* data, uint32_t count)
+{
+    /* The DMA only reads from data */
+    return transfer_all(sd, lba, (uint8_t*)(uintptr_t)data, count, 1);
+}
+
+status_t sdio_sync(sdio_t* sd)
+{
+    if (sd == NULL || sd->regs == NULL) {
+        return FAILURE;
+    }
+    return wait_ready(sd);
+}
+
+uint32_t sdio_blocks(const sdio_t* sd)
+{
+    return sd->blocks;
+}
+
+/* ------------------------------------------------------------- control --- */
+
+static status_t claim_stream(sdio_t* sd)
+{
+    /* Words in bursts of four both sides, as RM0090 31.3.2 requires for the SDIO FIFO */
+    dma_config_t dma_config;
+    memset(&dma_config, 0, sizeof(dma_config));
+    dma_config.channel = SDIO_DMA_CHANNEL;
+    dma_config.priority = 3;
+    dma_config.direction = DMA_PERIPH_TO_MEMORY;
+    dma_config.mode = DMA_MODE_NORMAL;
+    dma_config.peripheral_size = 4;
+    dma_config.memory_size = 4;
+    dma_config.memory_increment = 1;
+    dma_config.fifo_threshold = 4;
+    dma_config.peripheral_burst = 4;
+    dma_config.memory_burst = 4;
+    dma_config.peripheral_flow = 1;
+    dma_config.callback = dma_event;
+    dma_config.context = sd;
+    return dma_stream_init(&sd->dma, SDIO_DMA_CONTROLLER, SDIO_DMA_STREAM, &dma_config);
+}
+
+status_t sdio_init(sdio_t* sd, const sdio_config_t* config)
+{
+    if (sd == NULL || config == NULL || config->hclk_hz == 0U) {
+        return FAILURE;
+    }
+
+    /* Claiming the driver may race with another init from a task */
+    uint32_t primask = hal_irq_mask();
+    if (active != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    active = sd;
+    hal_irq_restore(primask);
+
+    memset(sd, 0, sizeof(*sd));
+    sd->config = *config;
+    /* About four cycles per busy-wait iteration */
+    sd->delay_loops = config->hclk_hz / 4000U;
+    if (claim_stream(sd) != SUCCESS) {
+        active = NULL;
+        return FAILURE;
+    }
+    sd->regs = SDIO_REGS;
+    sdio_regs_t* regs = sd->regs;
+
+    REG_SET(HAL_RCC->APB2ENR, RCC_APB2ENR_SDIOEN);
+    write_reg(&regs->CLKCR, SDIO_CLKCR_CLKEN | INIT_CLKDIV);
+    write_reg(&regs->POWER, SDIO_POWER_ON);
+    write_reg(&regs->ICR, SDIO_ICR_STATIC);
+    write_reg(&regs->MASK, SDIO_STA_DATA_ERRORS | SDIO_STA_DATAEND);
+    hal_nvic_enable(SDIO_IRQN);
+    /* 74 clocks before the first command; 185 us at 400 kHz */
+    delay_ms(sd, 1);
+
+    if (identify(sd) != SUCCESS) {
+        sdio_deinit(sd);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+void sdio_deinit(sdio_t* sd)
+{
+    if (sd == NULL || sd->regs == NULL) {
+        return;
+    }
+    /* Power is only cut once the card has finished programming */
+    (void)wait_ready(sd);
+    hal_nvic_disable(SDIO_IRQN);
+    dma_stream_release(&sd->dma);
+
+    sdio_regs_t* regs = sd->regs;
+    write_reg(&regs->MASK, 0);
+    write_reg(&regs->DCTRL, 0);
+    write_reg(&regs->CLKCR, 0);
+    write_reg(&regs->POWER, 0);
+    REG_CLEAR(HAL_RCC->APB2ENR, RCC_APB2ENR_SDIOEN);
+    sd->regs = NULL;
+
+    uint32_t primask = hal_irq_mask();
+    active = NULL;
+    hal_irq_restore(primask);
+}
+
+const sdio_stats_t* sdio_get_stats(const sdio_t* sd)
+{
+    return &sd->stats;
+}
+
+#if defined(STM32F407xx)
+void SDIO_IRQHandler(void) { sdio_irq(); }
+#endif
@@ -0,0 +1,290 @@
+#ifndef SDIO_H
+#define SDIO_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stdint.h>
+#if !defined(STM32F407xx)
+#include <stdio.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SD memory cards on the SDIO host controller, 4-bit bus, DMA data path.
+ *
+ * sdio_init() takes the card through identification at 400 kHz, selects
+ * it, widens the bus and raises the clock. Standard (SDSC, byte-addressed)
+ * and high capacity (SDHC/SDXC, block-addressed) cards are both handled;
+ * the block interface below always counts 512-byte blocks.
+ *
+ * Reads and writes of more than one block are single CMD18/CMD25
+ * transfers, so the card sees one command and one stop for the whole run
+ * rather than one per block. A multi-block write is preceded by ACMD23
+ * with its length: the card may pre-erase that many blocks and program the
+ * run without erasing along the way. Data moves between the card and
+ * memory by DMA2 stream 6 with the SDIO as flow controller; the SDIO
+ * interrupt reports the end of the data phase.
+ *
+ * Calls block until their data phase has finished. After a write the card
+ * goes on programming on its own; the driver does not wait for it then but
+ * before the next command, so the caller's work overlaps the programming
+ * time. sdio_sync() waits for it explicitly.
+ *
+ * CMD, CK and D0-D3 must be set to their alternate function by the
+ * application, and the 48 MHz clock (PLL Q) running.
+ */
+
+typedef struct {
+    volatile uint32_t POWER;
+    volatile uint32_t CLKCR;
+    volatile uint32_t ARG;
+    volatile uint32_t CMD;
+    volatile uint32_t RESPCMD;
+    volatile uint32_t RESP[4];
+    volatile uint32_t DTIMER;
+    volatile uint32_t DLEN;
+    volatile uint32_t DCTRL;
+    volatile uint32_t DCOUNT;
+    volatile uint32_t STA;
+    volatile uint32_t ICR;
+    volatile uint32_t MASK;
+    uint32_t reserved0[2];
+    volatile uint32_t FIFOCNT;
+    uint32_t reserved1[13];
+    volatile uint32_t FIFO[32];
+} sdio_regs_t;
+
+#if !defined(STM32F407xx)
+extern sdio_regs_t sdio_sim_regs;
+#endif
+
+#define SDIO_REGS HAL_PERIPH(sdio_regs_t, 0x40012C00U, sdio_sim_regs)
+
+#define SDIO_BLOCK_SIZE 512U
+#define SDIO_CLOCK_HZ 48000000U             /**< SDIOCLK, from PLL Q */
+#define SDIO_INIT_CLOCK_HZ 400000U
+#define SDIO_DMA_CONTROLLER 2U
+#define SDIO_DMA_STREAM 6U                  /**< Shared with USART6 TX; stream 3 is SPI1 TX */
+#define SDIO_DMA_CHANNEL 4U
+
+/** Blocks per CMD18/CMD25; longer requests are split. 65535 words at most per DMA start. */
+#define SDIO_MAX_TRANSFER_BLOCKS 256U
+
+#define SDIO_POWER_ON 3U
+
+#define SDIO_CLKCR_CLKDIV_Msk 0xFFU
+#define SDIO_CLKCR_CLKEN (1U << 8)
+#define SDIO_CLKCR_PWRSAV (1U << 9)
+#define SDIO_CLKCR_BYPASS (1U << 10)
+#define SDIO_CLKCR_WIDBUS_4 (1U << 11)
+#define SDIO_CLKCR_HWFC_EN (1U << 14)
+
+#define SDIO_CMD_WAITRESP_SHORT (1U << 6)
+#define SDIO_CMD_WAITRESP_LONG (3U << 6)
+#define SDIO_CMD_CPSMEN (1U << 10)
+
+#define SDIO_DCTRL_DTEN (1U << 0)
+#define SDIO_DCTRL_DTDIR (1U << 1)          /**< Card to controller */
+#define SDIO_DCTRL_DMAEN (1U << 3)
+#define SDIO_DCTRL_DBLOCKSIZE_Pos 4U
+
+#define SDIO_STA_CCRCFAIL (1U << 0)
+#define SDIO_STA_DCRCFAIL (1U << 1)
+#define SDIO_STA_CTIMEOUT (1U << 2)
+#define SDIO_STA_DTIMEOUT (1U << 3)
+#define SDIO_STA_TXUNDERR (1U << 4)
+#define SDIO_STA_RXOVERR (1U << 5)
+#define SDIO_STA_CMDREND (1U << 6)
+#define SDIO_STA_CMDSENT (1U << 7)
+#define SDIO_STA_DATAEND (1U << 8)
+#define SDIO_STA_STBITERR (1U << 9)
+#define SDIO_STA_DBCKEND (1U << 10)
+#define SDIO_STA_CMDACT (1U << 11)
+#define SDIO_STA_DATA_ERRORS \
+    (SDIO_STA_DCRCFAIL | SDIO_STA_DTIMEOUT | SDIO_STA_TXUNDERR | SDIO_STA_RXOVERR | SDIO_STA_STBITERR)
+#define SDIO_ICR_STATIC 0x000007FFU         /**< CCRCFAIL through DBCKEND */
+
+/** Commands */
+#define SD_CMD_GO_IDLE_STATE 0U
+#define SD_CMD_ALL_SEND_CID 2U
+#define SD_CMD_SEND_RELATIVE_ADDR 3U
+#define SD_CMD_SELECT_CARD 7U
+#define SD_CMD_SEND_IF_COND 8U
+#define SD_CMD_SEND_CSD 9U
+#define SD_CMD_STOP_TRANSMISSION 12U
+#define SD_CMD_SEND_STATUS 13U
+#define SD_CMD_SET_BLOCKLEN 16U
+#define SD_CMD_READ_SINGLE_BLOCK 17U
+#define SD_CMD_READ_MULTIPLE_BLOCK 18U
+#define SD_CMD_WRITE_BLOCK 24U
+#define SD_CMD_WRITE_MULTIPLE_BLOCK 25U
+#define SD_CMD_APP_CMD 55U
+/** Application commands, after APP_CMD */
+#define SD_ACMD_SET_BUS_WIDTH 6U
+#define SD_ACMD_SET_WR_BLK_ERASE_COUNT 23U
+#define SD_ACMD_SD_SEND_OP_COND 41U
+#define SD_ACMD_SET_CLR_CARD_DETECT 42U
+
+#define SD_CHECK_PATTERN 0x1AAU             /**< 2.7-3.6 V and the 0xAA echo of CMD8 */
+#define SD_OCR_VOLTAGE_3V3 0x00300000U      /**< 3.2-3.4 V */
+#define SD_OCR_HCS (1U << 30)
+#define SD_OCR_READY (1U << 31)
+
+/** Card status (R1) */
+#define SD_R1_APP_CMD (1U << 5)
+#define SD_R1_READY_FOR_DATA (1U << 8)
+#define SD_R1_STATE_Pos 9U
+#define SD_R1_STATE_Msk (0xFU << SD_R1_STATE_Pos)
+#define SD_R1_ERRORS 0xFDFFE008U
+#define SD_STATE_IDLE 0U
+#define SD_STATE_TRAN 4U
+#define SD_STATE_DATA 5U
+#define SD_STATE_RCV 6U
+#define SD_STATE_PRG 7U
+
+typedef struct {
+    uint32_t hclk_hz;           /**< Core clock, to time the power-up delay */
+    uint32_t max_clock_hz;      /**< Data transfer clock limit; 0 for the fastest, 24 MHz */
+    uint8_t one_bit;            /**< Keep the 1-bit bus, for boards with only D0 wired */
+} sdio_config_t;
+
+typedef struct {
+    uint32_t read_commands;     /**< CMD17 and CMD18 */
+    uint32_t write_commands;    /**< CMD24 and CMD25 */
+    uint32_t blocks_read;
+    uint32_t blocks_written;
+    uint32_t pre_erases;        /**< ACMD23 before a multi-block write */
+    uint32_t busy_polls;        /**< CMD13 sent while the card was still programming */
+    uint32_t command_errors;    /**< Timeouts, CRC failures and error bits in responses */
+    uint32_t data_errors;       /**< CRC, timeout, FIFO under/overrun and DMA errors in a data phase */
+} sdio_stats_t;
+
+typedef struct {
+    sdio_regs_t* regs;
+    dma_stream_t dma;
+    sdio_config_t config;
+    uint32_t delay_loops;       /**< Busy-wait iterations per millisecond */
+    uint32_t clkcr;             /**< Data transfer clock and bus width */
+    uint32_t rca;               /**< Relative card address, in bits 31:16 */
+    uint32_t blocks;            /**< Capacity */
+    uint8_t high_capacity;      /**< Block, rather than byte, addressing */
+    uint8_t programming;        /**< A write has ended; the card may still be busy */
+    volatile uint8_t pending;   /**< Data phase and DMA completions still to come */
+    volatile uint32_t data_status; /**< Error flags that ended the last data phase */
+    uint32_t cid[4];
+    uint32_t csd[4];
+    sdio_stats_t stats;
+} sdio_t;
+
+/**
+ * @brief Powers the controller, identifies and selects the card, and sets
+ * up the bus for data transfer.
+ *
+ * @return FAILURE if the configuration is invalid, the driver or its DMA
+ * stream is in use, no card answers or the card is not a usable SD memory
+ * card.
+ */
+status_t sdio_init(sdio_t* sd, const sdio_config_t* config);
+
+/** Powers the card and the controller off and releases the DMA stream. */
+void sdio_deinit(sdio_t* sd);
+
+/**
+ * @brief Reads count blocks from lba into data, which must be word aligned.
+ *
+ * @return FAILURE on invalid arguments, a range beyond the card, or a
+ * command or data error.
+ */
+status_t sdio_read(sdio_t* sd, uint32_t lba, void* data, uint32_t count);
+
+/**
+ * @brief Writes count blocks from data, which must be word aligned, to lba.
+ * Returns once the card has taken the data, possibly before it has
+ * programmed it.
+ *
+ * @return FAILURE as for sdio_read().
+ */
+status_t sdio_write(sdio_t* sd, uint32_t lba, const void* data, uint32_t count);
+
+/**
+ * @brief Waits until the card has programmed everything written to it.
+ *
+ * @return FAILURE if the card does not get there.
+ */
+status_t sdio_sync(sdio_t* sd);
+
+/** Capacity in blocks. */
+uint32_t sdio_blocks(const sdio_t* sd);
+
+/** SDIO interrupt body; SDIO_IRQHandler calls this. */
+void sdio_irq(void);
+
+const sdio_stats_t* sdio_get_stats(const sdio_t* sd);
+
+#if !defined(STM32F407xx)
+#define SDIO_SIM_LOG 32U
+#define SDIO_SIM_APP 0x80U
+
+/**
+ * @brief Host model of an SD card, its contents in an image file.
+ *
+ * The card answers commands on the SDIO as the physical layer
+ * specification describes, moves data through the DMA stream, and keeps a
+ * running total of the time the transfers would have taken on a real bus
+ * and card: command and data bits at the configured clock and width, an
+ * access time per read command, and a busy time per write command plus a
+ * per-block programming time. Blocks that a pre-erase (ACMD23) did not
+ * cover also pay an erase time.
+ */
+typedef struct {
+    FILE* image;                /**< Block n at offset n * 512; reads past its end return zeros */
+    uint32_t blocks;            /**< Capacity */
+    uint8_t high_capacity;      /**< SDHC; otherwise a version 1 SDSC card */
+    uint8_t ready_after;        /**< ACMD41 polls answered busy before power-up completes */
+    uint32_t read_access_ns;
+    uint32_t write_busy_ns;
+    uint32_t program_ns;        /**< Per block */
+    uint32_t erase_ns;          /**< Per block not pre-erased */
+    uint32_t inject;            /**< SDIO_STA data error to end the next data phase with, once */
+
+    /* Card state */
+    uint8_t state;              /**< SD_STATE_*, or 1-3 for ready, ident and stby */
+    uint8_t app_command;        /**< The next command is an application command */
+    uint8_t op_cond_polls;
+    uint8_t wide_bus;
+    uint8_t busy_polls;         /**< CMD13 polls still to be answered with the PRG state */
+    uint8_t data_pending;       /**< A data command is waiting for the data path */
+    uint8_t data_write;
+    uint8_t data_multiple;
+    uint16_t rca;
+    uint32_t status;            /**< Error bits for the next R1 */
+    uint32_t address;           /**< Block of the pending data phase */
+    uint32_t pre_erased;        /**< Blocks of the next multi-block write that ACMD23 covered */
+
+    uint64_t elapsed_ns;
+    uint8_t log[SDIO_SIM_LOG];  /**< The last commands, application ones with SDIO_SIM_APP set */
+    uint32_t log_count;         /**< Commands logged in total; the latest is log[(log_count - 1) % SDIO_SIM_LOG] */
+} sdio_sim_card_t;
+
+/**
+ * @brief Host model: fills in a card of the given size over an open image
+ * with typical class 10 timing, and inserts it in the slot.
+ */
+void sdio_sim_insert(sdio_sim_card_t* card, FILE* image, uint32_t blocks, uint8_t high_capacity);
+
+/** Host model: takes the card out; commands time out from then on. */
+void sdio_sim_remove(void);
+
+/** Host model: a write to a register with side effects in the hardware. */
+void sdio_sim_write(volatile uint32_t* reg, uint32_t value);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SDIO_H
@@ -0,0 +1,180 @@
+#include "sdio_cache.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+static uint8_t* line_data(const sdio_cache_t* cache, uint32_t index)
+{
+    return cache->storage + index * SDIO_BLOCK_SIZE;
+}
+
+static int32_t find(const sdio_cache_t* cache, uint32_t lba)
+{
+    for (uint32_t i = 0; i < cache->lines; i++) {
+        if (cache->line[i].valid && cache->line[i].lba == lba) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+/* Every dirty line, oldest first, one write per run of consecutive blocks in consecutive lines */
+static status_t write_back(sdio_cache_t* cache)
+{
+    uint32_t k = 0;
+    while (k < cache->lines && cache->dirty > 0U) {
+        uint32_t first = (cache->next + k) % cache->lines;
+        sdio_cache_line_t* line = &cache->line[first];
+        if (!line->dirty) {
+            k++;
+            continue;
+        }
+        uint32_t run = 1;
+        while (k + run < cache->lines && first + run < cache->lines && cache->line[first + run].dirty &&
+               cache->line[first + run].lba == line->lba + run) {
+            run++;
+        }
+        if (sdio_write(cache->sd, line->lba, line_data(cache, first), run) != SUCCESS) {
+            return FAILURE;
+        }
+        for (uint32_t i = 0; i < run; i++) {
+            cache->line[first + i].dirty = 0;
+        }
+        cache->dirty -= run;
+        STAT_INC(cache->stats.flushes);
+        STAT_ADD(cache->stats.blocks_flushed, run);
+        k += run;
+    }
+    return SUCCESS;
+}
+
+/* The next line in ring order, emptied; a dirty one first takes every dirty line to the card with it */
+static status_t take_line(sdio_cache_t* cache, uint32_t* index)
+{
+    uint32_t i = cache->next;
+    if (cache->line[i].dirty) {
+        STAT_INC(cache->stats.evictions);
+        if (write_back(cache) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    cache->next = (i + 1U) % cache->lines;
+    cache->line[i].valid = 0;
+    *index = i;
+    return SUCCESS;
+}
+
+static status_t check_range(const sdio_cache_t* cache, uint32_t lba, const void* data, uint32_t count)
+{
+    if (cache == NULL || cache->sd == NULL || data == NULL || count == 0U) {
+        return FAILURE;
+    }
+    uint32_t blocks = sdio_blocks(cache->sd);
+    return (lba < blocks && count <= blocks - lba) ? SUCCESS : FAILURE;
+}
+
+status_t sdio_cache_init(sdio_cache_t* cache, sdio_t* sd, void* storage, uint32_t lines)
+{
+    if (cache == NULL || sd == NULL || storage == NULL || ((uintptr_t)storage & 3U) != 0U || lines == 0U ||
+        lines > SDIO_CACHE_MAX_LINES) {
+        return FAILURE;
+    }
+    memset(cache, 0, sizeof(*cache));
+    cache->sd = sd;
+    cache->storage = (uint8_t*)storage;
+    cache->lines = lines;
+    return SUCCESS;
+}
+
+status_t sdio_cache_read(sdio_cache_t* cache, uint32_t lba, void* data, uint32_t count)
+{
+    if (check_range(cache, lba, data, count) != SUCCESS) {
+        return FAILURE;
+    }
+    uint8_t* out = (uint8_t*)data;
+    uint32_t done = 0;
+    while (done < count) {
+        uint8_t* block = out + done * SDIO_BLOCK_SIZE;
+        int32_t hit = find(cache, lba + done);
+        if (hit >= 0) {
+            memcpy(block, line_data(cache, (uint32_t)hit), SDIO_BLOCK_SIZE);
+            STAT_INC(cache->stats.read_hits);
+            done++;
+            continue;
+        }
+
+        uint32_t run = 1;
+        while (done + run < count && find(cache, lba + done + run) < 0) {
+            run++;
+        }
+        if (run > 1U && ((uintptr_t)block & 3U) == 0U) {
+            /* Bulk reads bypass the cache rather than sweep it */
+            if (sdio_read(cache->sd, lba + done, block, run) != SUCCESS) {
+                return FAILURE;
+            }
+            STAT_ADD(cache->stats.read_misses, run);
+            done += run;
+            continue;
+        }
+
+        uint32_t index;
+        if (take_line(cache, &index) != SUCCESS ||
+            sdio_read(cache->sd, lba + done, line_data(cache, index), 1) != SUCCESS) {
+            return FAILURE;
+        }
+        cache->line[index].lba = lba + done;
+        cache->line[index].valid = 1;
+        memcpy(block, line_data(cache, index), SDIO_BLOCK_SIZE);
+        STAT_INC(cache->stats.read_misses);
+        done++;
+    }
+    return SUCCESS;
+}
+
+status_t sdio_cache_write(sdio_cache_t* cache, uint32_t lba, const void* data, uint32_t count)
+{
+    if (check_range(cache, lba, data, count) != SUCCESS) {
+        return FAILURE;
+    }
+    const uint8_t* in = (const uint8_t*)data;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t hit = find(cache, lba + i);
+        uint32_t index;
+        if (hit >= 0) {
+            index = (uint32_t)hit;
+            STAT_INC(cache->stats.write_hits);
+        } else {
+            if (take_line(cache, &index) != SUCCESS) {
+                return FAILURE;
+            }
+            cache->line[index].lba = lba + i;
+            cache->line[index].valid = 1;
+        }
+        memcpy(line_data(cache, index), in + i * SDIO_BLOCK_SIZE, SDIO_BLOCK_SIZE);
+        if (!cache->line[index].dirty) {
+            cache->line[index].dirty = 1;
+            cache->dirty++;
+        }
+    }
+    return SUCCESS;
+}
+
+status_t sdio_cache_flush(sdio_cache_t* cache)
+{
+    if (cache == NULL || cache->sd == NULL || write_back(cache) != SUCCESS) {
+        return FAILURE;
+    }
+    return sdio_sync(cache->sd);
+}
+
+void sdio_cache_invalidate(sdio_cache_t* cache)
+{
+    memset(cache->line, 0, sizeof(cache->line));
+    cache->next = 0;
+    cache->dirty = 0;
+}
+
+const sdio_cache_stats_t* sdio_cache_get_stats(const sdio_cache_t* cache)
+{
+    return &cache->stats;
+}
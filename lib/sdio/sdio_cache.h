@@ -0,0 +1,104 @@
+#ifndef SDIO_CACHE_H
+#define SDIO_CACHE_H
+
+#include "sdio.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Write-back block cache in front of an SD card.
+ *
+ * Writes land in the cache and reach the card when their line is needed
+ * again or on sdio_cache_flush(). Lines are taken in ring order, so blocks
+ * written one after another end up in consecutive lines, and a flush sends
+ * each run of consecutive blocks as one multi-block write straight from the
+ * cache storage: a log written a record at a time goes to the card as a few
+ * long CMD25s (each pre-erased by ACMD23) instead of one command per block.
+ * A run is cut where the ring wraps. Once a flush is under way it writes
+ * every dirty line, so the runs are as long as the cache allows.
+ *
+ * Single-block reads are cached. Longer runs of uncached blocks are read
+ * straight into the caller's buffer when it is word aligned, and not
+ * cached; cached blocks in the range, dirty ones included, come from the
+ * cache.
+ *
+ * Nothing is written to the card on its own: data in the cache is lost on
+ * a reset until it has been flushed.
+ */
+
+/** Lines a cache may have */
+#define SDIO_CACHE_MAX_LINES 64U
+
+/** Word-aligned storage for a cache of the given number of lines */
+#define SDIO_CACHE_STORAGE(name, lines) uint32_t name[(lines) * (SDIO_BLOCK_SIZE / 4U)]
+
+typedef struct {
+    uint32_t lba;
+    uint8_t valid;
+    uint8_t dirty;
+} sdio_cache_line_t;
+
+typedef struct {
+    uint32_t read_hits;
+    uint32_t read_misses;       /**< Blocks read from the card */
+    uint32_t write_hits;        /**< Writes to a block already in the cache */
+    uint32_t flushes;           /**< Write commands issued */
+    uint32_t blocks_flushed;
+    uint32_t evictions;         /**< Flushes forced by a write or read needing a dirty line */
+} sdio_cache_stats_t;
+
+typedef struct {
+    sdio_t* sd;
+    uint8_t* storage;
+    uint32_t lines;
+    uint32_t next;              /**< Line to take next, the oldest */
+    uint32_t dirty;             /**< Dirty lines */
+    sdio_cache_line_t line[SDIO_CACHE_MAX_LINES];
+    sdio_cache_stats_t stats;
+} sdio_cache_t;
+
+/**
+ * @brief Sets up an empty cache over an initialized card.
+ *
+ * @param storage From SDIO_CACHE_STORAGE with the same number of lines.
+ * @param lines 1 to SDIO_CACHE_MAX_LINES.
+ */
+status_t sdio_cache_init(sdio_cache_t* cache, sdio_t* sd, void* storage, uint32_t lines);
+
+/**
+ * @brief Reads count blocks from lba; data need not be aligned.
+ *
+ * @return FAILURE on invalid arguments or a card error.
+ */
+status_t sdio_cache_read(sdio_cache_t* cache, uint32_t lba, void* data, uint32_t count);
+
+/**
+ * @brief Writes count blocks to lba through the cache; data need not be
+ * aligned.
+ *
+ * @return FAILURE on invalid arguments or if an eviction could not write a
+ * line back; the blocks before the failing one have been taken.
+ */
+status_t sdio_cache_write(sdio_cache_t* cache, uint32_t lba, const void* data, uint32_t count);
+
+/**
+ * @brief Writes every dirty line back and waits until the card has
+ * programmed them.
+ *
+ * @return FAILURE if the card failed; the lines it did not take stay dirty.
+ */
+status_t sdio_cache_flush(sdio_cache_t* cache);
+
+/** Forgets every line, dirty ones included, e.g. after the card was swapped. */
+void sdio_cache_invalidate(sdio_cache_t* cache);
+
+const sdio_cache_stats_t* sdio_cache_get_stats(const sdio_cache_t* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SDIO_CACHE_H
@@ -0,0 +1,450 @@
+#include "sdio.h"
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(STM32F407xx)
+
+#define BLOCK_WORDS (SDIO_BLOCK_SIZE / 4U)
+
+#define STATE_READY 1U
+#define STATE_IDENT 2U
+#define STATE_STBY 3U
+
+#define STATUS_OUT_OF_RANGE (1U << 31)
+#define STATUS_ADDRESS_ERROR (1U << 30)
+#define STATUS_BLOCK_LEN_ERROR (1U << 29)
+#define STATUS_ILLEGAL_COMMAND (1U << 22)
+
+#define CARD_RCA 0xB368U
+#define OCR_VOLTAGES 0x00FF8000U
+
+/* Bits on the CMD line: a command, and the short and long responses, each with its turnaround */
+#define COMMAND_BITS 56U
+#define SHORT_RESPONSE_BITS 56U
+#define LONG_RESPONSE_BITS 144U
+/* Start, CRC16 and end bits on each data line, and the CRC status a write block waits for */
+#define BLOCK_OVERHEAD_BITS 26U
+
+typedef enum {
+    RESPONSE_SILENT = 0, /* The card does not answer */
+    RESPONSE_NONE,       /* Nor is it meant to */
+    RESPONSE_R1,
+    RESPONSE_R2,
+    RESPONSE_R3,
+    RESPONSE_R6,
+    RESPONSE_R7,
+} response_t;
+
+static sdio_sim_card_t* card;
+
+static const uint32_t cid[4] = { 0x1B534D45, 0x42314752, 0x10A5C3E1, 0x23013A00 };
+
+static uint32_t clock_hz(void)
+{
+    uint32_t clkcr = sdio_sim_regs.CLKCR;
+    if (clkcr & SDIO_CLKCR_BYPASS) {
+        return SDIO_CLOCK_HZ;
+    }
+    return SDIO_CLOCK_HZ / ((clkcr & SDIO_CLKCR_CLKDIV_Msk) + 2U);
+}
+
+static void spend_clocks(uint32_t clocks)
+{
+    card->elapsed_ns += (uint64_t)clocks * 1000000000ULL / clock_hz();
+}
+
+static void card_reset(void)
+{
+    card->state = SD_STATE_IDLE;
+    card->app_command = 0;
+    card->op_cond_polls = 0;
+    card->wide_bus = 0;
+    card->busy_polls = 0;
+    card->data_pending = 0;
+    card->rca = 0;
+    card->status = 0;
+    card->pre_erased = 0;
+}
+
+/* The card status an R1 reports: error bits, the state the command found, and whether it was an ACMD */
+static uint32_t card_status(uint8_t app)
+{
+    uint32_t status = card->status | ((uint32_t)card->state << SD_R1_STATE_Pos);
+    if (card->state == SD_STATE_TRAN) {
+        status |= SD_R1_READY_FOR_DATA;
+    }
+    if (app) {
+        status |= SD_R1_APP_CMD;
+    }
+    return status;
+}
+
+static void csd(uint32_t* out)
+{
+    if (card->high_capacity) {
+        /* Version 2: C_SIZE in units of 512 KiB */
+        uint32_t c_size = card->blocks / 1024U - 1U;
+        out[0] = 0x400E0032U;
+        out[1] = 0x5B590000U | (c_size >> 16);
+        out[2] = (c_size << 16) | 0x7F80U;
+        out[3] = 0x0A400000U;
+    } else {
+        /* Version 1: READ_BL_LEN 9 and C_SIZE_MULT 7, so C_SIZE counts 512 blocks */
+        uint32_t c_size = card->blocks / 512U - 1U;
+        out[0] = 0x002E0032U;
+        out[1] = 0x5F590000U | (c_size >> 2);
+        out[2] = (c_size << 30) | (7U << 15) | 0x3FFF8000U;
+        out[3] = 0x0A400000U;
+    }
+}
+
+static response_t illegal(void)
+{
+    card->status |= STATUS_ILLEGAL_COMMAND;
+    return RESPONSE_SILENT;
+}
+
+static response_t application_command(uint32_t index, uint32_t argument, uint32_t* response)
+{
+    switch (index) {
+    case SD_ACMD_SD_SEND_OP_COND: {
+        if (card->state != SD_STATE_IDLE) {
+            return illegal();
+        }
+        /* A high capacity card stays busy for a host that does not say it can address it */
+        uint8_t usable = !card->high_capacity || (argument & SD_OCR_HCS);
+        response[0] = OCR_VOLTAGES;
+        if ((argument & OCR_VOLTAGES) && usable && card->op_cond_polls >= card->ready_after) {
+            response[0] |= SD_OCR_READY | (card->high_capacity ? SD_OCR_HCS : 0U);
+            card->state = STATE_READY;
+        }
+        if (card->op_cond_polls < 0xFFU) {
+            card->op_cond_polls++;
+        }
+        return RESPONSE_R3;
+    }
+    case SD_ACMD_SET_BUS_WIDTH:
+        if (card->state != SD_STATE_TRAN || (argument != 0U && argument != 2U)) {
+            return illegal();
+        }
+        card->wide_bus = argument == 2U;
+        return RESPONSE_R1;
+    case SD_ACMD_SET_WR_BLK_ERASE_COUNT:
+        if (card->state != SD_STATE_TRAN) {
+            return illegal();
+        }
+        card->pre_erased = argument & 0x7FFFFFU;
+        return RESPONSE_R1;
+    case SD_ACMD_SET_CLR_CARD_DETECT:
+        if (card->state != SD_STATE_TRAN) {
+            return illegal();
+        }
+        return RESPONSE_R1;
+    default:
+        return illegal();
+    }
+}
+
+static response_t data_command(uint32_t index, uint32_t argument, uint32_t* response)
+{
+    if (card->state != SD_STATE_TRAN) {
+        return illegal();
+    }
+    uint32_t address = card->high_capacity ? argument : argument / SDIO_BLOCK_SIZE;
+    if (!card->high_capacity && (argument % SDIO_BLOCK_SIZE) != 0U) {
+        response[0] |= STATUS_ADDRESS_ERROR;
+        return RESPONSE_R1;
+    }
+    if (address >= card->blocks) {
+        response[0] |= STATUS_OUT_OF_RANGE;
+        return RESPONSE_R1;
+    }
+    card->data_write = index == SD_CMD_WRITE_BLOCK || index == SD_CMD_WRITE_MULTIPLE_BLOCK;
+    card->data_multiple = index == SD_CMD_READ_MULTIPLE_BLOCK || index == SD_CMD_WRITE_MULTIPLE_BLOCK;
+    card->address = address;
+    card->data_pending = 1;
+    card->state = card->data_write ? SD_STATE_RCV : SD_STATE_DATA;
+    if (!card->data_write) {
+        card->elapsed_ns += card->read_access_ns;
+    }
+    return RESPONSE_R1;
+}
+
+/* Programming after a write: one CMD13 sees the card busy */
+static void start_programming(void)
+{
+    card->state = SD_STATE_PRG;
+    card->busy_polls = 1;
+    card->pre_erased = 0;
+    card->elapsed_ns += card->write_busy_ns;
+}
+
+static response_t card_command(uint32_t index, uint32_t argument, uint32_t* response)
+{
+    uint8_t app = card->app_command;
+    card->app_command = 0;
+    if (app && (index == SD_ACMD_SD_SEND_OP_COND || index == SD_ACMD_SET_BUS_WIDTH ||
+                index == SD_ACMD_SET_WR_BLK_ERASE_COUNT || index == SD_ACMD_SET_CLR_CARD_DETECT)) {
+        response[0] = card_status(1);
+        card->status = 0;
+        return application_command(index, argument, response);
+    }
+
+    response[0] = card_status(index == SD_CMD_APP_CMD);
+    card->status = 0;
+    uint8_t addressed = (argument >> 16) == card->rca;
+    switch (index) {
+    case SD_CMD_GO_IDLE_STATE:
+        card_reset();
+        return RESPONSE_NONE;
+    case SD_CMD_SEND_IF_COND:
+        /* Version 1 cards do not know it, and just stay silent */
+        if (!card->high_capacity) {
+            return RESPONSE_SILENT;
+        }
+        if (card->state != SD_STATE_IDLE) {
+            return illegal();
+        }
+        response[0] = argument & 0xFFFU;
+        return RESPONSE_R7;
+    case SD_CMD_APP_CMD:
+        if (card->state != SD_STATE_IDLE && !addressed) {
+            return RESPONSE_SILENT;
+        }
+        card->app_command = 1;
+        return RESPONSE_R1;
+    case SD_CMD_ALL_SEND_CID:
+        if (card->state != STATE_READY) {
+            return illegal();
+        }
+        card->state = STATE_IDENT;
+        memcpy(response, cid, sizeof(cid));
+        return RESPONSE_R2;
+    case SD_CMD_SEND_RELATIVE_ADDR: {
+        if (card->state != STATE_IDENT && card->state != STATE_STBY) {
+            return illegal();
+        }
+        /* R6 packs status bits 23, 22, 19 and 12:0 under the new address */
+        uint32_t status = response[0];
+        card->rca = CARD_RCA;
+        card->state = STATE_STBY;
+        response[0] = ((uint32_t)card->rca << 16) | ((status >> 8) & 0xC000U) | ((status >> 6) & 0x2000U) |
+                      (status & 0x1FFFU);
+        return RESPONSE_R6;
+    }
+    case SD_CMD_SEND_CSD:
+        if (card->state != STATE_STBY || !addressed) {
+            return illegal();
+        }
+        csd(response);
+        return RESPONSE_R2;
+    case SD_CMD_SELECT_CARD:
+        if (!addressed) {
+            /* Deselected cards do not answer */
+            if (card->state == SD_STATE_TRAN) {
+                card->state = STATE_STBY;
+            }
+            return RESPONSE_SILENT;
+        }
+        if (card->state != STATE_STBY) {
+            return illegal();
+        }
+        card->state = SD_STATE_TRAN;
+        return RESPONSE_R1;
+    case SD_CMD_SET_BLOCKLEN:
+        if (card->state != SD_STATE_TRAN) {
+            return illegal();
+        }
+        if (!card->high_capacity && argument != SDIO_BLOCK_SIZE) {
+            response[0] |= STATUS_BLOCK_LEN_ERROR;
+        }
+        return RESPONSE_R1;
+    case SD_CMD_SEND_STATUS:
+        if (!addressed) {
+            return RESPONSE_SILENT;
+        }
+        if (card->state == SD_STATE_PRG && card->busy_polls > 0U && --card->busy_polls == 0U) {
+            card->state = SD_STATE_TRAN;
+        }
+        return RESPONSE_R1;
+    case SD_CMD_READ_SINGLE_BLOCK:
+    case SD_CMD_READ_MULTIPLE_BLOCK:
+    case SD_CMD_WRITE_BLOCK:
+    case SD_CMD_WRITE_MULTIPLE_BLOCK:
+        return data_command(index, argument, response);
+    case SD_CMD_STOP_TRANSMISSION:
+        if (card->state == SD_STATE_DATA) {
+            card->state = SD_STATE_TRAN;
+        } else if (card->state == SD_STATE_RCV) {
+            start_programming();
+        } else {
+            return illegal();
+        }
+        card->data_pending = 0;
+        return RESPONSE_R1;
+    default:
+        return illegal();
+    }
+}
+
+static void raise(uint32_t flags)
+{
+    sdio_sim_regs.STA |= flags;
+    if (sdio_sim_regs.STA & sdio_sim_regs.MASK) {
+        sdio_irq();
+    }
+}
+
+static void execute(void)
+{
+    sdio_regs_t* regs = &sdio_sim_regs;
+    uint32_t index = regs->CMD & 0x3FU;
+    uint32_t wait = regs->CMD & SDIO_CMD_WAITRESP_LONG;
+    uint32_t response[4] = { 0, 0, 0, 0 };
+    response_t kind = RESPONSE_SILENT;
+
+    if (card != NULL && regs->POWER == SDIO_POWER_ON && (regs->CLKCR & SDIO_CLKCR_CLKEN)) {
+        uint8_t app = card->app_command;
+        kind = card_command(index, regs->ARG, response);
+        card->log[card->log_count % SDIO_SIM_LOG] = (uint8_t)(index | (app ? SDIO_SIM_APP : 0U));
+        card->log_count++;
+        spend_clocks(COMMAND_BITS);
+    }
+
+    if (wait == 0U) {
+        regs->STA |= SDIO_STA_CMDSENT;
+        return;
+    }
+    if (kind == RESPONSE_SILENT || kind == RESPONSE_NONE) {
+        regs->STA |= SDIO_STA_CTIMEOUT;
+        return;
+    }
+    spend_clocks(kind == RESPONSE_R2 ? LONG_RESPONSE_BITS : SHORT_RESPONSE_BITS);
+    /* R2 and R3 carry 111111 where the others echo the command index */
+    regs->RESPCMD = (kind == RESPONSE_R2 || kind == RESPONSE_R3) ? 0x3FU : index;
+    for (uint32_t i = 0; i < 4U; i++) {
+        regs->RESP[i] = response[i];
+    }
+    regs->STA |= (kind == RESPONSE_R3) ? SDIO_STA_CCRCFAIL : SDIO_STA_CMDREND;
+}
+
+static void read_block(uint32_t address, uint32_t* buffer)
+{
+    memset(buffer, 0, SDIO_BLOCK_SIZE);
+    if (fseek(card->image, (long)address * (long)SDIO_BLOCK_SIZE, SEEK_SET) == 0) {
+        (void)fread(buffer, 1, SDIO_BLOCK_SIZE, card->image);
+    }
+}
+
+static void write_block(uint32_t address, const uint32_t* buffer)
+{
+    if (fseek(card->image, (long)address * (long)SDIO_BLOCK_SIZE, SEEK_SET) == 0) {
+        (void)fwrite(buffer, 1, SDIO_BLOCK_SIZE, card->image);
+    }
+}
+
+/* Runs the data phase once the card has its command and the data path is enabled, in either order */
+static void data(void)
+{
+    sdio_regs_t* regs = &sdio_sim_regs;
+    uint32_t dctrl = regs->DCTRL;
+    if (card == NULL || !card->data_pending || (dctrl & SDIO_DCTRL_DTEN) == 0U ||
+        (dctrl & SDIO_DCTRL_DMAEN) == 0U) {
+        return;
+    }
+    card->data_pending = 0;
+
+    uint32_t blocks = regs->DLEN / SDIO_BLOCK_SIZE;
+    uint32_t error = 0;
+    if (((dctrl & SDIO_DCTRL_DTDIR) != 0U) == card->data_write) {
+        /* Both sides listening, or both driving */
+        error = SDIO_STA_DTIMEOUT;
+    } else if (((dctrl >> SDIO_DCTRL_DBLOCKSIZE_Pos) & 0xFU) != 9U || blocks == 0U ||
+               (regs->DLEN % SDIO_BLOCK_SIZE) != 0U ||
+               card->wide_bus != ((regs->CLKCR & SDIO_CLKCR_WIDBUS_4) != 0U)) {
+        /* The two ends frame the data differently */
+        error = SDIO_STA_DCRCFAIL;
+    }
+
+    uint32_t width = card->wide_bus ? 4U : 1U;
+    uint32_t buffer[BLOCK_WORDS];
+    for (uint32_t b = 0; b < blocks && error == 0U; b++) {
+        uint32_t address = card->address + b;
+        if (address >= card->blocks) {
+            card->status |= STATUS_OUT_OF_RANGE;
+            error = SDIO_STA_DTIMEOUT;
+            break;
+        }
+        if (card->inject != 0U && b == blocks / 2U) {
+            error = card->inject;
+            card->inject = 0;
+            break;
+        }
+        if (card->data_write) {
+            if (dma_sim_drain(SDIO_DMA_CONTROLLER, SDIO_DMA_STREAM, buffer, BLOCK_WORDS) != BLOCK_WORDS) {
+                error = SDIO_STA_TXUNDERR;
+                break;
+            }
+            write_block(address, buffer);
+            card->elapsed_ns += card->program_ns + ((b < card->pre_erased) ? 0U : card->erase_ns);
+        } else {
+            read_block(address, buffer);
+            if (dma_sim_transfer(SDIO_DMA_CONTROLLER, SDIO_DMA_STREAM, buffer, BLOCK_WORDS) != BLOCK_WORDS) {
+                error = SDIO_STA_RXOVERR;
+                break;
+            }
+        }
+        spend_clocks(SDIO_BLOCK_SIZE * 8U / width + BLOCK_OVERHEAD_BITS);
+    }
+
+    /* A single-block transfer ends on its own; a multiple one waits for CMD12 */
+    if (!card->data_multiple) {
+        if (card->data_write) {
+            start_programming();
+        } else {
+            card->state = SD_STATE_TRAN;
+        }
+    }
+    /* The data path goes idle; the next transfer enables it again */
+    regs->DCOUNT = 0;
+    regs->DCTRL &= ~SDIO_DCTRL_DTEN;
+    raise(error != 0U ? error : (SDIO_STA_DATAEND | SDIO_STA_DBCKEND));
+}
+
+void sdio_sim_insert(sdio_sim_card_t* sim, FILE* image, uint32_t blocks, uint8_t high_capacity)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->image = image;
+    sim->blocks = blocks;
+    sim->high_capacity = high_capacity;
+    sim->ready_after = 2;
+    sim->read_access_ns = 200000U;
+    sim->write_busy_ns = 750000U;
+    sim->program_ns = 20000U;
+    sim->erase_ns = 30000U;
+    card = sim;
+    card_reset();
+}
+
+void sdio_sim_remove(void)
+{
+    card = NULL;
+}
+
+void sdio_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    sdio_regs_t* regs = &sdio_sim_regs;
+    hal_reg_write(reg, value);
+    if (reg == &regs->ICR) {
+        regs->STA &= ~(value & SDIO_ICR_STATIC);
+    } else if (reg == &regs->CMD && (value & SDIO_CMD_CPSMEN)) {
+        execute();
+        data();
+    } else if (reg == &regs->DCTRL && (value & SDIO_DCTRL_DTEN)) {
+        data();
+    } else if (reg == &regs->POWER && value != SDIO_POWER_ON && card != NULL) {
+        card_reset();
+    }
+}
+
+#endif
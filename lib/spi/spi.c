@@ -0,0 +1,331 @@
+#include "spi.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define BUS_APB1 1U
+#define BUS_APB2 2U
+
+#define CS_NONE 0xFFU
+
+typedef struct {
+    uint8_t bus;
+    uint8_t rcc_bit;
+    uint8_t irqn;
+    uint8_t dma_controller;
+    uint8_t dma_channel;
+    uint8_t rx_stream;
+    uint8_t tx_stream;
+} spi_instance_t;
+
+/*
+ * RM0090 tables 42-43 and 61. SPI1 has DMA2 streams 2 and 3 to itself next
+ * to the ADC and USART1/6; on DMA1, SPI2 and SPI3 share streams with some
+ * of USART2-3 and UART4-5, and whichever driver comes second fails to init.
+ */
+static const spi_instance_t instances[SPI_INSTANCES] = {
+    { BUS_APB2, 12, 35, 2, 3, 2, 3 }, /* SPI1 */
+    { BUS_APB1, 14, 36, 1, 0, 3, 4 }, /* SPI2 */
+    { BUS_APB1, 15, 51, 1, 0, 0, 5 }, /* SPI3 */
+};
+
+#if !defined(STM32F407xx)
+spi_regs_t spi_sim_regs[SPI_INSTANCES];
+#endif
+
+static spi_bus_t* buses[SPI_INSTANCES];
+
+static spi_regs_t* instance_regs(uint8_t instance)
+{
+    switch (instance) {
+    case 1: return SPI1_REGS;
+    case 2: return SPI2_REGS;
+    default: return SPI3_REGS;
+    }
+}
+
+uint8_t spi_clock_div(uint32_t pclk_hz, uint32_t max_hz)
+{
+    for (uint8_t div = 0; div < 7U; div++) {
+        if ((pclk_hz >> (div + 1U)) <= max_hz) {
+            return div;
+        }
+    }
+    return 7;
+}
+
+static void cs_write(spi_bus_t* bus, uint8_t cs, uint32_t level)
+{
+    const spi_cs_t* pin = &bus->config.cs[cs];
+    hal_gpio_write(pin->port, pin->pin, level);
+}
+
+static void cs_release(spi_bus_t* bus)
+{
+    if (bus->cs_active != CS_NONE) {
+        cs_write(bus, bus->cs_active, 1);
+        bus->cs_active = CS_NONE;
+    }
+}
+
+/* ---------------------------------------------------------- transfers --- */
+
+/* Puts a transaction on the wire; called with interrupts masked and the bus idle */
+static void start(spi_bus_t* bus, spi_transaction_t* transaction)
+{
+    spi_regs_t* regs = bus->regs;
+
+    /* Mode and divider only change with SPE clear, and before the chip select drops */
+    uint32_t cr1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | ((uint32_t)transaction->clock_div << SPI_CR1_BR_Pos) |
+                   (transaction->mode & (SPI_CR1_CPOL | SPI_CR1_CPHA));
+    if (cr1 != bus->cr1) {
+        REG_WRITE(regs->CR1, cr1);
+        REG_WRITE(regs->CR1, cr1 | SPI_CR1_SPE);
+        bus->cr1 = cr1;
+    }
+    if (bus->cs_active != transaction->cs) {
+        cs_release(bus);
+        cs_write(bus, transaction->cs, 0);
+        bus->cs_active = transaction->cs;
+    }
+
+    /* RX first: the TX stream's first write starts the clock */
+    bus->current = transaction;
+    dma_set_memory_increment(&bus->rx_dma, transaction->rx != NULL);
+    dma_set_memory_increment(&bus->tx_dma, transaction->tx != NULL);
+    dma_start(&bus->rx_dma, (uintptr_t)&regs->DR, transaction->rx != NULL ? transaction->rx : &bus->sink,
+              transaction->length);
+    dma_start(&bus->tx_dma, (uintptr_t)&regs->DR,
+              transaction->tx != NULL ? (void*)(uintptr_t)transaction->tx : &bus->fill, transaction->length);
+}
+
+/* Retires the current transaction and starts the next; called with interrupts masked */
+static void finish(spi_bus_t* bus, status_t result)
+{
+    spi_transaction_t* done = bus->current;
+    bus->current = NULL;
+    if (done == NULL) {
+        return;
+    }
+    if (result == SUCCESS) {
+        STAT_INC(bus->stats.transactions);
+        STAT_ADD(bus->stats.bytes, done->length);
+    } else {
+        STAT_INC(bus->stats.aborted);
+    }
+    if (result != SUCCESS || (done->flags & SPI_TRANSACTION_KEEP_CS) == 0U) {
+        cs_release(bus);
+    }
+
+    /* The next transaction goes on the wire before the callback runs */
+    node_t* next = ll_list_remove_head(&bus->queue);
+    if (next != NULL) {
+        STAT_INC(bus->stats.chained);
+        start(bus, (spi_transaction_t*)next->data);
+    }
+    if (done->callback != NULL) {
+        done->callback(done, result);
+    }
+}
+
+/* Stops both streams and clears the SPI so that the next transaction starts from a clean state */
+static void abort_current(spi_bus_t* bus)
+{
+    spi_regs_t* regs = bus->regs;
+    dma_stop(&bus->tx_dma);
+    dma_stop(&bus->rx_dma);
+    REG_WRITE(regs->CR1, 0);
+    bus->cr1 = 0;
+    /* RM0090 28.4.9: OVR clears on a DR read followed by an SR read */
+    (void)REG_READ(regs->DR);
+    (void)REG_READ(regs->SR);
+    finish(bus, FAILURE);
+}
+
+static void rx_dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    spi_bus_t* bus = (spi_bus_t*)context;
+    uint32_t primask = hal_irq_mask();
+    if (event == DMA_EVENT_ERROR) {
+        abort_current(bus);
+    } else if (event == DMA_EVENT_COMPLETE) {
+        /* The last byte has come back, so the bus is idle */
+        finish(bus, SUCCESS);
+    }
+    hal_irq_restore(primask);
+}
+
+static void tx_dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    spi_bus_t* bus = (spi_bus_t*)context;
+    /* TX completes a byte ahead of RX, whose completion retires the transaction */
+    if (event == DMA_EVENT_ERROR) {
+        uint32_t primask = hal_irq_mask();
+        abort_current(bus);
+        hal_irq_restore(primask);
+    }
+}
+
+status_t spi_submit(spi_bus_t* bus, spi_transaction_t* transaction)
+{
+    if (bus == NULL || transaction == NULL || bus->regs == NULL || transaction->length == 0U ||
+        transaction->cs >= bus->config.cs_count || transaction->mode > 3U || transaction->clock_div > 7U) {
+        return FAILURE;
+    }
+    transaction->node.data = transaction;
+
+    uint32_t primask = hal_irq_mask();
+    if (bus->current == NULL) {
+        start(bus, transaction);
+    } else {
+        ll_list_insert_at_tail(&bus->queue, &transaction->node);
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+uint8_t spi_busy(const spi_bus_t* bus)
+{
+    return bus->current != NULL;
+}
+
+/* ------------------------------------------------------------- control --- */
+
+static status_t claim_streams(spi_bus_t* bus, const spi_instance_t* info)
+{
+    dma_config_t dma_config;
+    memset(&dma_config, 0, sizeof(dma_config));
+    dma_config.channel = info->dma_channel;
+    dma_config.priority = 2; /* Above TX, so a received byte is always taken before the next is sent */
+    dma_config.direction = DMA_PERIPH_TO_MEMORY;
+    dma_config.mode = DMA_MODE_NORMAL;
+    dma_config.peripheral_size = 1;
+    dma_config.memory_size = 1;
+    dma_config.memory_increment = 1;
+    dma_config.callback = rx_dma_event;
+    dma_config.context = bus;
+    if (dma_stream_init(&bus->rx_dma, info->dma_controller, info->rx_stream, &dma_config) != SUCCESS) {
+        return FAILURE;
+    }
+
+    dma_config.priority = 1;
+    dma_config.direction = DMA_MEMORY_TO_PERIPH;
+    dma_config.callback = tx_dma_event;
+    if (dma_stream_init(&bus->tx_dma, info->dma_controller, info->tx_stream, &dma_config) != SUCCESS) {
+        dma_stream_release(&bus->rx_dma);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+status_t spi_init(spi_bus_t* bus, uint8_t instance, const spi_config_t* config)
+{
+    if (bus == NULL || config == NULL || instance < 1U || instance > SPI_INSTANCES || config->cs == NULL ||
+        config->cs_count == 0U || config->cs_count == CS_NONE) {
+        return FAILURE;
+    }
+    for (uint32_t i = 0; i < config->cs_count; i++) {
+        if (config->cs[i].port >= HAL_GPIO_PORTS || config->cs[i].pin > 15U) {
+            return FAILURE;
+        }
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (buses[instance - 1U] != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    buses[instance - 1U] = bus;
+    hal_irq_restore(primask);
+
+    const spi_instance_t* info = &instances[instance - 1U];
+    memset(bus, 0, sizeof(*bus));
+    bus->config = *config;
+    bus->instance = instance;
+    bus->cs_active = CS_NONE;
+    bus->fill = config->fill;
+    if (claim_streams(bus, info) != SUCCESS) {
+        buses[instance - 1U] = NULL;
+        return FAILURE;
+    }
+    ll_list_init(&bus->queue);
+    bus->regs = instance_regs(instance);
+
+    if (info->bus == BUS_APB2) {
+        REG_SET(HAL_RCC->APB2ENR, 1U << info->rcc_bit);
+    } else {
+        REG_SET(HAL_RCC->APB1ENR, 1U << info->rcc_bit);
+    }
+    for (uint32_t i = 0; i < config->cs_count; i++) {
+        hal_gpio_output(config->cs[i].port, config->cs[i].pin, 1);
+    }
+
+    /* CR1 and SPE are written by the first transaction, once its mode is known */
+    REG_WRITE(bus->regs->CR1, 0);
+    REG_WRITE(bus->regs->CR2, SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN | SPI_CR2_ERRIE);
+    hal_nvic_enable(info->irqn);
+    return SUCCESS;
+}
+
+void spi_deinit(spi_bus_t* bus)
+{
+    if (bus == NULL || bus->regs == NULL) {
+        return;
+    }
+    const spi_instance_t* info = &instances[bus->instance - 1U];
+    hal_nvic_disable(info->irqn);
+
+    uint32_t primask = hal_irq_mask();
+    dma_stream_release(&bus->tx_dma);
+    dma_stream_release(&bus->rx_dma);
+    REG_WRITE(bus->regs->CR1, 0);
+    REG_WRITE(bus->regs->CR2, 0);
+    cs_release(bus);
+    buses[bus->instance - 1U] = NULL;
+    bus->regs = NULL; /* Callbacks submitting from here on are refused */
+
+    spi_transaction_t* cancelled = bus->current;
+    bus->current = NULL;
+    /* The queue is only ever non-empty behind a current transaction */
+    while (cancelled != NULL) {
+        STAT_INC(bus->stats.aborted);
+        if (cancelled->callback != NULL) {
+            cancelled->callback(cancelled, FAILURE);
+        }
+        node_t* next = ll_list_remove_head(&bus->queue);
+        cancelled = (next != NULL) ? (spi_transaction_t*)next->data : NULL;
+    }
+    hal_irq_restore(primask);
+}
+
+void spi_irq(uint8_t instance)
+{
+    spi_bus_t* bus = buses[instance - 1U];
+    if (bus == NULL) {
+        return;
+    }
+    uint32_t sr = REG_READ(bus->regs->SR);
+    if ((sr & SPI_SR_ERRORS) == 0U) {
+        return;
+    }
+    uint32_t primask = hal_irq_mask();
+    /* MODF clears with the CR1 write in abort_current, CRCERR by writing 0 to it */
+    REG_CLEAR(bus->regs->SR, SPI_SR_CRCERR);
+    abort_current(bus);
+    hal_irq_restore(primask);
+}
+
+const spi_stats_t* spi_get_stats(const spi_bus_t* bus)
+{
+    return &bus->stats;
+}
+
+#if defined(STM32F407xx)
+void SPI1_IRQHandler(void) { spi_irq(1); }
+void SPI2_IRQHandler(void) { spi_irq(2); }
+void SPI3_IRQHandler(void) { spi_irq(3); }
+#endif
@@ -0,0 +1,201 @@
+#ifndef SPI_H
+#define SPI_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SPI1-3 as bus masters, with full-duplex DMA transfers and a queue of
+ * transactions.
+ *
+ * A transaction names a chip select from the bus's table, a mode and a
+ * clock divider, and up to 65535 bytes to exchange. spi_submit() queues it.
+ * When the RX stream completes (the last byte has come back, so the bus
+ * is idle), the DMA interrupt releases the chip select, runs the
+ * transaction's callback and starts the next queued transaction at once.
+ * A queue of any length then runs back to back from interrupt context,
+ * without the main loop taking part. Callbacks run in that interrupt; they
+ * may submit further transactions.
+ *
+ * Chip selects are GPIO outputs driven by the driver, low while selected.
+ * A transaction marked SPI_TRANSACTION_KEEP_CS leaves its chip select low
+ * for the next one, so a command and its data can be two transactions
+ * with no gap in the selection.
+ *
+ * SCK, MISO and MOSI must be set to their alternate function by the
+ * application. Frames are 8 bits, MSB first.
+ */
+
+#define SPI_INSTANCES 3U
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t SR;
+    volatile uint32_t DR;
+    volatile uint32_t CRCPR;
+    volatile uint32_t RXCRCR;
+    volatile uint32_t TXCRCR;
+    volatile uint32_t I2SCFGR;
+    volatile uint32_t I2SPR;
+} spi_regs_t;
+
+#if !defined(STM32F407xx)
+extern spi_regs_t spi_sim_regs[SPI_INSTANCES];
+#endif
+
+#define SPI1_REGS HAL_PERIPH(spi_regs_t, 0x40013000U, spi_sim_regs[0])
+#define SPI2_REGS HAL_PERIPH(spi_regs_t, 0x40003800U, spi_sim_regs[1])
+#define SPI3_REGS HAL_PERIPH(spi_regs_t, 0x40003C00U, spi_sim_regs[2])
+
+#define SPI_CR1_CPHA (1U << 0)
+#define SPI_CR1_CPOL (1U << 1)
+#define SPI_CR1_MSTR (1U << 2)
+#define SPI_CR1_BR_Pos 3U
+#define SPI_CR1_SPE (1U << 6)
+#define SPI_CR1_SSI (1U << 8)
+#define SPI_CR1_SSM (1U << 9)
+
+#define SPI_CR2_RXDMAEN (1U << 0)
+#define SPI_CR2_TXDMAEN (1U << 1)
+#define SPI_CR2_ERRIE (1U << 5)
+
+#define SPI_SR_RXNE (1U << 0)
+#define SPI_SR_TXE (1U << 1)
+#define SPI_SR_CRCERR (1U << 4)
+#define SPI_SR_MODF (1U << 5)
+#define SPI_SR_OVR (1U << 6)
+#define SPI_SR_BSY (1U << 7)
+#define SPI_SR_ERRORS (SPI_SR_CRCERR | SPI_SR_MODF | SPI_SR_OVR)
+
+/** Leave the chip select asserted after the transaction */
+#define SPI_TRANSACTION_KEEP_CS (1U << 0)
+
+typedef struct spi_transaction spi_transaction_t;
+
+/**
+ * @brief Called from interrupt context when a transaction has finished,
+ * with FAILURE if it was aborted by an SPI or DMA error or by spi_deinit().
+ */
+typedef void (*spi_callback_t)(spi_transaction_t* transaction, status_t result);
+
+struct spi_transaction {
+    node_t node;                /**< Queue link, owned by the driver from submit to callback */
+    const void* tx;             /**< length bytes to send, or NULL to send the bus's fill byte */
+    void* rx;                   /**< length bytes to receive into, or NULL to discard */
+    uint16_t length;            /**< Bytes, 1-65535 */
+    uint8_t cs;                 /**< Index into the bus's chip-select table */
+    uint8_t mode;               /**< 0-3: CPOL in bit 1, CPHA in bit 0 */
+    uint8_t clock_div;          /**< SCK = PCLK / 2^(clock_div + 1), 0-7; see spi_clock_div() */
+    uint8_t flags;              /**< SPI_TRANSACTION_* */
+    spi_callback_t callback;    /**< Optional */
+    void* context;              /**< For the callback */
+};
+
+typedef struct {
+    uint8_t port;               /**< 0-8 for GPIOA-GPIOI */
+    uint8_t pin;                /**< 0-15 */
+} spi_cs_t;
+
+typedef struct {
+    const spi_cs_t* cs;         /**< Chip-select table, kept by reference */
+    uint8_t cs_count;           /**< At least 1 */
+    uint8_t fill;               /**< Sent by transactions without tx */
+} spi_config_t;
+
+typedef struct {
+    uint32_t transactions;      /**< Completed */
+    uint32_t bytes;             /**< Exchanged in completed transactions */
+    uint32_t chained;           /**< Started from the completion interrupt of the previous one */
+    uint32_t aborted;           /**< Failed on an SPI or DMA error, or cancelled by deinit */
+} spi_stats_t;
+
+typedef struct {
+    spi_regs_t* regs;
+    uint8_t instance;
+    uint8_t cs_active;          /**< Index of the asserted chip select, 0xFF for none */
+    uint8_t fill;               /**< TX source without a tx buffer */
+    uint8_t sink;               /**< RX destination without an rx buffer */
+    uint32_t cr1;               /**< Mode and divider of the last transaction, without SPE */
+    spi_transaction_t* current; /**< On the wire, NULL when idle */
+    list_t queue;
+    dma_stream_t rx_dma;
+    dma_stream_t tx_dma;
+    spi_config_t config;
+    spi_stats_t stats;
+} spi_bus_t;
+
+/**
+ * @brief Largest divider setting whose SCK does not exceed max_hz, or 7
+ * (PCLK / 256) if none is slow enough.
+ */
+uint8_t spi_clock_div(uint32_t pclk_hz, uint32_t max_hz);
+
+/**
+ * @brief Configures an instance as master and drives its chip selects high.
+ *
+ * @param instance 1-3; SPI1 runs from APB2, SPI2 and SPI3 from APB1.
+ * @return FAILURE if the configuration is invalid, the instance is in use
+ * or one of its DMA streams is taken.
+ */
+status_t spi_init(spi_bus_t* bus, uint8_t instance, const spi_config_t* config);
+
+/**
+ * @brief Stops the bus, releases the DMA streams and the chip selects, and
+ * fails the transaction in progress and every queued one.
+ */
+void spi_deinit(spi_bus_t* bus);
+
+/**
+ * @brief Queues a transaction, starting it if the bus is idle. The driver
+ * owns the transaction until its callback; safe from any context,
+ * including callbacks.
+ *
+ * @return FAILURE on invalid arguments; nothing is queued.
+ */
+status_t spi_submit(spi_bus_t* bus, spi_transaction_t* transaction);
+
+/** Whether a transaction is in progress or queued. */
+uint8_t spi_busy(const spi_bus_t* bus);
+
+/**
+ * @brief SPI interrupt body (overrun and mode faults); the SPIn_IRQHandler
+ * vectors call this.
+ */
+void spi_irq(uint8_t instance);
+
+const spi_stats_t* spi_get_stats(const spi_bus_t* bus);
+
+#if !defined(STM32F407xx)
+/**
+ * @brief Host model of a device on the bus: returns the byte it shifts out
+ * while receiving mosi. cs is the index of the selected chip select, or
+ * 0xFF if none is low.
+ */
+typedef uint8_t (*spi_sim_device_t)(uint8_t cs, uint8_t mosi, void* context);
+
+/**
+ * @brief Host model: the bus clocks up to max_frames bytes, each taken from
+ * the TX stream, exchanged with device (which may be NULL, reading 0xFF)
+ * and handed to the RX stream. Transactions chained from the completion
+ * interrupt carry on within the same call.
+ *
+ * @return Bytes exchanged; fewer than max_frames if the queue ran dry.
+ */
+uint32_t spi_sim_run(spi_bus_t* bus, spi_sim_device_t device, void* context, uint32_t max_frames);
+
+/** Host model: the SPI raises the given SR error flags. */
+void spi_sim_error(spi_bus_t* bus, uint32_t errors);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPI_H
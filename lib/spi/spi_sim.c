@@ -0,0 +1,47 @@
+#include "spi.h"
+#include <stddef.h>
+
+#if !defined(STM32F407xx)
+
+/* The chip select the GPIO outputs show as low, as a device on the bus sees it */
+static uint8_t selected(const spi_bus_t* bus)
+{
+    for (uint8_t i = 0; i < bus->config.cs_count; i++) {
+        const spi_cs_t* pin = &bus->config.cs[i];
+        if ((hal_sim_gpio[pin->port].ODR & (1U << pin->pin)) == 0U) {
+            return i;
+        }
+    }
+    return 0xFF;
+}
+
+uint32_t spi_sim_run(spi_bus_t* bus, spi_sim_device_t device, void* context, uint32_t max_frames)
+{
+    uint32_t frames = 0;
+    while (frames < max_frames && bus->regs != NULL && (bus->regs->CR1 & SPI_CR1_SPE) &&
+           (bus->regs->CR2 & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)) == (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)) {
+        uint8_t mosi;
+        if (dma_sim_drain(bus->tx_dma.controller_index, bus->tx_dma.stream_index, &mosi, 1) == 0U) {
+            break;
+        }
+        uint8_t miso = (device != NULL) ? device(selected(bus), mosi, context) : 0xFFU;
+        /* The RX completion of a transaction's last byte starts the next one */
+        dma_sim_transfer(bus->rx_dma.controller_index, bus->rx_dma.stream_index, &miso, 1);
+        frames++;
+    }
+    return frames;
+}
+
+void spi_sim_error(spi_bus_t* bus, uint32_t errors)
+{
+    if (bus->regs == NULL) {
+        return;
+    }
+    bus->regs->SR |= errors & SPI_SR_ERRORS;
+    if (bus->regs->CR2 & SPI_CR2_ERRIE) {
+        spi_irq(bus->instance);
+    }
+    bus->regs->SR &= ~SPI_SR_ERRORS;
+}
+
+#endif
@@ -0,0 +1,340 @@
+#include "timebase.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define SYST_CSR_ENABLE (1U << 0)
+#define SYST_CSR_TICKINT (1U << 1)
+#define SYST_CSR_CLKSOURCE (1U << 2)
+#define SYST_STOPPED (SYST_CSR_CLKSOURCE | SYST_CSR_TICKINT)
+#define SYST_RUNNING (SYST_CSR_CLKSOURCE | SYST_CSR_TICKINT | SYST_CSR_ENABLE)
+
+#define CYCLES_PER_TICK TIMEBASE_CYCLES_PER_TICK
+#define MAX_IDLE_TICKS (0x00FFFFFFU / CYCLES_PER_TICK)
+
+#if CYCLES_PER_TICK > 0x01000000U || CYCLES_PER_TICK <= 2U * (TIMEBASE_STOPPED_CYCLES + 2U)
+#error "TIMEBASE_CPU_HZ / TIMEBASE_TICK_HZ must fit the 24-bit SysTick reload"
+#endif
+
+#if defined(STM32F407xx)
+#define SYSTICK ((systick_regs_t*)0xE000E010U)
+#define SYST_CSR_COUNTFLAG (1U << 16)
+#define SCB_ICSR (*(volatile uint32_t*)0xE000ED04U)
+#define SCB_ICSR_PENDSTSET (1U << 26)
+
+static inline void systick_control(uint32_t csr)
+{
+    SYSTICK->CSR = csr;
+}
+
+static inline void systick_clear_current(void)
+{
+    SYSTICK->CVR = 0;
+}
+
+/* Reading CSR clears COUNTFLAG */
+static inline uint32_t systick_count_flag(void)
+{
+    return SYSTICK->CSR & SYST_CSR_COUNTFLAG;
+}
+
+static inline uint32_t tick_pending(void)
+{
+    return SCB_ICSR & SCB_ICSR_PENDSTSET;
+}
+
+static inline void cpu_wait(void)
+{
+    /* WFI wakes on a pending interrupt even while PRIMASK masks it */
+    __asm volatile("dsb\n"
+                   "wfi\n"
+                   "isb"
+                   :
+                   :
+                   : "memory");
+}
+#else
+#define SYSTICK (&timebase_sim_systick)
+#define systick_control timebase_sim_control
+#define systick_clear_current timebase_sim_clear_current
+#define systick_count_flag timebase_sim_count_flag
+#define tick_pending timebase_sim_tick_pending
+#define cpu_wait timebase_sim_wait
+#endif
+
+static timebase_tick_handler_t tick_handler;
+static timebase_deadline_t next_deadline;
+static volatile uint32_t tick_count;
+static timebase_stats_t stats;
+
+static void announce(uint32_t ticks)
+{
+    if (ticks != 0) {
+        tick_count += ticks;
+        tick_handler(ticks);
+    }
+}
+
+#if defined(STM32F407xx) && TIMEBASE_STOP_MIN_TICKS > 0
+
+#if TIMEBASE_TICK_HZ != 1000U
+#error "STOP mode timing assumes a 1 ms tick"
+#endif
+
+#define RCC_APB1ENR (*(volatile uint32_t*)0x40023840U)
+#define RCC_APB1ENR_PWREN (1U << 28)
+#define RCC_BDCR (*(volatile uint32_t*)0x40023870U)
+#define RCC_BDCR_RTCSEL_LSI (2U << 8)
+#define RCC_BDCR_RTCEN (1U << 15)
+#define RCC_CSR (*(volatile uint32_t*)0x40023874U)
+#define RCC_CSR_LSION (1U << 0)
+#define RCC_CSR_LSIRDY (1U << 1)
+#define PWR_CR (*(volatile uint32_t*)0x40007000U)
+#define PWR_CR_LPDS (1U << 0)
+#define PWR_CR_CWUF (1U << 2)
+#define PWR_CR_DBP (1U << 8)
+#define SCB_SCR (*(volatile uint32_t*)0xE000ED10U)
+#define SCB_SCR_SLEEPDEEP (1U << 2)
+#define NVIC_ISER0 (*(volatile uint32_t*)0xE000E100U)
+#define RTC_WKUP_IRQN 3U
+
+#define RTC_TR (*(volatile uint32_t*)0x40002800U)
+#define RTC_DR (*(volatile uint32_t*)0x40002804U)
+#define RTC_CR (*(volatile uint32_t*)0x40002808U)
+#define RTC_CR_WUTE (1U << 10)
+#define RTC_CR_WUTIE (1U << 14)
+#define RTC_ISR (*(volatile uint32_t*)0x4000280CU)
+#define RTC_ISR_WUTWF (1U << 2)
+#define RTC_ISR_INITF (1U << 6)
+#define RTC_ISR_INIT (1U << 7)
+#define RTC_ISR_WUTF (1U << 10)
+#define RTC_PRER (*(volatile uint32_t*)0x40002810U)
+#define RTC_WUTR (*(volatile uint32_t*)0x40002814U)
+#define RTC_WPR (*(volatile uint32_t*)0x40002824U)
+#define RTC_SSR (*(volatile uint32_t*)0x40002828U)
+
+#define EXTI_IMR (*(volatile uint32_t*)0x40013C00U)
+#define EXTI_RTSR (*(volatile uint32_t*)0x40013C08U)
+#define EXTI_PR (*(volatile uint32_t*)0x40013C14U)
+#define EXTI_LINE_RTC_WKUP (1U << 22)
+
+/* LSI / 32 / 1000: the sub-second counter steps once per millisecond */
+#define RTC_PREDIV_A 31U
+#define RTC_PREDIV_S 999U
+/* Wakeup timer on RTCCLK / 16: two counts per millisecond */
+#define RTC_WUT_PER_TICK 2U
+#define RTC_MS_PER_DAY 86400000U
+#define MAX_STOP_TICKS (0x10000U / RTC_WUT_PER_TICK)
+
+static uint8_t rtc_ready;
+
+static void rtc_init(void)
+{
+    RCC_APB1ENR |= RCC_APB1ENR_PWREN;
+    PWR_CR |= PWR_CR_DBP;
+    RCC_CSR |= RCC_CSR_LSION;
+    while ((RCC_CSR & RCC_CSR_LSIRDY) == 0) {
+    }
+    RCC_BDCR |= RCC_BDCR_RTCSEL_LSI | RCC_BDCR_RTCEN;
+
+    RTC_WPR = 0xCAU;
+    RTC_WPR = 0x53U;
+    RTC_ISR |= RTC_ISR_INIT;
+    while ((RTC_ISR & RTC_ISR_INITF) == 0) {
+    }
+    RTC_PRER = RTC_PREDIV_S;
+    RTC_PRER = (RTC_PREDIV_A << 16) | RTC_PREDIV_S;
+    RTC_ISR &= ~RTC_ISR_INIT;
+
+    EXTI_IMR |= EXTI_LINE_RTC_WKUP;
+    EXTI_RTSR |= EXTI_LINE_RTC_WKUP;
+    NVIC_ISER0 = 1U << RTC_WKUP_IRQN;
+    rtc_ready = 1;
+}
+
+static uint32_t bcd_seconds(uint32_t tr)
+{
+    uint32_t hours = ((tr >> 20) & 0x3U) * 10U + ((tr >> 16) & 0xFU);
+    uint32_t minutes = ((tr >> 12) & 0x7U) * 10U + ((tr >> 8) & 0xFU);
+    uint32_t seconds = ((tr >> 4) & 0x7U) * 10U + (tr & 0xFU);
+    return hours * 3600U + minutes * 60U + seconds;
+}
+
+/* Milliseconds since midnight; reading SSR freezes TR until DR is read */
+static uint32_t rtc_millis(void)
+{
+    uint32_t ssr = RTC_SSR;
+    uint32_t tr = RTC_TR;
+    (void)RTC_DR;
+    return bcd_seconds(tr) * 1000U + (RTC_PREDIV_S - ssr);
+}
+
+static void stop_sleep(uint32_t idle_ticks)
+{
+    if (!rtc_ready) {
+        rtc_init();
+    }
+    if (idle_ticks > MAX_STOP_TICKS) {
+        idle_ticks = MAX_STOP_TICKS;
+    }
+
+    RTC_CR &= ~RTC_CR_WUTE;
+    while ((RTC_ISR & RTC_ISR_WUTWF) == 0) {
+    }
+    RTC_WUTR = idle_ticks * RTC_WUT_PER_TICK - 1U;
+    RTC_ISR &= ~RTC_ISR_WUTF;
+    EXTI_PR = EXTI_LINE_RTC_WKUP;
+    RTC_CR |= RTC_CR_WUTIE | RTC_CR_WUTE;
+
+    /* SysTick stops with the core clock; STOP exits on HSI, which is the clock in use */
+    systick_control(SYST_STOPPED);
+    uint32_t start = rtc_millis();
+    PWR_CR |= PWR_CR_LPDS | PWR_CR_CWUF;
+    SCB_SCR |= SCB_SCR_SLEEPDEEP;
+    cpu_wait();
+    SCB_SCR &= ~SCB_SCR_SLEEPDEEP;
+    uint32_t slept = (rtc_millis() + RTC_MS_PER_DAY - start) % RTC_MS_PER_DAY;
+
+    RTC_CR &= ~(RTC_CR_WUTIE | RTC_CR_WUTE);
+    RTC_ISR &= ~RTC_ISR_WUTF;
+    EXTI_PR = EXTI_LINE_RTC_WKUP;
+
+    /* The sub-tick phase is lost across STOP; restart on a fresh period */
+    SYSTICK->RVR = CYCLES_PER_TICK - 1U;
+    systick_clear_current();
+    systick_control(SYST_RUNNING);
+
+    STAT_INC(stats.stop_entries);
+    STAT_ADD(stats.ticks_suppressed, slept);
+    announce(slept);
+}
+
+void RTC_WKUP_IRQHandler(void)
+{
+    /* Only here to end STOP; the sleeping code does the bookkeeping */
+    RTC_ISR &= ~RTC_ISR_WUTF;
+    EXTI_PR = EXTI_LINE_RTC_WKUP;
+}
+#endif
+
+status_t timebase_init(timebase_tick_handler_t handler, timebase_deadline_t deadline)
+{
+    if (handler == NULL || deadline == NULL) {
+        return FAILURE;
+    }
+    tick_handler = handler;
+    next_deadline = deadline;
+    tick_count = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    systick_control(0);
+    SYSTICK->RVR = CYCLES_PER_TICK - 1U;
+    systick_clear_current();
+    systick_control(SYST_RUNNING);
+    return SUCCESS;
+}
+
+uint32_t timebase_ticks(void)
+{
+    return tick_count;
+}
+
+void timebase_tick_isr(void)
+{
+    announce(1);
+}
+
+#if defined(STM32F407xx)
+void SysTick_Handler(void)
+{
+    timebase_tick_isr();
+}
+#endif
+
+void timebase_sleep(void)
+{
+    uint32_t idle_ticks = next_deadline();
+    if (idle_ticks == 0) {
+        return;
+    }
+    STAT_INC(stats.sleeps);
+
+#if defined(STM32F407xx) && TIMEBASE_STOP_MIN_TICKS > 0
+    if (idle_ticks >= TIMEBASE_STOP_MIN_TICKS && idle_ticks != UINT32_MAX) {
+        stop_sleep(idle_ticks);
+        return;
+    }
+#endif
+
+    if (idle_ticks < 2U || tick_pending()) {
+        /* The next tick is the deadline anyway */
+        cpu_wait();
+        return;
+    }
+    if (idle_ticks > MAX_IDLE_TICKS) {
+        idle_ticks = MAX_IDLE_TICKS;
+    }
+
+    /*
+     * Everything below counts cycles from the last tick boundary. The counter
+     * is frozen for about TIMEBASE_STOPPED_CYCLES each time it is stopped and
+     * restarted, so that much is taken off each period programmed afterwards.
+     * A tick that fires just before the stop is still pending and is delivered
+     * by its interrupt; the sleep then simply wakes at once.
+     */
+    systick_control(SYST_STOPPED);
+    uint32_t to_boundary = SYSTICK->CVR;
+    if (to_boundary == 0) {
+        /* Just wrapped: the reload cycle plus a full period remain */
+        to_boundary = CYCLES_PER_TICK;
+    }
+
+    uint32_t reload = to_boundary + CYCLES_PER_TICK * (idle_ticks - 1U) - TIMEBASE_STOPPED_CYCLES - 1U;
+    SYSTICK->RVR = reload;
+    systick_clear_current();
+    systick_control(SYST_RUNNING);
+
+    cpu_wait();
+
+    systick_control(SYST_STOPPED);
+    uint32_t current = SYSTICK->CVR;
+    uint32_t counted;
+    uint32_t expired = systick_count_flag() != 0;
+    if (expired) {
+        /* The deadline wrapped the counter, which reloaded and kept counting */
+        uint32_t latency = reload - current + 1U;
+        counted = reload + 1U + latency;
+        STAT_SET(stats.wake_latency_last, latency);
+        STAT_MAX(stats.wake_latency_max, latency);
+    } else {
+        counted = reload - current + 1U;
+        STAT_INC(stats.early_wakes);
+    }
+
+    uint32_t since_tick = (CYCLES_PER_TICK - to_boundary) + TIMEBASE_STOPPED_CYCLES + counted;
+    uint32_t elapsed = since_tick / CYCLES_PER_TICK;
+    uint32_t to_next = CYCLES_PER_TICK - since_tick % CYCLES_PER_TICK;
+    if (to_next <= TIMEBASE_STOPPED_CYCLES + 1U) {
+        /* The boundary falls inside the restart; count that tick now */
+        elapsed++;
+        to_next += CYCLES_PER_TICK;
+    }
+    if (expired) {
+        /* The pending SysTick interrupt delivers the deadline tick itself */
+        elapsed--;
+    }
+
+    SYSTICK->RVR = to_next - TIMEBASE_STOPPED_CYCLES - 1U;
+    systick_clear_current();
+    systick_control(SYST_RUNNING);
+    /* Takes effect at the next reload, restoring the periodic tick */
+    SYSTICK->RVR = CYCLES_PER_TICK - 1U;
+
+    STAT_ADD(stats.ticks_suppressed, elapsed);
+    announce(elapsed);
+}
+
+timebase_stats_t timebase_get_stats(void)
+{
+    return stats;
+}
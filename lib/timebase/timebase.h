@@ -0,0 +1,156 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "build_config.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * System tick and tickless sleep.
+ *
+ * SysTick interrupts once per tick and hands each tick to the registered
+ * handler (the event scheduler or the kernel). When the system idles, the
+ * sleep call asks the deadline callback how many ticks may pass, stretches
+ * one SysTick period to end on that deadline, waits in WFI and then hands
+ * the handler every tick that elapsed, so an idle system wakes only for its
+ * next timer or for an interrupt.
+ *
+ * With TIMEBASE_STOP_MIN_TICKS set, idle periods at least that long use
+ * STOP mode instead, timed by the RTC wakeup timer running from the LSI.
+ * STOP cuts far more current than WFI but the LSI is only accurate to a few
+ * percent, so ticks counted across STOP drift accordingly; it is off by
+ * default.
+ *
+ * On the host, SysTick is replaced by a clock model (see timebase_sim_*) so
+ * the compensation arithmetic can be exercised and its drift measured.
+ */
+
+/** Tick frequency in Hz. */
+#ifndef TIMEBASE_TICK_HZ
+#define TIMEBASE_TICK_HZ 1000U
+#endif
+
+/** SysTick input clock in Hz. Reset default is the 16 MHz HSI. */
+#ifndef TIMEBASE_CPU_HZ
+#define TIMEBASE_CPU_HZ 16000000U
+#endif
+
+/**
+ * Cycles SysTick spends stopped while a tickless sleep reprograms it; the
+ * next period is shortened by this much so ticks do not drift.
+ */
+#ifndef TIMEBASE_STOPPED_CYCLES
+#define TIMEBASE_STOPPED_CYCLES 24U
+#endif
+
+/** Idle ticks at which STOP mode replaces WFI; 0 disables STOP mode. */
+#ifndef TIMEBASE_STOP_MIN_TICKS
+#define TIMEBASE_STOP_MIN_TICKS 0U
+#endif
+
+#define TIMEBASE_CYCLES_PER_TICK (TIMEBASE_CPU_HZ / TIMEBASE_TICK_HZ)
+
+/**
+ * @brief Receives elapsed ticks: one per SysTick interrupt, or the ticks
+ * skipped by a tickless sleep. Called with interrupts masked or from SysTick.
+ */
+typedef void (*timebase_tick_handler_t)(uint32_t ticks);
+
+/**
+ * @brief Returns how many ticks may pass before the next deadline: zero if
+ * work is pending, UINT32_MAX if there is no deadline.
+ */
+typedef uint32_t (*timebase_deadline_t)(void);
+
+/** SysTick register block. */
+typedef struct {
+    volatile uint32_t CSR;
+    volatile uint32_t RVR;
+    volatile uint32_t CVR;
+    volatile uint32_t CALIB;
+} systick_regs_t;
+
+typedef struct {
+    uint32_t sleeps;
+    uint32_t ticks_suppressed;
+    uint32_t early_wakes;
+    uint32_t stop_entries;
+    uint32_t wake_latency_last;    /* SysTick cycles from deadline to resuming */
+    uint32_t wake_latency_max;
+} timebase_stats_t;
+
+/**
+ * @brief Starts the periodic tick.
+ *
+ * @param handler Receives elapsed ticks.
+ * @param deadline Reports how long the system may sleep.
+ * @return status_t SUCCESS, or FAILURE if a callback is NULL.
+ */
+status_t timebase_init(timebase_tick_handler_t handler, timebase_deadline_t deadline);
+
+/**
+ * @brief Returns the ticks counted since timebase_init(), including the ones
+ * skipped while sleeping.
+ */
+uint32_t timebase_ticks(void);
+
+/**
+ * @brief Sleeps until the next deadline or interrupt. Must be called with
+ * interrupts masked; it returns with them still masked, after handing the
+ * skipped ticks to the handler. Matches sched_idle_hook_t.
+ */
+void timebase_sleep(void);
+
+/**
+ * @brief Counts one tick; the SysTick interrupt body.
+ */
+void timebase_tick_isr(void);
+
+/**
+ * @brief Returns a snapshot of the sleep counters.
+ */
+timebase_stats_t timebase_get_stats(void);
+
+#if !defined(STM32F407xx)
+/*
+ * Host clock model. True time advances in core cycles; the modelled SysTick
+ * counts down at that rate, and its interrupt is delivered whenever the
+ * model runs unmasked. Sleeping costs a fixed wake-up latency, and every
+ * stop/start of the counter freezes it for a fixed number of cycles.
+ */
+
+/** The modelled SysTick registers. */
+extern systick_regs_t timebase_sim_systick;
+
+/** Resets true time to zero and sets the modelled costs, in cycles. */
+void timebase_sim_reset(uint32_t wake_cycles, uint32_t stopped_cycles);
+
+/** Runs awake for a number of cycles, delivering tick interrupts as they fire. */
+void timebase_sim_run(uint64_t cycles);
+
+/** Schedules an interrupt that ends the next sleep early, at an absolute time. */
+void timebase_sim_interrupt_at(uint64_t cycle);
+
+/** Returns true time in cycles. */
+uint64_t timebase_sim_cycles(void);
+
+/** Returns the true time at which the running counter next reaches zero. */
+uint64_t timebase_sim_next_tick(void);
+
+/* Hooks used by timebase.c in place of the SysTick hardware */
+void timebase_sim_control(uint32_t csr);
+void timebase_sim_clear_current(void);
+uint32_t timebase_sim_count_flag(void);
+uint32_t timebase_sim_tick_pending(void);
+void timebase_sim_wait(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMEBASE_H
@@ -0,0 +1,159 @@
+#include "timebase.h"
+
+#if !defined(STM32F407xx)
+
+#define SYST_CSR_ENABLE (1U << 0)
+#define SYST_CSR_TICKINT (1U << 1)
+#define SYST_CSR_COUNTFLAG (1U << 16)
+
+systick_regs_t timebase_sim_systick;
+
+static uint64_t now;
+static uint64_t interrupt_at; /* Zero when no interrupt is scheduled */
+static uint32_t wake_cost;
+static uint32_t stopped_cost;
+static uint8_t tick_irq_pending;
+
+/* Counts the modelled SysTick down, as the hardware would over that many cycles */
+static void advance(uint64_t cycles, int deliver)
+{
+    systick_regs_t* st = &timebase_sim_systick;
+
+    while (cycles > 0) {
+        if ((st->CSR & SYST_CSR_ENABLE) == 0) {
+            now += cycles;
+            return;
+        }
+        if (st->CVR == 0) {
+            /* The cycle after reaching zero reloads the counter */
+            st->CVR = st->RVR;
+            now++;
+            cycles--;
+            continue;
+        }
+
+        uint64_t step = (st->CVR < cycles) ? st->CVR : cycles;
+        st->CVR -= (uint32_t)step;
+        now += step;
+        cycles -= step;
+        if (st->CVR == 0) {
+            st->CSR |= SYST_CSR_COUNTFLAG;
+            if ((st->CSR & SYST_CSR_TICKINT) != 0) {
+                tick_irq_pending = 1;
+            }
+            if (deliver && tick_irq_pending) {
+                tick_irq_pending = 0;
+                timebase_tick_isr();
+            }
+        }
+    }
+}
+
+void timebase_sim_reset(uint32_t wake_cycles, uint32_t stopped_cycles)
+{
+    timebase_sim_systick.CSR = 0;
+    timebase_sim_systick.RVR = 0;
+    timebase_sim_systick.CVR = 0;
+    timebase_sim_systick.CALIB = 0;
+    now = 0;
+    interrupt_at = 0;
+    wake_cost = wake_cycles;
+    stopped_cost = stopped_cycles;
+    tick_irq_pending = 0;
+}
+
+void timebase_sim_run(uint64_t cycles)
+{
+    if (tick_irq_pending) {
+        tick_irq_pending = 0;
+        timebase_tick_isr();
+    }
+    advance(cycles, 1);
+}
+
+void timebase_sim_interrupt_at(uint64_t cycle)
+{
+    interrupt_at = cycle;
+}
+
+uint64_t timebase_sim_cycles(void)
+{
+    return now;
+}
+
+uint64_t timebase_sim_next_tick(void)
+{
+    systick_regs_t* st = &timebase_sim_systick;
+    if (st->CVR != 0) {
+        return now + st->CVR;
+    }
+    return now + 1U + st->RVR;
+}
+
+void timebase_sim_control(uint32_t csr)
+{
+    systick_regs_t* st = &timebase_sim_systick;
+    uint32_t was_enabled = st->CSR & SYST_CSR_ENABLE;
+
+    st->CSR = (csr & ~SYST_CSR_COUNTFLAG) | (st->CSR & SYST_CSR_COUNTFLAG);
+    if (!was_enabled && (csr & SYST_CSR_ENABLE) != 0) {
+        /* Time spent between stopping and restarting, invisible to the counter */
+        now += stopped_cost;
+        if (st->CVR == 0) {
+            /* The first clock loads the reload value, before any later RVR write lands */
+            st->CVR = st->RVR;
+            now++;
+        }
+    }
+}
+
+void timebase_sim_clear_current(void)
+{
+    timebase_sim_systick.CVR = 0;
+    timebase_sim_systick.CSR &= ~SYST_CSR_COUNTFLAG;
+}
+
+uint32_t timebase_sim_count_flag(void)
+{
+    uint32_t flag = timebase_sim_systick.CSR & SYST_CSR_COUNTFLAG;
+    timebase_sim_systick.CSR &= ~SYST_CSR_COUNTFLAG;
+    return flag;
+}
+
+uint32_t timebase_sim_tick_pending(void)
+{
+    return tick_irq_pending;
+}
+
+void timebase_sim_wait(void)
+{
+    systick_regs_t* st = &timebase_sim_systick;
+
+    for (;;) {
+        if (tick_irq_pending) {
+            break;
+        }
+        if (interrupt_at != 0 && now >= interrupt_at) {
+            interrupt_at = 0;
+            break;
+        }
+
+        uint64_t step = UINT64_MAX;
+        if ((st->CSR & SYST_CSR_ENABLE) != 0) {
+            step = (st->CVR == 0) ? 1U : st->CVR;
+        }
+        if (interrupt_at != 0 && interrupt_at - now < step) {
+            step = interrupt_at - now;
+        }
+        if (step == UINT64_MAX) {
+            /* Nothing could ever wake the core */
+            return;
+        }
+        advance(step, 0);
+    }
+
+    /* Wake-up latency: the counter keeps running while the core restarts */
+    advance(wake_cost, 0);
+}
+
+#endif
@@ -0,0 +1,394 @@
+#include "usart.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define BUS_APB1 1U
+#define BUS_APB2 2U
+
+typedef struct {
+    uint8_t bus;
+    uint8_t rcc_bit;
+    uint8_t irqn;
+    uint8_t dma_controller;
+    uint8_t dma_channel;
+    uint8_t rx_stream;
+    uint8_t tx_stream;
+} usart_instance_t;
+
+/*
+ * RM0090 tables 42-43 and 61. Streams are chosen so that no two instances
+ * share one, and USART1 and USART6 stay clear of the ADC and SPI1 on DMA2;
+ * on DMA1 the other USARTs use all eight streams, so SPI2 and SPI3 can only
+ * run next to some of them (usart_init fails on a taken stream).
+ */
+static const usart_instance_t instances[USART_INSTANCES] = {
+    { BUS_APB2, 4, 37, 2, 4, 5, 7 },  /* USART1 */
+    { BUS_APB1, 17, 38, 1, 4, 5, 6 }, /* USART2 */
+    { BUS_APB1, 18, 39, 1, 4, 1, 3 }, /* USART3 */
+    { BUS_APB1, 19, 52, 1, 4, 2, 4 }, /* UART4 */
+    { BUS_APB1, 20, 53, 1, 4, 0, 7 }, /* UART5 */
+    { BUS_APB2, 5, 71, 2, 5, 1, 6 },  /* USART6 */
+};
+
+#if !defined(STM32F407xx)
+usart_regs_t usart_sim_regs[USART_INSTANCES];
+#endif
+
+static usart_t* ports[USART_INSTANCES];
+
+static usart_regs_t* instance_regs(uint8_t instance)
+{
+    switch (instance) {
+    case 1: return USART1_REGS;
+    case 2: return USART2_REGS;
+    case 3: return USART3_REGS;
+    case 4: return UART4_REGS;
+    case 5: return UART5_REGS;
+    default: return USART6_REGS;
+    }
+}
+
+/*
+ * BRR holds USARTDIV in 1/16ths, or in 1/8ths with the fraction in bits
+ * 2:0 when oversampling by 8; either way the divider in bit times is
+ * clock / baud. Oversampling by 16 tolerates more clock error, so it is
+ * used whenever the divider allows.
+ */
+static status_t baud_divider(uint32_t clock_hz, uint32_t baud_rate, uint32_t* brr, uint32_t* over8)
+{
+    uint32_t divider = (uint32_t)(((uint64_t)clock_hz + baud_rate / 2U) / baud_rate);
+    if (divider < 8U || divider > 0xFFFFU) {
+        return FAILURE;
+    }
+    uint64_t actual = (uint64_t)divider * baud_rate;
+    uint64_t error = (actual > clock_hz) ? actual - clock_hz : clock_hz - actual;
+    if (error * 50U > clock_hz) {
+        return FAILURE;
+    }
+    if (divider >= 16U) {
+        *brr = divider;
+        *over8 = 0;
+    } else {
+        *brr = ((divider >> 3) << 4) | (divider & 7U);
+        *over8 = USART_CR1_OVER8;
+    }
+    return SUCCESS;
+}
+
+/* ------------------------------------------------------------- receive --- */
+
+static void rx_append(usart_t* port, const uint8_t* data, uint32_t count)
+{
+    if (count == 0U || port->rx_dropping) {
+        return;
+    }
+    msg_t* frame = port->rx_frame;
+    if (frame == NULL) {
+        frame = msg_alloc(port->config.rx_pool);
+        if (frame == NULL) {
+            STAT_INC(port->stats.rx_no_buffer);
+            port->rx_dropping = 1;
+            return;
+        }
+        port->rx_frame = frame;
+    }
+    if (frame->length + count > port->config.rx_pool->payload_size) {
+        STAT_INC(port->stats.rx_oversize);
+        msg_free(frame);
+        port->rx_frame = NULL;
+        port->rx_dropping = 1;
+        return;
+    }
+    memcpy((uint8_t*)msg_payload(frame) + frame->length, data, count);
+    frame->length = (uint16_t)(frame->length + count);
+}
+
+/* Moves what the DMA has written since the last drain into the frame in progress */
+static void rx_drain(usart_t* port)
+{
+    uint32_t primask = hal_irq_mask();
+    uint32_t size = port->config.rx_ring_size;
+    uint32_t head = size - dma_remaining(&port->rx_dma);
+    uint32_t tail = port->rx_tail;
+    const uint8_t* ring = port->config.rx_ring;
+
+    if (head >= size) {
+        head = 0;
+    }
+    if (head >= tail) {
+        rx_append(port, ring + tail, head - tail);
+    } else {
+        rx_append(port, ring + tail, size - tail);
+        rx_append(port, ring, head);
+    }
+    port->rx_tail = (uint16_t)head;
+    STAT_INC(port->stats.rx_interrupts);
+    hal_irq_restore(primask);
+}
+
+static void rx_frame_end(usart_t* port)
+{
+    uint32_t primask = hal_irq_mask();
+    rx_drain(port);
+    msg_t* frame = port->rx_frame;
+    if (port->rx_error && !port->rx_dropping) {
+        STAT_INC(port->stats.rx_line_errors);
+        if (frame != NULL) {
+            msg_free(frame);
+        }
+    } else if (frame != NULL) {
+        frame->type = port->config.rx_msg_type;
+        STAT_INC(port->stats.rx_frames);
+        STAT_ADD(port->stats.rx_bytes, frame->length);
+        mailbox_post(port->config.rx_output, frame);
+    }
+    port->rx_frame = NULL;
+    port->rx_error = 0;
+    port->rx_dropping = 0;
+    hal_irq_restore(primask);
+}
+
+static void rx_restart(usart_t* port)
+{
+    uint32_t primask = hal_irq_mask();
+    if (port->rx_frame != NULL) {
+        msg_free(port->rx_frame);
+        port->rx_frame = NULL;
+    }
+    port->rx_dropping = 1; /* The rest of the current frame is gone with the ring */
+    port->rx_tail = 0;
+    dma_start(&port->rx_dma, (uintptr_t)&port->regs->DR, port->config.rx_ring, port->config.rx_ring_size);
+    hal_irq_restore(primask);
+}
+
+static void rx_dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    usart_t* port = (usart_t*)context;
+    if (event == DMA_EVENT_ERROR) {
+        STAT_INC(port->stats.dma_errors);
+        rx_restart(port);
+        return;
+    }
+    rx_drain(port);
+}
+
+/* ------------------------------------------------------------ transmit --- */
+
+/* Starts the next queued message; called with interrupts masked, which makes this the queue's only consumer */
+static void tx_next(usart_t* port)
+{
+    for (;;) {
+        msg_t* msg = mailbox_fetch(&port->tx_queue);
+        port->tx_current = msg;
+        if (msg == NULL) {
+            return;
+        }
+        if (msg->length != 0U &&
+            dma_start(&port->tx_dma, (uintptr_t)&port->regs->DR, msg_payload(msg), msg->length) == SUCCESS) {
+            return;
+        }
+        msg_free(msg);
+    }
+}
+
+static void tx_dma_event(dma_stream_t* stream, dma_event_t event, void* buffer, void* context)
+{
+    (void)stream;
+    (void)buffer;
+    usart_t* port = (usart_t*)context;
+    if (event == DMA_EVENT_HALF) {
+        return;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    msg_t* done = port->tx_current;
+    if (event == DMA_EVENT_ERROR) {
+        STAT_INC(port->stats.dma_errors);
+    } else if (done != NULL) {
+        STAT_INC(port->stats.tx_messages);
+        STAT_ADD(port->stats.tx_bytes, done->length);
+    }
+    if (done != NULL) {
+        msg_free(done);
+    }
+    tx_next(port);
+    hal_irq_restore(primask);
+}
+
+status_t usart_send(usart_t* port, msg_t* msg)
+{
+    if (port == NULL || msg == NULL || port->regs == NULL) {
+        return FAILURE;
+    }
+    mailbox_post(&port->tx_queue, msg);
+
+    uint32_t primask = hal_irq_mask();
+    if (port->tx_current == NULL) {
+        tx_next(port);
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+uint8_t usart_tx_busy(const usart_t* port)
+{
+    return port->tx_current != NULL;
+}
+
+/* ------------------------------------------------------------- control --- */
+
+static status_t claim_streams(usart_t* port, const usart_instance_t* info)
+{
+    dma_config_t dma_config;
+    memset(&dma_config, 0, sizeof(dma_config));
+    dma_config.channel = info->dma_channel;
+    dma_config.priority = 2; /* Above TX: a late RX request loses a byte */
+    dma_config.direction = DMA_PERIPH_TO_MEMORY;
+    dma_config.mode = DMA_MODE_CIRCULAR;
+    dma_config.peripheral_size = 1;
+    dma_config.memory_size = 1;
+    dma_config.memory_increment = 1;
+    dma_config.half_transfer = 1;
+    dma_config.callback = rx_dma_event;
+    dma_config.context = port;
+    if (dma_stream_init(&port->rx_dma, info->dma_controller, info->rx_stream, &dma_config) != SUCCESS) {
+        return FAILURE;
+    }
+
+    dma_config.priority = 1;
+    dma_config.direction = DMA_MEMORY_TO_PERIPH;
+    dma_config.mode = DMA_MODE_NORMAL;
+    dma_config.half_transfer = 0;
+    dma_config.callback = tx_dma_event;
+    if (dma_stream_init(&port->tx_dma, info->dma_controller, info->tx_stream, &dma_config) != SUCCESS) {
+        dma_stream_release(&port->rx_dma);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+status_t usart_init(usart_t* port, uint8_t instance, const usart_config_t* config)
+{
+    uint32_t brr;
+    uint32_t over8;
+    if (port == NULL || config == NULL || instance < 1U || instance > USART_INSTANCES || config->baud_rate == 0U ||
+        config->parity > USART_PARITY_ODD || config->rx_ring == NULL || config->rx_ring_size < 2U ||
+        (config->rx_ring_size & 1U) != 0U || config->rx_pool == NULL || config->rx_output == NULL ||
+        baud_divider(config->clock_hz, config->baud_rate, &brr, &over8) != SUCCESS) {
+        return FAILURE;
+    }
+
+    uint32_t primask = hal_irq_mask();
+    if (ports[instance - 1U] != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    ports[instance - 1U] = port;
+    hal_irq_restore(primask);
+
+    const usart_instance_t* info = &instances[instance - 1U];
+    memset(port, 0, sizeof(*port));
+    port->config = *config;
+    port->instance = instance;
+    if (claim_streams(port, info) != SUCCESS) {
+        ports[instance - 1U] = NULL;
+        return FAILURE;
+    }
+    mailbox_init(&port->tx_queue, NULL, NULL);
+    port->regs = instance_regs(instance);
+
+    if (info->bus == BUS_APB2) {
+        REG_SET(HAL_RCC->APB2ENR, 1U << info->rcc_bit);
+    } else {
+        REG_SET(HAL_RCC->APB1ENR, 1U << info->rcc_bit);
+    }
+
+    /* Parity takes the ninth bit, so 8 data bits with parity need M set */
+    uint32_t cr1 = over8 | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE;
+    if (config->parity != USART_PARITY_NONE) {
+        cr1 |= USART_CR1_M | USART_CR1_PCE | USART_CR1_PEIE;
+        if (config->parity == USART_PARITY_ODD) {
+            cr1 |= USART_CR1_PS;
+        }
+    }
+
+    usart_regs_t* regs = port->regs;
+    REG_WRITE(regs->CR1, 0);
+    REG_WRITE(regs->BRR, brr);
+    REG_WRITE(regs->CR2, 0);
+    REG_WRITE(regs->CR3, USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE);
+    dma_start(&port->rx_dma, (uintptr_t)&regs->DR, config->rx_ring, config->rx_ring_size);
+    REG_WRITE(regs->CR1, cr1);
+    REG_WRITE(regs->CR1, cr1 | USART_CR1_UE);
+
+    hal_nvic_enable(info->irqn);
+    return SUCCESS;
+}
+
+void usart_deinit(usart_t* port)
+{
+    if (port == NULL || port->regs == NULL) {
+        return;
+    }
+    const usart_instance_t* info = &instances[port->instance - 1U];
+    hal_nvic_disable(info->irqn);
+    REG_WRITE(port->regs->CR1, 0);
+    REG_WRITE(port->regs->CR3, 0);
+    dma_stream_release(&port->rx_dma);
+    dma_stream_release(&port->tx_dma);
+
+    if (port->rx_frame != NULL) {
+        msg_free(port->rx_frame);
+        port->rx_frame = NULL;
+    }
+    if (port->tx_current != NULL) {
+        msg_free(port->tx_current);
+        port->tx_current = NULL;
+    }
+    for (msg_t* msg = mailbox_fetch(&port->tx_queue); msg != NULL; msg = mailbox_fetch(&port->tx_queue)) {
+        msg_free(msg);
+    }
+
+    uint32_t primask = hal_irq_mask();
+    ports[port->instance - 1U] = NULL;
+    hal_irq_restore(primask);
+    port->regs = NULL;
+}
+
+void usart_irq(uint8_t instance)
+{
+    usart_t* port = ports[instance - 1U];
+    if (port == NULL) {
+        return;
+    }
+    usart_regs_t* regs = port->regs;
+    uint32_t sr = REG_READ(regs->SR);
+    if ((sr & (USART_SR_IDLE | USART_SR_ERRORS)) == 0U) {
+        return;
+    }
+    /* RM0090 30.6.1: reading SR and then DR clears IDLE and the error flags */
+    (void)REG_READ(regs->DR);
+    if (sr & USART_SR_ERRORS) {
+        port->rx_error = 1;
+    }
+    if (sr & USART_SR_IDLE) {
+        rx_frame_end(port);
+    }
+}
+
+const usart_stats_t* usart_get_stats(const usart_t* port)
+{
+    return &port->stats;
+}
+
+#if defined(STM32F407xx)
+void USART1_IRQHandler(void) { usart_irq(1); }
+void USART2_IRQHandler(void) { usart_irq(2); }
+void USART3_IRQHandler(void) { usart_irq(3); }
+void UART4_IRQHandler(void) { usart_irq(4); }
+void UART5_IRQHandler(void) { usart_irq(5); }
+void USART6_IRQHandler(void) { usart_irq(6); }
+#endif
@@ -0,0 +1,191 @@
+#ifndef USART_H
+#define USART_H
+
+#include "dma.h"
+#include "hal_reg.h"
+#include "mailbox.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * USART1-3, UART4-5 and USART6 with DMA in both directions.
+ *
+ * Receive runs a circular DMA stream into a byte ring the application
+ * provides. The driver drains the ring when the line goes idle (IDLE
+ * interrupt) and when the DMA crosses the half or the end of the ring,
+ * so a frame of any length costs one interrupt, plus one per half ring
+ * it spans. A frame is the bytes between two idle lines; each one is
+ * copied into a message from the receive pool and posted to the receive
+ * mailbox. Frames larger than a pool payload, frames that arrive while the
+ * pool is empty and frames with a parity, framing, noise or overrun error
+ * are dropped and counted.
+ *
+ * The ring must hold what arrives in the time it takes to get to the
+ * interrupt after a half-ring crossing: at 4 Mbaud a 256-byte ring leaves
+ * 320 us.
+ *
+ * Transmit takes messages: usart_send() queues one and the TX stream sends
+ * the queued payloads back to back, one DMA transfer per message, freeing
+ * each when its last byte has been handed to the USART. Sending is safe
+ * from any context.
+ */
+
+#define USART_INSTANCES 6U
+
+typedef struct {
+    volatile uint32_t SR;
+    volatile uint32_t DR;
+    volatile uint32_t BRR;
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t CR3;
+    volatile uint32_t GTPR;
+} usart_regs_t;
+
+#if !defined(STM32F407xx)
+extern usart_regs_t usart_sim_regs[USART_INSTANCES];
+#endif
+
+#define USART1_REGS HAL_PERIPH(usart_regs_t, 0x40011000U, usart_sim_regs[0])
+#define USART2_REGS HAL_PERIPH(usart_regs_t, 0x40004400U, usart_sim_regs[1])
+#define USART3_REGS HAL_PERIPH(usart_regs_t, 0x40004800U, usart_sim_regs[2])
+#define UART4_REGS HAL_PERIPH(usart_regs_t, 0x40004C00U, usart_sim_regs[3])
+#define UART5_REGS HAL_PERIPH(usart_regs_t, 0x40005000U, usart_sim_regs[4])
+#define USART6_REGS HAL_PERIPH(usart_regs_t, 0x40011400U, usart_sim_regs[5])
+
+#define USART_SR_PE (1U << 0)
+#define USART_SR_FE (1U << 1)
+#define USART_SR_NF (1U << 2)
+#define USART_SR_ORE (1U << 3)
+#define USART_SR_IDLE (1U << 4)
+#define USART_SR_RXNE (1U << 5)
+#define USART_SR_TC (1U << 6)
+#define USART_SR_TXE (1U << 7)
+#define USART_SR_ERRORS (USART_SR_PE | USART_SR_FE | USART_SR_NF | USART_SR_ORE)
+
+#define USART_CR1_RE (1U << 2)
+#define USART_CR1_TE (1U << 3)
+#define USART_CR1_IDLEIE (1U << 4)
+#define USART_CR1_PEIE (1U << 8)
+#define USART_CR1_PS (1U << 9)
+#define USART_CR1_PCE (1U << 10)
+#define USART_CR1_M (1U << 12)
+#define USART_CR1_UE (1U << 13)
+#define USART_CR1_OVER8 (1U << 15)
+
+#define USART_CR3_EIE (1U << 0)
+#define USART_CR3_DMAR (1U << 6)
+#define USART_CR3_DMAT (1U << 7)
+
+typedef enum {
+    USART_PARITY_NONE = 0,
+    USART_PARITY_EVEN,
+    USART_PARITY_ODD,
+} usart_parity_t;
+
+typedef struct {
+    uint32_t baud_rate;
+    uint32_t clock_hz;          /**< PCLK of the instance's bus: APB2 for 1 and 6, APB1 otherwise */
+    uint8_t parity;             /**< usart_parity_t; 8 data bits either way, one stop bit */
+    uint8_t* rx_ring;           /**< Receive DMA ring */
+    uint16_t rx_ring_size;      /**< Bytes, even, at least 2 */
+    uint16_t rx_msg_type;       /**< Stored in each posted frame */
+    msg_pool_t* rx_pool;        /**< Frames are copied into its payloads */
+    mailbox_t* rx_output;
+} usart_config_t;
+
+typedef struct {
+    uint32_t rx_frames;         /**< Frames posted */
+    uint32_t rx_bytes;          /**< Bytes in posted frames */
+    uint32_t rx_interrupts;     /**< Ring drains: idle lines plus half-ring crossings */
+    uint32_t rx_oversize;       /**< Frames dropped for not fitting a payload */
+    uint32_t rx_no_buffer;      /**< Frames dropped because the pool was empty */
+    uint32_t rx_line_errors;    /**< Frames dropped for a parity, framing, noise or overrun error */
+    uint32_t tx_messages;       /**< Messages sent */
+    uint32_t tx_bytes;
+    uint32_t dma_errors;        /**< Either direction; the stream is restarted */
+} usart_stats_t;
+
+typedef struct {
+    usart_regs_t* regs;
+    uint8_t instance;
+    uint8_t rx_error;           /**< The frame in progress saw a line error */
+    uint8_t rx_dropping;        /**< The frame in progress is being dropped */
+    uint16_t rx_tail;           /**< Ring index of the first byte not yet drained */
+    msg_t* rx_frame;            /**< Frame in progress, NULL until its first byte */
+    msg_t* tx_current;          /**< Message on the TX stream, NULL when idle */
+    mailbox_t tx_queue;
+    dma_stream_t rx_dma;
+    dma_stream_t tx_dma;
+    usart_config_t config;
+    usart_stats_t stats;
+} usart_t;
+
+/**
+ * @brief Configures an instance and starts receiving.
+ *
+ * @param instance 1-6 for USART1, USART2, USART3, UART4, UART5, USART6.
+ * @return FAILURE if the configuration is invalid, the baud rate cannot be
+ * reached within 2% from clock_hz, the instance is in use or one of its DMA
+ * streams is taken.
+ */
+status_t usart_init(usart_t* port, uint8_t instance, const usart_config_t* config);
+
+/**
+ * @brief Stops both directions and releases the DMA streams. Messages still
+ * queued for transmit and a partly received frame go back to their pools.
+ */
+void usart_deinit(usart_t* port);
+
+/**
+ * @brief Queues msg->length payload bytes for transmission and passes
+ * ownership of the message to the driver, which frees it once sent.
+ * Safe from any context.
+ *
+ * @return FAILURE on invalid arguments; the caller keeps the message.
+ */
+status_t usart_send(usart_t* port, msg_t* msg);
+
+/** Whether a message is being sent or queued. */
+uint8_t usart_tx_busy(const usart_t* port);
+
+/**
+ * @brief USART interrupt body (idle line and line errors); the
+ * USARTn_IRQHandler and UARTn_IRQHandler vectors call this.
+ */
+void usart_irq(uint8_t instance);
+
+const usart_stats_t* usart_get_stats(const usart_t* port);
+
+#if !defined(STM32F407xx)
+/**
+ * @brief Host model: count bytes arrive back to back and are moved into the
+ * ring by the RX stream.
+ *
+ * @return Bytes taken; 0 if the receiver or its DMA is off.
+ */
+uint32_t usart_sim_receive(usart_t* port, const uint8_t* data, uint32_t count);
+
+/** Host model: the line stays idle for a character time after the last byte. */
+void usart_sim_idle(usart_t* port);
+
+/** Host model: the next character is received with the given SR error flags. */
+void usart_sim_line_error(usart_t* port, uint32_t errors);
+
+/**
+ * @brief Host model: the USART sends up to max bytes from the TX stream
+ * into out.
+ *
+ * @return Bytes sent.
+ */
+uint32_t usart_sim_transmit(usart_t* port, uint8_t* out, uint32_t max);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USART_H
@@ -0,0 +1,64 @@
+#include "usart.h"
+
+#if !defined(STM32F407xx)
+
+/* Raises SR flags and, if enabled, the interrupt; the driver's SR-then-DR read clears them */
+static void raise(usart_t* port, uint32_t flags, uint8_t enabled)
+{
+    usart_regs_t* regs = port->regs;
+    regs->SR |= flags;
+    if (enabled) {
+        usart_irq(port->instance);
+    }
+    regs->SR &= ~(USART_SR_IDLE | USART_SR_ERRORS);
+}
+
+static uint8_t running(const usart_t* port, uint32_t cr1_bits, uint32_t cr3_bits)
+{
+    return port->regs != NULL && (port->regs->CR1 & (USART_CR1_UE | cr1_bits)) == (USART_CR1_UE | cr1_bits) &&
+           (port->regs->CR3 & cr3_bits) == cr3_bits;
+}
+
+uint32_t usart_sim_receive(usart_t* port, const uint8_t* data, uint32_t count)
+{
+    if (!running(port, USART_CR1_RE, USART_CR3_DMAR)) {
+        return 0;
+    }
+    return dma_sim_transfer(port->rx_dma.controller_index, port->rx_dma.stream_index, data, count);
+}
+
+void usart_sim_idle(usart_t* port)
+{
+    if (running(port, USART_CR1_RE, 0)) {
+        raise(port, USART_SR_IDLE, (port->regs->CR1 & USART_CR1_IDLEIE) != 0U);
+    }
+}
+
+void usart_sim_line_error(usart_t* port, uint32_t errors)
+{
+    if (!running(port, USART_CR1_RE, 0)) {
+        return;
+    }
+    /* PE interrupts through PEIE; FE, NF and ORE through EIE, which only covers them with DMAR set */
+    uint8_t enabled = ((errors & USART_SR_PE) && (port->regs->CR1 & USART_CR1_PEIE)) ||
+                      ((errors & (USART_SR_FE | USART_SR_NF | USART_SR_ORE)) &&
+                       (port->regs->CR3 & (USART_CR3_EIE | USART_CR3_DMAR)) == (USART_CR3_EIE | USART_CR3_DMAR));
+    raise(port, errors & USART_SR_ERRORS, enabled);
+}
+
+uint32_t usart_sim_transmit(usart_t* port, uint8_t* out, uint32_t max)
+{
+    uint32_t sent = 0;
+    while (sent < max && running(port, USART_CR1_TE, USART_CR3_DMAT)) {
+        /* Each finished message starts the next from its completion interrupt */
+        uint32_t moved = dma_sim_drain(port->tx_dma.controller_index, port->tx_dma.stream_index, out + sent,
+                                       max - sent);
+        if (moved == 0U) {
+            break;
+        }
+        sent += moved;
+    }
+    return sent;
+}
+
+#endif
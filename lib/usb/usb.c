@@ -0,0 +1,785 @@
+#include "usb.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define USB_IRQN 67U
+
+/* RCC: OTGFSEN on AHB2 */
+#define RCC_AHB2_OTGFS (1U << 7)
+
+/* Resets and flushes take a few PHY clocks; forcing device mode can take 25 ms */
+#define RESET_WAIT_LOOPS 1000000U
+#define MODE_WAIT_LOOPS 10000000U
+
+/* Turnaround time for an AHB clock of 32 MHz or more, RM0090 table 212 */
+#define TRDT_FS 6U
+
+#define EP_NUMBER(address) ((uint8_t)((address) & 0x7FU))
+
+#if USB_RX_FIFO_WORDS + USB_EP1_TX_FIFO_WORDS + 3U * USB_TX_FIFO_MIN_WORDS > USB_FIFO_WORDS
+#error "USB FIFOs exceed the packet RAM"
+#endif
+
+/* Transmit FIFO depths by endpoint, in words */
+static const uint16_t tx_fifo_words[USB_EP_COUNT] = {
+    USB_TX_FIFO_MIN_WORDS, USB_EP1_TX_FIFO_WORDS, USB_TX_FIFO_MIN_WORDS, USB_TX_FIFO_MIN_WORDS
+};
+
+enum {
+    EP0_IDLE,
+    EP0_DATA_IN,
+    EP0_DATA_OUT,
+    EP0_STATUS_IN,
+    EP0_STATUS_OUT,
+};
+
+#if !defined(STM32F407xx)
+usb_regs_t usb_sim_regs;
+#endif
+
+static usb_device_t* active;
+
+/* Writes with a hardware side effect: resets, flushes, rc_w1 flags, endpoint control, FIFO pushes */
+static void write_reg(volatile uint32_t* reg, uint32_t value)
+{
+#if defined(STM32F407xx)
+    REG_WRITE(*reg, value);
+#else
+    usb_sim_write(reg, value);
+#endif
+}
+
+/* Reads that pop the receive FIFO or its status queue */
+static uint32_t read_reg(volatile uint32_t* reg)
+{
+#if defined(STM32F407xx)
+    return REG_READ(*reg);
+#else
+    return usb_sim_read(reg);
+#endif
+}
+
+static status_t wait_clear(volatile uint32_t* reg, uint32_t bits, uint32_t loops)
+{
+    for (uint32_t i = 0; i < loops; i++) {
+        if ((REG_READ(*reg) & bits) == 0U) {
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+static status_t flush_fifos(usb_regs_t* regs, uint32_t bits)
+{
+    write_reg(&regs->GRSTCTL, bits);
+    return wait_clear(&regs->GRSTCTL, USB_GRSTCTL_RXFFLSH | USB_GRSTCTL_TXFFLSH, RESET_WAIT_LOOPS);
+}
+
+static uint8_t ep_open(const usb_device_t* dev, uint8_t address)
+{
+    uint8_t n = EP_NUMBER(address);
+    if (n >= USB_EP_COUNT) {
+        return 0;
+    }
+    const usb_ep_t* ep = (address & USB_EP_DIR_IN) ? &dev->in[n] : &dev->out[n];
+    return ep->max_packet != 0U;
+}
+
+/* --------------------------------------------------------------- FIFOs --- */
+
+/* Pops one packet of count bytes, keeping the first keep of them */
+static void fifo_read(usb_regs_t* regs, uint8_t* dst, uint32_t count, uint32_t keep)
+{
+    volatile uint32_t* fifo = &regs->FIFO[0][0];
+    uint32_t words = (count + 3U) >> 2;
+    uint32_t whole = keep >> 2;
+    uint32_t i = 0;
+    for (; i < whole; i++) {
+        uint32_t word = read_reg(fifo);
+        memcpy(dst + 4U * i, &word, 4);
+    }
+    if (i < words && (keep & 3U) != 0U) {
+        uint32_t word = read_reg(fifo);
+        memcpy(dst + 4U * i, &word, keep & 3U);
+        i++;
+    }
+    for (; i < words; i++) {
+        (void)read_reg(fifo);
+    }
+}
+
+static void fifo_write(usb_regs_t* regs, uint32_t ep, const uint8_t* src, uint32_t count)
+{
+    volatile uint32_t* fifo = &regs->FIFO[ep][0];
+    uint32_t whole = count >> 2;
+    for (uint32_t i = 0; i < whole; i++) {
+        uint32_t word;
+        memcpy(&word, src + 4U * i, 4);
+        write_reg(fifo, word);
+    }
+    if (count & 3U) {
+        uint32_t word = 0;
+        memcpy(&word, src + 4U * whole, count & 3U);
+        write_reg(fifo, word);
+    }
+}
+
+/* Writes whole packets of the transfer while they fit; the FIFO-empty interrupt asks for the rest */
+static void in_fill(usb_device_t* dev, uint32_t n)
+{
+    usb_regs_t* regs = dev->regs;
+    usb_ep_t* in = &dev->in[n];
+    while (in->done < in->length) {
+        uint32_t chunk = in->length - in->done;
+        if (chunk > in->max_packet) {
+            chunk = in->max_packet;
+        }
+        if ((REG_READ(regs->IN[n].DTXFSTS) & USB_DTXFSTS_INEPTFSAV_Msk) < ((chunk + 3U) >> 2)) {
+            break;
+        }
+        fifo_write(regs, n, in->buffer + in->done, chunk);
+        in->done += chunk;
+        STAT_INC(dev->stats.tx_packets);
+        STAT_ADD(dev->stats.tx_bytes, chunk);
+    }
+
+    uint32_t bit = 1UL << n;
+    uint32_t mask = REG_READ(regs->DIEPEMPMSK);
+    if (in->done < in->length) {
+        if ((mask & bit) == 0U) {
+            REG_WRITE(regs->DIEPEMPMSK, mask | bit);
+        }
+    } else if (mask & bit) {
+        REG_WRITE(regs->DIEPEMPMSK, mask & ~bit);
+    }
+}
+
+static void in_start(usb_device_t* dev, uint32_t n, const void* data, uint32_t length)
+{
+    usb_regs_t* regs = dev->regs;
+    usb_ep_t* in = &dev->in[n];
+    in->buffer = (uint8_t*)(uintptr_t)data;
+    in->length = length;
+    in->done = 0;
+    in->busy = 1;
+
+    uint32_t packets = (length == 0U) ? 1U : (length + in->max_packet - 1U) / in->max_packet;
+    REG_WRITE(regs->IN[n].DIEPTSIZ, (packets << USB_EPTSIZ_PKTCNT_Pos) | length);
+    write_reg(&regs->IN[n].DIEPCTL, REG_READ(regs->IN[n].DIEPCTL) | USB_EPCTL_EPENA | USB_EPCTL_CNAK);
+    in_fill(dev, n);
+}
+
+/* setups is endpoint 0's count of back-to-back SETUP packets; with nak the endpoint takes only those */
+static void out_start(usb_device_t* dev, uint32_t n, void* buffer, uint32_t length, uint32_t setups, uint8_t nak)
+{
+    usb_regs_t* regs = dev->regs;
+    usb_ep_t* out = &dev->out[n];
+    uint32_t packets = length / out->max_packet;
+    out->buffer = (uint8_t*)buffer;
+    out->length = packets * out->max_packet;
+    out->done = 0;
+    out->busy = 1;
+
+    REG_WRITE(regs->OUT[n].DOEPTSIZ,
+              (setups << USB_DOEPTSIZ0_STUPCNT_Pos) | (packets << USB_EPTSIZ_PKTCNT_Pos) | out->length);
+    write_reg(&regs->OUT[n].DOEPCTL,
+              REG_READ(regs->OUT[n].DOEPCTL) | USB_EPCTL_EPENA | (nak ? USB_EPCTL_SNAK : USB_EPCTL_CNAK));
+}
+
+/* One entry of the receive FIFO: a packet, or the end of a transfer or setup stage */
+static void rx_packet(usb_device_t* dev)
+{
+    usb_regs_t* regs = dev->regs;
+    uint32_t status = read_reg(&regs->GRXSTSP);
+    uint32_t n = status & USB_GRXSTS_EPNUM_Msk;
+    uint32_t count = (status & USB_GRXSTS_BCNT_Msk) >> USB_GRXSTS_BCNT_Pos;
+
+    switch ((status & USB_GRXSTS_PKTSTS_Msk) >> USB_GRXSTS_PKTSTS_Pos) {
+    case USB_PKTSTS_SETUP_DATA:
+        fifo_read(regs, (uint8_t*)&dev->setup, count, (count < sizeof(dev->setup)) ? count : sizeof(dev->setup));
+        break;
+    case USB_PKTSTS_OUT_DATA: {
+        usb_ep_t* out = &dev->out[n & (USB_EP_COUNT - 1U)];
+        uint32_t room = out->busy ? out->length - out->done : 0U;
+        uint32_t keep = (count < room) ? count : room;
+        fifo_read(regs, out->buffer + out->done, count, keep);
+        out->done += keep;
+        if (keep < count) {
+            STAT_INC(dev->stats.rx_overruns);
+        }
+        STAT_INC(dev->stats.rx_packets);
+        STAT_ADD(dev->stats.rx_bytes, count);
+        break;
+    }
+    default:
+        /* Transfer and setup completion raise XFRC and STUP once popped */
+        break;
+    }
+}
+
+/* ---------------------------------------------------------- endpoint 0 --- */
+
+/* Ready for the next SETUP, and with cnak for an OUT data or status stage as well */
+static void ep0_arm_out(usb_device_t* dev, uint8_t cnak)
+{
+    out_start(dev, 0, dev->ep0_buffer, USB_EP0_SIZE, 3U, !cnak);
+}
+
+static void ep0_stall(usb_device_t* dev)
+{
+    usb_regs_t* regs = dev->regs;
+    STAT_INC(dev->stats.stalls);
+    dev->ep0_state = EP0_IDLE;
+    write_reg(&regs->IN[0].DIEPCTL, REG_READ(regs->IN[0].DIEPCTL) | USB_EPCTL_STALL);
+    write_reg(&regs->OUT[0].DOEPCTL, REG_READ(regs->OUT[0].DOEPCTL) | USB_EPCTL_STALL);
+    ep0_arm_out(dev, 0);
+}
+
+/* Control transfers use one packet per transfer, which fits endpoint 0's narrow size fields */
+static void ep0_send_next(usb_device_t* dev)
+{
+    uint16_t chunk = (dev->ep0_remaining < USB_EP0_SIZE) ? dev->ep0_remaining : (uint16_t)USB_EP0_SIZE;
+    in_start(dev, 0, dev->ep0_data, chunk);
+    dev->ep0_data += chunk;
+    dev->ep0_remaining = (uint16_t)(dev->ep0_remaining - chunk);
+}
+
+static void ep0_status_in(usb_device_t* dev)
+{
+    dev->ep0_state = EP0_STATUS_IN;
+    in_start(dev, 0, NULL, 0);
+}
+
+static status_t set_configuration(usb_device_t* dev, uint16_t value);
+
+static status_t standard_request(usb_device_t* dev, const uint8_t** data, uint16_t* length)
+{
+    const usb_setup_t* setup = &dev->setup;
+    uint8_t recipient = setup->request_type & USB_REQTYPE_RECIPIENT_Msk;
+    uint8_t* reply = (uint8_t*)dev->ep0_buffer;
+
+    switch (setup->request) {
+    case USB_REQ_GET_STATUS:
+        reply[0] = 0;
+        reply[1] = 0;
+        if (recipient == USB_RECIPIENT_DEVICE) {
+            reply[0] = (uint8_t)(dev->remote_wakeup << 1);
+        } else if (recipient == USB_RECIPIENT_ENDPOINT) {
+            uint8_t n = EP_NUMBER(setup->index);
+            if (!ep_open(dev, (uint8_t)setup->index)) {
+                return FAILURE;
+            }
+            volatile uint32_t* ctl = (setup->index & USB_EP_DIR_IN) ? &dev->regs->IN[n].DIEPCTL
+                                                                    : &dev->regs->OUT[n].DOEPCTL;
+            reply[0] = (REG_READ(*ctl) & USB_EPCTL_STALL) ? 1U : 0U;
+        } else if (recipient != USB_RECIPIENT_INTERFACE || dev->configuration == 0U) {
+            return FAILURE;
+        }
+        *data = reply;
+        *length = 2;
+        return SUCCESS;
+
+    case USB_REQ_CLEAR_FEATURE:
+    case USB_REQ_SET_FEATURE: {
+        uint8_t set = setup->request == USB_REQ_SET_FEATURE;
+        if (recipient == USB_RECIPIENT_DEVICE && setup->value == USB_FEATURE_REMOTE_WAKEUP) {
+            dev->remote_wakeup = set;
+            return SUCCESS;
+        }
+        if (recipient == USB_RECIPIENT_ENDPOINT && setup->value == USB_FEATURE_ENDPOINT_HALT &&
+            ep_open(dev, (uint8_t)setup->index)) {
+            usb_ep_stall(dev, (uint8_t)setup->index, set);
+            return SUCCESS;
+        }
+        return FAILURE;
+    }
+
+    case USB_REQ_SET_ADDRESS:
+        /* The core answers the status stage from the new address only once it is in DCFG */
+        if (recipient != USB_RECIPIENT_DEVICE || setup->value > 127U) {
+            return FAILURE;
+        }
+        REG_MODIFY(dev->regs->DCFG, USB_DCFG_DAD_Msk, (uint32_t)setup->value << USB_DCFG_DAD_Pos);
+        return SUCCESS;
+
+    case USB_REQ_GET_DESCRIPTOR:
+        *data = dev->config.cls->descriptor(dev, (uint8_t)(setup->value >> 8), (uint8_t)setup->value, length);
+        return (*data != NULL) ? SUCCESS : FAILURE;
+
+    case USB_REQ_GET_CONFIGURATION:
+        reply[0] = dev->configuration;
+        *data = reply;
+        *length = 1;
+        return SUCCESS;
+
+    case USB_REQ_SET_CONFIGURATION:
+        return set_configuration(dev, setup->value);
+
+    case USB_REQ_GET_INTERFACE:
+        if (dev->configuration == 0U) {
+            return FAILURE;
+        }
+        reply[0] = 0;
+        *data = reply;
+        *length = 1;
+        return SUCCESS;
+
+    case USB_REQ_SET_INTERFACE:
+        /* Every interface has only its default alternate setting */
+        return (dev->configuration != 0U && setup->value == 0U) ? SUCCESS : FAILURE;
+
+    default:
+        return FAILURE;
+    }
+}
+
+static void ep0_setup(usb_device_t* dev)
+{
+    const usb_setup_t* setup = &dev->setup;
+    const usb_class_t* cls = dev->config.cls;
+    STAT_INC(dev->stats.setups);
+
+    /* A new SETUP abandons whatever the previous request left in the FIFO */
+    if (dev->in[0].busy) {
+        usb_regs_t* regs = dev->regs;
+        write_reg(&regs->IN[0].DIEPCTL, REG_READ(regs->IN[0].DIEPCTL) | USB_EPCTL_EPDIS | USB_EPCTL_SNAK);
+        (void)flush_fifos(regs, USB_GRSTCTL_TXFFLSH);
+        dev->in[0].busy = 0;
+    }
+    dev->ep0_state = EP0_IDLE;
+
+    const uint8_t* data = NULL;
+    uint16_t length = 0;
+    status_t status = FAILURE;
+    if ((setup->request_type & USB_REQTYPE_TYPE_Msk) == USB_REQTYPE_STANDARD) {
+        status = standard_request(dev, &data, &length);
+    } else if (cls->setup != NULL) {
+        status = cls->setup(dev, setup, &data, &length);
+    }
+    if (status != SUCCESS) {
+        ep0_stall(dev);
+        return;
+    }
+
+    if (setup->length == 0U) {
+        ep0_status_in(dev);
+    } else if (setup->request_type & USB_REQTYPE_DIR_IN) {
+        if (length > setup->length) {
+            length = setup->length;
+        }
+        /* A reply shorter than asked for that ends on a packet boundary needs a zero-length packet */
+        dev->ep0_zlp = length < setup->length && length != 0U && (length % USB_EP0_SIZE) == 0U;
+        dev->ep0_data = data;
+        dev->ep0_remaining = length;
+        dev->ep0_state = EP0_DATA_IN;
+        ep0_send_next(dev);
+    } else if (setup->length > USB_EP0_SIZE || cls->control_out == NULL) {
+        ep0_stall(dev);
+    } else {
+        dev->ep0_state = EP0_DATA_OUT;
+        ep0_arm_out(dev, 1);
+    }
+}
+
+static void ep0_in_done(usb_device_t* dev)
+{
+    if (dev->ep0_state == EP0_DATA_IN) {
+        if (dev->ep0_remaining != 0U) {
+            ep0_send_next(dev);
+        } else if (dev->ep0_zlp) {
+            dev->ep0_zlp = 0;
+            in_start(dev, 0, NULL, 0);
+        } else {
+            dev->ep0_state = EP0_STATUS_OUT;
+            ep0_arm_out(dev, 1);
+        }
+    } else if (dev->ep0_state == EP0_STATUS_IN) {
+        dev->ep0_state = EP0_IDLE;
+        ep0_arm_out(dev, 0);
+    }
+}
+
+static void ep0_out_done(usb_device_t* dev)
+{
+    if (dev->ep0_state == EP0_DATA_OUT) {
+        const usb_class_t* cls = dev->config.cls;
+        if (cls->control_out(dev, &dev->setup, (const uint8_t*)dev->ep0_buffer, (uint16_t)dev->out[0].done) !=
+            SUCCESS) {
+            ep0_stall(dev);
+            return;
+        }
+        ep0_status_in(dev);
+        return;
+    }
+    if (dev->ep0_state == EP0_STATUS_OUT) {
+        dev->ep0_state = EP0_IDLE;
+    }
+    ep0_arm_out(dev, 0);
+}
+
+/* ----------------------------------------------------------- endpoints --- */
+
+/* Deactivates endpoints 1-3; endpoint 0 stays */
+static void close_endpoints(usb_device_t* dev)
+{
+    usb_regs_t* regs = dev->regs;
+    for (uint32_t n = 1; n < USB_EP_COUNT; n++) {
+        uint32_t ctl = REG_READ(regs->IN[n].DIEPCTL);
+        write_reg(&regs->IN[n].DIEPCTL, (ctl & USB_EPCTL_EPENA) ? (USB_EPCTL_EPDIS | USB_EPCTL_SNAK) : 0U);
+        ctl = REG_READ(regs->OUT[n].DOEPCTL);
+        write_reg(&regs->OUT[n].DOEPCTL, (ctl & USB_EPCTL_EPENA) ? (USB_EPCTL_EPDIS | USB_EPCTL_SNAK) : 0U);
+        memset(&dev->in[n], 0, sizeof(dev->in[n]));
+        memset(&dev->out[n], 0, sizeof(dev->out[n]));
+    }
+    REG_WRITE(regs->DAINTMSK, (1UL << 16) | 1UL);
+    REG_WRITE(regs->DIEPEMPMSK, 0);
+    (void)flush_fifos(regs, USB_GRSTCTL_TXFFLSH | USB_GRSTCTL_TXFNUM_ALL);
+}
+
+static status_t set_configuration(usb_device_t* dev, uint16_t value)
+{
+    /* The classes here have a single configuration, number 1 */
+    if (value > 1U) {
+        return FAILURE;
+    }
+    const usb_class_t* cls = dev->config.cls;
+    if (dev->configuration != 0U && value != dev->configuration) {
+        close_endpoints(dev);
+        dev->configuration = 0;
+        if (cls->configured != NULL) {
+            cls->configured(dev, 0);
+        }
+    }
+    if (value != 0U && dev->configuration == 0U) {
+        dev->configuration = (uint8_t)value;
+        if (cls->configured != NULL) {
+            cls->configured(dev, (uint8_t)value);
+        }
+    }
+    return SUCCESS;
+}
+
+status_t usb_ep_open(usb_device_t* dev, uint8_t address, uint8_t type, uint16_t max_packet)
+{
+    uint8_t n = EP_NUMBER(address);
+    if (dev == NULL || dev->regs == NULL || n == 0U || n >= USB_EP_COUNT || type == USB_EP_CONTROL ||
+        max_packet == 0U || max_packet > USB_EP0_SIZE) {
+        return FAILURE;
+    }
+    usb_regs_t* regs = dev->regs;
+    uint32_t ctl = USB_EPCTL_USBAEP | ((uint32_t)type << USB_EPCTL_EPTYP_Pos) | max_packet | USB_EPCTL_SD0PID |
+                   USB_EPCTL_SNAK;
+    if (address & USB_EP_DIR_IN) {
+        if (tx_fifo_words[n] < (max_packet + 3U) / 4U) {
+            return FAILURE;
+        }
+        memset(&dev->in[n], 0, sizeof(dev->in[n]));
+        dev->in[n].max_packet = max_packet;
+        write_reg(&regs->IN[n].DIEPCTL, ctl | ((uint32_t)n << USB_EPCTL_TXFNUM_Pos));
+        REG_SET(regs->DAINTMSK, 1UL << n);
+    } else {
+        memset(&dev->out[n], 0, sizeof(dev->out[n]));
+        dev->out[n].max_packet = max_packet;
+        write_reg(&regs->OUT[n].DOEPCTL, ctl);
+        REG_SET(regs->DAINTMSK, 1UL << (16U + n));
+    }
+    return SUCCESS;
+}
+
+status_t usb_ep_transmit(usb_device_t* dev, uint8_t ep, const void* data, uint32_t length)
+{
+    uint8_t n = EP_NUMBER(ep);
+    if (dev == NULL || n == 0U || n >= USB_EP_COUNT || dev->in[n].max_packet == 0U || dev->in[n].busy ||
+        length > USB_EPTSIZ_XFRSIZ_Msk || (data == NULL && length != 0U)) {
+        return FAILURE;
+    }
+    in_start(dev, n, data, length);
+    return SUCCESS;
+}
+
+status_t usb_ep_receive(usb_device_t* dev, uint8_t ep, void* buffer, uint32_t length)
+{
+    uint8_t n = EP_NUMBER(ep);
+    if (dev == NULL || buffer == NULL || n == 0U || n >= USB_EP_COUNT || dev->out[n].max_packet == 0U ||
+        dev->out[n].busy || length < dev->out[n].max_packet) {
+        return FAILURE;
+    }
+    uint32_t limit = USB_EPTSIZ_PKTCNT_MAX * dev->out[n].max_packet;
+    out_start(dev, n, buffer, (length < limit) ? length : limit, 0, 0);
+    return SUCCESS;
+}
+
+void usb_ep_stall(usb_device_t* dev, uint8_t address, uint8_t stall)
+{
+    uint8_t n = EP_NUMBER(address);
+    if (dev == NULL || dev->regs == NULL || n >= USB_EP_COUNT) {
+        return;
+    }
+    usb_regs_t* regs = dev->regs;
+    volatile uint32_t* ctl = (address & USB_EP_DIR_IN) ? &regs->IN[n].DIEPCTL : &regs->OUT[n].DOEPCTL;
+    if (stall) {
+        write_reg(ctl, REG_READ(*ctl) | USB_EPCTL_STALL);
+    } else {
+        write_reg(ctl, (REG_READ(*ctl) & ~USB_EPCTL_STALL) | ((n != 0U) ? USB_EPCTL_SD0PID : 0U));
+    }
+}
+
+void usb_sof_enable(usb_device_t* dev, uint8_t enable)
+{
+    if (dev == NULL || dev->regs == NULL) {
+        return;
+    }
+    if (enable) {
+        REG_SET(dev->regs->GINTMSK, USB_GINTSTS_SOF);
+    } else {
+        REG_CLEAR(dev->regs->GINTMSK, USB_GINTSTS_SOF);
+    }
+}
+
+/* ----------------------------------------------------------- interrupt --- */
+
+static void bus_reset(usb_device_t* dev)
+{
+    usb_regs_t* regs = dev->regs;
+    uint8_t was_configured = dev->configuration != 0U;
+    STAT_INC(dev->stats.resets);
+
+    close_endpoints(dev);
+    write_reg(&regs->OUT[0].DOEPCTL, REG_READ(regs->OUT[0].DOEPCTL) | USB_EPCTL_SNAK);
+    for (uint32_t n = 0; n < USB_EP_COUNT; n++) {
+        write_reg(&regs->IN[n].DIEPINT, 0xFFU);
+        write_reg(&regs->OUT[n].DOEPINT, 0xFFU);
+    }
+    (void)flush_fifos(regs, USB_GRSTCTL_RXFFLSH);
+    REG_WRITE(regs->DOEPMSK, USB_EPINT_XFRC | USB_EPINT_STUP);
+    REG_WRITE(regs->DIEPMSK, USB_EPINT_XFRC);
+    REG_CLEAR(regs->DCFG, USB_DCFG_DAD_Msk);
+
+    memset(dev->in, 0, sizeof(dev->in));
+    memset(dev->out, 0, sizeof(dev->out));
+    dev->in[0].max_packet = USB_EP0_SIZE;
+    dev->out[0].max_packet = USB_EP0_SIZE;
+    dev->ep0_state = EP0_IDLE;
+    dev->configuration = 0;
+    dev->remote_wakeup = 0;
+    dev->suspended = 0;
+    ep0_arm_out(dev, 0);
+
+    if (was_configured && dev->config.cls->configured != NULL) {
+        dev->config.cls->configured(dev, 0);
+    }
+}
+
+static void out_irq(usb_device_t* dev, uint32_t n)
+{
+    usb_regs_t* regs = dev->regs;
+    uint32_t flags = REG_READ(regs->OUT[n].DOEPINT);
+    write_reg(&regs->OUT[n].DOEPINT, flags);
+
+    if (n == 0U) {
+        if (flags & USB_EPINT_XFRC) {
+            dev->out[0].busy = 0;
+            ep0_out_done(dev);
+        }
+        if (flags & USB_EPINT_STUP) {
+            ep0_setup(dev);
+        }
+    } else if (flags & USB_EPINT_XFRC) {
+        usb_ep_t* out = &dev->out[n];
+        out->busy = 0;
+        if (dev->config.cls->received != NULL) {
+            dev->config.cls->received(dev, (uint8_t)n, out->done);
+        }
+    }
+}
+
+static void in_irq(usb_device_t* dev, uint32_t n)
+{
+    usb_regs_t* regs = dev->regs;
+    uint32_t flags = REG_READ(regs->IN[n].DIEPINT);
+
+    if (flags & USB_EPINT_XFRC) {
+        write_reg(&regs->IN[n].DIEPINT, flags & ~USB_EPINT_TXFE);
+        usb_ep_t* in = &dev->in[n];
+        in->busy = 0;
+        REG_CLEAR(regs->DIEPEMPMSK, 1UL << n);
+        if (n == 0U) {
+            ep0_in_done(dev);
+        } else if (dev->config.cls->transmitted != NULL) {
+            dev->config.cls->transmitted(dev, (uint8_t)n, in->length);
+        }
+    } else if ((flags & USB_EPINT_TXFE) && (REG_READ(regs->DIEPEMPMSK) & (1UL << n))) {
+        STAT_INC(dev->stats.tx_refills);
+        in_fill(dev, n);
+    }
+}
+
+void usb_irq(void)
+{
+    usb_device_t* dev = active;
+    if (dev == NULL || dev->regs == NULL) {
+        return;
+    }
+    usb_regs_t* regs = dev->regs;
+    uint32_t status = REG_READ(regs->GINTSTS) & REG_READ(regs->GINTMSK);
+
+    if (status & USB_GINTSTS_USBRST) {
+        write_reg(&regs->GINTSTS, USB_GINTSTS_USBRST);
+        bus_reset(dev);
+    }
+    if (status & USB_GINTSTS_ENUMDNE) {
+        write_reg(&regs->GINTSTS, USB_GINTSTS_ENUMDNE);
+        /* Full speed, so 64-byte packets on endpoint 0 (MPSIZ 0) */
+        write_reg(&regs->IN[0].DIEPCTL, REG_READ(regs->IN[0].DIEPCTL) & ~3U);
+        REG_SET(regs->DCTL, USB_DCTL_CGINAK);
+    }
+    if (status & USB_GINTSTS_RXFLVL) {
+        while (REG_READ(regs->GINTSTS) & USB_GINTSTS_RXFLVL) {
+            rx_packet(dev);
+        }
+    }
+    if (status & (USB_GINTSTS_OEPINT | USB_GINTSTS_IEPINT)) {
+        uint32_t pending = REG_READ(regs->DAINT) & REG_READ(regs->DAINTMSK);
+        for (uint32_t n = 0; n < USB_EP_COUNT; n++) {
+            if (pending & (1UL << (16U + n))) {
+                out_irq(dev, n);
+            }
+        }
+        for (uint32_t n = 0; n < USB_EP_COUNT; n++) {
+            if (pending & (1UL << n)) {
+                in_irq(dev, n);
+            }
+        }
+    }
+    if (status & USB_GINTSTS_SOF) {
+        write_reg(&regs->GINTSTS, USB_GINTSTS_SOF);
+        if (dev->config.cls->sof != NULL) {
+            dev->config.cls->sof(dev);
+        }
+    }
+    if (status & USB_GINTSTS_USBSUSP) {
+        write_reg(&regs->GINTSTS, USB_GINTSTS_USBSUSP);
+        dev->suspended = 1;
+        STAT_INC(dev->stats.suspends);
+    }
+    if (status & USB_GINTSTS_WKUPINT) {
+        write_reg(&regs->GINTSTS, USB_GINTSTS_WKUPINT);
+        dev->suspended = 0;
+    }
+}
+
+/* ------------------------------------------------------------- control --- */
+
+static status_t core_start(usb_device_t* dev)
+{
+    usb_regs_t* regs = dev->regs;
+
+    write_reg(&regs->GRSTCTL, USB_GRSTCTL_CSRST);
+    if (wait_clear(&regs->GRSTCTL, USB_GRSTCTL_CSRST, RESET_WAIT_LOOPS) != SUCCESS) {
+        return FAILURE;
+    }
+    for (uint32_t i = 0; (REG_READ(regs->GRSTCTL) & USB_GRSTCTL_AHBIDL) == 0U; i++) {
+        if (i == RESET_WAIT_LOOPS) {
+            return FAILURE;
+        }
+    }
+    REG_SET(regs->DCTL, USB_DCTL_SDIS);
+
+    REG_WRITE(regs->GUSBCFG, USB_GUSBCFG_FDMOD | USB_GUSBCFG_PHYSEL | (TRDT_FS << USB_GUSBCFG_TRDT_Pos));
+    if (wait_clear(&regs->GINTSTS, USB_GINTSTS_CMOD, MODE_WAIT_LOOPS) != SUCCESS) {
+        return FAILURE;
+    }
+    REG_WRITE(regs->GCCFG,
+              USB_GCCFG_PWRDWN | (dev->config.vbus_sensing ? USB_GCCFG_VBUSBSEN : USB_GCCFG_NOVBUSSENS));
+    REG_WRITE(regs->PCGCCTL, 0);
+    REG_WRITE(regs->DCFG, USB_DCFG_DSPD_FS);
+
+    /* Receive FIFO at the bottom of the packet RAM, transmit FIFOs after it */
+    uint32_t offset = USB_RX_FIFO_WORDS;
+    REG_WRITE(regs->GRXFSIZ, USB_RX_FIFO_WORDS);
+    REG_WRITE(regs->DIEPTXF0, ((uint32_t)tx_fifo_words[0] << 16) | offset);
+    offset += tx_fifo_words[0];
+    for (uint32_t n = 1; n < USB_EP_COUNT; n++) {
+        REG_WRITE(regs->DIEPTXF[n - 1U], ((uint32_t)tx_fifo_words[n] << 16) | offset);
+        offset += tx_fifo_words[n];
+    }
+    if (flush_fifos(regs, USB_GRSTCTL_TXFFLSH | USB_GRSTCTL_TXFNUM_ALL) != SUCCESS ||
+        flush_fifos(regs, USB_GRSTCTL_RXFFLSH) != SUCCESS) {
+        return FAILURE;
+    }
+
+    REG_WRITE(regs->DIEPMSK, 0);
+    REG_WRITE(regs->DOEPMSK, 0);
+    REG_WRITE(regs->DAINTMSK, 0);
+    REG_WRITE(regs->DIEPEMPMSK, 0);
+    write_reg(&regs->GINTSTS, 0xFFFFFFFFU);
+    REG_WRITE(regs->GINTMSK, USB_GINTSTS_USBRST | USB_GINTSTS_ENUMDNE | USB_GINTSTS_RXFLVL | USB_GINTSTS_IEPINT |
+                                 USB_GINTSTS_OEPINT | USB_GINTSTS_USBSUSP | USB_GINTSTS_WKUPINT);
+    /* FIFO-empty interrupts at half empty: the second packet of endpoint 1 is written while the first goes */
+    REG_WRITE(regs->GAHBCFG, USB_GAHBCFG_GINT);
+    REG_CLEAR(regs->DCTL, USB_DCTL_SDIS);
+    return SUCCESS;
+}
+
+status_t usb_init(usb_device_t* dev, const usb_config_t* config)
+{
+    if (dev == NULL || config == NULL || config->cls == NULL || config->cls->descriptor == NULL) {
+        return FAILURE;
+    }
+    uint32_t primask = hal_irq_mask();
+    if (active != NULL) {
+        hal_irq_restore(primask);
+        return FAILURE;
+    }
+    active = dev;
+    hal_irq_restore(primask);
+
+    memset(dev, 0, sizeof(*dev));
+    dev->config = *config;
+    dev->regs = USB_REGS;
+    dev->in[0].max_packet = USB_EP0_SIZE;
+    dev->out[0].max_packet = USB_EP0_SIZE;
+
+    REG_SET(HAL_RCC->AHB2ENR, RCC_AHB2_OTGFS);
+    if (core_start(dev) != SUCCESS) {
+        REG_CLEAR(HAL_RCC->AHB2ENR, RCC_AHB2_OTGFS);
+        dev->regs = NULL;
+        active = NULL;
+        return FAILURE;
+    }
+    hal_nvic_enable(USB_IRQN);
+    return SUCCESS;
+}
+
+void usb_deinit(usb_device_t* dev)
+{
+    if (dev == NULL || dev->regs == NULL) {
+        return;
+    }
+    hal_nvic_disable(USB_IRQN);
+
+    usb_regs_t* regs = dev->regs;
+    REG_SET(regs->DCTL, USB_DCTL_SDIS);
+    REG_WRITE(regs->GINTMSK, 0);
+    REG_WRITE(regs->GAHBCFG, 0);
+    REG_WRITE(regs->GCCFG, 0);
+    if (dev->configuration != 0U) {
+        dev->configuration = 0;
+        if (dev->config.cls->configured != NULL) {
+            dev->config.cls->configured(dev, 0);
+        }
+    }
+    REG_CLEAR(HAL_RCC->AHB2ENR, RCC_AHB2_OTGFS);
+    dev->regs = NULL;
+    active = NULL;
+}
+
+const usb_stats_t* usb_get_stats(const usb_device_t* dev)
+{
+    return &dev->stats;
+}
+
+#if defined(STM32F407xx)
+void OTG_FS_IRQHandler(void) { usb_irq(); }
+#endif
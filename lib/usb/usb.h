@@ -0,0 +1,446 @@
+#ifndef USB_H
+#define USB_H
+
+#include "hal_reg.h"
+#include "linked_list.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * USB OTG FS device core.
+ *
+ * Device mode only, at full speed on the internal PHY. The core owns
+ * endpoint 0 and the packet FIFOs and answers the standard requests; a class
+ * (see usb_cdc.h) supplies the descriptors through usb_class_t, handles its
+ * own requests and moves data on endpoints 1-3 with usb_ep_transmit() and
+ * usb_ep_receive().
+ *
+ * FIFOs: the 1.25 KB of packet RAM is split once, at init. OUT endpoints
+ * share the receive FIFO; the interrupt pops each packet straight into the
+ * buffer its endpoint was armed with, so there is no bounce buffer. Each IN
+ * endpoint has a transmit FIFO of its own, written a whole packet at a time
+ * directly from the transfer's buffer as space allows; the FIFO-empty
+ * interrupt tops it up with the rest. Endpoint 1 IN holds two full packets,
+ * so one is written while the other goes out, which is how this core double
+ * buffers; the receive FIFO holds several, so the host can keep sending
+ * while the interrupt drains it.
+ *
+ * Transfers: an IN transfer goes out as full packets and a short last one; a
+ * class that needs a zero-length packet to end a transfer sends one itself.
+ * An OUT transfer ends when its buffer is full or the host sends a short
+ * packet. Endpoint functions are not reentrant with usb_irq(): call them
+ * from the class callbacks, which run in the interrupt, or with interrupts
+ * masked.
+ *
+ * Control transfers on endpoint 0 use packets of USB_EP0_SIZE bytes; OUT
+ * data stages longer than that are refused. The pins (PA11/PA12 in AF10,
+ * PA9 for VBUS sensing) are the application's.
+ */
+
+#define USB_EP_COUNT 4U
+#define USB_EP0_SIZE 64U
+
+/** Packet RAM, in words, and its split: the receive FIFO, then one transmit FIFO per IN endpoint */
+#define USB_FIFO_WORDS 320U
+#ifndef USB_RX_FIFO_WORDS
+#define USB_RX_FIFO_WORDS 128U
+#endif
+#ifndef USB_EP1_TX_FIFO_WORDS
+#define USB_EP1_TX_FIFO_WORDS 32U
+#endif
+#define USB_TX_FIFO_MIN_WORDS 16U
+
+typedef struct {
+    volatile uint32_t DIEPCTL;
+    uint32_t reserved0;
+    volatile uint32_t DIEPINT;
+    uint32_t reserved1;
+    volatile uint32_t DIEPTSIZ;
+    uint32_t reserved2;
+    volatile uint32_t DTXFSTS;
+    uint32_t reserved3;
+} usb_in_ep_regs_t;
+
+typedef struct {
+    volatile uint32_t DOEPCTL;
+    uint32_t reserved0;
+    volatile uint32_t DOEPINT;
+    uint32_t reserved1;
+    volatile uint32_t DOEPTSIZ;
+    uint32_t reserved2[3];
+} usb_out_ep_regs_t;
+
+typedef struct {
+    volatile uint32_t GOTGCTL;
+    volatile uint32_t GOTGINT;
+    volatile uint32_t GAHBCFG;
+    volatile uint32_t GUSBCFG;
+    volatile uint32_t GRSTCTL;
+    volatile uint32_t GINTSTS;
+    volatile uint32_t GINTMSK;
+    volatile uint32_t GRXSTSR;
+    volatile uint32_t GRXSTSP;
+    volatile uint32_t GRXFSIZ;
+    volatile uint32_t DIEPTXF0;
+    volatile uint32_t HNPTXSTS;
+    uint32_t reserved0[2];
+    volatile uint32_t GCCFG;
+    volatile uint32_t CID;
+    uint32_t reserved1[48];
+    volatile uint32_t HPTXFSIZ;         /* 0x100 */
+    volatile uint32_t DIEPTXF[3];       /* Endpoints 1-3 */
+    uint32_t reserved2[444];            /* Host mode registers */
+    volatile uint32_t DCFG;             /* 0x800 */
+    volatile uint32_t DCTL;
+    volatile uint32_t DSTS;
+    uint32_t reserved3;
+    volatile uint32_t DIEPMSK;
+    volatile uint32_t DOEPMSK;
+    volatile uint32_t DAINT;
+    volatile uint32_t DAINTMSK;
+    uint32_t reserved4[2];
+    volatile uint32_t DVBUSDIS;
+    volatile uint32_t DVBUSPULSE;
+    uint32_t reserved5;
+    volatile uint32_t DIEPEMPMSK;
+    uint32_t reserved6[50];
+    usb_in_ep_regs_t IN[USB_EP_COUNT];   /* 0x900 */
+    uint32_t reserved7[96];
+    usb_out_ep_regs_t OUT[USB_EP_COUNT]; /* 0xB00 */
+    uint32_t reserved8[160];
+    volatile uint32_t PCGCCTL;          /* 0xE00 */
+    uint32_t reserved9[127];
+    volatile uint32_t FIFO[USB_EP_COUNT][1024]; /* 0x1000: push (IN n) and pop (all OUT) windows */
+} usb_regs_t;
+
+#if !defined(STM32F407xx)
+extern usb_regs_t usb_sim_regs;
+#endif
+
+#define USB_REGS HAL_PERIPH(usb_regs_t, 0x50000000U, usb_sim_regs)
+
+#define USB_GAHBCFG_GINT (1U << 0)
+#define USB_GAHBCFG_TXFELVL (1U << 7)
+
+#define USB_GUSBCFG_PHYSEL (1U << 6)
+#define USB_GUSBCFG_TRDT_Pos 10U
+#define USB_GUSBCFG_TRDT_Msk (0xFU << USB_GUSBCFG_TRDT_Pos)
+#define USB_GUSBCFG_FHMOD (1U << 29)
+#define USB_GUSBCFG_FDMOD (1U << 30)
+
+#define USB_GRSTCTL_CSRST (1U << 0)
+#define USB_GRSTCTL_RXFFLSH (1U << 4)
+#define USB_GRSTCTL_TXFFLSH (1U << 5)
+#define USB_GRSTCTL_TXFNUM_Pos 6U
+#define USB_GRSTCTL_TXFNUM_ALL (0x10U << USB_GRSTCTL_TXFNUM_Pos)
+#define USB_GRSTCTL_AHBIDL (1U << 31)
+
+#define USB_GINTSTS_CMOD (1U << 0)
+#define USB_GINTSTS_SOF (1U << 3)
+#define USB_GINTSTS_RXFLVL (1U << 4)
+#define USB_GINTSTS_USBSUSP (1U << 11)
+#define USB_GINTSTS_USBRST (1U << 12)
+#define USB_GINTSTS_ENUMDNE (1U << 13)
+#define USB_GINTSTS_IEPINT (1U << 18)
+#define USB_GINTSTS_OEPINT (1U << 19)
+#define USB_GINTSTS_WKUPINT (1U << 31)
+
+#define USB_GRXSTS_EPNUM_Msk 0xFU
+#define USB_GRXSTS_BCNT_Pos 4U
+#define USB_GRXSTS_BCNT_Msk (0x7FFU << USB_GRXSTS_BCNT_Pos)
+#define USB_GRXSTS_PKTSTS_Pos 17U
+#define USB_GRXSTS_PKTSTS_Msk (0xFU << USB_GRXSTS_PKTSTS_Pos)
+#define USB_PKTSTS_OUT_DATA 2U
+#define USB_PKTSTS_OUT_DONE 3U
+#define USB_PKTSTS_SETUP_DONE 4U
+#define USB_PKTSTS_SETUP_DATA 6U
+
+#define USB_GCCFG_PWRDWN (1U << 16)
+#define USB_GCCFG_VBUSBSEN (1U << 19)
+#define USB_GCCFG_NOVBUSSENS (1U << 21)
+
+#define USB_DCFG_DSPD_FS 3U
+#define USB_DCFG_DAD_Pos 4U
+#define USB_DCFG_DAD_Msk (0x7FU << USB_DCFG_DAD_Pos)
+
+#define USB_DCTL_SDIS (1U << 1)
+#define USB_DCTL_CGINAK (1U << 8)
+
+#define USB_DSTS_SUSPSTS (1U << 0)
+#define USB_DSTS_ENUMSPD_Pos 1U
+#define USB_DSTS_ENUMSPD_Msk (3U << USB_DSTS_ENUMSPD_Pos)
+#define USB_DSTS_FNSOF_Pos 8U
+#define USB_DSTS_FNSOF_Msk (0x3FFFU << USB_DSTS_FNSOF_Pos)
+
+/* DIEPCTL and DOEPCTL */
+#define USB_EPCTL_MPSIZ_Msk 0x7FFU
+#define USB_EPCTL_USBAEP (1U << 15)
+#define USB_EPCTL_NAKSTS (1U << 17)
+#define USB_EPCTL_EPTYP_Pos 18U
+#define USB_EPCTL_STALL (1U << 21)
+#define USB_EPCTL_TXFNUM_Pos 22U
+#define USB_EPCTL_CNAK (1U << 26)
+#define USB_EPCTL_SNAK (1U << 27)
+#define USB_EPCTL_SD0PID (1U << 28)
+#define USB_EPCTL_EPDIS (1U << 30)
+#define USB_EPCTL_EPENA (1U << 31)
+
+/* DIEPINT and DOEPINT, and the masks in DIEPMSK and DOEPMSK */
+#define USB_EPINT_XFRC (1U << 0)
+#define USB_EPINT_EPDISD (1U << 1)
+#define USB_EPINT_STUP (1U << 3)
+#define USB_EPINT_TXFE (1U << 7)
+
+/* DIEPTSIZ and DOEPTSIZ; endpoint 0 has narrower fields */
+#define USB_EPTSIZ_PKTCNT_Pos 19U
+#define USB_EPTSIZ_XFRSIZ_Msk 0x7FFFFU
+#define USB_EPTSIZ_PKTCNT_MAX 0x3FFU
+#define USB_EP0TSIZ_XFRSIZ_Msk 0x7FU
+#define USB_DOEPTSIZ0_STUPCNT_Pos 29U
+
+#define USB_DTXFSTS_INEPTFSAV_Msk 0xFFFFU
+
+/** Control request header; little-endian, as on the wire. */
+typedef struct {
+    uint8_t request_type;
+    uint8_t request;
+    uint16_t value;
+    uint16_t index;
+    uint16_t length;
+} usb_setup_t;
+
+#define USB_REQTYPE_DIR_IN 0x80U
+#define USB_REQTYPE_TYPE_Msk 0x60U
+#define USB_REQTYPE_STANDARD 0x00U
+#define USB_REQTYPE_CLASS 0x20U
+#define USB_REQTYPE_VENDOR 0x40U
+#define USB_REQTYPE_RECIPIENT_Msk 0x1FU
+#define USB_RECIPIENT_DEVICE 0U
+#define USB_RECIPIENT_INTERFACE 1U
+#define USB_RECIPIENT_ENDPOINT 2U
+
+#define USB_REQ_GET_STATUS 0x00U
+#define USB_REQ_CLEAR_FEATURE 0x01U
+#define USB_REQ_SET_FEATURE 0x03U
+#define USB_REQ_SET_ADDRESS 0x05U
+#define USB_REQ_GET_DESCRIPTOR 0x06U
+#define USB_REQ_GET_CONFIGURATION 0x08U
+#define USB_REQ_SET_CONFIGURATION 0x09U
+#define USB_REQ_GET_INTERFACE 0x0AU
+#define USB_REQ_SET_INTERFACE 0x0BU
+
+#define USB_FEATURE_ENDPOINT_HALT 0U
+#define USB_FEATURE_REMOTE_WAKEUP 1U
+
+#define USB_DESC_DEVICE 1U
+#define USB_DESC_CONFIGURATION 2U
+#define USB_DESC_STRING 3U
+#define USB_DESC_INTERFACE 4U
+#define USB_DESC_ENDPOINT 5U
+#define USB_DESC_DEVICE_QUALIFIER 6U
+#define USB_DESC_CS_INTERFACE 0x24U
+
+#define USB_EP_CONTROL 0U
+#define USB_EP_ISOCHRONOUS 1U
+#define USB_EP_BULK 2U
+#define USB_EP_INTERRUPT 3U
+
+#define USB_EP_DIR_IN 0x80U
+
+typedef struct usb_device usb_device_t;
+
+/**
+ * @brief What a class plugs into the core. Every callback runs in the
+ * interrupt; only descriptor is required.
+ */
+typedef struct {
+    /**
+     * Descriptor of a type and index for GET_DESCRIPTOR, with its full length
+     * in *length, or NULL to refuse it. Strings may be built in
+     * dev->ep0_buffer.
+     */
+    const uint8_t* (*descriptor)(usb_device_t* dev, uint8_t type, uint8_t index, uint16_t* length);
+    /**
+     * A class or vendor request. For an IN data stage, point *data at the
+     * reply (dev->ep0_buffer will do) and set *length; an OUT data stage is
+     * delivered to control_out(). FAILURE stalls the request.
+     */
+    status_t (*setup)(usb_device_t* dev, const usb_setup_t* setup, const uint8_t** data, uint16_t* length);
+    /** The OUT data stage of a request setup() accepted; FAILURE stalls its status stage. */
+    status_t (*control_out)(usb_device_t* dev, const usb_setup_t* setup, const uint8_t* data, uint16_t length);
+    /** SET_CONFIGURATION: open the endpoints. 0 after a bus reset or deconfiguration: they are closed. */
+    void (*configured)(usb_device_t* dev, uint8_t configuration);
+    /** An IN transfer on endpoint ep (1-3) completed. */
+    void (*transmitted)(usb_device_t* dev, uint8_t ep, uint32_t length);
+    /** An OUT transfer on endpoint ep (1-3) completed with length bytes in its buffer. */
+    void (*received)(usb_device_t* dev, uint8_t ep, uint32_t length);
+    /** Start of frame, once per millisecond while enabled with usb_sof_enable(). */
+    void (*sof)(usb_device_t* dev);
+} usb_class_t;
+
+typedef struct {
+    const usb_class_t* cls;
+    void* context;              /**< For the class; see usb_context() */
+    uint8_t vbus_sensing;       /**< VBUS on PA9 gates the pull-up, rather than assuming the bus is powered */
+} usb_config_t;
+
+typedef struct {
+    uint32_t resets;            /**< Bus resets */
+    uint32_t setups;            /**< Control requests received */
+    uint32_t stalls;            /**< Control requests refused */
+    uint32_t rx_packets;        /**< OUT data packets popped from the receive FIFO */
+    uint32_t rx_bytes;
+    uint32_t rx_overruns;       /**< Packets that did not fit in their endpoint's buffer; the excess is dropped */
+    uint32_t tx_packets;        /**< Packets written to a transmit FIFO */
+    uint32_t tx_bytes;
+    uint32_t tx_refills;        /**< FIFO-empty interrupts that wrote more packets */
+    uint32_t suspends;
+} usb_stats_t;
+
+/** Transfer state of one endpoint direction. */
+typedef struct {
+    uint8_t* buffer;
+    uint32_t length;            /**< Bytes in the transfer */
+    uint32_t done;              /**< IN: written to the FIFO; OUT: received */
+    uint16_t max_packet;        /**< 0 while the endpoint is closed */
+    uint8_t busy;
+} usb_ep_t;
+
+struct usb_device {
+    usb_regs_t* regs;
+    usb_config_t config;
+    usb_ep_t in[USB_EP_COUNT];
+    usb_ep_t out[USB_EP_COUNT];
+    usb_setup_t setup;          /**< Request in progress on endpoint 0 */
+    const uint8_t* ep0_data;    /**< IN data stage: the part not yet handed to the FIFO */
+    uint16_t ep0_remaining;
+    uint8_t ep0_state;
+    uint8_t ep0_zlp;            /**< The IN data stage ends with a zero-length packet */
+    uint8_t configuration;      /**< 0 until SET_CONFIGURATION */
+    uint8_t remote_wakeup;      /**< Enabled by the host */
+    uint8_t suspended;
+    uint32_t ep0_buffer[USB_EP0_SIZE / 4U]; /**< Replies and OUT data stages on endpoint 0 */
+    usb_stats_t stats;
+};
+
+/** The class context given in usb_config_t. */
+static inline void* usb_context(const usb_device_t* dev)
+{
+    return dev->config.context;
+}
+
+/**
+ * @brief Resets the core into device mode, splits the FIFOs and connects
+ * to the bus. Enumeration then runs from the interrupt.
+ *
+ * @return FAILURE if the configuration is invalid, the driver is in use or
+ * the core does not come out of reset.
+ */
+status_t usb_init(usb_device_t* dev, const usb_config_t* config);
+
+/** Disconnects from the bus and powers the transceiver down. */
+void usb_deinit(usb_device_t* dev);
+
+/**
+ * @brief Activates endpoint 1-3 in the given direction (USB_EP_DIR_IN or
+ * not) with a packet size of at most 64 bytes; for the class's configured()
+ * callback.
+ *
+ * @return FAILURE on invalid arguments or an IN FIFO too small for the packet size.
+ */
+status_t usb_ep_open(usb_device_t* dev, uint8_t address, uint8_t type, uint16_t max_packet);
+
+/**
+ * @brief Starts an IN transfer from data, which must stay untouched until
+ * the class's transmitted() callback. length 0 sends a zero-length packet.
+ *
+ * @return FAILURE if the endpoint is closed or busy.
+ */
+status_t usb_ep_transmit(usb_device_t* dev, uint8_t ep, const void* data, uint32_t length);
+
+/**
+ * @brief Arms an OUT endpoint to receive into buffer; length is rounded
+ * down to whole packets, up to 1023 of them.
+ *
+ * @return FAILURE if the endpoint is closed or busy or length is under one packet.
+ */
+status_t usb_ep_receive(usb_device_t* dev, uint8_t ep, void* buffer, uint32_t length);
+
+/** Sets or clears an endpoint's halt; clearing also resets its data toggle. */
+void usb_ep_stall(usb_device_t* dev, uint8_t address, uint8_t stall);
+
+/** Turns the class's sof() callback on or off. */
+void usb_sof_enable(usb_device_t* dev, uint8_t enable);
+
+/** Core interrupt body; OTG_FS_IRQHandler calls this. */
+void usb_irq(void);
+
+const usb_stats_t* usb_get_stats(const usb_device_t* dev);
+
+#if !defined(STM32F407xx)
+/** Host model: handshakes the bus side of usb_sim_in() and usb_sim_out() can return */
+#define USB_SIM_NAK (-1)
+#define USB_SIM_STALL (-2)
+
+/** Host model: the pull-up is on, i.e. the core is powered, in device mode and soft-connected. */
+uint8_t usb_sim_attached(void);
+
+/** Host model: the host resets the bus and the device enumerates at full speed. */
+void usb_sim_reset(usb_device_t* dev);
+
+/**
+ * @brief Host model: a SETUP transaction to endpoint 0.
+ *
+ * @return 0 once the packet is in the receive FIFO, USB_SIM_NAK if the
+ * device is detached or the FIFO is full.
+ */
+int32_t usb_sim_setup(usb_device_t* dev, const usb_setup_t* setup);
+
+/**
+ * @brief Host model: an IN transaction. A packet larger than max is cut short.
+ *
+ * @return Packet bytes, or USB_SIM_NAK if the endpoint has no whole packet
+ * ready, or USB_SIM_STALL.
+ */
+int32_t usb_sim_in(usb_device_t* dev, uint8_t ep, uint8_t* data, uint32_t max);
+
+/**
+ * @brief Host model: an OUT transaction of one packet, at most the
+ * endpoint's packet size.
+ *
+ * @return 0 if the device took it, USB_SIM_NAK or USB_SIM_STALL.
+ */
+int32_t usb_sim_out(usb_device_t* dev, uint8_t ep, const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Host model: a whole control transfer, setup, data and status
+ * stages, retrying NAKed transactions a few times like a host controller.
+ * An IN data stage is read into data, an OUT one sent from it.
+ *
+ * @return Bytes in the data stage, or USB_SIM_NAK or USB_SIM_STALL from the
+ * stage that failed.
+ */
+int32_t usb_sim_control(usb_device_t* dev, const usb_setup_t* setup, uint8_t* data);
+
+/** Host model: a start-of-frame token. */
+void usb_sim_sof(usb_device_t* dev);
+
+/** Host model: the bus goes idle for 3 ms, then resumes. */
+void usb_sim_suspend(usb_device_t* dev);
+void usb_sim_resume(usb_device_t* dev);
+
+/** Host model: a write to a register with side effects in the hardware. */
+void usb_sim_write(volatile uint32_t* reg, uint32_t value);
+
+/** Host model: a read with side effects, i.e. a pop of the receive FIFO or its status. */
+uint32_t usb_sim_read(volatile uint32_t* reg);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_H
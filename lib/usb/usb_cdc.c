@@ -0,0 +1,379 @@
+#include "usb_cdc.h"
+#include "feature_hooks.h"
+#include <stddef.h>
+#include <string.h>
+
+#define CDC_DATA_EP 1U
+#define CDC_NOTIFY_EP 2U
+#define STRING_MAX_CHARS 31U
+
+enum {
+    STRING_LANGUAGE,
+    STRING_MANUFACTURER,
+    STRING_PRODUCT,
+    STRING_SERIAL,
+};
+
+/* Configuration 1: communications interface 0 with its functional descriptors, data interface 1 */
+static const uint8_t config_descriptor[67] = {
+    9, USB_DESC_CONFIGURATION, 67, 0, 2, 1, 0, 0x80, 50,                    /* Bus powered, 100 mA */
+    9, USB_DESC_INTERFACE, USB_CDC_COMM_INTERFACE, 0, 1, 0x02, 0x02, 0x01, 0, /* CDC, ACM, V.250 */
+    5, USB_DESC_CS_INTERFACE, 0x00, 0x10, 0x01,                             /* Header, CDC 1.10 */
+    5, USB_DESC_CS_INTERFACE, 0x01, 0x00, USB_CDC_DATA_INTERFACE,           /* Call management */
+    4, USB_DESC_CS_INTERFACE, 0x02, 0x02,                                   /* ACM: line coding and state */
+    5, USB_DESC_CS_INTERFACE, 0x06, USB_CDC_COMM_INTERFACE, USB_CDC_DATA_INTERFACE, /* Union */
+    7, USB_DESC_ENDPOINT, USB_CDC_NOTIFY_IN, USB_EP_INTERRUPT, USB_CDC_NOTIFY_PACKET, 0, 16,
+    9, USB_DESC_INTERFACE, USB_CDC_DATA_INTERFACE, 0, 2, 0x0A, 0, 0, 0,     /* CDC data */
+    7, USB_DESC_ENDPOINT, USB_CDC_DATA_OUT, USB_EP_BULK, USB_CDC_PACKET, 0, 0,
+    7, USB_DESC_ENDPOINT, USB_CDC_DATA_IN, USB_EP_BULK, USB_CDC_PACKET, 0, 0,
+};
+
+/* US English only */
+static const uint8_t language_descriptor[4] = { 4, USB_DESC_STRING, 0x09, 0x04 };
+
+static usb_cdc_t* cdc_of(usb_device_t* dev)
+{
+    return (usb_cdc_t*)usb_context(dev);
+}
+
+/* ------------------------------------------------------------ receive --- */
+
+/* Arms the OUT endpoint with the current message, or a new one from the pool */
+static void rx_arm(usb_cdc_t* cdc)
+{
+    if (cdc->rx_current == NULL) {
+        cdc->rx_current = msg_alloc(cdc->config.rx_pool);
+        if (cdc->rx_current == NULL) {
+            if (!cdc->rx_starved) {
+                cdc->rx_starved = 1;
+                STAT_INC(cdc->stats.rx_starved);
+                usb_sof_enable(&cdc->usb, 1);
+            }
+            return;
+        }
+    }
+    if (cdc->rx_starved) {
+        cdc->rx_starved = 0;
+        usb_sof_enable(&cdc->usb, 0);
+    }
+    uint32_t capacity = cdc->config.rx_pool->payload_size;
+    capacity = (capacity < UINT16_MAX) ? capacity : UINT16_MAX;
+    (void)usb_ep_receive(&cdc->usb, CDC_DATA_EP, msg_payload(cdc->rx_current), capacity);
+}
+
+static void rx_done(usb_cdc_t* cdc, uint32_t length)
+{
+    msg_t* msg = cdc->rx_current;
+    if (msg != NULL && length != 0U) {
+        cdc->rx_current = NULL;
+        msg->length = (uint16_t)length;
+        STAT_INC(cdc->stats.rx_messages);
+        STAT_ADD(cdc->stats.rx_bytes, length);
+        rx_arm(cdc);
+        mailbox_post(cdc->config.rx_output, msg);
+        return;
+    }
+    /* A zero-length transfer: the same message takes the next one */
+    rx_arm(cdc);
+}
+
+/* ----------------------------------------------------------- transmit --- */
+
+/* Starts the next queued message; called with interrupts masked, which makes this the queue's only consumer */
+static void tx_next(usb_cdc_t* cdc)
+{
+    for (;;) {
+        msg_t* msg = mailbox_fetch(&cdc->tx_queue);
+        cdc->tx_current = msg;
+        if (msg == NULL) {
+            return;
+        }
+        if (msg->length != 0U &&
+            usb_ep_transmit(&cdc->usb, CDC_DATA_EP, msg_payload(msg), msg->length) == SUCCESS) {
+            return;
+        }
+        msg_free(msg);
+    }
+}
+
+static void tx_done(usb_cdc_t* cdc)
+{
+    msg_t* done = cdc->tx_current;
+    if (done == NULL) {
+        return;
+    }
+    if (!cdc->tx_zlp && (done->length % USB_CDC_PACKET) == 0U) {
+        cdc->tx_zlp = 1;
+        STAT_INC(cdc->stats.tx_zlps);
+        (void)usb_ep_transmit(&cdc->usb, CDC_DATA_EP, NULL, 0);
+        return;
+    }
+    cdc->tx_zlp = 0;
+    STAT_INC(cdc->stats.tx_messages);
+    STAT_ADD(cdc->stats.tx_bytes, done->length);
+    msg_free(done);
+    tx_next(cdc);
+}
+
+status_t usb_cdc_send(usb_cdc_t* cdc, msg_t* msg)
+{
+    if (cdc == NULL || msg == NULL || cdc->usb.configuration == 0U) {
+        return FAILURE;
+    }
+    mailbox_post(&cdc->tx_queue, msg);
+
+    uint32_t primask = hal_irq_mask();
+    if (cdc->tx_current == NULL && cdc->usb.configuration != 0U) {
+        tx_next(cdc);
+    }
+    hal_irq_restore(primask);
+    return SUCCESS;
+}
+
+/* Frees everything in flight; the endpoints are already closed */
+static void release(usb_cdc_t* cdc)
+{
+    if (cdc->rx_current != NULL) {
+        msg_free(cdc->rx_current);
+        cdc->rx_current = NULL;
+    }
+    if (cdc->tx_current != NULL) {
+        STAT_INC(cdc->stats.tx_dropped);
+        msg_free(cdc->tx_current);
+        cdc->tx_current = NULL;
+    }
+    for (msg_t* msg = mailbox_fetch(&cdc->tx_queue); msg != NULL; msg = mailbox_fetch(&cdc->tx_queue)) {
+        STAT_INC(cdc->stats.tx_dropped);
+        msg_free(msg);
+    }
+    cdc->tx_zlp = 0;
+    cdc->rx_starved = 0;
+    cdc->control_lines = 0;
+}
+
+/* ---------------------------------------------------------- class ops --- */
+
+static const uint8_t* string_descriptor(usb_device_t* dev, const char* text, uint16_t* length)
+{
+    if (text == NULL) {
+        return NULL;
+    }
+    uint8_t* out = (uint8_t*)dev->ep0_buffer;
+    uint32_t chars = 0;
+    for (; chars < STRING_MAX_CHARS && text[chars] != '\0'; chars++) {
+        out[2U + 2U * chars] = (uint8_t)text[chars];
+        out[3U + 2U * chars] = 0;
+    }
+    out[0] = (uint8_t)(2U + 2U * chars);
+    out[1] = USB_DESC_STRING;
+    *length = out[0];
+    return out;
+}
+
+static const uint8_t* cdc_descriptor(usb_device_t* dev, uint8_t type, uint8_t index, uint16_t* length)
+{
+    usb_cdc_t* cdc = cdc_of(dev);
+    switch (type) {
+    case USB_DESC_DEVICE:
+        *length = sizeof(cdc->device_descriptor);
+        return cdc->device_descriptor;
+    case USB_DESC_CONFIGURATION:
+        *length = sizeof(config_descriptor);
+        return (index == 0U) ? config_descriptor : NULL;
+    case USB_DESC_STRING:
+        switch (index) {
+        case STRING_LANGUAGE:
+            *length = sizeof(language_descriptor);
+            return language_descriptor;
+        case STRING_MANUFACTURER:
+            return string_descriptor(dev, cdc->config.manufacturer, length);
+        case STRING_PRODUCT:
+            return string_descriptor(dev, cdc->config.product, length);
+        case STRING_SERIAL:
+            return string_descriptor(dev, cdc->config.serial, length);
+        default:
+            return NULL;
+        }
+    default:
+        /* Including the device qualifier: a full-speed-only device refuses it */
+        return NULL;
+    }
+}
+
+static status_t cdc_setup(usb_device_t* dev, const usb_setup_t* setup, const uint8_t** data, uint16_t* length)
+{
+    usb_cdc_t* cdc = cdc_of(dev);
+    if ((setup->request_type & USB_REQTYPE_TYPE_Msk) != USB_REQTYPE_CLASS ||
+        (setup->request_type & USB_REQTYPE_RECIPIENT_Msk) != USB_RECIPIENT_INTERFACE ||
+        setup->index != USB_CDC_COMM_INTERFACE) {
+        return FAILURE;
+    }
+
+    switch (setup->request) {
+    case USB_CDC_SET_LINE_CODING:
+        return (setup->length == 7U) ? SUCCESS : FAILURE;
+    case USB_CDC_GET_LINE_CODING: {
+        uint8_t* reply = (uint8_t*)dev->ep0_buffer;
+        uint32_t baud = cdc->line_coding.baud;
+        reply[0] = (uint8_t)baud;
+        reply[1] = (uint8_t)(baud >> 8);
+        reply[2] = (uint8_t)(baud >> 16);
+        reply[3] = (uint8_t)(baud >> 24);
+        reply[4] = cdc->line_coding.stop_bits;
+        reply[5] = cdc->line_coding.parity;
+        reply[6] = cdc->line_coding.data_bits;
+        *data = reply;
+        *length = 7;
+        return SUCCESS;
+    }
+    case USB_CDC_SET_CONTROL_LINE_STATE:
+        cdc->control_lines = (uint8_t)(setup->value & (USB_CDC_DTR | USB_CDC_RTS));
+        return SUCCESS;
+    case USB_CDC_SEND_BREAK:
+        return SUCCESS;
+    default:
+        return FAILURE;
+    }
+}
+
+static status_t cdc_control_out(usb_device_t* dev, const usb_setup_t* setup, const uint8_t* data, uint16_t length)
+{
+    usb_cdc_t* cdc = cdc_of(dev);
+    if (setup->request != USB_CDC_SET_LINE_CODING || length != 7U) {
+        return FAILURE;
+    }
+    cdc->line_coding.baud =
+        (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    cdc->line_coding.stop_bits = data[4];
+    cdc->line_coding.parity = data[5];
+    cdc->line_coding.data_bits = data[6];
+    return SUCCESS;
+}
+
+static void cdc_configured(usb_device_t* dev, uint8_t configuration)
+{
+    usb_cdc_t* cdc = cdc_of(dev);
+    release(cdc);
+    usb_sof_enable(dev, 0);
+    if (configuration == 0U) {
+        return;
+    }
+    (void)usb_ep_open(dev, USB_CDC_NOTIFY_IN, USB_EP_INTERRUPT, USB_CDC_NOTIFY_PACKET);
+    (void)usb_ep_open(dev, USB_CDC_DATA_OUT, USB_EP_BULK, USB_CDC_PACKET);
+    (void)usb_ep_open(dev, USB_CDC_DATA_IN, USB_EP_BULK, USB_CDC_PACKET);
+    rx_arm(cdc);
+}
+
+static void cdc_transmitted(usb_device_t* dev, uint8_t ep, uint32_t length)
+{
+    (void)length;
+    if (ep == CDC_DATA_EP) {
+        tx_done(cdc_of(dev));
+    }
+}
+
+static void cdc_received(usb_device_t* dev, uint8_t ep, uint32_t length)
+{
+    if (ep == CDC_DATA_EP) {
+        rx_done(cdc_of(dev), length);
+    }
+}
+
+static void cdc_sof(usb_device_t* dev)
+{
+    usb_cdc_t* cdc = cdc_of(dev);
+    if (cdc->rx_starved) {
+        rx_arm(cdc);
+    }
+}
+
+static const usb_class_t cdc_class = {
+    .descriptor = cdc_descriptor,
+    .setup = cdc_setup,
+    .control_out = cdc_control_out,
+    .configured = cdc_configured,
+    .transmitted = cdc_transmitted,
+    .received = cdc_received,
+    .sof = cdc_sof,
+};
+
+/* ------------------------------------------------------------ control --- */
+
+status_t usb_cdc_init(usb_cdc_t* cdc, const usb_cdc_config_t* config)
+{
+    if (cdc == NULL || config == NULL || config->rx_pool == NULL || config->rx_output == NULL ||
+        config->rx_pool->payload_size < USB_CDC_PACKET) {
+        return FAILURE;
+    }
+    memset(cdc, 0, sizeof(*cdc));
+    cdc->config = *config;
+    mailbox_init(&cdc->tx_queue, NULL, NULL);
+    cdc->line_coding.baud = 115200U;
+    cdc->line_coding.data_bits = 8;
+
+    const uint8_t device[18] = {
+        18, USB_DESC_DEVICE, 0x00, 0x02,    /* USB 2.0 */
+        0x02, 0x00, 0x00,                   /* CDC; the interfaces say the rest */
+        USB_EP0_SIZE,
+        (uint8_t)config->vendor_id, (uint8_t)(config->vendor_id >> 8),
+        (uint8_t)config->product_id, (uint8_t)(config->product_id >> 8),
+        0x00, 0x01,                         /* Device release 1.00 */
+        (config->manufacturer != NULL) ? STRING_MANUFACTURER : 0U,
+        (config->product != NULL) ? STRING_PRODUCT : 0U,
+        (config->serial != NULL) ? STRING_SERIAL : 0U,
+        1,
+    };
+    memcpy(cdc->device_descriptor, device, sizeof(device));
+
+    usb_config_t usb_config = {
+        .cls = &cdc_class,
+        .context = cdc,
+        .vbus_sensing = config->vbus_sensing,
+    };
+    return usb_init(&cdc->usb, &usb_config);
+}
+
+void usb_cdc_deinit(usb_cdc_t* cdc)
+{
+    if (cdc == NULL || cdc->usb.regs == NULL) {
+        return;
+    }
+    usb_deinit(&cdc->usb);
+    release(cdc);
+}
+
+uint8_t usb_cdc_connected(const usb_cdc_t* cdc)
+{
+    return cdc->usb.configuration != 0U && (cdc->control_lines & USB_CDC_DTR);
+}
+
+status_t usb_cdc_serial_state(usb_cdc_t* cdc, uint16_t state)
+{
+    if (cdc == NULL || cdc->usb.configuration == 0U) {
+        return FAILURE;
+    }
+    uint32_t primask = hal_irq_mask();
+    status_t status = FAILURE;
+    if (!cdc->usb.in[CDC_NOTIFY_EP].busy) {
+        static const uint8_t header[8] = {
+            USB_REQTYPE_DIR_IN | USB_REQTYPE_CLASS | USB_RECIPIENT_INTERFACE, USB_CDC_SERIAL_STATE, 0, 0,
+            USB_CDC_COMM_INTERFACE, 0, 2, 0,
+        };
+        memcpy(cdc->notification, header, sizeof(header));
+        cdc->notification[8] = (uint8_t)state;
+        cdc->notification[9] = (uint8_t)(state >> 8);
+        status = usb_ep_transmit(&cdc->usb, CDC_NOTIFY_EP, cdc->notification, sizeof(cdc->notification));
+    }
+    hal_irq_restore(primask);
+    return status;
+}
+
+const usb_cdc_line_coding_t* usb_cdc_get_line_coding(const usb_cdc_t* cdc)
+{
+    return &cdc->line_coding;
+}
+
+const usb_cdc_stats_t* usb_cdc_get_stats(const usb_cdc_t* cdc)
+{
+    return &cdc->stats;
+}
@@ -0,0 +1,148 @@
+#ifndef USB_CDC_H
+#define USB_CDC_H
+
+#include "mailbox.h"
+#include "usb.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CDC-ACM virtual serial port on the USB device core.
+ *
+ * The device has one configuration with two interfaces: communications,
+ * with SERIAL_STATE notifications on endpoint 2 IN, and data, on bulk
+ * endpoint 1 IN and OUT with 64-byte packets. Hosts bind their stock serial
+ * driver to it (cdc_acm, usbser.sys, AppleUSBCDC).
+ *
+ * Receive: the OUT endpoint is armed with a message from rx_pool as its
+ * buffer, so packets go from the FIFO straight into the message payload.
+ * The message is posted to rx_output when it is full or the host ends a
+ * transfer with a short packet, and the endpoint is armed again with a fresh
+ * one in the same interrupt. If the pool is empty the endpoint stays
+ * NAKing: the host holds its data back rather than losing it, and the driver
+ * retries on every start of frame until a message is free.
+ *
+ * Transmit: usb_cdc_send() queues a message from any context. Each goes out
+ * as one IN transfer read straight from its payload, and back to its pool
+ * once the host has taken it. A message that fills a whole number of
+ * packets is followed by a zero-length packet, so the host's read returns.
+ *
+ * Both directions move msg_t buffers the way the USART driver does, so a
+ * telemetry or log producer can hand its messages to either transport
+ * unchanged. Line coding set by the host is recorded for the application;
+ * it has no effect on the link, which runs at bus speed.
+ */
+
+#define USB_CDC_PACKET 64U
+#define USB_CDC_DATA_OUT 0x01U
+#define USB_CDC_DATA_IN 0x81U
+#define USB_CDC_NOTIFY_IN 0x82U
+#define USB_CDC_NOTIFY_PACKET 16U
+
+/** Interfaces */
+#define USB_CDC_COMM_INTERFACE 0U
+#define USB_CDC_DATA_INTERFACE 1U
+
+/** Class requests */
+#define USB_CDC_SET_LINE_CODING 0x20U
+#define USB_CDC_GET_LINE_CODING 0x21U
+#define USB_CDC_SET_CONTROL_LINE_STATE 0x22U
+#define USB_CDC_SEND_BREAK 0x23U
+#define USB_CDC_SERIAL_STATE 0x20U
+
+/** SET_CONTROL_LINE_STATE bits */
+#define USB_CDC_DTR (1U << 0)
+#define USB_CDC_RTS (1U << 1)
+
+/** SERIAL_STATE bits */
+#define USB_CDC_STATE_DCD (1U << 0)
+#define USB_CDC_STATE_DSR (1U << 1)
+#define USB_CDC_STATE_BREAK (1U << 2)
+#define USB_CDC_STATE_RING (1U << 3)
+#define USB_CDC_STATE_FRAMING (1U << 4)
+#define USB_CDC_STATE_PARITY (1U << 5)
+#define USB_CDC_STATE_OVERRUN (1U << 6)
+
+typedef struct {
+    uint32_t baud;
+    uint8_t stop_bits;          /**< 0: 1, 1: 1.5, 2: 2 */
+    uint8_t parity;             /**< 0: none, 1: odd, 2: even, 3: mark, 4: space */
+    uint8_t data_bits;
+} usb_cdc_line_coding_t;
+
+typedef struct {
+    uint16_t vendor_id;
+    uint16_t product_id;
+    const char* manufacturer;   /**< ASCII strings of up to 31 characters, or NULL for none */
+    const char* product;
+    const char* serial;
+    uint8_t vbus_sensing;       /**< See usb_config_t */
+    msg_pool_t* rx_pool;        /**< Receive buffers; payloads of at least USB_CDC_PACKET bytes */
+    mailbox_t* rx_output;       /**< Receives each filled message */
+} usb_cdc_config_t;
+
+typedef struct {
+    uint32_t rx_messages;       /**< Posted */
+    uint32_t rx_bytes;
+    uint32_t rx_starved;        /**< Times the receive endpoint waited for the pool */
+    uint32_t tx_messages;       /**< Taken by the host */
+    uint32_t tx_bytes;
+    uint32_t tx_zlps;           /**< Zero-length packets ending whole-packet messages */
+    uint32_t tx_dropped;        /**< Queued messages freed unsent by a reset or deconfiguration */
+} usb_cdc_stats_t;
+
+typedef struct {
+    usb_device_t usb;
+    usb_cdc_config_t config;
+    mailbox_t tx_queue;
+    msg_t* tx_current;          /**< Message in the IN endpoint, NULL when idle */
+    msg_t* rx_current;          /**< Message the OUT endpoint is filling */
+    uint8_t tx_zlp;             /**< The zero-length packet after tx_current is in flight */
+    uint8_t rx_starved;         /**< Waiting for the pool; retried on start of frame */
+    uint8_t control_lines;      /**< USB_CDC_DTR and USB_CDC_RTS, as the host last set them */
+    usb_cdc_line_coding_t line_coding;
+    uint8_t device_descriptor[18];
+    uint8_t notification[10];
+    usb_cdc_stats_t stats;
+} usb_cdc_t;
+
+/**
+ * @brief Starts the USB core with the CDC-ACM descriptors and connects.
+ *
+ * @return FAILURE if the configuration is invalid or usb_init() fails.
+ */
+status_t usb_cdc_init(usb_cdc_t* cdc, const usb_cdc_config_t* config);
+
+/** Disconnects; queued and partly received messages go back to their pools. */
+void usb_cdc_deinit(usb_cdc_t* cdc);
+
+/**
+ * @brief Queues a message for the host and passes its ownership to the
+ * driver. Safe from any context.
+ *
+ * @return FAILURE if the device is not configured; the caller keeps the message.
+ */
+status_t usb_cdc_send(usb_cdc_t* cdc, msg_t* msg);
+
+/** Configured, and a terminal on the host has the port open (DTR set). */
+uint8_t usb_cdc_connected(const usb_cdc_t* cdc);
+
+/**
+ * @brief Sends a SERIAL_STATE notification with USB_CDC_STATE_* bits.
+ *
+ * @return FAILURE if not configured or the previous notification is still pending.
+ */
+status_t usb_cdc_serial_state(usb_cdc_t* cdc, uint16_t state);
+
+const usb_cdc_line_coding_t* usb_cdc_get_line_coding(const usb_cdc_t* cdc);
+
+const usb_cdc_stats_t* usb_cdc_get_stats(const usb_cdc_t* cdc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_CDC_H
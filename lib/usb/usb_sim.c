@@ -0,0 +1,479 @@
+#include "usb.h"
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(STM32F407xx)
+
+/* rc_w1 bits of GINTSTS: MMIS, SOF, ESUSP to EOPF, IISOIXFR, IPXFR, CIDSCHG to WKUPINT */
+#define GINTSTS_W1C 0xF030FC0AU
+#define EPCTL_WRITE_ONLY (USB_EPCTL_CNAK | USB_EPCTL_SNAK | USB_EPCTL_SD0PID | (1U << 29) | USB_EPCTL_EPDIS)
+
+/* Transactions a host controller retries on NAK before it gives up on a control stage */
+#define CONTROL_RETRIES 3U
+
+/* Passes of the interrupt before the model stops calling it for a level that stays up */
+#define IRQ_PASSES 16U
+
+/* Packet RAM as the FIFOs see it: words queued in each, oldest first */
+static struct {
+    uint32_t rx[USB_FIFO_WORDS];
+    uint32_t rx_head;
+    uint32_t rx_count;
+    uint32_t tx[USB_EP_COUNT][USB_FIFO_WORDS];
+    uint32_t tx_head[USB_EP_COUNT];
+    uint32_t tx_count[USB_EP_COUNT];
+} fifo;
+
+static uint32_t rx_depth(void)
+{
+    uint32_t depth = usb_sim_regs.GRXFSIZ & 0xFFFFU;
+    return (depth < USB_FIFO_WORDS) ? depth : USB_FIFO_WORDS;
+}
+
+static uint32_t tx_depth(uint32_t n)
+{
+    uint32_t size = (n == 0U) ? usb_sim_regs.DIEPTXF0 : usb_sim_regs.DIEPTXF[n - 1U];
+    uint32_t depth = size >> 16;
+    return (depth < USB_FIFO_WORDS) ? depth : USB_FIFO_WORDS;
+}
+
+static void rx_push(uint32_t word)
+{
+    fifo.rx[(fifo.rx_head + fifo.rx_count) % USB_FIFO_WORDS] = word;
+    fifo.rx_count++;
+}
+
+static uint32_t rx_pop(void)
+{
+    if (fifo.rx_count == 0U) {
+        return 0;
+    }
+    uint32_t word = fifo.rx[fifo.rx_head];
+    fifo.rx_head = (fifo.rx_head + 1U) % USB_FIFO_WORDS;
+    fifo.rx_count--;
+    return word;
+}
+
+static uint32_t tx_pop(uint32_t n)
+{
+    uint32_t word = fifo.tx[n][fifo.tx_head[n]];
+    fifo.tx_head[n] = (fifo.tx_head[n] + 1U) % USB_FIFO_WORDS;
+    fifo.tx_count[n]--;
+    return word;
+}
+
+static uint32_t rx_status(uint32_t ep, uint32_t count, uint32_t pktsts)
+{
+    return ep | (count << USB_GRXSTS_BCNT_Pos) | (pktsts << USB_GRXSTS_PKTSTS_Pos);
+}
+
+/* Free space and the FIFO-empty level of one transmit FIFO */
+static void tx_status(uint32_t n)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    uint32_t depth = tx_depth(n);
+    uint32_t used = fifo.tx_count[n];
+    regs->IN[n].DTXFSTS = (used < depth) ? depth - used : 0U;
+    uint8_t empty = (regs->GAHBCFG & USB_GAHBCFG_TXFELVL) ? (used == 0U) : (used <= depth / 2U);
+    if (empty) {
+        regs->IN[n].DIEPINT |= USB_EPINT_TXFE;
+    } else {
+        regs->IN[n].DIEPINT &= ~USB_EPINT_TXFE;
+    }
+}
+
+/* Endpoint interrupts roll up into DAINT and from there into GINTSTS */
+static void update(void)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    uint32_t daint = 0;
+    for (uint32_t n = 0; n < USB_EP_COUNT; n++) {
+        tx_status(n);
+        uint32_t in_mask = regs->DIEPMSK | (((regs->DIEPEMPMSK >> n) & 1U) ? USB_EPINT_TXFE : 0U);
+        if (regs->IN[n].DIEPINT & in_mask) {
+            daint |= 1UL << n;
+        }
+        if (regs->OUT[n].DOEPINT & regs->DOEPMSK) {
+            daint |= 1UL << (16U + n);
+        }
+    }
+    regs->DAINT = daint;
+
+    uint32_t status = regs->GINTSTS & ~(USB_GINTSTS_IEPINT | USB_GINTSTS_OEPINT | USB_GINTSTS_RXFLVL);
+    daint &= regs->DAINTMSK;
+    if (daint & 0xFFFFU) {
+        status |= USB_GINTSTS_IEPINT;
+    }
+    if (daint >> 16) {
+        status |= USB_GINTSTS_OEPINT;
+    }
+    if (fifo.rx_count != 0U) {
+        status |= USB_GINTSTS_RXFLVL;
+    }
+    regs->GINTSTS = status;
+}
+
+static void raise(usb_device_t* dev)
+{
+    const usb_regs_t* regs = &usb_sim_regs;
+    for (uint32_t pass = 0; pass < IRQ_PASSES; pass++) {
+        if (dev->regs == NULL || (regs->GAHBCFG & USB_GAHBCFG_GINT) == 0U ||
+            (regs->GINTSTS & regs->GINTMSK) == 0U) {
+            return;
+        }
+        usb_irq();
+    }
+}
+
+static void core_reset(void)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    memset(regs, 0, offsetof(usb_regs_t, FIFO));
+    memset(&fifo, 0, sizeof(fifo));
+    regs->GRSTCTL = USB_GRSTCTL_AHBIDL;
+    regs->GINTSTS = 0x04000020U;
+    regs->GUSBCFG = 0x00000A00U | USB_GUSBCFG_PHYSEL;
+    regs->GRXFSIZ = 0x00000200U;
+    regs->DIEPTXF0 = 0x00000200U;
+    regs->CID = 0x00001200U;
+    regs->DCFG = 0x02200000U;
+    regs->DSTS = 0x00000010U;
+}
+
+static uint32_t ep_max_packet(uint32_t n, uint32_t ctl)
+{
+    static const uint32_t ep0_sizes[4] = { 64, 32, 16, 8 };
+    return (n == 0U) ? ep0_sizes[ctl & 3U] : (ctl & USB_EPCTL_MPSIZ_Msk);
+}
+
+/* ------------------------------------------------------------- the bus --- */
+
+uint8_t usb_sim_attached(void)
+{
+    const usb_regs_t* regs = &usb_sim_regs;
+    return (hal_sim_rcc.AHB2ENR & (1U << 7)) && (regs->GCCFG & USB_GCCFG_PWRDWN) &&
+           (regs->GUSBCFG & USB_GUSBCFG_FDMOD) && (regs->DCTL & USB_DCTL_SDIS) == 0U;
+}
+
+void usb_sim_reset(usb_device_t* dev)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    if (!usb_sim_attached()) {
+        return;
+    }
+    regs->GINTSTS |= USB_GINTSTS_USBRST;
+    update();
+    raise(dev);
+    regs->DSTS = (regs->DSTS & ~USB_DSTS_ENUMSPD_Msk) | (USB_DCFG_DSPD_FS << USB_DSTS_ENUMSPD_Pos);
+    regs->GINTSTS |= USB_GINTSTS_ENUMDNE;
+    update();
+    raise(dev);
+}
+
+int32_t usb_sim_setup(usb_device_t* dev, const usb_setup_t* setup)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    if (!usb_sim_attached() || rx_depth() - fifo.rx_count < 4U) {
+        return USB_SIM_NAK;
+    }
+    /* A SETUP always gets through: it clears a stall and NAKs both directions until the device is ready */
+    regs->IN[0].DIEPCTL = (regs->IN[0].DIEPCTL & ~USB_EPCTL_STALL) | USB_EPCTL_NAKSTS;
+    regs->OUT[0].DOEPCTL = (regs->OUT[0].DOEPCTL & ~USB_EPCTL_STALL) | USB_EPCTL_NAKSTS;
+
+    uint32_t words[2];
+    memcpy(words, setup, sizeof(words));
+    rx_push(rx_status(0, sizeof(words), USB_PKTSTS_SETUP_DATA));
+    rx_push(words[0]);
+    rx_push(words[1]);
+    rx_push(rx_status(0, 0, USB_PKTSTS_SETUP_DONE));
+    update();
+    raise(dev);
+    return 0;
+}
+
+int32_t usb_sim_in(usb_device_t* dev, uint8_t ep, uint8_t* data, uint32_t max)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    uint32_t n = ep & 0x7FU;
+    if (!usb_sim_attached() || n >= USB_EP_COUNT) {
+        return USB_SIM_NAK;
+    }
+    usb_in_ep_regs_t* in = &regs->IN[n];
+    uint32_t ctl = in->DIEPCTL;
+    if (ctl & USB_EPCTL_STALL) {
+        return USB_SIM_STALL;
+    }
+    if ((ctl & USB_EPCTL_EPENA) == 0U || (ctl & USB_EPCTL_NAKSTS)) {
+        return USB_SIM_NAK;
+    }
+
+    uint32_t size_mask = (n == 0U) ? USB_EP0TSIZ_XFRSIZ_Msk : USB_EPTSIZ_XFRSIZ_Msk;
+    uint32_t count_mask = ((n == 0U) ? 3U : USB_EPTSIZ_PKTCNT_MAX) << USB_EPTSIZ_PKTCNT_Pos;
+    uint32_t remaining = in->DIEPTSIZ & size_mask;
+    uint32_t packets = (in->DIEPTSIZ & count_mask) >> USB_EPTSIZ_PKTCNT_Pos;
+    uint32_t max_packet = ep_max_packet(n, ctl);
+    uint32_t length = (remaining < max_packet) ? remaining : max_packet;
+    uint32_t words = (length + 3U) >> 2;
+    if (packets == 0U || fifo.tx_count[n] < words) {
+        return USB_SIM_NAK;
+    }
+
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t word = tx_pop(n);
+        uint32_t offset = 4U * i;
+        uint32_t bytes = (length - offset < 4U) ? length - offset : 4U;
+        if (offset < max) {
+            memcpy(data + offset, &word, (max - offset < bytes) ? max - offset : bytes);
+        }
+    }
+    packets--;
+    in->DIEPTSIZ = (in->DIEPTSIZ & ~(size_mask | count_mask)) | (packets << USB_EPTSIZ_PKTCNT_Pos) |
+                   (remaining - length);
+    if (packets == 0U) {
+        in->DIEPCTL &= ~USB_EPCTL_EPENA;
+        in->DIEPINT |= USB_EPINT_XFRC;
+    }
+    update();
+    raise(dev);
+    return (int32_t)length;
+}
+
+int32_t usb_sim_out(usb_device_t* dev, uint8_t ep, const uint8_t* data, uint32_t length)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    uint32_t n = ep & 0x7FU;
+    if (!usb_sim_attached() || n >= USB_EP_COUNT) {
+        return USB_SIM_NAK;
+    }
+    usb_out_ep_regs_t* out = &regs->OUT[n];
+    uint32_t ctl = out->DOEPCTL;
+    if (ctl & USB_EPCTL_STALL) {
+        return USB_SIM_STALL;
+    }
+    uint32_t max_packet = ep_max_packet(n, ctl);
+    uint32_t words = (length + 3U) >> 2;
+    if ((ctl & USB_EPCTL_EPENA) == 0U || (ctl & USB_EPCTL_NAKSTS) || length > max_packet ||
+        rx_depth() - fifo.rx_count < words + 2U) {
+        return USB_SIM_NAK;
+    }
+
+    rx_push(rx_status(n, length, USB_PKTSTS_OUT_DATA));
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t word = 0;
+        uint32_t offset = 4U * i;
+        memcpy(&word, data + offset, (length - offset < 4U) ? length - offset : 4U);
+        rx_push(word);
+    }
+
+    uint32_t size_mask = (n == 0U) ? USB_EP0TSIZ_XFRSIZ_Msk : USB_EPTSIZ_XFRSIZ_Msk;
+    uint32_t count_mask = ((n == 0U) ? 1U : USB_EPTSIZ_PKTCNT_MAX) << USB_EPTSIZ_PKTCNT_Pos;
+    uint32_t remaining = out->DOEPTSIZ & size_mask;
+    uint32_t packets = (out->DOEPTSIZ & count_mask) >> USB_EPTSIZ_PKTCNT_Pos;
+    remaining = (remaining > length) ? remaining - length : 0U;
+    packets = (packets != 0U) ? packets - 1U : 0U;
+    out->DOEPTSIZ = (out->DOEPTSIZ & ~(size_mask | count_mask)) | (packets << USB_EPTSIZ_PKTCNT_Pos) | remaining;
+
+    /* A short packet or the last one ends the transfer, and the endpoint NAKs until it is armed again */
+    if (length < max_packet || packets == 0U) {
+        rx_push(rx_status(n, 0, USB_PKTSTS_OUT_DONE));
+        out->DOEPCTL = (ctl & ~USB_EPCTL_EPENA) | USB_EPCTL_NAKSTS;
+    }
+    update();
+    raise(dev);
+    return 0;
+}
+
+static int32_t in_retry(usb_device_t* dev, uint8_t* data, uint32_t max)
+{
+    int32_t result = USB_SIM_NAK;
+    for (uint32_t i = 0; i < CONTROL_RETRIES && result == USB_SIM_NAK; i++) {
+        result = usb_sim_in(dev, 0, data, max);
+    }
+    return result;
+}
+
+static int32_t out_retry(usb_device_t* dev, const uint8_t* data, uint32_t length)
+{
+    int32_t result = USB_SIM_NAK;
+    for (uint32_t i = 0; i < CONTROL_RETRIES && result == USB_SIM_NAK; i++) {
+        result = usb_sim_out(dev, 0, data, length);
+    }
+    return result;
+}
+
+int32_t usb_sim_control(usb_device_t* dev, const usb_setup_t* setup, uint8_t* data)
+{
+    int32_t result = usb_sim_setup(dev, setup);
+    if (result < 0) {
+        return result;
+    }
+
+    uint32_t total = 0;
+    if (setup->length != 0U && (setup->request_type & USB_REQTYPE_DIR_IN)) {
+        while (total < setup->length) {
+            result = in_retry(dev, data + total, setup->length - total);
+            if (result < 0) {
+                return result;
+            }
+            total += (uint32_t)result;
+            if ((uint32_t)result < USB_EP0_SIZE) {
+                break;
+            }
+        }
+        result = out_retry(dev, NULL, 0);
+    } else {
+        while (total < setup->length) {
+            uint32_t chunk = setup->length - total;
+            chunk = (chunk < USB_EP0_SIZE) ? chunk : USB_EP0_SIZE;
+            result = out_retry(dev, data + total, chunk);
+            if (result < 0) {
+                return result;
+            }
+            total += chunk;
+        }
+        uint8_t status[1];
+        result = in_retry(dev, status, 0);
+    }
+    return (result < 0) ? result : (int32_t)total;
+}
+
+void usb_sim_sof(usb_device_t* dev)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    uint32_t frame = ((regs->DSTS & USB_DSTS_FNSOF_Msk) >> USB_DSTS_FNSOF_Pos) + 1U;
+    regs->DSTS = (regs->DSTS & ~USB_DSTS_FNSOF_Msk) | ((frame << USB_DSTS_FNSOF_Pos) & USB_DSTS_FNSOF_Msk);
+    regs->GINTSTS |= USB_GINTSTS_SOF;
+    update();
+    raise(dev);
+}
+
+void usb_sim_suspend(usb_device_t* dev)
+{
+    usb_sim_regs.DSTS |= USB_DSTS_SUSPSTS;
+    usb_sim_regs.GINTSTS |= USB_GINTSTS_USBSUSP;
+    update();
+    raise(dev);
+}
+
+void usb_sim_resume(usb_device_t* dev)
+{
+    usb_sim_regs.DSTS &= ~USB_DSTS_SUSPSTS;
+    usb_sim_regs.GINTSTS |= USB_GINTSTS_WKUPINT;
+    update();
+    raise(dev);
+}
+
+/* --------------------------------------------------------- registers --- */
+
+static void ep_control(volatile uint32_t* reg, uint32_t old, uint32_t value, volatile uint32_t* flags)
+{
+    uint32_t ctl = (value & ~(EPCTL_WRITE_ONLY | USB_EPCTL_NAKSTS)) | (old & USB_EPCTL_NAKSTS);
+    if (value & USB_EPCTL_SNAK) {
+        ctl |= USB_EPCTL_NAKSTS;
+    }
+    if (value & USB_EPCTL_CNAK) {
+        ctl &= ~USB_EPCTL_NAKSTS;
+    }
+    if ((value & USB_EPCTL_EPDIS) && (old & USB_EPCTL_EPENA)) {
+        ctl &= ~USB_EPCTL_EPENA;
+        *flags |= USB_EPINT_EPDISD;
+    }
+    *reg = ctl;
+}
+
+static void flush_tx(uint32_t n)
+{
+    fifo.tx_head[n] = 0;
+    fifo.tx_count[n] = 0;
+}
+
+void usb_sim_write(volatile uint32_t* reg, uint32_t value)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    volatile uint32_t* windows = &regs->FIFO[0][0];
+    if (reg >= windows && reg < windows + USB_EP_COUNT * 1024U) {
+        /* A push into an IN endpoint's transmit FIFO; one that does not fit is lost */
+        uint32_t n = (uint32_t)(reg - windows) / 1024U;
+        if (fifo.tx_count[n] < tx_depth(n)) {
+            fifo.tx[n][(fifo.tx_head[n] + fifo.tx_count[n]) % USB_FIFO_WORDS] = value;
+            fifo.tx_count[n]++;
+        }
+        tx_status(n);
+        return;
+    }
+
+    uint32_t old = *reg;
+    hal_reg_write(reg, value);
+
+    if (reg == &regs->GRSTCTL) {
+        if (value & USB_GRSTCTL_CSRST) {
+            core_reset();
+        }
+        if (value & USB_GRSTCTL_RXFFLSH) {
+            fifo.rx_head = 0;
+            fifo.rx_count = 0;
+        }
+        if (value & USB_GRSTCTL_TXFFLSH) {
+            uint32_t n = (value >> USB_GRSTCTL_TXFNUM_Pos) & 0x1FU;
+            for (uint32_t i = 0; i < USB_EP_COUNT; i++) {
+                if (n == 0x10U || n == i) {
+                    flush_tx(i);
+                }
+            }
+        }
+        regs->GRSTCTL = USB_GRSTCTL_AHBIDL;
+    } else if (reg == &regs->GINTSTS) {
+        *reg = old & ~(value & GINTSTS_W1C);
+    } else if (reg == &regs->GUSBCFG) {
+        if (value & USB_GUSBCFG_FHMOD) {
+            regs->GINTSTS |= USB_GINTSTS_CMOD;
+        } else if (value & USB_GUSBCFG_FDMOD) {
+            regs->GINTSTS &= ~USB_GINTSTS_CMOD;
+        }
+    } else {
+        for (uint32_t n = 0; n < USB_EP_COUNT; n++) {
+            if (reg == &regs->IN[n].DIEPCTL) {
+                ep_control(reg, old, value, &regs->IN[n].DIEPINT);
+            } else if (reg == &regs->IN[n].DIEPINT) {
+                *reg = old & ~(value & ~USB_EPINT_TXFE);
+            } else if (reg == &regs->OUT[n].DOEPCTL) {
+                ep_control(reg, old, value, &regs->OUT[n].DOEPINT);
+            } else if (reg == &regs->OUT[n].DOEPINT) {
+                *reg = old & ~value;
+            }
+        }
+    }
+    update();
+}
+
+uint32_t usb_sim_read(volatile uint32_t* reg)
+{
+    usb_regs_t* regs = &usb_sim_regs;
+    volatile uint32_t* windows = &regs->FIFO[0][0];
+    if (reg == &regs->GRXSTSP) {
+        if (fifo.rx_count == 0U) {
+            return 0;
+        }
+        /* Popping the end of a setup stage or transfer is what raises STUP or XFRC */
+        uint32_t status = rx_pop();
+        uint32_t n = status & USB_GRXSTS_EPNUM_Msk & (USB_EP_COUNT - 1U);
+        uint32_t pktsts = (status & USB_GRXSTS_PKTSTS_Msk) >> USB_GRXSTS_PKTSTS_Pos;
+        if (pktsts == USB_PKTSTS_SETUP_DONE) {
+            regs->OUT[0].DOEPINT |= USB_EPINT_STUP;
+        } else if (pktsts == USB_PKTSTS_OUT_DONE) {
+            regs->OUT[n].DOEPINT |= USB_EPINT_XFRC;
+        }
+        update();
+        return status;
+    }
+    if (reg >= windows && reg < windows + USB_EP_COUNT * 1024U) {
+        uint32_t word = rx_pop();
+        if (fifo.rx_count == 0U) {
+            regs->GINTSTS &= ~USB_GINTSTS_RXFLVL;
+        }
+        return word;
+    }
+    return *reg;
+}
+
+#endif
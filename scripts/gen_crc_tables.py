@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Generates the slicing-by-8 CRC-32 tables.
+
+Writes crc_tables.h and crc_tables.c for the CRC the STM32 CRC unit
+computes: polynomial --poly, shifted in most significant bit first, no
+reflection. crc32_table[0][b] is the register after a top byte of b has
+been shifted out through eight steps; table k advances table k - 1 by eight
+more steps, so in a group of eight bytes the one with k bytes still to come
+after it is looked up in table k.
+"""
+
+import argparse
+import os
+
+
+def rows(values, per_row):
+    for i in range(0, len(values), per_row):
+        yield "        " + " ".join(values[i:i + per_row])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--poly", type=lambda text: int(text, 0), default=0x04C11DB7)
+    parser.add_argument("--out-dir", required=True)
+    args = parser.parse_args()
+
+    poly = args.poly
+    if poly <= 0 or poly > 0xFFFFFFFF or not poly & 1:
+        parser.error("--poly must be an odd 32-bit value")
+
+    def advance(crc):
+        for _ in range(8):
+            crc = ((crc << 1) ^ poly if crc & 0x80000000 else crc << 1) & 0xFFFFFFFF
+        return crc
+
+    tables = [[advance(b << 24) for b in range(256)]]
+    for _ in range(7):
+        previous = tables[-1]
+        tables.append([((c << 8) & 0xFFFFFFFF) ^ tables[0][c >> 24] for c in previous])
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    with open(os.path.join(args.out_dir, "crc_tables.h"), "w") as header:
+        header.write("/* Generated by scripts/gen_crc_tables.py; do not edit. */\n")
+        header.write("#ifndef CRC_TABLES_H\n#define CRC_TABLES_H\n\n#include <stdint.h>\n\n")
+        header.write("#define CRC_TABLE_POLY 0x{:08X}U\n\n".format(poly))
+        header.write("extern const uint32_t crc32_table[8][256];\n\n")
+        header.write("#endif // CRC_TABLES_H\n")
+
+    with open(os.path.join(args.out_dir, "crc_tables.c"), "w") as source:
+        source.write("/* Generated by scripts/gen_crc_tables.py; do not edit. */\n")
+        source.write('#include "crc_tables.h"\n\n')
+        source.write("const uint32_t crc32_table[8][256] = {\n")
+        for table in tables:
+            source.write("    {\n")
+            source.write("\n".join(rows(["0x{:08X}U,".format(v) for v in table], 6)))
+            source.write("\n    },\n")
+        source.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
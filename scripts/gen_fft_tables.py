@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Generates the FFT twiddle and bit-reversal tables.
+
+Writes fft_tables.h and fft_tables.c for transforms of up to --size points.
+Twiddle k is W^k = cos(2 pi k / size) - i sin(2 pi k / size), stored as the
+pair (cos, sin) for k in [0, 3 * size / 4), which covers every radix-4 stage
+of a complex transform of up to size points and the split step of a real
+transform of up to size points. bitrev[i] reverses the log2(size) bits of i;
+smaller transforms shift it right.
+"""
+
+import argparse
+import math
+import os
+
+
+def q15(value):
+    return max(-32768, min(32767, int(round(value * 32768.0))))
+
+
+def rows(values, per_row):
+    for i in range(0, len(values), per_row):
+        yield "    " + " ".join(values[i:i + per_row])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--size", type=int, required=True, help="largest transform, a power of two")
+    parser.add_argument("--out-dir", required=True)
+    args = parser.parse_args()
+
+    size = args.size
+    if size < 16 or size > 65536 or size & (size - 1):
+        parser.error("--size must be a power of two between 16 and 65536")
+    bits = size.bit_length() - 1
+    twiddles = size * 3 // 4
+
+    angles = [2.0 * math.pi * k / size for k in range(twiddles)]
+    twiddle_q15 = []
+    twiddle_f32 = []
+    for angle in angles:
+        twiddle_q15 += [q15(math.cos(angle)), q15(math.sin(angle))]
+        twiddle_f32 += [math.cos(angle), math.sin(angle)]
+    bitrev = [int(format(i, "0{}b".format(bits))[::-1], 2) for i in range(size)]
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    with open(os.path.join(args.out_dir, "fft_tables.h"), "w") as header:
+        header.write("/* Generated by scripts/gen_fft_tables.py; do not edit. */\n")
+        header.write("#ifndef FFT_TABLES_H\n#define FFT_TABLES_H\n\n#include <stdint.h>\n\n")
+        header.write("#define FFT_TABLE_SIZE {}U\n".format(size))
+        header.write("#define FFT_TABLE_BITS {}U\n".format(bits))
+        header.write("#define FFT_TABLE_TWIDDLES {}U\n\n".format(twiddles))
+        header.write("extern const int16_t fft_twiddle_q15[2U * FFT_TABLE_TWIDDLES];\n")
+        header.write("extern const float fft_twiddle_f32[2U * FFT_TABLE_TWIDDLES];\n")
+        header.write("extern const uint16_t fft_bitrev[FFT_TABLE_SIZE];\n\n")
+        header.write("#endif // FFT_TABLES_H\n")
+
+    with open(os.path.join(args.out_dir, "fft_tables.c"), "w") as source:
+        source.write("/* Generated by scripts/gen_fft_tables.py; do not edit. */\n")
+        source.write('#include "fft_tables.h"\n\n')
+        source.write("const int16_t fft_twiddle_q15[2U * FFT_TABLE_TWIDDLES] = {\n")
+        source.write("\n".join(rows(["{},".format(v) for v in twiddle_q15], 12)))
+        source.write("\n};\n\n")
+        source.write("const float fft_twiddle_f32[2U * FFT_TABLE_TWIDDLES] = {\n")
+        source.write("\n".join(rows(["{:.9e}f,".format(v) for v in twiddle_f32], 6)))
+        source.write("\n};\n\n")
+        source.write("const uint16_t fft_bitrev[FFT_TABLE_SIZE] = {\n")
+        source.write("\n".join(rows(["{},".format(v) for v in bitrev], 16)))
+        source.write("\n};\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,6 @@
 #include "linked_list.h"
+#include "scheduler.h"
+#include "timebase.h"
 
 node_t node1, node2, node3, node4, node5, node6;
 char* str1 = "Node 1";
@@ -22,5 +24,8 @@ int main()
     ll_delete_at_head();
     ll_delete_at_tail();
 
-    return 0;
+    sched_init();
+    timebase_init(sched_tick_announce, sched_idle_ticks);
+    sched_set_idle_hook(timebase_sleep);
+    sched_run();
 }
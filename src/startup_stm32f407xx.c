@@ -110,7 +110,7 @@ void CRYP_IRQHandler(void) __attribute__((weak, alias("Default_Handler")));
 void HASH_RNG_IRQHandler(void) __attribute__((weak, alias("Default_Handler")));
 void FPU_IRQHandler(void) __attribute__((weak, alias("Default_Handler")));
 
-uint32_t vectors[] __attribute__((section(".isr_vector"))) = {
+uint32_t vectors[] __attribute__((used, section(".isr_vector"))) = {
 	STACK_START,
 	(uint32_t)Reset_Handler,
 	(uint32_t)NMI_Handler,
@@ -219,6 +219,11 @@ void Default_Handler(void)
 
 void Reset_Handler(void)
 {
+	/* enable CP10/CP11 so hard-float code and the kernel's FPU context save can run */
+	*(volatile uint32_t *)0xE000ED88U |= (0xFU << 20);
+	__asm volatile("dsb\n"
+				   "isb");
+
 	/* copy the .data section to SRAM */
 	uint32_t size = (uint32_t)&_edata - (uint32_t)&_sdata;
 
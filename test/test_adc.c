@@ -0,0 +1,227 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/adc/adc.h"
+#include <string.h>
+
+#define CHANNELS 2U
+#define SCANS 32U
+#define BLOCK_SAMPLES (SCANS * CHANNELS)
+#define BLOCKS 4U
+
+static MSG_POOL_STORAGE(storage, BLOCK_SAMPLES * sizeof(uint16_t), BLOCKS);
+static msg_pool_t pool;
+static mailbox_t output;
+static adc_config_t config;
+
+/* Channel 0 counts up, channel 1 is a triangle with period 512; n is the scan index */
+static void waveform(uint16_t* samples, uint32_t first_scan, uint32_t scans)
+{
+    for (uint32_t i = 0; i < scans; i++) {
+        uint32_t n = first_scan + i;
+        uint32_t phase = n & 511U;
+        samples[i * 2U] = (uint16_t)(n & 0xFFFU);
+        samples[i * 2U + 1U] = (uint16_t)((phase < 256U) ? phase * 16U : (511U - phase) * 16U);
+    }
+}
+
+static void feed_scans(uint32_t first_scan, uint32_t scans)
+{
+    uint16_t samples[BLOCK_SAMPLES];
+    while (scans > 0U) {
+        uint32_t chunk = (scans < SCANS) ? scans : SCANS;
+        waveform(samples, first_scan, chunk);
+        adc_sim_feed(samples, chunk * CHANNELS);
+        first_scan += chunk;
+        scans -= chunk;
+    }
+}
+
+/* Checks a block holds scans first_scan.. of the waveform, then frees it */
+static void expect_block(uint32_t first_scan)
+{
+    uint16_t expected[BLOCK_SAMPLES];
+    msg_t* block = mailbox_fetch(&output);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL(BLOCK_SAMPLES * sizeof(uint16_t), block->length);
+    TEST_ASSERT_EQUAL(7, block->type);
+    waveform(expected, first_scan, SCANS);
+    TEST_ASSERT_EQUAL_INT16_ARRAY((const int16_t*)expected, (const int16_t*)adc_block_samples(block), BLOCK_SAMPLES);
+    msg_free(block);
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(&adc_sim_adc1, 0, sizeof(adc_sim_adc1));
+    memset(&adc_sim_tim2, 0, sizeof(adc_sim_tim2));
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    msg_pool_init(&pool, storage, BLOCK_SAMPLES * sizeof(uint16_t), BLOCKS);
+    mailbox_init(&output, NULL, NULL);
+
+    memset(&config, 0, sizeof(config));
+    config.channels[0] = 3;
+    config.channels[1] = 12;
+    config.channel_count = CHANNELS;
+    config.sample_time = 1;
+    config.msg_type = 7;
+    config.scan_rate_hz = 200000;
+    config.timer_clock_hz = 84000000;
+    config.scans_per_block = SCANS;
+    config.pool = &pool;
+    config.output = &output;
+    TEST_ASSERT_EQUAL(SUCCESS, adc_init(&config));
+}
+
+void tearDown(void)
+{
+    adc_stop();
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    adc_config_t bad = config;
+    bad.scans_per_block = SCANS + 1U; /* block larger than a payload */
+    TEST_ASSERT_EQUAL(FAILURE, adc_init(&bad));
+    bad = config;
+    bad.scan_rate_hz = 50000000; /* faster than the timer can divide */
+    TEST_ASSERT_EQUAL(FAILURE, adc_init(&bad));
+    bad = config;
+    bad.channels[1] = 19;
+    TEST_ASSERT_EQUAL(FAILURE, adc_init(&bad));
+    bad = config;
+    bad.channel_count = 0;
+    TEST_ASSERT_EQUAL(FAILURE, adc_init(&bad));
+}
+
+void test_init_programs_scan_trigger_and_dma(void)
+{
+    TEST_ASSERT_EQUAL_HEX32(1U << 20, adc_sim_adc1.SQR1);
+    TEST_ASSERT_EQUAL_HEX32(3U | (12U << 5), adc_sim_adc1.SQR3);
+    TEST_ASSERT_EQUAL_HEX32(1U << 9, adc_sim_adc1.SMPR2);
+    TEST_ASSERT_EQUAL_HEX32(1U << 6, adc_sim_adc1.SMPR1);
+    TEST_ASSERT_EQUAL_HEX32(ADC_CR1_SCAN | ADC_CR1_OVRIE, adc_sim_adc1.CR1);
+    TEST_ASSERT_EQUAL_HEX32((1U << 28) | (6U << 24) | ADC_CR2_DMA | ADC_CR2_DDS, adc_sim_adc1.CR2);
+    TEST_ASSERT_EQUAL(419, adc_sim_tim2.ARR);
+    TEST_ASSERT_EQUAL_HEX32(ADC_TIM_CR2_MMS_UPDATE, adc_sim_tim2.CR2);
+    TEST_ASSERT_EQUAL(0, adc_sim_tim2.CR1 & ADC_TIM_CR1_CEN);
+
+    TEST_ASSERT_EQUAL(SUCCESS, adc_start());
+    TEST_ASSERT_TRUE(adc_sim_adc1.CR2 & ADC_CR2_ADON);
+    TEST_ASSERT_TRUE(adc_sim_tim2.CR1 & ADC_TIM_CR1_CEN);
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[0].CR & DMA_SxCR_DBM);
+    TEST_ASSERT_EQUAL(BLOCK_SAMPLES, dma_sim_regs[1].S[0].NDTR);
+    TEST_ASSERT_EQUAL(2, pool.in_use);
+    TEST_ASSERT_EQUAL(FAILURE, adc_start());
+}
+
+void test_nothing_is_posted_before_a_block_completes(void)
+{
+    adc_start();
+    feed_scans(0, SCANS - 1U);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+    feed_scans(SCANS - 1U, 1);
+    expect_block(0);
+}
+
+void test_blocks_stream_in_order_without_copies(void)
+{
+    adc_start();
+    for (uint32_t block = 0; block < 20; block++) {
+        feed_scans(block * SCANS, SCANS);
+        expect_block(block * SCANS);
+        TEST_ASSERT_EQUAL(2, pool.in_use);
+    }
+    TEST_ASSERT_EQUAL(20, adc_get_stats()->blocks);
+    TEST_ASSERT_EQUAL(0, adc_get_stats()->dropped_blocks);
+}
+
+void test_consumer_may_hold_blocks_while_acquisition_continues(void)
+{
+    adc_start();
+    feed_scans(0, 2U * SCANS);
+    TEST_ASSERT_EQUAL(BLOCKS, pool.in_use);
+    expect_block(0);
+    expect_block(SCANS);
+}
+
+void test_empty_pool_drops_block_and_recovers(void)
+{
+    adc_start();
+    feed_scans(0, 2U * SCANS); /* two posted, pool now empty */
+    feed_scans(2U * SCANS, SCANS);
+    TEST_ASSERT_EQUAL(1, adc_get_stats()->dropped_blocks);
+    TEST_ASSERT_EQUAL(2, adc_get_stats()->blocks);
+
+    expect_block(0);
+    expect_block(SCANS);
+    feed_scans(3U * SCANS, 2U * SCANS);
+    expect_block(3U * SCANS);
+    expect_block(4U * SCANS);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+}
+
+void test_overrun_restarts_acquisition(void)
+{
+    adc_start();
+    feed_scans(0, SCANS / 2U);
+    adc_sim_overrun();
+    TEST_ASSERT_EQUAL(1, adc_get_stats()->overruns);
+    TEST_ASSERT_EQUAL(0, adc_sim_adc1.SR & ADC_SR_OVR);
+    TEST_ASSERT_TRUE(adc_sim_adc1.CR2 & ADC_CR2_DMA);
+    TEST_ASSERT_EQUAL(BLOCK_SAMPLES, dma_sim_regs[1].S[0].NDTR);
+
+    /* The half block before the overrun is discarded */
+    feed_scans(100, SCANS);
+    expect_block(100);
+}
+
+void test_dma_error_restarts_acquisition(void)
+{
+    adc_start();
+    dma_sim_regs[1].LISR = DMA_FLAG_TE;
+    dma_sim_regs[1].S[0].CR &= ~DMA_SxCR_EN;
+    dma_stream_irq(2, 0);
+    dma_sim_regs[1].LISR = 0;
+    TEST_ASSERT_EQUAL(1, adc_get_stats()->dma_errors);
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[0].CR & DMA_SxCR_EN);
+
+    feed_scans(0, SCANS);
+    expect_block(0);
+}
+
+void test_samples_without_dma_cause_overrun(void)
+{
+    adc_start();
+    dma_sim_regs[1].S[0].CR &= ~DMA_SxCR_EN;
+    uint16_t sample[2] = { 1, 2 };
+    TEST_ASSERT_EQUAL(0, adc_sim_feed(sample, 1));
+    TEST_ASSERT_EQUAL(1, adc_get_stats()->overruns);
+    TEST_ASSERT_EQUAL(2, adc_sim_feed(sample, 2));
+}
+
+void test_stop_returns_blocks_to_pool(void)
+{
+    adc_start();
+    feed_scans(0, SCANS + 3U);
+    expect_block(0);
+    adc_stop();
+    TEST_ASSERT_EQUAL(0, pool.in_use);
+    TEST_ASSERT_EQUAL(0, adc_sim_tim2.CR1 & ADC_TIM_CR1_CEN);
+    uint16_t sample = 0;
+    TEST_ASSERT_EQUAL(0, adc_sim_feed(&sample, 1));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_programs_scan_trigger_and_dma);
+    RUN_TEST(test_nothing_is_posted_before_a_block_completes);
+    RUN_TEST(test_blocks_stream_in_order_without_copies);
+    RUN_TEST(test_consumer_may_hold_blocks_while_acquisition_continues);
+    RUN_TEST(test_empty_pool_drops_block_and_recovers);
+    RUN_TEST(test_overrun_restarts_acquisition);
+    RUN_TEST(test_dma_error_restarts_acquisition);
+    RUN_TEST(test_samples_without_dma_cause_overrun);
+    RUN_TEST(test_stop_returns_blocks_to_pool);
+    return UNITY_END();
+}
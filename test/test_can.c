@@ -0,0 +1,489 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/can/can.h"
+#include <string.h>
+
+#define RX_LENGTH 8U
+
+static can_config_t config;
+static can_t can;
+static can_frame_t rx0[RX_LENGTH];
+static can_frame_t rx1[RX_LENGTH];
+static uint32_t notified;
+
+static const can_filter_t filters[] = {
+    { 0x100, CAN_STD_EXACT, 0, 0 },
+    { 0x1234567, CAN_EXT_EXACT, 1, 0 },
+    { 0x200, 0x7F0, 0, 1 }, /* 0x200-0x20F */
+};
+
+static void on_rx(void* context)
+{
+    (void)context;
+    notified++;
+}
+
+static can_frame_t make(uint32_t id, uint8_t flags, uint8_t first)
+{
+    can_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.id = id;
+    frame.flags = flags;
+    frame.length = 8;
+    for (uint8_t i = 0; i < 8U; i++) {
+        frame.data[i] = (uint8_t)(first + i);
+    }
+    return frame;
+}
+
+/* ISER is write-one-to-set: look for the write in the register trace */
+static uint8_t nvic_enabled(uint32_t irqn)
+{
+    volatile uint32_t* iser = &hal_sim_nvic.ISER[irqn >> 5];
+    for (int32_t i = hal_reg_trace_find(iser, 0); i >= 0; i = hal_reg_trace_find(iser, (uint32_t)i + 1U)) {
+        if (hal_reg_trace[i].value & (1U << (irqn & 31U))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(&hal_sim_nvic, 0, sizeof(hal_sim_nvic));
+    memset(can_sim_regs, 0, sizeof(can_sim_regs));
+    hal_reg_trace_reset();
+    notified = 0;
+
+    memset(&config, 0, sizeof(config));
+    config.clock_hz = 42000000;
+    config.bitrate = 1000000;
+    config.filters = filters;
+    config.filter_count = 3;
+    config.rx_buffer[0] = rx0;
+    config.rx_buffer[1] = rx1;
+    config.rx_length[0] = RX_LENGTH;
+    config.rx_length[1] = RX_LENGTH;
+    config.rx_notify = on_rx;
+    TEST_ASSERT_EQUAL(SUCCESS, can_init(&can, 1, &config));
+}
+
+void tearDown(void)
+{
+    can_deinit(&can);
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    can_t other;
+    can_config_t bad = config;
+    TEST_ASSERT_EQUAL(FAILURE, can_init(&other, 1, &config)); /* in use */
+    TEST_ASSERT_EQUAL(FAILURE, can_init(&other, 3, &config));
+    bad.clock_hz = 41000000; /* no whole number of quanta */
+    TEST_ASSERT_EQUAL(FAILURE, can_init(&other, 2, &bad));
+    bad = config;
+    bad.rx_length[0] = 6;
+    TEST_ASSERT_EQUAL(FAILURE, can_init(&other, 2, &bad));
+    bad = config;
+    bad.rx_length[1] = 0; /* a filter routes to FIFO 1 */
+    TEST_ASSERT_EQUAL(FAILURE, can_init(&other, 2, &bad));
+
+    TEST_ASSERT_EQUAL(SUCCESS, can_init(&other, 2, &config));
+    can_deinit(&other);
+}
+
+void test_init_programs_timing_and_interrupts(void)
+{
+    can_regs_t* regs = &can_sim_regs[0];
+    /* 42 MHz / 3 = 14 quanta per bit: 1 + 11 + 2, sampled at 85.7% */
+    TEST_ASSERT_EQUAL_HEX32(0x001A0002, regs->BTR);
+    TEST_ASSERT_EQUAL_HEX32(CAN_MCR_ABOM, regs->MCR);
+    TEST_ASSERT_EQUAL(0, regs->MSR & (CAN_MSR_INAK | CAN_MSR_SLAK));
+    TEST_ASSERT_TRUE(regs->IER & CAN_IER_FMPIE0);
+    TEST_ASSERT_TRUE(regs->IER & CAN_IER_FMPIE1);
+    TEST_ASSERT_TRUE(regs->IER & CAN_IER_TMEIE);
+    for (uint32_t irqn = 19; irqn <= 22U; irqn++) {
+        TEST_ASSERT_TRUE(nvic_enabled(irqn));
+    }
+    TEST_ASSERT_TRUE(hal_sim_rcc.APB1ENR & (1U << 25));
+    TEST_ASSERT_EQUAL(0, regs->FMR & CAN_FMR_FINIT);
+    TEST_ASSERT_EQUAL(14, (regs->FMR >> CAN_FMR_CAN2SB_Pos) & 0x3FU);
+
+    can_t other;
+    can_config_t slow = config;
+    slow.bitrate = 500000;
+    slow.mode = CAN_MODE_LOOPBACK;
+    TEST_ASSERT_EQUAL(SUCCESS, can_init(&other, 2, &slow));
+    TEST_ASSERT_EQUAL_HEX32(0x001A0005 | CAN_BTR_LBKM | CAN_BTR_SILM, can_sim_regs[1].BTR);
+    TEST_ASSERT_TRUE(hal_sim_rcc.APB1ENR & (1U << 26));
+    for (uint32_t irqn = 63; irqn <= 66U; irqn++) {
+        TEST_ASSERT_TRUE(nvic_enabled(irqn));
+    }
+    /* Its filters went to banks 14 and up, next to CAN1's */
+    TEST_ASSERT_EQUAL_HEX32(0x3U, regs->FA1R & 0x3FFFU);
+    TEST_ASSERT_EQUAL_HEX32(0x3U << 14, regs->FA1R & (0x3FFFU << 14));
+    can_deinit(&other);
+}
+
+void test_compile_packs_each_class_densely(void)
+{
+    can_filter_bank_t banks[4];
+    uint32_t used;
+    const can_filter_t std_ids[] = {
+        { 0x100, CAN_STD_EXACT, 0, 0 },
+        { 0x101, CAN_STD_EXACT, 0, 0 },
+        { 0x102, CAN_STD_EXACT, 0, 0 },
+        { 0x7FF, CAN_STD_EXACT, 0, 0 },
+    };
+    TEST_ASSERT_EQUAL(SUCCESS, can_filter_compile(std_ids, 4, banks, 4, &used));
+    TEST_ASSERT_EQUAL(1, used);
+    TEST_ASSERT_EQUAL(1, banks[0].list);
+    TEST_ASSERT_EQUAL(0, banks[0].wide);
+    TEST_ASSERT_EQUAL_HEX32((0x101U << 21) | (0x100U << 5), banks[0].fr1);
+    TEST_ASSERT_EQUAL_HEX32((0x7FFU << 21) | (0x102U << 5), banks[0].fr2);
+
+    const can_filter_t masks[] = {
+        { 0x300, 0x700, 0, 1 },
+        { 0x080, 0x7C0, 0, 1 },
+        { 0x18FF0000, 0x1FFF0000, 1, 1 },
+    };
+    TEST_ASSERT_EQUAL(SUCCESS, can_filter_compile(masks, 3, banks, 4, &used));
+    TEST_ASSERT_EQUAL(2, used);
+    TEST_ASSERT_EQUAL(0, banks[0].list);
+    TEST_ASSERT_EQUAL(0, banks[0].wide);
+    TEST_ASSERT_EQUAL(1, banks[0].fifo);
+    TEST_ASSERT_EQUAL_HEX32((((0x700U << 5) | 0x18U) << 16) | (0x300U << 5), banks[0].fr1);
+    TEST_ASSERT_EQUAL_HEX32((((0x7C0U << 5) | 0x18U) << 16) | (0x080U << 5), banks[0].fr2);
+    TEST_ASSERT_EQUAL(0, banks[1].list);
+    TEST_ASSERT_EQUAL(1, banks[1].wide);
+    TEST_ASSERT_EQUAL_HEX32((0x18FF0000U << 3) | CAN_IR_IDE, banks[1].fr1);
+    TEST_ASSERT_EQUAL_HEX32((0x1FFF0000U << 3) | CAN_IR_IDE | CAN_IR_RTR, banks[1].fr2);
+}
+
+void test_compile_shares_left_over_slots(void)
+{
+    can_filter_bank_t banks[4];
+    uint32_t used;
+    /* One standard mask leaves a 16-bit mask slot for the exact standard ID */
+    const can_filter_t mixed16[] = {
+        { 0x400, 0x7F0, 0, 0 },
+        { 0x123, CAN_STD_EXACT, 0, 0 },
+    };
+    TEST_ASSERT_EQUAL(SUCCESS, can_filter_compile(mixed16, 2, banks, 4, &used));
+    TEST_ASSERT_EQUAL(1, used);
+    TEST_ASSERT_EQUAL_HEX32((((0x7FFU << 5) | 0x18U) << 16) | (0x123U << 5), banks[0].fr2);
+
+    /* Five exact standard IDs and one extended: the fifth standard ID pairs with the extended one */
+    const can_filter_t mixed32[] = {
+        { 0x10, CAN_STD_EXACT, 0, 0 }, { 0x11, CAN_STD_EXACT, 0, 0 }, { 0x12, CAN_STD_EXACT, 0, 0 },
+        { 0x13, CAN_STD_EXACT, 0, 0 }, { 0x14, CAN_STD_EXACT, 0, 0 }, { 0x12345, CAN_EXT_EXACT, 1, 0 },
+    };
+    TEST_ASSERT_EQUAL(SUCCESS, can_filter_compile(mixed32, 6, banks, 4, &used));
+    TEST_ASSERT_EQUAL(2, used);
+    TEST_ASSERT_EQUAL(1, banks[1].wide);
+    TEST_ASSERT_EQUAL(1, banks[1].list);
+    TEST_ASSERT_EQUAL_HEX32((0x12345U << 3) | CAN_IR_IDE, banks[1].fr1);
+    TEST_ASSERT_EQUAL_HEX32(0x14U << 21, banks[1].fr2);
+}
+
+void test_compile_drops_covered_entries(void)
+{
+    can_filter_bank_t banks[4];
+    uint32_t used;
+    const can_filter_t redundant[] = {
+        { 0x120, 0x7F0, 0, 0 },
+        { 0x123, CAN_STD_EXACT, 0, 0 }, /* inside the mask */
+        { 0x300, CAN_STD_EXACT, 0, 0 },
+        { 0x300, CAN_STD_EXACT, 0, 0 }, /* duplicate */
+        { 0x12F, 0x7FF, 0, 0 },         /* inside the mask */
+        { 0x123, CAN_STD_EXACT, 0, 1 }, /* other FIFO: kept */
+    };
+    TEST_ASSERT_EQUAL(SUCCESS, can_filter_compile(redundant, 6, banks, 4, &used));
+    TEST_ASSERT_EQUAL(2, used);
+    TEST_ASSERT_EQUAL(0, banks[0].fifo);
+    TEST_ASSERT_EQUAL_HEX32((((0x7FFU << 5) | 0x18U) << 16) | (0x300U << 5), banks[0].fr2);
+    TEST_ASSERT_EQUAL(1, banks[1].fifo);
+}
+
+void test_compile_rejects_invalid_or_oversized_lists(void)
+{
+    can_filter_bank_t banks[CAN_INSTANCE_BANKS];
+    can_filter_t many[4U * CAN_INSTANCE_BANKS + 1U];
+    uint32_t used;
+    can_filter_t bad = { 0x800, CAN_STD_EXACT, 0, 0 };
+    TEST_ASSERT_EQUAL(FAILURE, can_filter_compile(&bad, 1, banks, CAN_INSTANCE_BANKS, &used));
+    bad.id = 0x100;
+    bad.fifo = 2;
+    TEST_ASSERT_EQUAL(FAILURE, can_filter_compile(&bad, 1, banks, CAN_INSTANCE_BANKS, &used));
+
+    for (uint32_t i = 0; i < sizeof(many) / sizeof(many[0]); i++) {
+        many[i] = (can_filter_t){ i, CAN_STD_EXACT, 0, 0 };
+    }
+    TEST_ASSERT_EQUAL(SUCCESS, can_filter_compile(many, 4U * CAN_INSTANCE_BANKS, banks, CAN_INSTANCE_BANKS, &used));
+    TEST_ASSERT_EQUAL(CAN_INSTANCE_BANKS, used);
+    TEST_ASSERT_EQUAL(FAILURE, can_filter_compile(many, 4U * CAN_INSTANCE_BANKS + 1U, banks, CAN_INSTANCE_BANKS, &used));
+    TEST_ASSERT_EQUAL(FAILURE, can_set_filters(&can, many, 4U * CAN_INSTANCE_BANKS + 1U));
+}
+
+void test_filters_pass_only_wanted_frames(void)
+{
+    const can_frame_t frames[] = {
+        make(0x100, 0, 0x10),
+        make(0x101, 0, 0x20),
+        make(0x205, 0, 0x30),
+        make(0x1234567, CAN_FRAME_EXTENDED, 0x40),
+        make(0x100, CAN_FRAME_REMOTE, 0x50),
+        make(0x100, CAN_FRAME_EXTENDED, 0x60), /* extended ID 0x100 is not standard 0x100 */
+    };
+    can_frame_t frame;
+    TEST_ASSERT_EQUAL(1, can_sim_receive(&can, &frames[0], 1));
+    TEST_ASSERT_EQUAL(0, can_sim_receive(&can, &frames[1], 1));
+    TEST_ASSERT_EQUAL(1, can_sim_receive(&can, &frames[2], 1));
+    TEST_ASSERT_EQUAL(1, can_sim_receive(&can, &frames[3], 1));
+    TEST_ASSERT_EQUAL(0, can_sim_receive(&can, &frames[4], 2));
+    TEST_ASSERT_EQUAL(3, can_get_stats(&can)->rx_interrupts);
+    TEST_ASSERT_EQUAL(3, notified);
+
+    /* FIFO 0's queue first; FIFO 0 holds one 32-bit list bank: extended ID, then 0x100 */
+    TEST_ASSERT_EQUAL(SUCCESS, can_receive(&can, &frame));
+    TEST_ASSERT_EQUAL_HEX32(0x100, frame.id);
+    TEST_ASSERT_EQUAL(0, frame.flags);
+    TEST_ASSERT_EQUAL(1, frame.filter);
+    TEST_ASSERT_EQUAL(8, frame.length);
+    TEST_ASSERT_EQUAL_HEX8(0x17, frame.data[7]);
+    TEST_ASSERT_EQUAL(SUCCESS, can_receive(&can, &frame));
+    TEST_ASSERT_EQUAL_HEX32(0x1234567, frame.id);
+    TEST_ASSERT_EQUAL(CAN_FRAME_EXTENDED, frame.flags);
+    TEST_ASSERT_EQUAL(0, frame.filter);
+    TEST_ASSERT_EQUAL(SUCCESS, can_receive(&can, &frame));
+    TEST_ASSERT_EQUAL_HEX32(0x205, frame.id);
+    TEST_ASSERT_EQUAL(0, frame.filter);
+    TEST_ASSERT_EQUAL_HEX8(0x30, frame.data[0]);
+    TEST_ASSERT_EQUAL(FAILURE, can_receive(&can, &frame));
+}
+
+void test_interrupt_drains_the_whole_fifo(void)
+{
+    can_frame_t burst[5];
+    can_frame_t frame;
+    for (uint8_t i = 0; i < 5U; i++) {
+        burst[i] = make(0x100, 0, (uint8_t)(i * 16U));
+    }
+    TEST_ASSERT_EQUAL(3, can_sim_receive(&can, burst, 3));
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->rx_interrupts);
+    TEST_ASSERT_EQUAL(3, can_get_stats(&can)->rx_frames);
+    TEST_ASSERT_EQUAL(0, can_sim_regs[0].RFR[0] & CAN_RFR_FMP_Msk);
+    for (uint8_t i = 0; i < 3U; i++) {
+        can_receive(&can, &frame);
+        TEST_ASSERT_EQUAL_HEX8(i * 16U, frame.data[0]);
+    }
+
+    /* Five before the interrupt runs: the FIFO overruns and the fifth replaces the third */
+    TEST_ASSERT_EQUAL(5, can_sim_receive(&can, burst, 5));
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->rx_overruns);
+    TEST_ASSERT_EQUAL(0, can_sim_regs[0].RFR[0] & CAN_RFR_FOVR);
+    const uint8_t kept[] = { 0x00, 0x10, 0x40 };
+    for (uint8_t i = 0; i < 3U; i++) {
+        TEST_ASSERT_EQUAL(SUCCESS, can_receive(&can, &frame));
+        TEST_ASSERT_EQUAL_HEX8(kept[i], frame.data[0]);
+    }
+    TEST_ASSERT_EQUAL(FAILURE, can_receive(&can, &frame));
+}
+
+void test_full_queue_drops_and_counts(void)
+{
+    can_frame_t burst[3];
+    can_frame_t frame;
+    for (uint8_t i = 0; i < 3U; i++) {
+        burst[i] = make(0x100, 0, i);
+    }
+    for (uint32_t round = 0; round < 4U; round++) {
+        can_sim_receive(&can, burst, 3);
+    }
+    TEST_ASSERT_EQUAL(RX_LENGTH, can_get_stats(&can)->rx_frames);
+    TEST_ASSERT_EQUAL(4, can_get_stats(&can)->rx_dropped);
+    TEST_ASSERT_EQUAL(3, notified); /* the last drain queued nothing */
+    /* The hardware FIFO was emptied all the same */
+    TEST_ASSERT_EQUAL(0, can_sim_regs[0].RFR[0] & CAN_RFR_FMP_Msk);
+
+    uint32_t count = 0;
+    while (can_receive(&can, &frame) == SUCCESS) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL(RX_LENGTH, count);
+    TEST_ASSERT_EQUAL(3, can_sim_receive(&can, burst, 3));
+    TEST_ASSERT_EQUAL(RX_LENGTH + 3U, can_get_stats(&can)->rx_frames);
+}
+
+void test_urgent_frame_preempts_a_mailbox(void)
+{
+    const uint32_t ids[] = { 0x300, 0x200, 0x100, 0x050, 0x400 };
+    const uint32_t order[] = { 0x050, 0x100, 0x200, 0x300, 0x400 };
+    can_frame_t out[8];
+    for (uint32_t i = 0; i < 5U; i++) {
+        can_frame_t frame = make(ids[i], 0, (uint8_t)i);
+        TEST_ASSERT_EQUAL(SUCCESS, can_send(&can, &frame));
+    }
+    /* All three mailboxes were taken, so the lowest-priority one was asked to give way */
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->tx_preempted);
+    TEST_ASSERT_TRUE(can_sim_regs[0].TSR & CAN_TSR_ABRQ(0));
+    TEST_ASSERT_EQUAL(5, can_tx_pending(&can));
+
+    TEST_ASSERT_EQUAL(5, can_sim_transmit(&can, out, 8));
+    for (uint32_t i = 0; i < 5U; i++) {
+        TEST_ASSERT_EQUAL_HEX32(order[i], out[i].id);
+    }
+    TEST_ASSERT_EQUAL_HEX8(0, out[3].data[0]); /* the aborted frame went out intact */
+    TEST_ASSERT_EQUAL(5, can_get_stats(&can)->tx_frames);
+    TEST_ASSERT_EQUAL(0, can_tx_pending(&can));
+}
+
+void test_same_identifier_frames_keep_their_order(void)
+{
+    can_frame_t out[6];
+    for (uint8_t i = 0; i < 6U; i++) {
+        can_frame_t frame = make(0x123, 0, i);
+        TEST_ASSERT_EQUAL(SUCCESS, can_send(&can, &frame));
+    }
+    /* Only one mailbox may hold the identifier */
+    TEST_ASSERT_TRUE(can_sim_regs[0].TX[0].TIR & CAN_IR_TXRQ);
+    TEST_ASSERT_FALSE(can_sim_regs[0].TX[1].TIR & CAN_IR_TXRQ);
+    TEST_ASSERT_EQUAL(6, can_sim_transmit(&can, out, 6));
+    for (uint8_t i = 0; i < 6U; i++) {
+        TEST_ASSERT_EQUAL_HEX8(i, out[i].data[0]);
+    }
+}
+
+void test_arbitration_order_of_mixed_frames(void)
+{
+    /* Same base ID: standard data, then standard remote, then extended */
+    can_frame_t ext = make((0x100U << 18) | 1U, CAN_FRAME_EXTENDED, 1);
+    can_frame_t remote = make(0x100, CAN_FRAME_REMOTE, 2);
+    can_frame_t data = make(0x100, 0, 3);
+    can_frame_t out[3];
+    remote.length = 0;
+    can_send(&can, &ext);
+    can_send(&can, &remote);
+    can_send(&can, &data);
+    TEST_ASSERT_EQUAL(3, can_sim_transmit(&can, out, 3));
+    TEST_ASSERT_EQUAL_HEX8(3, out[0].data[0]);
+    TEST_ASSERT_EQUAL(CAN_FRAME_REMOTE, out[1].flags);
+    TEST_ASSERT_EQUAL(CAN_FRAME_EXTENDED, out[2].flags);
+    TEST_ASSERT_EQUAL_HEX32((0x100U << 18) | 1U, out[2].id);
+}
+
+void test_send_rejects_invalid_frames_and_a_full_queue(void)
+{
+    can_frame_t frame = make(0x800, 0, 0);
+    TEST_ASSERT_EQUAL(FAILURE, can_send(&can, &frame));
+    frame = make(0x20000000, CAN_FRAME_EXTENDED, 0);
+    TEST_ASSERT_EQUAL(FAILURE, can_send(&can, &frame));
+    frame = make(0x10, 0, 0);
+    frame.length = 9;
+    TEST_ASSERT_EQUAL(FAILURE, can_send(&can, &frame));
+
+    for (uint32_t i = 0; i < 3U + CAN_TX_QUEUE_LENGTH; i++) {
+        frame = make(0x10 + i, 0, 0);
+        TEST_ASSERT_EQUAL(SUCCESS, can_send(&can, &frame));
+    }
+    TEST_ASSERT_EQUAL(FAILURE, can_send(&can, &frame));
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->tx_rejected);
+    TEST_ASSERT_EQUAL(3U + CAN_TX_QUEUE_LENGTH, can_tx_pending(&can));
+}
+
+void test_loopback_receives_its_own_frames(void)
+{
+    can_frame_t out[2];
+    can_frame_t frame = make(0x100, 0, 0x77);
+    can_frame_t unwanted = make(0x555, 0, 0);
+    can_deinit(&can);
+    config.mode = CAN_MODE_LOOPBACK;
+    TEST_ASSERT_EQUAL(SUCCESS, can_init(&can, 1, &config));
+    TEST_ASSERT_EQUAL(0, can_sim_receive(&can, &unwanted, 1)); /* the pin is disconnected */
+
+    can_send(&can, &frame);
+    can_send(&can, &unwanted);
+    memset(out, 0, sizeof(out));
+    TEST_ASSERT_EQUAL(2, can_sim_transmit(&can, out, 2));
+    TEST_ASSERT_EQUAL(0, out[0].id); /* nothing driven onto the bus */
+    TEST_ASSERT_EQUAL(SUCCESS, can_receive(&can, &frame));
+    TEST_ASSERT_EQUAL_HEX32(0x100, frame.id);
+    TEST_ASSERT_EQUAL_HEX8(0x77, frame.data[0]);
+    TEST_ASSERT_EQUAL(FAILURE, can_receive(&can, &frame));
+}
+
+void test_error_state_changes_are_counted(void)
+{
+    can_sim_error(&can, 100, 0, 3);
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->error_warnings);
+    TEST_ASSERT_EQUAL(0, can_sim_regs[0].MSR & CAN_MSR_ERRI);
+    can_sim_error(&can, 130, 0, 3);
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->error_warnings);
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->error_passive);
+    can_sim_error(&can, 300, 0, 3);
+    can_sim_error(&can, 300, 0, 3);
+    TEST_ASSERT_EQUAL(1, can_get_stats(&can)->bus_off);
+    /* Recovered, which the transmit interrupt notices, then back into warning */
+    can_frame_t frame = make(0x10, 0, 0);
+    can_sim_error(&can, 0, 0, 0);
+    can_send(&can, &frame);
+    can_sim_transmit(&can, NULL, 1);
+    can_sim_error(&can, 96, 0, 0);
+    TEST_ASSERT_EQUAL(2, can_get_stats(&can)->error_warnings);
+}
+
+void test_set_filters_replaces_only_this_instance(void)
+{
+    const can_filter_t replacement[] = { { 0x555, CAN_STD_EXACT, 0, 0 } };
+    can_frame_t old_id = make(0x100, 0, 0);
+    can_frame_t new_id = make(0x555, 0, 0);
+    can_t other;
+    TEST_ASSERT_EQUAL(SUCCESS, can_init(&other, 2, &config));
+
+    TEST_ASSERT_EQUAL(SUCCESS, can_set_filters(&can, replacement, 1));
+    TEST_ASSERT_EQUAL(0, can_sim_receive(&can, &old_id, 1));
+    TEST_ASSERT_EQUAL(1, can_sim_receive(&can, &new_id, 1));
+    TEST_ASSERT_EQUAL_HEX32(0x1U, can_sim_regs[0].FA1R & 0x3FFFU);
+    TEST_ASSERT_EQUAL(1, can_sim_receive(&other, &old_id, 1));
+    can_deinit(&other);
+    TEST_ASSERT_EQUAL_HEX32(0, can_sim_regs[0].FA1R & (0x3FFFU << 14));
+}
+
+void test_deinit_stops_the_controller(void)
+{
+    can_frame_t frame = make(0x100, 0, 0);
+    can_sim_receive(&can, &frame, 1);
+    can_send(&can, &frame);
+    can_deinit(&can);
+
+    TEST_ASSERT_EQUAL(0, can_sim_regs[0].FA1R);
+    TEST_ASSERT_EQUAL(CAN_MSR_SLAK, can_sim_regs[0].MSR & (CAN_MSR_SLAK | CAN_MSR_INAK));
+    TEST_ASSERT_EQUAL(FAILURE, can_send(&can, &frame));
+    TEST_ASSERT_EQUAL(0, can_sim_receive(&can, &frame, 1));
+    TEST_ASSERT_EQUAL(0, can_tx_pending(&can));
+    TEST_ASSERT_EQUAL(SUCCESS, can_receive(&can, &frame)); /* received frames stay readable */
+    TEST_ASSERT_EQUAL(SUCCESS, can_init(&can, 1, &config));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_programs_timing_and_interrupts);
+    RUN_TEST(test_compile_packs_each_class_densely);
+    RUN_TEST(test_compile_shares_left_over_slots);
+    RUN_TEST(test_compile_drops_covered_entries);
+    RUN_TEST(test_compile_rejects_invalid_or_oversized_lists);
+    RUN_TEST(test_filters_pass_only_wanted_frames);
+    RUN_TEST(test_interrupt_drains_the_whole_fifo);
+    RUN_TEST(test_full_queue_drops_and_counts);
+    RUN_TEST(test_urgent_frame_preempts_a_mailbox);
+    RUN_TEST(test_same_identifier_frames_keep_their_order);
+    RUN_TEST(test_arbitration_order_of_mixed_frames);
+    RUN_TEST(test_send_rejects_invalid_frames_and_a_full_queue);
+    RUN_TEST(test_loopback_receives_its_own_frames);
+    RUN_TEST(test_error_state_changes_are_counted);
+    RUN_TEST(test_set_filters_replaces_only_this_instance);
+    RUN_TEST(test_deinit_stops_the_controller);
+    return UNITY_END();
+}
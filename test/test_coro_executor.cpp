@@ -0,0 +1,184 @@
+#include "../lib/Unity/src/unity.h"
+
+/* Enough frames for thousands of concurrent flows on the host */
+#define CORO_FRAME_COUNT 4096
+#include "../lib/coro_executor/coro_executor.hpp"
+
+static uint32_t trace[16];
+static uint32_t trace_length;
+
+static void record(uint32_t value)
+{
+    if (trace_length < 16) {
+        trace[trace_length] = value;
+    }
+    trace_length++;
+}
+
+void setUp(void)
+{
+    trace_length = 0;
+}
+
+void tearDown(void)
+{
+    TEST_ASSERT_EQUAL(0, coro::frame_pool::instance().used());
+}
+
+static coro::task sleeper(uint32_t id, uint32_t ticks)
+{
+    co_await coro::delay { ticks };
+    record(id);
+}
+
+void test_delays_wake_in_deadline_order(void)
+{
+    coro::executor executor;
+    TEST_ASSERT_TRUE(executor.spawn(sleeper(1, 30)));
+    TEST_ASSERT_TRUE(executor.spawn(sleeper(2, 10)));
+    TEST_ASSERT_TRUE(executor.spawn(sleeper(3, 20)));
+
+    TEST_ASSERT_EQUAL(3, executor.run_once(0));
+    TEST_ASSERT_EQUAL(10, executor.next_deadline());
+    TEST_ASSERT_EQUAL(0, executor.run_once(9));
+    TEST_ASSERT_EQUAL(1, executor.run_once(10));
+    TEST_ASSERT_EQUAL(2, executor.run_once(40));
+
+    TEST_ASSERT_EQUAL(3, trace_length);
+    TEST_ASSERT_EQUAL(2, trace[0]);
+    TEST_ASSERT_EQUAL(3, trace[1]);
+    TEST_ASSERT_EQUAL(1, trace[2]);
+    TEST_ASSERT_EQUAL(0, executor.live_tasks());
+}
+
+static coro::task waiter(coro::event& irq, uint32_t id)
+{
+    co_await irq;
+    record(id);
+}
+
+void test_event_wakes_waiters_and_latches(void)
+{
+    coro::executor executor;
+    coro::event irq;
+
+    executor.spawn(waiter(irq, 1));
+    executor.spawn(waiter(irq, 2));
+    executor.run_once(0);
+    TEST_ASSERT_EQUAL(0, trace_length);
+
+    /* As if called from the interrupt handler */
+    irq.set();
+    TEST_ASSERT_EQUAL(2, executor.run_once(1));
+    TEST_ASSERT_EQUAL(2, trace_length);
+
+    /* Set with nobody waiting: the next waiter passes straight through */
+    irq.set();
+    executor.spawn(waiter(irq, 3));
+    executor.run_once(2);
+    TEST_ASSERT_EQUAL(3, trace_length);
+    TEST_ASSERT_EQUAL(3, trace[2]);
+}
+
+static coro::task consumer(coro::channel<uint32_t, 4>& queue, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t item = co_await queue.receive();
+        record(item);
+    }
+}
+
+void test_channel_hands_over_and_buffers(void)
+{
+    coro::executor executor;
+    coro::channel<uint32_t, 4> queue;
+
+    executor.spawn(consumer(queue, 3));
+    executor.run_once(0);
+
+    /* Receiver is waiting: direct hand-off, nothing buffered */
+    TEST_ASSERT_TRUE(queue.send(7));
+    TEST_ASSERT_EQUAL(0, queue.size());
+    TEST_ASSERT_TRUE(queue.send(8));
+    TEST_ASSERT_TRUE(queue.send(9));
+    TEST_ASSERT_EQUAL(2, queue.size());
+
+    executor.run_once(1);
+    TEST_ASSERT_EQUAL(3, trace_length);
+    TEST_ASSERT_EQUAL(7, trace[0]);
+    TEST_ASSERT_EQUAL(8, trace[1]);
+    TEST_ASSERT_EQUAL(9, trace[2]);
+}
+
+static coro::task yielder(uint32_t id)
+{
+    record(id);
+    co_await coro::yield {};
+    record(id + 10);
+}
+
+void test_yield_runs_on_next_pass(void)
+{
+    coro::executor executor;
+    executor.spawn(yielder(1));
+    executor.spawn(yielder(2));
+
+    TEST_ASSERT_EQUAL(2, executor.run_once(0));
+    TEST_ASSERT_EQUAL(2, trace_length);
+    TEST_ASSERT_EQUAL(2, executor.run_once(0));
+    TEST_ASSERT_EQUAL(11, trace[2]);
+    TEST_ASSERT_EQUAL(12, trace[3]);
+}
+
+static uint32_t flows_done;
+
+static coro::task flow(uint32_t id)
+{
+    co_await coro::delay { 1 + (id % 7) };
+    co_await coro::yield {};
+    flows_done++;
+}
+
+void test_thousands_of_flows_and_pool_exhaustion(void)
+{
+    coro::executor executor;
+    flows_done = 0;
+
+    for (uint32_t i = 0; i < CORO_FRAME_COUNT; i++) {
+        TEST_ASSERT_TRUE(executor.spawn(flow(i)));
+    }
+    TEST_ASSERT_EQUAL(CORO_FRAME_COUNT, executor.live_tasks());
+
+    /* Pool is full: creation fails cleanly instead of allocating */
+    std::size_t failed = coro::frame_pool::instance().failed();
+    TEST_ASSERT_FALSE(executor.spawn(flow(0)));
+    TEST_ASSERT_EQUAL(failed + 1, coro::frame_pool::instance().failed());
+
+    for (uint32_t tick = 0; tick < 16; tick++) {
+        executor.run_once(tick);
+    }
+    TEST_ASSERT_EQUAL(CORO_FRAME_COUNT, flows_done);
+    TEST_ASSERT_EQUAL(0, executor.live_tasks());
+}
+
+void test_unspawned_task_releases_frame(void)
+{
+    {
+        coro::task pending = sleeper(1, 1);
+        TEST_ASSERT_TRUE(pending);
+        TEST_ASSERT_EQUAL(1, coro::frame_pool::instance().used());
+    }
+    TEST_ASSERT_EQUAL(0, coro::frame_pool::instance().used());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_delays_wake_in_deadline_order);
+    RUN_TEST(test_event_wakes_waiters_and_latches);
+    RUN_TEST(test_channel_hands_over_and_buffers);
+    RUN_TEST(test_yield_runs_on_next_pass);
+    RUN_TEST(test_thousands_of_flows_and_pool_exhaustion);
+    RUN_TEST(test_unspawned_task_releases_frame);
+    return UNITY_END();
+}
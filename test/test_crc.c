@@ -0,0 +1,225 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/crc/crc.h"
+#include "../lib/feature_hooks/feature_hooks.h"
+#include <string.h>
+
+/*
+ * The tables, the unit model and background DMA runs are all checked
+ * against a bit-at-a-time reference of the unit's CRC, over every offset
+ * and every tail length.
+ */
+
+#define LONG_WORDS 70000U   /* More than one DMA transfer */
+#define LONG_BYTES (LONG_WORDS * 4U + 3U)
+
+static uint8_t data[LONG_BYTES + 8U] __attribute__((aligned(4)));
+static uint32_t result;
+static uint32_t results;
+
+static uint32_t reference(uint32_t crc, const uint8_t* p, size_t length)
+{
+    for (size_t i = 0; i < length; i += 4) {
+        uint32_t word = 0;
+        for (size_t b = 0; b < 4U && i + b < length; b++) {
+            word |= (uint32_t)p[i + b] << (8U * b);
+        }
+        crc ^= word;
+        for (uint32_t bit = 0; bit < 32U; bit++) {
+            crc = (crc & 0x80000000U) ? (crc << 1) ^ 0x04C11DB7U : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void on_result(uint32_t crc, void* context)
+{
+    (void)context;
+    result = crc;
+    results++;
+}
+
+/* Raises a transfer error on the CRC's stream and runs its vector */
+static void raise_dma_error(void)
+{
+    dma_sim_regs[1].HISR = DMA_FLAG_TE;
+    dma_sim_regs[1].S[CRC_DMA_STREAM].CR &= ~DMA_SxCR_EN;
+    dma_stream_irq(CRC_DMA_CONTROLLER, CRC_DMA_STREAM);
+    dma_sim_regs[1].HISR = 0;
+}
+
+void setUp(void)
+{
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1664525U + 1013904223U;
+        data[i] = (uint8_t)(seed >> 24);
+    }
+    result = 0;
+    results = 0;
+    TEST_ASSERT_EQUAL(SUCCESS, crc_init());
+}
+
+void tearDown(void)
+{
+}
+
+void test_check_values(void)
+{
+    static const uint8_t word[4] = { 0x78, 0x56, 0x34, 0x12 };
+    TEST_ASSERT_EQUAL_HEX32(0xDF8A8A2BU, crc32(word, 4));
+    TEST_ASSERT_EQUAL_HEX32(0xAFF19057U, crc32("123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(CRC32_INIT, crc32(word, 0));
+    TEST_ASSERT_EQUAL_HEX32(0xDF8A8A2BU, crc32_hw_update(CRC32_INIT, word, 4));
+    TEST_ASSERT_EQUAL_HEX32(0xAFF19057U, crc32_hw_update(CRC32_INIT, "123456789", 9));
+}
+
+void test_tables_match_the_reference_at_every_offset_and_tail(void)
+{
+    for (uint32_t offset = 0; offset < 8U; offset++) {
+        for (uint32_t length = 0; length <= 40U; length++) {
+            TEST_ASSERT_EQUAL_HEX32(reference(CRC32_INIT, data + offset, length),
+                                    crc32_sw_update(CRC32_INIT, data + offset, length));
+        }
+    }
+    TEST_ASSERT_EQUAL_HEX32(reference(CRC32_INIT, data + 1, 4099), crc32_sw_update(CRC32_INIT, data + 1, 4099));
+}
+
+void test_unit_matches_the_tables_at_every_offset_and_tail(void)
+{
+    for (uint32_t offset = 0; offset < 8U; offset++) {
+        for (uint32_t length = 0; length <= 40U; length++) {
+            TEST_ASSERT_EQUAL_HEX32(crc32_sw_update(CRC32_INIT, data + offset, length),
+                                    crc32_hw_update(CRC32_INIT, data + offset, length));
+        }
+    }
+    TEST_ASSERT_EQUAL_HEX32(crc32_sw_update(CRC32_INIT, data + 3, 4099), crc32_hw_update(CRC32_INIT, data + 3, 4099));
+}
+
+void test_results_chain_over_whole_words(void)
+{
+    uint32_t whole = reference(CRC32_INIT, data, 103);
+    TEST_ASSERT_EQUAL_HEX32(whole, crc32_sw_update(crc32_sw_update(CRC32_INIT, data, 60), data + 60, 43));
+    /* The unit starts from CRC32_INIT, so continuing writes a preset word first */
+    TEST_ASSERT_EQUAL_HEX32(whole, crc32_hw_update(crc32_hw_update(CRC32_INIT, data, 60), data + 60, 43));
+    TEST_ASSERT_EQUAL_HEX32(whole, crc32_hw_update(crc32_sw_update(CRC32_INIT, data, 4), data + 4, 99));
+
+    static const uint32_t starts[] = { 0, 1, 0x80000000U, 0x12345678U, 0xFFFFFFFEU };
+    for (uint32_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+        TEST_ASSERT_EQUAL_HEX32(reference(starts[i], data, 17), crc32_hw_update(starts[i], data, 17));
+    }
+}
+
+void test_unit_registers(void)
+{
+    hal_reg_trace_reset();
+    crc32_hw_update(CRC32_INIT, data, 8);
+    TEST_ASSERT_EQUAL(3, hal_reg_trace_count);
+    TEST_ASSERT_EQUAL_PTR(&crc_sim_regs.CR, hal_reg_trace[0].reg);
+    TEST_ASSERT_EQUAL_HEX32(CRC_CR_RESET, hal_reg_trace[0].value);
+    TEST_ASSERT_EQUAL_PTR(&crc_sim_regs.DR, hal_reg_trace[1].reg);
+    TEST_ASSERT_EQUAL_HEX32((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 |
+                                (uint32_t)data[3] << 24,
+                            hal_reg_trace[1].value);
+    TEST_ASSERT_TRUE(hal_sim_rcc.AHB1ENR & (1U << 12));
+}
+
+void test_background_crc_by_dma(void)
+{
+    crc_stats_t before = *crc_get_stats();
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(CRC32_INIT, data, LONG_BYTES, on_result, NULL));
+    TEST_ASSERT_EQUAL(1, results);
+    TEST_ASSERT_EQUAL_HEX32(crc32_sw_update(CRC32_INIT, data, LONG_BYTES), result);
+
+    /* Memory to memory from the data into DR, in two transfers */
+    uint32_t cr = dma_sim_regs[1].S[CRC_DMA_STREAM].CR;
+    TEST_ASSERT_EQUAL_HEX32(2U << DMA_SxCR_DIR_Pos, cr & (3U << DMA_SxCR_DIR_Pos));
+    TEST_ASSERT_TRUE(cr & DMA_SxCR_PINC);
+    TEST_ASSERT_FALSE(cr & DMA_SxCR_MINC);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(LONG_WORDS * 4U, crc_get_stats()->dma_bytes - before.dma_bytes);
+    TEST_ASSERT_EQUAL(LONG_BYTES, crc_get_stats()->hardware_bytes - before.hardware_bytes);
+#else
+    (void)before;
+#endif
+
+    /* And from a CRC to continue */
+    uint32_t start = crc32_sw_update(CRC32_INIT, data, 64);
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(start, data + 64, 4096, on_result, NULL));
+    TEST_ASSERT_EQUAL_HEX32(crc32_sw_update(CRC32_INIT, data, 64 + 4096), result);
+}
+
+void test_short_background_crc_runs_at_once(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(CRC32_INIT, data + 1, CRC_DMA_MIN_BYTES - 1U, on_result, NULL));
+    TEST_ASSERT_EQUAL(1, results);
+    TEST_ASSERT_EQUAL_HEX32(crc32_sw_update(CRC32_INIT, data + 1, CRC_DMA_MIN_BYTES - 1U), result);
+}
+
+void test_background_crc_rejects_what_dma_cannot_read(void)
+{
+    TEST_ASSERT_EQUAL(FAILURE, crc32_hw_start(CRC32_INIT, data + 2, CRC_DMA_MIN_BYTES, on_result, NULL));
+    TEST_ASSERT_EQUAL(FAILURE, crc32_hw_start(CRC32_INIT, data, CRC_DMA_MIN_BYTES, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, results);
+    /* Nothing was left claimed */
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(CRC32_INIT, data, CRC_DMA_MIN_BYTES, on_result, NULL));
+    TEST_ASSERT_EQUAL(1, results);
+}
+
+void test_unit_in_use_falls_back_to_the_tables(void)
+{
+    crc_stats_t before = *crc_get_stats();
+    crc_sim_dma_hold(100);
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(CRC32_INIT, data, 8192, on_result, NULL));
+    TEST_ASSERT_EQUAL(0, results);
+
+    /* As from an interrupt while the DMA runs */
+    TEST_ASSERT_EQUAL_HEX32(reference(CRC32_INIT, data + 5, 33), crc32_hw_update(CRC32_INIT, data + 5, 33));
+    TEST_ASSERT_EQUAL(FAILURE, crc32_hw_start(CRC32_INIT, data, 8192, on_result, NULL));
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, crc_get_stats()->busy_fallbacks - before.busy_fallbacks);
+#else
+    (void)before;
+#endif
+
+    crc_sim_dma_resume();
+    TEST_ASSERT_EQUAL(1, results);
+    TEST_ASSERT_EQUAL_HEX32(reference(CRC32_INIT, data, 8192), result);
+}
+
+void test_dma_error_finishes_with_the_tables(void)
+{
+    crc_stats_t before = *crc_get_stats();
+    crc_sim_dma_hold(10);
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(CRC32_INIT, data, 4096 + 2, on_result, NULL));
+    raise_dma_error();
+    TEST_ASSERT_EQUAL(1, results);
+    TEST_ASSERT_EQUAL_HEX32(reference(CRC32_INIT, data, 4096 + 2), result);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, crc_get_stats()->dma_errors - before.dma_errors);
+#else
+    (void)before;
+#endif
+    crc_sim_dma_resume();
+    TEST_ASSERT_EQUAL(1, results);
+
+    /* The unit is free again */
+    TEST_ASSERT_EQUAL(SUCCESS, crc32_hw_start(CRC32_INIT, data, 4096, on_result, NULL));
+    TEST_ASSERT_EQUAL(2, results);
+    TEST_ASSERT_EQUAL_HEX32(reference(CRC32_INIT, data, 4096), result);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_check_values);
+    RUN_TEST(test_tables_match_the_reference_at_every_offset_and_tail);
+    RUN_TEST(test_unit_matches_the_tables_at_every_offset_and_tail);
+    RUN_TEST(test_results_chain_over_whole_words);
+    RUN_TEST(test_unit_registers);
+    RUN_TEST(test_background_crc_by_dma);
+    RUN_TEST(test_short_background_crc_runs_at_once);
+    RUN_TEST(test_background_crc_rejects_what_dma_cannot_read);
+    RUN_TEST(test_unit_in_use_falls_back_to_the_tables);
+    RUN_TEST(test_dma_error_finishes_with_the_tables);
+    return UNITY_END();
+}
@@ -0,0 +1,683 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/crypto/cryp.h"
+#include "../lib/crypto/hash.h"
+#include "../lib/feature_hooks/feature_hooks.h"
+#include <string.h>
+
+/*
+ * Known answers from FIPS-197, SP 800-38A, the GCM specification's test
+ * cases, FIPS 180-2 and RFCs 2202 and 4231, each through the software, the
+ * core from the CPU and, where long enough, the DMA path; long messages
+ * through the core by DMA against the software.
+ */
+
+#define LONG_BYTES (65532U * 4U + 1000U)   /* More than one DMA transfer, and a partial block */
+
+static uint8_t data[LONG_BYTES + 16U] __attribute__((aligned(4)));
+static uint8_t out[LONG_BYTES + 16U] __attribute__((aligned(4)));
+static uint8_t expected[LONG_BYTES + 16U] __attribute__((aligned(4)));
+static status_t job_status;
+static uint32_t jobs_done;
+static uint32_t hashes_done;
+static uint8_t* hashed;
+
+static size_t hex(const char* text, uint8_t* bytes)
+{
+    size_t n = strlen(text) / 2U;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t byte = 0;
+        for (size_t j = 0; j < 2U; j++) {
+            char c = text[2U * i + j];
+            byte = (uint8_t)(byte << 4) | (uint8_t)((c <= '9') ? c - '0' : c - 'a' + 10);
+        }
+        bytes[i] = byte;
+    }
+    return n;
+}
+
+static void on_job(status_t status, void* context)
+{
+    (void)context;
+    job_status = status;
+    jobs_done++;
+}
+
+static void on_hash(uint8_t* digest, void* context)
+{
+    (void)context;
+    hashed = digest;
+    hashes_done++;
+}
+
+/* Raises a transfer error on a DMA2 stream from 4 up and runs its vector */
+static void raise_dma_error(uint8_t stream)
+{
+    static const uint8_t shift[4] = { 0, 6, 16, 22 };
+    dma_sim_regs[1].HISR = DMA_FLAG_TE << shift[stream - 4U];
+    dma_sim_regs[1].S[stream].CR &= ~DMA_SxCR_EN;
+    dma_stream_irq(2, stream);
+    dma_sim_regs[1].HISR = 0;
+}
+
+void setUp(void)
+{
+    uint32_t seed = 11;
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1664525U + 1013904223U;
+        data[i] = (uint8_t)(seed >> 24);
+    }
+    job_status = FAILURE;
+    jobs_done = 0;
+    hashes_done = 0;
+    hashed = NULL;
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_init());
+    TEST_ASSERT_EQUAL(SUCCESS, hash_init());
+}
+
+void tearDown(void)
+{
+}
+
+void test_aes_block_known_answers(void)
+{
+    static const char* const ciphertexts[3] = {
+        "69c4e0d86a7b0430d8cdb78070b4c55a",
+        "dda97ca4864cdfe06eaf70a0ec0d7191",
+        "8ea2b7ca516745bfeafc49904b496089",
+    };
+    uint8_t key_bytes[32];
+    uint8_t plain[16];
+    uint8_t cipher[16];
+    uint8_t block[16];
+    aes_key_t key;
+    hex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f", key_bytes);
+    hex("00112233445566778899aabbccddeeff", plain);
+
+    for (uint32_t i = 0; i < 3U; i++) {
+        TEST_ASSERT_EQUAL(SUCCESS, aes_set_key(&key, key_bytes, 16U + 8U * i));
+        TEST_ASSERT_EQUAL(10 + 2 * i, key.rounds);
+        hex(ciphertexts[i], cipher);
+        aes_encrypt_block(&key, plain, block);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(cipher, block, 16);
+        aes_decrypt_block(&key, cipher, block);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(plain, block, 16);
+    }
+    TEST_ASSERT_EQUAL(FAILURE, aes_set_key(&key, key_bytes, 20));
+}
+
+/* SP 800-38A F.2.1, F.2.5 and F.5.1 */
+void test_cbc_and_ctr_known_answers(void)
+{
+    static const char* const plain_text = "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                                          "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+    static const struct {
+        cryp_mode_t mode;
+        const char* key;
+        const char* iv;
+        const char* cipher;
+    } vectors[] = {
+        { CRYP_CBC, "2b7e151628aed2a6abf7158809cf4f3c", "000102030405060708090a0b0c0d0e0f",
+          "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+          "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7" },
+        { CRYP_CBC, "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+          "000102030405060708090a0b0c0d0e0f",
+          "f58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d"
+          "39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b" },
+        { CRYP_CTR, "2b7e151628aed2a6abf7158809cf4f3c", "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff",
+          "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+          "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee" },
+    };
+    uint8_t key[32];
+    uint8_t iv[16];
+    uint8_t plain[64];
+    uint8_t cipher[64];
+    uint8_t result[64];
+    hex(plain_text, plain);
+
+    for (uint32_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        cryp_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.mode = vectors[v].mode;
+        job.key = key;
+        job.key_length = hex(vectors[v].key, key);
+        job.iv = iv;
+        job.length = hex(vectors[v].cipher, cipher);
+
+        for (uint32_t decrypt = 0; decrypt < 2U; decrypt++) {
+            job.decrypt = (uint8_t)decrypt;
+            job.in = decrypt ? cipher : plain;
+            job.out = result;
+            const uint8_t* answer = decrypt ? plain : cipher;
+
+            /* The core from the CPU, the core in the background, the software */
+            hex(vectors[v].iv, iv);
+            TEST_ASSERT_EQUAL(SUCCESS, cryp_run(&job));
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, result, 64);
+
+            hex(vectors[v].iv, iv);
+            memset(result, 0, sizeof(result));
+            jobs_done = 0;
+            TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+            TEST_ASSERT_EQUAL(1, jobs_done);
+            TEST_ASSERT_EQUAL(SUCCESS, job_status);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, result, 64);
+
+            aes_key_t sw;
+            aes_set_key(&sw, key, job.key_length);
+            hex(vectors[v].iv, iv);
+            if (job.mode == CRYP_CTR) {
+                aes_ctr(&sw, iv, job.in, result, 64);
+            } else if (decrypt) {
+                aes_cbc_decrypt(&sw, iv, job.in, result, 64);
+            } else {
+                aes_cbc_encrypt(&sw, iv, job.in, result, 64);
+            }
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, result, 64);
+        }
+    }
+}
+
+/* Test cases 1-4 and 16 of the GCM specification */
+void test_gcm_known_answers(void)
+{
+    static const char* const plain_text = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+                                          "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255";
+    static const struct {
+        const char* key;
+        const char* iv;
+        const char* aad;
+        size_t length;
+        const char* cipher;
+        const char* tag;
+    } vectors[] = {
+        { "00000000000000000000000000000000", "000000000000000000000000", "", 0, "",
+          "58e2fccefa7e3061367f1d57a4e7455a" },
+        { "00000000000000000000000000000000", "000000000000000000000000", "", 16,
+          "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf" },
+        { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "", 64,
+          "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+          "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+          "4d5c2af327cd64a62cf35abd2ba6fab4" },
+        { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+          60,
+          "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+          "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+          "5bc94fbc3221a5db94fae95ae7121a47" },
+        { "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+          "feedfacedeadbeeffeedfacedeadbeefabaddad2", 60,
+          "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+          "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+          "76fc6ece0f4e1768cddf8853bb2d551b" },
+    };
+    uint8_t key[32];
+    uint8_t iv[16];
+    uint8_t aad[20];
+    uint8_t plain[64];
+    uint8_t cipher[64];
+    uint8_t tag[16];
+    uint8_t answer_tag[16];
+    uint8_t result[64];
+
+    for (uint32_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        memset(plain, 0, sizeof(plain));
+        if (v >= 2U) {
+            hex(plain_text, plain);
+        }
+        cryp_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.mode = CRYP_GCM;
+        job.key = key;
+        job.key_length = hex(vectors[v].key, key);
+        job.iv = iv;
+        hex(vectors[v].iv, iv);
+        job.aad = aad;
+        job.aad_length = hex(vectors[v].aad, aad);
+        job.length = vectors[v].length;
+        job.tag = tag;
+        hex(vectors[v].cipher, cipher);
+        hex(vectors[v].tag, answer_tag);
+
+        job.in = plain;
+        job.out = result;
+        TEST_ASSERT_EQUAL(SUCCESS, cryp_run(&job));
+        if (job.length > 0U) {
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(cipher, result, job.length);
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(answer_tag, tag, 16);
+
+        job.decrypt = 1;
+        job.in = cipher;
+        memset(result, 0, sizeof(result));
+        jobs_done = 0;
+        TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+        TEST_ASSERT_EQUAL(1, jobs_done);
+        TEST_ASSERT_EQUAL(SUCCESS, job_status);
+        if (job.length > 0U) {
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(plain, result, job.length);
+        }
+
+        /* A changed tag is caught and the plaintext withheld */
+        tag[15] ^= 1;
+        TEST_ASSERT_EQUAL(FAILURE, cryp_run(&job));
+        for (size_t i = 0; i < job.length; i++) {
+            TEST_ASSERT_EQUAL_HEX8(0, result[i]);
+        }
+
+        aes_key_t sw;
+        aes_set_key(&sw, key, job.key_length);
+        aes_gcm_encrypt(&sw, iv, aad, job.aad_length, plain, result, job.length, tag);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(answer_tag, tag, 16);
+        TEST_ASSERT_EQUAL(SUCCESS, aes_gcm_decrypt(&sw, iv, aad, job.aad_length, cipher, result, job.length, tag));
+    }
+}
+
+/* FIPS 180-2 examples, the long one in uneven pieces */
+void test_sha_known_answers(void)
+{
+    static const char* const two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    uint8_t digest[32];
+    uint8_t answer[32];
+
+    hash_run(SHA_1, NULL, 0, "abc", 3, digest);
+    hex("a9993e364706816aba3e25717850c26c9cd0d89d", answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 20);
+    hash_run(SHA_1, NULL, 0, two_blocks, strlen(two_blocks), digest);
+    hex("84983e441c3bd26ebaae4aa1f95129e5e54670f1", answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 20);
+
+    hash_run(SHA_256, NULL, 0, "abc", 3, digest);
+    hex("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+    sha_digest(SHA_256, "abc", 3, digest);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+    hash_run(SHA_256, NULL, 0, two_blocks, strlen(two_blocks), digest);
+    hex("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+    hash_run(SHA_256, NULL, 0, "", 0, digest);
+    hex("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+
+    memset(out, 'a', 1000);
+    static const char* const million[2] = {
+        "34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+    };
+    for (uint32_t algo = 0; algo < 2U; algo++) {
+        sha_ctx_t ctx;
+        sha_init(&ctx, (sha_algo_t)algo);
+        for (size_t done = 0, piece = 1; done < 1000000U; done += piece, piece = piece * 3U % 1000U + 1U) {
+            if (piece > 1000000U - done) {
+                piece = 1000000U - done;
+            }
+            sha_update(&ctx, out, piece);
+        }
+        sha_final(&ctx, digest);
+        size_t size = hex(million[algo], answer);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, size);
+    }
+}
+
+/* RFC 2202 cases 1 and 6, RFC 4231 cases 1, 2 and 6 */
+void test_hmac_known_answers(void)
+{
+    static const char* const long_key_data = "Test Using Larger Than Block-Size Key - Hash Key First";
+    static const struct {
+        sha_algo_t algo;
+        uint8_t key_byte;
+        size_t key_length;
+        const char* message;
+        const char* mac;
+    } vectors[] = {
+        { SHA_1, 0x0B, 20, "Hi There", "b617318655057264e28bc0b6fb378c8ef146be00" },
+        { SHA_1, 0xAA, 80, NULL, "aa4ae5e15272d00e95705637ce8a3b55ed402112" },
+        { SHA_256, 0x0B, 20, "Hi There", "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" },
+        { SHA_256, 0, 4, "what do ya want for nothing?",
+          "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" },
+        { SHA_256, 0xAA, 131, NULL, "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" },
+    };
+    uint8_t key[131];
+    uint8_t mac[32];
+    uint8_t answer[32];
+
+    for (uint32_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        if (vectors[v].key_byte != 0U) {
+            memset(key, vectors[v].key_byte, vectors[v].key_length);
+        } else {
+            memcpy(key, "Jefe", 4);
+        }
+        const char* message = (vectors[v].message != NULL) ? vectors[v].message : long_key_data;
+        size_t size = hex(vectors[v].mac, answer);
+
+        hash_run(vectors[v].algo, key, vectors[v].key_length, message, strlen(message), mac);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, mac, size);
+        memset(mac, 0, sizeof(mac));
+        hmac(vectors[v].algo, key, vectors[v].key_length, message, strlen(message), mac);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, mac, size);
+        memset(mac, 0, sizeof(mac));
+        hashes_done = 0;
+        TEST_ASSERT_EQUAL(SUCCESS, hash_start(vectors[v].algo, key, vectors[v].key_length, message, strlen(message),
+                                              mac, on_hash, NULL));
+        TEST_ASSERT_EQUAL(1, hashes_done);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, mac, size);
+    }
+}
+
+void test_cryp_registers(void)
+{
+    uint8_t key[24];
+    uint8_t iv[16];
+    memset(key, 0, sizeof(key));
+    key[0] = 0x01;
+    key[23] = 0x02;
+    memset(iv, 0, sizeof(iv));
+    iv[15] = 0x03;
+    cryp_job_t job = { CRYP_CTR, 0, key, sizeof(key), iv, NULL, 0, data, out, 16, NULL };
+
+    hal_reg_trace_reset();
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_run(&job));
+    /* A 192-bit key from K1LR, big-endian words; the IV likewise */
+    TEST_ASSERT_EQUAL_HEX32(0x01000000U, cryp_sim_regs.K[2]);
+    TEST_ASSERT_EQUAL_HEX32(0x00000002U, cryp_sim_regs.K[7]);
+    TEST_ASSERT_EQUAL_HEX32(0x00000003U, cryp_sim_regs.IV[3]);
+    uint32_t cr = 0;
+    for (uint32_t i = 0; i < hal_reg_trace_count; i++) {
+        if (hal_reg_trace[i].reg == &cryp_sim_regs.CR && (hal_reg_trace[i].value & CRYP_CR_CRYPEN)) {
+            cr = hal_reg_trace[i].value;
+        }
+    }
+    TEST_ASSERT_EQUAL_HEX32(CRYP_CR_ALGOMODE_AES_CTR | CRYP_CR_DATATYPE_BYTE | (1U << CRYP_CR_KEYSIZE_Pos) |
+                                CRYP_CR_CRYPEN,
+                            cr);
+    TEST_ASSERT_EQUAL_HEX32(0, cryp_sim_regs.CR);
+    TEST_ASSERT_EQUAL_HEX8(4, iv[15]);
+    TEST_ASSERT_TRUE(hal_sim_rcc.AHB2ENR & (1U << 4));
+    TEST_ASSERT_TRUE(hal_sim_rcc.AHB2ENR & (1U << 5));
+
+}
+
+static void check_long_job(cryp_mode_t mode, uint8_t decrypt, size_t length, const uint8_t* in, uint8_t* result)
+{
+    static const uint8_t key[32] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                                     17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32 };
+    uint8_t iv[16];
+    uint8_t iv_sw[16];
+    uint8_t tag[16];
+    uint8_t tag_sw[16];
+    aes_key_t sw;
+    aes_set_key(&sw, key, sizeof(key));
+    memset(iv, 0xA5, sizeof(iv));
+    memcpy(iv_sw, iv, sizeof(iv));
+
+    if (mode == CRYP_CBC) {
+        if (decrypt) {
+            aes_cbc_decrypt(&sw, iv_sw, in, expected, length);
+        } else {
+            aes_cbc_encrypt(&sw, iv_sw, in, expected, length);
+        }
+    } else if (mode == CRYP_CTR) {
+        aes_ctr(&sw, iv_sw, in, expected, length);
+    } else {
+        aes_gcm_encrypt(&sw, iv_sw, data, 20, in, expected, length, tag_sw);
+        if (decrypt) {
+            /* Open what the software sealed */
+            memcpy(out, expected, length);
+            memcpy(expected, in, length);
+            in = out;
+            memcpy(tag, tag_sw, sizeof(tag));
+        }
+    }
+
+    cryp_job_t job = { mode, decrypt, key, sizeof(key), iv, data, 20, in, result, length, tag };
+    jobs_done = 0;
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+    TEST_ASSERT_EQUAL(1, jobs_done);
+    TEST_ASSERT_EQUAL(SUCCESS, job_status);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, result, length);
+    if (mode == CRYP_GCM) {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(tag_sw, tag, 16);
+    } else {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(iv_sw, iv, 16);
+    }
+}
+
+void test_cryp_dma_across_transfers(void)
+{
+    cryp_stats_t before = *cryp_get_stats();
+    size_t whole = LONG_BYTES - LONG_BYTES % 16U;
+    check_long_job(CRYP_CBC, 0, whole, data, out);
+    check_long_job(CRYP_CBC, 1, whole, data, out);
+    check_long_job(CRYP_CTR, 0, LONG_BYTES, data, out);
+    check_long_job(CRYP_GCM, 0, whole, data, out);
+    check_long_job(CRYP_GCM, 1, LONG_BYTES, data, out);
+
+    /* Memory into DIN and DOUT into memory, both on channel 2 */
+    uint32_t in_cr = dma_sim_regs[1].S[CRYP_DMA_IN_STREAM].CR;
+    uint32_t out_cr = dma_sim_regs[1].S[CRYP_DMA_OUT_STREAM].CR;
+    TEST_ASSERT_EQUAL_HEX32(1U << DMA_SxCR_DIR_Pos, in_cr & (3U << DMA_SxCR_DIR_Pos));
+    TEST_ASSERT_EQUAL_HEX32(0, out_cr & (3U << DMA_SxCR_DIR_Pos));
+    TEST_ASSERT_EQUAL_HEX32(2U << DMA_SxCR_CHSEL_Pos, in_cr & (7U << DMA_SxCR_CHSEL_Pos));
+    TEST_ASSERT_EQUAL_HEX32(2U << DMA_SxCR_CHSEL_Pos, out_cr & (7U << DMA_SxCR_CHSEL_Pos));
+#if BUILD_CFG_FEATURE_STATS
+    const cryp_stats_t* stats = cryp_get_stats();
+    TEST_ASSERT_EQUAL(3 * whole + 2 * LONG_BYTES, stats->hardware_bytes - before.hardware_bytes);
+    TEST_ASSERT_EQUAL(5 * whole, stats->dma_bytes - before.dma_bytes);
+    TEST_ASSERT_EQUAL(0, stats->software_bytes - before.software_bytes);
+#else
+    (void)before;
+#endif
+}
+
+void test_cryp_in_place_and_chained(void)
+{
+    static const uint8_t key[16] = { 0 };
+    uint8_t iv[16];
+    uint8_t iv_sw[16];
+    aes_key_t sw;
+    aes_set_key(&sw, key, sizeof(key));
+    memset(iv, 0x5A, sizeof(iv));
+    memcpy(iv_sw, iv, sizeof(iv));
+    aes_cbc_encrypt(&sw, iv_sw, data, expected, 4096);
+
+    /* Two jobs continue one chain, the first from an unaligned buffer through the CPU */
+    memcpy(out + 1, data, 1024);
+    cryp_job_t job = { CRYP_CBC, 0, key, sizeof(key), iv, NULL, 0, out + 1, out + 1, 1024, NULL };
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out + 1, 1024);
+    memcpy(out, data + 1024, 3072);
+    job.in = out;
+    job.out = out;
+    job.length = 3072;
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+    TEST_ASSERT_EQUAL(2, jobs_done);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected + 1024, out, 3072);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(iv_sw, iv, 16);
+}
+
+void test_gcm_encryption_with_a_partial_block_avoids_the_core(void)
+{
+    cryp_stats_t before = *cryp_get_stats();
+    check_long_job(CRYP_GCM, 0, 1000 + 7, data, out);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, cryp_get_stats()->erratum_fallbacks - before.erratum_fallbacks);
+    TEST_ASSERT_EQUAL(1000 + 7, cryp_get_stats()->software_bytes - before.software_bytes);
+#else
+    (void)before;
+#endif
+}
+
+void test_cryp_in_use_falls_back_to_software(void)
+{
+    static const uint8_t key[16] = { 9 };
+    uint8_t iv[16] = { 0 };
+    uint8_t iv2[16] = { 0 };
+    uint8_t small[32];
+    cryp_stats_t before = *cryp_get_stats();
+    cryp_job_t job = { CRYP_CTR, 0, key, sizeof(key), iv, NULL, 0, data, out, 8192, NULL };
+    cryp_sim_dma_hold(100);
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+    TEST_ASSERT_EQUAL(0, jobs_done);
+
+    /* As from an interrupt while the DMA runs */
+    cryp_job_t other = { CRYP_CTR, 0, key, sizeof(key), iv2, NULL, 0, data, small, sizeof(small), NULL };
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_run(&other));
+    TEST_ASSERT_EQUAL(FAILURE, cryp_start(&other, on_job, NULL));
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, cryp_get_stats()->busy_fallbacks - before.busy_fallbacks);
+#else
+    (void)before;
+#endif
+
+    cryp_sim_dma_resume();
+    TEST_ASSERT_EQUAL(1, jobs_done);
+    TEST_ASSERT_EQUAL(SUCCESS, job_status);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(out, small, sizeof(small));
+    aes_key_t sw;
+    uint8_t counter[16] = { 0 };
+    aes_set_key(&sw, key, sizeof(key));
+    aes_ctr(&sw, counter, data, expected, 8192);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, 8192);
+}
+
+void test_cryp_dma_error_fails_the_job(void)
+{
+    static const uint8_t key[16] = { 3 };
+    uint8_t iv[16] = { 0 };
+    cryp_stats_t before = *cryp_get_stats();
+    cryp_job_t job = { CRYP_CBC, 0, key, sizeof(key), iv, NULL, 0, data, out, 4096, NULL };
+    cryp_sim_dma_hold(10);
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+    raise_dma_error(CRYP_DMA_IN_STREAM);
+    TEST_ASSERT_EQUAL(1, jobs_done);
+    TEST_ASSERT_EQUAL(FAILURE, job_status);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, cryp_get_stats()->dma_errors - before.dma_errors);
+#else
+    (void)before;
+#endif
+    cryp_sim_dma_resume();
+    TEST_ASSERT_EQUAL(1, jobs_done);
+
+    /* The core is free again */
+    TEST_ASSERT_EQUAL(SUCCESS, cryp_start(&job, on_job, NULL));
+    TEST_ASSERT_EQUAL(2, jobs_done);
+    TEST_ASSERT_EQUAL(SUCCESS, job_status);
+}
+
+void test_cryp_rejects_invalid_jobs(void)
+{
+    static const uint8_t key[16] = { 0 };
+    uint8_t iv[16] = { 0 };
+    cryp_job_t job = { CRYP_CBC, 0, key, 20, iv, NULL, 0, data, out, 32, NULL };
+    TEST_ASSERT_EQUAL(FAILURE, cryp_start(&job, on_job, NULL));
+    job.key_length = 16;
+    job.length = 33;
+    TEST_ASSERT_EQUAL(FAILURE, cryp_run(&job));
+    job.length = 32;
+    TEST_ASSERT_EQUAL(FAILURE, cryp_start(&job, NULL, NULL));
+    job.mode = CRYP_GCM;
+    TEST_ASSERT_EQUAL(FAILURE, cryp_run(&job));
+    TEST_ASSERT_EQUAL(0, jobs_done);
+}
+
+void test_hash_dma_across_transfers(void)
+{
+    static const uint8_t key[100] = { 7 };
+    uint8_t digest[32];
+    uint8_t answer[32];
+    hash_stats_t before = *hash_get_stats();
+
+    TEST_ASSERT_EQUAL(SUCCESS, hash_start(SHA_256, NULL, 0, data, LONG_BYTES + 3U, digest, on_hash, NULL));
+    TEST_ASSERT_EQUAL(1, hashes_done);
+    sha_digest(SHA_256, data, LONG_BYTES + 3U, answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+
+    TEST_ASSERT_EQUAL(SUCCESS, hash_start(SHA_1, key, sizeof(key), data, LONG_BYTES, digest, on_hash, NULL));
+    TEST_ASSERT_EQUAL(2, hashes_done);
+    hmac(SHA_1, key, sizeof(key), data, LONG_BYTES, answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 20);
+    TEST_ASSERT_EQUAL_HEX32(2U << DMA_SxCR_CHSEL_Pos,
+                            dma_sim_regs[1].S[HASH_DMA_STREAM].CR & (7U << DMA_SxCR_CHSEL_Pos));
+#if BUILD_CFG_FEATURE_STATS
+    const hash_stats_t* stats = hash_get_stats();
+    TEST_ASSERT_EQUAL(2 * LONG_BYTES + 3U, stats->hardware_bytes - before.hardware_bytes);
+    TEST_ASSERT_EQUAL(2 * (LONG_BYTES - LONG_BYTES % 4U), stats->dma_bytes - before.dma_bytes);
+    TEST_ASSERT_EQUAL(0, stats->software_bytes - before.software_bytes);
+#else
+    (void)before;
+#endif
+
+    /* Unaligned data goes through DIN from the CPU */
+    TEST_ASSERT_EQUAL(SUCCESS, hash_start(SHA_256, NULL, 0, data + 1, 4096, digest, on_hash, NULL));
+    sha_digest(SHA_256, data + 1, 4096, answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+}
+
+void test_hash_in_use_falls_back_to_software(void)
+{
+    uint8_t digest[32];
+    uint8_t other[32];
+    uint8_t answer[32];
+    hash_sim_dma_hold(100);
+    TEST_ASSERT_EQUAL(SUCCESS, hash_start(SHA_256, NULL, 0, data, 8192, digest, on_hash, NULL));
+    TEST_ASSERT_EQUAL(0, hashes_done);
+
+    hash_run(SHA_1, NULL, 0, "abc", 3, other);
+    hex("a9993e364706816aba3e25717850c26c9cd0d89d", answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, other, 20);
+    TEST_ASSERT_EQUAL(FAILURE, hash_start(SHA_1, NULL, 0, "abc", 3, other, on_hash, NULL));
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_TRUE(hash_get_stats()->busy_fallbacks > 0U);
+#endif
+
+    hash_sim_dma_resume();
+    TEST_ASSERT_EQUAL(1, hashes_done);
+    sha_digest(SHA_256, data, 8192, answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+}
+
+void test_hash_dma_error_finishes_in_software(void)
+{
+    static const uint8_t key[16] = { 1 };
+    uint8_t digest[32];
+    uint8_t answer[32];
+    hash_stats_t before = *hash_get_stats();
+    hash_sim_dma_hold(10);
+    TEST_ASSERT_EQUAL(SUCCESS, hash_start(SHA_256, key, sizeof(key), data, 4096 + 2, digest, on_hash, NULL));
+    raise_dma_error(HASH_DMA_STREAM);
+    TEST_ASSERT_EQUAL(1, hashes_done);
+    hmac(SHA_256, key, sizeof(key), data, 4096 + 2, answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, hash_get_stats()->dma_errors - before.dma_errors);
+#else
+    (void)before;
+#endif
+    hash_sim_dma_resume();
+    TEST_ASSERT_EQUAL(1, hashes_done);
+
+    TEST_ASSERT_EQUAL(SUCCESS, hash_start(SHA_256, NULL, 0, data, 4096, digest, on_hash, NULL));
+    TEST_ASSERT_EQUAL(2, hashes_done);
+    sha_digest(SHA_256, data, 4096, answer);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(answer, digest, 32);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_aes_block_known_answers);
+    RUN_TEST(test_cbc_and_ctr_known_answers);
+    RUN_TEST(test_gcm_known_answers);
+    RUN_TEST(test_sha_known_answers);
+    RUN_TEST(test_hmac_known_answers);
+    RUN_TEST(test_cryp_registers);
+    RUN_TEST(test_cryp_dma_across_transfers);
+    RUN_TEST(test_cryp_in_place_and_chained);
+    RUN_TEST(test_gcm_encryption_with_a_partial_block_avoids_the_core);
+    RUN_TEST(test_cryp_in_use_falls_back_to_software);
+    RUN_TEST(test_cryp_dma_error_fails_the_job);
+    RUN_TEST(test_cryp_rejects_invalid_jobs);
+    RUN_TEST(test_hash_dma_across_transfers);
+    RUN_TEST(test_hash_in_use_falls_back_to_software);
+    RUN_TEST(test_hash_dma_error_finishes_in_software);
+    return UNITY_END();
+}
@@ -0,0 +1,446 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/dcmi/dcmi.h"
+#include <string.h>
+
+#define WIDTH 16U
+#define HEIGHT 8U
+#define LINE_BYTES (WIDTH * 2U)
+#define LINES_PER_BLOCK 2U
+#define BLOCK_BYTES (LINE_BYTES * LINES_PER_BLOCK)
+#define BLOCKS_PER_FRAME (HEIGHT / LINES_PER_BLOCK)
+#define POOL_BLOCKS 6U
+#define LOG_SIZE 64U
+
+static MSG_POOL_STORAGE(storage, LINE_BYTES * HEIGHT, POOL_BLOCKS);
+static msg_pool_t pool;
+static mailbox_t output;
+static dcmi_t dcmi;
+static dcmi_config_t config;
+
+static dcmi_lines_t seen_lines[LOG_SIZE];
+static uint32_t lines_count;
+static dcmi_frame_t seen_frames[LOG_SIZE];
+static uint32_t frames_count;
+
+/* Run from the lines callback once a block of the given frame and first line arrives */
+static void (*on_block_hook)(void);
+static uint32_t hook_frame;
+static uint16_t hook_line;
+
+static void on_lines(msg_t* block, const dcmi_lines_t* lines, void* context)
+{
+    TEST_ASSERT_EQUAL_PTR(&output, context);
+    if (lines_count < LOG_SIZE) {
+        seen_lines[lines_count++] = *lines;
+    }
+    mailbox_post(&output, block);
+    if (on_block_hook != NULL && lines->frame == hook_frame && lines->first_line == hook_line) {
+        on_block_hook();
+    }
+}
+
+static void on_frame(const dcmi_frame_t* frame, void* context)
+{
+    (void)context;
+    if (frames_count < LOG_SIZE) {
+        seen_frames[frames_count++] = *frame;
+    }
+}
+
+/* Pixel bytes of a frame as the sensor sends it; tag tells frames apart */
+static void image(uint8_t* data, uint32_t tag, uint32_t lines)
+{
+    for (uint32_t i = 0; i < lines * LINE_BYTES; i++) {
+        data[i] = (uint8_t)(tag * 31U + i);
+    }
+}
+
+static void send_frame(uint32_t tag, uint32_t lines)
+{
+    static uint8_t data[LINE_BYTES * (HEIGHT + 2U)];
+    image(data, tag, lines);
+    dcmi_sim_frame(data, LINE_BYTES, lines);
+}
+
+/* Checks the next block holds lines first_line.. of the frame sent with tag, then frees it */
+static void expect_block(uint32_t tag, uint32_t first_line)
+{
+    static uint8_t expected[LINE_BYTES * (HEIGHT + 2U)];
+    msg_t* block = mailbox_fetch(&output);
+    if (block == NULL) {
+        TEST_FAIL_MESSAGE("no block");
+        return;
+    }
+    TEST_ASSERT_EQUAL(BLOCK_BYTES, block->length);
+    TEST_ASSERT_EQUAL(first_line, block->type);
+    image(expected, tag, HEIGHT);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected + first_line * LINE_BYTES, msg_payload(block), BLOCK_BYTES);
+    msg_free(block);
+}
+
+static void expect_frame(uint32_t tag)
+{
+    for (uint32_t line = 0; line < HEIGHT; line += LINES_PER_BLOCK) {
+        expect_block(tag, line);
+    }
+}
+
+static void free_blocks(void)
+{
+    for (msg_t* block = mailbox_fetch(&output); block != NULL; block = mailbox_fetch(&output)) {
+        msg_free(block);
+    }
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(&dcmi_sim_regs, 0, sizeof(dcmi_sim_regs));
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    msg_pool_init(&pool, storage, LINE_BYTES * HEIGHT, POOL_BLOCKS);
+    mailbox_init(&output, NULL, NULL);
+    lines_count = 0;
+    frames_count = 0;
+    on_block_hook = NULL;
+    dcmi_sim_timing(12000000U, 160U, 20U);
+
+    memset(&config, 0, sizeof(config));
+    config.width = WIDTH;
+    config.height = HEIGHT;
+    config.bytes_per_pixel = 2;
+    config.lines_per_block = LINES_PER_BLOCK;
+    config.sync = DCMI_CR_PCKPOL | DCMI_CR_VSPOL;
+    config.pool = &pool;
+    config.on_lines = on_lines;
+    config.on_frame = on_frame;
+    config.clock = dcmi_sim_time_us;
+    config.context = &output;
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_init(&dcmi, &config));
+}
+
+void tearDown(void)
+{
+    dcmi_deinit(&dcmi);
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    dcmi_config_t bad = config;
+    bad.on_lines = NULL;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+    bad = config;
+    bad.width = 3; /* 6-byte lines split a word */
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+    bad = config;
+    bad.lines_per_block = 3;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+    bad = config;
+    bad.width = 64; /* four lines of 128 bytes, twice what a payload holds */
+    bad.height = 4;
+    bad.lines_per_block = 4;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+    bad = config;
+    bad.bytes_per_pixel = 3;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+    bad = config;
+    bad.frame_skip = 3;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+    bad = config;
+    bad.sync = DCMI_CR_JPEG;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &bad));
+}
+
+void test_init_fails_while_in_use(void)
+{
+    dcmi_t other;
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&other, &config));
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_init(&dcmi, &config));
+
+    dcmi_deinit(&dcmi);
+    TEST_ASSERT_EQUAL(0, hal_sim_rcc.AHB2ENR & 1U);
+    TEST_ASSERT_EQUAL(0, dcmi_sim_regs.IER);
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_start(&dcmi));
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_init(&other, &config));
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&other));
+    send_frame(0, HEIGHT);
+    expect_frame(0);
+    TEST_ASSERT_EQUAL(1, dcmi_get_stats(&other)->frames);
+    dcmi_deinit(&other);
+    TEST_ASSERT_EQUAL(0, pool.in_use);
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_init(&dcmi, &config));
+}
+
+void test_init_and_start_program_the_interface_and_dma(void)
+{
+    TEST_ASSERT_TRUE(hal_sim_rcc.AHB2ENR & 1U);
+    TEST_ASSERT_EQUAL_HEX32(DCMI_CR_PCKPOL | DCMI_CR_VSPOL, dcmi_sim_regs.CR);
+    TEST_ASSERT_EQUAL_HEX32(DCMI_IT_FRAME | DCMI_IT_OVR, dcmi_sim_regs.IER);
+
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    TEST_ASSERT_EQUAL_HEX32(DCMI_CR_PCKPOL | DCMI_CR_VSPOL | DCMI_CR_ENABLE | DCMI_CR_CAPTURE, dcmi_sim_regs.CR);
+    TEST_ASSERT_EQUAL(1, dma_sim_regs[1].S[1].CR >> DMA_SxCR_CHSEL_Pos);
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[1].CR & DMA_SxCR_DBM);
+    TEST_ASSERT_EQUAL(BLOCK_BYTES / 4U, dma_sim_regs[1].S[1].NDTR);
+    TEST_ASSERT_EQUAL(2, pool.in_use);
+    TEST_ASSERT_EQUAL(FAILURE, dcmi_start(&dcmi));
+}
+
+void test_nothing_is_captured_before_start(void)
+{
+    send_frame(1, HEIGHT);
+    TEST_ASSERT_EQUAL(0, lines_count);
+    TEST_ASSERT_EQUAL(0, frames_count);
+}
+
+void test_frames_are_handed_off_in_blocks_without_copies(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    for (uint32_t frame = 0; frame < 5U; frame++) {
+        send_frame(frame, HEIGHT);
+        expect_frame(frame);
+        TEST_ASSERT_EQUAL(2, pool.in_use);
+    }
+    TEST_ASSERT_EQUAL(5U * BLOCKS_PER_FRAME, lines_count);
+    TEST_ASSERT_EQUAL(2, seen_lines[10].frame);
+    TEST_ASSERT_EQUAL(4, seen_lines[10].first_line);
+    TEST_ASSERT_EQUAL(LINES_PER_BLOCK, seen_lines[10].lines);
+
+    TEST_ASSERT_EQUAL(5, frames_count);
+    for (uint32_t i = 0; i < 5U; i++) {
+        TEST_ASSERT_EQUAL(i, seen_frames[i].number);
+        TEST_ASSERT_EQUAL(1, seen_frames[i].complete);
+        TEST_ASSERT_EQUAL(BLOCKS_PER_FRAME, seen_frames[i].blocks);
+    }
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    TEST_ASSERT_EQUAL(5, stats->frames);
+    TEST_ASSERT_EQUAL(20, stats->blocks);
+    TEST_ASSERT_EQUAL(0, stats->dropped_frames);
+    TEST_ASSERT_EQUAL(0, stats->sync_errors);
+}
+
+void test_frame_timing_follows_the_sensor(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    for (uint32_t frame = 0; frame < 3U; frame++) {
+        send_frame(frame, HEIGHT);
+        expect_frame(frame);
+    }
+    /* (32 bytes + 160 clocks of blanking) per line at 12 MHz is 16 us; 8 lines and 20 of blanking */
+    TEST_ASSERT_EQUAL(0, seen_frames[0].interval_us);
+    TEST_ASSERT_EQUAL(448, seen_frames[1].interval_us);
+    TEST_ASSERT_EQUAL(448, seen_frames[2].interval_us);
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    TEST_ASSERT_EQUAL(448, stats->frame_interval_us);
+    TEST_ASSERT_EQUAL(448, stats->min_frame_interval_us);
+    TEST_ASSERT_EQUAL(448, stats->max_frame_interval_us);
+
+    /* A frame the pipeline missed, a line short, shows up as a long interval */
+    send_frame(3, HEIGHT - 1U);
+    free_blocks();
+    send_frame(4, HEIGHT);
+    expect_frame(4);
+    TEST_ASSERT_EQUAL(880, stats->max_frame_interval_us);
+    TEST_ASSERT_EQUAL(448, stats->min_frame_interval_us);
+}
+
+void test_an_empty_pool_drops_blocks_and_the_frame(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    /* The consumer holds on to the first frame, which takes the last of the pool */
+    send_frame(0, HEIGHT);
+    TEST_ASSERT_EQUAL(POOL_BLOCKS, pool.in_use);
+    send_frame(1, HEIGHT);
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    TEST_ASSERT_EQUAL(BLOCKS_PER_FRAME, stats->blocks);
+    TEST_ASSERT_EQUAL(BLOCKS_PER_FRAME, stats->dropped_blocks);
+    TEST_ASSERT_EQUAL(1, stats->dropped_frames);
+    TEST_ASSERT_EQUAL(2, frames_count);
+    TEST_ASSERT_EQUAL(0, seen_frames[1].complete);
+    TEST_ASSERT_EQUAL(0, seen_frames[1].blocks);
+
+    /* The dropped blocks were refilled in place, so the buffers in flight are still the right ones */
+    expect_frame(0);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+    send_frame(2, HEIGHT);
+    expect_frame(2);
+    TEST_ASSERT_EQUAL(2, stats->frames);
+    TEST_ASSERT_EQUAL(1, seen_frames[2].complete);
+}
+
+static void overrun_now(void)
+{
+    dcmi_sim_overrun();
+}
+
+void test_an_overrun_drops_the_frame_and_resumes_at_the_next(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    on_block_hook = overrun_now;
+    hook_frame = 0;
+    hook_line = 2;
+    send_frame(0, HEIGHT);
+    expect_block(0, 0);
+    expect_block(0, 2);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    TEST_ASSERT_EQUAL(1, stats->overruns);
+    TEST_ASSERT_EQUAL(1, stats->dropped_frames);
+    TEST_ASSERT_EQUAL(0, seen_frames[0].complete);
+    TEST_ASSERT_EQUAL(0, dcmi_sim_regs.RIS & DCMI_IT_OVR);
+    TEST_ASSERT_TRUE(dcmi_sim_regs.CR & DCMI_CR_CAPTURE);
+
+    send_frame(1, HEIGHT);
+    expect_frame(1);
+    TEST_ASSERT_EQUAL(1, stats->frames);
+    TEST_ASSERT_EQUAL(1, seen_frames[1].number);
+}
+
+void test_a_short_frame_is_a_sync_error(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    send_frame(0, HEIGHT - 1U);
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    TEST_ASSERT_EQUAL(1, stats->sync_errors);
+    TEST_ASSERT_EQUAL(1, stats->dropped_frames);
+    for (uint32_t line = 0; line < HEIGHT - LINES_PER_BLOCK; line += LINES_PER_BLOCK) {
+        expect_block(0, line);
+    }
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+
+    /* The half block of the short frame does not shift the next one */
+    send_frame(1, HEIGHT);
+    expect_frame(1);
+    TEST_ASSERT_EQUAL(1, stats->frames);
+}
+
+void test_a_long_frame_is_a_sync_error(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    send_frame(0, HEIGHT + 1U);
+    expect_frame(0);
+    const dcmi_stats_t* stats = dcmi_get_stats(&dcmi);
+    TEST_ASSERT_EQUAL(1, stats->sync_errors);
+    /* The extra line started a frame that never finished */
+    TEST_ASSERT_EQUAL(2, frames_count);
+    TEST_ASSERT_EQUAL(0, seen_frames[1].complete);
+
+    send_frame(1, HEIGHT);
+    expect_frame(1);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+}
+
+void test_frame_skip_captures_every_other_frame(void)
+{
+    config.frame_skip = 1;
+    dcmi_deinit(&dcmi);
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_init(&dcmi, &config));
+    TEST_ASSERT_EQUAL(1U << DCMI_CR_FCRC_Pos, dcmi_sim_regs.CR & DCMI_CR_FCRC_Msk);
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    for (uint32_t frame = 0; frame < 4U; frame++) {
+        send_frame(frame, HEIGHT);
+        if ((frame & 1U) == 0U) {
+            expect_frame(frame);
+        }
+        TEST_ASSERT_NULL(mailbox_fetch(&output));
+    }
+    TEST_ASSERT_EQUAL(2, dcmi_get_stats(&dcmi)->frames);
+    TEST_ASSERT_EQUAL(896, dcmi_get_stats(&dcmi)->frame_interval_us);
+}
+
+void test_a_whole_frame_fits_one_block(void)
+{
+    config.lines_per_block = HEIGHT;
+    dcmi_deinit(&dcmi);
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_init(&dcmi, &config));
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    static uint8_t expected[LINE_BYTES * HEIGHT];
+    for (uint32_t frame = 0; frame < 3U; frame++) {
+        send_frame(frame, HEIGHT);
+        msg_t* block = mailbox_fetch(&output);
+        if (block == NULL) {
+            TEST_FAIL_MESSAGE("no frame");
+            return;
+        }
+        image(expected, frame, HEIGHT);
+        TEST_ASSERT_EQUAL(LINE_BYTES * HEIGHT, block->length);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, msg_payload(block), LINE_BYTES * HEIGHT);
+        msg_free(block);
+    }
+    TEST_ASSERT_EQUAL(3, dcmi_get_stats(&dcmi)->frames);
+    TEST_ASSERT_EQUAL(1, seen_frames[2].blocks);
+}
+
+void test_dma_error_drops_the_frame_and_restarts(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    dma_sim_regs[1].LISR = DMA_FLAG_TE << 6;
+    dma_sim_regs[1].S[1].CR &= ~DMA_SxCR_EN;
+    dma_stream_irq(2, 1);
+    dma_sim_regs[1].LISR = 0;
+    TEST_ASSERT_EQUAL(1, dcmi_get_stats(&dcmi)->dma_errors);
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[1].CR & DMA_SxCR_EN);
+    /* Nothing had arrived yet, so no frame was lost */
+    TEST_ASSERT_EQUAL(0, frames_count);
+
+    send_frame(0, HEIGHT);
+    expect_frame(0);
+}
+
+void test_a_stream_that_stops_overruns_the_fifo(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    dma_sim_regs[1].S[1].CR &= ~DMA_SxCR_EN;
+    send_frame(0, HEIGHT);
+    TEST_ASSERT_EQUAL(1, dcmi_get_stats(&dcmi)->overruns);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+
+    send_frame(1, HEIGHT);
+    expect_frame(1);
+}
+
+static void stop_now(void)
+{
+    dcmi_stop(&dcmi);
+}
+
+void test_stop_mid_frame_reports_it_and_returns_the_buffers(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, dcmi_start(&dcmi));
+    on_block_hook = stop_now;
+    hook_frame = 0;
+    hook_line = 2;
+    send_frame(0, HEIGHT);
+    TEST_ASSERT_EQUAL(1, frames_count);
+    TEST_ASSERT_EQUAL(0, seen_frames[0].complete);
+    TEST_ASSERT_EQUAL(2, seen_frames[0].blocks);
+
+    expect_block(0, 0);
+    expect_block(0, 2);
+    TEST_ASSERT_EQUAL(0, pool.in_use);
+    TEST_ASSERT_EQUAL(0, dcmi_sim_regs.CR & DCMI_CR_ENABLE);
+
+    send_frame(1, HEIGHT);
+    TEST_ASSERT_NULL(mailbox_fetch(&output));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_fails_while_in_use);
+    RUN_TEST(test_init_and_start_program_the_interface_and_dma);
+    RUN_TEST(test_nothing_is_captured_before_start);
+    RUN_TEST(test_frames_are_handed_off_in_blocks_without_copies);
+    RUN_TEST(test_frame_timing_follows_the_sensor);
+    RUN_TEST(test_an_empty_pool_drops_blocks_and_the_frame);
+    RUN_TEST(test_an_overrun_drops_the_frame_and_resumes_at_the_next);
+    RUN_TEST(test_a_short_frame_is_a_sync_error);
+    RUN_TEST(test_a_long_frame_is_a_sync_error);
+    RUN_TEST(test_frame_skip_captures_every_other_frame);
+    RUN_TEST(test_a_whole_frame_fits_one_block);
+    RUN_TEST(test_dma_error_drops_the_frame_and_restarts);
+    RUN_TEST(test_a_stream_that_stops_overruns_the_fifo);
+    RUN_TEST(test_stop_mid_frame_reports_it_and_returns_the_buffers);
+    return UNITY_END();
+}
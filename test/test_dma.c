@@ -0,0 +1,357 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/dma/dma.h"
+#include <string.h>
+
+#define PERIPH_ADDRESS 0x4001204CU
+
+static dma_stream_t stream;
+static dma_stream_t other;
+
+typedef struct {
+    dma_event_t event;
+    void* buffer;
+} record_t;
+
+static record_t records[8];
+static uint32_t record_count;
+
+static void record(dma_stream_t* s, dma_event_t event, void* buffer, void* context)
+{
+    (void)s;
+    (void)context;
+    if (record_count < 8U) {
+        records[record_count].event = event;
+        records[record_count].buffer = buffer;
+    }
+    record_count++;
+}
+
+static dma_config_t adc_config(uint8_t mode)
+{
+    dma_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.channel = 0;
+    config.priority = 3;
+    config.direction = DMA_PERIPH_TO_MEMORY;
+    config.mode = mode;
+    config.peripheral_size = 2;
+    config.memory_size = 2;
+    config.memory_increment = 1;
+    config.half_transfer = 1;
+    config.callback = record;
+    return config;
+}
+
+/* Raises flags for a stream the way the hardware would and runs its vector */
+static void raise(uint8_t controller, uint8_t index, uint32_t flags)
+{
+    dma_regs_t* regs = &dma_sim_regs[controller - 1U];
+    static const uint8_t shift[4] = { 0, 6, 16, 22 };
+    volatile uint32_t* isr = (index < 4U) ? &regs->LISR : &regs->HISR;
+    *isr |= flags << shift[index & 3U];
+    dma_stream_irq(controller, index);
+    *isr = 0;
+}
+
+void setUp(void)
+{
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    hal_reg_trace_reset();
+    record_count = 0;
+}
+
+void tearDown(void)
+{
+    if (stream.regs != NULL) {
+        dma_stream_release(&stream);
+    }
+    if (other.regs != NULL) {
+        dma_stream_release(&other);
+    }
+    memset(&stream, 0, sizeof(stream));
+    memset(&other, 0, sizeof(other));
+}
+
+void test_init_claims_stream_once(void)
+{
+    dma_config_t config = adc_config(DMA_MODE_NORMAL);
+    TEST_ASSERT_EQUAL(SUCCESS, dma_stream_init(&stream, 2, 0, &config));
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&other, 2, 0, &config));
+    TEST_ASSERT_EQUAL(SUCCESS, dma_stream_init(&other, 2, 4, &config));
+    TEST_ASSERT_TRUE(hal_sim_rcc.AHB1ENR & (1U << 22));
+
+    dma_stream_release(&other);
+    memset(&other, 0, sizeof(other));
+    TEST_ASSERT_EQUAL(SUCCESS, dma_stream_init(&other, 2, 4, &config));
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    dma_config_t config = adc_config(DMA_MODE_NORMAL);
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 3, 0, &config));
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 1, 8, &config));
+
+    config.memory_size = 4;
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 1, 0, &config)); /* packing needs the FIFO */
+
+    config = adc_config(DMA_MODE_NORMAL);
+    config.memory_burst = 4;
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 1, 0, &config)); /* bursts need the FIFO */
+    config.fifo_threshold = 1;
+    config.memory_size = 4;
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 1, 0, &config)); /* 16 B burst over a 4 B threshold */
+
+    config = adc_config(DMA_MODE_NORMAL);
+    config.direction = DMA_MEMORY_TO_MEMORY;
+    config.fifo_threshold = 4;
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 1, 0, &config));
+    config.mode = DMA_MODE_CIRCULAR;
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 2, 0, &config));
+    memset(&stream, 0, sizeof(stream));
+}
+
+void test_start_writes_registers_in_reference_order(void)
+{
+    static uint16_t buffer[64];
+    dma_config_t config = adc_config(DMA_MODE_CIRCULAR);
+    config.channel = 2;
+    config.fifo_threshold = 2;
+    config.memory_burst = 4;
+    TEST_ASSERT_EQUAL(SUCCESS, dma_stream_init(&stream, 2, 1, &config));
+    dma_stream_regs_t* regs = &dma_sim_regs[1].S[1];
+
+    hal_reg_trace_reset();
+    TEST_ASSERT_EQUAL(SUCCESS, dma_start(&stream, PERIPH_ADDRESS, buffer, 64));
+
+    int32_t clear = hal_reg_trace_find(&dma_sim_regs[1].LIFCR, 0);
+    int32_t par = hal_reg_trace_find(&regs->PAR, 0);
+    int32_t m0ar = hal_reg_trace_find(&regs->M0AR, 0);
+    int32_t ndtr = hal_reg_trace_find(&regs->NDTR, 0);
+    int32_t fcr = hal_reg_trace_find(&regs->FCR, 0);
+    int32_t cr = hal_reg_trace_find(&regs->CR, 0);
+    int32_t enable = hal_reg_trace_find(&regs->CR, (uint32_t)cr + 1U);
+    TEST_ASSERT_TRUE(clear >= 0);
+    TEST_ASSERT_TRUE(clear < par && par < m0ar && m0ar < ndtr && ndtr < fcr && fcr < cr && cr < enable);
+    TEST_ASSERT_EQUAL(-1, hal_reg_trace_find(&regs->M1AR, 0));
+
+    TEST_ASSERT_EQUAL_HEX32(0x3DU << 6, hal_reg_trace[clear].value);
+    TEST_ASSERT_EQUAL_HEX32(PERIPH_ADDRESS, regs->PAR);
+    TEST_ASSERT_EQUAL(64, regs->NDTR);
+    TEST_ASSERT_EQUAL_HEX32(DMA_SxFCR_DMDIS | 1U, regs->FCR);
+    TEST_ASSERT_EQUAL(0, hal_reg_trace[cr].value & DMA_SxCR_EN);
+    uint32_t expected = (2U << DMA_SxCR_CHSEL_Pos) | (3U << DMA_SxCR_PL_Pos) | (1U << DMA_SxCR_MBURST_Pos) |
+                        (1U << DMA_SxCR_MSIZE_Pos) | (1U << DMA_SxCR_PSIZE_Pos) | DMA_SxCR_MINC | DMA_SxCR_CIRC |
+                        DMA_SxCR_TCIE | DMA_SxCR_HTIE | DMA_SxCR_TEIE | DMA_SxCR_DMEIE | DMA_SxCR_EN;
+    TEST_ASSERT_EQUAL_HEX32(expected, regs->CR);
+}
+
+void test_restart_disables_stream_first(void)
+{
+    static uint16_t buffer[16];
+    dma_config_t config = adc_config(DMA_MODE_NORMAL);
+    dma_stream_init(&stream, 1, 5, &config);
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 16);
+    dma_stream_regs_t* regs = &dma_sim_regs[0].S[5];
+
+    hal_reg_trace_reset();
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 8);
+    TEST_ASSERT_EQUAL_PTR(&regs->CR, hal_reg_trace[0].reg);
+    TEST_ASSERT_EQUAL(0, hal_reg_trace[0].value & DMA_SxCR_EN);
+    TEST_ASSERT_EQUAL_PTR(&dma_sim_regs[0].HIFCR, hal_reg_trace[1].reg);
+    TEST_ASSERT_EQUAL_HEX32(0x3DU << 6, hal_reg_trace[1].value);
+    TEST_ASSERT_EQUAL(8, dma_remaining(&stream));
+}
+
+void test_half_then_complete_and_normal_mode_finishes(void)
+{
+    static uint16_t buffer[32];
+    dma_config_t config = adc_config(DMA_MODE_NORMAL);
+    dma_stream_init(&stream, 2, 0, &config);
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 32);
+
+    raise(2, 0, DMA_FLAG_HT | DMA_FLAG_TC);
+    TEST_ASSERT_EQUAL(2, record_count);
+    TEST_ASSERT_EQUAL(DMA_EVENT_HALF, records[0].event);
+    TEST_ASSERT_EQUAL(DMA_EVENT_COMPLETE, records[1].event);
+    TEST_ASSERT_EQUAL_PTR(buffer, records[1].buffer);
+    TEST_ASSERT_EQUAL(0, stream.active);
+    TEST_ASSERT_EQUAL(1, stream.stats.transfers);
+    TEST_ASSERT_EQUAL(1, stream.stats.half_transfers);
+
+    int32_t clear = hal_reg_trace_find(&dma_sim_regs[1].LIFCR, 0);
+    TEST_ASSERT_EQUAL_HEX32(DMA_FLAG_HT | DMA_FLAG_TC, hal_reg_trace[hal_reg_trace_count - 1U].value);
+    TEST_ASSERT_TRUE(clear >= 0);
+}
+
+void test_circular_mode_keeps_running(void)
+{
+    static uint16_t buffer[32];
+    dma_config_t config = adc_config(DMA_MODE_CIRCULAR);
+    dma_stream_init(&stream, 2, 7, &config);
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 32);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        raise(2, 7, DMA_FLAG_HT);
+        raise(2, 7, DMA_FLAG_TC);
+    }
+    TEST_ASSERT_EQUAL(6, record_count);
+    TEST_ASSERT_EQUAL(DMA_EVENT_HALF, records[4].event);
+    TEST_ASSERT_EQUAL(DMA_EVENT_COMPLETE, records[5].event);
+    TEST_ASSERT_EQUAL(1, stream.active);
+    TEST_ASSERT_EQUAL(3, stream.stats.transfers);
+}
+
+void test_double_buffer_reports_finished_buffer(void)
+{
+    static uint16_t ping[16];
+    static uint16_t pong[16];
+    static uint16_t spare[16];
+    dma_config_t config = adc_config(DMA_MODE_DOUBLE_BUFFER);
+    config.half_transfer = 0;
+    dma_stream_init(&stream, 2, 0, &config);
+    dma_stream_regs_t* regs = &dma_sim_regs[1].S[0];
+
+    TEST_ASSERT_EQUAL(FAILURE, dma_start(&stream, PERIPH_ADDRESS, ping, 16));
+    TEST_ASSERT_EQUAL(SUCCESS, dma_start_double_buffer(&stream, PERIPH_ADDRESS, ping, pong, 16));
+    TEST_ASSERT_EQUAL_HEX32((uintptr_t)pong, regs->M1AR);
+    TEST_ASSERT_TRUE(regs->CR & DMA_SxCR_DBM);
+    TEST_ASSERT_EQUAL(0, dma_current_buffer(&stream));
+
+    /* Hardware finishes ping and switches to pong */
+    regs->CR |= DMA_SxCR_CT;
+    raise(2, 0, DMA_FLAG_TC);
+    TEST_ASSERT_EQUAL_PTR(ping, records[0].buffer);
+
+    /* Refilling while on pong replaces ping */
+    TEST_ASSERT_EQUAL(SUCCESS, dma_set_idle_buffer(&stream, spare));
+    TEST_ASSERT_EQUAL_HEX32((uintptr_t)spare, regs->M0AR);
+
+    regs->CR &= ~DMA_SxCR_CT;
+    raise(2, 0, DMA_FLAG_TC);
+    TEST_ASSERT_EQUAL_PTR(pong, records[1].buffer);
+
+    regs->CR |= DMA_SxCR_CT;
+    raise(2, 0, DMA_FLAG_TC);
+    TEST_ASSERT_EQUAL_PTR(spare, records[2].buffer);
+    TEST_ASSERT_EQUAL(1, stream.active);
+}
+
+void test_error_stops_stream_and_skips_other_events(void)
+{
+    static uint16_t buffer[16];
+    dma_config_t config = adc_config(DMA_MODE_CIRCULAR);
+    dma_stream_init(&stream, 1, 3, &config);
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 16);
+
+    raise(1, 3, DMA_FLAG_TE | DMA_FLAG_TC | DMA_FLAG_FE);
+    TEST_ASSERT_EQUAL(1, record_count);
+    TEST_ASSERT_EQUAL(DMA_EVENT_ERROR, records[0].event);
+    TEST_ASSERT_EQUAL(0, stream.active);
+    TEST_ASSERT_EQUAL(0, dma_sim_regs[0].S[3].CR & DMA_SxCR_EN);
+    TEST_ASSERT_EQUAL(1, stream.stats.transfer_errors);
+    TEST_ASSERT_EQUAL(1, stream.stats.fifo_errors);
+    TEST_ASSERT_EQUAL(0, stream.stats.transfers);
+}
+
+void test_irq_ignores_other_streams_flags(void)
+{
+    static uint16_t buffer[16];
+    dma_config_t config = adc_config(DMA_MODE_CIRCULAR);
+    dma_stream_init(&stream, 1, 2, &config);
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 16);
+
+    dma_sim_regs[0].LISR = DMA_FLAG_TC << 22; /* stream 3 */
+    dma_stream_irq(1, 2);
+    TEST_ASSERT_EQUAL(0, record_count);
+    dma_sim_regs[0].LISR = 0;
+}
+
+void test_sim_transfer_fills_ping_pong_buffers(void)
+{
+    static uint16_t ping[4];
+    static uint16_t pong[4];
+    static const uint16_t data[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    dma_config_t config = adc_config(DMA_MODE_DOUBLE_BUFFER);
+    config.half_transfer = 0;
+    dma_stream_init(&stream, 2, 0, &config);
+    dma_start_double_buffer(&stream, PERIPH_ADDRESS, ping, pong, 4);
+
+    TEST_ASSERT_EQUAL(10, dma_sim_transfer(2, 0, data, 10));
+    TEST_ASSERT_EQUAL(2, record_count); /* half-transfer flags are not reported without HTIE */
+    TEST_ASSERT_EQUAL(DMA_EVENT_COMPLETE, records[0].event);
+    TEST_ASSERT_EQUAL_PTR(ping, records[0].buffer);
+    TEST_ASSERT_EQUAL_PTR(pong, records[1].buffer);
+    TEST_ASSERT_EQUAL(9, ping[0]);
+    TEST_ASSERT_EQUAL(10, ping[1]);
+    TEST_ASSERT_EQUAL(4, ping[3]);
+    TEST_ASSERT_EQUAL(8, pong[3]);
+    TEST_ASSERT_EQUAL(2, dma_remaining(&stream));
+}
+
+void test_sim_transfer_stops_normal_mode_at_end(void)
+{
+    static uint8_t buffer[4];
+    static const uint8_t data[6] = { 1, 2, 3, 4, 5, 6 };
+    dma_config_t config = adc_config(DMA_MODE_NORMAL);
+    config.peripheral_size = 1;
+    config.memory_size = 1;
+    dma_stream_init(&stream, 1, 6, &config);
+    dma_start(&stream, PERIPH_ADDRESS, buffer, 4);
+
+    TEST_ASSERT_EQUAL(4, dma_sim_transfer(1, 6, data, 6));
+    TEST_ASSERT_EQUAL(2, record_count);
+    TEST_ASSERT_EQUAL(DMA_EVENT_HALF, records[0].event);
+    TEST_ASSERT_EQUAL(DMA_EVENT_COMPLETE, records[1].event);
+    TEST_ASSERT_EQUAL(4, buffer[3]);
+    TEST_ASSERT_EQUAL(0, stream.active);
+}
+
+void test_peripheral_flow_and_direction_switch(void)
+{
+    static uint32_t buffer[8];
+    static const uint32_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    dma_config_t config = adc_config(DMA_MODE_CIRCULAR);
+    config.peripheral_size = 4;
+    config.memory_size = 4;
+    config.fifo_threshold = 4;
+    config.peripheral_burst = 4;
+    config.memory_burst = 4;
+    config.peripheral_flow = 1;
+    TEST_ASSERT_EQUAL(FAILURE, dma_stream_init(&stream, 2, 6, &config));
+    memset(&stream, 0, sizeof(stream));
+    config.mode = DMA_MODE_NORMAL;
+    TEST_ASSERT_EQUAL(SUCCESS, dma_stream_init(&stream, 2, 6, &config));
+
+    TEST_ASSERT_EQUAL(SUCCESS, dma_start(&stream, PERIPH_ADDRESS, buffer, 8));
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[6].CR & DMA_SxCR_PFCTRL);
+    TEST_ASSERT_EQUAL(8, dma_sim_transfer(2, 6, data, 8));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(data, buffer, 8);
+
+    /* The same stream then feeds the peripheral */
+    static uint32_t out[8];
+    TEST_ASSERT_EQUAL(SUCCESS, dma_set_direction(&stream, DMA_MEMORY_TO_PERIPH));
+    TEST_ASSERT_EQUAL(FAILURE, dma_set_direction(&stream, DMA_MEMORY_TO_MEMORY));
+    TEST_ASSERT_EQUAL(SUCCESS, dma_start(&stream, PERIPH_ADDRESS, buffer, 8));
+    TEST_ASSERT_EQUAL(1U, (dma_sim_regs[1].S[6].CR >> DMA_SxCR_DIR_Pos) & 3U);
+    TEST_ASSERT_EQUAL(8, dma_sim_drain(2, 6, out, 8));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(data, out, 8);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_claims_stream_once);
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_start_writes_registers_in_reference_order);
+    RUN_TEST(test_restart_disables_stream_first);
+    RUN_TEST(test_half_then_complete_and_normal_mode_finishes);
+    RUN_TEST(test_circular_mode_keeps_running);
+    RUN_TEST(test_double_buffer_reports_finished_buffer);
+    RUN_TEST(test_error_stops_stream_and_skips_other_events);
+    RUN_TEST(test_irq_ignores_other_streams_flags);
+    RUN_TEST(test_sim_transfer_fills_ping_pong_buffers);
+    RUN_TEST(test_sim_transfer_stops_normal_mode_at_end);
+    RUN_TEST(test_peripheral_flow_and_direction_switch);
+    return UNITY_END();
+}
@@ -0,0 +1,384 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/dsp/dsp.h"
+#include <string.h>
+
+/*
+ * Each kernel is checked bit for bit against a plain loop doing the same
+ * arithmetic, over lengths that exercise the unrolled body and every tail,
+ * with inputs that include full-scale values to hit saturation.
+ */
+
+#define MAX_LENGTH 67U
+#define TAPS 29U
+
+static uint32_t seed;
+
+static uint32_t next_random(void)
+{
+    seed = seed * 1664525U + 1013904223U;
+    return seed;
+}
+
+static void random_q15(q15_t* v, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t r = next_random();
+        v[i] = ((r & 0xF0000000U) == 0U) ? INT16_MIN : ((r & 0xF0000000U) == 0x10000000U) ? INT16_MAX : (q15_t)(r >> 16);
+    }
+}
+
+static void random_q31(q31_t* v, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t r = next_random();
+        v[i] = ((r & 0xF) == 0U) ? INT32_MIN : ((r & 0xF) == 1U) ? INT32_MAX : (q31_t)(r ^ (next_random() >> 7));
+    }
+}
+
+static void random_f32(float32_t* v, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        v[i] = (float32_t)(int32_t)next_random() / 2147483648.0f;
+    }
+}
+
+static q15_t ref_sat_q15(int64_t v)
+{
+    return (q15_t)((v > 32767) ? 32767 : (v < -32768) ? -32768 : v);
+}
+
+static q31_t ref_sat_q31(int64_t v)
+{
+    return (q31_t)((v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : v);
+}
+
+static void assert_f32_identical(const float32_t* expected, const float32_t* actual, uint32_t count)
+{
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, count * sizeof(float32_t));
+}
+
+void setUp(void)
+{
+    seed = 12345;
+}
+
+void tearDown(void)
+{
+}
+
+void test_add_matches_reference(void)
+{
+    q15_t a15[MAX_LENGTH], b15[MAX_LENGTH], out15[MAX_LENGTH], ref15[MAX_LENGTH];
+    q31_t a31[MAX_LENGTH], b31[MAX_LENGTH], out31[MAX_LENGTH], ref31[MAX_LENGTH];
+    float32_t af[MAX_LENGTH], bf[MAX_LENGTH], outf[MAX_LENGTH], reff[MAX_LENGTH];
+
+    for (uint32_t n = 0; n <= MAX_LENGTH; n += 3U) {
+        random_q15(a15, n);
+        random_q15(b15, n);
+        random_q31(a31, n);
+        random_q31(b31, n);
+        random_f32(af, n);
+        random_f32(bf, n);
+        for (uint32_t i = 0; i < n; i++) {
+            ref15[i] = ref_sat_q15((int32_t)a15[i] + b15[i]);
+            ref31[i] = ref_sat_q31((int64_t)a31[i] + b31[i]);
+            reff[i] = af[i] + bf[i];
+        }
+        dsp_add_q15(a15, b15, out15, n);
+        dsp_add_q31(a31, b31, out31, n);
+        dsp_add_f32(af, bf, outf, n);
+        if (n > 0U) {
+            TEST_ASSERT_EQUAL_INT16_ARRAY(ref15, out15, n);
+            TEST_ASSERT_EQUAL_INT32_ARRAY(ref31, out31, n);
+            assert_f32_identical(reff, outf, n);
+        }
+    }
+}
+
+void test_add_q15_handles_unaligned_buffers(void)
+{
+    q15_t a[MAX_LENGTH + 1U], b[MAX_LENGTH + 1U], out[MAX_LENGTH + 1U], ref[MAX_LENGTH];
+    random_q15(a, MAX_LENGTH + 1U);
+    random_q15(b, MAX_LENGTH + 1U);
+    for (uint32_t i = 0; i < MAX_LENGTH; i++) {
+        ref[i] = ref_sat_q15((int32_t)a[i + 1U] + b[i + 1U]);
+    }
+    dsp_add_q15(a + 1, b + 1, out + 1, MAX_LENGTH);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(ref, out + 1, MAX_LENGTH);
+}
+
+void test_scale_matches_reference(void)
+{
+    q15_t in15[MAX_LENGTH], out15[MAX_LENGTH], ref15[MAX_LENGTH];
+    q31_t in31[MAX_LENGTH], out31[MAX_LENGTH], ref31[MAX_LENGTH];
+    float32_t inf[MAX_LENGTH], outf[MAX_LENGTH], reff[MAX_LENGTH];
+    static const int8_t shifts[] = { 0, 2, -3 };
+
+    random_q15(in15, MAX_LENGTH);
+    random_q31(in31, MAX_LENGTH);
+    random_f32(inf, MAX_LENGTH);
+    for (uint32_t s = 0; s < sizeof(shifts); s++) {
+        int8_t shift = shifts[s];
+        for (uint32_t i = 0; i < MAX_LENGTH; i++) {
+            int64_t p15 = (int64_t)in15[i] * -23170;
+            int64_t p31 = (int64_t)in31[i] * 1518500250;
+            ref15[i] = ref_sat_q15((15 - shift >= 0) ? p15 >> (15 - shift) : p15 * (1 << (shift - 15)));
+            ref31[i] = ref_sat_q31(p31 >> (31 - shift));
+            reff[i] = inf[i] * 0.7071f;
+        }
+        dsp_scale_q15(in15, -23170, shift, out15, MAX_LENGTH);
+        dsp_scale_q31(in31, 1518500250, shift, out31, MAX_LENGTH);
+        dsp_scale_f32(inf, 0.7071f, outf, MAX_LENGTH);
+        TEST_ASSERT_EQUAL_INT16_ARRAY(ref15, out15, MAX_LENGTH);
+        TEST_ASSERT_EQUAL_INT32_ARRAY(ref31, out31, MAX_LENGTH);
+        assert_f32_identical(reff, outf, MAX_LENGTH);
+    }
+}
+
+void test_dot_matches_reference(void)
+{
+    q15_t a15[MAX_LENGTH], b15[MAX_LENGTH];
+    q31_t a31[MAX_LENGTH], b31[MAX_LENGTH];
+    float32_t af[MAX_LENGTH], bf[MAX_LENGTH];
+
+    for (uint32_t n = 0; n <= MAX_LENGTH; n++) {
+        random_q15(a15, n);
+        random_q15(b15, n);
+        random_q31(a31, n);
+        random_q31(b31, n);
+        random_f32(af, n);
+        random_f32(bf, n);
+        int64_t ref15 = 0;
+        int64_t ref31 = 0;
+        float32_t reff = 0.0f;
+        for (uint32_t i = 0; i < n; i++) {
+            ref15 += (int32_t)a15[i] * b15[i];
+            ref31 += ((int64_t)a31[i] * b31[i]) >> 14;
+            reff += af[i] * bf[i];
+        }
+        TEST_ASSERT_TRUE(ref15 == dsp_dot_q15(a15, b15, n));
+        TEST_ASSERT_TRUE(ref31 == dsp_dot_q31(a31, b31, n));
+        float32_t dot = dsp_dot_f32(af, bf, n);
+        assert_f32_identical(&reff, &dot, 1);
+    }
+}
+
+/* Direct convolution over the whole signal, history starting at zero */
+static void ref_fir_q15(const q15_t* coeffs, uint32_t taps, const q15_t* in, q15_t* out, uint32_t count)
+{
+    for (uint32_t n = 0; n < count; n++) {
+        int64_t acc = 0;
+        for (uint32_t i = 0; i < taps && i <= n; i++) {
+            acc += (int32_t)coeffs[i] * in[n - i];
+        }
+        out[n] = ref_sat_q15(acc >> 15);
+    }
+}
+
+void test_fir_q15_matches_reference_across_blocks(void)
+{
+    static const uint32_t tap_counts[] = { 1, 2, 3, 4, 5, 8, TAPS };
+    static const uint32_t blocks[] = { 1, 7, 16, 3, 40 };
+    q15_t coeffs[TAPS], in[67], out[67], ref[67];
+    q15_t state[DSP_FIR_STATE_LENGTH(TAPS, 40U)];
+    dsp_fir_q15_t fir;
+
+    random_q15(in, 67);
+    for (uint32_t t = 0; t < sizeof(tap_counts) / sizeof(tap_counts[0]); t++) {
+        uint32_t taps = tap_counts[t];
+        random_q15(coeffs, taps);
+        ref_fir_q15(coeffs, taps, in, ref, 67);
+
+        TEST_ASSERT_EQUAL(SUCCESS, dsp_fir_init_q15(&fir, coeffs, (uint16_t)taps, state, 40));
+        uint32_t done = 0;
+        for (uint32_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+            dsp_fir_q15(&fir, in + done, out + done, blocks[b]);
+            done += blocks[b];
+        }
+        TEST_ASSERT_EQUAL_INT16_ARRAY(ref, out, 67);
+    }
+}
+
+void test_fir_q31_and_f32_match_reference(void)
+{
+    q31_t c31[TAPS], in31[MAX_LENGTH], out31[MAX_LENGTH], ref31[MAX_LENGTH];
+    float32_t cf[TAPS], inf[MAX_LENGTH], outf[MAX_LENGTH], reff[MAX_LENGTH];
+    q31_t state31[DSP_FIR_STATE_LENGTH(TAPS, 32U)];
+    float32_t statef[DSP_FIR_STATE_LENGTH(TAPS, 32U)];
+    dsp_fir_q31_t fir31;
+    dsp_fir_f32_t firf;
+
+    random_q31(c31, TAPS);
+    for (uint32_t i = 0; i < TAPS; i++) {
+        c31[i] /= 32; /* the coefficient sum has to stay within the accumulator's guard bit */
+    }
+    random_q31(in31, MAX_LENGTH);
+    random_f32(cf, TAPS);
+    random_f32(inf, MAX_LENGTH);
+    for (uint32_t n = 0; n < MAX_LENGTH; n++) {
+        int64_t acc = 0;
+        float32_t accf = 0.0f;
+        for (uint32_t i = 0; i < TAPS && i <= n; i++) {
+            acc += (int64_t)c31[i] * in31[n - i];
+        }
+        /* The kernel walks zeros where the reference stops; adding +0.0f products changes nothing */
+        for (uint32_t i = 0; i < TAPS; i++) {
+            accf += cf[i] * ((i <= n) ? inf[n - i] : 0.0f);
+        }
+        ref31[n] = ref_sat_q31(acc >> 31);
+        reff[n] = accf;
+    }
+
+    dsp_fir_init_q31(&fir31, c31, TAPS, state31, 32);
+    dsp_fir_init_f32(&firf, cf, TAPS, statef, 32);
+    for (uint32_t done = 0; done < MAX_LENGTH;) {
+        uint32_t block = (MAX_LENGTH - done < 32U) ? MAX_LENGTH - done : 32U;
+        dsp_fir_q31(&fir31, in31 + done, out31 + done, block);
+        dsp_fir_f32(&firf, inf + done, outf + done, block);
+        done += block;
+    }
+    TEST_ASSERT_EQUAL_INT32_ARRAY(ref31, out31, MAX_LENGTH);
+    assert_f32_identical(reff, outf, MAX_LENGTH);
+}
+
+void test_fir_q15_passes_dc_at_coefficient_sum(void)
+{
+    static const q15_t coeffs[4] = { 8192, 8192, 8192, 8192 }; /* moving average */
+    q15_t state[DSP_FIR_STATE_LENGTH(4U, 8U)];
+    q15_t in[8], out[8];
+    dsp_fir_q15_t fir;
+    for (uint32_t i = 0; i < 8; i++) {
+        in[i] = 16000;
+    }
+    dsp_fir_init_q15(&fir, coeffs, 4, state, 8);
+    dsp_fir_q15(&fir, in, out, 8);
+    TEST_ASSERT_EQUAL_INT16(4000, out[0]);
+    TEST_ASSERT_EQUAL_INT16(12000, out[2]);
+    TEST_ASSERT_EQUAL_INT16(16000, out[7]);
+}
+
+void test_biquad_q15_impulse_response(void)
+{
+    /* y = 0.5 x + 0.5 y[n-1] with post_shift 1: coefficients hold half their value */
+    static const q15_t coeffs[5] = { 8192, 0, 0, 8192, 0 };
+    q15_t state[4];
+    q15_t in[5] = { 32767, 0, 0, 0, 0 };
+    q15_t out[5];
+    dsp_biquad_q15_t biquad;
+    TEST_ASSERT_EQUAL(SUCCESS, dsp_biquad_init_q15(&biquad, 1, coeffs, state, 1));
+    dsp_biquad_q15(&biquad, in, out, 5);
+    TEST_ASSERT_EQUAL_INT16(16383, out[0]);
+    TEST_ASSERT_EQUAL_INT16(8191, out[1]);
+    TEST_ASSERT_EQUAL_INT16(4095, out[2]);
+    TEST_ASSERT_EQUAL_INT16(2047, out[3]);
+}
+
+void test_biquad_cascades_match_reference(void)
+{
+    enum { STAGES = 3, LENGTH = 64 };
+    /* Stable sections, stored at half scale for post_shift 1 */
+    static const float32_t design[STAGES][5] = {
+        { 0.0675f, 0.1349f, 0.0675f, 1.1430f, -0.4128f },
+        { 0.0500f, 0.1000f, 0.0500f, 1.2000f, -0.5000f },
+        { 0.2000f, -0.1000f, 0.0300f, 0.6000f, -0.2000f },
+    };
+    q15_t c15[STAGES * 5];
+    q31_t c31[STAGES * 5];
+    float32_t cf[STAGES * 5];
+    for (uint32_t s = 0; s < STAGES; s++) {
+        for (uint32_t k = 0; k < 5; k++) {
+            c15[s * 5U + k] = (q15_t)(design[s][k] * 16384.0f);
+            c31[s * 5U + k] = (q31_t)(design[s][k] * 1073741824.0f);
+            cf[s * 5U + k] = design[s][k];
+        }
+    }
+
+    q15_t in15[LENGTH], out15[LENGTH], ref15[LENGTH];
+    q31_t in31[LENGTH], out31[LENGTH], ref31[LENGTH];
+    float32_t inf[LENGTH], outf[LENGTH], reff[LENGTH];
+    random_q15(in15, LENGTH);
+    random_q31(in31, LENGTH);
+    random_f32(inf, LENGTH);
+    for (uint32_t i = 0; i < LENGTH; i++) {
+        in15[i] /= 2; /* keep the Q31 path within its guard bit */
+        in31[i] /= 2;
+    }
+
+    memcpy(ref15, in15, sizeof(ref15));
+    memcpy(ref31, in31, sizeof(ref31));
+    memcpy(reff, inf, sizeof(reff));
+    for (uint32_t s = 0; s < STAGES; s++) {
+        const q15_t* b15 = &c15[s * 5U];
+        const q31_t* b31 = &c31[s * 5U];
+        const float32_t* bf = &cf[s * 5U];
+        int64_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+        int64_t u1 = 0, u2 = 0, v1 = 0, v2 = 0;
+        float32_t d1 = 0.0f, d2 = 0.0f;
+        for (uint32_t n = 0; n < LENGTH; n++) {
+            int64_t x0 = ref15[n];
+            int64_t y0 = ref_sat_q15((b15[0] * x0 + b15[1] * x1 + b15[2] * x2 + b15[3] * y1 + b15[4] * y2) >> 14);
+            x2 = x1, x1 = x0, y2 = y1, y1 = y0;
+            ref15[n] = (q15_t)y0;
+
+            int64_t u0 = ref31[n];
+            int64_t v0 = ref_sat_q31((b31[0] * u0 + b31[1] * u1 + b31[2] * u2 + b31[3] * v1 + b31[4] * v2) >> 30);
+            u2 = u1, u1 = u0, v2 = v1, v1 = v0;
+            ref31[n] = (q31_t)v0;
+
+            float32_t f0 = reff[n];
+            float32_t g0 = bf[0] * f0 + d1;
+            d1 = bf[1] * f0 + bf[3] * g0 + d2;
+            d2 = bf[2] * f0 + bf[4] * g0;
+            reff[n] = g0;
+        }
+    }
+
+    q15_t s15[STAGES * 4];
+    q31_t s31[STAGES * 4];
+    float32_t sf[STAGES * 2];
+    dsp_biquad_q15_t bq15;
+    dsp_biquad_q31_t bq31;
+    dsp_biquad_f32_t bqf;
+    dsp_biquad_init_q15(&bq15, STAGES, c15, s15, 1);
+    dsp_biquad_init_q31(&bq31, STAGES, c31, s31, 1);
+    dsp_biquad_init_f32(&bqf, STAGES, cf, sf);
+    /* Two calls to carry state across a block boundary */
+    dsp_biquad_q15(&bq15, in15, out15, 21);
+    dsp_biquad_q15(&bq15, in15 + 21, out15 + 21, LENGTH - 21);
+    dsp_biquad_q31(&bq31, in31, out31, 21);
+    dsp_biquad_q31(&bq31, in31 + 21, out31 + 21, LENGTH - 21);
+    dsp_biquad_f32(&bqf, inf, outf, 21);
+    dsp_biquad_f32(&bqf, inf + 21, outf + 21, LENGTH - 21);
+
+    TEST_ASSERT_EQUAL_INT16_ARRAY(ref15, out15, LENGTH);
+    TEST_ASSERT_EQUAL_INT32_ARRAY(ref31, out31, LENGTH);
+    assert_f32_identical(reff, outf, LENGTH);
+}
+
+void test_init_rejects_bad_arguments(void)
+{
+    q15_t coeffs[4] = { 0 };
+    q15_t state[8];
+    dsp_fir_q15_t fir;
+    dsp_biquad_q15_t biquad;
+    TEST_ASSERT_EQUAL(FAILURE, dsp_fir_init_q15(&fir, coeffs, 0, state, 4));
+    TEST_ASSERT_EQUAL(FAILURE, dsp_fir_init_q15(&fir, coeffs, 4, NULL, 4));
+    TEST_ASSERT_EQUAL(FAILURE, dsp_biquad_init_q15(&biquad, 1, coeffs, state, 16));
+    TEST_ASSERT_EQUAL(FAILURE, dsp_biquad_init_q15(&biquad, 0, coeffs, state, 1));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_add_matches_reference);
+    RUN_TEST(test_add_q15_handles_unaligned_buffers);
+    RUN_TEST(test_scale_matches_reference);
+    RUN_TEST(test_dot_matches_reference);
+    RUN_TEST(test_fir_q15_matches_reference_across_blocks);
+    RUN_TEST(test_fir_q31_and_f32_match_reference);
+    RUN_TEST(test_fir_q15_passes_dc_at_coefficient_sum);
+    RUN_TEST(test_biquad_q15_impulse_response);
+    RUN_TEST(test_biquad_cascades_match_reference);
+    RUN_TEST(test_init_rejects_bad_arguments);
+    return UNITY_END();
+}
@@ -0,0 +1,687 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/eth/eth.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BUFFER 256U
+#define RX_BUFFERS (2U * ETH_RX_RING_LENGTH + 2U)
+#define TX_BUFFERS 16U
+
+static MSG_POOL_STORAGE(rx_storage, ETH_BUF_PAYLOAD(BUFFER), RX_BUFFERS);
+static MSG_POOL_STORAGE(tx_storage, ETH_BUF_PAYLOAD(BUFFER), TX_BUFFERS);
+static msg_pool_t rx_pool;
+static msg_pool_t tx_pool;
+static mailbox_t rx_output;
+static eth_config_t config;
+static eth_t eth;
+
+static const uint8_t local_mac[6] = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+static const uint8_t peer_mac[6] = { 0x02, 0x00, 0x00, 0xAB, 0xCD, 0xEF };
+static const uint8_t broadcast_mac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+/* ---------------------------------------------------------- frames --- */
+
+static uint16_t ones_complement(const uint8_t* data, uint32_t length, uint32_t sum)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        sum += (i & 1U) ? data[i] : ((uint32_t)data[i] << 8);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFFU) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+static void put16(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+/* Ethernet + IPv4 + UDP with valid checksums and a patterned payload; returns the frame length */
+static uint32_t udp_frame(uint8_t* frame, const uint8_t* dst, uint32_t payload, uint8_t seed)
+{
+    uint32_t udp_length = 8U + payload;
+    memset(frame, 0, 42U + payload);
+    memcpy(frame, dst, 6);
+    memcpy(frame + 6, peer_mac, 6);
+    put16(frame + 12, 0x0800);
+
+    uint8_t* ip = frame + 14;
+    ip[0] = 0x45;
+    put16(ip + 2, 20U + udp_length);
+    ip[8] = 64;
+    ip[9] = 17;
+    static const uint8_t addresses[8] = { 192, 168, 1, 2, 192, 168, 1, 1 };
+    memcpy(ip + 12, addresses, 8);
+    put16(ip + 10, (uint16_t)~ones_complement(ip, 20, 0));
+
+    uint8_t* udp = ip + 20;
+    put16(udp, 5000);
+    put16(udp + 2, 6000);
+    put16(udp + 4, udp_length);
+    for (uint32_t i = 0; i < payload; i++) {
+        udp[8U + i] = (uint8_t)(seed + i * 13U);
+    }
+    uint32_t pseudo = ones_complement(ip + 12, 8, 0) + 17U + udp_length;
+    put16(udp + 6, (uint16_t)~ones_complement(udp, udp_length, pseudo));
+    return 42U + payload;
+}
+
+static uint8_t checksums_valid(const uint8_t* frame)
+{
+    const uint8_t* ip = frame + 14;
+    uint32_t udp_length = ((uint32_t)ip[2] << 8 | ip[3]) - 20U;
+    uint32_t pseudo = ones_complement(ip + 12, 8, 0) + 17U + udp_length;
+    return ones_complement(ip, 20, 0) == 0xFFFFU && ones_complement(ip + 20, udp_length, pseudo) == 0xFFFFU;
+}
+
+/* Copies a received chain out, checking that each buffer but the last is full */
+static uint32_t flatten(msg_t* frame, uint8_t* out)
+{
+    uint32_t length = 0;
+    for (msg_t* buf = frame; buf != NULL; buf = eth_buf_next(buf)) {
+        if (eth_buf_next(buf) != NULL) {
+            TEST_ASSERT_EQUAL(BUFFER, buf->length);
+        }
+        memcpy(out + length, eth_buf_data(buf), buf->length);
+        length += buf->length;
+    }
+    return length;
+}
+
+static void expect_received(const uint8_t* frame, uint32_t length, uint16_t type)
+{
+    uint8_t data[ETH_FRAME_MAX];
+    msg_t* head = mailbox_fetch(&rx_output);
+    TEST_ASSERT_NOT_NULL(head);
+    TEST_ASSERT_EQUAL(type, head->type);
+    TEST_ASSERT_EQUAL(length, eth_buf_total(head));
+    TEST_ASSERT_EQUAL(length, flatten(head, data));
+    TEST_ASSERT_EQUAL_MEMORY(frame, data, length);
+    eth_buf_free(head);
+}
+
+/* A chain of buffers from the TX pool holding the frame, split bytes to a buffer */
+static msg_t* tx_chain(const uint8_t* frame, uint32_t length, uint32_t split)
+{
+    msg_t* head = NULL;
+    for (uint32_t done = 0; done < length;) {
+        uint32_t chunk = (length - done < split) ? length - done : split;
+        msg_t* buf = eth_buf_alloc(&tx_pool);
+        if (buf == NULL) {
+            TEST_FAIL_MESSAGE("TX pool empty");
+            return head;
+        }
+        memcpy(eth_buf_data(buf), frame + done, chunk);
+        buf->length = (uint16_t)chunk;
+        if (head == NULL) {
+            head = buf;
+        } else {
+            eth_buf_append(head, buf);
+        }
+        done += chunk;
+    }
+    return head;
+}
+
+/* A capture of the frames in the given byte order */
+static uint32_t pcap(uint8_t* out, uint8_t* const* frames, const uint32_t* lengths, uint32_t count, uint8_t big_endian)
+{
+    uint32_t header[6] = { 0xA1B2C3D4U, 0x00040002U, 0, 0, 65535, 1 };
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < 6U; i++) {
+        uint32_t value = (i == 1U) ? (big_endian ? 0x00020004U : 0x00040002U) : header[i];
+        value = big_endian ? __builtin_bswap32(value) : value;
+        memcpy(out + offset, &value, 4);
+        offset += 4;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t record[4] = { i, 0, lengths[i], lengths[i] };
+        for (uint32_t j = 0; j < 4U; j++) {
+            uint32_t value = big_endian ? __builtin_bswap32(record[j]) : record[j];
+            memcpy(out + offset, &value, 4);
+            offset += 4;
+        }
+        memcpy(out + offset, frames[i], lengths[i]);
+        offset += lengths[i];
+    }
+    return offset;
+}
+
+static uint8_t nvic_enabled(uint32_t irqn)
+{
+    for (int32_t i = hal_reg_trace_find(&hal_sim_nvic.ISER[irqn >> 5], 0); i >= 0;
+         i = hal_reg_trace_find(&hal_sim_nvic.ISER[irqn >> 5], (uint32_t)i + 1U)) {
+        if (hal_reg_trace[i].value & (1U << (irqn & 31U))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(&eth_sim_regs, 0, sizeof(eth_sim_regs));
+    memset(eth_sim_phy, 0, sizeof(eth_sim_phy));
+    eth_sim_syscfg_pmc = 0;
+    hal_reg_trace_reset();
+    msg_pool_init(&rx_pool, rx_storage, ETH_BUF_PAYLOAD(BUFFER), RX_BUFFERS);
+    msg_pool_init(&tx_pool, tx_storage, ETH_BUF_PAYLOAD(BUFFER), TX_BUFFERS);
+    mailbox_init(&rx_output, NULL, NULL);
+
+    memset(&config, 0, sizeof(config));
+    config.hclk_hz = 168000000;
+    memcpy(config.mac, local_mac, 6);
+    config.rmii = 1;
+    config.speed_100 = 1;
+    config.full_duplex = 1;
+    config.checksum_offload = 1;
+    config.rx_pool = &rx_pool;
+    config.rx_output = &rx_output;
+}
+
+void tearDown(void)
+{
+    eth_deinit(&eth);
+}
+
+static void start(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, eth_init(&eth, &config));
+}
+
+/* ------------------------------------------------------------ tests --- */
+
+void test_init_rejects_invalid_configurations(void)
+{
+    static MSG_POOL_STORAGE(small_storage, ETH_BUF_PAYLOAD(BUFFER), RX_BUFFERS);
+    msg_pool_t small;
+    eth_config_t bad = config;
+
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(NULL, &config));
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&eth, NULL));
+    bad.rx_output = NULL;
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&eth, &bad));
+    bad = config;
+    bad.hclk_hz = 16000000;
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&eth, &bad));
+    bad.hclk_hz = 180000000;
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&eth, &bad));
+
+    /* Buffers below ETH_RX_BUFFER_MIN, then too few buffers to fill the ring and swap one */
+    msg_pool_init(&small, small_storage, ETH_BUF_PAYLOAD(64), RX_BUFFERS);
+    bad = config;
+    bad.rx_pool = &small;
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&eth, &bad));
+    msg_pool_init(&small, small_storage, ETH_BUF_PAYLOAD(BUFFER), ETH_RX_RING_LENGTH);
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&eth, &bad));
+
+    start();
+    eth_t other;
+    TEST_ASSERT_EQUAL(FAILURE, eth_init(&other, &config));
+}
+
+void test_init_programs_mac_dma_and_rings(void)
+{
+    start();
+    eth_regs_t* regs = &eth_sim_regs;
+
+    TEST_ASSERT_EQUAL_HEX32(7U << 25, hal_sim_rcc.AHB1ENR);
+    TEST_ASSERT_EQUAL_HEX32(ETH_SYSCFG_PMC_RMII, eth_sim_syscfg_pmc);
+    TEST_ASSERT_TRUE(nvic_enabled(61));
+
+    TEST_ASSERT_EQUAL_HEX32(ETH_MACCR_FES | ETH_MACCR_DM | ETH_MACCR_IPCO | ETH_MACCR_CSTF | ETH_MACCR_APCS |
+                                ETH_MACCR_TE | ETH_MACCR_RE,
+                            regs->MACCR);
+    TEST_ASSERT_EQUAL_HEX32(0x5634, regs->MACA0HR);
+    TEST_ASSERT_EQUAL_HEX32(0x12000002, regs->MACA0LR);
+    TEST_ASSERT_EQUAL_HEX32(0, regs->MACFFR);
+    TEST_ASSERT_EQUAL_HEX32(ETH_DMAOMR_TSF | ETH_DMAOMR_RSF | ETH_DMAOMR_ST | ETH_DMAOMR_SR, regs->DMAOMR);
+    TEST_ASSERT_EQUAL_HEX32((uint32_t)(uintptr_t)&eth.rx_desc[0], regs->DMARDLAR);
+    TEST_ASSERT_EQUAL_HEX32((uint32_t)(uintptr_t)&eth.tx_desc[0], regs->DMATDLAR);
+    TEST_ASSERT_EQUAL_HEX32(ETH_DMAIER_NISE | ETH_DMAIER_AISE | ETH_DMAIER_RIE | ETH_DMAIER_TIE | ETH_DMAIER_RBUIE |
+                                ETH_DMAIER_FBEIE,
+                            regs->DMAIER);
+
+    /* The DMA reset comes before any other DMA register is written */
+    int32_t reset = hal_reg_trace_find(&regs->DMABMR, 0);
+    TEST_ASSERT_TRUE(reset >= 0);
+    TEST_ASSERT_EQUAL_HEX32(ETH_DMABMR_SR, hal_reg_trace[reset].value);
+    TEST_ASSERT_TRUE(hal_reg_trace_find(&regs->DMARDLAR, 0) > reset);
+
+    /* The whole ring is the DMA's, chained in a circle, one pool buffer each */
+    TEST_ASSERT_EQUAL(ETH_RX_RING_LENGTH, rx_pool.in_use);
+    for (uint32_t i = 0; i < ETH_RX_RING_LENGTH; i++) {
+        TEST_ASSERT_EQUAL_HEX32(ETH_DES0_OWN, eth.rx_desc[i].status);
+        TEST_ASSERT_EQUAL_HEX32(ETH_RDES1_RCH | BUFFER, eth.rx_desc[i].control);
+        TEST_ASSERT_EQUAL_PTR(&eth.rx_desc[(i + 1U) % ETH_RX_RING_LENGTH], eth.rx_desc[i].next);
+        TEST_ASSERT_EQUAL_PTR(eth_buf_data(eth.rx_buf[i]), eth.rx_desc[i].buffer);
+        TEST_ASSERT_EQUAL(0, (uintptr_t)eth.rx_desc[i].buffer & 3U);
+    }
+}
+
+void test_received_frame_is_posted_without_a_copy(void)
+{
+    uint8_t frame[128];
+    start();
+    void* buffer = eth.rx_desc[0].buffer;
+    uint32_t length = udp_frame(frame, local_mac, 60, 1);
+
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+
+    msg_t* head = mailbox_fetch(&rx_output);
+    TEST_ASSERT_NOT_NULL(head);
+    TEST_ASSERT_EQUAL_PTR(buffer, eth_buf_data(head));
+    TEST_ASSERT_NULL(eth_buf_next(head));
+    TEST_ASSERT_EQUAL(length, head->length);
+    TEST_ASSERT_EQUAL_MEMORY(frame, eth_buf_data(head), length);
+    TEST_ASSERT_EQUAL(ETH_RX_CHECKSUM_OK, head->type);
+
+    /* The descriptor went back to the DMA with a fresh buffer */
+    TEST_ASSERT_EQUAL_HEX32(ETH_DES0_OWN, eth.rx_desc[0].status);
+    TEST_ASSERT_TRUE(eth.rx_desc[0].buffer != buffer);
+    TEST_ASSERT_EQUAL(ETH_RX_RING_LENGTH + 1U, rx_pool.in_use);
+    eth_buf_free(head);
+    TEST_ASSERT_EQUAL(ETH_RX_RING_LENGTH, rx_pool.in_use);
+
+    const eth_stats_t* stats = eth_get_stats(&eth);
+    TEST_ASSERT_EQUAL(1, stats->rx_frames);
+    TEST_ASSERT_EQUAL(length, stats->rx_bytes);
+    TEST_ASSERT_EQUAL(1, stats->rx_interrupts);
+}
+
+void test_large_frames_arrive_as_chains(void)
+{
+    uint8_t frame[ETH_FRAME_MAX];
+    start();
+
+    uint32_t length = udp_frame(frame, local_mac, 1472, 7);
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    expect_received(frame, length, ETH_RX_CHECKSUM_OK);
+
+    /* Six buffers; the ring keeps going after wrapping */
+    length = udp_frame(frame, local_mac, 700, 9);
+    for (uint32_t i = 0; i < 4U; i++) {
+        TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+        expect_received(frame, length, ETH_RX_CHECKSUM_OK);
+    }
+    TEST_ASSERT_EQUAL(5, eth_get_stats(&eth)->rx_frames);
+    TEST_ASSERT_EQUAL(ETH_RX_RING_LENGTH, rx_pool.in_use);
+}
+
+void test_address_filter(void)
+{
+    uint8_t frame[128];
+    static const uint8_t other[6] = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x57 };
+    static const uint8_t multicast[6] = { 0x01, 0x00, 0x5E, 0x00, 0x00, 0xFB };
+    start();
+
+    uint32_t length = udp_frame(frame, other, 40, 0);
+    TEST_ASSERT_EQUAL(0, eth_sim_receive(&eth, frame, length));
+    udp_frame(frame, multicast, 40, 0);
+    TEST_ASSERT_EQUAL(0, eth_sim_receive(&eth, frame, length));
+    udp_frame(frame, broadcast_mac, 40, 0);
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    expect_received(frame, length, ETH_RX_CHECKSUM_OK);
+    eth_deinit(&eth);
+
+    config.all_multicast = 1;
+    start();
+    udp_frame(frame, multicast, 40, 0);
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    udp_frame(frame, other, 40, 0);
+    TEST_ASSERT_EQUAL(0, eth_sim_receive(&eth, frame, length));
+    eth_deinit(&eth);
+
+    config.promiscuous = 1;
+    start();
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    TEST_ASSERT_EQUAL_HEX32(ETH_MACFFR_PM | ETH_MACFFR_PAM, eth_sim_regs.MACFFR);
+}
+
+void test_receive_checksum_offload(void)
+{
+    uint8_t frame[128];
+    start();
+    uint32_t length = udp_frame(frame, local_mac, 40, 3);
+
+    /* Bad payload checksum, then bad header checksum: both dropped by the driver */
+    frame[50] ^= 0x40;
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    frame[50] ^= 0x40;
+    frame[14 + 8] = 1;
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(2, eth_get_stats(&eth)->rx_checksum_errors);
+
+    /* Not IP: passed on without the flag */
+    uint8_t arp[60];
+    memset(arp, 0, sizeof(arp));
+    memcpy(arp, broadcast_mac, 6);
+    memcpy(arp + 6, peer_mac, 6);
+    put16(arp + 12, 0x0806);
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, arp, sizeof(arp)));
+    expect_received(arp, sizeof(arp), 0);
+    eth_deinit(&eth);
+
+    /* Without offload the stack gets the bad frame and checks it itself */
+    config.checksum_offload = 0;
+    start();
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    expect_received(frame, length, 0);
+    TEST_ASSERT_EQUAL(0, eth_get_stats(&eth)->rx_checksum_errors);
+}
+
+void test_empty_pool_drops_frames_and_keeps_the_ring_full(void)
+{
+    uint8_t frame[600];
+    msg_t* held[RX_BUFFERS];
+    uint32_t spare = RX_BUFFERS - ETH_RX_RING_LENGTH;
+    start();
+
+    /* The application holds on to every spare buffer... */
+    uint32_t small = udp_frame(frame, local_mac, 100, 5);
+    for (uint32_t i = 0; i < spare; i++) {
+        TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, small));
+        held[i] = mailbox_fetch(&rx_output);
+        TEST_ASSERT_NOT_NULL(held[i]);
+    }
+    /* ...so the next frame is dropped and its descriptor handed straight back */
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, small));
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(1, eth_get_stats(&eth)->rx_no_buffer);
+    for (uint32_t i = 0; i < ETH_RX_RING_LENGTH; i++) {
+        TEST_ASSERT_EQUAL_HEX32(ETH_DES0_OWN, eth.rx_desc[i].status);
+    }
+
+    /* One buffer back: a two-buffer frame takes it for its first part and drops the rest */
+    eth_buf_free(held[0]);
+    uint32_t length = udp_frame(frame, local_mac, 400, 5);
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(2, eth_get_stats(&eth)->rx_no_buffer);
+    TEST_ASSERT_EQUAL(RX_BUFFERS - 1U, rx_pool.in_use);
+
+    for (uint32_t i = 1; i < spare; i++) {
+        eth_buf_free(held[i]);
+    }
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    expect_received(frame, length, ETH_RX_CHECKSUM_OK);
+}
+
+void test_ring_overrun_suspends_and_resumes(void)
+{
+    uint8_t frame[128];
+    config.rx_watchdog = 4;
+    start();
+    TEST_ASSERT_EQUAL_HEX32(ETH_RDES1_DIC | ETH_RDES1_RCH | BUFFER, eth.rx_desc[0].control);
+    TEST_ASSERT_EQUAL(4, eth_sim_regs.DMARSWTR);
+    uint32_t length = udp_frame(frame, local_mac, 60, 0);
+
+    /* Completion interrupts are suppressed, so the ring fills up */
+    for (uint32_t i = 0; i < ETH_RX_RING_LENGTH; i++) {
+        TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    }
+    TEST_ASSERT_EQUAL(0, eth_get_stats(&eth)->rx_interrupts);
+
+    /* The next frame finds no descriptor: missed, and the interrupt drains the ring and resumes */
+    TEST_ASSERT_EQUAL(0, eth_sim_receive(&eth, frame, length));
+    TEST_ASSERT_EQUAL(1, eth_sim_regs.DMAMFBOCR);
+    TEST_ASSERT_TRUE(hal_reg_trace_find(&eth_sim_regs.DMARPDR, 0) >= 0);
+    const eth_stats_t* stats = eth_get_stats(&eth);
+    TEST_ASSERT_EQUAL(1, stats->rx_ring_full);
+    TEST_ASSERT_EQUAL(ETH_RX_RING_LENGTH, stats->rx_frames);
+
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    eth_sim_rx_watchdog(&eth);
+    TEST_ASSERT_EQUAL(ETH_RX_RING_LENGTH + 1U, stats->rx_frames);
+    TEST_ASSERT_EQUAL(2, stats->rx_interrupts);
+}
+
+void test_pcap_playback_coalesces_interrupts(void)
+{
+    static uint8_t capture[8192];
+    uint8_t frames[5][200];
+    uint8_t* list[5];
+    uint32_t lengths[5];
+    config.rx_watchdog = 1;
+    for (uint32_t i = 0; i < 5U; i++) {
+        lengths[i] = udp_frame(frames[i], local_mac, 20U + 30U * i, (uint8_t)i);
+        list[i] = frames[i];
+    }
+
+    for (uint8_t big_endian = 0; big_endian < 2U; big_endian++) {
+        start();
+        uint32_t size = pcap(capture, list, lengths, 5, big_endian);
+        TEST_ASSERT_EQUAL(5, eth_sim_play_pcap(&eth, capture, size));
+        TEST_ASSERT_EQUAL(1, eth_get_stats(&eth)->rx_interrupts);
+        for (uint32_t i = 0; i < 5U; i++) {
+            expect_received(frames[i], lengths[i], ETH_RX_CHECKSUM_OK);
+        }
+
+        /* A truncated record, and a capture of something other than Ethernet */
+        TEST_ASSERT_EQUAL(-1, eth_sim_play_pcap(&eth, capture, size - 1U));
+        capture[big_endian ? 23 : 20] = 105;
+        TEST_ASSERT_EQUAL(-1, eth_sim_play_pcap(&eth, capture, size));
+        eth_deinit(&eth);
+    }
+}
+
+void test_pcap_file_playback(void)
+{
+    static uint8_t capture[4096];
+    uint8_t frames[3][128];
+    uint8_t* list[3];
+    uint32_t lengths[3];
+    const char* path = "test_eth_capture.pcap";
+    for (uint32_t i = 0; i < 3U; i++) {
+        lengths[i] = udp_frame(frames[i], local_mac, 50U + i, (uint8_t)(i * 3U));
+        list[i] = frames[i];
+    }
+    uint32_t size = pcap(capture, list, lengths, 3, 0);
+    FILE* file = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL(size, fwrite(capture, 1, size, file));
+    fclose(file);
+
+    start();
+    TEST_ASSERT_EQUAL(3, eth_sim_play_pcap_file(&eth, path));
+    remove(path);
+    for (uint32_t i = 0; i < 3U; i++) {
+        expect_received(frames[i], lengths[i], ETH_RX_CHECKSUM_OK);
+    }
+    TEST_ASSERT_EQUAL(-1, eth_sim_play_pcap_file(&eth, path));
+}
+
+void test_transmit_chain_without_a_copy(void)
+{
+    uint8_t frame[600];
+    uint8_t out[ETH_FRAME_MAX];
+    start();
+    uint32_t length = udp_frame(frame, peer_mac, 500, 2);
+
+    msg_t* head = tx_chain(frame, length, 200);
+    TEST_ASSERT_EQUAL(SUCCESS, eth_send(&eth, head));
+    TEST_ASSERT_EQUAL_PTR(eth_buf_data(head), eth.tx_desc[0].buffer);
+    TEST_ASSERT_EQUAL_HEX32(ETH_DES0_OWN | ETH_TDES0_TCH | ETH_TDES0_CIC_FULL | ETH_TDES0_FS, eth.tx_desc[0].status);
+    TEST_ASSERT_TRUE(eth.tx_desc[2].status & ETH_TDES0_LS);
+    TEST_ASSERT_TRUE(eth.tx_desc[2].status & ETH_TDES0_IC);
+    TEST_ASSERT_TRUE(hal_reg_trace_find(&eth_sim_regs.DMATPDR, 0) >= 0);
+
+    TEST_ASSERT_EQUAL(length, eth_sim_transmit(&eth, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY(frame, out, length);
+    TEST_ASSERT_EQUAL(0, eth_sim_transmit(&eth, out, sizeof(out)));
+
+    const eth_stats_t* stats = eth_get_stats(&eth);
+    TEST_ASSERT_EQUAL(1, stats->tx_frames);
+    TEST_ASSERT_EQUAL(length, stats->tx_bytes);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+}
+
+void test_transmit_checksum_insertion(void)
+{
+    uint8_t frame[128];
+    uint8_t out[128];
+    start();
+    uint32_t length = udp_frame(frame, peer_mac, 30, 4);
+    TEST_ASSERT_TRUE(checksums_valid(frame));
+
+    /* The stack leaves the checksums to the MAC */
+    memset(frame + 24, 0, 2);
+    memset(frame + 40, 0, 2);
+    TEST_ASSERT_EQUAL(SUCCESS, eth_send(&eth, tx_chain(frame, length, BUFFER)));
+    TEST_ASSERT_EQUAL(length, eth_sim_transmit(&eth, out, sizeof(out)));
+    TEST_ASSERT_TRUE(checksums_valid(out));
+    eth_deinit(&eth);
+
+    config.checksum_offload = 0;
+    start();
+    TEST_ASSERT_EQUAL(SUCCESS, eth_send(&eth, tx_chain(frame, length, BUFFER)));
+    TEST_ASSERT_EQUAL(length, eth_sim_transmit(&eth, out, sizeof(out)));
+    TEST_ASSERT_FALSE(checksums_valid(out));
+}
+
+void test_short_frames_are_padded(void)
+{
+    uint8_t frame[64];
+    uint8_t out[64];
+    start();
+    uint32_t length = udp_frame(frame, peer_mac, 4, 0);
+    TEST_ASSERT_EQUAL(SUCCESS, eth_send(&eth, tx_chain(frame, length, BUFFER)));
+    TEST_ASSERT_EQUAL(60, eth_sim_transmit(&eth, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY(frame, out, length);
+}
+
+void test_transmit_backlog_keeps_order(void)
+{
+    uint8_t frames[5][128];
+    uint8_t out[128];
+    start();
+
+    /* Three buffers each: two fit in the ring, three wait */
+    for (uint32_t i = 0; i < 5U; i++) {
+        uint32_t length = udp_frame(frames[i], peer_mac, 60, (uint8_t)(i * 11U));
+        TEST_ASSERT_EQUAL(SUCCESS, eth_send(&eth, tx_chain(frames[i], length, 40)));
+    }
+    TEST_ASSERT_EQUAL(6, eth.tx_used);
+    TEST_ASSERT_EQUAL(3, eth_get_stats(&eth)->tx_backlogged);
+
+    for (uint32_t i = 0; i < 5U; i++) {
+        TEST_ASSERT_EQUAL(102, eth_sim_transmit(&eth, out, sizeof(out)));
+        TEST_ASSERT_EQUAL_MEMORY(frames[i], out, 102);
+    }
+    TEST_ASSERT_EQUAL(5, eth_get_stats(&eth)->tx_frames);
+    TEST_ASSERT_EQUAL(0, eth.tx_used);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+}
+
+void test_send_rejects_invalid_chains(void)
+{
+    uint8_t frame[ETH_FRAME_MAX + 1U];
+    memset(frame, 0x5A, sizeof(frame));
+    start();
+
+    msg_t* empty = eth_buf_alloc(&tx_pool);
+    TEST_ASSERT_EQUAL(FAILURE, eth_send(&eth, empty));
+    TEST_ASSERT_EQUAL(FAILURE, eth_send(&eth, NULL));
+    msg_free(empty);
+
+    msg_t* oversize = tx_chain(frame, sizeof(frame), BUFFER);
+    TEST_ASSERT_EQUAL(FAILURE, eth_send(&eth, oversize));
+    eth_buf_free(oversize);
+
+    msg_t* scattered = tx_chain(frame, ETH_TX_RING_LENGTH + 1U, 1);
+    TEST_ASSERT_EQUAL(FAILURE, eth_send(&eth, scattered));
+    eth_buf_free(scattered);
+
+    eth_deinit(&eth);
+    msg_t* late = tx_chain(frame, 64, BUFFER);
+    TEST_ASSERT_EQUAL(FAILURE, eth_send(&eth, late));
+    eth_buf_free(late);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+}
+
+void test_mdio_and_link(void)
+{
+    uint16_t value = 0;
+    start();
+    eth_sim_phy[1] = 0x782D;
+
+    TEST_ASSERT_EQUAL(SUCCESS, eth_phy_read(&eth, 0, 1, &value));
+    TEST_ASSERT_EQUAL_HEX16(0x782D, value);
+    int32_t read = hal_reg_trace_find(&eth_sim_regs.MACMIIAR, 0);
+    TEST_ASSERT_EQUAL_HEX32((1U << ETH_MACMIIAR_MR_Pos) | (4U << ETH_MACMIIAR_CR_Pos) | ETH_MACMIIAR_MB,
+                            hal_reg_trace[read].value);
+
+    TEST_ASSERT_EQUAL(SUCCESS, eth_phy_write(&eth, 0, 0, 0x1200));
+    TEST_ASSERT_EQUAL_HEX16(0x1200, eth_sim_phy[0]);
+
+    /* Stuck busy bit */
+    eth_sim_regs.MACMIIAR = ETH_MACMIIAR_MB;
+    TEST_ASSERT_EQUAL(FAILURE, eth_phy_read(&eth, 0, 1, &value));
+    eth_sim_regs.MACMIIAR = 0;
+
+    eth_set_link(&eth, 0, 0);
+    TEST_ASSERT_EQUAL_HEX32(0, eth_sim_regs.MACCR & (ETH_MACCR_FES | ETH_MACCR_DM));
+    TEST_ASSERT_TRUE(eth_sim_regs.MACCR & ETH_MACCR_RE);
+    eth_set_link(&eth, 1, 1);
+    TEST_ASSERT_EQUAL_HEX32(ETH_MACCR_FES | ETH_MACCR_DM, eth_sim_regs.MACCR & (ETH_MACCR_FES | ETH_MACCR_DM));
+}
+
+void test_bus_error_is_counted(void)
+{
+    start();
+    eth_sim_regs.DMASR |= ETH_DMASR_FBES | ETH_DMASR_AIS;
+    eth_irq();
+    TEST_ASSERT_EQUAL(1, eth_get_stats(&eth)->bus_errors);
+    TEST_ASSERT_EQUAL_HEX32(0, eth_sim_regs.DMASR);
+}
+
+void test_deinit_returns_every_buffer(void)
+{
+    uint8_t frame[128];
+    start();
+    uint32_t length = udp_frame(frame, peer_mac, 60, 0);
+    for (uint32_t i = 0; i < 4U; i++) {
+        TEST_ASSERT_EQUAL(SUCCESS, eth_send(&eth, tx_chain(frame, length, 40)));
+    }
+    TEST_ASSERT_TRUE(eth.tx_backlog.head != NULL);
+
+    eth_deinit(&eth);
+    TEST_ASSERT_EQUAL(0, rx_pool.in_use);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL_HEX32(0, eth_sim_regs.MACCR & (ETH_MACCR_TE | ETH_MACCR_RE));
+    TEST_ASSERT_EQUAL(0, eth_sim_receive(&eth, frame, length));
+
+    /* And the driver can start again */
+    start();
+    length = udp_frame(frame, local_mac, 60, 0);
+    TEST_ASSERT_EQUAL(1, eth_sim_receive(&eth, frame, length));
+    expect_received(frame, length, ETH_RX_CHECKSUM_OK);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_programs_mac_dma_and_rings);
+    RUN_TEST(test_received_frame_is_posted_without_a_copy);
+    RUN_TEST(test_large_frames_arrive_as_chains);
+    RUN_TEST(test_address_filter);
+    RUN_TEST(test_receive_checksum_offload);
+    RUN_TEST(test_empty_pool_drops_frames_and_keeps_the_ring_full);
+    RUN_TEST(test_ring_overrun_suspends_and_resumes);
+    RUN_TEST(test_pcap_playback_coalesces_interrupts);
+    RUN_TEST(test_pcap_file_playback);
+    RUN_TEST(test_transmit_chain_without_a_copy);
+    RUN_TEST(test_transmit_checksum_insertion);
+    RUN_TEST(test_short_frames_are_padded);
+    RUN_TEST(test_transmit_backlog_keeps_order);
+    RUN_TEST(test_send_rejects_invalid_chains);
+    RUN_TEST(test_mdio_and_link);
+    RUN_TEST(test_bus_error_is_counted);
+    RUN_TEST(test_deinit_returns_every_buffer);
+    return UNITY_END();
+}
@@ -0,0 +1,100 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/feature_hooks/feature_hooks.h"
+#include <stdio.h>
+#include <string.h>
+
+static int side_effects;
+
+static int touch(void)
+{
+    return ++side_effects;
+}
+
+void setUp(void)
+{
+    side_effects = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_build_config_version_matches_string(void)
+{
+    char version[32];
+    snprintf(version, sizeof(version), "%d.%d.%d",
+        BUILD_CFG_FW_VERSION_MAJOR, BUILD_CFG_FW_VERSION_MINOR, BUILD_CFG_FW_VERSION_PATCH);
+    TEST_ASSERT_EQUAL_STRING(BUILD_CFG_FW_VERSION, version);
+}
+
+void test_build_config_ids_are_constant(void)
+{
+    /* Usable in preprocessor conditions, so hot paths can be specialized */
+#if BUILD_CFG_CLIENT_ID < 0 || BUILD_CFG_ENVIRONMENT_ID < 0
+    TEST_FAIL_MESSAGE("identifiers must be non-negative constants");
+#endif
+    TEST_ASSERT_TRUE(strlen(BUILD_CFG_CLIENT) > 0);
+}
+
+void test_stat_hooks_follow_feature_flag(void)
+{
+    uint32_t counter = 0;
+    STAT_INC(counter);
+    STAT_ADD(counter, 2);
+    STAT_MAX(counter, 10U);
+    TEST_ASSERT_EQUAL_UINT32(BUILD_CFG_FEATURE_STATS ? 10U : 0U, counter);
+    STAT_SET(counter, 4U);
+    TEST_ASSERT_EQUAL_UINT32(BUILD_CFG_FEATURE_STATS ? 4U : 0U, counter);
+
+    uint32_t least = 0;
+    STAT_MIN(least, 7U);
+    STAT_MIN(least, 9U);
+    STAT_MIN(least, 5U);
+    TEST_ASSERT_EQUAL_UINT32(BUILD_CFG_FEATURE_STATS ? 5U : 0U, least);
+}
+
+void test_disabled_hooks_do_not_evaluate_arguments(void)
+{
+    int expected = 0;
+
+    TRACE(1, touch());
+#if BUILD_CFG_FEATURE_TRACE
+    expected++;
+    TEST_ASSERT_EQUAL_UINT32(1, trace_buffer[(trace_count - 1) % TRACE_BUFFER_LENGTH].arg);
+#endif
+    LOG_INFO("%d", touch());
+#if BUILD_CFG_FEATURE_LOGGING && BUILD_CFG_LOG_LEVEL >= LOG_LEVEL_INFO
+    expected++;
+    printf("\n");
+#endif
+    LOG_WARN("%d", touch());
+#if BUILD_CFG_FEATURE_LOGGING && BUILD_CFG_LOG_LEVEL >= LOG_LEVEL_WARN
+    expected++;
+    printf("\n");
+#endif
+    TEST_ASSERT_EQUAL(expected, side_effects);
+}
+
+void test_lock_hooks_nest(void)
+{
+    LOCK_STATE(outer);
+    LOCK_STATE(inner);
+
+    LOCK_ACQUIRE(outer);
+    LOCK_ACQUIRE(inner);
+    side_effects++;
+    LOCK_RELEASE(inner);
+    LOCK_RELEASE(outer);
+    TEST_ASSERT_EQUAL(1, side_effects);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_build_config_version_matches_string);
+    RUN_TEST(test_build_config_ids_are_constant);
+    RUN_TEST(test_stat_hooks_follow_feature_flag);
+    RUN_TEST(test_disabled_hooks_do_not_evaluate_arguments);
+    RUN_TEST(test_lock_hooks_nest);
+    return UNITY_END();
+}
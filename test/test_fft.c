@@ -0,0 +1,301 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/dsp/fft.h"
+#include <string.h>
+
+/*
+ * Every size is checked against a double-precision DFT. Float transforms
+ * must agree to a small relative error; Q15 transforms, whose output is the
+ * DFT divided by the size, must keep the error power below a fixed fraction
+ * of the signal power on white noise as loud as the API allows.
+ */
+
+#define MAX_N FFT_MAX_SIZE
+#define PI 3.14159265358979323846
+
+static uint32_t seed;
+static double ref_cos[MAX_N], ref_sin[MAX_N];
+static double ref_re[MAX_N], ref_im[MAX_N];
+static q15_t buf15[2U * MAX_N];
+static float32_t buff[2U * MAX_N];
+static q15_t in15[2U * MAX_N];
+static float32_t inf[2U * MAX_N];
+
+static uint32_t next_random(void)
+{
+    seed = seed * 1664525U + 1013904223U;
+    return seed;
+}
+
+/* sin and cos of x in [-pi, pi] by Taylor series; the tests link no libm */
+static void sincos_ref(double x, double* s, double* c)
+{
+    double term_s = x, term_c = 1.0;
+    *s = 0.0;
+    *c = 0.0;
+    for (int k = 1; k < 40; k += 2) {
+        *s += term_s;
+        *c += term_c;
+        term_s *= -x * x / ((k + 1) * (k + 2));
+        term_c *= -x * x / (k * (k + 1));
+    }
+}
+
+static void prepare_twiddles(uint32_t n)
+{
+    for (uint32_t k = 0; k < n; k++) {
+        double angle = 2.0 * PI * k / n;
+        sincos_ref((angle > PI) ? angle - 2.0 * PI : angle, &ref_sin[k], &ref_cos[k]);
+    }
+}
+
+/* X[k] = sum x[t] exp(-/+ 2 pi i k t / n) of interleaved input */
+static void reference_dft(const double* re, const double* im, uint32_t n, uint8_t inverse)
+{
+    for (uint32_t k = 0; k < n; k++) {
+        double acc_re = 0.0, acc_im = 0.0;
+        for (uint32_t t = 0; t < n; t++) {
+            uint32_t index = (uint32_t)(((uint64_t)k * t) % n);
+            double c = ref_cos[index], s = inverse ? -ref_sin[index] : ref_sin[index];
+            acc_re += re[t] * c + im[t] * s;
+            acc_im += im[t] * c - re[t] * s;
+        }
+        ref_re[k] = acc_re;
+        ref_im[k] = acc_im;
+    }
+}
+
+static double work_re[MAX_N], work_im[MAX_N];
+static double out_re[MAX_N], out_im[MAX_N];
+
+static void reference_from_q15(const q15_t* in, uint32_t n, uint8_t inverse, uint8_t real)
+{
+    for (uint32_t t = 0; t < n; t++) {
+        work_re[t] = real ? in[t] : in[2U * t];
+        work_im[t] = real ? 0.0 : in[2U * t + 1U];
+    }
+    reference_dft(work_re, work_im, n, inverse);
+}
+
+static void reference_from_f32(const float32_t* in, uint32_t n, uint8_t inverse, uint8_t real)
+{
+    for (uint32_t t = 0; t < n; t++) {
+        work_re[t] = real ? in[t] : in[2U * t];
+        work_im[t] = real ? 0.0 : in[2U * t + 1U];
+    }
+    reference_dft(work_re, work_im, n, inverse);
+}
+
+/* Spreads a packed real-transform output over bins 0..n/2 */
+#define UNPACK_REAL(data, n)                                                                                         \
+    do {                                                                                                             \
+        out_re[0] = (data)[0];                                                                                       \
+        out_im[0] = 0.0;                                                                                             \
+        out_re[(n) / 2U] = (data)[1];                                                                                \
+        out_im[(n) / 2U] = 0.0;                                                                                      \
+        for (uint32_t k = 1; k < (n) / 2U; k++) {                                                                    \
+            out_re[k] = (data)[2U * k];                                                                              \
+            out_im[k] = (data)[2U * k + 1U];                                                                         \
+        }                                                                                                            \
+    } while (0)
+
+/* Error power over signal power between the reference and {re, im} pairs */
+static double noise_ratio(const double* re, const double* im, uint32_t bins, double scale)
+{
+    double signal = 0.0, noise = 0.0;
+    for (uint32_t k = 0; k < bins; k++) {
+        double dr = re[k] * scale - ref_re[k], di = im[k] * scale - ref_im[k];
+        signal += ref_re[k] * ref_re[k] + ref_im[k] * ref_im[k];
+        noise += dr * dr + di * di;
+    }
+    return noise / signal;
+}
+
+static double complex_ratio_q15(uint32_t n, uint8_t inverse)
+{
+    for (uint32_t i = 0; i < 2U * n; i++) {
+        in15[i] = (q15_t)(((int32_t)(int16_t)(next_random() >> 16) * 23170) >> 15); /* |x| <= 1 */
+    }
+    memcpy(buf15, in15, 2U * n * sizeof(q15_t));
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_q15(buf15, n, inverse));
+    reference_from_q15(in15, n, inverse, 0);
+    for (uint32_t k = 0; k < n; k++) {
+        out_re[k] = buf15[2U * k];
+        out_im[k] = buf15[2U * k + 1U];
+    }
+    return noise_ratio(out_re, out_im, n, (double)n);
+}
+
+static double real_ratio_q15(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        in15[i] = (q15_t)(next_random() >> 16);
+    }
+    memcpy(buf15, in15, n * sizeof(q15_t));
+    TEST_ASSERT_EQUAL(SUCCESS, fft_real_q15(buf15, n));
+    reference_from_q15(in15, n, 0, 1);
+    UNPACK_REAL(buf15, n);
+    return noise_ratio(out_re, out_im, n / 2U + 1U, (double)n);
+}
+
+static double complex_ratio_f32(uint32_t n, uint8_t inverse)
+{
+    for (uint32_t i = 0; i < 2U * n; i++) {
+        inf[i] = (float32_t)(int32_t)next_random() / 2147483648.0f;
+    }
+    memcpy(buff, inf, 2U * n * sizeof(float32_t));
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_f32(buff, n, inverse));
+    reference_from_f32(inf, n, inverse, 0);
+    for (uint32_t k = 0; k < n; k++) {
+        out_re[k] = buff[2U * k];
+        out_im[k] = buff[2U * k + 1U];
+    }
+    return noise_ratio(out_re, out_im, n, inverse ? (double)n : 1.0);
+}
+
+static double real_ratio_f32(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        inf[i] = (float32_t)(int32_t)next_random() / 2147483648.0f;
+    }
+    memcpy(buff, inf, n * sizeof(float32_t));
+    TEST_ASSERT_EQUAL(SUCCESS, fft_real_f32(buff, n));
+    reference_from_f32(inf, n, 0, 1);
+    UNPACK_REAL(buff, n);
+    return noise_ratio(out_re, out_im, n / 2U + 1U, 1.0);
+}
+
+void setUp(void)
+{
+    seed = 2024;
+}
+
+void tearDown(void)
+{
+}
+
+void test_fft_rejects_unsupported_sizes(void)
+{
+    TEST_ASSERT_EQUAL(FAILURE, fft_complex_q15(buf15, 0, 0));
+    TEST_ASSERT_EQUAL(FAILURE, fft_complex_q15(buf15, 2, 0));
+    TEST_ASSERT_EQUAL(FAILURE, fft_complex_f32(buff, 48, 0));
+    TEST_ASSERT_EQUAL(FAILURE, fft_complex_f32(buff, 2U * MAX_N, 0));
+    TEST_ASSERT_EQUAL(FAILURE, fft_complex_f32(NULL, 16, 0));
+    TEST_ASSERT_EQUAL(FAILURE, fft_real_q15(buf15, 4));
+    TEST_ASSERT_EQUAL(FAILURE, fft_real_q15(buf15, 2U * MAX_N));
+    TEST_ASSERT_EQUAL(FAILURE, fft_real_f32(buff, 96));
+}
+
+void test_fft_complex_f32_impulse_and_dc(void)
+{
+    memset(buff, 0, sizeof(buff));
+    buff[0] = 1.0f;
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_f32(buff, 512, 0));
+    for (uint32_t k = 0; k < 512U; k++) {
+        TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, buff[2U * k]);
+        TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, buff[2U * k + 1U]);
+    }
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_f32(buff, 512, 1));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, buff[0]);
+    for (uint32_t i = 1; i < 1024U; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, buff[i]);
+    }
+}
+
+void test_fft_q15_dc_lands_in_bin_zero(void)
+{
+    for (uint32_t i = 0; i < 256U; i++) {
+        buf15[2U * i] = 8192;
+        buf15[2U * i + 1U] = -4096;
+    }
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_q15(buf15, 256, 0));
+    TEST_ASSERT_EQUAL_INT16(8192, buf15[0]);
+    TEST_ASSERT_EQUAL_INT16(-4096, buf15[1]);
+    for (uint32_t i = 2; i < 512U; i++) {
+        TEST_ASSERT_INT_WITHIN(1, 0, buf15[i]);
+    }
+
+    for (uint32_t i = 0; i < 1024U; i++) {
+        buf15[i] = 16384;
+    }
+    TEST_ASSERT_EQUAL(SUCCESS, fft_real_q15(buf15, 1024));
+    TEST_ASSERT_EQUAL_INT16(16384, buf15[0]);
+    for (uint32_t i = 1; i < 1024U; i++) {
+        TEST_ASSERT_INT_WITHIN(1, 0, buf15[i]);
+    }
+}
+
+void test_fft_real_q15_full_scale_does_not_clip(void)
+{
+    for (uint32_t i = 0; i < 1024U; i += 2U) {
+        buf15[i] = INT16_MAX;
+        buf15[i + 1U] = INT16_MIN;
+    }
+    TEST_ASSERT_EQUAL(SUCCESS, fft_real_q15(buf15, 1024));
+    TEST_ASSERT_INT_WITHIN(1, 0, buf15[0]);
+    TEST_ASSERT_INT_WITHIN(1, INT16_MAX, buf15[1]);
+    for (uint32_t i = 2; i < 1024U; i++) {
+        TEST_ASSERT_INT_WITHIN(1, 0, buf15[i]);
+    }
+}
+
+void test_fft_complex_f32_matches_dft(void)
+{
+    for (uint32_t n = FFT_MIN_SIZE; n <= MAX_N; n *= 2U) {
+        prepare_twiddles(n);
+        TEST_ASSERT_LESS_THAN(1e-12, complex_ratio_f32(n, 0));
+        TEST_ASSERT_LESS_THAN(1e-12, complex_ratio_f32(n, 1));
+    }
+}
+
+void test_fft_real_f32_matches_dft(void)
+{
+    for (uint32_t n = 2U * FFT_MIN_SIZE; n <= MAX_N; n *= 2U) {
+        prepare_twiddles(n);
+        TEST_ASSERT_LESS_THAN(1e-12, real_ratio_f32(n));
+    }
+}
+
+void test_fft_complex_q15_matches_dft(void)
+{
+    for (uint32_t n = FFT_MIN_SIZE; n <= MAX_N; n *= 2U) {
+        prepare_twiddles(n);
+        TEST_ASSERT_LESS_THAN(1e-4, complex_ratio_q15(n, 0));
+        TEST_ASSERT_LESS_THAN(1e-4, complex_ratio_q15(n, 1));
+    }
+}
+
+void test_fft_real_q15_matches_dft(void)
+{
+    for (uint32_t n = 2U * FFT_MIN_SIZE; n <= MAX_N; n *= 2U) {
+        prepare_twiddles(n);
+        TEST_ASSERT_LESS_THAN(1e-4, real_ratio_q15(n));
+    }
+}
+
+void test_fft_f32_round_trip(void)
+{
+    for (uint32_t i = 0; i < 2U * 2048U; i++) {
+        inf[i] = (float32_t)(int32_t)next_random() / 2147483648.0f;
+    }
+    memcpy(buff, inf, 2U * 2048U * sizeof(float32_t));
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_f32(buff, 2048, 0));
+    TEST_ASSERT_EQUAL(SUCCESS, fft_complex_f32(buff, 2048, 1));
+    for (uint32_t i = 0; i < 2U * 2048U; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(1e-5f, inf[i], buff[i]);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fft_rejects_unsupported_sizes);
+    RUN_TEST(test_fft_complex_f32_impulse_and_dc);
+    RUN_TEST(test_fft_q15_dc_lands_in_bin_zero);
+    RUN_TEST(test_fft_real_q15_full_scale_does_not_clip);
+    RUN_TEST(test_fft_complex_f32_matches_dft);
+    RUN_TEST(test_fft_real_f32_matches_dft);
+    RUN_TEST(test_fft_complex_q15_matches_dft);
+    RUN_TEST(test_fft_real_q15_matches_dft);
+    RUN_TEST(test_fft_f32_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,178 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/fixed_containers/inplace_function.hpp"
+#include "../lib/fixed_containers/ring.hpp"
+#include "../lib/fixed_containers/static_string.hpp"
+#include "../lib/fixed_containers/static_vector.hpp"
+
+/* Counts live instances to check that constructors and destructors pair up */
+struct tracked {
+    static int live;
+    int value;
+
+    tracked(int v)
+        : value(v)
+    {
+        live++;
+    }
+
+    tracked(const tracked& other)
+        : value(other.value)
+    {
+        live++;
+    }
+
+    tracked& operator=(const tracked& other) = default;
+
+    ~tracked()
+    {
+        live--;
+    }
+};
+
+int tracked::live = 0;
+
+/* Global with a constructor, run through __libc_init_array on the target */
+static fixed::static_string<16> boot_banner("fw");
+
+void setUp(void)
+{
+    tracked::live = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_static_vector_trivial(void)
+{
+    const int initial[] = { 1, 2, 3 };
+    fixed::static_vector<int, 4> vector(initial);
+
+    TEST_ASSERT_EQUAL(3, vector.size());
+    TEST_ASSERT_TRUE(vector.push_back(4));
+    TEST_ASSERT_FALSE(vector.push_back(5));
+
+    TEST_ASSERT_TRUE(vector.erase(0));
+    TEST_ASSERT_TRUE(vector.insert(1, 9));
+    const int expected[] = { 2, 9, 3, 4 };
+    TEST_ASSERT_EQUAL_INT32_ARRAY(expected, vector.data(), 4);
+
+    fixed::static_vector<int, 4> copy = vector;
+    TEST_ASSERT_EQUAL(9, copy[1]);
+}
+
+void test_static_vector_non_trivial(void)
+{
+    {
+        fixed::static_vector<tracked, 4> vector;
+        vector.emplace_back(1);
+        vector.emplace_back(2);
+        vector.emplace_back(3);
+        TEST_ASSERT_EQUAL(3, tracked::live);
+
+        TEST_ASSERT_TRUE(vector.insert(0, tracked(0)));
+        TEST_ASSERT_EQUAL(4, tracked::live);
+        TEST_ASSERT_EQUAL(0, vector.front().value);
+        TEST_ASSERT_EQUAL(3, vector.back().value);
+
+        TEST_ASSERT_TRUE(vector.erase(1));
+        TEST_ASSERT_EQUAL(3, tracked::live);
+        TEST_ASSERT_EQUAL(2, vector[1].value);
+
+        vector.pop_back();
+        TEST_ASSERT_EQUAL(2, tracked::live);
+
+        /* The value inserted is one of the elements shifted to make room */
+        TEST_ASSERT_TRUE(vector.insert(0, vector[1]));
+        TEST_ASSERT_EQUAL(3, tracked::live);
+        TEST_ASSERT_EQUAL(2, vector[0].value);
+        TEST_ASSERT_EQUAL(0, vector[1].value);
+        TEST_ASSERT_EQUAL(2, vector[2].value);
+    }
+    TEST_ASSERT_EQUAL(0, tracked::live);
+}
+
+void test_ring_wraps_and_bulk_copies(void)
+{
+    fixed::ring<uint8_t, 8> ring;
+    const uint8_t data[] = { 1, 2, 3, 4, 5, 6 };
+    uint8_t out[8];
+
+    TEST_ASSERT_EQUAL(6, ring.push_n(data, 6));
+    TEST_ASSERT_EQUAL(4, ring.pop_n(out, 4));
+    /* Crosses the end of the buffer */
+    TEST_ASSERT_EQUAL(6, ring.push_n(data, 6));
+    TEST_ASSERT_EQUAL(8, ring.size());
+    TEST_ASSERT_FALSE(ring.push(7));
+
+    TEST_ASSERT_EQUAL(8, ring.pop_n(out, 8));
+    const uint8_t expected[] = { 5, 6, 1, 2, 3, 4, 5, 6 };
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, 8);
+
+    /* Nothing to copy: no buffer needed, and an empty ring leaves the buffer alone */
+    TEST_ASSERT_EQUAL(0, ring.pop_n(nullptr, 0));
+    TEST_ASSERT_EQUAL(0, ring.push_n(nullptr, 0));
+    TEST_ASSERT_EQUAL(0, ring.pop_n(out, 3));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, 8);
+
+    uint8_t value;
+    TEST_ASSERT_FALSE(ring.pop(value));
+    TEST_ASSERT_TRUE(ring.push(42));
+    TEST_ASSERT_TRUE(ring.pop(value));
+    TEST_ASSERT_EQUAL(42, value);
+}
+
+static int add(int a, int b)
+{
+    return a + b;
+}
+
+void test_inplace_function(void)
+{
+    fixed::inplace_function<int(int, int)> function;
+    TEST_ASSERT_FALSE(function);
+
+    function = add;
+    TEST_ASSERT_EQUAL(5, function(2, 3));
+
+    int offset = 10;
+    function = [offset](int a, int b) { return a + b + offset; };
+    fixed::inplace_function<int(int, int)> copy = function;
+    TEST_ASSERT_EQUAL(15, copy(2, 3));
+
+    {
+        tracked captured(7);
+        fixed::inplace_function<int(), 16> holder = [captured]() { return captured.value; };
+        fixed::inplace_function<int(), 16> second = holder;
+        TEST_ASSERT_EQUAL(7, second());
+        TEST_ASSERT_EQUAL(3, tracked::live);
+    }
+    TEST_ASSERT_EQUAL(0, tracked::live);
+}
+
+void test_static_string(void)
+{
+    TEST_ASSERT_TRUE(boot_banner == "fw");
+
+    fixed::static_string<8> text("abc");
+    TEST_ASSERT_TRUE(text.append("def"));
+    TEST_ASSERT_FALSE(text.append("ghi"));
+    TEST_ASSERT_EQUAL_STRING("abcdefgh", text.c_str());
+    TEST_ASSERT_EQUAL(8, text.size());
+
+    text.truncate(3);
+    text += "-x";
+    TEST_ASSERT_EQUAL_STRING("abc-x", text.c_str());
+    TEST_ASSERT_TRUE(text == fixed::static_string<5>("abc-x"));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_static_vector_trivial);
+    RUN_TEST(test_static_vector_non_trivial);
+    RUN_TEST(test_ring_wraps_and_bulk_copies);
+    RUN_TEST(test_inplace_function);
+    RUN_TEST(test_static_string);
+    return UNITY_END();
+}
@@ -0,0 +1,446 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/i2c/i2c.h"
+#include <string.h>
+
+#define TRACE_SIZE 64U
+#define SENSOR 0x48U
+#define EEPROM 0x50U
+#define ABSENT 0x23U
+
+static i2c_config_t config;
+static i2c_bus_t bus;
+static i2c_sim_t sim;
+static i2c_sim_device_t devices[2];
+static uint8_t sensor_memory[16];
+static uint8_t eeprom_memory[64];
+static i2c_sim_trace_t trace[TRACE_SIZE];
+
+static i2c_batch_t* completed[4];
+static uint32_t completed_count;
+
+static void on_done(i2c_batch_t* batch)
+{
+    completed[completed_count++] = batch;
+}
+
+static void attach(uint8_t sda_stuck)
+{
+    memset(&sim, 0, sizeof(sim));
+    sim.devices = devices;
+    sim.device_count = 2;
+    sim.trace = trace;
+    sim.trace_size = TRACE_SIZE;
+    sim.sda_stuck = sda_stuck;
+    i2c_sim_attach(&bus, &sim);
+}
+
+static void register_read(i2c_transfer_t* t, uint8_t address, const uint8_t* reg, uint8_t* data, uint16_t length)
+{
+    memset(t, 0, sizeof(*t));
+    t->address = address;
+    t->write = reg;
+    t->write_length = 1;
+    t->read = data;
+    t->read_length = length;
+}
+
+static void expect_trace(uint32_t index, uint8_t action, uint32_t cycle, uint8_t data, uint8_t ack)
+{
+    TEST_ASSERT_TRUE(index < sim.trace_count);
+    TEST_ASSERT_EQUAL(action, trace[index].action);
+    TEST_ASSERT_EQUAL(cycle, trace[index].cycle);
+    if (action != I2C_SIM_START && action != I2C_SIM_STOP) {
+        TEST_ASSERT_EQUAL_HEX8(data, trace[index].data);
+        TEST_ASSERT_EQUAL(ack, trace[index].ack);
+    }
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(hal_sim_gpio, 0, sizeof(hal_sim_gpio));
+    memset(i2c_sim_regs, 0, sizeof(i2c_sim_regs));
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    completed_count = 0;
+
+    for (uint32_t i = 0; i < sizeof(sensor_memory); i++) {
+        sensor_memory[i] = (uint8_t)(0xA0U + i);
+    }
+    memset(eeprom_memory, 0, sizeof(eeprom_memory));
+    memset(devices, 0, sizeof(devices));
+    devices[0].address = SENSOR;
+    devices[0].memory = sensor_memory;
+    devices[0].size = sizeof(sensor_memory);
+    devices[1].address = EEPROM;
+    devices[1].memory = eeprom_memory;
+    devices[1].size = sizeof(eeprom_memory);
+
+    memset(&config, 0, sizeof(config));
+    config.clock_hz = 42000000;
+    config.speed_hz = 400000;
+    config.timeout_ticks = 5;
+    config.scl = (i2c_pin_t){ 1, 6 }; /* PB6 */
+    config.sda = (i2c_pin_t){ 1, 7 }; /* PB7 */
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_init(&bus, 1, &config));
+    attach(0);
+}
+
+void tearDown(void)
+{
+    i2c_deinit(&bus);
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    i2c_bus_t other;
+    i2c_config_t bad = config;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_init(&other, 1, &config)); /* instance in use */
+    TEST_ASSERT_EQUAL(FAILURE, i2c_init(&other, 4, &config));
+    bad.speed_hz = 1000000;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_init(&other, 2, &bad));
+    bad = config;
+    bad.clock_hz = 1000000;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_init(&other, 2, &bad));
+    bad = config;
+    bad.timeout_ticks = 0;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_init(&other, 2, &bad));
+}
+
+void test_init_programs_timing(void)
+{
+    i2c_regs_t* regs = &i2c_sim_regs[0];
+    TEST_ASSERT_EQUAL_HEX32(42U | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN, regs->CR2);
+    TEST_ASSERT_EQUAL_HEX32(I2C_CCR_FS | 35U, regs->CCR); /* 42 MHz / (3 * 400 kHz) */
+    TEST_ASSERT_EQUAL(13, regs->TRISE);
+    TEST_ASSERT_EQUAL_HEX32(I2C_CR1_PE, regs->CR1);
+    TEST_ASSERT_TRUE(hal_sim_rcc.APB1ENR & (1U << 21));
+    TEST_ASSERT_TRUE(hal_sim_nvic.ISER[0] & (1U << 31));
+    TEST_ASSERT_TRUE(hal_sim_nvic.ISER[1] & (1U << 0));
+
+    i2c_bus_t other;
+    i2c_config_t standard = config;
+    standard.speed_hz = 100000;
+    standard.clock_hz = 16000000;
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_init(&other, 3, &standard));
+    TEST_ASSERT_EQUAL_HEX32(80, i2c_sim_regs[2].CCR);
+    TEST_ASSERT_EQUAL(17, i2c_sim_regs[2].TRISE);
+    i2c_deinit(&other);
+}
+
+void test_all_three_buses_run_together(void)
+{
+    i2c_bus_t second;
+    i2c_bus_t third;
+    i2c_config_t other = config;
+    other.scl = (i2c_pin_t){ 1, 10 }; /* PB10 */
+    other.sda = (i2c_pin_t){ 1, 11 }; /* PB11 */
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_init(&second, 2, &other));
+    other.scl = (i2c_pin_t){ 0, 8 }; /* PA8 */
+    other.sda = (i2c_pin_t){ 2, 9 }; /* PC9 */
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_init(&third, 3, &other));
+    TEST_ASSERT_EQUAL(3, second.rx_dma.stream_index);
+    TEST_ASSERT_EQUAL(2, third.rx_dma.stream_index);
+    i2c_deinit(&third);
+    i2c_deinit(&second);
+}
+
+void test_batch_add_rejects_invalid_transfers(void)
+{
+    i2c_batch_t batch;
+    i2c_transfer_t t;
+    uint8_t data[2];
+    i2c_batch_init(&batch, NULL, NULL);
+    memset(&t, 0, sizeof(t));
+    t.address = SENSOR;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_batch_add(&batch, &t));
+    t.read_length = 2;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_batch_add(&batch, &t));
+    t.read = data;
+    t.address = 0x80;
+    TEST_ASSERT_EQUAL(FAILURE, i2c_batch_add(&batch, &t));
+    TEST_ASSERT_EQUAL(FAILURE, i2c_submit(&bus, &batch));
+}
+
+void test_register_read_follows_the_master_receiver_sequence(void)
+{
+    uint8_t reg = 4;
+    uint8_t data[2] = { 0 };
+    i2c_transfer_t t;
+    i2c_batch_t batch;
+    register_read(&t, SENSOR, &reg, data, sizeof(data));
+    i2c_batch_init(&batch, on_done, NULL);
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_batch_add(&batch, &t));
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_submit(&bus, &batch));
+    TEST_ASSERT_TRUE(i2c_busy(&bus));
+
+    TEST_ASSERT_EQUAL(48, i2c_sim_run(&bus, 1000));
+    TEST_ASSERT_EQUAL(8, sim.trace_count);
+    expect_trace(0, I2C_SIM_START, 1, 0, 0);
+    expect_trace(1, I2C_SIM_ADDRESS, 10, SENSOR << 1, 1);
+    expect_trace(2, I2C_SIM_WRITE, 19, 4, 1);
+    expect_trace(3, I2C_SIM_START, 20, 0, 0);
+    expect_trace(4, I2C_SIM_ADDRESS, 29, (SENSOR << 1) | 1, 1);
+    expect_trace(5, I2C_SIM_READ, 38, 0xA4, 1);
+    expect_trace(6, I2C_SIM_READ, 47, 0xA5, 0); /* NACKed by LAST */
+    expect_trace(7, I2C_SIM_STOP, 48, 0, 0);
+
+    TEST_ASSERT_EQUAL_HEX8(0xA4, data[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, data[1]);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(SUCCESS, t.result);
+    TEST_ASSERT_EQUAL(0, batch.failed);
+    TEST_ASSERT_FALSE(i2c_busy(&bus));
+    /* SB, ADDR, TXE, BTF for the write; SB, ADDR for the read; the DMA does the rest */
+    TEST_ASSERT_EQUAL(6, i2c_get_stats(&bus)->interrupts);
+    TEST_ASSERT_EQUAL(0, i2c_sim_regs[0].CR2 & (I2C_CR2_DMAEN | I2C_CR2_LAST | I2C_CR2_ITBUFEN));
+}
+
+void test_single_byte_read_nacks_before_the_byte(void)
+{
+    uint8_t reg = 9;
+    uint8_t data = 0;
+    i2c_transfer_t t;
+    i2c_batch_t batch;
+    register_read(&t, SENSOR, &reg, &data, 1);
+    i2c_batch_init(&batch, on_done, NULL);
+    i2c_batch_add(&batch, &t);
+    i2c_submit(&bus, &batch);
+
+    TEST_ASSERT_EQUAL(39, i2c_sim_run(&bus, 1000));
+    expect_trace(5, I2C_SIM_READ, 38, 0xA9, 0);
+    expect_trace(6, I2C_SIM_STOP, 39, 0, 0);
+    TEST_ASSERT_EQUAL_HEX8(0xA9, data);
+    TEST_ASSERT_EQUAL(SUCCESS, t.result);
+}
+
+void test_batch_uses_repeated_starts_across_devices_and_one_stop(void)
+{
+    uint8_t regs[3] = { 0, 2, 8 };
+    uint8_t data[3][2];
+    uint8_t page[] = { 0x10, 1, 2, 3, 4, 5, 6, 7, 8 };
+    i2c_transfer_t t[4];
+    i2c_batch_t batch;
+    i2c_batch_init(&batch, on_done, NULL);
+    for (uint32_t i = 0; i < 3; i++) {
+        register_read(&t[i], (i == 1U) ? EEPROM : SENSOR, &regs[i], data[i], 2);
+        i2c_batch_add(&batch, &t[i]);
+    }
+    memset(&t[3], 0, sizeof(t[3]));
+    t[3].address = EEPROM;
+    t[3].write = page;
+    t[3].write_length = sizeof(page); /* over I2C_DMA_MIN: the TX stream feeds it */
+    i2c_batch_add(&batch, &t[3]);
+    eeprom_memory[2] = 0x5A;
+    eeprom_memory[3] = 0x5B;
+
+    i2c_submit(&bus, &batch);
+    i2c_sim_run(&bus, 10000);
+
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(0, batch.failed);
+    TEST_ASSERT_EQUAL_HEX8(0xA0, data[0][0]);
+    TEST_ASSERT_EQUAL_HEX8(0x5B, data[1][1]);
+    TEST_ASSERT_EQUAL_HEX8(0xA9, data[2][1]);
+    TEST_ASSERT_EQUAL_MEMORY(page + 1, eeprom_memory + 0x10, sizeof(page) - 1);
+
+    uint32_t starts = 0;
+    uint32_t stops = 0;
+    for (uint32_t i = 0; i < sim.trace_count; i++) {
+        starts += trace[i].action == I2C_SIM_START;
+        stops += trace[i].action == I2C_SIM_STOP;
+    }
+    TEST_ASSERT_EQUAL(7, starts); /* two per register read, one for the write */
+    TEST_ASSERT_EQUAL(1, stops);
+    TEST_ASSERT_EQUAL(I2C_SIM_STOP, trace[sim.trace_count - 1].action);
+    TEST_ASSERT_EQUAL(4, i2c_get_stats(&bus)->transfers);
+}
+
+void test_unacknowledged_address_fails_only_its_transfer(void)
+{
+    uint8_t reg = 1;
+    uint8_t data[2][2];
+    i2c_transfer_t t[2];
+    i2c_batch_t batch;
+    i2c_batch_init(&batch, on_done, NULL);
+    register_read(&t[0], ABSENT, &reg, data[0], 2);
+    register_read(&t[1], SENSOR, &reg, data[1], 2);
+    i2c_batch_add(&batch, &t[0]);
+    i2c_batch_add(&batch, &t[1]);
+    i2c_submit(&bus, &batch);
+    i2c_sim_run(&bus, 1000);
+
+    expect_trace(1, I2C_SIM_ADDRESS, 10, ABSENT << 1, 0);
+    expect_trace(2, I2C_SIM_START, 11, 0, 0);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(FAILURE, t[0].result);
+    TEST_ASSERT_EQUAL(SUCCESS, t[1].result);
+    TEST_ASSERT_EQUAL(1, batch.failed);
+    TEST_ASSERT_EQUAL_HEX8(0xA1, data[1][0]);
+    TEST_ASSERT_EQUAL(1, i2c_get_stats(&bus)->nacks);
+    TEST_ASSERT_EQUAL(0, i2c_get_stats(&bus)->recoveries);
+}
+
+void test_unacknowledged_data_ends_the_write(void)
+{
+    uint8_t page[6] = { 0, 1, 2, 3, 4, 5 };
+    i2c_transfer_t t;
+    i2c_batch_t batch;
+    devices[1].nack_data = 1;
+    memset(&t, 0, sizeof(t));
+    t.address = EEPROM;
+    t.write = page;
+    t.write_length = sizeof(page);
+    i2c_batch_init(&batch, on_done, NULL);
+    i2c_batch_add(&batch, &t);
+    i2c_submit(&bus, &batch);
+    i2c_sim_run(&bus, 1000);
+
+    expect_trace(2, I2C_SIM_WRITE, 19, 0, 0);
+    expect_trace(3, I2C_SIM_STOP, 20, 0, 0);
+    TEST_ASSERT_EQUAL(FAILURE, t.result);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(0, dma_sim_regs[0].S[6].CR & DMA_SxCR_EN);
+}
+
+void test_queued_batches_run_back_to_back(void)
+{
+    uint8_t reg = 0;
+    uint8_t data[3][2];
+    i2c_transfer_t t[3];
+    i2c_batch_t batch[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        register_read(&t[i], SENSOR, &reg, data[i], 2);
+        i2c_batch_init(&batch[i], on_done, NULL);
+        i2c_batch_add(&batch[i], &t[i]);
+        TEST_ASSERT_EQUAL(SUCCESS, i2c_submit(&bus, &batch[i]));
+    }
+    TEST_ASSERT_EQUAL(3 * 48, i2c_sim_run(&bus, 10000));
+    TEST_ASSERT_EQUAL(3, completed_count);
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_PTR(&batch[i], completed[i]);
+        TEST_ASSERT_EQUAL(SUCCESS, t[i].result);
+    }
+}
+
+void test_timeout_recovers_a_stalled_bus(void)
+{
+    uint8_t reg = 0;
+    uint8_t data[2];
+    i2c_transfer_t t[2];
+    i2c_batch_t batch[2];
+    devices[0].hold = 1;
+    register_read(&t[0], SENSOR, &reg, data, 2);
+    register_read(&t[1], EEPROM, &reg, data, 2);
+    i2c_batch_init(&batch[0], on_done, NULL);
+    i2c_batch_add(&batch[0], &t[0]);
+    i2c_batch_init(&batch[1], on_done, NULL);
+    i2c_batch_add(&batch[1], &t[1]);
+    i2c_submit(&bus, &batch[0]);
+    i2c_submit(&bus, &batch[1]);
+
+    TEST_ASSERT_EQUAL(10, i2c_sim_run(&bus, 1000)); /* stuck after the address */
+    i2c_tick(4);
+    TEST_ASSERT_EQUAL(0, completed_count);
+    i2c_tick(1);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(FAILURE, t[0].result);
+    TEST_ASSERT_EQUAL(1, i2c_get_stats(&bus)->timeouts);
+    TEST_ASSERT_EQUAL(1, i2c_get_stats(&bus)->recoveries);
+
+    /* The next batch was started by the recovery and runs on the cleared bus */
+    i2c_sim_run(&bus, 1000);
+    TEST_ASSERT_EQUAL(2, completed_count);
+    TEST_ASSERT_EQUAL(SUCCESS, t[1].result);
+}
+
+void test_bus_error_clears_a_stuck_sda(void)
+{
+    uint8_t reg = 0;
+    uint8_t data[2];
+    i2c_transfer_t t;
+    i2c_batch_t batch;
+    attach(3);
+    register_read(&t, SENSOR, &reg, data, 2);
+    i2c_batch_init(&batch, on_done, NULL);
+    i2c_batch_add(&batch, &t);
+    i2c_submit(&bus, &batch);
+
+    i2c_sim_error(&bus, I2C_SR1_BERR);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(FAILURE, t.result);
+    TEST_ASSERT_EQUAL(1, i2c_get_stats(&bus)->bus_errors);
+    /* Three pulses released SDA, then the STOP; the pins are back on the peripheral */
+    TEST_ASSERT_EQUAL(0, sim.sda_stuck);
+    TEST_ASSERT_EQUAL(4, sim.cycles);
+    TEST_ASSERT_EQUAL(I2C_SIM_STOP, trace[sim.trace_count - 1].action);
+    TEST_ASSERT_EQUAL_HEX32((2U << 12) | (2U << 14), hal_sim_gpio[1].MODER & (0xFU << 12));
+    TEST_ASSERT_EQUAL_HEX32(I2C_CR1_PE, i2c_sim_regs[0].CR1);
+    TEST_ASSERT_TRUE(hal_sim_gpio[1].ODR & (1U << 6));
+    TEST_ASSERT_TRUE(hal_sim_gpio[1].ODR & (1U << 7));
+}
+
+void test_arbitration_loss_fails_the_rest_of_the_batch(void)
+{
+    uint8_t reg = 0;
+    uint8_t data[2][2];
+    i2c_transfer_t t[2];
+    i2c_batch_t batch;
+    i2c_batch_init(&batch, on_done, NULL);
+    register_read(&t[0], SENSOR, &reg, data[0], 2);
+    register_read(&t[1], EEPROM, &reg, data[1], 2);
+    i2c_batch_add(&batch, &t[0]);
+    i2c_batch_add(&batch, &t[1]);
+    i2c_submit(&bus, &batch);
+    i2c_sim_run(&bus, 19);
+
+    i2c_sim_error(&bus, I2C_SR1_ARLO);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(2, batch.failed);
+    TEST_ASSERT_EQUAL(FAILURE, t[1].result);
+    TEST_ASSERT_EQUAL(1, i2c_get_stats(&bus)->arbitration_lost);
+    TEST_ASSERT_FALSE(i2c_busy(&bus));
+}
+
+void test_deinit_fails_pending_batches(void)
+{
+    uint8_t reg = 0;
+    uint8_t data[2][2];
+    i2c_transfer_t t[2];
+    i2c_batch_t batch[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        register_read(&t[i], SENSOR, &reg, data[i], 2);
+        i2c_batch_init(&batch[i], on_done, NULL);
+        i2c_batch_add(&batch[i], &t[i]);
+        i2c_submit(&bus, &batch[i]);
+    }
+    i2c_sim_run(&bus, 10);
+    i2c_deinit(&bus);
+
+    TEST_ASSERT_EQUAL(2, completed_count);
+    TEST_ASSERT_EQUAL(FAILURE, t[0].result);
+    TEST_ASSERT_EQUAL(FAILURE, t[1].result);
+    TEST_ASSERT_EQUAL(0, i2c_sim_regs[0].CR1);
+    TEST_ASSERT_EQUAL(FAILURE, i2c_submit(&bus, &batch[0]));
+
+    TEST_ASSERT_EQUAL(SUCCESS, i2c_init(&bus, 1, &config));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_programs_timing);
+    RUN_TEST(test_all_three_buses_run_together);
+    RUN_TEST(test_batch_add_rejects_invalid_transfers);
+    RUN_TEST(test_register_read_follows_the_master_receiver_sequence);
+    RUN_TEST(test_single_byte_read_nacks_before_the_byte);
+    RUN_TEST(test_batch_uses_repeated_starts_across_devices_and_one_stop);
+    RUN_TEST(test_unacknowledged_address_fails_only_its_transfer);
+    RUN_TEST(test_unacknowledged_data_ends_the_write);
+    RUN_TEST(test_queued_batches_run_back_to_back);
+    RUN_TEST(test_timeout_recovers_a_stalled_bus);
+    RUN_TEST(test_bus_error_clears_a_stuck_sda);
+    RUN_TEST(test_arbitration_loss_fails_the_rest_of_the_batch);
+    RUN_TEST(test_deinit_fails_pending_batches);
+    return UNITY_END();
+}
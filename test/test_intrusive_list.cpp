@@ -0,0 +1,141 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/intrusive_list/intrusive_list.hpp"
+
+struct event {
+    uint32_t id;
+    node_t hook;
+    uint32_t payload;
+};
+
+using event_list = ll::intrusive_list<LL_HOOK(event, hook)>;
+
+static event events[4];
+
+void setUp(void)
+{
+    for (uint32_t i = 0; i < 4; i++) {
+        events[i].id = i;
+        events[i].hook.data = nullptr;
+        events[i].hook.next = nullptr;
+        events[i].payload = i * 10;
+    }
+}
+
+void tearDown(void)
+{
+}
+
+void test_hook_offset_is_member_offset(void)
+{
+    static_assert(ll::hook_traits<LL_HOOK(event, hook)>::offset == offsetof(event, hook), "offset is a constant");
+    TEST_ASSERT_EQUAL_PTR(&events[2].hook, (ll::hook_traits<LL_HOOK(event, hook)>::to_node(events[2])));
+    TEST_ASSERT_EQUAL_PTR(&events[2], (ll::hook_traits<LL_HOOK(event, hook)>::from_node(&events[2].hook)));
+}
+
+void test_push_back_keeps_fifo_order(void)
+{
+    event_list list;
+    TEST_ASSERT_TRUE(list.empty());
+
+    list.push_back(events[0]);
+    list.push_back(events[1]);
+    list.push_back(events[2]);
+    TEST_ASSERT_EQUAL(3, list.size());
+    TEST_ASSERT_EQUAL(0, list.front().id);
+    TEST_ASSERT_EQUAL(2, list.back().id);
+
+    uint32_t expected = 0;
+    for (event& e : list) {
+        TEST_ASSERT_EQUAL(expected * 10, e.payload);
+        expected++;
+    }
+    TEST_ASSERT_EQUAL(3, expected);
+}
+
+void test_push_front_and_pop_front(void)
+{
+    event_list list;
+    list.push_front(events[0]);
+    list.push_front(events[1]);
+
+    TEST_ASSERT_EQUAL(1, list.pop_front()->id);
+    TEST_ASSERT_EQUAL(0, list.pop_front()->id);
+    TEST_ASSERT_NULL(list.pop_front());
+    TEST_ASSERT_TRUE(list.empty());
+
+    /* Tail must be reset so a later push_back starts a fresh chain */
+    list.push_back(events[3]);
+    TEST_ASSERT_EQUAL(3, list.front().id);
+    TEST_ASSERT_EQUAL(3, list.back().id);
+}
+
+void test_remove_updates_tail(void)
+{
+    event_list list;
+    list.push_back(events[0]);
+    list.push_back(events[1]);
+    list.push_back(events[2]);
+
+    TEST_ASSERT_TRUE(list.remove(events[2]));
+    TEST_ASSERT_EQUAL(1, list.back().id);
+    TEST_ASSERT_FALSE(list.remove(events[2]));
+    TEST_ASSERT_TRUE(list.remove(events[0]));
+    TEST_ASSERT_EQUAL(1, list.front().id);
+    TEST_ASSERT_EQUAL(1, list.size());
+
+    list.push_back(events[3]);
+    TEST_ASSERT_EQUAL(3, list.back().id);
+}
+
+void test_insert_after(void)
+{
+    event_list list;
+    list.insert_after(nullptr, events[1]);
+    list.insert_after(nullptr, events[0]);
+    list.insert_after(&events[1], events[3]);
+    list.insert_after(&events[1], events[2]);
+
+    uint32_t expected = 0;
+    for (event& e : list) {
+        TEST_ASSERT_EQUAL(expected, e.id);
+        expected++;
+    }
+    TEST_ASSERT_EQUAL(4, list.size());
+    TEST_ASSERT_EQUAL(3, list.back().id);
+}
+
+void test_interop_with_c_list(void)
+{
+    /* Build the chain with the C API and view it as typed elements */
+    ll_init(&events[0].hook);
+    ll_insert_at_tail(&events[1].hook);
+    ll_insert_at_tail(&events[2].hook);
+
+    uint32_t sum = 0;
+    for (event& e : ll::intrusive_range<LL_HOOK(event, hook)>(ll_get_head())) {
+        sum += e.id;
+    }
+    TEST_ASSERT_EQUAL(3, sum);
+
+    event_list list;
+    list.adopt(ll_get_head());
+    TEST_ASSERT_EQUAL(3, list.size());
+    TEST_ASSERT_EQUAL(2, list.back().id);
+
+    /* And hand a C++ built chain back to C */
+    list.push_back(events[3]);
+    TEST_ASSERT_EQUAL_PTR(&events[3].hook, events[2].hook.next);
+    TEST_ASSERT_EQUAL_PTR(&events[0].hook, list.head());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hook_offset_is_member_offset);
+    RUN_TEST(test_push_back_keeps_fifo_order);
+    RUN_TEST(test_push_front_and_pop_front);
+    RUN_TEST(test_remove_updates_tail);
+    RUN_TEST(test_insert_after);
+    RUN_TEST(test_interop_with_c_list);
+    return UNITY_END();
+}
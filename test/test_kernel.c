@@ -0,0 +1,237 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/kernel/kernel.h"
+#include "../lib/kernel/kernel_port.h"
+#include <setjmp.h>
+
+#define STACK_WORDS 64
+
+static kernel_thread_t low;
+static kernel_thread_t mid;
+static kernel_thread_t high;
+static uint32_t low_stack[STACK_WORDS] __attribute__((aligned(8)));
+static uint32_t mid_stack[STACK_WORDS] __attribute__((aligned(8)));
+static uint32_t high_stack[STACK_WORDS] __attribute__((aligned(8)));
+
+static void thread_entry(void* arg)
+{
+    (void)arg;
+}
+
+void setUp(void)
+{
+    kernel_init();
+}
+
+void tearDown(void)
+{
+}
+
+void test_thread_create_rejects_bad_arguments(void)
+{
+    TEST_ASSERT_EQUAL(FAILURE, kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 0, "low"));
+    TEST_ASSERT_EQUAL(FAILURE,
+                      kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, KERNEL_PRIORITIES, "low"));
+    TEST_ASSERT_EQUAL(FAILURE, kernel_thread_create(&low, NULL, NULL, low_stack, STACK_WORDS, 1, "low"));
+    TEST_ASSERT_EQUAL(FAILURE, kernel_thread_create(&low, thread_entry, NULL, low_stack, 4, 1, "low"));
+}
+
+void test_start_runs_highest_priority_thread(void)
+{
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    kernel_start();
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+}
+
+void test_higher_priority_thread_preempts(void)
+{
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_start();
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+    TEST_ASSERT_EQUAL(1, kernel_get_stats().preemptions);
+
+    kernel_exit();
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    TEST_ASSERT_EQUAL(KERNEL_THREAD_TERMINATED, high.state);
+}
+
+void test_yield_round_robins_equal_priority(void)
+{
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 2, "a");
+    kernel_thread_create(&mid, thread_entry, NULL, mid_stack, STACK_WORDS, 2, "b");
+    kernel_start();
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+
+    kernel_yield();
+    TEST_ASSERT_EQUAL_PTR(&mid, kernel_current());
+    kernel_yield();
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+}
+
+void test_time_slice_expiry_rotates(void)
+{
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 2, "a");
+    kernel_thread_create(&mid, thread_entry, NULL, mid_stack, STACK_WORDS, 2, "b");
+    kernel_start();
+
+    kernel_tick_announce(KERNEL_TIME_SLICE_TICKS - 1U);
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    kernel_tick_announce(1);
+    TEST_ASSERT_EQUAL_PTR(&mid, kernel_current());
+}
+
+void test_sleep_blocks_until_deadline(void)
+{
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    kernel_start();
+
+    kernel_sleep(5);
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    TEST_ASSERT_EQUAL(KERNEL_THREAD_SLEEPING, high.state);
+
+    kernel_tick_announce(4);
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    kernel_tick_announce(1);
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+    TEST_ASSERT_EQUAL(5, kernel_ticks());
+}
+
+void test_idle_skips_to_next_deadline(void)
+{
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    kernel_start();
+
+    kernel_sleep(40);
+    TEST_ASSERT_EQUAL(0, kernel_idle_ticks());
+    kernel_sleep(25);
+    TEST_ASSERT_EQUAL_STRING("idle", kernel_current()->name);
+    TEST_ASSERT_EQUAL(25, kernel_idle_ticks());
+
+    kernel_port_idle(kernel_idle_ticks());
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    TEST_ASSERT_EQUAL(25, kernel_ticks());
+
+    kernel_sleep(100);
+    TEST_ASSERT_EQUAL(15, kernel_idle_ticks());
+    kernel_port_idle(kernel_idle_ticks());
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+    TEST_ASSERT_EQUAL(24 + 14, kernel_get_stats().idle_ticks_skipped);
+}
+
+void test_idle_without_sleepers_has_no_deadline(void)
+{
+    kernel_start();
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, kernel_idle_ticks());
+}
+
+void test_mutex_lock_unlock_uncontended(void)
+{
+    kernel_mutex_t mutex;
+    kernel_mutex_init(&mutex);
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_start();
+
+    TEST_ASSERT_EQUAL(SUCCESS, kernel_mutex_lock(&mutex));
+    TEST_ASSERT_EQUAL(FAILURE, kernel_mutex_lock(&mutex));
+    TEST_ASSERT_EQUAL(FAILURE, kernel_mutex_try_lock(&mutex));
+    TEST_ASSERT_EQUAL(SUCCESS, kernel_mutex_unlock(&mutex));
+    TEST_ASSERT_EQUAL(FAILURE, kernel_mutex_unlock(&mutex));
+    TEST_ASSERT_EQUAL(SUCCESS, kernel_mutex_try_lock(&mutex));
+}
+
+void test_mutex_priority_inheritance(void)
+{
+    kernel_mutex_t mutex;
+    kernel_mutex_init(&mutex);
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_start();
+    kernel_mutex_lock(&mutex);
+
+    kernel_thread_create(&mid, thread_entry, NULL, mid_stack, STACK_WORDS, 2, "mid");
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+
+    /* high blocks; low inherits its priority and runs ahead of mid */
+    kernel_mutex_lock(&mutex);
+    TEST_ASSERT_EQUAL(KERNEL_THREAD_BLOCKED, high.state);
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    TEST_ASSERT_EQUAL(3, low.priority);
+
+    /* Unlocking hands the mutex to high and drops the boost */
+    TEST_ASSERT_EQUAL(SUCCESS, kernel_mutex_unlock(&mutex));
+    TEST_ASSERT_EQUAL_PTR(&high, mutex.owner);
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+    TEST_ASSERT_EQUAL(1, low.priority);
+    TEST_ASSERT_EQUAL(1, kernel_get_stats().inheritance_boosts);
+}
+
+void test_mutex_inheritance_is_transitive(void)
+{
+    kernel_mutex_t outer;
+    kernel_mutex_t inner;
+    kernel_mutex_init(&outer);
+    kernel_mutex_init(&inner);
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_start();
+    kernel_mutex_lock(&inner);
+
+    kernel_thread_create(&mid, thread_entry, NULL, mid_stack, STACK_WORDS, 2, "mid");
+    kernel_mutex_lock(&outer);
+    kernel_mutex_lock(&inner);
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    TEST_ASSERT_EQUAL(2, low.priority);
+
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    kernel_mutex_lock(&outer);
+    TEST_ASSERT_EQUAL(3, mid.priority);
+    TEST_ASSERT_EQUAL(3, low.priority);
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+
+    /* low releases inner: mid gets it, keeps high's priority through outer */
+    kernel_mutex_unlock(&inner);
+    TEST_ASSERT_EQUAL(1, low.priority);
+    TEST_ASSERT_EQUAL_PTR(&mid, kernel_current());
+    TEST_ASSERT_EQUAL(3, mid.priority);
+
+    kernel_mutex_unlock(&outer);
+    TEST_ASSERT_EQUAL_PTR(&high, kernel_current());
+    TEST_ASSERT_EQUAL(2, mid.priority);
+}
+
+void test_exit_releases_held_mutexes(void)
+{
+    kernel_mutex_t mutex;
+    kernel_mutex_init(&mutex);
+    kernel_thread_create(&low, thread_entry, NULL, low_stack, STACK_WORDS, 1, "low");
+    kernel_thread_create(&high, thread_entry, NULL, high_stack, STACK_WORDS, 3, "high");
+    kernel_start();
+
+    kernel_mutex_lock(&mutex);
+    kernel_exit();
+    TEST_ASSERT_EQUAL_PTR(&low, kernel_current());
+    TEST_ASSERT_NULL(mutex.owner);
+    TEST_ASSERT_EQUAL(SUCCESS, kernel_mutex_lock(&mutex));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_thread_create_rejects_bad_arguments);
+    RUN_TEST(test_start_runs_highest_priority_thread);
+    RUN_TEST(test_higher_priority_thread_preempts);
+    RUN_TEST(test_yield_round_robins_equal_priority);
+    RUN_TEST(test_time_slice_expiry_rotates);
+    RUN_TEST(test_sleep_blocks_until_deadline);
+    RUN_TEST(test_idle_skips_to_next_deadline);
+    RUN_TEST(test_idle_without_sleepers_has_no_deadline);
+    RUN_TEST(test_mutex_lock_unlock_uncontended);
+    RUN_TEST(test_mutex_priority_inheritance);
+    RUN_TEST(test_mutex_inheritance_is_transitive);
+    RUN_TEST(test_exit_releases_held_mutexes);
+    return UNITY_END();
+}
@@ -66,6 +66,74 @@ void test_ll_delete_at_tail(void)
     TEST_ASSERT_EQUAL(SUCCESS, ll_delete_at_tail());
 }
 
+void test_ll_get_head(void)
+{
+    resetTest();
+    test_node1.data = "test1";
+    test_node1.next = NULL;
+    TEST_ASSERT_EQUAL_PTR(&test_node_initial, ll_get_head());
+    ll_insert_at_head(&test_node1);
+    TEST_ASSERT_EQUAL_PTR(&test_node1, ll_get_head());
+    ll_delete_at_head();
+    ll_delete_at_head();
+    TEST_ASSERT_NULL(ll_get_head());
+}
+
+void test_ll_list_fifo(void)
+{
+    list_t list;
+    node_t a, b, c;
+
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_init(&list));
+    TEST_ASSERT_NULL(ll_list_remove_head(&list));
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_insert_at_tail(&list, &a));
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_insert_at_tail(&list, &b));
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_insert_at_head(&list, &c));
+    TEST_ASSERT_EQUAL(3, list.count);
+
+    TEST_ASSERT_EQUAL_PTR(&c, ll_list_remove_head(&list));
+    TEST_ASSERT_EQUAL_PTR(&a, ll_list_remove_head(&list));
+    TEST_ASSERT_EQUAL_PTR(&b, ll_list_remove_head(&list));
+    TEST_ASSERT_NULL(ll_list_remove_head(&list));
+    TEST_ASSERT_NULL(list.tail);
+    TEST_ASSERT_EQUAL(FAILURE, ll_list_insert_at_tail(NULL, &a));
+}
+
+void test_ll_list_remove(void)
+{
+    list_t list;
+    node_t a, b, c;
+
+    ll_list_init(&list);
+    ll_list_insert_at_tail(&list, &a);
+    ll_list_insert_at_tail(&list, &b);
+    ll_list_insert_at_tail(&list, &c);
+
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_remove(&list, &c));
+    TEST_ASSERT_EQUAL_PTR(&b, list.tail);
+    TEST_ASSERT_EQUAL(FAILURE, ll_list_remove(&list, &c));
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_remove(&list, &a));
+    TEST_ASSERT_EQUAL_PTR(&b, list.head);
+    TEST_ASSERT_EQUAL(1, list.count);
+}
+
+void test_ll_list_insert_after(void)
+{
+    list_t list;
+    node_t a, b, c;
+
+    ll_list_init(&list);
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_insert_after(&list, NULL, &b));
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_insert_after(&list, &b, &c));
+    TEST_ASSERT_EQUAL(SUCCESS, ll_list_insert_after(&list, NULL, &a));
+
+    TEST_ASSERT_EQUAL_PTR(&a, list.head);
+    TEST_ASSERT_EQUAL_PTR(&b, a.next);
+    TEST_ASSERT_EQUAL_PTR(&c, b.next);
+    TEST_ASSERT_EQUAL_PTR(&c, list.tail);
+    TEST_ASSERT_EQUAL(3, list.count);
+}
+
 int main(void)
 {
     UNITY_BEGIN();
@@ -74,5 +142,9 @@ int main(void)
     RUN_TEST(test_ll_insert_at_tail);
     RUN_TEST(test_ll_delete_at_head);
     RUN_TEST(test_ll_delete_at_tail);
+    RUN_TEST(test_ll_get_head);
+    RUN_TEST(test_ll_list_fifo);
+    RUN_TEST(test_ll_list_remove);
+    RUN_TEST(test_ll_list_insert_after);
     return UNITY_END();
 }
@@ -0,0 +1,157 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/mailbox/mailbox.h"
+#include "../lib/scheduler/scheduler.h"
+#include <setjmp.h>
+#include <string.h>
+
+#define PAYLOAD 64U
+#define COUNT 4U
+
+static MSG_POOL_STORAGE(storage, PAYLOAD, COUNT);
+static msg_pool_t pool;
+static mailbox_t mailbox;
+static uint32_t wakeups;
+
+static void count_wakeup(void* context)
+{
+    (void)context;
+    wakeups++;
+}
+
+void setUp(void)
+{
+    msg_pool_init(&pool, storage, PAYLOAD, COUNT);
+    mailbox_init(&mailbox, count_wakeup, NULL);
+    wakeups = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_pool_init_rejects_bad_arguments(void)
+{
+    msg_pool_t other;
+    TEST_ASSERT_EQUAL(FAILURE, msg_pool_init(&other, NULL, PAYLOAD, COUNT));
+    TEST_ASSERT_EQUAL(FAILURE, msg_pool_init(&other, storage, 0, COUNT));
+    TEST_ASSERT_EQUAL(FAILURE, msg_pool_init(&other, storage, 70000, COUNT));
+    TEST_ASSERT_EQUAL(FAILURE, msg_pool_init(&other, (uint8_t*)storage + 4, PAYLOAD, COUNT));
+}
+
+void test_pool_exhaustion_and_reuse(void)
+{
+    msg_t* msgs[COUNT];
+    for (uint32_t i = 0; i < COUNT; i++) {
+        msgs[i] = msg_alloc(&pool);
+        TEST_ASSERT_NOT_NULL(msgs[i]);
+    }
+    TEST_ASSERT_NULL(msg_alloc(&pool));
+    TEST_ASSERT_EQUAL(COUNT, pool.in_use);
+    TEST_ASSERT_EQUAL(COUNT, pool.peak);
+    TEST_ASSERT_EQUAL(1, pool.alloc_failures);
+
+    msg_free(msgs[2]);
+    TEST_ASSERT_EQUAL_PTR(msgs[2], msg_alloc(&pool));
+}
+
+void test_payloads_do_not_overlap(void)
+{
+    msg_t* a = msg_alloc(&pool);
+    msg_t* b = msg_alloc(&pool);
+    memset(msg_payload(a), 0xAA, PAYLOAD);
+    memset(msg_payload(b), 0x55, PAYLOAD);
+    TEST_ASSERT_EQUAL_HEX8(0xAA, ((uint8_t*)msg_payload(a))[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xAA, ((uint8_t*)msg_payload(a))[PAYLOAD - 1U]);
+    TEST_ASSERT_EQUAL_HEX32(0, (uintptr_t)msg_payload(a) & 7U);
+}
+
+void test_fetch_from_empty_mailbox(void)
+{
+    TEST_ASSERT_NULL(mailbox_fetch(&mailbox));
+}
+
+void test_messages_arrive_in_order_without_copying(void)
+{
+    msg_t* sent[COUNT];
+    for (uint32_t i = 0; i < COUNT; i++) {
+        sent[i] = msg_alloc(&pool);
+        *(uint32_t*)msg_payload(sent[i]) = i;
+        sent[i]->length = sizeof(uint32_t);
+        TEST_ASSERT_EQUAL(SUCCESS, mailbox_post(&mailbox, sent[i]));
+    }
+    TEST_ASSERT_EQUAL(COUNT, wakeups);
+
+    for (uint32_t i = 0; i < COUNT; i++) {
+        msg_t* msg = mailbox_fetch(&mailbox);
+        TEST_ASSERT_EQUAL_PTR(sent[i], msg);
+        TEST_ASSERT_EQUAL(i, *(uint32_t*)msg_payload(msg));
+        msg_free(msg);
+    }
+    TEST_ASSERT_NULL(mailbox_fetch(&mailbox));
+    TEST_ASSERT_EQUAL(0, pool.in_use);
+}
+
+void test_interleaved_post_and_fetch(void)
+{
+    for (uint32_t round = 0; round < 100; round++) {
+        msg_t* a = msg_alloc(&pool);
+        msg_t* b = msg_alloc(&pool);
+        mailbox_post(&mailbox, a);
+        TEST_ASSERT_EQUAL_PTR(a, mailbox_fetch(&mailbox));
+        mailbox_post(&mailbox, b);
+        msg_free(a);
+        TEST_ASSERT_EQUAL_PTR(b, mailbox_fetch(&mailbox));
+        TEST_ASSERT_NULL(mailbox_fetch(&mailbox));
+        msg_free(b);
+    }
+}
+
+static sched_task_t consumer;
+static uint32_t consumed;
+
+static void consume(sched_task_t* task, uint32_t events)
+{
+    (void)events;
+    msg_t* msg;
+    while ((msg = mailbox_fetch((mailbox_t*)task->context)) != NULL) {
+        consumed += msg->length;
+        msg_free(msg);
+    }
+}
+
+static void wake_consumer(void* context)
+{
+    sched_post_from_isr((sched_task_t*)context, 1);
+}
+
+void test_wakeup_hook_drives_scheduler_task(void)
+{
+    sched_init();
+    sched_task_init(&consumer, consume, &mailbox, 1);
+    mailbox_init(&mailbox, wake_consumer, &consumer);
+    consumed = 0;
+
+    for (uint16_t i = 1; i <= 3; i++) {
+        msg_t* msg = msg_alloc(&pool);
+        msg->length = i;
+        mailbox_post(&mailbox, msg);
+    }
+
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(0, sched_run_once());
+    TEST_ASSERT_EQUAL(6, consumed);
+    TEST_ASSERT_EQUAL(0, pool.in_use);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pool_init_rejects_bad_arguments);
+    RUN_TEST(test_pool_exhaustion_and_reuse);
+    RUN_TEST(test_payloads_do_not_overlap);
+    RUN_TEST(test_fetch_from_empty_mailbox);
+    RUN_TEST(test_messages_arrive_in_order_without_copying);
+    RUN_TEST(test_interleaved_post_and_fetch);
+    RUN_TEST(test_wakeup_hook_drives_scheduler_task);
+    return UNITY_END();
+}
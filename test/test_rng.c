@@ -0,0 +1,274 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/feature_hooks/feature_hooks.h"
+#include "../lib/rng/rng.h"
+#include <string.h>
+
+/*
+ * The pool is checked word for word against the model's xorshift32
+ * sequence, computed here independently: what comes out of rng_getentropy
+ * is exactly the words that passed the health tests, in order.
+ */
+
+#define SEED 0x2545F491U
+
+static uint32_t sequence[4 * RNG_POOL_WORDS];
+
+void setUp(void)
+{
+    uint32_t x = SEED;
+    for (uint32_t i = 0; i < sizeof(sequence) / sizeof(sequence[0]); i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        sequence[i] = x;
+    }
+    rng_sim_seed(SEED);
+    rng_sim_stuck(0, 0);
+    rng_sim_regs.SR = 0;
+    rng_init();
+}
+
+void tearDown(void)
+{
+}
+
+static void expect_words(const uint32_t* expected, uint32_t count)
+{
+    uint32_t words[RNG_POOL_WORDS];
+    TEST_ASSERT_EQUAL(SUCCESS, rng_getentropy(words, count * 4U));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected, words, count);
+}
+
+void test_pool_fills_in_tested_windows(void)
+{
+    uint8_t buffer[16];
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t empty = rng_get_stats()->empty_reads;
+#endif
+    TEST_ASSERT_EQUAL_HEX32(RNG_CR_RNGEN | RNG_CR_IE, rng_sim_regs.CR);
+    TEST_ASSERT_EQUAL(FAILURE, rng_getentropy(buffer, sizeof(buffer)));
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(empty + 1U, rng_get_stats()->empty_reads);
+#endif
+
+    /* The first word only starts the comparisons; a window is only whole one word later */
+    rng_sim_generate(RNG_WINDOW_WORDS);
+    TEST_ASSERT_EQUAL(0, rng_available());
+    TEST_ASSERT_EQUAL(FAILURE, rng_getentropy(buffer, sizeof(buffer)));
+    rng_sim_generate(1);
+    TEST_ASSERT_EQUAL(RNG_WINDOW_WORDS * 4U, rng_available());
+    expect_words(&sequence[1], RNG_WINDOW_WORDS);
+    TEST_ASSERT_EQUAL(0, rng_available());
+    TEST_ASSERT_EQUAL(SUCCESS, rng_getentropy(NULL, 0));
+}
+
+void test_short_reads_use_whole_words(void)
+{
+    uint8_t buffer[5];
+    rng_sim_generate(RNG_WINDOW_WORDS + 1U);
+    TEST_ASSERT_EQUAL(SUCCESS, rng_getentropy(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY((const uint8_t*)&sequence[1], buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL((RNG_WINDOW_WORDS - 2U) * 4U, rng_available());
+    expect_words(&sequence[3], 1);
+    TEST_ASSERT_EQUAL(FAILURE, rng_getentropy(buffer, RNG_GETENTROPY_MAX + 1U));
+    TEST_ASSERT_EQUAL(FAILURE, rng_getentropy(NULL, 4));
+}
+
+void test_full_pool_stops_the_interrupt_until_read(void)
+{
+    rng_sim_generate(1U + RNG_POOL_WORDS + 10U);
+    TEST_ASSERT_EQUAL(RNG_POOL_WORDS * 4U, rng_available());
+    TEST_ASSERT_EQUAL_HEX32(RNG_CR_RNGEN, rng_sim_regs.CR);
+    TEST_ASSERT_TRUE(rng_sim_regs.SR & RNG_SR_DRDY);
+
+    /* Reading turns the interrupt back on, and the word waiting in DR comes straight in */
+    expect_words(&sequence[1], RNG_POOL_WORDS);
+    TEST_ASSERT_EQUAL_HEX32(RNG_CR_RNGEN | RNG_CR_IE, rng_sim_regs.CR);
+    TEST_ASSERT_FALSE(rng_sim_regs.SR & RNG_SR_DRDY);
+
+    uint32_t next = 1U + RNG_POOL_WORDS + 10U;
+    rng_sim_generate(RNG_POOL_WORDS - 1U);
+    TEST_ASSERT_EQUAL(RNG_POOL_WORDS * 4U, rng_available());
+    TEST_ASSERT_EQUAL_HEX32(RNG_CR_RNGEN, rng_sim_regs.CR);
+    expect_words(&sequence[next - 1U], RNG_POOL_WORDS);
+}
+
+void test_repeated_word_discards_the_window(void)
+{
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t before = rng_get_stats()->repeats;
+#endif
+    rng_sim_generate(11);
+    rng_sim_repeat(1);
+    rng_sim_generate(1);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(before + 1U, rng_get_stats()->repeats);
+#endif
+    rng_sim_generate(RNG_WINDOW_WORDS - 1U);
+    TEST_ASSERT_EQUAL(0, rng_available());
+    rng_sim_generate(1);
+    TEST_ASSERT_EQUAL(RNG_WINDOW_WORDS * 4U, rng_available());
+    expect_words(&sequence[11], RNG_WINDOW_WORDS);
+    TEST_ASSERT_FALSE(rng_failed());
+}
+
+void test_stuck_bit_fails_the_window(void)
+{
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t before = rng_get_stats()->stuck_windows;
+#endif
+    rng_sim_stuck(1U << 7, 0);
+    rng_sim_generate(RNG_WINDOW_WORDS + 1U);
+    TEST_ASSERT_EQUAL(0, rng_available());
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(before + 1U, rng_get_stats()->stuck_windows);
+#endif
+
+    rng_sim_stuck(0, 0);
+    rng_sim_generate(RNG_WINDOW_WORDS);
+    expect_words(&sequence[RNG_WINDOW_WORDS + 1U], RNG_WINDOW_WORDS);
+}
+
+void test_seed_error_restarts_the_rng(void)
+{
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t errors = rng_get_stats()->seed_errors;
+    uint32_t restarts = rng_get_stats()->restarts;
+#endif
+    rng_sim_generate(11);
+    rng_sim_seed_error();
+    TEST_ASSERT_FALSE(rng_sim_regs.SR & (RNG_SR_SEIS | RNG_SR_SECS | RNG_SR_DRDY));
+    TEST_ASSERT_EQUAL_HEX32(RNG_CR_RNGEN | RNG_CR_IE, rng_sim_regs.CR);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(errors + 1U, rng_get_stats()->seed_errors);
+    TEST_ASSERT_EQUAL(restarts + 1U, rng_get_stats()->restarts);
+#endif
+
+    /* The window is gone, and the first word after the restart is only compared with */
+    rng_sim_generate(RNG_WINDOW_WORDS);
+    TEST_ASSERT_EQUAL(0, rng_available());
+    rng_sim_generate(1);
+    expect_words(&sequence[12], RNG_WINDOW_WORDS);
+}
+
+void test_clock_error_is_counted_and_cleared(void)
+{
+#if BUILD_CFG_FEATURE_STATS
+    uint32_t before = rng_get_stats()->clock_errors;
+#endif
+    rng_sim_regs.SR |= RNG_SR_CEIS | RNG_SR_CECS;
+    rng_sim_generate(RNG_WINDOW_WORDS + 1U);
+    TEST_ASSERT_FALSE(rng_sim_regs.SR & RNG_SR_CEIS);
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(before + 1U, rng_get_stats()->clock_errors);
+#endif
+    expect_words(&sequence[1], RNG_WINDOW_WORDS);
+}
+
+void test_failures_in_a_row_stop_the_rng(void)
+{
+    uint32_t word;
+    rng_sim_stuck(0xFFFFFFFFU, 0x5A5A5A5AU);
+    rng_sim_generate(100);
+    TEST_ASSERT_TRUE(rng_failed());
+    TEST_ASSERT_EQUAL_HEX32(0, rng_sim_regs.CR);
+    TEST_ASSERT_EQUAL(FAILURE, rng_getentropy(&word, sizeof(word)));
+
+    /* One passing window in between resets the count */
+    rng_sim_stuck(0, 0);
+    rng_init();
+    TEST_ASSERT_FALSE(rng_failed());
+    for (uint32_t i = 0; i < 2U * RNG_MAX_FAILURES; i++) {
+        rng_sim_generate(RNG_WINDOW_WORDS + 1U);
+        rng_sim_repeat(1);
+        rng_sim_generate(1);
+        TEST_ASSERT_EQUAL(SUCCESS, rng_getentropy(&word, sizeof(word)));
+        TEST_ASSERT_EQUAL(SUCCESS, rng_getentropy(NULL, 0));
+        while (rng_available() > 0U) {
+            TEST_ASSERT_EQUAL(SUCCESS, rng_getentropy(&word, sizeof(word)));
+        }
+    }
+    TEST_ASSERT_FALSE(rng_failed());
+}
+
+void test_a_stopped_rng_switches_off_if_enabled_again(void)
+{
+    rng_sim_stuck(0xFFFFFFFFU, 0x5A5A5A5AU);
+    rng_sim_generate(100);
+    TEST_ASSERT_TRUE(rng_failed());
+
+    /* As if a reader had turned the interrupt back on just as the RNG stopped */
+    rng_sim_write(&rng_sim_regs.CR, RNG_CR_RNGEN | RNG_CR_IE);
+    rng_sim_generate(1);
+    TEST_ASSERT_EQUAL_HEX32(0, rng_sim_regs.CR);
+    TEST_ASSERT_TRUE(rng_failed());
+    TEST_ASSERT_EQUAL(0, rng_available());
+}
+
+void test_prng_reference_sequence(void)
+{
+    /* xoshiro128** from the state 1, 2, 3, 4 */
+    rng_prng_t prng = { { 1, 2, 3, 4 } };
+    TEST_ASSERT_EQUAL_HEX32(11520U, rng_prng_next(&prng));
+    TEST_ASSERT_EQUAL_HEX32(0U, rng_prng_next(&prng));
+    TEST_ASSERT_EQUAL_HEX32(5927040U, rng_prng_next(&prng));
+}
+
+void test_prng_seeding(void)
+{
+    rng_prng_t a;
+    rng_prng_t b;
+    rng_prng_seed(&a, 42);
+    rng_prng_seed(&b, 42);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(a.s, b.s, 4);
+    rng_prng_seed(&b, 43);
+    TEST_ASSERT_TRUE(memcmp(a.s, b.s, sizeof(a.s)) != 0);
+    rng_prng_seed(&a, 0);
+    TEST_ASSERT_TRUE(a.s[0] | a.s[1] | a.s[2] | a.s[3]);
+
+    /* From the pool: nothing changes until there is enough in it */
+    memcpy(&b, &a, sizeof(a));
+    TEST_ASSERT_EQUAL(FAILURE, rng_prng_seed_from_pool(&a));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(b.s, a.s, 4);
+    rng_sim_generate(RNG_WINDOW_WORDS + 1U);
+    TEST_ASSERT_EQUAL(SUCCESS, rng_prng_seed_from_pool(&a));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(&sequence[1], a.s, 4);
+}
+
+void test_prng_below_is_bounded_and_even(void)
+{
+    uint32_t counts[6] = { 0 };
+    rng_prng_t prng;
+    rng_prng_seed(&prng, 1);
+    for (uint32_t i = 0; i < 60000U; i++) {
+        uint32_t value = rng_prng_below(&prng, 6);
+        TEST_ASSERT_TRUE(value < 6U);
+        counts[value]++;
+    }
+    for (uint32_t i = 0; i < 6U; i++) {
+        TEST_ASSERT_UINT32_WITHIN(500, 10000, counts[i]);
+    }
+
+    for (uint32_t i = 0; i < 1000U; i++) {
+        TEST_ASSERT_EQUAL(0, rng_prng_below(&prng, 1));
+        TEST_ASSERT_TRUE(rng_prng_below(&prng, 0x80000001U) <= 0x80000000U);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pool_fills_in_tested_windows);
+    RUN_TEST(test_short_reads_use_whole_words);
+    RUN_TEST(test_full_pool_stops_the_interrupt_until_read);
+    RUN_TEST(test_repeated_word_discards_the_window);
+    RUN_TEST(test_stuck_bit_fails_the_window);
+    RUN_TEST(test_seed_error_restarts_the_rng);
+    RUN_TEST(test_clock_error_is_counted_and_cleared);
+    RUN_TEST(test_failures_in_a_row_stop_the_rng);
+    RUN_TEST(test_a_stopped_rng_switches_off_if_enabled_again);
+    RUN_TEST(test_prng_reference_sequence);
+    RUN_TEST(test_prng_seeding);
+    RUN_TEST(test_prng_below_is_bounded_and_even);
+    return UNITY_END();
+}
@@ -0,0 +1,215 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/scheduler/scheduler.h"
+#include <setjmp.h>
+
+static sched_task_t low_task;
+static sched_task_t high_task;
+
+static uint32_t order[8];
+static uint32_t order_length;
+static uint32_t last_events;
+
+static void record_handler(sched_task_t* task, uint32_t events)
+{
+    order[order_length++] = task->priority;
+    last_events = events;
+}
+
+void setUp(void)
+{
+    sched_init();
+    order_length = 0;
+    last_events = 0;
+    sched_task_init(&low_task, record_handler, NULL, 1);
+    sched_task_init(&high_task, record_handler, NULL, 5);
+}
+
+void tearDown(void)
+{
+}
+
+void test_task_init_rejects_bad_priority(void)
+{
+    sched_task_t task;
+    TEST_ASSERT_EQUAL(FAILURE, sched_task_init(&task, record_handler, NULL, SCHED_PRIORITIES));
+    TEST_ASSERT_EQUAL(FAILURE, sched_task_init(&task, NULL, NULL, 0));
+}
+
+void test_highest_priority_runs_first(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, sched_post(&low_task, 1));
+    TEST_ASSERT_EQUAL(SUCCESS, sched_post(&high_task, 1));
+
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(0, sched_run_once());
+
+    TEST_ASSERT_EQUAL(2, order_length);
+    TEST_ASSERT_EQUAL(5, order[0]);
+    TEST_ASSERT_EQUAL(1, order[1]);
+}
+
+void test_events_coalesce_into_one_dispatch(void)
+{
+    sched_post(&low_task, 0x1);
+    sched_post(&low_task, 0x4);
+
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(0, sched_run_once());
+    TEST_ASSERT_EQUAL_HEX32(0x5, last_events);
+}
+
+void test_isr_posts_are_deferred(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, sched_post_from_isr(&low_task, 0x2));
+    TEST_ASSERT_EQUAL(SUCCESS, sched_post_from_isr(&high_task, 0x8));
+    TEST_ASSERT_EQUAL(SUCCESS, sched_post_from_isr(&low_task, 0x1));
+
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(5, order[0]);
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL_HEX32(0x3, last_events);
+}
+
+void test_isr_queue_overflow_is_reported(void)
+{
+    for (uint32_t i = 0; i < SCHED_ISR_QUEUE_LENGTH; i++) {
+        TEST_ASSERT_EQUAL(SUCCESS, sched_post_from_isr(&low_task, 1));
+    }
+    TEST_ASSERT_EQUAL(FAILURE, sched_post_from_isr(&low_task, 1));
+
+    /* Draining frees every cell again, repeatedly */
+    for (uint32_t round = 0; round < 3; round++) {
+        TEST_ASSERT_EQUAL(1, sched_run_once());
+        for (uint32_t i = 0; i < SCHED_ISR_QUEUE_LENGTH; i++) {
+            TEST_ASSERT_EQUAL(SUCCESS, sched_post_from_isr(&low_task, 1));
+        }
+    }
+#if BUILD_CFG_FEATURE_STATS
+    TEST_ASSERT_EQUAL(1, sched_get_stats()->isr_queue_overflows);
+    TEST_ASSERT_EQUAL(SCHED_ISR_QUEUE_LENGTH, sched_get_stats()->isr_queue_peak);
+#endif
+}
+
+static sched_task_t self_task;
+static uint32_t self_runs;
+
+static void reposting_handler(sched_task_t* task, uint32_t events)
+{
+    (void)events;
+    if (++self_runs < 3) {
+        sched_post(task, 1);
+    }
+}
+
+void test_handler_can_repost_itself(void)
+{
+    self_runs = 0;
+    sched_task_init(&self_task, reposting_handler, NULL, 0);
+    sched_post(&self_task, 1);
+    while (sched_run_once() != 0) {
+    }
+    TEST_ASSERT_EQUAL(3, self_runs);
+}
+
+void test_stats_track_depth_and_runtime(void)
+{
+#if BUILD_CFG_FEATURE_STATS
+    sched_task_t extra;
+    sched_task_init(&extra, record_handler, NULL, 1);
+    sched_post(&low_task, 1);
+    sched_post(&extra, 1);
+    TEST_ASSERT_EQUAL(2, sched_get_stats()->queue_depth[1]);
+
+    sched_run_once();
+    sched_run_once();
+    TEST_ASSERT_EQUAL(0, sched_get_stats()->queue_depth[1]);
+    TEST_ASSERT_EQUAL(2, sched_get_stats()->queue_peak[1]);
+    TEST_ASSERT_EQUAL(2, sched_get_stats()->dispatches);
+    TEST_ASSERT_EQUAL(1, low_task.stats.dispatches);
+    TEST_ASSERT_TRUE(low_task.stats.runtime_cycles >= low_task.stats.max_cycles);
+#endif
+}
+
+static jmp_buf idle_exit;
+static uint32_t idle_calls;
+
+static void escaping_idle(void)
+{
+    idle_calls++;
+    longjmp(idle_exit, 1);
+}
+
+void test_run_idles_when_no_work(void)
+{
+    idle_calls = 0;
+    sched_set_idle_hook(escaping_idle);
+    sched_post(&low_task, 1);
+    if (setjmp(idle_exit) == 0) {
+        sched_run();
+    }
+    TEST_ASSERT_EQUAL(1, order_length);
+    TEST_ASSERT_EQUAL(1, idle_calls);
+}
+
+void test_timer_posts_on_expiry(void)
+{
+    sched_timer_t timer = {0};
+    TEST_ASSERT_EQUAL(SUCCESS, sched_timer_start(&timer, &low_task, 0x2, 3, 0));
+    TEST_ASSERT_EQUAL(3, sched_idle_ticks());
+
+    sched_tick_announce(2);
+    TEST_ASSERT_EQUAL(0, sched_run_once());
+    TEST_ASSERT_EQUAL(1, sched_idle_ticks());
+
+    sched_tick_announce(1);
+    TEST_ASSERT_EQUAL(0, sched_idle_ticks());
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL_HEX32(0x2, last_events);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, sched_idle_ticks());
+}
+
+void test_periodic_timer_catches_up_after_long_sleep(void)
+{
+    sched_timer_t timer = {0};
+    sched_timer_start(&timer, &low_task, 0x1, 10, 10);
+
+    sched_tick_announce(35);
+    TEST_ASSERT_EQUAL(3, sched_get_stats()->timer_expiries);
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(5, sched_idle_ticks());
+
+    sched_timer_stop(&timer);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, sched_idle_ticks());
+}
+
+void test_timers_expire_in_deadline_order(void)
+{
+    sched_timer_t late = {0};
+    sched_timer_t early = {0};
+    sched_timer_start(&late, &low_task, 1, 20, 0);
+    sched_timer_start(&early, &high_task, 1, 5, 0);
+    TEST_ASSERT_EQUAL(5, sched_idle_ticks());
+
+    sched_tick_announce(5);
+    TEST_ASSERT_EQUAL(1, sched_run_once());
+    TEST_ASSERT_EQUAL(5, order[0]);
+    TEST_ASSERT_EQUAL(15, sched_idle_ticks());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_task_init_rejects_bad_priority);
+    RUN_TEST(test_highest_priority_runs_first);
+    RUN_TEST(test_events_coalesce_into_one_dispatch);
+    RUN_TEST(test_isr_posts_are_deferred);
+    RUN_TEST(test_isr_queue_overflow_is_reported);
+    RUN_TEST(test_handler_can_repost_itself);
+    RUN_TEST(test_stats_track_depth_and_runtime);
+    RUN_TEST(test_run_idles_when_no_work);
+    RUN_TEST(test_timer_posts_on_expiry);
+    RUN_TEST(test_periodic_timer_catches_up_after_long_sleep);
+    RUN_TEST(test_timers_expire_in_deadline_order);
+    return UNITY_END();
+}
@@ -0,0 +1,517 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/sdio/sdio_cache.h"
+#include <stddef.h>
+#include <string.h>
+
+#define CARD_BLOCKS 4096U
+#define BLOCK_WORDS (SDIO_BLOCK_SIZE / 4U)
+#define CACHE_LINES 8U
+
+static FILE* image;
+static sdio_sim_card_t card;
+static sdio_config_t config;
+static sdio_t sd;
+static sdio_cache_t cache;
+static SDIO_CACHE_STORAGE(cache_storage, CACHE_LINES);
+
+/* Up to 300 blocks, past one full-size transfer */
+static uint32_t out[300 * BLOCK_WORDS];
+static uint32_t in[300 * BLOCK_WORDS];
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(&sdio_sim_regs, 0, sizeof(sdio_sim_regs));
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    hal_reg_trace_reset();
+
+    image = tmpfile();
+    sdio_sim_insert(&card, image, CARD_BLOCKS, 1);
+
+    memset(&config, 0, sizeof(config));
+    config.hclk_hz = 16000000U;
+}
+
+void tearDown(void)
+{
+    sdio_deinit(&sd);
+    sdio_sim_remove();
+    if (image != NULL) {
+        fclose(image);
+    }
+}
+
+/* ------------------------------------------------------------ helpers --- */
+
+static void fill(uint32_t* data, uint32_t blocks, uint32_t seed)
+{
+    for (uint32_t i = 0; i < blocks * BLOCK_WORDS; i++) {
+        data[i] = seed * 0x9E3779B9U + i;
+    }
+}
+
+static void image_block(uint32_t lba, uint32_t* data)
+{
+    memset(data, 0, SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL(0, fseek(image, (long)lba * (long)SDIO_BLOCK_SIZE, SEEK_SET));
+    TEST_ASSERT_EQUAL(SDIO_BLOCK_SIZE, fread(data, 1, SDIO_BLOCK_SIZE, image));
+}
+
+/* The commands since mark, application ones with SDIO_SIM_APP set */
+static uint32_t commands_since(uint32_t mark, uint8_t* log, uint32_t size)
+{
+    uint32_t count = 0;
+    for (uint32_t i = mark; i < card.log_count && count < size; i++) {
+        log[count++] = card.log[i % SDIO_SIM_LOG];
+    }
+    return count;
+}
+
+static uint32_t count_command(uint32_t mark, uint8_t command)
+{
+    uint32_t count = 0;
+    for (uint32_t i = mark; i < card.log_count; i++) {
+        if (card.log[i % SDIO_SIM_LOG] == command) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void start(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_init(&sd, &config));
+}
+
+/* -------------------------------------------------------------- tests --- */
+
+void test_init_identifies_a_high_capacity_card_and_widens_the_bus(void)
+{
+    start();
+
+    TEST_ASSERT_EQUAL(CARD_BLOCKS, sdio_blocks(&sd));
+    TEST_ASSERT_EQUAL(1, sd.high_capacity);
+    TEST_ASSERT_EQUAL_HEX32(0xB3680000U, sd.rca);
+    TEST_ASSERT_EQUAL(SD_STATE_TRAN, card.state);
+    TEST_ASSERT_EQUAL(1, card.wide_bus);
+
+    /* Identification at 400 kHz, data transfer at 24 MHz on four lines */
+    int32_t first = hal_reg_trace_find(&sdio_sim_regs.CLKCR, 0);
+    TEST_ASSERT_TRUE(first >= 0);
+    TEST_ASSERT_EQUAL(118, hal_reg_trace[first].value & SDIO_CLKCR_CLKDIV_Msk);
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.CLKCR & SDIO_CLKCR_CLKDIV_Msk);
+    TEST_ASSERT_TRUE(sdio_sim_regs.CLKCR & SDIO_CLKCR_WIDBUS_4);
+    TEST_ASSERT_TRUE(sdio_sim_regs.CLKCR & SDIO_CLKCR_CLKEN);
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.CLKCR & SDIO_CLKCR_HWFC_EN);
+
+    /* The op cond loop polled until the card was ready */
+    uint8_t log[SDIO_SIM_LOG];
+    uint32_t count = commands_since(0, log, SDIO_SIM_LOG);
+    TEST_ASSERT_EQUAL(SD_CMD_GO_IDLE_STATE, log[0]);
+    TEST_ASSERT_EQUAL(SD_CMD_SEND_IF_COND, log[1]);
+    TEST_ASSERT_EQUAL(3, count_command(0, SD_ACMD_SD_SEND_OP_COND | SDIO_SIM_APP));
+    TEST_ASSERT_EQUAL(1, count_command(0, SD_ACMD_SET_BUS_WIDTH | SDIO_SIM_APP));
+    TEST_ASSERT_EQUAL(0, count_command(0, SD_CMD_SET_BLOCKLEN));
+    TEST_ASSERT_EQUAL(SD_ACMD_SET_BUS_WIDTH | SDIO_SIM_APP, log[count - 1U]);
+
+    TEST_ASSERT_TRUE(hal_sim_rcc.APB2ENR & (1U << 11));
+    TEST_ASSERT_EQUAL(SDIO_POWER_ON, sdio_sim_regs.POWER);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 0, in, 1));
+    TEST_ASSERT_EQUAL(4, dma_sim_regs[1].S[6].CR >> DMA_SxCR_CHSEL_Pos);
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[6].CR & DMA_SxCR_PFCTRL);
+}
+
+void test_init_handles_a_version_1_card_with_byte_addresses(void)
+{
+    sdio_sim_insert(&card, image, 2048, 0);
+    config.one_bit = 1;
+    config.max_clock_hz = 12000000U;
+    start();
+
+    TEST_ASSERT_EQUAL(2048, sdio_blocks(&sd));
+    TEST_ASSERT_EQUAL(0, sd.high_capacity);
+    TEST_ASSERT_EQUAL(1, count_command(0, SD_CMD_SET_BLOCKLEN));
+    TEST_ASSERT_EQUAL(0, count_command(0, SD_ACMD_SET_BUS_WIDTH | SDIO_SIM_APP));
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.CLKCR & SDIO_CLKCR_WIDBUS_4);
+    TEST_ASSERT_EQUAL(2, sdio_sim_regs.CLKCR & SDIO_CLKCR_CLKDIV_Msk);
+
+    fill(out, 2, 7);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 100, out, 2));
+    /* Byte addressing on the wire */
+    uint8_t found = 0;
+    for (int32_t i = hal_reg_trace_find(&sdio_sim_regs.ARG, 0); i >= 0;
+         i = hal_reg_trace_find(&sdio_sim_regs.ARG, (uint32_t)i + 1U)) {
+        found |= hal_reg_trace[i].value == 100U * SDIO_BLOCK_SIZE;
+    }
+    TEST_ASSERT_TRUE(found);
+
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 100, in, 2));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, 2 * SDIO_BLOCK_SIZE);
+    uint32_t block[BLOCK_WORDS];
+    image_block(101, block);
+    TEST_ASSERT_EQUAL_MEMORY(&out[BLOCK_WORDS], block, SDIO_BLOCK_SIZE);
+}
+
+void test_init_fails_without_a_card_and_releases_everything(void)
+{
+    sdio_sim_remove();
+    TEST_ASSERT_EQUAL(FAILURE, sdio_init(&sd, &config));
+    TEST_ASSERT_NULL(sd.regs);
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.POWER);
+    TEST_ASSERT_EQUAL(0, hal_sim_rcc.APB2ENR & (1U << 11));
+
+    /* Neither the driver nor the stream stayed claimed */
+    sdio_sim_insert(&card, image, CARD_BLOCKS, 1);
+    start();
+}
+
+void test_init_rejects_invalid_arguments_and_a_second_driver(void)
+{
+    sdio_t other;
+    TEST_ASSERT_EQUAL(FAILURE, sdio_init(NULL, &config));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_init(&sd, NULL));
+    config.hclk_hz = 0;
+    TEST_ASSERT_EQUAL(FAILURE, sdio_init(&sd, &config));
+    config.hclk_hz = 16000000U;
+
+    start();
+    TEST_ASSERT_EQUAL(FAILURE, sdio_init(&other, &config));
+}
+
+void test_transfers_reject_misaligned_buffers_and_out_of_range_requests(void)
+{
+    start();
+    uint8_t* bytes = (uint8_t*)out;
+    uint32_t mark = card.log_count;
+
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, 0, bytes + 1, 1));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_write(&sd, 0, bytes + 2, 1));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, 0, in, 0));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, 0, NULL, 1));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, CARD_BLOCKS, in, 1));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_write(&sd, CARD_BLOCKS - 1U, out, 2));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(NULL, 0, in, 1));
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, CARD_BLOCKS - 1U, in, 1));
+}
+
+void test_a_multi_block_write_is_pre_erased_and_stopped(void)
+{
+    start();
+    fill(out, 8, 1);
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 40, out, 8));
+
+    uint8_t log[8];
+    TEST_ASSERT_EQUAL(4, commands_since(mark, log, 8));
+    TEST_ASSERT_EQUAL(SD_CMD_APP_CMD, log[0]);
+    TEST_ASSERT_EQUAL(SD_ACMD_SET_WR_BLK_ERASE_COUNT | SDIO_SIM_APP, log[1]);
+    TEST_ASSERT_EQUAL(SD_CMD_WRITE_MULTIPLE_BLOCK, log[2]);
+    TEST_ASSERT_EQUAL(SD_CMD_STOP_TRANSMISSION, log[3]);
+    TEST_ASSERT_EQUAL(SD_STATE_PRG, card.state);
+
+    for (uint32_t b = 0; b < 8U; b++) {
+        uint32_t block[BLOCK_WORDS];
+        image_block(40U + b, block);
+        TEST_ASSERT_EQUAL_MEMORY(&out[b * BLOCK_WORDS], block, SDIO_BLOCK_SIZE);
+    }
+
+    const sdio_stats_t* stats = sdio_get_stats(&sd);
+    TEST_ASSERT_EQUAL(1, stats->write_commands);
+    TEST_ASSERT_EQUAL(8, stats->blocks_written);
+    TEST_ASSERT_EQUAL(1, stats->pre_erases);
+    TEST_ASSERT_EQUAL(0, stats->data_errors);
+}
+
+void test_single_blocks_use_the_single_block_commands(void)
+{
+    start();
+    fill(out, 1, 2);
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 3, out, 1));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 3, in, 1));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, SDIO_BLOCK_SIZE);
+
+    /* The read first polled the card through its programming */
+    uint8_t log[8];
+    TEST_ASSERT_EQUAL(4, commands_since(mark, log, 8));
+    TEST_ASSERT_EQUAL(SD_CMD_WRITE_BLOCK, log[0]);
+    TEST_ASSERT_EQUAL(SD_CMD_SEND_STATUS, log[1]);
+    TEST_ASSERT_EQUAL(SD_CMD_SEND_STATUS, log[2]);
+    TEST_ASSERT_EQUAL(SD_CMD_READ_SINGLE_BLOCK, log[3]);
+    TEST_ASSERT_EQUAL(0, count_command(mark, SD_CMD_STOP_TRANSMISSION));
+}
+
+void test_long_transfers_are_split_and_read_back(void)
+{
+    start();
+    fill(out, 300, 3);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 1000, out, 300));
+    memset(in, 0, sizeof(in));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 1000, in, 300));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, sizeof(out));
+
+    const sdio_stats_t* stats = sdio_get_stats(&sd);
+    TEST_ASSERT_EQUAL(2, stats->write_commands);
+    TEST_ASSERT_EQUAL(2, stats->read_commands);
+    TEST_ASSERT_EQUAL(300, stats->blocks_read);
+    TEST_ASSERT_EQUAL(2, stats->pre_erases);
+}
+
+void test_the_busy_wait_is_left_to_the_next_command(void)
+{
+    start();
+    fill(out, 4, 4);
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 0, out, 4));
+    /* The write returns with the card still programming */
+    TEST_ASSERT_EQUAL(0, count_command(mark, SD_CMD_SEND_STATUS));
+    TEST_ASSERT_EQUAL(1, sd.programming);
+
+    /* Three polls find it busy, the fourth back in tran */
+    card.busy_polls = 3;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 0, in, 4));
+    TEST_ASSERT_EQUAL(4, count_command(mark, SD_CMD_SEND_STATUS));
+    TEST_ASSERT_EQUAL(3, sdio_get_stats(&sd)->busy_polls);
+    TEST_ASSERT_EQUAL(0, sd.programming);
+
+    /* Nothing to wait for after a read */
+    mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_sync(&sd));
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 8, out, 1));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_sync(&sd));
+    TEST_ASSERT_EQUAL(SD_STATE_TRAN, card.state);
+}
+
+void test_a_data_error_fails_the_transfer_and_the_next_one_recovers(void)
+{
+    start();
+    fill(out, 8, 5);
+    card.inject = SDIO_STA_DCRCFAIL;
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(FAILURE, sdio_write(&sd, 16, out, 8));
+    /* The card is stopped all the same */
+    TEST_ASSERT_EQUAL(1, count_command(mark, SD_CMD_STOP_TRANSMISSION));
+    TEST_ASSERT_EQUAL(1, sdio_get_stats(&sd)->data_errors);
+    TEST_ASSERT_EQUAL(0, sdio_get_stats(&sd)->write_commands);
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.DCTRL & SDIO_DCTRL_DTEN);
+    TEST_ASSERT_EQUAL(0, dma_sim_regs[1].S[6].CR & DMA_SxCR_EN);
+
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 16, out, 8));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 16, in, 8));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, 8 * SDIO_BLOCK_SIZE);
+
+    card.inject = SDIO_STA_DTIMEOUT;
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, 16, in, 1));
+    TEST_ASSERT_EQUAL(2, sdio_get_stats(&sd)->data_errors);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 16, in, 1));
+}
+
+void test_a_card_removed_mid_session_fails_commands(void)
+{
+    start();
+    sdio_sim_remove();
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, 0, in, 1));
+    TEST_ASSERT_EQUAL(1, sdio_get_stats(&sd)->command_errors);
+}
+
+void test_deinit_powers_down_and_releases_the_stream(void)
+{
+    start();
+    fill(out, 2, 6);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 0, out, 2));
+    uint32_t mark = card.log_count;
+    sdio_deinit(&sd);
+
+    /* The last write was waited out before power went */
+    TEST_ASSERT_EQUAL(2, count_command(mark, SD_CMD_SEND_STATUS));
+    TEST_ASSERT_NULL(sd.regs);
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.POWER);
+    TEST_ASSERT_EQUAL(0, sdio_sim_regs.CLKCR);
+    TEST_ASSERT_EQUAL(0, hal_sim_rcc.APB2ENR & (1U << 11));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_read(&sd, 0, in, 1));
+    sdio_deinit(&sd);
+
+    start();
+}
+
+void test_cache_coalesces_sequential_records_into_one_write(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_init(&cache, &sd, cache_storage, CACHE_LINES));
+    fill(out, 6, 8);
+    uint32_t mark = card.log_count;
+    for (uint32_t b = 0; b < 6U; b++) {
+        TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 200U + b, &out[b * BLOCK_WORDS], 1));
+    }
+    /* Nothing reaches the card until a flush */
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_flush(&cache));
+    TEST_ASSERT_EQUAL(1, count_command(mark, SD_CMD_WRITE_MULTIPLE_BLOCK));
+    TEST_ASSERT_EQUAL(0, count_command(mark, SD_CMD_WRITE_BLOCK));
+    TEST_ASSERT_EQUAL(SD_STATE_TRAN, card.state);
+    for (uint32_t b = 0; b < 6U; b++) {
+        uint32_t block[BLOCK_WORDS];
+        image_block(200U + b, block);
+        TEST_ASSERT_EQUAL_MEMORY(&out[b * BLOCK_WORDS], block, SDIO_BLOCK_SIZE);
+    }
+
+    const sdio_cache_stats_t* stats = sdio_cache_get_stats(&cache);
+    TEST_ASSERT_EQUAL(1, stats->flushes);
+    TEST_ASSERT_EQUAL(6, stats->blocks_flushed);
+    TEST_ASSERT_EQUAL(0, stats->evictions);
+
+    /* A clean cache flushes to nothing */
+    mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_flush(&cache));
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+}
+
+void test_cache_evicts_every_dirty_line_when_it_runs_out(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_init(&cache, &sd, cache_storage, CACHE_LINES));
+    fill(out, CACHE_LINES + 1U, 9);
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 500, out, CACHE_LINES + 1U));
+
+    /* The ninth block needed the first line, so the first eight went as one write */
+    TEST_ASSERT_EQUAL(1, count_command(mark, SD_CMD_WRITE_MULTIPLE_BLOCK));
+    const sdio_cache_stats_t* stats = sdio_cache_get_stats(&cache);
+    TEST_ASSERT_EQUAL(1, stats->evictions);
+    TEST_ASSERT_EQUAL(CACHE_LINES, stats->blocks_flushed);
+    TEST_ASSERT_EQUAL(1, cache.dirty);
+
+    /* The last block sits at the start of the ring and the rest are clean */
+    mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_flush(&cache));
+    TEST_ASSERT_EQUAL(1, count_command(mark, SD_CMD_WRITE_BLOCK));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 500, in, CACHE_LINES + 1U));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, (CACHE_LINES + 1U) * SDIO_BLOCK_SIZE);
+}
+
+void test_cache_splits_a_run_where_the_ring_wraps(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_init(&cache, &sd, cache_storage, CACHE_LINES));
+    fill(out, 8, 10);
+    /* Six clean lines move the ring on, then eight blocks in a row straddle its end */
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 900, out, 6));
+    for (uint32_t b = 0; b < 6U; b++) {
+        TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_read(&cache, 900U + b, &in[b * BLOCK_WORDS], 1));
+    }
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 600, out, 8));
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_flush(&cache));
+
+    /* Lines 6 and 7, then lines 0 to 5 */
+    TEST_ASSERT_EQUAL(2, count_command(mark, SD_CMD_WRITE_MULTIPLE_BLOCK));
+    TEST_ASSERT_EQUAL(2, sdio_cache_get_stats(&cache)->flushes);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_read(&sd, 600, in, 8));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, 8 * SDIO_BLOCK_SIZE);
+}
+
+void test_cache_write_hits_stay_dirty_and_reads_see_them(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_init(&cache, &sd, cache_storage, CACHE_LINES));
+    fill(out, 3, 11);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 70, out, 2));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 71, &out[2 * BLOCK_WORDS], 1));
+    TEST_ASSERT_EQUAL(1, sdio_cache_get_stats(&cache)->write_hits);
+    TEST_ASSERT_EQUAL(2, cache.dirty);
+
+    /* Unaligned buffers are fine through the cache */
+    static uint8_t bytes[2 * SDIO_BLOCK_SIZE + 1];
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_read(&cache, 70, bytes + 1, 2));
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+    TEST_ASSERT_EQUAL_MEMORY(out, bytes + 1, SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(&out[2 * BLOCK_WORDS], bytes + 1 + SDIO_BLOCK_SIZE, SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL(2, sdio_cache_get_stats(&cache)->read_hits);
+
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_flush(&cache));
+    uint32_t block[BLOCK_WORDS];
+    image_block(71, block);
+    TEST_ASSERT_EQUAL_MEMORY(&out[2 * BLOCK_WORDS], block, SDIO_BLOCK_SIZE);
+}
+
+void test_cache_bulk_reads_bypass_it(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_init(&cache, &sd, cache_storage, CACHE_LINES));
+    fill(out, 32, 12);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_write(&sd, 300, out, 32));
+    /* One block cached and dirty in the middle of the range */
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 310, &out[31 * BLOCK_WORDS], 1));
+
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_read(&cache, 300, in, 32));
+    TEST_ASSERT_EQUAL(2, count_command(mark, SD_CMD_READ_MULTIPLE_BLOCK));
+    TEST_ASSERT_EQUAL_MEMORY(out, in, 10 * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(&out[31 * BLOCK_WORDS], &in[10 * BLOCK_WORDS], SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(&out[11 * BLOCK_WORDS], &in[11 * BLOCK_WORDS], 21 * SDIO_BLOCK_SIZE);
+
+    const sdio_cache_stats_t* stats = sdio_cache_get_stats(&cache);
+    TEST_ASSERT_EQUAL(31, stats->read_misses);
+    TEST_ASSERT_EQUAL(1, stats->read_hits);
+    /* Nothing but the written block took a line */
+    TEST_ASSERT_EQUAL(1, cache.next);
+
+    /* Single blocks are cached */
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_read(&cache, 320, in, 1));
+    mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_read(&cache, 320, in, 1));
+    TEST_ASSERT_EQUAL(mark, card.log_count);
+}
+
+void test_cache_rejects_invalid_arguments(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_init(&cache, &sd, cache_storage, 0));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_init(&cache, &sd, cache_storage, SDIO_CACHE_MAX_LINES + 1U));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_init(&cache, &sd, (uint8_t*)cache_storage + 1, 1));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_init(&cache, NULL, cache_storage, 1));
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_init(&cache, &sd, cache_storage, CACHE_LINES));
+
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_write(&cache, CARD_BLOCKS, out, 1));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_read(&cache, CARD_BLOCKS - 1U, in, 2));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_read(&cache, 0, in, 0));
+    TEST_ASSERT_EQUAL(FAILURE, sdio_cache_write(&cache, 0, NULL, 1));
+
+    fill(out, 1, 13);
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_write(&cache, 5, out, 1));
+    sdio_cache_invalidate(&cache);
+    uint32_t mark = card.log_count;
+    TEST_ASSERT_EQUAL(SUCCESS, sdio_cache_flush(&cache));
+    TEST_ASSERT_EQUAL(0, count_command(mark, SD_CMD_WRITE_BLOCK));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_identifies_a_high_capacity_card_and_widens_the_bus);
+    RUN_TEST(test_init_handles_a_version_1_card_with_byte_addresses);
+    RUN_TEST(test_init_fails_without_a_card_and_releases_everything);
+    RUN_TEST(test_init_rejects_invalid_arguments_and_a_second_driver);
+    RUN_TEST(test_transfers_reject_misaligned_buffers_and_out_of_range_requests);
+    RUN_TEST(test_a_multi_block_write_is_pre_erased_and_stopped);
+    RUN_TEST(test_single_blocks_use_the_single_block_commands);
+    RUN_TEST(test_long_transfers_are_split_and_read_back);
+    RUN_TEST(test_the_busy_wait_is_left_to_the_next_command);
+    RUN_TEST(test_a_data_error_fails_the_transfer_and_the_next_one_recovers);
+    RUN_TEST(test_a_card_removed_mid_session_fails_commands);
+    RUN_TEST(test_deinit_powers_down_and_releases_the_stream);
+    RUN_TEST(test_cache_coalesces_sequential_records_into_one_write);
+    RUN_TEST(test_cache_evicts_every_dirty_line_when_it_runs_out);
+    RUN_TEST(test_cache_splits_a_run_where_the_ring_wraps);
+    RUN_TEST(test_cache_write_hits_stay_dirty_and_reads_see_them);
+    RUN_TEST(test_cache_bulk_reads_bypass_it);
+    RUN_TEST(test_cache_rejects_invalid_arguments);
+    return UNITY_END();
+}
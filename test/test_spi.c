@@ -0,0 +1,348 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/spi/spi.h"
+#include <string.h>
+
+#define LOG_SIZE 256U
+
+static const spi_cs_t cs_pins[] = {
+    { 0, 4 },  /* PA4 */
+    { 1, 12 }, /* PB12 */
+};
+
+static spi_config_t config;
+static spi_bus_t bus;
+
+/* What the device saw, and the order transactions finished in */
+static uint8_t seen_mosi[LOG_SIZE];
+static uint8_t seen_cs[LOG_SIZE];
+static uint32_t seen;
+static spi_transaction_t* finished[8];
+static status_t results[8];
+static uint32_t finished_count;
+
+static uint8_t device(uint8_t cs, uint8_t mosi, void* context)
+{
+    (void)context;
+    if (seen < LOG_SIZE) {
+        seen_mosi[seen] = mosi;
+        seen_cs[seen] = cs;
+        seen++;
+    }
+    return (uint8_t)(mosi ^ 0xA5U);
+}
+
+static void on_done(spi_transaction_t* transaction, status_t result)
+{
+    finished[finished_count] = transaction;
+    results[finished_count] = result;
+    finished_count++;
+}
+
+static void transaction_init(spi_transaction_t* t, const void* tx, void* rx, uint16_t length, uint8_t cs)
+{
+    memset(t, 0, sizeof(*t));
+    t->tx = tx;
+    t->rx = rx;
+    t->length = length;
+    t->cs = cs;
+    t->callback = on_done;
+}
+
+static uint8_t cs_high(uint8_t cs)
+{
+    return (hal_sim_gpio[cs_pins[cs].port].ODR >> cs_pins[cs].pin) & 1U;
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(hal_sim_gpio, 0, sizeof(hal_sim_gpio));
+    memset(spi_sim_regs, 0, sizeof(spi_sim_regs));
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    seen = 0;
+    finished_count = 0;
+
+    memset(&config, 0, sizeof(config));
+    config.cs = cs_pins;
+    config.cs_count = 2;
+    config.fill = 0xFF;
+    TEST_ASSERT_EQUAL(SUCCESS, spi_init(&bus, 1, &config));
+}
+
+void tearDown(void)
+{
+    spi_deinit(&bus);
+}
+
+void test_clock_div_picks_the_fastest_clock_within_the_limit(void)
+{
+    TEST_ASSERT_EQUAL(0, spi_clock_div(84000000, 42000000));
+    TEST_ASSERT_EQUAL(1, spi_clock_div(84000000, 25000000));
+    TEST_ASSERT_EQUAL(2, spi_clock_div(42000000, 10000000));
+    TEST_ASSERT_EQUAL(7, spi_clock_div(84000000, 100000));
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    spi_bus_t other;
+    spi_config_t bad = config;
+    spi_cs_t bad_pin[] = { { 9, 0 } };
+    TEST_ASSERT_EQUAL(FAILURE, spi_init(&other, 1, &config)); /* instance in use */
+    TEST_ASSERT_EQUAL(FAILURE, spi_init(&other, 4, &config));
+    bad.cs_count = 0;
+    TEST_ASSERT_EQUAL(FAILURE, spi_init(&other, 2, &bad));
+    bad = config;
+    bad.cs = bad_pin;
+    bad.cs_count = 1;
+    TEST_ASSERT_EQUAL(FAILURE, spi_init(&other, 2, &bad));
+}
+
+void test_init_programs_spi_and_chip_selects(void)
+{
+    TEST_ASSERT_TRUE(hal_sim_rcc.APB2ENR & (1U << 12));
+    TEST_ASSERT_TRUE(hal_sim_nvic.ISER[1] & (1U << 3));
+    TEST_ASSERT_EQUAL_HEX32(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN | SPI_CR2_ERRIE, spi_sim_regs[0].CR2);
+    TEST_ASSERT_EQUAL(0, spi_sim_regs[0].CR1 & SPI_CR1_SPE);
+    TEST_ASSERT_EQUAL_HEX32(1U << (4 * 2), hal_sim_gpio[0].MODER);
+    TEST_ASSERT_EQUAL_HEX32(1U << (12 * 2), hal_sim_gpio[1].MODER);
+    TEST_ASSERT_TRUE(cs_high(0));
+    TEST_ASSERT_TRUE(cs_high(1));
+    TEST_ASSERT_EQUAL(0x3, hal_sim_rcc.AHB1ENR & 0x3U);
+}
+
+void test_submit_rejects_invalid_transactions(void)
+{
+    uint8_t data[4] = { 0 };
+    spi_transaction_t t;
+    transaction_init(&t, data, NULL, 0, 0);
+    TEST_ASSERT_EQUAL(FAILURE, spi_submit(&bus, &t));
+    transaction_init(&t, data, NULL, 4, 2);
+    TEST_ASSERT_EQUAL(FAILURE, spi_submit(&bus, &t));
+    transaction_init(&t, data, NULL, 4, 0);
+    t.mode = 4;
+    TEST_ASSERT_EQUAL(FAILURE, spi_submit(&bus, &t));
+    t.mode = 0;
+    t.clock_div = 8;
+    TEST_ASSERT_EQUAL(FAILURE, spi_submit(&bus, &t));
+    TEST_ASSERT_FALSE(spi_busy(&bus));
+}
+
+void test_full_duplex_transfer(void)
+{
+    uint8_t tx[16];
+    uint8_t rx[16];
+    for (uint32_t i = 0; i < sizeof(tx); i++) {
+        tx[i] = (uint8_t)(i * 13U);
+    }
+    spi_transaction_t t;
+    transaction_init(&t, tx, rx, sizeof(tx), 1);
+    t.mode = 3;
+    t.clock_div = 2;
+    TEST_ASSERT_EQUAL(SUCCESS, spi_submit(&bus, &t));
+
+    spi_regs_t* regs = &spi_sim_regs[0];
+    TEST_ASSERT_EQUAL_HEX32(SPI_CR1_SPE | SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | SPI_CR1_CPOL | SPI_CR1_CPHA |
+                                (2U << SPI_CR1_BR_Pos),
+                            regs->CR1);
+    TEST_ASSERT_FALSE(cs_high(1));
+    TEST_ASSERT_TRUE(cs_high(0));
+    TEST_ASSERT_EQUAL(3, dma_sim_regs[1].S[2].CR >> DMA_SxCR_CHSEL_Pos);
+    TEST_ASSERT_EQUAL(sizeof(tx), dma_sim_regs[1].S[3].NDTR);
+
+    TEST_ASSERT_EQUAL(sizeof(tx), spi_sim_run(&bus, device, NULL, 100));
+    TEST_ASSERT_EQUAL_MEMORY(tx, seen_mosi, sizeof(tx));
+    for (uint32_t i = 0; i < sizeof(tx); i++) {
+        TEST_ASSERT_EQUAL_HEX8(tx[i] ^ 0xA5U, rx[i]);
+        TEST_ASSERT_EQUAL(1, seen_cs[i]);
+    }
+    TEST_ASSERT_EQUAL(1, finished_count);
+    TEST_ASSERT_EQUAL_PTR(&t, finished[0]);
+    TEST_ASSERT_EQUAL(SUCCESS, results[0]);
+    TEST_ASSERT_TRUE(cs_high(1));
+    TEST_ASSERT_FALSE(spi_busy(&bus));
+    TEST_ASSERT_EQUAL(1, spi_get_stats(&bus)->transactions);
+    TEST_ASSERT_EQUAL(sizeof(tx), spi_get_stats(&bus)->bytes);
+}
+
+void test_queue_chains_transactions_from_the_completion_interrupt(void)
+{
+    uint8_t tx[3][8];
+    uint8_t rx[3][8];
+    spi_transaction_t t[3];
+    memset(tx, 0x11, sizeof(tx));
+    for (uint32_t i = 0; i < 3; i++) {
+        transaction_init(&t[i], tx[i], rx[i], (uint16_t)(4U + i), (uint8_t)(i & 1U));
+        TEST_ASSERT_EQUAL(SUCCESS, spi_submit(&bus, &t[i]));
+    }
+    TEST_ASSERT_TRUE(spi_busy(&bus));
+
+    /* One call of the bus model runs the whole queue: nothing outside the interrupts restarts it */
+    TEST_ASSERT_EQUAL(4 + 5 + 6, spi_sim_run(&bus, device, NULL, 100));
+    TEST_ASSERT_EQUAL(3, finished_count);
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_PTR(&t[i], finished[i]);
+        TEST_ASSERT_EQUAL(SUCCESS, results[i]);
+        TEST_ASSERT_EQUAL_HEX8(0x11 ^ 0xA5, rx[i][3 + i]);
+    }
+    TEST_ASSERT_EQUAL(0, seen_cs[3]);
+    TEST_ASSERT_EQUAL(1, seen_cs[4]);
+    TEST_ASSERT_EQUAL(1, seen_cs[8]);
+    TEST_ASSERT_EQUAL(0, seen_cs[9]);
+    TEST_ASSERT_EQUAL(2, spi_get_stats(&bus)->chained);
+    TEST_ASSERT_TRUE(cs_high(0));
+    TEST_ASSERT_TRUE(cs_high(1));
+}
+
+void test_missing_buffers_send_fill_and_discard(void)
+{
+    uint8_t tx[6] = { 1, 2, 3, 4, 5, 6 };
+    uint8_t rx[6];
+    spi_transaction_t write;
+    spi_transaction_t read;
+    transaction_init(&write, tx, NULL, sizeof(tx), 0);
+    transaction_init(&read, NULL, rx, sizeof(rx), 0);
+    spi_submit(&bus, &write);
+    spi_submit(&bus, &read);
+    TEST_ASSERT_EQUAL(12, spi_sim_run(&bus, device, NULL, 100));
+
+    TEST_ASSERT_EQUAL_MEMORY(tx, seen_mosi, sizeof(tx));
+    for (uint32_t i = 0; i < sizeof(rx); i++) {
+        TEST_ASSERT_EQUAL_HEX8(0xFF, seen_mosi[6 + i]);
+        TEST_ASSERT_EQUAL_HEX8(0xFF ^ 0xA5, rx[i]);
+    }
+    TEST_ASSERT_EQUAL(0, dma_sim_regs[1].S[2].CR & DMA_SxCR_EN);
+}
+
+void test_keep_cs_holds_the_selection_into_the_next_transaction(void)
+{
+    uint8_t command[2] = { 0x03, 0x00 };
+    uint8_t data[4];
+    spi_transaction_t header;
+    spi_transaction_t payload;
+    transaction_init(&header, command, NULL, sizeof(command), 1);
+    header.flags = SPI_TRANSACTION_KEEP_CS;
+    transaction_init(&payload, NULL, data, sizeof(data), 1);
+
+    spi_submit(&bus, &header);
+    TEST_ASSERT_EQUAL(2, spi_sim_run(&bus, device, NULL, 100));
+    TEST_ASSERT_FALSE(spi_busy(&bus));
+    TEST_ASSERT_FALSE(cs_high(1));
+
+    spi_submit(&bus, &payload);
+    TEST_ASSERT_EQUAL(4, spi_sim_run(&bus, device, NULL, 100));
+    TEST_ASSERT_TRUE(cs_high(1));
+    for (uint32_t i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(1, seen_cs[i]);
+    }
+}
+
+static spi_transaction_t follow_up;
+
+static void submit_follow_up(spi_transaction_t* transaction, status_t result)
+{
+    on_done(transaction, result);
+    TEST_ASSERT_EQUAL(SUCCESS, spi_submit(&bus, &follow_up));
+}
+
+void test_callback_may_submit_the_next_transaction(void)
+{
+    uint8_t tx[2] = { 1, 2 };
+    uint8_t follow_tx[3] = { 7, 8, 9 };
+    spi_transaction_t first;
+    transaction_init(&first, tx, NULL, sizeof(tx), 0);
+    first.callback = submit_follow_up;
+    transaction_init(&follow_up, follow_tx, NULL, sizeof(follow_tx), 1);
+    TEST_ASSERT_EQUAL(SUCCESS, spi_submit(&bus, &first));
+
+    TEST_ASSERT_EQUAL(5, spi_sim_run(&bus, device, NULL, 100));
+    TEST_ASSERT_EQUAL(2, finished_count);
+    TEST_ASSERT_EQUAL_PTR(&follow_up, finished[1]);
+    TEST_ASSERT_EQUAL_MEMORY(follow_tx, seen_mosi + 2, sizeof(follow_tx));
+    TEST_ASSERT_EQUAL(1, seen_cs[2]);
+}
+
+void test_overrun_aborts_the_transaction_and_starts_the_next(void)
+{
+    uint8_t tx[8] = { 0 };
+    spi_transaction_t t[2];
+    transaction_init(&t[0], tx, NULL, sizeof(tx), 0);
+    transaction_init(&t[1], tx, NULL, sizeof(tx), 1);
+    spi_submit(&bus, &t[0]);
+    spi_submit(&bus, &t[1]);
+    TEST_ASSERT_EQUAL(3, spi_sim_run(&bus, device, NULL, 3));
+
+    spi_sim_error(&bus, SPI_SR_OVR);
+    TEST_ASSERT_EQUAL(1, finished_count);
+    TEST_ASSERT_EQUAL(FAILURE, results[0]);
+    TEST_ASSERT_TRUE(cs_high(0));
+    TEST_ASSERT_FALSE(cs_high(1));
+    TEST_ASSERT_TRUE(spi_sim_regs[0].CR1 & SPI_CR1_SPE);
+
+    TEST_ASSERT_EQUAL(8, spi_sim_run(&bus, device, NULL, 100));
+    TEST_ASSERT_EQUAL(2, finished_count);
+    TEST_ASSERT_EQUAL(SUCCESS, results[1]);
+    TEST_ASSERT_EQUAL(1, spi_get_stats(&bus)->aborted);
+    TEST_ASSERT_EQUAL(1, spi_get_stats(&bus)->transactions);
+}
+
+void test_dma_error_aborts_the_transaction(void)
+{
+    uint8_t tx[8] = { 0 };
+    spi_transaction_t t;
+    transaction_init(&t, tx, NULL, sizeof(tx), 0);
+    spi_submit(&bus, &t);
+    spi_sim_run(&bus, device, NULL, 2);
+
+    dma_sim_regs[1].LISR = DMA_FLAG_TE << 16;
+    dma_sim_regs[1].S[2].CR &= ~DMA_SxCR_EN;
+    dma_stream_irq(2, 2);
+    dma_sim_regs[1].LISR = 0;
+
+    TEST_ASSERT_EQUAL(1, finished_count);
+    TEST_ASSERT_EQUAL(FAILURE, results[0]);
+    TEST_ASSERT_FALSE(spi_busy(&bus));
+    TEST_ASSERT_EQUAL(0, dma_sim_regs[1].S[3].CR & DMA_SxCR_EN);
+    TEST_ASSERT_TRUE(cs_high(0));
+}
+
+void test_deinit_fails_pending_transactions_and_frees_the_instance(void)
+{
+    uint8_t tx[8] = { 0 };
+    spi_transaction_t t[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        transaction_init(&t[i], tx, NULL, sizeof(tx), 0);
+        spi_submit(&bus, &t[i]);
+    }
+    spi_sim_run(&bus, device, NULL, 4);
+    spi_deinit(&bus);
+
+    TEST_ASSERT_EQUAL(3, finished_count);
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_PTR(&t[i], finished[i]);
+        TEST_ASSERT_EQUAL(FAILURE, results[i]);
+    }
+    TEST_ASSERT_TRUE(cs_high(0));
+    TEST_ASSERT_EQUAL(0, spi_sim_regs[0].CR2);
+    TEST_ASSERT_EQUAL(FAILURE, spi_submit(&bus, &t[0]));
+    TEST_ASSERT_EQUAL(0, spi_sim_run(&bus, device, NULL, 1));
+
+    TEST_ASSERT_EQUAL(SUCCESS, spi_init(&bus, 1, &config));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clock_div_picks_the_fastest_clock_within_the_limit);
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_programs_spi_and_chip_selects);
+    RUN_TEST(test_submit_rejects_invalid_transactions);
+    RUN_TEST(test_full_duplex_transfer);
+    RUN_TEST(test_queue_chains_transactions_from_the_completion_interrupt);
+    RUN_TEST(test_missing_buffers_send_fill_and_discard);
+    RUN_TEST(test_keep_cs_holds_the_selection_into_the_next_transaction);
+    RUN_TEST(test_callback_may_submit_the_next_transaction);
+    RUN_TEST(test_overrun_aborts_the_transaction_and_starts_the_next);
+    RUN_TEST(test_dma_error_aborts_the_transaction);
+    RUN_TEST(test_deinit_fails_pending_transactions_and_frees_the_instance);
+    return UNITY_END();
+}
@@ -0,0 +1,140 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/timebase/timebase.h"
+#include <setjmp.h>
+
+#define C TIMEBASE_CYCLES_PER_TICK
+#define WAKE_CYCLES 12U
+
+static uint32_t handler_ticks;
+static uint32_t handler_calls;
+static uint32_t idle_ticks;
+static uint64_t start_cycle;
+
+static void count_ticks(uint32_t ticks)
+{
+    handler_ticks += ticks;
+    handler_calls++;
+}
+
+static uint32_t next_deadline(void)
+{
+    return idle_ticks;
+}
+
+static void start(uint32_t stopped_cycles)
+{
+    timebase_sim_reset(WAKE_CYCLES, stopped_cycles);
+    handler_ticks = 0;
+    handler_calls = 0;
+    timebase_init(count_ticks, next_deadline);
+    start_cycle = timebase_sim_next_tick() - C;
+}
+
+/* Cycles between where the next tick will fire and where an ideal clock would fire it */
+static int64_t phase_error(void)
+{
+    timebase_sim_run(0);
+    uint64_t next = timebase_sim_next_tick();
+    uint64_t ideal = start_cycle + ((uint64_t)timebase_ticks() + 1U) * C;
+    return (int64_t)(next - ideal);
+}
+
+void setUp(void)
+{
+    start(TIMEBASE_STOPPED_CYCLES);
+}
+
+void tearDown(void)
+{
+}
+
+void test_init_rejects_null_callbacks(void)
+{
+    TEST_ASSERT_EQUAL(FAILURE, timebase_init(NULL, next_deadline));
+    TEST_ASSERT_EQUAL(FAILURE, timebase_init(count_ticks, NULL));
+}
+
+void test_periodic_ticks(void)
+{
+    timebase_sim_run(10U * C);
+    TEST_ASSERT_EQUAL(10, timebase_ticks());
+    TEST_ASSERT_EQUAL(10, handler_ticks);
+    TEST_ASSERT_EQUAL(0, phase_error());
+}
+
+void test_sleep_runs_to_deadline(void)
+{
+    timebase_sim_run(C / 3U);
+    idle_ticks = 50;
+    timebase_sleep();
+    TEST_ASSERT_EQUAL(0, phase_error());
+    TEST_ASSERT_EQUAL(50, timebase_ticks());
+    TEST_ASSERT_EQUAL(50, handler_ticks);
+    TEST_ASSERT_EQUAL(2, handler_calls);
+
+    timebase_stats_t stats = timebase_get_stats();
+    TEST_ASSERT_EQUAL(WAKE_CYCLES, stats.wake_latency_last);
+    TEST_ASSERT_EQUAL(49, stats.ticks_suppressed);
+    TEST_ASSERT_EQUAL(0, stats.early_wakes);
+}
+
+void test_early_wake_counts_partial_sleep(void)
+{
+    idle_ticks = 100;
+    timebase_sim_interrupt_at(start_cycle + 37U * C + C / 2U);
+    timebase_sleep();
+    TEST_ASSERT_EQUAL(37, timebase_ticks());
+    TEST_ASSERT_EQUAL(0, phase_error());
+    TEST_ASSERT_EQUAL(1, timebase_get_stats().early_wakes);
+}
+
+void test_single_tick_deadline_just_waits(void)
+{
+    idle_ticks = 1;
+    timebase_sleep();
+    timebase_sim_run(0);
+    TEST_ASSERT_EQUAL(1, timebase_ticks());
+    TEST_ASSERT_EQUAL(0, timebase_get_stats().ticks_suppressed);
+}
+
+void test_no_drift_over_many_sleeps(void)
+{
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < 2000; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        timebase_sim_run(seed % (3U * C));
+        idle_ticks = 2U + (seed >> 8) % 300U;
+        if ((seed & 0x100U) != 0) {
+            timebase_sim_interrupt_at(timebase_sim_cycles() + (seed >> 4) % (idle_ticks * C));
+        }
+        timebase_sleep();
+        timebase_sim_interrupt_at(0);
+    }
+    TEST_ASSERT_EQUAL(0, phase_error());
+    TEST_ASSERT_EQUAL((timebase_sim_cycles() - start_cycle) / C, timebase_ticks());
+}
+
+void test_uncompensated_stop_time_drifts(void)
+{
+    start(TIMEBASE_STOPPED_CYCLES + 10U);
+    for (uint32_t i = 0; i < 100; i++) {
+        idle_ticks = 20;
+        timebase_sleep();
+        timebase_sim_run(C / 2U);
+    }
+    /* Two restarts per sleep, each 10 cycles longer than the code allows for */
+    TEST_ASSERT_EQUAL(100 * 2 * 10, phase_error());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_null_callbacks);
+    RUN_TEST(test_periodic_ticks);
+    RUN_TEST(test_sleep_runs_to_deadline);
+    RUN_TEST(test_early_wake_counts_partial_sleep);
+    RUN_TEST(test_single_tick_deadline_just_waits);
+    RUN_TEST(test_no_drift_over_many_sleeps);
+    RUN_TEST(test_uncompensated_stop_time_drifts);
+    return UNITY_END();
+}
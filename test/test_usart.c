@@ -0,0 +1,304 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/usart/usart.h"
+#include <string.h>
+
+#define RING_SIZE 64U
+#define PAYLOAD 256U
+#define MESSAGES 6U
+
+static MSG_POOL_STORAGE(rx_storage, PAYLOAD, MESSAGES);
+static MSG_POOL_STORAGE(tx_storage, PAYLOAD, MESSAGES);
+static msg_pool_t rx_pool;
+static msg_pool_t tx_pool;
+static mailbox_t rx_output;
+static uint8_t ring[RING_SIZE];
+static usart_config_t config;
+static usart_t port;
+
+/* Byte i of a frame starting at sequence number first */
+static void pattern(uint8_t* data, uint32_t first, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        data[i] = (uint8_t)((first + i) * 7U + 3U);
+    }
+}
+
+static void receive_frame(uint32_t first, uint32_t count)
+{
+    uint8_t data[512];
+    pattern(data, first, count);
+    TEST_ASSERT_EQUAL(count, usart_sim_receive(&port, data, count));
+    usart_sim_idle(&port);
+}
+
+static void expect_frame(uint32_t first, uint32_t count)
+{
+    uint8_t expected[512];
+    msg_t* frame = mailbox_fetch(&rx_output);
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL(count, frame->length);
+    TEST_ASSERT_EQUAL(0x55, frame->type);
+    pattern(expected, first, count);
+    TEST_ASSERT_EQUAL_MEMORY(expected, msg_payload(frame), count);
+    msg_free(frame);
+}
+
+static msg_t* tx_message(uint32_t first, uint32_t count)
+{
+    msg_t* msg = msg_alloc(&tx_pool);
+    TEST_ASSERT_NOT_NULL(msg);
+    pattern((uint8_t*)msg_payload(msg), first, count);
+    msg->length = (uint16_t)count;
+    return msg;
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(usart_sim_regs, 0, sizeof(usart_sim_regs));
+    memset(dma_sim_regs, 0, sizeof(dma_sim_regs));
+    msg_pool_init(&rx_pool, rx_storage, PAYLOAD, MESSAGES);
+    msg_pool_init(&tx_pool, tx_storage, PAYLOAD, MESSAGES);
+    mailbox_init(&rx_output, NULL, NULL);
+
+    memset(&config, 0, sizeof(config));
+    config.baud_rate = 4000000;
+    config.clock_hz = 84000000;
+    config.rx_ring = ring;
+    config.rx_ring_size = RING_SIZE;
+    config.rx_msg_type = 0x55;
+    config.rx_pool = &rx_pool;
+    config.rx_output = &rx_output;
+    TEST_ASSERT_EQUAL(SUCCESS, usart_init(&port, 1, &config));
+}
+
+void tearDown(void)
+{
+    usart_deinit(&port);
+}
+
+void test_init_rejects_invalid_configurations(void)
+{
+    usart_t other;
+    usart_config_t bad = config;
+    TEST_ASSERT_EQUAL(FAILURE, usart_init(&other, 1, &config)); /* instance in use */
+    TEST_ASSERT_EQUAL(FAILURE, usart_init(&other, 7, &config));
+    bad.clock_hz = 42000000; /* 4 Mbaud from 42 MHz is off by 4.5% */
+    TEST_ASSERT_EQUAL(FAILURE, usart_init(&other, 2, &bad));
+    bad = config;
+    bad.rx_ring_size = 63;
+    TEST_ASSERT_EQUAL(FAILURE, usart_init(&other, 2, &bad));
+    bad = config;
+    bad.rx_pool = NULL;
+    TEST_ASSERT_EQUAL(FAILURE, usart_init(&other, 2, &bad));
+    bad = config;
+    bad.parity = 3;
+    TEST_ASSERT_EQUAL(FAILURE, usart_init(&other, 2, &bad));
+}
+
+void test_init_programs_usart_and_dma(void)
+{
+    usart_regs_t* regs = &usart_sim_regs[0];
+    TEST_ASSERT_EQUAL(21, regs->BRR); /* 84 MHz / 4 Mbaud, oversampling by 16 */
+    TEST_ASSERT_EQUAL_HEX32(USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE, regs->CR1);
+    TEST_ASSERT_EQUAL_HEX32(USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE, regs->CR3);
+    TEST_ASSERT_TRUE(hal_sim_rcc.APB2ENR & (1U << 4));
+    TEST_ASSERT_TRUE(hal_sim_nvic.ISER[1] & (1U << 5));
+
+    dma_stream_regs_t* rx = &dma_sim_regs[1].S[5];
+    TEST_ASSERT_EQUAL(RING_SIZE, rx->NDTR);
+    TEST_ASSERT_EQUAL_HEX32((uint32_t)(uintptr_t)&regs->DR, rx->PAR); /* truncated on 64-bit hosts */
+    TEST_ASSERT_EQUAL(4, rx->CR >> DMA_SxCR_CHSEL_Pos);
+    TEST_ASSERT_TRUE(rx->CR & DMA_SxCR_EN);
+    TEST_ASSERT_TRUE(rx->CR & DMA_SxCR_CIRC);
+    TEST_ASSERT_TRUE(rx->CR & DMA_SxCR_HTIE);
+    TEST_ASSERT_EQUAL(0, dma_sim_regs[1].S[7].CR & DMA_SxCR_EN);
+}
+
+void test_init_uses_oversampling_by_8_for_small_dividers(void)
+{
+    usart_t other;
+    usart_config_t fast = config;
+    uint8_t other_ring[16];
+    fast.baud_rate = 3000000;
+    fast.clock_hz = 42000000;
+    fast.parity = USART_PARITY_ODD;
+    fast.rx_ring = other_ring;
+    fast.rx_ring_size = sizeof(other_ring);
+    TEST_ASSERT_EQUAL(SUCCESS, usart_init(&other, 2, &fast));
+    /* Divider 14: mantissa 1, fraction 6/8 */
+    TEST_ASSERT_EQUAL_HEX32(0x16, usart_sim_regs[1].BRR);
+    TEST_ASSERT_TRUE(usart_sim_regs[1].CR1 & USART_CR1_OVER8);
+    TEST_ASSERT_TRUE(usart_sim_regs[1].CR1 & USART_CR1_PS);
+    TEST_ASSERT_TRUE(usart_sim_regs[1].CR1 & USART_CR1_M);
+    usart_deinit(&other);
+}
+
+void test_frames_are_split_at_idle_lines(void)
+{
+    receive_frame(0, 5);
+    receive_frame(100, 17);
+    receive_frame(200, 1);
+    expect_frame(0, 5);
+    expect_frame(100, 17);
+    expect_frame(200, 1);
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(3, usart_get_stats(&port)->rx_frames);
+    TEST_ASSERT_EQUAL(23, usart_get_stats(&port)->rx_bytes);
+    TEST_ASSERT_EQUAL(3, usart_get_stats(&port)->rx_interrupts);
+}
+
+void test_frames_wrap_around_the_ring(void)
+{
+    for (uint32_t frame = 0; frame < 10; frame++) {
+        receive_frame(frame * 50U, 29);
+        expect_frame(frame * 50U, 29);
+    }
+    /* One interrupt per frame, plus one per half-ring crossing */
+    const usart_stats_t* stats = usart_get_stats(&port);
+    TEST_ASSERT_EQUAL(10, stats->rx_frames);
+    TEST_ASSERT_EQUAL(10U + (10U * 29U) / (RING_SIZE / 2U), stats->rx_interrupts);
+    TEST_ASSERT_EQUAL(0, rx_pool.in_use);
+}
+
+void test_frame_longer_than_the_ring_is_drained_at_half_ring_crossings(void)
+{
+    receive_frame(0, 4U * RING_SIZE);
+    expect_frame(0, 4U * RING_SIZE);
+    receive_frame(1000, 3);
+    expect_frame(1000, 3);
+}
+
+void test_frame_larger_than_a_payload_is_dropped(void)
+{
+    receive_frame(0, PAYLOAD + 1U);
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(1, usart_get_stats(&port)->rx_oversize);
+    TEST_ASSERT_EQUAL(0, rx_pool.in_use);
+    receive_frame(7, PAYLOAD);
+    expect_frame(7, PAYLOAD);
+}
+
+void test_empty_pool_drops_frames_until_one_is_freed(void)
+{
+    for (uint32_t i = 0; i < MESSAGES; i++) {
+        receive_frame(i, 4);
+    }
+    receive_frame(99, 4);
+    TEST_ASSERT_EQUAL(1, usart_get_stats(&port)->rx_no_buffer);
+    for (uint32_t i = 0; i < MESSAGES; i++) {
+        expect_frame(i, 4);
+    }
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    receive_frame(50, 4);
+    expect_frame(50, 4);
+}
+
+void test_line_error_drops_the_frame(void)
+{
+    uint8_t data[8];
+    pattern(data, 0, sizeof(data));
+    usart_sim_receive(&port, data, 4);
+    usart_sim_line_error(&port, USART_SR_FE);
+    usart_sim_receive(&port, data + 4, 4);
+    usart_sim_idle(&port);
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(1, usart_get_stats(&port)->rx_line_errors);
+    TEST_ASSERT_EQUAL(0, usart_sim_regs[0].SR & USART_SR_ERRORS);
+
+    receive_frame(3, 9);
+    expect_frame(3, 9);
+}
+
+void test_rx_dma_error_restarts_the_ring(void)
+{
+    uint8_t data[10];
+    pattern(data, 0, sizeof(data));
+    usart_sim_receive(&port, data, sizeof(data));
+    dma_sim_regs[1].HISR = DMA_FLAG_TE << 6;
+    dma_sim_regs[1].S[5].CR &= ~DMA_SxCR_EN;
+    dma_stream_irq(2, 5);
+    dma_sim_regs[1].HISR = 0;
+    TEST_ASSERT_EQUAL(1, usart_get_stats(&port)->dma_errors);
+    TEST_ASSERT_TRUE(dma_sim_regs[1].S[5].CR & DMA_SxCR_EN);
+    TEST_ASSERT_EQUAL(RING_SIZE, dma_sim_regs[1].S[5].NDTR);
+
+    /* The interrupted frame is lost; the next one is whole */
+    usart_sim_idle(&port);
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    receive_frame(40, 12);
+    expect_frame(40, 12);
+}
+
+void test_transmit_sends_queued_messages_back_to_back(void)
+{
+    uint8_t out[128];
+    uint8_t expected[128];
+    TEST_ASSERT_EQUAL(SUCCESS, usart_send(&port, tx_message(0, 10)));
+    TEST_ASSERT_TRUE(usart_tx_busy(&port));
+    TEST_ASSERT_EQUAL(10, dma_sim_regs[1].S[7].NDTR);
+    TEST_ASSERT_EQUAL(SUCCESS, usart_send(&port, tx_message(10, 30)));
+    TEST_ASSERT_EQUAL(SUCCESS, usart_send(&port, tx_message(40, 1)));
+    TEST_ASSERT_EQUAL(3, tx_pool.in_use);
+
+    TEST_ASSERT_EQUAL(41, usart_sim_transmit(&port, out, sizeof(out)));
+    pattern(expected, 0, 41);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out, 41);
+    TEST_ASSERT_FALSE(usart_tx_busy(&port));
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(3, usart_get_stats(&port)->tx_messages);
+    TEST_ASSERT_EQUAL(41, usart_get_stats(&port)->tx_bytes);
+}
+
+void test_transmit_picks_up_messages_queued_mid_transfer(void)
+{
+    uint8_t out[64];
+    uint8_t expected[64];
+    usart_send(&port, tx_message(0, 20));
+    TEST_ASSERT_EQUAL(8, usart_sim_transmit(&port, out, 8));
+    usart_send(&port, tx_message(20, 20));
+    msg_t* empty = tx_message(0, 0);
+    usart_send(&port, empty);
+    usart_send(&port, tx_message(40, 5));
+    TEST_ASSERT_EQUAL(37, usart_sim_transmit(&port, out + 8, sizeof(out) - 8U));
+    pattern(expected, 0, 45);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out, 45);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(FAILURE, usart_send(&port, NULL));
+}
+
+void test_deinit_returns_messages_and_frees_the_instance(void)
+{
+    uint8_t data[6] = { 1, 2, 3, 4, 5, 6 };
+    usart_send(&port, tx_message(0, 20));
+    usart_send(&port, tx_message(0, 20));
+    usart_sim_receive(&port, data, sizeof(data));
+    usart_sim_idle(&port);
+    usart_sim_receive(&port, data, 3); /* frame in progress stays in the ring */
+    usart_deinit(&port);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(1, rx_pool.in_use); /* the posted frame still belongs to the consumer */
+    TEST_ASSERT_EQUAL(0, usart_sim_regs[0].CR1);
+    TEST_ASSERT_EQUAL(0, usart_sim_receive(&port, data, 1));
+
+    TEST_ASSERT_EQUAL(SUCCESS, usart_init(&port, 1, &config));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_programs_usart_and_dma);
+    RUN_TEST(test_init_uses_oversampling_by_8_for_small_dividers);
+    RUN_TEST(test_frames_are_split_at_idle_lines);
+    RUN_TEST(test_frames_wrap_around_the_ring);
+    RUN_TEST(test_frame_longer_than_the_ring_is_drained_at_half_ring_crossings);
+    RUN_TEST(test_frame_larger_than_a_payload_is_dropped);
+    RUN_TEST(test_empty_pool_drops_frames_until_one_is_freed);
+    RUN_TEST(test_line_error_drops_the_frame);
+    RUN_TEST(test_rx_dma_error_restarts_the_ring);
+    RUN_TEST(test_transmit_sends_queued_messages_back_to_back);
+    RUN_TEST(test_transmit_picks_up_messages_queued_mid_transfer);
+    RUN_TEST(test_deinit_returns_messages_and_frees_the_instance);
+    return UNITY_END();
+}
@@ -0,0 +1,669 @@
+#include "../lib/Unity/src/unity.h"
+#include "../lib/usb/usb_cdc.h"
+#include <stddef.h>
+#include <string.h>
+
+#define RX_PAYLOAD 128U
+#define RX_BUFFERS 4U
+#define TX_PAYLOAD 256U
+#define TX_BUFFERS 8U
+
+static MSG_POOL_STORAGE(rx_storage, RX_PAYLOAD, RX_BUFFERS);
+static MSG_POOL_STORAGE(tx_storage, TX_PAYLOAD, TX_BUFFERS);
+static msg_pool_t rx_pool;
+static msg_pool_t tx_pool;
+static mailbox_t rx_output;
+static usb_cdc_config_t config;
+static usb_cdc_t cdc;
+
+static const char manufacturer[] = "Acme Instruments";
+static const char product[] = "Telemetry Port";
+static const char serial[] = "0123456789ABCDEF0123456789ABCDE"; /* 31 characters: a 64-byte descriptor */
+
+static uint8_t nvic_enabled(uint32_t irqn)
+{
+    for (int32_t i = hal_reg_trace_find(&hal_sim_nvic.ISER[irqn >> 5], 0); i >= 0;
+         i = hal_reg_trace_find(&hal_sim_nvic.ISER[irqn >> 5], (uint32_t)i + 1U)) {
+        if (hal_reg_trace[i].value & (1U << (irqn & 31U))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void setUp(void)
+{
+    memset(&hal_sim_rcc, 0, sizeof(hal_sim_rcc));
+    memset(&usb_sim_regs, 0, sizeof(usb_sim_regs));
+    hal_reg_trace_reset();
+    msg_pool_init(&rx_pool, rx_storage, RX_PAYLOAD, RX_BUFFERS);
+    msg_pool_init(&tx_pool, tx_storage, TX_PAYLOAD, TX_BUFFERS);
+    mailbox_init(&rx_output, NULL, NULL);
+
+    memset(&config, 0, sizeof(config));
+    config.vendor_id = 0x0483;
+    config.product_id = 0x5740;
+    config.manufacturer = manufacturer;
+    config.product = product;
+    config.serial = serial;
+    config.rx_pool = &rx_pool;
+    config.rx_output = &rx_output;
+}
+
+void tearDown(void)
+{
+    usb_cdc_deinit(&cdc);
+}
+
+/* ------------------------------------------------------------ helpers --- */
+
+static int32_t control(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, uint8_t* data)
+{
+    usb_setup_t setup = { type, request, value, index, length };
+    return usb_sim_control(&cdc.usb, &setup, data);
+}
+
+static int32_t get_descriptor(uint8_t type, uint8_t index, uint16_t length, uint8_t* data)
+{
+    uint16_t language = (type == USB_DESC_STRING && index != 0U) ? 0x0409U : 0U;
+    return control(USB_REQTYPE_DIR_IN, USB_REQ_GET_DESCRIPTOR, (uint16_t)((type << 8) | index), language, length,
+                   data);
+}
+
+static int32_t class_request(uint8_t request, uint16_t value, uint16_t length, uint8_t* data)
+{
+    uint8_t direction = (request == USB_CDC_GET_LINE_CODING) ? USB_REQTYPE_DIR_IN : 0U;
+    return control(direction | USB_REQTYPE_CLASS | USB_RECIPIENT_INTERFACE, request, value, USB_CDC_COMM_INTERFACE,
+                   length, data);
+}
+
+static void start(void)
+{
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_init(&cdc, &config));
+}
+
+/* Reset, address and configure, as a host does once it has read the descriptors */
+static void enumerate(void)
+{
+    start();
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_ADDRESS, 9, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(1, cdc.usb.configuration);
+}
+
+static msg_t* message(const uint8_t* data, uint16_t length)
+{
+    msg_t* msg = msg_alloc(&tx_pool);
+    if (msg == NULL) {
+        TEST_FAIL_MESSAGE("transmit pool exhausted");
+        return NULL;
+    }
+    memcpy(msg_payload(msg), data, length);
+    msg->length = length;
+    return msg;
+}
+
+static void pattern(uint8_t* data, uint32_t length, uint8_t seed)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)(seed + i * 7U);
+    }
+}
+
+/* Reads one IN transfer on the data endpoint, up to and including its short or zero-length packet */
+static int32_t read_transfer(uint8_t* out, uint32_t max)
+{
+    uint32_t total = 0;
+    for (;;) {
+        int32_t got = usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, out + total, max - total);
+        if (got < 0) {
+            return got;
+        }
+        total += (uint32_t)got;
+        if ((uint32_t)got < USB_CDC_PACKET) {
+            return (int32_t)total;
+        }
+    }
+}
+
+/* -------------------------------------------------------------- tests --- */
+
+static void test_register_layout(void)
+{
+    TEST_ASSERT_EQUAL_HEX32(0x038, offsetof(usb_regs_t, GCCFG));
+    TEST_ASSERT_EQUAL_HEX32(0x104, offsetof(usb_regs_t, DIEPTXF));
+    TEST_ASSERT_EQUAL_HEX32(0x800, offsetof(usb_regs_t, DCFG));
+    TEST_ASSERT_EQUAL_HEX32(0x834, offsetof(usb_regs_t, DIEPEMPMSK));
+    TEST_ASSERT_EQUAL_HEX32(0x900, offsetof(usb_regs_t, IN));
+    TEST_ASSERT_EQUAL_HEX32(0x938, offsetof(usb_regs_t, IN[1].DTXFSTS));
+    TEST_ASSERT_EQUAL_HEX32(0xB00, offsetof(usb_regs_t, OUT));
+    TEST_ASSERT_EQUAL_HEX32(0xB30, offsetof(usb_regs_t, OUT[1].DOEPTSIZ));
+    TEST_ASSERT_EQUAL_HEX32(0xE00, offsetof(usb_regs_t, PCGCCTL));
+    TEST_ASSERT_EQUAL_HEX32(0x2000, offsetof(usb_regs_t, FIFO[1]));
+    TEST_ASSERT_EQUAL(8, sizeof(usb_setup_t));
+}
+
+static void test_init_rejects_invalid_configurations(void)
+{
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_init(NULL, &config));
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_init(&cdc, NULL));
+
+    usb_cdc_config_t bad = config;
+    bad.rx_pool = NULL;
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_init(&cdc, &bad));
+    bad = config;
+    bad.rx_output = NULL;
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_init(&cdc, &bad));
+
+    static MSG_POOL_STORAGE(small_storage, 32, 2);
+    msg_pool_t small;
+    msg_pool_init(&small, small_storage, 32, 2);
+    bad = config;
+    bad.rx_pool = &small;
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_init(&cdc, &bad));
+
+    start();
+    usb_cdc_t other;
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_init(&other, &config));
+}
+
+static void test_init_resets_core_and_splits_fifos(void)
+{
+    start();
+    const usb_regs_t* regs = &usb_sim_regs;
+    TEST_ASSERT_TRUE(hal_reg_trace_find(&usb_sim_regs.GRSTCTL, 0) >= 0);
+    TEST_ASSERT_TRUE(hal_sim_rcc.AHB2ENR & (1U << 7));
+    TEST_ASSERT_TRUE(nvic_enabled(67));
+    TEST_ASSERT_TRUE(usb_sim_attached());
+    TEST_ASSERT_TRUE(regs->GUSBCFG & USB_GUSBCFG_FDMOD);
+    TEST_ASSERT_EQUAL_HEX32(USB_GCCFG_PWRDWN | USB_GCCFG_NOVBUSSENS, regs->GCCFG);
+    TEST_ASSERT_EQUAL_HEX32(USB_DCFG_DSPD_FS, regs->DCFG & 3U);
+    TEST_ASSERT_EQUAL_HEX32(USB_GAHBCFG_GINT, regs->GAHBCFG);
+
+    /* The FIFOs tile the packet RAM from the bottom without overlap */
+    uint32_t end = regs->GRXFSIZ & 0xFFFFU;
+    uint32_t sizes[USB_EP_COUNT] = { regs->DIEPTXF0, regs->DIEPTXF[0], regs->DIEPTXF[1], regs->DIEPTXF[2] };
+    for (uint32_t n = 0; n < USB_EP_COUNT; n++) {
+        TEST_ASSERT_EQUAL(end, sizes[n] & 0xFFFFU);
+        TEST_ASSERT_TRUE((sizes[n] >> 16) >= USB_TX_FIFO_MIN_WORDS);
+        end += sizes[n] >> 16;
+    }
+    TEST_ASSERT_TRUE(end <= USB_FIFO_WORDS);
+    /* Endpoint 1 IN holds two full packets */
+    TEST_ASSERT_EQUAL(2U * USB_CDC_PACKET / 4U, regs->DIEPTXF[0] >> 16);
+
+    usb_cdc_deinit(&cdc);
+    TEST_ASSERT_FALSE(usb_sim_attached());
+    config.vbus_sensing = 1;
+    start();
+    TEST_ASSERT_EQUAL_HEX32(USB_GCCFG_PWRDWN | USB_GCCFG_VBUSBSEN, regs->GCCFG);
+}
+
+static void test_enumeration_conformance(void)
+{
+    start();
+    uint8_t data[256];
+
+    /* Windows asks for 64 bytes of the device descriptor at address 0, then resets again */
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(18, get_descriptor(USB_DESC_DEVICE, 0, 64, data));
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_ADDRESS, 42, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(42, (usb_sim_regs.DCFG & USB_DCFG_DAD_Msk) >> USB_DCFG_DAD_Pos);
+
+    /* Device descriptor */
+    TEST_ASSERT_EQUAL(18, get_descriptor(USB_DESC_DEVICE, 0, 18, data));
+    TEST_ASSERT_EQUAL(18, data[0]);
+    TEST_ASSERT_EQUAL(USB_DESC_DEVICE, data[1]);
+    TEST_ASSERT_EQUAL_HEX16(0x0200, data[2] | (data[3] << 8));
+    TEST_ASSERT_EQUAL(0x02, data[4]);
+    TEST_ASSERT_EQUAL(USB_EP0_SIZE, data[7]);
+    TEST_ASSERT_EQUAL_HEX16(0x0483, data[8] | (data[9] << 8));
+    TEST_ASSERT_EQUAL_HEX16(0x5740, data[10] | (data[11] << 8));
+    TEST_ASSERT_EQUAL(1, data[17]);
+    uint8_t strings[3] = { data[14], data[15], data[16] };
+
+    /* Configuration: the 9-byte header first for the total length, then all of it */
+    TEST_ASSERT_EQUAL(9, get_descriptor(USB_DESC_CONFIGURATION, 0, 9, data));
+    uint16_t total = (uint16_t)(data[2] | (data[3] << 8));
+    TEST_ASSERT_EQUAL(total, get_descriptor(USB_DESC_CONFIGURATION, 0, 255, data));
+    TEST_ASSERT_EQUAL(USB_DESC_CONFIGURATION, data[1]);
+    TEST_ASSERT_EQUAL(1, data[5]);
+    TEST_ASSERT_TRUE(data[7] & 0x80U);
+
+    /* Walk it: lengths add up, interfaces and endpoints match their counts, endpoints are sane */
+    uint32_t interfaces = 0;
+    uint32_t endpoints_expected = 0;
+    uint32_t endpoints_seen = 0;
+    uint8_t addresses[8];
+    uint32_t address_count = 0;
+    uint8_t header_seen = 0;
+    uint8_t union_seen = 0;
+    int32_t current_interface = -1;
+    uint32_t offset = data[0];
+    while (offset < total) {
+        const uint8_t* d = data + offset;
+        TEST_ASSERT_TRUE(d[0] >= 2U);
+        TEST_ASSERT_TRUE(offset + d[0] <= total);
+        if (d[1] == USB_DESC_INTERFACE) {
+            TEST_ASSERT_EQUAL(endpoints_expected, endpoints_seen);
+            TEST_ASSERT_EQUAL(9, d[0]);
+            TEST_ASSERT_EQUAL(interfaces, d[2]);
+            current_interface = d[2];
+            interfaces++;
+            endpoints_expected = d[4];
+            endpoints_seen = 0;
+        } else if (d[1] == USB_DESC_ENDPOINT) {
+            TEST_ASSERT_EQUAL(7, d[0]);
+            uint16_t max_packet = (uint16_t)(d[4] | (d[5] << 8));
+            uint8_t type = d[3] & 3U;
+            TEST_ASSERT_TRUE(type == USB_EP_BULK || type == USB_EP_INTERRUPT);
+            if (type == USB_EP_BULK) {
+                TEST_ASSERT_TRUE(max_packet == 8 || max_packet == 16 || max_packet == 32 || max_packet == 64);
+            } else {
+                TEST_ASSERT_TRUE(max_packet >= 1 && max_packet <= 64);
+                TEST_ASSERT_TRUE(d[6] >= 1);
+            }
+            TEST_ASSERT_TRUE((d[2] & 0x7FU) >= 1 && (d[2] & 0x7FU) < USB_EP_COUNT);
+            for (uint32_t i = 0; i < address_count; i++) {
+                TEST_ASSERT_TRUE(addresses[i] != d[2]);
+            }
+            addresses[address_count++] = d[2];
+            endpoints_seen++;
+        } else if (d[1] == USB_DESC_CS_INTERFACE) {
+            TEST_ASSERT_EQUAL(USB_CDC_COMM_INTERFACE, current_interface);
+            if (d[2] == 0x00) {
+                TEST_ASSERT_EQUAL_HEX16(0x0110, d[3] | (d[4] << 8));
+                header_seen = 1;
+            } else {
+                TEST_ASSERT_TRUE(header_seen);
+            }
+            if (d[2] == 0x06) {
+                TEST_ASSERT_EQUAL(USB_CDC_COMM_INTERFACE, d[3]);
+                TEST_ASSERT_EQUAL(USB_CDC_DATA_INTERFACE, d[4]);
+                union_seen = 1;
+            }
+        }
+        offset += d[0];
+    }
+    TEST_ASSERT_EQUAL(3, address_count);
+    TEST_ASSERT_EQUAL(total, offset);
+    TEST_ASSERT_EQUAL(endpoints_expected, endpoints_seen);
+    TEST_ASSERT_EQUAL(data[4], interfaces);
+    TEST_ASSERT_TRUE(union_seen);
+
+    /* Strings: US English, then UTF-16LE of the configured text */
+    TEST_ASSERT_EQUAL(4, get_descriptor(USB_DESC_STRING, 0, 255, data));
+    TEST_ASSERT_EQUAL_HEX16(0x0409, data[2] | (data[3] << 8));
+    const char* texts[3] = { manufacturer, product, serial };
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(strings[i] != 0U);
+        int32_t length = get_descriptor(USB_DESC_STRING, strings[i], 255, data);
+        TEST_ASSERT_EQUAL(2 + 2 * strlen(texts[i]), length);
+        TEST_ASSERT_EQUAL(length, data[0]);
+        TEST_ASSERT_EQUAL(USB_DESC_STRING, data[1]);
+        for (uint32_t c = 0; c < strlen(texts[i]); c++) {
+            TEST_ASSERT_EQUAL(texts[i][c], data[2 + 2 * c]);
+            TEST_ASSERT_EQUAL(0, data[3 + 2 * c]);
+        }
+    }
+
+    /* A full-speed-only device refuses the device qualifier */
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, get_descriptor(USB_DESC_DEVICE_QUALIFIER, 0, 10, data));
+
+    TEST_ASSERT_EQUAL(1, control(USB_REQTYPE_DIR_IN, USB_REQ_GET_CONFIGURATION, 0, 0, 1, data));
+    TEST_ASSERT_EQUAL(0, data[0]);
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(1, control(USB_REQTYPE_DIR_IN, USB_REQ_GET_CONFIGURATION, 0, 0, 1, data));
+    TEST_ASSERT_EQUAL(1, data[0]);
+    TEST_ASSERT_EQUAL(2, control(USB_REQTYPE_DIR_IN, USB_REQ_GET_STATUS, 0, 0, 2, data));
+    TEST_ASSERT_EQUAL(0, data[0] | data[1]);
+    TEST_ASSERT_EQUAL(1, control(USB_REQTYPE_DIR_IN | USB_RECIPIENT_INTERFACE, USB_REQ_GET_INTERFACE, 0, 1, 1, data));
+    TEST_ASSERT_EQUAL(0, data[0]);
+
+    /* The endpoints the descriptor promises are the ones the device opened */
+    TEST_ASSERT_TRUE(usb_sim_regs.IN[1].DIEPCTL & USB_EPCTL_USBAEP);
+    TEST_ASSERT_TRUE(usb_sim_regs.IN[2].DIEPCTL & USB_EPCTL_USBAEP);
+    TEST_ASSERT_TRUE(usb_sim_regs.OUT[1].DOEPCTL & USB_EPCTL_USBAEP);
+    TEST_ASSERT_FALSE(usb_sim_regs.OUT[2].DOEPCTL & USB_EPCTL_USBAEP);
+    TEST_ASSERT_EQUAL(USB_CDC_PACKET, usb_sim_regs.IN[1].DIEPCTL & USB_EPCTL_MPSIZ_Msk);
+}
+
+static void test_descriptor_reads_are_truncated_or_ended_with_a_zlp(void)
+{
+    start();
+    usb_sim_reset(&cdc.usb);
+    uint8_t data[256];
+
+    TEST_ASSERT_EQUAL(64, get_descriptor(USB_DESC_CONFIGURATION, 0, 64, data));
+    TEST_ASSERT_EQUAL(8, get_descriptor(USB_DESC_DEVICE, 0, 8, data));
+    TEST_ASSERT_EQUAL(18, data[0]);
+
+    /* The 64-byte serial string asked for with room to spare ends with a zero-length packet */
+    TEST_ASSERT_EQUAL(64, get_descriptor(USB_DESC_STRING, 3, 255, data));
+    TEST_ASSERT_EQUAL(64, data[0]);
+
+    /* Without strings the indices are 0 and the descriptors are refused */
+    usb_cdc_deinit(&cdc);
+    config.manufacturer = NULL;
+    config.product = NULL;
+    config.serial = NULL;
+    start();
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(18, get_descriptor(USB_DESC_DEVICE, 0, 18, data));
+    TEST_ASSERT_EQUAL(0, data[14] | data[15] | data[16]);
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, get_descriptor(USB_DESC_STRING, 1, 255, data));
+}
+
+static void test_unsupported_requests_stall_and_recover(void)
+{
+    start();
+    usb_sim_reset(&cdc.usb);
+    uint8_t data[64];
+
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, control(0, 0x42, 0, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, control(USB_REQTYPE_DIR_IN | USB_REQTYPE_VENDOR, 1, 0, 0, 4, data));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, control(0, USB_REQ_SET_CONFIGURATION, 2, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, get_descriptor(USB_DESC_CONFIGURATION, 1, 9, data));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, get_descriptor(USB_DESC_STRING, 7, 255, data));
+    /* Interface requests before configuration, and class requests to the wrong interface */
+    TEST_ASSERT_EQUAL(USB_SIM_STALL,
+                      control(USB_REQTYPE_DIR_IN | USB_RECIPIENT_INTERFACE, USB_REQ_GET_INTERFACE, 0, 0, 1, data));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, control(USB_REQTYPE_CLASS | USB_RECIPIENT_INTERFACE,
+                                             USB_CDC_SET_CONTROL_LINE_STATE, 1, USB_CDC_DATA_INTERFACE, 0, NULL));
+    TEST_ASSERT_EQUAL(7, usb_get_stats(&cdc.usb)->stalls);
+
+    /* The next SETUP clears the stall */
+    TEST_ASSERT_EQUAL(18, get_descriptor(USB_DESC_DEVICE, 0, 18, data));
+}
+
+static void test_line_coding_and_control_lines(void)
+{
+    enumerate();
+    uint8_t data[7];
+    TEST_ASSERT_EQUAL(7, class_request(USB_CDC_GET_LINE_CODING, 0, 7, data));
+    TEST_ASSERT_EQUAL(115200, data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24));
+    TEST_ASSERT_EQUAL(8, data[6]);
+
+    const uint8_t coding[7] = { 0x80, 0x25, 0x00, 0x00, 2, 2, 7 }; /* 9600 7E2 */
+    memcpy(data, coding, sizeof(coding));
+    TEST_ASSERT_EQUAL(7, class_request(USB_CDC_SET_LINE_CODING, 0, 7, data));
+    const usb_cdc_line_coding_t* line = usb_cdc_get_line_coding(&cdc);
+    TEST_ASSERT_EQUAL(9600, line->baud);
+    TEST_ASSERT_EQUAL(2, line->stop_bits);
+    TEST_ASSERT_EQUAL(2, line->parity);
+    TEST_ASSERT_EQUAL(7, line->data_bits);
+    memset(data, 0, sizeof(data));
+    TEST_ASSERT_EQUAL(7, class_request(USB_CDC_GET_LINE_CODING, 0, 7, data));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(coding, data, 7);
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, class_request(USB_CDC_SET_LINE_CODING, 0, 5, data));
+
+    TEST_ASSERT_FALSE(usb_cdc_connected(&cdc));
+    TEST_ASSERT_EQUAL(0, class_request(USB_CDC_SET_CONTROL_LINE_STATE, USB_CDC_DTR | USB_CDC_RTS, 0, NULL));
+    TEST_ASSERT_TRUE(usb_cdc_connected(&cdc));
+    TEST_ASSERT_EQUAL(0, class_request(USB_CDC_SEND_BREAK, 0xFFFF, 0, NULL));
+    TEST_ASSERT_EQUAL(0, class_request(USB_CDC_SET_CONTROL_LINE_STATE, 0, 0, NULL));
+    TEST_ASSERT_FALSE(usb_cdc_connected(&cdc));
+}
+
+static void test_out_packets_land_in_pool_messages(void)
+{
+    enumerate();
+    uint8_t data[138];
+    pattern(data, sizeof(data), 3);
+
+    /* A short packet ends the transfer: 64 + 10 bytes in one message */
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 64));
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data + 64, 10));
+    msg_t* msg = mailbox_fetch(&rx_output);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL_PTR(&rx_pool, msg->pool);
+    TEST_ASSERT_EQUAL(74, msg->length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, msg_payload(msg), 74);
+    msg_free(msg);
+
+    /* Two full packets fill a 128-byte message; the next is already armed for the rest */
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 64));
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data + 64, 64));
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data + 128, 10));
+    msg = mailbox_fetch(&rx_output);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL(128, msg->length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, msg_payload(msg), 128);
+    msg_free(msg);
+    msg = mailbox_fetch(&rx_output);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL(10, msg->length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 128, msg_payload(msg), 10);
+    msg_free(msg);
+
+    /* A zero-length packet posts nothing */
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, NULL, 0));
+    TEST_ASSERT_NULL(mailbox_fetch(&rx_output));
+
+    const usb_cdc_stats_t* stats = usb_cdc_get_stats(&cdc);
+    TEST_ASSERT_EQUAL(3, stats->rx_messages);
+    TEST_ASSERT_EQUAL(212, stats->rx_bytes);
+    TEST_ASSERT_EQUAL(0, usb_get_stats(&cdc.usb)->rx_overruns);
+}
+
+static void test_empty_pool_naks_until_a_message_is_free(void)
+{
+    enumerate();
+    uint8_t data[64];
+    pattern(data, sizeof(data), 9);
+
+    /* Every message of the pool gets filled and posted; nothing is left to arm with */
+    for (uint32_t i = 0; i < RX_BUFFERS; i++) {
+        TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 20));
+    }
+    TEST_ASSERT_EQUAL(1, usb_cdc_get_stats(&cdc)->rx_starved);
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 20));
+    TEST_ASSERT_TRUE(usb_sim_regs.GINTMSK & USB_GINTSTS_SOF);
+    usb_sim_sof(&cdc.usb);
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 20));
+
+    /* Once the application frees one, the next frame re-arms the endpoint and the host's retry gets in */
+    msg_free(mailbox_fetch(&rx_output));
+    usb_sim_sof(&cdc.usb);
+    TEST_ASSERT_FALSE(usb_sim_regs.GINTMSK & USB_GINTSTS_SOF);
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 20));
+    uint32_t count = 0;
+    for (msg_t* msg = mailbox_fetch(&rx_output); msg != NULL; msg = mailbox_fetch(&rx_output)) {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data, msg_payload(msg), 20);
+        msg_free(msg);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(RX_BUFFERS, count);
+    /* That message was the last free one too, so the endpoint waits again */
+    TEST_ASSERT_EQUAL(2, usb_cdc_get_stats(&cdc)->rx_starved);
+}
+
+static void test_send_goes_out_in_packets_from_the_payload(void)
+{
+    uint8_t data[150];
+    pattern(data, sizeof(data), 1);
+    msg_t* early = message(data, 10);
+    start();
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_send(&cdc, early));
+    msg_free(early);
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL));
+
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, sizeof(data))));
+
+    /* Two packets fit in the FIFO at once; the third follows from the FIFO-empty interrupt */
+    TEST_ASSERT_EQUAL(2, usb_get_stats(&cdc.usb)->tx_packets);
+    uint8_t out[256];
+    TEST_ASSERT_EQUAL(150, read_transfer(out, sizeof(out)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, 150);
+    TEST_ASSERT_EQUAL(3, usb_get_stats(&cdc.usb)->tx_packets);
+    TEST_ASSERT_TRUE(usb_get_stats(&cdc.usb)->tx_refills >= 1);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, out, sizeof(out)));
+
+    const usb_cdc_stats_t* stats = usb_cdc_get_stats(&cdc);
+    TEST_ASSERT_EQUAL(1, stats->tx_messages);
+    TEST_ASSERT_EQUAL(150, stats->tx_bytes);
+    TEST_ASSERT_EQUAL(0, stats->tx_zlps);
+}
+
+static void test_whole_packet_messages_end_with_a_zlp_and_keep_order(void)
+{
+    enumerate();
+    uint8_t data[TX_PAYLOAD];
+    uint8_t out[TX_PAYLOAD];
+    static const uint16_t lengths[4] = { 128, 1, 64, 200 };
+    for (uint32_t i = 0; i < 4; i++) {
+        pattern(data, lengths[i], (uint8_t)(i * 40U));
+        TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, lengths[i])));
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        pattern(data, lengths[i], (uint8_t)(i * 40U));
+        TEST_ASSERT_EQUAL(lengths[i], read_transfer(out, sizeof(out)));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, lengths[i]);
+    }
+    TEST_ASSERT_EQUAL(2, usb_cdc_get_stats(&cdc)->tx_zlps);
+    TEST_ASSERT_EQUAL(4, usb_cdc_get_stats(&cdc)->tx_messages);
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+
+    /* Empty messages are dropped rather than sent as a bare zero-length packet */
+    msg_t* empty = msg_alloc(&tx_pool);
+    empty->length = 0;
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, empty));
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, out, sizeof(out)));
+}
+
+static void test_endpoint_halt(void)
+{
+    enumerate();
+    uint8_t data[64] = { 0 };
+    uint8_t status[2];
+
+    TEST_ASSERT_EQUAL(0, control(USB_RECIPIENT_ENDPOINT, USB_REQ_SET_FEATURE, USB_FEATURE_ENDPOINT_HALT,
+                                 USB_CDC_DATA_IN, 0, NULL));
+    TEST_ASSERT_EQUAL(2, control(USB_REQTYPE_DIR_IN | USB_RECIPIENT_ENDPOINT, USB_REQ_GET_STATUS, 0,
+                                 USB_CDC_DATA_IN, 2, status));
+    TEST_ASSERT_EQUAL(1, status[0]);
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, 5)));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, data, sizeof(data)));
+
+    TEST_ASSERT_EQUAL(0, control(USB_RECIPIENT_ENDPOINT, USB_REQ_CLEAR_FEATURE, USB_FEATURE_ENDPOINT_HALT,
+                                 USB_CDC_DATA_IN, 0, NULL));
+    TEST_ASSERT_EQUAL(2, control(USB_REQTYPE_DIR_IN | USB_RECIPIENT_ENDPOINT, USB_REQ_GET_STATUS, 0,
+                                 USB_CDC_DATA_IN, 2, status));
+    TEST_ASSERT_EQUAL(0, status[0]);
+    TEST_ASSERT_EQUAL(5, usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, data, sizeof(data)));
+
+    /* Halting the OUT endpoint, and endpoints that do not exist */
+    TEST_ASSERT_EQUAL(0, control(USB_RECIPIENT_ENDPOINT, USB_REQ_SET_FEATURE, USB_FEATURE_ENDPOINT_HALT,
+                                 USB_CDC_DATA_OUT, 0, NULL));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 4));
+    TEST_ASSERT_EQUAL(0, control(USB_RECIPIENT_ENDPOINT, USB_REQ_CLEAR_FEATURE, USB_FEATURE_ENDPOINT_HALT,
+                                 USB_CDC_DATA_OUT, 0, NULL));
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 4));
+    TEST_ASSERT_EQUAL(USB_SIM_STALL, control(USB_RECIPIENT_ENDPOINT, USB_REQ_SET_FEATURE,
+                                             USB_FEATURE_ENDPOINT_HALT, 0x83, 0, NULL));
+}
+
+static void test_serial_state_notification(void)
+{
+    start();
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_serial_state(&cdc, USB_CDC_STATE_DCD));
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL));
+
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_serial_state(&cdc, USB_CDC_STATE_DCD | USB_CDC_STATE_DSR));
+    TEST_ASSERT_EQUAL(FAILURE, usb_cdc_serial_state(&cdc, 0));
+    uint8_t data[16];
+    TEST_ASSERT_EQUAL(10, usb_sim_in(&cdc.usb, USB_CDC_NOTIFY_IN, data, sizeof(data)));
+    static const uint8_t expected[10] = { 0xA1, 0x20, 0, 0, 0, 0, 2, 0, 0x03, 0x00 };
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, data, 10);
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_serial_state(&cdc, 0));
+}
+
+static void test_bus_reset_returns_messages_and_deconfigures(void)
+{
+    enumerate();
+    uint8_t data[128] = { 0 };
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, 100)));
+    }
+    TEST_ASSERT_EQUAL(0, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 64));
+    TEST_ASSERT_EQUAL(1, rx_pool.in_use);
+
+    usb_sim_reset(&cdc.usb);
+    TEST_ASSERT_EQUAL(0, cdc.usb.configuration);
+    TEST_ASSERT_EQUAL(0, (usb_sim_regs.DCFG & USB_DCFG_DAD_Msk));
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(0, rx_pool.in_use);
+    TEST_ASSERT_EQUAL(3, usb_cdc_get_stats(&cdc)->tx_dropped);
+    TEST_ASSERT_FALSE(usb_sim_regs.IN[1].DIEPCTL & USB_EPCTL_USBAEP);
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_out(&cdc.usb, USB_CDC_DATA_OUT, data, 64));
+    TEST_ASSERT_EQUAL(2, usb_get_stats(&cdc.usb)->resets);
+
+    /* And it enumerates again */
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_CONFIGURATION, 1, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, 7)));
+    TEST_ASSERT_EQUAL(7, usb_sim_in(&cdc.usb, USB_CDC_DATA_IN, data, sizeof(data)));
+}
+
+static void test_suspend_and_resume(void)
+{
+    enumerate();
+    usb_sim_suspend(&cdc.usb);
+    TEST_ASSERT_TRUE(cdc.usb.suspended);
+    TEST_ASSERT_EQUAL(1, usb_get_stats(&cdc.usb)->suspends);
+    usb_sim_resume(&cdc.usb);
+    TEST_ASSERT_FALSE(cdc.usb.suspended);
+    TEST_ASSERT_EQUAL(1, cdc.usb.configuration);
+
+    /* Remote wakeup is the host's to enable, and shows in the device status */
+    uint8_t status[2];
+    TEST_ASSERT_EQUAL(0, control(0, USB_REQ_SET_FEATURE, USB_FEATURE_REMOTE_WAKEUP, 0, 0, NULL));
+    TEST_ASSERT_EQUAL(2, control(USB_REQTYPE_DIR_IN, USB_REQ_GET_STATUS, 0, 0, 2, status));
+    TEST_ASSERT_EQUAL(2, status[0]);
+}
+
+static void test_deinit_detaches_and_returns_messages(void)
+{
+    enumerate();
+    uint8_t data[128] = { 0 };
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, 100)));
+    TEST_ASSERT_EQUAL(SUCCESS, usb_cdc_send(&cdc, message(data, 100)));
+    usb_cdc_deinit(&cdc);
+    TEST_ASSERT_FALSE(usb_sim_attached());
+    TEST_ASSERT_FALSE(hal_sim_rcc.AHB2ENR & (1U << 7));
+    TEST_ASSERT_EQUAL(0, tx_pool.in_use);
+    TEST_ASSERT_EQUAL(0, rx_pool.in_use);
+    TEST_ASSERT_EQUAL(USB_SIM_NAK, usb_sim_setup(&cdc.usb, &(usb_setup_t){ 0x80, 6, 0x0100, 0, 18 }));
+
+    /* The driver is free for the next user */
+    start();
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_register_layout);
+    RUN_TEST(test_init_rejects_invalid_configurations);
+    RUN_TEST(test_init_resets_core_and_splits_fifos);
+    RUN_TEST(test_enumeration_conformance);
+    RUN_TEST(test_descriptor_reads_are_truncated_or_ended_with_a_zlp);
+    RUN_TEST(test_unsupported_requests_stall_and_recover);
+    RUN_TEST(test_line_coding_and_control_lines);
+    RUN_TEST(test_out_packets_land_in_pool_messages);
+    RUN_TEST(test_empty_pool_naks_until_a_message_is_free);
+    RUN_TEST(test_send_goes_out_in_packets_from_the_payload);
+    RUN_TEST(test_whole_packet_messages_end_with_a_zlp_and_keep_order);
+    RUN_TEST(test_endpoint_halt);
+    RUN_TEST(test_serial_state_notification);
+    RUN_TEST(test_bus_reset_returns_messages_and_deconfigures);
+    RUN_TEST(test_suspend_and_resume);
+    RUN_TEST(test_deinit_detaches_and_returns_messages);
+    return UNITY_END();
+}